@@ -36,6 +36,7 @@ LOCAL_SRC_FILES:= \
 	camera2/CaptureRequest.cpp \
 	camera2/OutputConfiguration.cpp \
 	CameraBase.cpp \
+	CameraFrameTrace.cpp \
 	CameraUtils.cpp \
 	VendorTagDescriptor.cpp
 
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraFrameTrace"
+//#define LOG_NDEBUG 0
+
+#include <camera/CameraFrameTrace.h>
+
+#include <cutils/atomic.h>
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace android {
+
+namespace {
+
+/**
+ * One stamp. tag is the ring index + 1 of the stamp that last completed
+ * writing the slot, 0 while a writer owns it. Readers copy the fields and
+ * only keep the copy if tag was the expected value before and after.
+ */
+struct TraceSlot {
+    int64_t timestamp;
+    uint32_t frameNumber;
+    uint32_t aux;
+    uint16_t stage;
+    uint16_t cameraId;
+    volatile int32_t tag;
+};
+
+struct TraceRecord {
+    nsecs_t timestamp;
+    uint32_t frameNumber;
+    uint32_t aux;
+    uint16_t stage;
+    uint16_t cameraId;
+};
+
+const uint32_t kMask = CameraFrameTrace::kCapacity - 1;
+
+TraceSlot sRing[CameraFrameTrace::kCapacity];
+volatile int32_t sNext = 0;
+
+// Number of records printed by dump() without -v
+const size_t kRecentRecords = 32;
+
+// Stages that carry the backend frame index instead of the frame number
+bool isBackendStage(uint32_t stage) {
+    switch (stage) {
+        case CAMERA_FRAME_TRACE_SOF:
+        case CAMERA_FRAME_TRACE_STREAM_BUF:
+        case CAMERA_FRAME_TRACE_SUPERBUF_MATCH:
+        case CAMERA_FRAME_TRACE_POSTPROC:
+        case CAMERA_FRAME_TRACE_JPEG_START:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint64_t frameKey(uint16_t cameraId, uint32_t id) {
+    return ((uint64_t)cameraId << 32) | id;
+}
+
+int compareRecords(const TraceRecord* lhs, const TraceRecord* rhs) {
+    if (lhs->timestamp < rhs->timestamp) return -1;
+    if (lhs->timestamp > rhs->timestamp) return 1;
+    return 0;
+}
+
+int compareNsecs(const nsecs_t* lhs, const nsecs_t* rhs) {
+    if (*lhs < *rhs) return -1;
+    if (*lhs > *rhs) return 1;
+    return 0;
+}
+
+/**
+ * Copy the records currently in the ring, oldest first. Slots being
+ * rewritten while we read are skipped.
+ */
+void snapshot(Vector<TraceRecord>& records, uint32_t* total) {
+    uint32_t end = (uint32_t)android_atomic_acquire_load(&sNext);
+    uint32_t start = end - CameraFrameTrace::kCapacity;
+    *total = end;
+
+    records.setCapacity(CameraFrameTrace::kCapacity);
+    for (uint32_t index = start; index != end; index++) {
+        const TraceSlot& slot = sRing[index & kMask];
+        int32_t expected = (int32_t)(index + 1);
+        // 0 marks a slot that is being written or was never written
+        if (expected == 0) continue;
+        if (android_atomic_acquire_load(&slot.tag) != expected) continue;
+
+        TraceRecord record;
+        record.timestamp = slot.timestamp;
+        record.frameNumber = slot.frameNumber;
+        record.aux = slot.aux;
+        record.stage = slot.stage;
+        record.cameraId = slot.cameraId;
+
+        android_memory_barrier();
+        if (android_atomic_acquire_load(&slot.tag) != expected) continue;
+        records.push(record);
+    }
+    // Stamps are claimed after reading the clock, so concurrent writers can
+    // land slightly out of order
+    records.sort(compareRecords);
+}
+
+/**
+ * Rewrite backend frame indices into frame numbers using the map records.
+ * Returns false for records that cannot be attributed to a request.
+ */
+bool resolveFrameNumber(const KeyedVector<uint64_t, uint32_t>& idMap,
+        const TraceRecord& record, uint32_t* frameNumber) {
+    if (record.stage == CAMERA_FRAME_TRACE_FRAME_ID_MAP) return false;
+    if (!isBackendStage(record.stage)) {
+        *frameNumber = record.frameNumber;
+        return true;
+    }
+    ssize_t idx = idMap.indexOfKey(frameKey(record.cameraId, record.frameNumber));
+    if (idx < 0) return false;
+    *frameNumber = idMap.valueAt(idx);
+    return true;
+}
+
+void buildIdMap(const Vector<TraceRecord>& records,
+        KeyedVector<uint64_t, uint32_t>& idMap) {
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord& record = records[i];
+        if (record.stage != CAMERA_FRAME_TRACE_FRAME_ID_MAP) continue;
+        idMap.add(frameKey(record.cameraId, record.aux), record.frameNumber);
+    }
+}
+
+struct StageStats {
+    // Time since the request was submitted, per stamp
+    Vector<nsecs_t> sinceSubmit[CAMERA_FRAME_TRACE_STAGE_COUNT];
+    // Time between consecutive stamps of the stage
+    Vector<nsecs_t> interval[CAMERA_FRAME_TRACE_STAGE_COUNT];
+    nsecs_t last[CAMERA_FRAME_TRACE_STAGE_COUNT];
+
+    StageStats() {
+        for (size_t i = 0; i < CAMERA_FRAME_TRACE_STAGE_COUNT; i++) last[i] = 0;
+    }
+};
+
+double toMs(nsecs_t t) {
+    return t / 1000000.0;
+}
+
+void appendPercentiles(String8& lines, Vector<nsecs_t>& samples) {
+    if (samples.isEmpty()) {
+        lines.append("         -        -        -");
+        return;
+    }
+    samples.sort(compareNsecs);
+    size_t n = samples.size();
+    lines.appendFormat(" %9.3f %8.3f %8.3f", toMs(samples[n / 2]),
+            toMs(samples[n * 9 / 10]), toMs(samples[n - 1]));
+}
+
+void appendRecord(String8& lines, const TraceRecord& record) {
+    lines.appendFormat("    %" PRId64 ".%06" PRId64 " cam %u %-15s frame %u aux %u\n",
+            record.timestamp / 1000000000, (record.timestamp / 1000) % 1000000,
+            record.cameraId, CameraFrameTrace::stageName(record.stage),
+            record.frameNumber, record.aux);
+}
+
+void appendMicros(String8& line, nsecs_t t) {
+    line.appendFormat("%" PRId64 ".%03" PRId64, t / 1000, t % 1000);
+}
+
+} // anonymous namespace
+
+extern "C" void camera_frame_trace(uint32_t stage, uint32_t camera_id,
+        uint32_t frame_number, uint32_t aux) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    int32_t index = android_atomic_inc(&sNext);
+    TraceSlot& slot = sRing[(uint32_t)index & kMask];
+
+    // Invalidate before touching the payload so readers drop the slot
+    android_atomic_acquire_store(0, &slot.tag);
+    slot.timestamp = now;
+    slot.frameNumber = frame_number;
+    slot.aux = aux;
+    slot.stage = (uint16_t)stage;
+    slot.cameraId = (uint16_t)camera_id;
+    android_atomic_release_store(index + 1, &slot.tag);
+}
+
+const char* CameraFrameTrace::stageName(uint32_t stage) {
+    static const char* kNames[CAMERA_FRAME_TRACE_STAGE_COUNT] = {
+        "request-submit",
+        "hal-request",
+        "sof",
+        "stream-buf",
+        "superbuf-match",
+        "postproc",
+        "jpeg-start",
+        "jpeg-done",
+        "result",
+        "return-buffers",
+        "frame-id-map",
+    };
+    if (stage >= CAMERA_FRAME_TRACE_STAGE_COUNT) return "unknown";
+    return kNames[stage];
+}
+
+status_t CameraFrameTrace::dump(int fd, const Vector<String16>& args) {
+    bool verbose = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == String16("-v")) verbose = true;
+    }
+
+    Vector<TraceRecord> records;
+    uint32_t total;
+    snapshot(records, &total);
+
+    String8 lines;
+    lines.appendFormat("Camera frame trace: %zu records held, %u stamped\n",
+            records.size(), total);
+    if (records.isEmpty()) {
+        write(fd, lines.string(), lines.size());
+        return OK;
+    }
+
+    KeyedVector<uint64_t, uint32_t> idMap;
+    buildIdMap(records, idMap);
+
+    KeyedVector<uint64_t, nsecs_t> submitTimes;
+    KeyedVector<uint16_t, StageStats> stats;
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord& record = records[i];
+        if (record.stage >= CAMERA_FRAME_TRACE_FRAME_ID_MAP) continue;
+
+        ssize_t statsIdx = stats.indexOfKey(record.cameraId);
+        if (statsIdx < 0) statsIdx = stats.add(record.cameraId, StageStats());
+        StageStats& s = stats.editValueAt(statsIdx);
+
+        if (s.last[record.stage] != 0) {
+            s.interval[record.stage].push(record.timestamp - s.last[record.stage]);
+        }
+        s.last[record.stage] = record.timestamp;
+
+        uint32_t frameNumber;
+        if (!resolveFrameNumber(idMap, record, &frameNumber)) continue;
+        uint64_t key = frameKey(record.cameraId, frameNumber);
+        if (record.stage == CAMERA_FRAME_TRACE_REQUEST_SUBMIT) {
+            submitTimes.add(key, record.timestamp);
+            continue;
+        }
+        ssize_t submitIdx = submitTimes.indexOfKey(key);
+        if (submitIdx < 0) continue;
+        s.sinceSubmit[record.stage].push(record.timestamp - submitTimes.valueAt(submitIdx));
+    }
+
+    for (size_t i = 0; i < stats.size(); i++) {
+        StageStats& s = stats.editValueAt(i);
+        lines.appendFormat("  Camera %u, latency since submit / interval (ms):\n",
+                stats.keyAt(i));
+        lines.append("    stage              count       p50      p90      max"
+                "  |     p50      p90      max\n");
+        for (uint32_t stage = 0; stage < CAMERA_FRAME_TRACE_FRAME_ID_MAP; stage++) {
+            if (s.interval[stage].isEmpty() && s.last[stage] == 0) continue;
+            lines.appendFormat("    %-15s %8zu", stageName(stage),
+                    s.sinceSubmit[stage].size());
+            appendPercentiles(lines, s.sinceSubmit[stage]);
+            lines.append("  |");
+            appendPercentiles(lines, s.interval[stage]);
+            lines.append("\n");
+        }
+    }
+
+    size_t first = 0;
+    if (!verbose && records.size() > kRecentRecords) {
+        first = records.size() - kRecentRecords;
+    }
+    lines.appendFormat("  Last %zu records:\n", records.size() - first);
+    for (size_t i = first; i < records.size(); i++) {
+        appendRecord(lines, records[i]);
+    }
+    write(fd, lines.string(), lines.size());
+    return OK;
+}
+
+status_t CameraFrameTrace::dumpChromeTrace(int fd) {
+    Vector<TraceRecord> records;
+    uint32_t total;
+    snapshot(records, &total);
+
+    KeyedVector<uint64_t, uint32_t> idMap;
+    buildIdMap(records, idMap);
+
+    // One process per camera, one thread row per stage. Each stamp becomes
+    // a slice starting at the previous stamp of the same frame, so the
+    // slice length is the time spent reaching that stage.
+    String8 out("[\n");
+    KeyedVector<uint16_t, bool> cameras;
+    KeyedVector<uint64_t, nsecs_t> lastStamp;
+    bool first = true;
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord& record = records[i];
+        if (record.stage >= CAMERA_FRAME_TRACE_FRAME_ID_MAP) continue;
+
+        if (cameras.indexOfKey(record.cameraId) < 0) {
+            cameras.add(record.cameraId, true);
+            out.appendFormat("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+                    "\"args\":{\"name\":\"Camera %u\"}}", first ? "" : ",\n",
+                    record.cameraId, record.cameraId);
+            for (uint32_t stage = 0; stage < CAMERA_FRAME_TRACE_FRAME_ID_MAP; stage++) {
+                out.appendFormat(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,"
+                        "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                        record.cameraId, stage, stageName(stage));
+                out.appendFormat(",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+                        "\"pid\":%u,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                        record.cameraId, stage, stage);
+            }
+            first = false;
+        }
+
+        uint32_t frameNumber;
+        bool resolved = resolveFrameNumber(idMap, record, &frameNumber);
+        ssize_t lastIdx = -1;
+        if (resolved) {
+            uint64_t key = frameKey(record.cameraId, frameNumber);
+            lastIdx = lastStamp.indexOfKey(key);
+            if (lastIdx < 0) {
+                lastStamp.add(key, record.timestamp);
+            }
+        }
+
+        out.appendFormat(",\n{\"name\":\"%s %u\",\"cat\":\"camera\",\"pid\":%u,\"tid\":%u,",
+                stageName(record.stage), resolved ? frameNumber : record.frameNumber,
+                record.cameraId, record.stage);
+        if (lastIdx >= 0) {
+            nsecs_t start = lastStamp.valueAt(lastIdx);
+            out.append("\"ph\":\"X\",\"ts\":");
+            appendMicros(out, start);
+            out.append(",\"dur\":");
+            appendMicros(out, record.timestamp - start);
+            lastStamp.editValueAt(lastIdx) = record.timestamp;
+        } else {
+            out.append("\"ph\":\"i\",\"s\":\"t\",\"ts\":");
+            appendMicros(out, record.timestamp);
+        }
+        out.appendFormat(",\"args\":{\"frame\":%u,\"id\":%u,\"aux\":%u}}",
+                resolved ? frameNumber : record.frameNumber, record.frameNumber, record.aux);
+
+        if (out.size() > 64 * 1024) {
+            write(fd, out.string(), out.size());
+            out.clear();
+        }
+    }
+    out.append("\n]\n");
+    write(fd, out.string(), out.size());
+    return OK;
+}
+
+}; // namespace android
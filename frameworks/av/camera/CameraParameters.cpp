@@ -185,20 +185,31 @@ CameraParameters::~CameraParameters()
 
 String8 CameraParameters::flatten() const
 {
-    String8 flattened("");
     size_t size = mMap.size();
-
+    size_t length = size > 0 ? size * 2 - 1 : 0; // '=' and ';' separators
     for (size_t i = 0; i < size; i++) {
-        String8 k, v;
-        k = mMap.keyAt(i);
-        v = mMap.valueAt(i);
+        length += mMap.keyAt(i).length() + mMap.valueAt(i).length();
+    }
 
-        flattened += k;
-        flattened += "=";
-        flattened += v;
+    // Build in place; appending pair by pair reallocates every time
+    String8 flattened;
+    char *out = flattened.lockBuffer(length);
+    if (out == NULL) {
+        return String8("");
+    }
+    for (size_t i = 0; i < size; i++) {
+        const String8& k = mMap.keyAt(i);
+        const String8& v = mMap.valueAt(i);
+
+        memcpy(out, k.string(), k.length());
+        out += k.length();
+        *out++ = '=';
+        memcpy(out, v.string(), v.length());
+        out += v.length();
         if (i != size-1)
-            flattened += ";";
+            *out++ = ';';
     }
+    flattened.unlockBuffer(length);
 
     return flattened;
 }
@@ -210,6 +221,12 @@ void CameraParameters::unflatten(const String8 &params)
 
     mMap.clear();
 
+    size_t count = 1;
+    for (b = strchr(a, ';'); b != 0; b = strchr(b + 1, ';')) {
+        count++;
+    }
+    mMap.setCapacity(count);
+
     for (;;) {
         // Find the bounds of the key name.
         b = strchr(a, '=');
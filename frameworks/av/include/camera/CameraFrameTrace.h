@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CAMERA_CLIENT_CAMERAFRAMETRACE_H
+#define ANDROID_CAMERA_CLIENT_CAMERAFRAMETRACE_H
+
+#include <stdint.h>
+
+/**
+ * Points along the capture pipeline where a frame is stamped into the
+ * process wide frame trace ring.
+ *
+ * Stages marked "backend id" carry the camera backend frame index instead of
+ * the framework frame number; CAMERA_FRAME_TRACE_FRAME_ID_MAP records link
+ * the two so dumps can put every stage of a frame on one timeline.
+ */
+typedef enum {
+    /** Framework hands the request to the HAL, aux = number of buffers */
+    CAMERA_FRAME_TRACE_REQUEST_SUBMIT = 0,
+    /** HAL processCaptureRequest entry */
+    CAMERA_FRAME_TRACE_HAL_REQUEST,
+    /** Start of frame reported by the backend, backend id */
+    CAMERA_FRAME_TRACE_SOF,
+    /** Stream buffer dequeued from the kernel, backend id, aux = stream type */
+    CAMERA_FRAME_TRACE_STREAM_BUF,
+    /** All buffers of a super buffer received, backend id, aux = channel */
+    CAMERA_FRAME_TRACE_SUPERBUF_MATCH,
+    /** Frame handed to offline post processing, backend id */
+    CAMERA_FRAME_TRACE_POSTPROC,
+    /** JPEG encode job started, backend id */
+    CAMERA_FRAME_TRACE_JPEG_START,
+    /** JPEG encode job finished */
+    CAMERA_FRAME_TRACE_JPEG_DONE,
+    /** Framework received a capture result, aux = number of buffers */
+    CAMERA_FRAME_TRACE_RESULT,
+    /** Framework returned output buffers to their streams */
+    CAMERA_FRAME_TRACE_RETURN_BUFFERS,
+    /** Mapping record, aux = backend id of the frame number */
+    CAMERA_FRAME_TRACE_FRAME_ID_MAP,
+
+    CAMERA_FRAME_TRACE_STAGE_COUNT
+} camera_frame_trace_stage_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stamp the current CLOCK_MONOTONIC time for a frame at a stage. Lock free
+ * and safe from any thread; the oldest records are overwritten once the
+ * ring is full.
+ */
+void camera_frame_trace(uint32_t stage, uint32_t camera_id,
+        uint32_t frame_number, uint32_t aux);
+
+#ifdef __cplusplus
+}
+
+#include <utils/Errors.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/**
+ * Dump side of the frame trace ring. The ring lives in libcamera_client so
+ * that the camera service and the camera HAL loaded in the same process
+ * stamp into the same buffer.
+ */
+class CameraFrameTrace {
+public:
+    // Number of records kept, must be a power of two
+    static const uint32_t kCapacity = 4096;
+
+    /**
+     * Print per-stage latency relative to request submit, per camera, and
+     * the most recent records. Pass "-v" in args to print every record
+     * still in the ring.
+     */
+    static status_t dump(int fd, const Vector<String16>& args);
+
+    /**
+     * Write the ring as a Chrome trace (JSON array format) for
+     * chrome://tracing.
+     */
+    static status_t dumpChromeTrace(int fd);
+
+    static const char* stageName(uint32_t stage);
+
+private:
+    CameraFrameTrace();
+};
+
+}; // namespace android
+
+#endif // __cplusplus
+
+#endif
@@ -53,7 +53,10 @@ LOCAL_SRC_FILES:=               \
     device3/StatusTracker.cpp \
     gui/RingBufferConsumer.cpp \
     utils/CameraTraces.cpp \
-    utils/AutoConditionLock.cpp
+    utils/AutoConditionLock.cpp \
+    utils/LockStats.cpp \
+    utils/LatencyHistogram.cpp \
+    utils/YuvRepack.cpp
 
 LOCAL_SHARED_LIBRARIES:= \
     libui \
@@ -82,3 +85,5 @@ LOCAL_CFLAGS += -Wall -Wextra
 LOCAL_MODULE:= libcameraservice
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -34,6 +34,7 @@
 #include <binder/MemoryBase.h>
 #include <binder/MemoryHeapBase.h>
 #include <binder/ProcessInfoService.h>
+#include <camera/CameraFrameTrace.h>
 #include <cutils/atomic.h>
 #include <cutils/properties.h>
 #include <gui/Surface.h>
@@ -2278,6 +2279,10 @@ status_t CameraService::dump(int fd, const Vector<String16>& args) {
                 getCallingPid(),
                 getCallingUid());
         write(fd, result.string(), result.size());
+    } else if (args.size() > 0 && args[0] == String16("--frame-trace")) {
+        // Machine readable output only, so it can be redirected to a file
+        // and loaded in chrome://tracing
+        CameraFrameTrace::dumpChromeTrace(fd);
     } else {
         bool locked = tryLock(mServiceLock);
         // failed to lock - CameraService is probably deadlocked
@@ -2412,6 +2417,10 @@ status_t CameraService::dump(int fd, const Vector<String16>& args) {
         write(fd, "\n", 1);
         camera3::CameraTraces::dump(fd, args);
 
+        // Per-stage capture timing
+        write(fd, "\n", 1);
+        CameraFrameTrace::dump(fd, args);
+
         // change logging level
         int n = args.size();
         for (int i = 0; i + 1 < n; i++) {
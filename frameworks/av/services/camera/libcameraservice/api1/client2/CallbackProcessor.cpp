@@ -18,19 +18,74 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 //#define LOG_NDEBUG 0
 
+#include <inttypes.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <binder/MemoryBase.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include <gui/Surface.h>
+#include <ui/GraphicBuffer.h>
 
 #include "common/CameraDeviceBase.h"
 #include "api1/Camera2Client.h"
 #include "api1/client2/CallbackProcessor.h"
+#include "utils/YuvRepack.h"
 
 #define ALIGN(x, mask) ( ((x) + (mask) - 1) & ~((mask) - 1) )
 
 namespace android {
 namespace camera2 {
 
+/**
+ * Client mapping of one acquired gralloc buffer, made for a single frame. The
+ * buffer is kept locked for CPU reads while the client can see it, and goes
+ * back to the callback stream when the last reference to the heap, local or
+ * remote, is dropped.
+ */
+class CallbackProcessor::ZeroCopyHeap: public MemoryHeapBase {
+  public:
+    ZeroCopyHeap(int fd, size_t size):
+            MemoryHeapBase(fd, size, MemoryHeapBase::READ_ONLY),
+            mHolding(false) {
+    }
+
+    bool isValid() {
+        return getHeapID() >= 0 && getBase() != MAP_FAILED;
+    }
+
+    // Take over the acquired and locked buffer until the heap goes away
+    void hold(const wp<CallbackProcessor> &parent,
+            const sp<BufferItemConsumer> &consumer, const BufferItem &item) {
+        mParent = parent;
+        mConsumer = consumer;
+        mItem = item;
+        mHolding = true;
+    }
+
+    virtual ~ZeroCopyHeap() {
+        if (!mHolding) {
+            return;
+        }
+        mItem.mGraphicBuffer->unlock();
+        // Fails harmlessly if the stream was torn down in the meantime
+        mConsumer->releaseBuffer(mItem);
+        sp<CallbackProcessor> parent = mParent.promote();
+        if (parent != 0) {
+            android_atomic_dec(&parent->mZeroCopyOutstanding);
+        }
+    }
+
+  private:
+    bool mHolding;
+    wp<CallbackProcessor> mParent;
+    sp<BufferItemConsumer> mConsumer;
+    BufferItem mItem;
+};
+
 CallbackProcessor::CallbackProcessor(sp<Camera2Client> client):
         Thread(false),
         mClient(client),
@@ -38,7 +93,17 @@ CallbackProcessor::CallbackProcessor(sp<Camera2Client> client):
         mId(client->getCameraId()),
         mCallbackAvailable(false),
         mCallbackToApp(false),
-        mCallbackStreamId(NO_STREAM) {
+        mCallbackStreamId(NO_STREAM),
+        mZeroCopy(false),
+        mZeroCopyOutstanding(0),
+        mFramesCopied(0),
+        mFramesShared(0),
+        mBytesCopied(0),
+        mZeroCopyRejected(0),
+        mZeroCopyThrottled(0) {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("camera.callback.zerocopy", value, "0");
+    mZeroCopyEnabled = !strcmp(value, "1");
 }
 
 CallbackProcessor::~CallbackProcessor() {
@@ -76,6 +141,8 @@ status_t CallbackProcessor::setCallbackWindow(
         }
         mCallbackStreamId = NO_STREAM;
         mCallbackConsumer.clear();
+        mZeroCopyConsumer.clear();
+        clearZeroCopySlotsLocked();
     }
     mCallbackWindow = callbackWindow;
     mCallbackToApp = (mCallbackWindow != NULL);
@@ -95,29 +162,66 @@ status_t CallbackProcessor::updateStream(const Parameters &params) {
         return INVALID_OPERATION;
     }
 
+    // Zero-copy needs the HAL to produce the API format itself
+    bool zeroCopy = mZeroCopyEnabled && !mCallbackToApp &&
+            ((params.previewFormat == HAL_PIXEL_FORMAT_YCrCb_420_SP &&
+              params.fastInfo.nativeNv21) ||
+             (params.previewFormat == HAL_PIXEL_FORMAT_YV12 &&
+              params.fastInfo.nativeYv12));
+
     // If possible, use the flexible YUV format
     int32_t callbackFormat = params.previewFormat;
     if (mCallbackToApp) {
         // TODO: etalvala: This should use the flexible YUV format as well, but
         // need to reconcile HAL2/HAL3 requirements.
         callbackFormat = HAL_PIXEL_FORMAT_YV12;
+    } else if (zeroCopy) {
+        callbackFormat = params.previewFormat;
     } else if(params.fastInfo.useFlexibleYuv &&
             (params.previewFormat == HAL_PIXEL_FORMAT_YCrCb_420_SP ||
              params.previewFormat == HAL_PIXEL_FORMAT_YV12) ) {
         callbackFormat = HAL_PIXEL_FORMAT_YCbCr_420_888;
     }
 
-    if (!mCallbackToApp && mCallbackConsumer == 0) {
+    if (!mCallbackToApp && zeroCopy != mZeroCopy &&
+            (mCallbackConsumer != 0 || mZeroCopyConsumer != 0)) {
+        // Switching consumer type, the old stream can't be reused
+        if (mCallbackStreamId != NO_STREAM) {
+            res = device->deleteStream(mCallbackStreamId);
+            if (res != OK) {
+                ALOGE("%s: Camera %d: Unable to delete old output stream "
+                        "for callbacks: %s (%d)", __FUNCTION__,
+                        mId, strerror(-res), res);
+                return res;
+            }
+            mCallbackStreamId = NO_STREAM;
+        }
+        mCallbackConsumer.clear();
+        mZeroCopyConsumer.clear();
+        clearZeroCopySlotsLocked();
+        mCallbackWindow.clear();
+    }
+
+    if (!mCallbackToApp && mCallbackConsumer == 0 && mZeroCopyConsumer == 0) {
         // Create CPU buffer queue endpoint, since app hasn't given us one
         // Make it async to avoid disconnect deadlocks
         sp<IGraphicBufferProducer> producer;
         sp<IGraphicBufferConsumer> consumer;
         BufferQueue::createBufferQueue(&producer, &consumer);
-        mCallbackConsumer = new CpuConsumer(consumer, kCallbackHeapCount);
-        mCallbackConsumer->setFrameAvailableListener(this);
-        mCallbackConsumer->setName(String8("Camera2-CallbackConsumer"));
+        if (zeroCopy) {
+            mZeroCopyConsumer = new BufferItemConsumer(consumer,
+                    GRALLOC_USAGE_SW_READ_OFTEN, kCallbackHeapCount);
+            mZeroCopyConsumer->setFrameAvailableListener(this);
+            mZeroCopyConsumer->setName(
+                    String8("Camera2-ZeroCopyCallbackConsumer"));
+        } else {
+            mCallbackConsumer = new CpuConsumer(consumer, kCallbackHeapCount);
+            mCallbackConsumer->setFrameAvailableListener(this);
+            mCallbackConsumer->setName(String8("Camera2-CallbackConsumer"));
+        }
         mCallbackWindow = new Surface(producer);
     }
+    mZeroCopy = zeroCopy;
 
     if (mCallbackStreamId != NO_STREAM) {
         // Check if stream parameters have to change
@@ -203,6 +307,8 @@ status_t CallbackProcessor::deleteStream() {
         mCallbackHeap.clear();
         mCallbackWindow.clear();
         mCallbackConsumer.clear();
+        mZeroCopyConsumer.clear();
+        clearZeroCopySlotsLocked();
 
         mCallbackStreamId = NO_STREAM;
     }
@@ -214,7 +320,23 @@ int CallbackProcessor::getStreamId() const {
     return mCallbackStreamId;
 }
 
-void CallbackProcessor::dump(int /*fd*/, const Vector<String16>& /*args*/) const {
+void CallbackProcessor::dump(int fd, const Vector<String16>& /*args*/) const {
+    String8 result;
+    Mutex::Autolock l(mInputMutex);
+
+    result.appendFormat("  Preview callbacks: %s\n",
+            mCallbackToApp ? "to app window" :
+            mZeroCopy ? "zero-copy" : "copy");
+    result.appendFormat("    Frames shared %" PRIu64 ", copied %" PRIu64
+            " (%" PRIu64 " KB)\n", mFramesShared, mFramesCopied,
+            mBytesCopied / 1024);
+    if (mZeroCopyEnabled) {
+        result.appendFormat("    Zero-copy buffers rejected %" PRIu64
+                ", frames copied under pressure %" PRIu64
+                ", outstanding %d\n", mZeroCopyRejected,
+                mZeroCopyThrottled, android_atomic_acquire_load(&mZeroCopyOutstanding));
+    }
+    write(fd, result.string(), result.size());
 }
 
 bool CallbackProcessor::threadLoop() {
@@ -231,9 +353,16 @@ bool CallbackProcessor::threadLoop() {
     }
 
     do {
+        bool zeroCopy;
+        {
+            Mutex::Autolock l(mInputMutex);
+            zeroCopy = mZeroCopy;
+        }
         sp<Camera2Client> client = mClient.promote();
         if (client == 0) {
             res = discardNewCallback();
+        } else if (zeroCopy) {
+            res = processNewZeroCopyCallback(client);
         } else {
             res = processNewCallback(client);
         }
@@ -245,6 +374,21 @@ bool CallbackProcessor::threadLoop() {
 status_t CallbackProcessor::discardNewCallback() {
     ATRACE_CALL();
     status_t res;
+    {
+        Mutex::Autolock l(mInputMutex);
+        if (mZeroCopyConsumer != 0) {
+            BufferItem item;
+            res = mZeroCopyConsumer->acquireBuffer(&item, 0);
+            if (res != OK) {
+                return res;
+            }
+            mZeroCopyConsumer->releaseBuffer(item);
+            return OK;
+        }
+        if (mCallbackConsumer == 0) {
+            return INVALID_OPERATION;
+        }
+    }
     CpuConsumer::LockedBuffer imgBuffer;
     res = mCallbackConsumer->lockNextBuffer(&imgBuffer);
     if (res != OK) {
@@ -291,25 +435,7 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
         ALOGV("%s: Camera %d: Preview callback available", __FUNCTION__,
                 mId);
 
-        if ( l.mParameters.state != Parameters::PREVIEW
-                && l.mParameters.state != Parameters::RECORD
-                && l.mParameters.state != Parameters::VIDEO_SNAPSHOT) {
-            ALOGV("%s: Camera %d: No longer streaming",
-                    __FUNCTION__, mId);
-            mCallbackConsumer->unlockBuffer(imgBuffer);
-            return OK;
-        }
-
-        if (! (l.mParameters.previewCallbackFlags &
-                CAMERA_FRAME_CALLBACK_FLAG_ENABLE_MASK) ) {
-            ALOGV("%s: No longer enabled, dropping", __FUNCTION__);
-            mCallbackConsumer->unlockBuffer(imgBuffer);
-            return OK;
-        }
-        if ((l.mParameters.previewCallbackFlags &
-                        CAMERA_FRAME_CALLBACK_FLAG_ONE_SHOT_MASK) &&
-                !l.mParameters.previewCallbackOneShot) {
-            ALOGV("%s: One shot mode, already sent, dropping", __FUNCTION__);
+        if (!callbackEnabledLocked(l.mParameters)) {
             mCallbackConsumer->unlockBuffer(imgBuffer);
             return OK;
         }
@@ -369,37 +495,13 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
         size_t bufferSize = Camera2Client::calculateBufferSize(
                 imgBuffer.width, imgBuffer.height,
                 previewFormat, destYStride);
-        size_t currentBufferSize = (mCallbackHeap == 0) ?
-                0 : (mCallbackHeap->mHeap->getSize() / kCallbackHeapCount);
-        if (bufferSize != currentBufferSize) {
-            mCallbackHeap.clear();
-            mCallbackHeap = new Camera2Heap(bufferSize, kCallbackHeapCount,
-                    "Camera2Client::CallbackHeap");
-            if (mCallbackHeap->mHeap->getSize() == 0) {
-                ALOGE("%s: Camera %d: Unable to allocate memory for callbacks",
-                        __FUNCTION__, mId);
-                mCallbackConsumer->unlockBuffer(imgBuffer);
-                return INVALID_OPERATION;
-            }
-
-            mCallbackHeapHead = 0;
-            mCallbackHeapFree = kCallbackHeapCount;
-        }
-
-        if (mCallbackHeapFree == 0) {
-            ALOGE("%s: Camera %d: No free callback buffers, dropping frame",
-                    __FUNCTION__, mId);
+        res = getHeapBufferLocked(bufferSize, &heapIdx);
+        if (res != OK) {
             mCallbackConsumer->unlockBuffer(imgBuffer);
-            return OK;
+            return (res == WOULD_BLOCK) ? OK : res;
         }
 
-        heapIdx = mCallbackHeapHead;
-
-        mCallbackHeapHead = (mCallbackHeapHead + 1) % kCallbackHeapCount;
-        mCallbackHeapFree--;
-
-        // TODO: Get rid of this copy by passing the gralloc queue all the way
-        // to app
+        // Copying mode; see processNewZeroCopyCallback for the shared path
 
         ssize_t offset;
         size_t size;
@@ -424,6 +526,8 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
 
         ALOGV("%s: Freeing buffer", __FUNCTION__);
         mCallbackConsumer->unlockBuffer(imgBuffer);
+        mFramesCopied++;
+        mBytesCopied += bufferSize;
 
         // mCallbackHeap may get freed up once input mutex is released
         callbackHeap = mCallbackHeap;
@@ -449,6 +553,358 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
     return OK;
 }
 
+status_t CallbackProcessor::processNewZeroCopyCallback(
+        sp<Camera2Client> &client) {
+    ATRACE_CALL();
+    status_t res;
+
+    sp<IMemory> frame;
+    sp<Camera2Heap> callbackHeap;
+    size_t heapIdx = 0;
+
+    {
+        /* acquire SharedParameters before mMutex so we don't dead lock
+            with Camera2Client code calling into StreamingProcessor */
+        SharedParameters::Lock l(client->getParameters());
+        Mutex::Autolock m(mInputMutex);
+        if (mCallbackStreamId == NO_STREAM || mZeroCopyConsumer == 0) {
+            ALOGV("%s: Camera %d: No zero-copy stream is available",
+                    __FUNCTION__, mId);
+            return INVALID_OPERATION;
+        }
+
+        BufferItem item;
+        res = mZeroCopyConsumer->acquireBuffer(&item, 0);
+        if (res != OK) {
+            if (res != BufferItemConsumer::NO_BUFFER_AVAILABLE) {
+                ALOGE("%s: Camera %d: Error receiving next callback buffer: "
+                        "%s (%d)", __FUNCTION__, mId, strerror(-res), res);
+            }
+            return res;
+        }
+        sp<GraphicBuffer> buffer = item.mGraphicBuffer;
+
+        if (!callbackEnabledLocked(l.mParameters)) {
+            mZeroCopyConsumer->releaseBuffer(item);
+            return OK;
+        }
+
+        int32_t previewFormat = l.mParameters.previewFormat;
+        if (buffer->getWidth() !=
+                    static_cast<uint32_t>(l.mParameters.previewWidth) ||
+                buffer->getHeight() !=
+                    static_cast<uint32_t>(l.mParameters.previewHeight)) {
+            ALOGW("%s: The preview size has changed to %d x %d from %d x %d, "
+                    "this buffer is no longer valid, dropping", __FUNCTION__,
+                    l.mParameters.previewWidth, l.mParameters.previewHeight,
+                    buffer->getWidth(), buffer->getHeight());
+            mZeroCopyConsumer->releaseBuffer(item);
+            return OK;
+        }
+        if (buffer->getPixelFormat() != previewFormat) {
+            ALOGE("%s: Camera %d: Unexpected format for callback: "
+                    "0x%x, expected 0x%x", __FUNCTION__, mId,
+                    buffer->getPixelFormat(), previewFormat);
+            mZeroCopyConsumer->releaseBuffer(item);
+            return INVALID_OPERATION;
+        }
+
+        // In one-shot mode, stop sending callbacks after the first one
+        if (l.mParameters.previewCallbackFlags &
+                CAMERA_FRAME_CALLBACK_FLAG_ONE_SHOT_MASK) {
+            ALOGV("%s: clearing oneshot", __FUNCTION__);
+            l.mParameters.previewCallbackOneShot = false;
+        }
+
+        ZeroCopySlot &slot = mZeroCopySlots[item.mBuf];
+        if (slot.buffer != buffer) {
+            // First use of this slot, or the producer reallocated it
+            slot.buffer = buffer;
+            slot.checked = false;
+            slot.shareable = false;
+        }
+        if (!slot.checked) {
+            slot.checked = true;
+            slot.shareable = checkZeroCopySlotLocked(slot, previewFormat);
+            if (!slot.shareable) {
+                ALOGW("%s: Camera %d: Buffer in slot %d can't be shared, "
+                        "copying its frames", __FUNCTION__, mId, item.mBuf);
+                mZeroCopyRejected++;
+            }
+        }
+
+        // Keep at least one buffer in the stream so that a client holding
+        // on to frames degrades to copies instead of stalling preview
+        sp<ZeroCopyHeap> zeroCopyHeap;
+        if (slot.shareable) {
+            if (android_atomic_acquire_load(&mZeroCopyOutstanding) <
+                    static_cast<int32_t>(kZeroCopyMaxOutstanding)) {
+                zeroCopyHeap = new ZeroCopyHeap(buffer->handle->data[0],
+                        slot.size);
+                if (!zeroCopyHeap->isValid()) {
+                    ALOGE("%s: Camera %d: Unable to map callback buffer, "
+                            "copying", __FUNCTION__, mId);
+                    zeroCopyHeap.clear();
+                }
+            } else {
+                mZeroCopyThrottled++;
+            }
+        }
+
+        if (zeroCopyHeap != 0) {
+            void *vaddr = NULL;
+            res = buffer->lock(GRALLOC_USAGE_SW_READ_OFTEN, &vaddr);
+            if (res != OK) {
+                ALOGE("%s: Camera %d: Unable to lock callback buffer: %s (%d)",
+                        __FUNCTION__, mId, strerror(-res), res);
+                mZeroCopyConsumer->releaseBuffer(item);
+                return res;
+            }
+            android_atomic_inc(&mZeroCopyOutstanding);
+            // Stays locked and acquired until the client lets go
+            zeroCopyHeap->hold(this, mZeroCopyConsumer, item);
+            frame = new MemoryBase(zeroCopyHeap, 0, slot.size);
+            mFramesShared++;
+        } else {
+            res = copyZeroCopyFrameLocked(slot, previewFormat, &heapIdx);
+            mZeroCopyConsumer->releaseBuffer(item);
+            if (res != OK) {
+                return (res == WOULD_BLOCK) ? OK : res;
+            }
+            // mCallbackHeap may get freed up once input mutex is released
+            callbackHeap = mCallbackHeap;
+            frame = callbackHeap->mBuffers[heapIdx];
+        }
+    }
+
+    // Call outside parameter lock to allow re-entrancy from notification
+    {
+        Camera2Client::SharedCameraCallbacks::Lock
+            l(client->mSharedCameraCallbacks);
+        if (l.mRemoteCallback != 0) {
+            ALOGV("%s: Camera %d: Invoking client data callback",
+                    __FUNCTION__, mId);
+            l.mRemoteCallback->dataCallback(CAMERA_MSG_PREVIEW_FRAME,
+                    frame, NULL);
+        }
+    }
+
+    if (callbackHeap != 0) {
+        mCallbackHeapFree++;
+    }
+
+    // A shared frame goes back to the stream once the client drops it
+    frame.clear();
+
+    ALOGV("%s: exit", __FUNCTION__);
+
+    return OK;
+}
+
+bool CallbackProcessor::callbackEnabledLocked(const Parameters &params) const {
+    if ( params.state != Parameters::PREVIEW
+            && params.state != Parameters::RECORD
+            && params.state != Parameters::VIDEO_SNAPSHOT) {
+        ALOGV("%s: Camera %d: No longer streaming",
+                __FUNCTION__, mId);
+        return false;
+    }
+
+    if (! (params.previewCallbackFlags &
+            CAMERA_FRAME_CALLBACK_FLAG_ENABLE_MASK) ) {
+        ALOGV("%s: No longer enabled, dropping", __FUNCTION__);
+        return false;
+    }
+    if ((params.previewCallbackFlags &
+                    CAMERA_FRAME_CALLBACK_FLAG_ONE_SHOT_MASK) &&
+            !params.previewCallbackOneShot) {
+        ALOGV("%s: One shot mode, already sent, dropping", __FUNCTION__);
+        return false;
+    }
+    return true;
+}
+
+status_t CallbackProcessor::getHeapBufferLocked(size_t bufferSize,
+        size_t *heapIdx) {
+    size_t currentBufferSize = (mCallbackHeap == 0) ?
+            0 : (mCallbackHeap->mHeap->getSize() / kCallbackHeapCount);
+    if (bufferSize != currentBufferSize) {
+        mCallbackHeap.clear();
+        mCallbackHeap = new Camera2Heap(bufferSize, kCallbackHeapCount,
+                "Camera2Client::CallbackHeap");
+        if (mCallbackHeap->mHeap->getSize() == 0) {
+            ALOGE("%s: Camera %d: Unable to allocate memory for callbacks",
+                    __FUNCTION__, mId);
+            return INVALID_OPERATION;
+        }
+
+        mCallbackHeapHead = 0;
+        mCallbackHeapFree = kCallbackHeapCount;
+    }
+
+    if (mCallbackHeapFree == 0) {
+        ALOGE("%s: Camera %d: No free callback buffers, dropping frame",
+                __FUNCTION__, mId);
+        return WOULD_BLOCK;
+    }
+
+    *heapIdx = mCallbackHeapHead;
+
+    mCallbackHeapHead = (mCallbackHeapHead + 1) % kCallbackHeapCount;
+    mCallbackHeapFree--;
+    return OK;
+}
+
+status_t CallbackProcessor::copyZeroCopyFrameLocked(const ZeroCopySlot &slot,
+        int32_t previewFormat, size_t *heapIdx) {
+    sp<GraphicBuffer> buffer = slot.buffer;
+    uint32_t width = buffer->getWidth();
+    uint32_t height = buffer->getHeight();
+    uint32_t destYStride;
+    uint32_t destCStride;
+    if (previewFormat == HAL_PIXEL_FORMAT_YV12) {
+        // Strides must align to 16 for YV12
+        destYStride = ALIGN(width, 16);
+        destCStride = ALIGN(destYStride / 2, 16);
+    } else {
+        // No padding for NV21
+        destYStride = width;
+        destCStride = destYStride / 2;
+    }
+
+    size_t bufferSize = Camera2Client::calculateBufferSize(width, height,
+            previewFormat, destYStride);
+    status_t res = getHeapBufferLocked(bufferSize, heapIdx);
+    if (res != OK) {
+        return res;
+    }
+    ssize_t offset;
+    size_t size;
+    sp<IMemoryHeap> heap =
+            mCallbackHeap->mBuffers[*heapIdx]->getMemory(&offset, &size);
+    uint8_t *data = (uint8_t*)heap->getBase() + offset;
+
+    if (slot.shareable) {
+        // Can just memcpy when the gralloc layout is the API layout
+        void *vaddr = NULL;
+        res = buffer->lock(GRALLOC_USAGE_SW_READ_OFTEN, &vaddr);
+        if (res != OK) {
+            ALOGE("%s: Camera %d: Unable to lock callback buffer: %s (%d)",
+                    __FUNCTION__, mId, strerror(-res), res);
+            return res;
+        }
+        memcpy(data, vaddr, bufferSize);
+        buffer->unlock();
+    } else {
+        android_ycbcr ycbcr;
+        res = buffer->lockYCbCr(GRALLOC_USAGE_SW_READ_OFTEN, &ycbcr);
+        if (res != OK) {
+            ALOGE("%s: Camera %d: Unable to lock callback buffer: %s (%d)",
+                    __FUNCTION__, mId, strerror(-res), res);
+            return res;
+        }
+        CpuConsumer::LockedBuffer src;
+        memset(&src, 0, sizeof(src));
+        src.data = static_cast<uint8_t*>(ycbcr.y);
+        src.width = width;
+        src.height = height;
+        src.format = buffer->getPixelFormat();
+        src.stride = static_cast<uint32_t>(ycbcr.ystride);
+        src.dataCb = static_cast<uint8_t*>(ycbcr.cb);
+        src.dataCr = static_cast<uint8_t*>(ycbcr.cr);
+        src.chromaStride = static_cast<uint32_t>(ycbcr.cstride);
+        src.chromaStep = static_cast<uint32_t>(ycbcr.chroma_step);
+        res = convertFromFlexibleYuv(previewFormat, data, src, destYStride,
+                destCStride);
+        buffer->unlock();
+        if (res != OK) {
+            ALOGE("%s: Camera %d: Can't convert callback buffer to 0x%x!",
+                    __FUNCTION__, mId, previewFormat);
+            return BAD_VALUE;
+        }
+    }
+    mFramesCopied++;
+    mBytesCopied += bufferSize;
+    return OK;
+}
+
+bool CallbackProcessor::checkZeroCopySlotLocked(ZeroCopySlot &slot,
+        int32_t format) {
+    sp<GraphicBuffer> buffer = slot.buffer;
+    uint32_t width = buffer->getWidth();
+    uint32_t height = buffer->getHeight();
+    const native_handle_t *handle = buffer->handle;
+    if (handle == NULL || handle->numFds < 1) {
+        return false;
+    }
+
+    // The gralloc layout must already be the one the API defines
+    android_ycbcr ycbcr;
+    if (buffer->lockYCbCr(GRALLOC_USAGE_SW_READ_OFTEN, &ycbcr) != OK) {
+        return false;
+    }
+    buffer->unlock();
+    const uint8_t *y = static_cast<const uint8_t*>(ycbcr.y);
+    const uint8_t *cb = static_cast<const uint8_t*>(ycbcr.cb);
+    const uint8_t *cr = static_cast<const uint8_t*>(ycbcr.cr);
+    size_t yStride, cStride;
+    bool layoutMatches;
+    if (format == HAL_PIXEL_FORMAT_YCrCb_420_SP) {
+        yStride = width;
+        cStride = width;
+        layoutMatches = ycbcr.chroma_step == 2 &&
+                cr == y + yStride * height && cb == cr + 1;
+    } else {
+        yStride = ALIGN(width, 16);
+        cStride = ALIGN(yStride / 2, 16);
+        layoutMatches = ycbcr.chroma_step == 1 &&
+                cr == y + yStride * height &&
+                cb == cr + cStride * (height / 2);
+    }
+    if (!layoutMatches || ycbcr.ystride != yStride ||
+            ycbcr.cstride != cStride) {
+        return false;
+    }
+    size_t size = Camera2Client::calculateBufferSize(width, height, format,
+            yStride);
+
+    int fd = handle->data[0];
+    off_t fdSize = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    if (fdSize >= 0 && static_cast<size_t>(fdSize) < size) {
+        return false;
+    }
+
+    // Only to check the mapping; every shared frame maps the fd anew
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(fd, size,
+            MemoryHeapBase::READ_ONLY);
+    if (heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        return false;
+    }
+
+    // The fd has to map the pixels the HAL wrote, starting at offset 0
+    void *vaddr = NULL;
+    if (buffer->lock(GRALLOC_USAGE_SW_READ_OFTEN, &vaddr) != OK) {
+        return false;
+    }
+    bool samePixels = memcmp(heap->getBase(), vaddr, size) == 0;
+    buffer->unlock();
+    if (!samePixels) {
+        return false;
+    }
+
+    slot.size = size;
+    return true;
+}
+
+void CallbackProcessor::clearZeroCopySlotsLocked() {
+    for (size_t i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        mZeroCopySlots[i].buffer.clear();
+        mZeroCopySlots[i].checked = false;
+        mZeroCopySlots[i].shareable = false;
+    }
+}
+
 status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
         uint8_t *dst,
         const CpuConsumer::LockedBuffer &src,
@@ -492,6 +948,22 @@ status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
                 crcbDst += src.width;
                 crSrc += src.chromaStride;
             }
+        } else if (crSrc == cbSrc + 1 && src.chromaStep == 2) {
+            ALOGV("%s: Fast NV12->NV21", __FUNCTION__);
+            // Semiplanar CbCr, swap each pair
+            for (size_t row = 0; row < chromaHeight; row++) {
+                YuvRepack::swapPairs(crcbDst, cbSrc, chromaWidth);
+                crcbDst += chromaWidth * 2;
+                cbSrc += src.chromaStride;
+            }
+        } else if (src.chromaStep == 1) {
+            ALOGV("%s: Fast planar->NV21", __FUNCTION__);
+            for (size_t row = 0; row < chromaHeight; row++) {
+                YuvRepack::interleave(crcbDst, crSrc, cbSrc, chromaWidth);
+                crcbDst += chromaWidth * 2;
+                crSrc += src.chromaStride;
+                cbSrc += src.chromaStride;
+            }
         } else {
             ALOGV("%s: Generic->NV21", __FUNCTION__);
             // Generic copy, always works but not very efficient
@@ -525,6 +997,22 @@ status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
                 cbDst += dstCStride;
                 cbSrc += src.chromaStride;
             }
+        } else if (src.chromaStep == 2 &&
+                (cbSrc == crSrc + 1 || crSrc == cbSrc + 1)) {
+            ALOGV("%s: Fast semiplanar->YV12", __FUNCTION__);
+            // Split interleaved chroma rows into the two planes
+            bool crFirst = (cbSrc == crSrc + 1);
+            const uint8_t *cSrc = crFirst ? crSrc : cbSrc;
+            for (size_t row = 0; row < chromaHeight; row++) {
+                if (crFirst) {
+                    YuvRepack::deinterleave(crDst, cbDst, cSrc, chromaWidth);
+                } else {
+                    YuvRepack::deinterleave(cbDst, crDst, cSrc, chromaWidth);
+                }
+                cSrc += src.chromaStride;
+                crDst += dstCStride;
+                cbDst += dstCStride;
+            }
         } else {
             ALOGV("%s: Generic->YV12", __FUNCTION__);
             // Generic copy, always works but not very efficient
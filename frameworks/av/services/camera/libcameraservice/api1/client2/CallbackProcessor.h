@@ -23,6 +23,8 @@
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
 #include <gui/CpuConsumer.h>
+#include <gui/BufferItemConsumer.h>
+#include <binder/MemoryHeapBase.h>
 
 #include "api1/client2/Camera2Heap.h"
 
@@ -78,12 +80,59 @@ class CallbackProcessor:
     int mCallbackHeapId;
     size_t mCallbackHeapHead, mCallbackHeapFree;
 
+    /**
+     * Zero-copy mode (camera.callback.zerocopy=1). When the HAL can output
+     * the API preview format directly in the layout the API expects, the
+     * gralloc buffer the HAL filled is handed to the client as an IMemory
+     * mapping of its fd. Each frame gets a heap of its own, and the buffer
+     * stays acquired until the client drops its last reference to the frame
+     * or its heap, at which point it is released back to the stream. The
+     * client thus never maps a buffer the HAL may fill again. Buffers that
+     * can't be shared, or frames arriving while too many buffers are out,
+     * fall back to the copy into mCallbackHeap.
+     */
+    class ZeroCopyHeap;
+    friend class ZeroCopyHeap;
+    static const size_t kZeroCopyMaxOutstanding = kCallbackHeapCount - 1;
+    bool mZeroCopyEnabled;
+    bool mZeroCopy;
+    sp<BufferItemConsumer> mZeroCopyConsumer;
+    struct ZeroCopySlot {
+        sp<GraphicBuffer> buffer;
+        size_t size;
+        bool checked;
+        // The fd maps the frame in the API layout
+        bool shareable;
+    };
+    ZeroCopySlot mZeroCopySlots[BufferQueue::NUM_BUFFER_SLOTS];
+    volatile int32_t mZeroCopyOutstanding;
+
+    // Statistics, guarded by mInputMutex
+    uint64_t mFramesCopied;
+    uint64_t mFramesShared;
+    uint64_t mBytesCopied;
+    uint64_t mZeroCopyRejected;
+    uint64_t mZeroCopyThrottled;
+
     virtual bool threadLoop();
 
     status_t processNewCallback(sp<Camera2Client> &client);
+    status_t processNewZeroCopyCallback(sp<Camera2Client> &client);
     // Used when shutting down
     status_t discardNewCallback();
 
+    // Preview state and callback flags allow sending this frame
+    bool callbackEnabledLocked(const Parameters &params) const;
+    // Reserve a buffer of bufferSize bytes in mCallbackHeap. Returns
+    // WOULD_BLOCK if all buffers are in use by the client.
+    status_t getHeapBufferLocked(size_t bufferSize, size_t *heapIdx);
+    // Check once per gralloc buffer that it can be shared with the client
+    bool checkZeroCopySlotLocked(ZeroCopySlot &slot, int32_t format);
+    // Copy the frame in slot into mCallbackHeap in the API layout
+    status_t copyZeroCopyFrameLocked(const ZeroCopySlot &slot,
+            int32_t previewFormat, size_t *heapIdx);
+    void clearZeroCopySlotsLocked();
+
     // Convert from flexible YUV to NV21 or YV12
     status_t convertFromFlexibleYuv(int32_t previewFormat,
             uint8_t *dst,
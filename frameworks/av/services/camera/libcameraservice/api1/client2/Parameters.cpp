@@ -1127,6 +1127,16 @@ status_t Parameters::buildFastInfo() {
     ALOGV("Camera %d: Flexible YUV %s supported",
             cameraId, fastInfo.useFlexibleYuv ? "is" : "is not");
 
+    fastInfo.nativeNv21 = false;
+    fastInfo.nativeYv12 = false;
+    for (size_t i = 0; i < availableFormats.size(); i++) {
+        if (availableFormats[i] == HAL_PIXEL_FORMAT_YCrCb_420_SP) {
+            fastInfo.nativeNv21 = true;
+        } else if (availableFormats[i] == HAL_PIXEL_FORMAT_YV12) {
+            fastInfo.nativeYv12 = true;
+        }
+    }
+
     return OK;
 }
 
@@ -223,6 +223,9 @@ struct Parameters {
         DefaultKeyedVector<uint8_t, OverrideModes> sceneModeOverrides;
         float minFocalLength;
         bool useFlexibleYuv;
+        // HAL can output the API preview formats without conversion
+        bool nativeNv21;
+        bool nativeYv12;
     } fastInfo;
 
     // Quirks information; these are short-lived flags to enable workarounds for
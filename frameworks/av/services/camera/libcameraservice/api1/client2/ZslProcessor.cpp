@@ -52,11 +52,13 @@ ZslProcessor::ZslProcessor(
         mZslBufferAvailable(false),
         mZslStreamId(NO_STREAM),
         mZslReprocessStreamId(NO_STREAM),
-        mFrameListHead(0),
+        mZslBufferDepth(getZslDepth(kDefaultZslBufferDepth)),
+        mFrameListDepth(mZslBufferDepth * 2),
         mZslQueueHead(0),
         mZslQueueTail(0) {
-    mZslQueue.insertAt(0, kZslBufferDepth);
-    mFrameList.insertAt(0, kFrameListDepth);
+    mZslQueue.insertAt(0, mZslBufferDepth);
+    mFrameList.setCapacity(mFrameListDepth + 1);
+    mUnmatchedBuffers.setCapacity(mZslBufferDepth);
     sp<CaptureSequencer> captureSequencer = mSequencer.promote();
     if (captureSequencer != 0) captureSequencer->setZslProcessor(this);
 }
@@ -77,19 +79,23 @@ void ZslProcessor::onFrameAvailable(const BufferItem& /*item*/) {
 void ZslProcessor::onResultAvailable(const CaptureResult &result) {
     ATRACE_CALL();
     ALOGV("%s:", __FUNCTION__);
-    Mutex::Autolock l(mInputMutex);
     camera_metadata_ro_entry_t entry;
     entry = result.mMetadata.find(ANDROID_SENSOR_TIMESTAMP);
+    if (entry.count == 0) {
+        ALOGE("%s: Camera %d: Result has no sensor timestamp",
+                __FUNCTION__, mId);
+        return;
+    }
     nsecs_t timestamp = entry.data.i64[0];
-    (void)timestamp;
     ALOGVV("Got preview frame for timestamp %" PRId64, timestamp);
 
-    if (mState != RUNNING) return;
+    // Clone before taking the lock; from here on the metadata is only moved
+    CameraMetadata frame(result.mMetadata);
 
-    mFrameList.editItemAt(mFrameListHead) = result.mMetadata;
-    mFrameListHead = (mFrameListHead + 1) % kFrameListDepth;
+    Mutex::Autolock l(mInputMutex);
+    if (mState != RUNNING) return;
 
-    findMatchesLocked();
+    matchFrameLocked(timestamp, frame);
 }
 
 void ZslProcessor::onBufferReleased(buffer_handle_t *handle) {
@@ -137,7 +143,7 @@ status_t ZslProcessor::updateStream(const Parameters &params) {
         BufferQueue::createBufferQueue(&producer, &consumer);
         mZslConsumer = new BufferItemConsumer(consumer,
             GRALLOC_USAGE_HW_CAMERA_ZSL,
-            kZslBufferDepth);
+            mZslBufferDepth);
         mZslConsumer->setFrameAvailableListener(this);
         mZslConsumer->setName(String8("Camera2-ZslConsumer"));
         mZslWindow = new Surface(producer);
@@ -287,7 +293,7 @@ status_t ZslProcessor::pushToReprocess(int32_t requestId) {
                 request = mZslQueue[index].frame;
                 break;
             }
-            index = (index + 1) % kZslBufferDepth;
+            index = (index + 1) % mZslBufferDepth;
         }
         if (index == mZslQueueHead) {
             ALOGV("%s: ZSL queue has no valid frames to send yet.",
@@ -394,6 +400,7 @@ status_t ZslProcessor::clearZslQueueLocked() {
     }
     mZslQueueHead = 0;
     mZslQueueTail = 0;
+    mUnmatchedBuffers.clear();
     return OK;
 }
 
@@ -463,76 +470,92 @@ status_t ZslProcessor::processNewZslBuffer() {
 
     ALOGVV("Got ZSL buffer: head: %d, tail: %d", mZslQueueHead, mZslQueueTail);
 
-    if ( (mZslQueueHead + 1) % kZslBufferDepth == mZslQueueTail) {
+    if ( (mZslQueueHead + 1) % mZslBufferDepth == mZslQueueTail) {
         ALOGVV("Releasing oldest buffer");
-        zslConsumer->releaseBuffer(mZslQueue[mZslQueueTail].buffer);
+        const ZslPair &queueTail = mZslQueue[mZslQueueTail];
+        if (queueTail.frame.isEmpty()) {
+            mUnmatchedBuffers.removeItem(queueTail.buffer.mTimestamp);
+        }
+        zslConsumer->releaseBuffer(queueTail.buffer);
         mZslQueue.replaceAt(mZslQueueTail);
-        mZslQueueTail = (mZslQueueTail + 1) % kZslBufferDepth;
+        mZslQueueTail = (mZslQueueTail + 1) % mZslBufferDepth;
     }
 
     ZslPair &queueHead = mZslQueue.editItemAt(mZslQueueHead);
 
     queueHead.buffer = item;
-    queueHead.frame.release();
-
-    mZslQueueHead = (mZslQueueHead + 1) % kZslBufferDepth;
+    queueHead.frame.clear();
 
     ALOGVV("  Acquired buffer, timestamp %" PRId64, queueHead.buffer.mTimestamp);
 
-    findMatchesLocked();
+    matchBufferLocked(mZslQueueHead);
+
+    mZslQueueHead = (mZslQueueHead + 1) % mZslBufferDepth;
 
     return OK;
 }
 
-void ZslProcessor::findMatchesLocked() {
-    ALOGVV("Scanning");
-    for (size_t i = 0; i < mZslQueue.size(); i++) {
-        ZslPair &queueEntry = mZslQueue.editItemAt(i);
-        nsecs_t bufferTimestamp = queueEntry.buffer.mTimestamp;
-        IF_ALOGV() {
-            camera_metadata_entry_t entry;
-            nsecs_t frameTimestamp = 0;
-            if (!queueEntry.frame.isEmpty()) {
-                entry = queueEntry.frame.find(ANDROID_SENSOR_TIMESTAMP);
-                frameTimestamp = entry.data.i64[0];
-            }
-            ALOGVV("   %d: b: %" PRId64 "\tf: %" PRId64, i,
-                    bufferTimestamp, frameTimestamp );
-        }
-        if (queueEntry.frame.isEmpty() && bufferTimestamp != 0) {
-            // Have buffer, no matching frame. Look for one
-            for (size_t j = 0; j < mFrameList.size(); j++) {
-                bool match = false;
-                CameraMetadata &frame = mFrameList.editItemAt(j);
-                if (!frame.isEmpty()) {
-                    camera_metadata_entry_t entry;
-                    entry = frame.find(ANDROID_SENSOR_TIMESTAMP);
-                    if (entry.count == 0) {
-                        ALOGE("%s: Can't find timestamp in frame!",
-                                __FUNCTION__);
-                        continue;
-                    }
-                    nsecs_t frameTimestamp = entry.data.i64[0];
-                    if (bufferTimestamp == frameTimestamp) {
-                        ALOGVV("%s: Found match %" PRId64, __FUNCTION__,
-                                frameTimestamp);
-                        match = true;
-                    } else {
-                        int64_t delta = abs(bufferTimestamp - frameTimestamp);
-                        if ( delta < 1000000) {
-                            ALOGVV("%s: Found close match %" PRId64 " (delta %" PRId64 ")",
-                                    __FUNCTION__, bufferTimestamp, delta);
-                            match = true;
-                        }
-                    }
-                }
-                if (match) {
-                    queueEntry.frame.acquire(frame);
-                    break;
-                }
-            }
+/**
+ * Index of the entry whose timestamp is closest to timestamp and less than
+ * tolerance away, or -1. Binary search; keys are kept sorted.
+ */
+template<typename T>
+static ssize_t findClosest(const KeyedVector<nsecs_t, T> &list,
+        nsecs_t timestamp, nsecs_t tolerance) {
+    size_t lo = 0, hi = list.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (list.keyAt(mid) < timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
+
+    ssize_t closest = -1;
+    nsecs_t closestDelta = tolerance;
+    if (lo < list.size() && list.keyAt(lo) - timestamp < closestDelta) {
+        closest = lo;
+        closestDelta = list.keyAt(lo) - timestamp;
+    }
+    if (lo > 0 && timestamp - list.keyAt(lo - 1) < closestDelta) {
+        closest = lo - 1;
+    }
+    return closest;
+}
+
+void ZslProcessor::matchBufferLocked(size_t index) {
+    ZslPair &queueEntry = mZslQueue.editItemAt(index);
+    nsecs_t bufferTimestamp = queueEntry.buffer.mTimestamp;
+
+    ssize_t match = findClosest(mFrameList, bufferTimestamp, kMatchTolerance);
+    if (match >= 0) {
+        ALOGVV("%s: Found match %" PRId64 " for buffer %" PRId64,
+                __FUNCTION__, mFrameList.keyAt(match), bufferTimestamp);
+        queueEntry.frame.acquire(mFrameList.editValueAt(match));
+        mFrameList.removeItemsAt(match);
+    } else {
+        mUnmatchedBuffers.add(bufferTimestamp, index);
+    }
+}
+
+void ZslProcessor::matchFrameLocked(nsecs_t timestamp, CameraMetadata &frame) {
+    ssize_t match = findClosest(mUnmatchedBuffers, timestamp, kMatchTolerance);
+    if (match >= 0) {
+        ALOGVV("%s: Found match %" PRId64 " for frame %" PRId64,
+                __FUNCTION__, mUnmatchedBuffers.keyAt(match), timestamp);
+        mZslQueue.editItemAt(mUnmatchedBuffers.valueAt(match)).frame.acquire(frame);
+        mUnmatchedBuffers.removeItemsAt(match);
+        return;
+    }
+
+    if (mFrameList.size() >= mFrameListDepth) {
+        mFrameList.removeItemsAt(0);
+    }
+    ssize_t index = mFrameList.add(timestamp, CameraMetadata());
+    if (index >= 0) {
+        mFrameList.editValueAt(index).acquire(frame);
+    }
 }
 
 void ZslProcessor::dumpZslQueue(int fd) const {
@@ -565,6 +588,13 @@ void ZslProcessor::dumpZslQueue(int fd) const {
         }
 
     }
+    String8 result = String8::format("   Unmatched results: %zu, buffers: %zu",
+            mFrameList.size(), mUnmatchedBuffers.size());
+    ALOGV("%s", result.string());
+    if (fd != -1) {
+        result = indent + result + "\n";
+        write(fd, result.string(), result.size());
+    }
 }
 
 }; // namespace camera2
@@ -20,6 +20,7 @@
 #include <utils/Thread.h>
 #include <utils/String16.h>
 #include <utils/Vector.h>
+#include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
 #include <gui/BufferItem.h>
@@ -77,6 +78,8 @@ class ZslProcessor:
     void dump(int fd, const Vector<String16>& args) const;
   private:
     static const nsecs_t kWaitDuration = 10000000; // 10 ms
+    // Max distance between a buffer and a result timestamp to pair them
+    static const nsecs_t kMatchTolerance = 1000000; // 1 ms
 
     enum {
         RUNNING,
@@ -108,10 +111,16 @@ class ZslProcessor:
         CameraMetadata frame;
     };
 
-    static const size_t kZslBufferDepth = 4;
-    static const size_t kFrameListDepth = kZslBufferDepth * 2;
-    Vector<CameraMetadata> mFrameList;
-    size_t mFrameListHead;
+    static const size_t kDefaultZslBufferDepth = 4;
+    // kDefaultZslBufferDepth unless overridden, see getZslDepth()
+    const size_t mZslBufferDepth;
+    const size_t mFrameListDepth;
+    // Results not yet paired with a ZSL buffer, by sensor timestamp. Holds
+    // at most mFrameListDepth entries; the oldest is dropped first.
+    KeyedVector<nsecs_t, CameraMetadata> mFrameList;
+    // ZSL queue indices of buffers still waiting for their result, by
+    // buffer timestamp
+    KeyedVector<nsecs_t, size_t> mUnmatchedBuffers;
 
     ZslPair mNextPair;
 
@@ -125,8 +134,12 @@ class ZslProcessor:
 
     status_t processNewZslBuffer();
 
-    // Match up entries from frame list to buffers in ZSL queue
-    void findMatchesLocked();
+    // Pair the buffer just queued at index with a stored result, or
+    // remember it until its result arrives
+    void matchBufferLocked(size_t index);
+    // Hand a result to the ZSL queue entry waiting for it, or store it.
+    // Takes ownership of the metadata.
+    void matchFrameLocked(nsecs_t timestamp, CameraMetadata &frame);
 
     status_t clearZslQueueLocked();
 
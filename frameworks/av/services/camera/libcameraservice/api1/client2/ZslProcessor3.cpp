@@ -50,9 +50,6 @@ ZslProcessor3::ZslProcessor3(
         mSequencer(sequencer),
         mId(client->getCameraId()),
         mZslStreamId(NO_STREAM),
-        mFrameListHead(0),
-        mZslQueueHead(0),
-        mZslQueueTail(0),
         mHasFocuser(false) {
     // Initialize buffer queue and frame list based on pipeline max depth.
     size_t pipelineMaxDepth = kDefaultMaxPipelineDepth;
@@ -82,12 +79,15 @@ ZslProcessor3::ZslProcessor3(
     // Need to keep buffer queue longer than metadata queue because sometimes buffer arrives
     // earlier than metadata which causes the buffer corresponding to oldest metadata being
     // removed.
-    mFrameListDepth = pipelineMaxDepth;
+    // A deeper history can be configured, but never one shallower than the
+    // pipeline.
+    mFrameListDepth = getZslDepth(pipelineMaxDepth);
+    if (mFrameListDepth < pipelineMaxDepth) {
+        mFrameListDepth = pipelineMaxDepth;
+    }
     mBufferQueueDepth = mFrameListDepth + 1;
+    ALOGV("%s: ZSL depth %zu", __FUNCTION__, mFrameListDepth);
 
-
-    mZslQueue.insertAt(0, mBufferQueueDepth);
-    mFrameList.insertAt(0, mFrameListDepth);
     sp<CaptureSequencer> captureSequencer = mSequencer.promote();
     if (captureSequencer != 0) captureSequencer->setZslProcessor(this);
 }
@@ -123,8 +123,38 @@ void ZslProcessor3::onResultAvailable(const CaptureResult &result) {
     // Corresponding buffer has been cleared. No need to push into mFrameList
     if (timestamp <= mLatestClearedBufferTimestamp) return;
 
-    mFrameList.editItemAt(mFrameListHead) = result.mMetadata;
-    mFrameListHead = (mFrameListHead + 1) % mFrameListDepth;
+    ssize_t idx = mFrameList.indexOfKey(frameNumber);
+    if (idx >= 0) {
+        // Repeated frame number, keep the candidate index consistent
+        removeFrameLocked(idx);
+    }
+    idx = mFrameList.add(frameNumber, result.mMetadata);
+    if (idx < 0) {
+        ALOGE("%s: Unable to cache metadata for frame %d: %s (%zd)",
+                __FUNCTION__, frameNumber, strerror(-idx), idx);
+        return;
+    }
+    if (isCandidateFrame(result.mMetadata)) {
+        mCandidateFrames.add(timestamp, frameNumber);
+    }
+
+    while (mFrameList.size() > mFrameListDepth) {
+        removeFrameLocked(0);
+    }
+}
+
+void ZslProcessor3::removeFrameLocked(size_t index) {
+    int32_t frameNumber = mFrameList.keyAt(index);
+    camera_metadata_ro_entry_t entry =
+            mFrameList.valueAt(index).find(ANDROID_SENSOR_TIMESTAMP);
+    if (entry.count > 0) {
+        ssize_t candidateIdx = mCandidateFrames.indexOfKey(entry.data.i64[0]);
+        if (candidateIdx >= 0 &&
+                mCandidateFrames.valueAt(candidateIdx) == frameNumber) {
+            mCandidateFrames.removeItemsAt(candidateIdx);
+        }
+    }
+    mFrameList.removeItemsAt(index);
 }
 
 status_t ZslProcessor3::updateStream(const Parameters &params) {
@@ -300,8 +330,8 @@ status_t ZslProcessor3::pushToReprocess(int32_t requestId) {
         dumpZslQueue(-1);
     }
 
-    size_t metadataIdx;
-    nsecs_t candidateTimestamp = getCandidateTimestampLocked(&metadataIdx);
+    int32_t frameNumber;
+    nsecs_t candidateTimestamp = getCandidateTimestampLocked(&frameNumber);
 
     if (candidateTimestamp == -1) {
         ALOGE("%s: Could not find good candidate for ZSL reprocessing",
@@ -322,7 +352,7 @@ status_t ZslProcessor3::pushToReprocess(int32_t requestId) {
     }
 
     {
-        CameraMetadata request = mFrameList[metadataIdx];
+        CameraMetadata request = mFrameList.valueFor(frameNumber);
 
         // Verify that the frame is reasonable for reprocessing
 
@@ -449,8 +479,7 @@ status_t ZslProcessor3::clearZslQueueLocked() {
 
 void ZslProcessor3::clearZslResultQueueLocked() {
     mFrameList.clear();
-    mFrameListHead = 0;
-    mFrameList.insertAt(0, mFrameListDepth);
+    mCandidateFrames.clear();
 }
 
 void ZslProcessor3::dump(int fd, const Vector<String16>& /*args*/) const {
@@ -473,28 +502,30 @@ bool ZslProcessor3::threadLoop() {
 }
 
 void ZslProcessor3::dumpZslQueue(int fd) const {
-    String8 header("ZSL queue contents:");
+    String8 header = String8::format("ZSL result cache contents (depth %zu, "
+            "%zu candidates):", mFrameListDepth, mCandidateFrames.size());
     String8 indent("    ");
     ALOGV("%s", header.string());
     if (fd != -1) {
         header = indent + header + "\n";
         write(fd, header.string(), header.size());
     }
-    for (size_t i = 0; i < mZslQueue.size(); i++) {
-        const ZslPair &queueEntry = mZslQueue[i];
-        nsecs_t bufferTimestamp = queueEntry.buffer.mTimestamp;
+    for (size_t i = 0; i < mFrameList.size(); i++) {
+        const CameraMetadata &frame = mFrameList.valueAt(i);
         camera_metadata_ro_entry_t entry;
         nsecs_t frameTimestamp = 0;
         int frameAeState = -1;
-        if (!queueEntry.frame.isEmpty()) {
-            entry = queueEntry.frame.find(ANDROID_SENSOR_TIMESTAMP);
-            if (entry.count > 0) frameTimestamp = entry.data.i64[0];
-            entry = queueEntry.frame.find(ANDROID_CONTROL_AE_STATE);
-            if (entry.count > 0) frameAeState = entry.data.u8[0];
-        }
+        entry = frame.find(ANDROID_SENSOR_TIMESTAMP);
+        if (entry.count > 0) frameTimestamp = entry.data.i64[0];
+        entry = frame.find(ANDROID_CONTROL_AE_STATE);
+        if (entry.count > 0) frameAeState = entry.data.u8[0];
+        ssize_t candidateIdx = mCandidateFrames.indexOfKey(frameTimestamp);
+        bool candidate = candidateIdx >= 0 &&
+                mCandidateFrames.valueAt(candidateIdx) == mFrameList.keyAt(i);
         String8 result =
-                String8::format("   %zu: b: %" PRId64 "\tf: %" PRId64 ", AE state: %d", i,
-                        bufferTimestamp, frameTimestamp, frameAeState);
+                String8::format("   frame %d: f: %" PRId64 ", AE state: %d%s",
+                        mFrameList.keyAt(i), frameTimestamp, frameAeState,
+                        candidate ? ", candidate" : "");
         ALOGV("%s", result.string());
         if (fd != -1) {
             result = indent + result + "\n";
@@ -521,92 +552,71 @@ bool ZslProcessor3::isFixedFocusMode(uint8_t afMode) const {
     }
 }
 
-nsecs_t ZslProcessor3::getCandidateTimestampLocked(size_t* metadataIdx) const {
-    /**
-     * Find the smallest timestamp we know about so far
-     * - ensure that aeState is either converged or locked
-     */
-
-    size_t idx = 0;
-    nsecs_t minTimestamp = -1;
-
-    size_t emptyCount = mFrameList.size();
-
-    for (size_t j = 0; j < mFrameList.size(); j++) {
-        const CameraMetadata &frame = mFrameList[j];
-        if (!frame.isEmpty()) {
+bool ZslProcessor3::isCandidateFrame(const CameraMetadata &frame) const {
+    camera_metadata_ro_entry_t entry;
+    entry = frame.find(ANDROID_CONTROL_AE_STATE);
 
-            emptyCount--;
+    if (entry.count == 0) {
+        /**
+         * This is most likely a HAL bug. The aeState field is
+         * mandatory, so it should always be in a metadata packet.
+         */
+        ALOGW("%s: ZSL queue frame has no AE state field!",
+                __FUNCTION__);
+        return false;
+    }
+    if (entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_CONVERGED &&
+            entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_LOCKED) {
+        ALOGVV("%s: ZSL queue frame AE state is %d, need "
+               "full capture",  __FUNCTION__, entry.data.u8[0]);
+        return false;
+    }
 
-            camera_metadata_ro_entry_t entry;
-            entry = frame.find(ANDROID_SENSOR_TIMESTAMP);
-            if (entry.count == 0) {
-                ALOGE("%s: Can't find timestamp in frame!",
-                        __FUNCTION__);
-                continue;
-            }
-            nsecs_t frameTimestamp = entry.data.i64[0];
-            if (minTimestamp > frameTimestamp || minTimestamp == -1) {
-
-                entry = frame.find(ANDROID_CONTROL_AE_STATE);
-
-                if (entry.count == 0) {
-                    /**
-                     * This is most likely a HAL bug. The aeState field is
-                     * mandatory, so it should always be in a metadata packet.
-                     */
-                    ALOGW("%s: ZSL queue frame has no AE state field!",
-                            __FUNCTION__);
-                    continue;
-                }
-                if (entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_CONVERGED &&
-                        entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_LOCKED) {
-                    ALOGVV("%s: ZSL queue frame AE state is %d, need "
-                           "full capture",  __FUNCTION__, entry.data.u8[0]);
-                    continue;
-                }
-
-                entry = frame.find(ANDROID_CONTROL_AF_MODE);
-                if (entry.count == 0) {
-                    ALOGW("%s: ZSL queue frame has no AF mode field!",
-                            __FUNCTION__);
-                    continue;
-                }
-                uint8_t afMode = entry.data.u8[0];
-                if (afMode == ANDROID_CONTROL_AF_MODE_OFF) {
-                    // Skip all the ZSL buffer for manual AF mode, as we don't really
-                    // know the af state.
-                    continue;
-                }
-
-                // Check AF state if device has focuser and focus mode isn't fixed
-                if (mHasFocuser && !isFixedFocusMode(afMode)) {
-                    // Make sure the candidate frame has good focus.
-                    entry = frame.find(ANDROID_CONTROL_AF_STATE);
-                    if (entry.count == 0) {
-                        ALOGW("%s: ZSL queue frame has no AF state field!",
-                                __FUNCTION__);
-                        continue;
-                    }
-                    uint8_t afState = entry.data.u8[0];
-                    if (afState != ANDROID_CONTROL_AF_STATE_PASSIVE_FOCUSED &&
-                            afState != ANDROID_CONTROL_AF_STATE_FOCUSED_LOCKED &&
-                            afState != ANDROID_CONTROL_AF_STATE_NOT_FOCUSED_LOCKED) {
-                        ALOGVV("%s: ZSL queue frame AF state is %d is not good for capture, skip it",
-                                __FUNCTION__, afState);
-                        continue;
-                    }
-                }
-
-                minTimestamp = frameTimestamp;
-                idx = j;
-            }
+    entry = frame.find(ANDROID_CONTROL_AF_MODE);
+    if (entry.count == 0) {
+        ALOGW("%s: ZSL queue frame has no AF mode field!",
+                __FUNCTION__);
+        return false;
+    }
+    uint8_t afMode = entry.data.u8[0];
+    if (afMode == ANDROID_CONTROL_AF_MODE_OFF) {
+        // Skip all the ZSL buffer for manual AF mode, as we don't really
+        // know the af state.
+        return false;
+    }
 
-            ALOGVV("%s: Saw timestamp %" PRId64, __FUNCTION__, frameTimestamp);
+    // Check AF state if device has focuser and focus mode isn't fixed
+    if (mHasFocuser && !isFixedFocusMode(afMode)) {
+        // Make sure the candidate frame has good focus.
+        entry = frame.find(ANDROID_CONTROL_AF_STATE);
+        if (entry.count == 0) {
+            ALOGW("%s: ZSL queue frame has no AF state field!",
+                    __FUNCTION__);
+            return false;
+        }
+        uint8_t afState = entry.data.u8[0];
+        if (afState != ANDROID_CONTROL_AF_STATE_PASSIVE_FOCUSED &&
+                afState != ANDROID_CONTROL_AF_STATE_FOCUSED_LOCKED &&
+                afState != ANDROID_CONTROL_AF_STATE_NOT_FOCUSED_LOCKED) {
+            ALOGVV("%s: ZSL queue frame AF state is %d is not good for capture, skip it",
+                    __FUNCTION__, afState);
+            return false;
         }
     }
 
-    if (emptyCount == mFrameList.size()) {
+    return true;
+}
+
+nsecs_t ZslProcessor3::getCandidateTimestampLocked(int32_t* frameNumber) const {
+    /**
+     * Find the smallest timestamp we know about so far
+     * - ensure that aeState is either converged or locked
+     *
+     * Results are vetted as they arrive, so this is just the oldest entry
+     * in mCandidateFrames.
+     */
+
+    if (mFrameList.isEmpty()) {
         /**
          * This could be mildly bad and means our ZSL was triggered before
          * there were any frames yet received by the camera framework.
@@ -622,11 +632,19 @@ nsecs_t ZslProcessor3::getCandidateTimestampLocked(size_t* metadataIdx) const {
         ALOGW("%s: ZSL queue has no metadata frames", __FUNCTION__);
     }
 
-    ALOGV("%s: Candidate timestamp %" PRId64 " (idx %zu), empty frames: %zu",
-          __FUNCTION__, minTimestamp, idx, emptyCount);
+    if (mCandidateFrames.isEmpty()) {
+        ALOGV("%s: No candidate among %zu frames", __FUNCTION__,
+                mFrameList.size());
+        return -1;
+    }
+
+    nsecs_t minTimestamp = mCandidateFrames.keyAt(0);
+    ALOGV("%s: Candidate timestamp %" PRId64 " (frame %d), frames: %zu",
+          __FUNCTION__, minTimestamp, mCandidateFrames.valueAt(0),
+          mFrameList.size());
 
-    if (metadataIdx) {
-        *metadataIdx = idx;
+    if (frameNumber) {
+        *frameNumber = mCandidateFrames.valueAt(0);
     }
 
     return minTimestamp;
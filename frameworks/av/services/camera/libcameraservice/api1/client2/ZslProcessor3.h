@@ -19,6 +19,7 @@
 
 #include <utils/Thread.h>
 #include <utils/String16.h>
+#include <utils/KeyedVector.h>
 #include <utils/Vector.h>
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
@@ -104,22 +105,14 @@ class ZslProcessor3 :
     int mZslStreamId;
     sp<camera3::Camera3ZslStream> mZslStream;
 
-    struct ZslPair {
-        BufferItem buffer;
-        CameraMetadata frame;
-    };
-
     static const int32_t kDefaultMaxPipelineDepth = 4;
     size_t mBufferQueueDepth;
     size_t mFrameListDepth;
-    Vector<CameraMetadata> mFrameList;
-    size_t mFrameListHead;
-
-    ZslPair mNextPair;
-
-    Vector<ZslPair> mZslQueue;
-    size_t mZslQueueHead;
-    size_t mZslQueueTail;
+    // Recent preview results by frame number, at most mFrameListDepth
+    KeyedVector<int32_t, CameraMetadata> mFrameList;
+    // Results usable for reprocessing (AE and AF settled) by sensor
+    // timestamp, mapping to their frame number in mFrameList
+    KeyedVector<nsecs_t, int32_t> mCandidateFrames;
 
     CameraMetadata mLatestCapturedRequest;
 
@@ -133,7 +126,13 @@ class ZslProcessor3 :
 
     void dumpZslQueue(int id) const;
 
-    nsecs_t getCandidateTimestampLocked(size_t* metadataIdx) const;
+    // Oldest usable result, or -1 if there is none
+    nsecs_t getCandidateTimestampLocked(int32_t* frameNumber) const;
+
+    // Checked once per result as it arrives
+    bool isCandidateFrame(const CameraMetadata &frame) const;
+
+    void removeFrameLocked(size_t index);
 
     bool isFixedFocusMode(uint8_t afMode) const;
 
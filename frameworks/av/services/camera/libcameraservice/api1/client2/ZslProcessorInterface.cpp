@@ -14,6 +14,13 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "Camera2-ZslProcessorInterface"
+
+#include <stdlib.h>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+
 #include "ZslProcessorInterface.h"
 
 namespace android {
@@ -23,6 +30,21 @@ status_t ZslProcessorInterface::disconnect() {
     return OK;
 }
 
+size_t ZslProcessorInterface::getZslDepth(size_t defaultDepth) {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("camera.zsl.depth", value, "0");
+    int depth = atoi(value);
+    if (depth == 0) {
+        return defaultDepth;
+    }
+    if (depth < 2 || depth > (int)kMaxZslDepth) {
+        ALOGW("%s: Ignoring camera.zsl.depth %d, outside [2, %zu]",
+                __FUNCTION__, depth, kMaxZslDepth);
+        return defaultDepth;
+    }
+    return depth;
+}
+
 }; //namespace camera2
 }; //namespace android
 
@@ -56,6 +56,13 @@ public:
 
     // (Debugging only) Dump the current state to the specified file descriptor
     virtual void dump(int fd, const Vector<String16>& args) const = 0;
+
+    // Upper bound for the number of buffers kept for ZSL selection
+    static const size_t kMaxZslDepth = 32;
+
+    // Number of ZSL buffers to keep; camera.zsl.depth overrides defaultDepth
+    // so longer ZSL history can be kept, within [2, kMaxZslDepth]
+    static size_t getZslDepth(size_t defaultDepth);
 };
 
 }; //namespace camera2
@@ -90,7 +90,8 @@ status_t CameraDeviceClient::initialize(CameraModule *module)
     mFrameProcessor->registerListener(FRAME_PROCESSOR_LISTENER_MIN_ID,
                                       FRAME_PROCESSOR_LISTENER_MAX_ID,
                                       /*listener*/this,
-                                      /*sendPartials*/true);
+                                      /*sendPartials*/true,
+                                      /*asyncDelivery*/true);
 
     return OK;
 }
@@ -18,6 +18,10 @@
 #define ATRACE_TAG ATRACE_TAG_CAMERA
 //#define LOG_NDEBUG 0
 
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
@@ -44,13 +48,21 @@ FrameProcessorBase::FrameProcessorBase(wp<CameraDeviceBase> device) :
 
 FrameProcessorBase::~FrameProcessorBase() {
     ALOGV("%s: Exit", __FUNCTION__);
+    sp<ListenerSet> listeners = getListeners();
+    if (listeners != NULL) {
+        for (size_t i = 0; i < listeners->listeners.size(); i++) {
+            listeners->listeners[i]->stop();
+        }
+    }
 }
 
 status_t FrameProcessorBase::registerListener(int32_t minId,
-        int32_t maxId, wp<FilteredListener> listener, bool sendPartials) {
+        int32_t maxId, wp<FilteredListener> listener, bool sendPartials,
+        bool asyncDelivery) {
     Mutex::Autolock l(mInputMutex);
-    List<RangeListener>::iterator item = mRangeListeners.begin();
-    while (item != mRangeListeners.end()) {
+    size_t count = mListeners != NULL ? mListeners->listeners.size() : 0;
+    for (size_t i = 0; i < count; i++) {
+        const sp<RangeListener>& item = mListeners->listeners[i];
         if (item->minId == minId &&
                 item->maxId == maxId &&
                 item->listener == listener) {
@@ -59,34 +71,104 @@ status_t FrameProcessorBase::registerListener(int32_t minId,
                     __FUNCTION__);
             return OK;
         }
-        item++;
     }
-    ALOGV("%s: Registering listener for frame id range %d - %d",
-            __FUNCTION__, minId, maxId);
-    RangeListener rListener = { minId, maxId, listener, sendPartials };
-    mRangeListeners.push_back(rListener);
+    ALOGV("%s: Registering %s listener for frame id range %d - %d",
+            __FUNCTION__, asyncDelivery ? "async" : "sync", minId, maxId);
+    sp<RangeListener> rListener = new RangeListener(minId, maxId, listener,
+            sendPartials, asyncDelivery);
+    if (asyncDelivery) {
+        sp<CameraDeviceBase> device = mDevice.promote();
+        String8 name = String8::format("Cam%d-Results",
+                device != 0 ? device->getId() : -1);
+        status_t res = rListener->start(name.string());
+        if (res != OK) {
+            ALOGE("%s: Unable to start result delivery thread: %s (%d)",
+                    __FUNCTION__, strerror(-res), res);
+            return res;
+        }
+    }
+
+    // Copy on write; the delivery path may still be using the old set
+    sp<ListenerSet> listeners = new ListenerSet();
+    listeners->listeners.setCapacity(count + 1);
+    for (size_t i = 0; i < count; i++) {
+        listeners->listeners.push_back(mListeners->listeners[i]);
+    }
+    listeners->listeners.push_back(rListener);
+    mListeners = listeners;
     return OK;
 }
 
 status_t FrameProcessorBase::removeListener(int32_t minId,
                                            int32_t maxId,
                                            wp<FilteredListener> listener) {
-    Mutex::Autolock l(mInputMutex);
-    List<RangeListener>::iterator item = mRangeListeners.begin();
-    while (item != mRangeListeners.end()) {
-        if (item->minId == minId &&
-                item->maxId == maxId &&
-                item->listener == listener) {
-            item = mRangeListeners.erase(item);
-        } else {
-            item++;
+    Vector<sp<RangeListener> > removed;
+    {
+        Mutex::Autolock l(mInputMutex);
+        if (mListeners == NULL) return OK;
+
+        sp<ListenerSet> listeners = new ListenerSet();
+        for (size_t i = 0; i < mListeners->listeners.size(); i++) {
+            const sp<RangeListener>& item = mListeners->listeners[i];
+            if (item->minId == minId &&
+                    item->maxId == maxId &&
+                    item->listener == listener) {
+                removed.push_back(item);
+            } else {
+                listeners->listeners.push_back(item);
+            }
         }
+        if (removed.isEmpty()) return OK;
+        mListeners = listeners;
+    }
+
+    // Wait for any in-progress asynchronous delivery outside of the lock.
+    // A synchronous listener may still be getting a result the frame
+    // processor thread picked up before it was removed.
+    for (size_t i = 0; i < removed.size(); i++) {
+        removed[i]->stop();
     }
     return OK;
 }
 
+sp<FrameProcessorBase::ListenerSet> FrameProcessorBase::getListeners() {
+    Mutex::Autolock l(mInputMutex);
+    return mListeners;
+}
+
+void FrameProcessorBase::pruneListeners() {
+    Vector<sp<RangeListener> > removed;
+    {
+        Mutex::Autolock l(mInputMutex);
+        if (mListeners == NULL) return;
+
+        sp<ListenerSet> listeners = new ListenerSet();
+        for (size_t i = 0; i < mListeners->listeners.size(); i++) {
+            const sp<RangeListener>& item = mListeners->listeners[i];
+            if (item->isDead()) {
+                removed.push_back(item);
+            } else {
+                listeners->listeners.push_back(item);
+            }
+        }
+        mListeners = listeners;
+    }
+    for (size_t i = 0; i < removed.size(); i++) {
+        removed[i]->stop();
+    }
+}
+
 void FrameProcessorBase::dump(int fd, const Vector<String16>& /*args*/) {
-    String8 result("    Latest received frame:\n");
+    String8 result("    Result listeners:\n");
+    sp<ListenerSet> listeners = getListeners();
+    if (listeners == NULL || listeners->listeners.isEmpty()) {
+        result.append("      None\n");
+    } else {
+        for (size_t i = 0; i < listeners->listeners.size(); i++) {
+            listeners->listeners[i]->dump(result);
+        }
+    }
+    result.append("    Latest received frame:\n");
     write(fd, result.string(), result.size());
 
     CameraMetadata lastFrame;
@@ -195,35 +277,228 @@ status_t FrameProcessorBase::processListeners(const CaptureResult &result,
     }
     int32_t requestId = entry.data.i32[0];
 
-    List<sp<FilteredListener> > listeners;
-    {
-        Mutex::Autolock l(mInputMutex);
+    sp<ListenerSet> listeners = getListeners();
+    if (listeners == NULL) return OK;
 
-        List<RangeListener>::iterator item = mRangeListeners.begin();
+    nsecs_t publishTime = systemTime();
+    bool pruneNeeded = false;
+    size_t count = 0;
+    for (size_t i = 0; i < listeners->listeners.size(); i++) {
+        const sp<RangeListener>& item = listeners->listeners[i];
         // Don't deliver partial results to listeners that don't want them
-        while (item != mRangeListeners.end()) {
-            if (requestId >= item->minId && requestId < item->maxId &&
-                    (!isPartialResult || item->sendPartials)) {
-                sp<FilteredListener> listener = item->listener.promote();
-                if (listener == 0) {
-                    item = mRangeListeners.erase(item);
-                    continue;
-                } else {
-                    listeners.push_back(listener);
-                }
-            }
-            item++;
+        if (requestId >= item->minId && requestId < item->maxId &&
+                (!isPartialResult || item->sendPartials)) {
+            item->publish(result, isPartialResult, publishTime);
+            count++;
         }
+        pruneNeeded |= item->isDead();
     }
     ALOGV("%s: Camera %d: Got %zu range listeners out of %zu", __FUNCTION__,
-          device->getId(), listeners.size(), mRangeListeners.size());
+          device->getId(), count, listeners->listeners.size());
 
-    List<sp<FilteredListener> >::iterator item = listeners.begin();
-    for (; item != listeners.end(); item++) {
-        (*item)->onResultAvailable(result);
+    if (pruneNeeded) {
+        pruneListeners();
     }
     return OK;
 }
 
+FrameProcessorBase::RangeListener::RangeListener(int32_t minId, int32_t maxId,
+        const wp<FilteredListener>& listener, bool sendPartials,
+        bool asyncDelivery) :
+        minId(minId),
+        maxId(maxId),
+        listener(listener),
+        sendPartials(sendPartials),
+        mHead(0),
+        mTail(0),
+        mWaiting(0),
+        mProducerWaiting(0),
+        mStopping(0),
+        mDead(0),
+        mDelivered(0),
+        mDropped(0),
+        mMaxQueued(0) {
+    if (asyncDelivery) {
+        mThread = new DeliveryThread(wp<RangeListener>(this));
+    }
+}
+
+FrameProcessorBase::RangeListener::~RangeListener() {
+    stop();
+}
+
+bool FrameProcessorBase::RangeListener::isDead() const {
+    return android_atomic_acquire_load(&mDead) != 0;
+}
+
+status_t FrameProcessorBase::RangeListener::start(const char *name) {
+    if (mThread == NULL) return OK;
+    return mThread->run(name);
+}
+
+void FrameProcessorBase::RangeListener::stop() {
+    if (mThread == NULL) return;
+    mThread->requestExit();
+    {
+        Mutex::Autolock l(mWaitLock);
+        android_atomic_release_store(1, &mStopping);
+        mQueueSignal.signal();
+        mSpaceSignal.signal();
+    }
+    if (mThread->isCurrentThread()) {
+        // A listener dropped the last reference to itself from its own
+        // callback. The thread holds no reference to this object past the
+        // callback and exits on its own; joining it here would not return.
+        ALOGV("%s: Result listener [%d, %d) stopped from its own thread",
+                __FUNCTION__, minId, maxId);
+        return;
+    }
+    mThread->join();
+}
+
+void FrameProcessorBase::RangeListener::publish(const CaptureResult &result,
+        bool isPartialResult, nsecs_t publishTime) {
+    if (mThread == NULL) {
+        deliver(result, publishTime);
+        return;
+    }
+
+    int32_t tail = mTail;
+    int32_t queued = tail - android_atomic_acquire_load(&mHead);
+    if (queued >= kQueueDepth && isPartialResult) {
+        mDropped++;
+        ALOGW("%s: Result listener [%d, %d) is %d results behind, dropping"
+                " partial result of frame %" PRId64, __FUNCTION__, minId,
+                maxId, queued, result.mResultExtras.frameNumber);
+        return;
+    }
+    if (queued >= kQueueDepth) {
+        // Final results are never dropped: wait for the delivery thread to
+        // make room, unless the listener is going away
+        ALOGW("%s: Result listener [%d, %d) is %d results behind, waiting"
+                " to queue frame %" PRId64, __FUNCTION__, minId, maxId, queued,
+                result.mResultExtras.frameNumber);
+        Mutex::Autolock l(mWaitLock);
+        android_atomic_release_store(1, &mProducerWaiting);
+        android_memory_barrier();
+        while ((queued = tail - android_atomic_acquire_load(&mHead)) >=
+                kQueueDepth) {
+            if (android_atomic_acquire_load(&mStopping) || isDead()) {
+                android_atomic_release_store(0, &mProducerWaiting);
+                mDropped++;
+                return;
+            }
+            mSpaceSignal.waitRelative(mWaitLock, kWaitDuration);
+        }
+        android_atomic_release_store(0, &mProducerWaiting);
+    }
+    CaptureResult &slot = mQueue[tail & (kQueueDepth - 1)];
+    slot.mMetadata = result.mMetadata;
+    slot.mResultExtras = result.mResultExtras;
+    mQueueTimes[tail & (kQueueDepth - 1)] = publishTime;
+    android_atomic_release_store(tail + 1, &mTail);
+    if (queued + 1 > mMaxQueued) mMaxQueued = queued + 1;
+
+    // Pairs with the barrier in waitForResult(): either the delivery thread
+    // sees the new tail, or this sees it waiting and wakes it up.
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&mWaiting)) {
+        Mutex::Autolock l(mWaitLock);
+        mQueueSignal.signal();
+    }
+}
+
+void FrameProcessorBase::RangeListener::deliver(const CaptureResult &result,
+        nsecs_t publishTime) {
+    sp<FilteredListener> target = listener.promote();
+    if (target == 0) {
+        android_atomic_release_store(1, &mDead);
+        return;
+    }
+    target->onResultAvailable(result);
+    mLatency.record(systemTime() - publishTime);
+    mDelivered++;
+}
+
+bool FrameProcessorBase::RangeListener::waitForResult(nsecs_t timeout) {
+    if (android_atomic_acquire_load(&mTail) != mHead) return true;
+
+    Mutex::Autolock l(mWaitLock);
+    android_atomic_release_store(1, &mWaiting);
+    android_memory_barrier();
+    bool ready = android_atomic_acquire_load(&mTail) != mHead;
+    if (!ready && !android_atomic_acquire_load(&mStopping)) {
+        mQueueSignal.waitRelative(mWaitLock, timeout);
+        ready = android_atomic_acquire_load(&mTail) != mHead;
+    }
+    android_atomic_release_store(0, &mWaiting);
+    return ready;
+}
+
+void FrameProcessorBase::RangeListener::deliverQueued() {
+    int32_t tail = android_atomic_acquire_load(&mTail);
+    int32_t head = mHead;
+    while (head != tail && !android_atomic_acquire_load(&mStopping)) {
+        CaptureResult &slot = mQueue[head & (kQueueDepth - 1)];
+        if (!isDead()) {
+            deliver(slot, mQueueTimes[head & (kQueueDepth - 1)]);
+        }
+        // Don't hold on to the metadata until the slot is reused
+        slot.mMetadata.clear();
+        head++;
+        android_atomic_release_store(head, &mHead);
+
+        // Pairs with the barrier in publish()
+        android_memory_barrier();
+        if (android_atomic_acquire_load(&mProducerWaiting)) {
+            Mutex::Autolock l(mWaitLock);
+            mSpaceSignal.signal();
+        }
+    }
+}
+
+void FrameProcessorBase::RangeListener::dump(String8& lines) const {
+    int32_t queued = android_atomic_acquire_load(&mTail) -
+            android_atomic_acquire_load(&mHead);
+    lines.appendFormat("      Range [%d, %d)%s: %s, delivered %u",
+            minId, maxId, sendPartials ? " +partials" : "",
+            isAsync() ? "async" : "sync", mDelivered);
+    if (mThread != NULL) {
+        lines.appendFormat(", queued %d (max %d/%d), dropped %u",
+                queued, mMaxQueued, kQueueDepth, mDropped);
+    }
+    lines.append("\n");
+    mLatency.dump(lines, "Delivery latency", "        ");
+}
+
+FrameProcessorBase::RangeListener::DeliveryThread::DeliveryThread(
+        const wp<RangeListener>& parent) :
+        Thread(/*canCallJava*/false),
+        mParent(parent),
+        mThreadId(0) {
+}
+
+bool FrameProcessorBase::RangeListener::DeliveryThread::isCurrentThread() const {
+    return android_atomic_acquire_load(&mThreadId) == gettid();
+}
+
+status_t FrameProcessorBase::RangeListener::DeliveryThread::readyToRun() {
+    android_atomic_release_store(gettid(), &mThreadId);
+    return OK;
+}
+
+bool FrameProcessorBase::RangeListener::DeliveryThread::threadLoop() {
+    // If this drops the last reference, the listener is destroyed here, on
+    // this thread, after the callback has returned
+    sp<RangeListener> parent = mParent.promote();
+    if (parent == 0) {
+        return false;
+    }
+    if (parent->waitForResult(kWaitDuration)) {
+        parent->deliverQueued();
+    }
+    return true;
+}
+
 }; // namespace camera2
 }; // namespace android
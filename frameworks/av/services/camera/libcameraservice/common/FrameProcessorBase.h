@@ -22,9 +22,13 @@
 #include <utils/Vector.h>
 #include <utils/KeyedVector.h>
 #include <utils/List.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
 #include <camera/CameraMetadata.h>
 #include <camera/CaptureResult.h>
 
+#include "utils/LatencyHistogram.h"
+
 namespace android {
 
 class CameraDeviceBase;
@@ -47,9 +51,13 @@ class FrameProcessorBase: public Thread {
     // can be listening to the same range. Registering the same listener with
     // the same range of IDs has no effect.
     // sendPartials controls whether partial results will be sent.
+    // asyncDelivery gives the listener its own result queue and delivery
+    // thread, so a listener that may block (e.g. on a binder call into the
+    // app) can't delay results to the other listeners.
     status_t registerListener(int32_t minId, int32_t maxId,
                               wp<FilteredListener> listener,
-                              bool sendPartials = true);
+                              bool sendPartials = true,
+                              bool asyncDelivery = false);
     status_t removeListener(int32_t minId, int32_t maxId,
                             wp<FilteredListener> listener);
 
@@ -63,13 +71,108 @@ class FrameProcessorBase: public Thread {
     Mutex mInputMutex;
     Mutex mLastFrameMutex;
 
-    struct RangeListener {
-        int32_t minId;
-        int32_t maxId;
-        wp<FilteredListener> listener;
-        bool sendPartials;
+    /**
+     * A registered listener and its delivery statistics. The range and
+     * listener never change after registration.
+     *
+     * Synchronous listeners are called on the frame processor thread.
+     * Asynchronous ones get a single producer (frame processor thread) /
+     * single consumer (delivery thread) ring of results. When the ring is
+     * full, partial results are dropped for that listener only and counted;
+     * final results wait for room, since clients rely on getting every one.
+     */
+    class RangeListener: public RefBase {
+      public:
+        RangeListener(int32_t minId, int32_t maxId,
+                const wp<FilteredListener>& listener, bool sendPartials,
+                bool asyncDelivery);
+        ~RangeListener();
+
+        const int32_t minId;
+        const int32_t maxId;
+        const wp<FilteredListener> listener;
+        const bool sendPartials;
+
+        bool isAsync() const { return mThread != NULL; }
+        // Set once the listener has gone away
+        bool isDead() const;
+
+        // Frame processor thread only. Calls the listener or queues the
+        // result for the delivery thread.
+        void publish(const CaptureResult &result, bool isPartialResult,
+                nsecs_t publishTime);
+
+        // Start/stop the delivery thread of an asynchronous listener. Once
+        // stop() returns no more callbacks arrive, unless it is called from
+        // the delivery thread itself, in which case the thread is left to
+        // exit on its own.
+        status_t start(const char *name);
+        void stop();
+
+        void dump(String8& lines) const;
+
+      private:
+        class DeliveryThread: public Thread {
+          public:
+            DeliveryThread(const wp<RangeListener>& parent);
+            // True when called on this thread
+            bool isCurrentThread() const;
+          private:
+            virtual status_t readyToRun();
+            virtual bool threadLoop();
+            // Weak, so that the last reference to the listener may be
+            // dropped during a callback on this thread
+            const wp<RangeListener> mParent;
+            volatile int32_t mThreadId;
+        };
+        friend class DeliveryThread;
+
+        // Power of two. A few frames' worth of partial and final results.
+        static const int32_t kQueueDepth = 64;
+
+        void deliver(const CaptureResult &result, nsecs_t publishTime);
+        // Delivery thread only. Returns false if the wait timed out.
+        bool waitForResult(nsecs_t timeout);
+        void deliverQueued();
+
+        sp<DeliveryThread> mThread;
+
+        // Ring state; mTail is written by the producer, mHead by the consumer
+        CaptureResult mQueue[kQueueDepth];
+        nsecs_t mQueueTimes[kQueueDepth];
+        volatile int32_t mHead;
+        volatile int32_t mTail;
+        // Set while the delivery thread is about to sleep on mQueueSignal
+        volatile int32_t mWaiting;
+        // Set while the producer waits on mSpaceSignal for room in the ring
+        volatile int32_t mProducerWaiting;
+        Mutex mWaitLock;
+        Condition mQueueSignal;
+        Condition mSpaceSignal;
+
+        volatile int32_t mStopping;
+        volatile int32_t mDead;
+
+        // Written by a single thread each, read racily by dump()
+        uint32_t mDelivered;
+        uint32_t mDropped;
+        int32_t mMaxQueued;
+        LatencyHistogram mLatency;
+    };
+
+    /**
+     * Immutable list of listeners. Registration builds a new one and swaps
+     * it in under mInputMutex, so result delivery only holds the lock long
+     * enough to take a reference.
+     */
+    struct ListenerSet: public LightRefBase<ListenerSet> {
+        Vector<sp<RangeListener> > listeners;
     };
-    List<RangeListener> mRangeListeners;
+    sp<ListenerSet> mListeners;
+
+    sp<ListenerSet> getListeners();
+    // Drop listeners whose target has gone away
+    void pruneListeners();
 
     // Number of partial result the HAL will potentially send.
     int32_t mNumPartialResults;
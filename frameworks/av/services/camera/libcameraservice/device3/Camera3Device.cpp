@@ -42,6 +42,7 @@
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include <utils/Timers.h>
+#include <camera/CameraFrameTrace.h>
 
 #include "utils/CameraTraces.h"
 #include "mediautils/SchedulingPolicyService.h"
@@ -217,6 +218,8 @@ status_t Camera3Device::initialize(CameraModule *module)
         }
     }
 
+    updateInFlightCapacityLocked();
+
     camera_metadata_entry configs =
             mDeviceInfo.find(ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS);
     for (uint32_t i = 0; i < configs.count; i += 4) {
@@ -469,17 +472,33 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
         mOutputStreams[i]->dump(fd,args);
     }
 
-    lines = String8("    In-flight requests:\n");
-    if (mInFlightMap.size() == 0) {
-        lines.append("      None\n");
+    // Walking the map must not race removals or a rehash, so skip it without the lock
+    bool gotInFlightLock = tryLockSpinRightRound(mInFlightLock);
+    if (!gotInFlightLock) {
+        ALOGW("Camera %d: %s: Unable to lock in-flight lock, skipping in-flight requests",
+                mId, __FUNCTION__);
+        lines = String8("    In-flight requests: unavailable (lock not taken)\n");
     } else {
-        for (size_t i = 0; i < mInFlightMap.size(); i++) {
-            InFlightRequest r = mInFlightMap.valueAt(i);
-            lines.appendFormat("      Frame %d |  Timestamp: %" PRId64 ", metadata"
-                    " arrived: %s, buffers left: %d\n", mInFlightMap.keyAt(i),
-                    r.shutterTimestamp, r.haveResultMetadata ? "true" : "false",
-                    r.numBuffersLeft);
+        lines = String8::format("    In-flight requests (table capacity %zu):\n",
+                mInFlightMap.capacity());
+        if (mInFlightMap.size() == 0) {
+            lines.append("      None\n");
+        } else {
+            for (ssize_t i = mInFlightMap.oldestIndex(); i >= 0;
+                    i = mInFlightMap.nextIndex(i)) {
+                const InFlightRequest &r = mInFlightMap.valueAt(i);
+                lines.appendFormat("      Frame %d |  Timestamp: %" PRId64 ", metadata"
+                        " arrived: %s, buffers left: %d\n", mInFlightMap.keyAt(i),
+                        r.shutterTimestamp, r.haveResultMetadata ? "true" : "false",
+                        r.numBuffersLeft);
+            }
         }
+        mInFlightLockStats.dump(lines, "In-flight lock", "    ");
+        mInFlightLock.unlock();
+    }
+    if (mRequestThread != NULL) {
+        lines.append("    Request thread:\n");
+        mRequestThread->dumpStats(lines, "      ");
     }
     write(fd, lines.string(), lines.size());
 
@@ -574,7 +593,8 @@ status_t Camera3Device::convertMetadataListToRequestListLocked(
         for (auto& outputStream : (*firstRequest)->mOutputStreams) {
             if (outputStream->isVideoStream()) {
                 (*firstRequest)->mBatchSize = requestList->size();
-                break;
+                // Move the video buffers of a batch in one call each way
+                outputStream->setBatchSize(requestList->size());
             }
         }
     }
@@ -1787,6 +1807,8 @@ status_t Camera3Device::configureStreamsLocked() {
 
     mNeedConfig = false;
 
+    updateInFlightCapacityLocked();
+
     internalUpdateStatusLocked((mDummyStreamId == NO_STREAM) ?
             STATUS_CONFIGURED : STATUS_UNCONFIGURED);
 
@@ -1917,7 +1939,7 @@ status_t Camera3Device::registerInFlight(uint32_t frameNumber,
         int32_t numBuffers, CaptureResultExtras resultExtras, bool hasInput,
         const AeTriggerCancelOverride_t &aeTriggerCancelOverride) {
     ATRACE_CALL();
-    Mutex::Autolock l(mInFlightLock);
+    ProfiledAutolock l(mInFlightLock, mInFlightLockStats);
 
     ssize_t res;
     res = mInFlightMap.add(frameNumber, InFlightRequest(numBuffers, resultExtras, hasInput,
@@ -1927,6 +1949,25 @@ status_t Camera3Device::registerInFlight(uint32_t frameNumber,
     return OK;
 }
 
+void Camera3Device::updateInFlightCapacityLocked() {
+    size_t depth = 1;
+    camera_metadata_entry pipelineDepth =
+            mDeviceInfo.find(ANDROID_REQUEST_PIPELINE_MAX_DEPTH);
+    if (pipelineDepth.count > 0 && pipelineDepth.data.u8[0] > 0) {
+        depth = pipelineDepth.data.u8[0];
+    }
+
+    // In high speed mode every pipeline stage may hold a whole batch
+    size_t capacity = mIsConstrainedHighSpeedConfiguration ?
+            depth * kHighSpeedMaxBatchSize : depth;
+    if (capacity < kInFlightWarnLimit) {
+        capacity = kInFlightWarnLimit;
+    }
+
+    ProfiledAutolock l(mInFlightLock, mInFlightLockStats);
+    mInFlightMap.setCapacity(capacity);
+}
+
 /**
  * Check if all 3A fields are ready, and send off a partial 3A-only result
  * to the output frame queue
@@ -2099,7 +2140,10 @@ bool Camera3Device::insert3AResult(CameraMetadata& result, int32_t tag,
 
 void Camera3Device::returnOutputBuffers(
         const camera3_stream_buffer_t *outputBuffers, size_t numBuffers,
-        nsecs_t timestamp) {
+        nsecs_t timestamp, uint32_t frameNumber) {
+    if (numBuffers > 0) {
+        camera_frame_trace(CAMERA_FRAME_TRACE_RETURN_BUFFERS, mId, frameNumber, numBuffers);
+    }
     for (size_t i = 0; i < numBuffers; i++)
     {
         Camera3Stream *stream = Camera3Stream::cast(outputBuffers[i].stream);
@@ -2146,9 +2190,9 @@ void Camera3Device::removeInFlightRequestIfReadyLocked(int idx) {
         assert(request.requestStatus != OK ||
                request.pendingOutputBuffers.size() == 0);
         returnOutputBuffers(request.pendingOutputBuffers.array(),
-            request.pendingOutputBuffers.size(), 0);
+            request.pendingOutputBuffers.size(), 0, frameNumber);
 
-        mInFlightMap.removeItemsAt(idx, 1);
+        mInFlightMap.removeItemAt(idx);
 
         ALOGVV("%s: removed frame %d from InFlightMap", __FUNCTION__, frameNumber);
      }
@@ -2249,6 +2293,7 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
     status_t res;
 
     uint32_t frameNumber = result->frame_number;
+    camera_frame_trace(CAMERA_FRAME_TRACE_RESULT, mId, frameNumber, result->num_output_buffers);
     if (result->result == NULL && result->num_output_buffers == 0 &&
             result->input_buffer == NULL) {
         SET_ERR("No result data provided by HAL for frame %d",
@@ -2282,7 +2327,7 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
     nsecs_t shutterTimestamp = 0;
 
     {
-        Mutex::Autolock l(mInFlightLock);
+        ProfiledAutolock l(mInFlightLock, mInFlightLockStats);
         ssize_t idx = mInFlightMap.indexOfKey(frameNumber);
         if (idx == NAME_NOT_FOUND) {
             SET_ERR("Unknown frame number for capture result: %d",
@@ -2394,7 +2439,7 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
                 result->num_output_buffers);
         } else {
             returnOutputBuffers(result->output_buffers,
-                result->num_output_buffers, shutterTimestamp);
+                result->num_output_buffers, shutterTimestamp, frameNumber);
         }
 
         if (result->result != NULL && !isPartialResult) {
@@ -2506,7 +2551,7 @@ void Camera3Device::notifyError(const camera3_error_msg_t &msg,
         case ICameraDeviceCallbacks::ERROR_CAMERA_RESULT:
         case ICameraDeviceCallbacks::ERROR_CAMERA_BUFFER:
             {
-                Mutex::Autolock l(mInFlightLock);
+                ProfiledAutolock l(mInFlightLock, mInFlightLockStats);
                 ssize_t idx = mInFlightMap.indexOfKey(msg.frame_number);
                 if (idx >= 0) {
                     InFlightRequest &r = mInFlightMap.editValueAt(idx);
@@ -2539,7 +2584,7 @@ void Camera3Device::notifyShutter(const camera3_shutter_msg_t &msg,
     // Set timestamp for the request in the in-flight tracking
     // and get the request ID to send upstream
     {
-        Mutex::Autolock l(mInFlightLock);
+        ProfiledAutolock l(mInFlightLock, mInFlightLockStats);
         idx = mInFlightMap.indexOfKey(msg.frame_number);
         if (idx >= 0) {
             InFlightRequest &r = mInFlightMap.editValueAt(idx);
@@ -2582,7 +2627,7 @@ void Camera3Device::notifyShutter(const camera3_shutter_msg_t &msg,
                 r.partialResult.collectedResult, msg.frame_number,
                 r.hasInputBuffer, r.aeTriggerCancelOverride);
             returnOutputBuffers(r.pendingOutputBuffers.array(),
-                r.pendingOutputBuffers.size(), r.shutterTimestamp);
+                r.pendingOutputBuffers.size(), r.shutterTimestamp, msg.frame_number);
             r.pendingOutputBuffers.clear();
 
             removeInFlightRequestIfReadyLocked(idx);
@@ -2629,7 +2674,11 @@ Camera3Device::RequestThread::RequestThread(wp<Camera3Device> parent,
         mCurrentAfTriggerId(0),
         mCurrentPreCaptureTriggerId(0),
         mRepeatingLastFrameNumber(NO_IN_FLIGHT_REPEATING_FRAMES),
-        mAeLockAvailable(aeLockAvailable) {
+        mAeLockAvailable(aeLockAvailable),
+        mBufferPrefetcher(new BufferPrefetcher()),
+        mSettingsSent(0),
+        mSettingsRepeated(0),
+        mSettingsMatched(0) {
     mStatusId = statusTracker->addComponent();
 }
 
@@ -2917,10 +2966,12 @@ bool Camera3Device::RequestThread::threadLoop() {
     }
 
     // Wait for the next batch of requests.
+    nsecs_t waitStart = systemTime();
     waitForNextRequestBatch();
     if (mNextRequests.size() == 0) {
         return true;
     }
+    mWaitTime.record(systemTime() - waitStart);
 
     // Get the latest request ID, if any
     int latestRequestId;
@@ -2965,13 +3016,21 @@ bool Camera3Device::RequestThread::threadLoop() {
         mFlushLock.lock();
     }
 
+    // Let the buffer queues catch up for the next request while the HAL works on this batch
+    prefetchNextRequestBuffers();
+
     ALOGVV("%s: %d: submitting %d requests in a batch.", __FUNCTION__, __LINE__,
             mNextRequests.size());
     for (auto& nextRequest : mNextRequests) {
         // Submit request and block until ready for next one
         ATRACE_ASYNC_BEGIN("frame capture", nextRequest.halRequest.frame_number);
         ATRACE_BEGIN("camera3->process_capture_request");
+        camera_frame_trace(CAMERA_FRAME_TRACE_REQUEST_SUBMIT, mId,
+                nextRequest.halRequest.frame_number,
+                nextRequest.halRequest.num_output_buffers);
+        nsecs_t submitStart = systemTime();
         res = mHal3Device->ops->process_capture_request(mHal3Device, &nextRequest.halRequest);
+        mSubmitTime.record(systemTime() - submitStart);
         ATRACE_END();
 
         if (res != OK) {
@@ -3041,6 +3100,8 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
         // Prepare a request to HAL
         halRequest->frame_number = captureRequest->mResultExtras.frameNumber;
 
+        nsecs_t triggerStart = systemTime();
+
         // Insert any queued triggers (before metadata is locked)
         status_t res = insertTriggers(captureRequest);
 
@@ -3054,8 +3115,15 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
         bool triggersMixedIn = (triggerCount > 0 || mPrevTriggers > 0);
         mPrevTriggers = triggerCount;
 
-        // If the request is the same as last, or we had triggers last time
-        if (mPrevRequest != captureRequest || triggersMixedIn) {
+        // A different request whose settings match the last ones sent can also reuse them.
+        // Reprocess requests must always carry their settings.
+        bool isReprocess = captureRequest->mInputStream != NULL;
+        bool reuseSettings = !triggersMixedIn && !isReprocess &&
+                (mPrevRequest == captureRequest ||
+                isSameAsPrevSettings(captureRequest->mSettings));
+
+        // Send new settings unless they are the same as last time, with no triggers involved
+        if (!reuseSettings) {
             /**
              * HAL workaround:
              * Insert a dummy trigger ID if a trigger is set but no trigger ID is
@@ -3075,6 +3143,14 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
             captureRequest->mSettings.sort();
             halRequest->settings = captureRequest->mSettings.getAndLock();
             mPrevRequest = captureRequest;
+            if (isReprocess) {
+                // The settings of a reprocess request describe the input
+                // buffer, don't let the next regular request match them
+                mPrevSettings.clear();
+            } else {
+                mPrevSettings = halRequest->settings;
+            }
+            mSettingsSent++;
             ALOGVV("%s: Request settings are NEW", __FUNCTION__);
 
             IF_ALOGV() {
@@ -3093,10 +3169,19 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
             }
         } else {
             // leave request.settings NULL to indicate 'reuse latest given'
+            if (mPrevRequest == captureRequest) {
+                mSettingsRepeated++;
+            } else {
+                mPrevRequest = captureRequest;
+                mSettingsMatched++;
+            }
             ALOGVV("%s: Request settings are REUSED",
                    __FUNCTION__);
         }
 
+        nsecs_t bufferStart = systemTime();
+        mTriggerTime.record(bufferStart - triggerStart);
+
         uint32_t totalNumBuffers = 0;
 
         // Fill in buffers
@@ -3111,8 +3196,12 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
                 captureRequest->mOutputStreams.size());
         halRequest->output_buffers = outputBuffers->array();
         for (size_t i = 0; i < captureRequest->mOutputStreams.size(); i++) {
-            res = captureRequest->mOutputStreams.editItemAt(i)->
-                    getBuffer(&outputBuffers->editItemAt(i));
+            const sp<Camera3OutputStreamInterface>& outputStream =
+                    captureRequest->mOutputStreams[i];
+            res = mBufferPrefetcher->takeBuffer(outputStream, &outputBuffers->editItemAt(i));
+            if (res == NAME_NOT_FOUND) {
+                res = outputStream->getBuffer(&outputBuffers->editItemAt(i));
+            }
             if (res != OK) {
                 // Can't get output buffer from gralloc queue - this could be due to
                 // abandoned queue or other consumer misbehavior, so not a fatal
@@ -3125,6 +3214,7 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
             halRequest->num_output_buffers++;
         }
         totalNumBuffers += halRequest->num_output_buffers;
+        mBufferTime.record(systemTime() - bufferStart);
 
         // Log request in the in-flight queue
         sp<Camera3Device> parent = mParent.promote();
@@ -3149,9 +3239,73 @@ status_t Camera3Device::RequestThread::prepareHalRequests() {
         }
     }
 
+    // Anything left over was prefetched for a request that did not come next
+    mBufferPrefetcher->releaseAll();
+
     return OK;
 }
 
+bool Camera3Device::RequestThread::isSameAsPrevSettings(const CameraMetadata& settings) {
+    size_t entryCount = mPrevSettings.entryCount();
+    if (entryCount == 0 || settings.entryCount() != entryCount) {
+        return false;
+    }
+
+    // Resending a trigger would fire it again, so never fold those into 'same as last'
+    camera_metadata_ro_entry_t e = settings.find(ANDROID_CONTROL_AF_TRIGGER);
+    if (e.count > 0 && e.data.u8[0] != ANDROID_CONTROL_AF_TRIGGER_IDLE) {
+        return false;
+    }
+    e = settings.find(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER);
+    if (e.count > 0 && e.data.u8[0] != ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE) {
+        return false;
+    }
+
+    // Tags are unique, so equal entry counts and every previous entry found with the same
+    // contents means the settings are identical. find() is a binary search on sorted settings.
+    const camera_metadata_t *prev = mPrevSettings.getAndLock();
+    bool same = true;
+    for (size_t i = 0; same && i < entryCount; i++) {
+        camera_metadata_ro_entry_t prevEntry;
+        get_camera_metadata_ro_entry(prev, i, &prevEntry);
+        if (prevEntry.count == 0) {
+            same = settings.exists(prevEntry.tag);
+            continue;
+        }
+        camera_metadata_ro_entry_t entry = settings.find(prevEntry.tag);
+        same = entry.count == prevEntry.count && entry.type == prevEntry.type &&
+                memcmp(entry.data.u8, prevEntry.data.u8,
+                        entry.count * camera_metadata_type_size[entry.type]) == 0;
+    }
+    mPrevSettings.unlock(prev);
+    return same;
+}
+
+void Camera3Device::RequestThread::prefetchNextRequestBuffers() {
+    sp<CaptureRequest> nextRequest;
+    {
+        Mutex::Autolock l(mRequestLock);
+        if (!mRequestQueue.empty()) {
+            nextRequest = *mRequestQueue.begin();
+        } else if (!mRepeatingRequests.empty()) {
+            nextRequest = *mRepeatingRequests.begin();
+        }
+    }
+    if (nextRequest != nullptr) {
+        mBufferPrefetcher->prefetch(nextRequest);
+    }
+}
+
+void Camera3Device::RequestThread::dumpStats(String8& lines, const char* indent) const {
+    lines.appendFormat("%sRequest settings: %" PRIu64 " sent, %" PRIu64 " repeated, %" PRIu64
+            " matched last sent\n", indent, mSettingsSent, mSettingsRepeated, mSettingsMatched);
+    mWaitTime.dump(lines, "Wait for request", indent);
+    mTriggerTime.dump(lines, "Triggers and settings", indent);
+    mBufferTime.dump(lines, "Output buffers", indent);
+    mSubmitTime.dump(lines, "process_capture_request", indent);
+    mBufferPrefetcher->dump(lines, indent);
+}
+
 CameraMetadata Camera3Device::RequestThread::getLatestRequest() const {
     Mutex::Autolock al(mLatestRequestMutex);
 
@@ -3305,6 +3459,7 @@ sp<Camera3Device::CaptureRequest>
             Mutex::Autolock pl(mPauseLock);
             if (mPaused == false) {
                 ALOGV("%s: RequestThread: Going idle", __FUNCTION__);
+                mBufferPrefetcher->releaseAll();
                 mPaused = true;
                 // Let the tracker know
                 sp<StatusTracker> statusTracker = mStatusTracker.promote();
@@ -3343,6 +3498,7 @@ sp<Camera3Device::CaptureRequest>
     // request if so. Can't use 'NULL request == repeat' across configure calls.
     if (mReconfigured) {
         mPrevRequest.clear();
+        mPrevSettings.clear();
         mReconfigured = false;
     }
 
@@ -3381,6 +3537,7 @@ bool Camera3Device::RequestThread::waitIfPaused() {
     Mutex::Autolock l(mPauseLock);
     while (mDoPause) {
         if (mPaused == false) {
+            mBufferPrefetcher->releaseAll();
             mPaused = true;
             ALOGV("%s: RequestThread: Paused", __FUNCTION__);
             // Let the tracker know
@@ -3619,6 +3776,179 @@ status_t Camera3Device::RequestThread::addDummyTriggerIds(
     return OK;
 }
 
+/**
+ * BufferPrefetcher inner class methods
+ */
+
+Camera3Device::BufferPrefetcher::BufferPrefetcher() :
+        Thread(/*canCallJava*/false), mDiscardCurrent(false), mActive(false), mHits(0),
+        mMisses(0), mReleased(0) {
+}
+
+Camera3Device::BufferPrefetcher::~BufferPrefetcher() {
+    Thread::requestExitAndWait();
+    releaseAll();
+}
+
+void Camera3Device::BufferPrefetcher::prefetch(const sp<CaptureRequest>& request) {
+    Mutex::Autolock l(mLock);
+
+    bool queued = false;
+    for (const auto& stream : request->mOutputStreams) {
+        if (stream == mCurrentStream && !mDiscardCurrent) continue;
+
+        bool held = false;
+        for (const auto& pending : mPendingStreams) {
+            if (pending == stream) {
+                held = true;
+                break;
+            }
+        }
+        for (size_t i = 0; !held && i < mPrefetched.size(); i++) {
+            held = mPrefetched[i].stream == stream;
+        }
+        if (held) continue;
+
+        mPendingStreams.push_back(stream);
+        queued = true;
+    }
+    if (!queued) return;
+
+    if (!mActive) {
+        // mActive is cleared before the thread fully shuts down, so wait to be sure it
+        // isn't running
+        Thread::requestExitAndWait();
+        status_t res = Thread::run("C3PrefetchThread");
+        if (res != OK) {
+            ALOGE("%s: Unable to start buffer prefetch thread: %s (%d)", __FUNCTION__,
+                    strerror(-res), res);
+            mPendingStreams.clear();
+            return;
+        }
+        mActive = true;
+    }
+    mWorkSignal.signal();
+}
+
+status_t Camera3Device::BufferPrefetcher::takeBuffer(
+        const sp<Camera3OutputStreamInterface>& stream, camera3_stream_buffer_t *buffer) {
+    Mutex::Autolock l(mLock);
+
+    // Not started yet; the caller can just as well dequeue it directly
+    for (size_t i = 0; i < mPendingStreams.size(); i++) {
+        if (mPendingStreams[i] == stream) {
+            mPendingStreams.removeAt(i);
+            break;
+        }
+    }
+    if (mCurrentStream == stream) {
+        // Keep the buffer even if a release asked for the dequeue to be dropped
+        mDiscardCurrent = false;
+        while (mCurrentStream == stream) {
+            mDoneSignal.wait(mLock);
+        }
+    }
+
+    for (size_t i = 0; i < mPrefetched.size(); i++) {
+        if (mPrefetched[i].stream == stream) {
+            status_t res = mPrefetched[i].res;
+            *buffer = mPrefetched[i].buffer;
+            mPrefetched.removeAt(i);
+            if (res == OK) mHits++;
+            return res;
+        }
+    }
+    mMisses++;
+    return NAME_NOT_FOUND;
+}
+
+void Camera3Device::BufferPrefetcher::releaseAll() {
+    Vector<PrefetchedBuffer> prefetched;
+    {
+        Mutex::Autolock l(mLock);
+        mPendingStreams.clear();
+        // Don't wait for a dequeue in progress; its stream may not be used by the request
+        // being prepared, and getBuffer() can block for its full timeout. The thread returns
+        // that buffer itself once it arrives.
+        if (mCurrentStream != nullptr) {
+            mDiscardCurrent = true;
+        }
+        if (mPrefetched.isEmpty()) return;
+        prefetched = mPrefetched;
+        mPrefetched.clear();
+    }
+
+    for (size_t i = 0; i < prefetched.size(); i++) {
+        PrefetchedBuffer& p = prefetched.editItemAt(i);
+        if (p.res != OK) continue;
+        p.buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+        p.stream->returnBuffer(p.buffer, 0);
+
+        Mutex::Autolock l(mLock);
+        mReleased++;
+    }
+}
+
+void Camera3Device::BufferPrefetcher::dump(String8& lines, const char* indent) const {
+    Mutex::Autolock l(mLock);
+    lines.appendFormat("%sBuffer prefetch: %" PRIu64 " used, %" PRIu64 " missed, %" PRIu64
+            " released unused, %zu held\n", indent, mHits, mMisses, mReleased,
+            mPrefetched.size());
+    mDequeueTime.dump(lines, "Prefetch dequeue", indent);
+}
+
+bool Camera3Device::BufferPrefetcher::threadLoop() {
+    PrefetchedBuffer prefetched;
+    {
+        Mutex::Autolock l(mLock);
+        if (mPendingStreams.empty()) {
+            mWorkSignal.waitRelative(mLock, kIdleTimeout);
+            if (mPendingStreams.empty()) {
+                // threadLoop _must not_ re-acquire mLock after it sets mActive to false; would
+                // cause deadlock with prefetch()'s requestExitAndWait triggered by !mActive.
+                mActive = false;
+                return false;
+            }
+        }
+        mCurrentStream = mPendingStreams[0];
+        mPendingStreams.removeAt(0);
+        prefetched.stream = mCurrentStream;
+    }
+
+    ATRACE_BEGIN("camera3 prefetch buffer");
+    nsecs_t start = systemTime();
+    prefetched.buffer = camera3_stream_buffer_t();
+    prefetched.res = prefetched.stream->getBuffer(&prefetched.buffer);
+    nsecs_t dequeueTime = systemTime() - start;
+    ATRACE_END();
+    if (prefetched.res != OK) {
+        ALOGW("%s: Can't prefetch output buffer: %s (%d)", __FUNCTION__,
+                strerror(-prefetched.res), prefetched.res);
+    }
+
+    bool discard;
+    {
+        Mutex::Autolock l(mLock);
+        mDequeueTime.record(dequeueTime);
+        discard = mDiscardCurrent;
+        mDiscardCurrent = false;
+        if (!discard) {
+            mPrefetched.push_back(prefetched);
+        }
+        mCurrentStream.clear();
+        mDoneSignal.broadcast();
+    }
+
+    if (discard && prefetched.res == OK) {
+        prefetched.buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+        prefetched.stream->returnBuffer(prefetched.buffer, 0);
+
+        Mutex::Autolock l(mLock);
+        mReleased++;
+    }
+    return true;
+}
+
 /**
  * PreparerThread inner class methods
  */
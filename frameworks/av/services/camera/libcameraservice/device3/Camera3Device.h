@@ -29,6 +29,9 @@
 
 #include "common/CameraDeviceBase.h"
 #include "device3/StatusTracker.h"
+#include "utils/FrameNumberMap.h"
+#include "utils/LatencyHistogram.h"
+#include "utils/LockStats.h"
 
 /**
  * Function pointer types with C calling convention to
@@ -161,6 +164,7 @@ class Camera3Device :
     static const nsecs_t       kActiveTimeout     = 500000000;  // 500 ms
     static const size_t        kInFlightWarnLimit = 20;
     static const size_t        kInFlightWarnLimitHighSpeed = 256; // batch size 32 * pipe depth 8
+    static const size_t        kHighSpeedMaxBatchSize = 32;
     // SCHED_FIFO priority for request submission thread in HFR mode
     static const int           kConstrainedHighSpeedThreadPriority = 1;
 
@@ -406,6 +410,72 @@ class Camera3Device :
         }
     };
 
+    /**
+     * Background dequeuer for output buffers. While the request thread is blocked in
+     * process_capture_request, it fetches one buffer for each output stream of the next
+     * expected request, so the following prepareHalRequests does not have to wait on the
+     * buffer queues. At most one buffer per stream is held.
+     */
+    class BufferPrefetcher : private Thread, public virtual RefBase {
+      public:
+        BufferPrefetcher();
+        ~BufferPrefetcher();
+
+        /**
+         * Queue the output streams of request for dequeuing. Streams that already have a
+         * buffer prefetched, or queued for it, are skipped.
+         */
+        void prefetch(const sp<CaptureRequest>& request);
+
+        /**
+         * Hand over the buffer prefetched for stream, waiting if its dequeue is in progress.
+         * Returns NAME_NOT_FOUND if nothing was prefetched for the stream, or the error the
+         * background getBuffer() failed with.
+         */
+        status_t takeBuffer(const sp<camera3::Camera3OutputStreamInterface>& stream,
+                camera3_stream_buffer_t *buffer);
+
+        /**
+         * Drop queued work and return all held buffers to their streams in the error state.
+         * Held buffers keep their streams active, so this must be called before the request
+         * thread goes idle. A dequeue in progress is not waited for; its buffer is returned
+         * by the prefetch thread when getBuffer() completes, unless takeBuffer() claims it
+         * first.
+         */
+        void releaseAll();
+
+        void dump(String8& lines, const char* indent) const;
+
+      private:
+        static const nsecs_t kIdleTimeout = 100e6; // 100 ms
+
+        virtual bool threadLoop();
+
+        struct PrefetchedBuffer {
+            sp<camera3::Camera3OutputStreamInterface> stream;
+            camera3_stream_buffer_t buffer;
+            status_t res;
+        };
+
+        mutable Mutex mLock;
+        Condition mWorkSignal;
+        Condition mDoneSignal;
+
+        // Guarded by mLock
+
+        Vector<sp<camera3::Camera3OutputStreamInterface> > mPendingStreams;
+        sp<camera3::Camera3OutputStreamInterface> mCurrentStream;
+        // Return mCurrentStream's buffer instead of holding it; set by releaseAll()
+        bool mDiscardCurrent;
+        Vector<PrefetchedBuffer> mPrefetched;
+        bool mActive;
+
+        uint64_t mHits;
+        uint64_t mMisses;
+        uint64_t mReleased;
+        LatencyHistogram mDequeueTime;
+    };
+
     /**
      * Thread for managing capture request submission to HAL device.
      */
@@ -493,6 +563,12 @@ class Camera3Device :
          */
         bool isStreamPending(sp<camera3::Camera3StreamInterface>& stream);
 
+        /**
+         * Append per-stage timing and settings/buffer reuse counters. Counters are
+         * updated by the request thread only and read here without locking.
+         */
+        void dumpStats(String8& lines, const char* indent) const;
+
       protected:
 
         virtual bool threadLoop();
@@ -551,6 +627,13 @@ class Camera3Device :
         // Handle AE precapture trigger cancel for devices <= CAMERA_DEVICE_API_VERSION_3_2.
         void handleAePrecaptureCancelRequest(sp<CaptureRequest> request);
 
+        // Whether settings match the last settings sent to the HAL, and carry no trigger that
+        // would be re-fired by resending them. Such settings can be sent as NULL.
+        bool               isSameAsPrevSettings(const CameraMetadata& settings);
+
+        // Start dequeuing output buffers for the request expected after the current batch.
+        void               prefetchNextRequestBuffers();
+
         wp<Camera3Device>  mParent;
         wp<camera3::StatusTracker>  mStatusTracker;
         camera3_device_t  *mHal3Device;
@@ -584,6 +667,8 @@ class Camera3Device :
 
         sp<CaptureRequest> mPrevRequest;
         int32_t            mPrevTriggers;
+        // Copy of the last non-NULL settings sent to the HAL; only used by threadLoop
+        CameraMetadata     mPrevSettings;
 
         uint32_t           mFrameNumber;
 
@@ -605,6 +690,17 @@ class Camera3Device :
 
         // Whether the device supports AE lock
         bool               mAeLockAvailable;
+
+        sp<BufferPrefetcher> mBufferPrefetcher;
+
+        // Per-stage timing, only updated by threadLoop
+        LatencyHistogram   mWaitTime;     // waiting for the next request batch
+        LatencyHistogram   mTriggerTime;  // trigger mix-in and settings preparation
+        LatencyHistogram   mBufferTime;   // output buffer acquisition
+        LatencyHistogram   mSubmitTime;   // process_capture_request
+        uint64_t           mSettingsSent;
+        uint64_t           mSettingsRepeated; // same request object as last time
+        uint64_t           mSettingsMatched;  // different request, same contents
     };
     sp<RequestThread> mRequestThread;
 
@@ -656,7 +752,7 @@ class Camera3Device :
             }
         } partialResult;
 
-        // Default constructor needed by KeyedVector
+        // Default constructor needed by FrameNumberMap
         InFlightRequest() :
                 shutterTimestamp(0),
                 sensorTimestamp(0),
@@ -680,11 +776,18 @@ class Camera3Device :
         }
     };
 
-    // Map from frame number to the in-flight request state
-    typedef KeyedVector<uint32_t, InFlightRequest> InFlightMap;
+    // Map from frame number to the in-flight request state. Frame numbers
+    // are sequential, so this is a circular table indexed by frame number,
+    // sized from the HAL pipeline depth.
+    typedef FrameNumberMap<InFlightRequest> InFlightMap;
 
     Mutex                  mInFlightLock; // Protects mInFlightMap
     InFlightMap            mInFlightMap;
+    LockStats              mInFlightLockStats; // Updated with mInFlightLock held
+
+    // Size mInFlightMap for the HAL pipeline depth of the current
+    // configuration
+    void updateInFlightCapacityLocked();
 
     status_t registerInFlight(uint32_t frameNumber,
             int32_t numBuffers, CaptureResultExtras resultExtras, bool hasInput,
@@ -796,7 +899,7 @@ class Camera3Device :
 
     // helper function to return the output buffers to the streams.
     void returnOutputBuffers(const camera3_stream_buffer_t *outputBuffers,
-            size_t numBuffers, nsecs_t timestamp);
+            size_t numBuffers, nsecs_t timestamp, uint32_t frameNumber);
 
     // Insert the capture result given the pending metadata, result extras,
     // partial results, and the frame number to the result queue.
@@ -96,6 +96,12 @@ bool Camera3DummyStream::isVideoStream() const {
     return false;
 }
 
+status_t Camera3DummyStream::setBatchSize(size_t batchSize) {
+    (void) batchSize;
+    // Do nothing
+    return OK;
+}
+
 }; // namespace camera3
 
 }; // namespace android
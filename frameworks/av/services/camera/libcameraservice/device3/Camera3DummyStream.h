@@ -59,6 +59,8 @@ class Camera3DummyStream :
      */
     bool isVideoStream() const;
 
+    status_t         setBatchSize(size_t batchSize);
+
   protected:
 
     /**
@@ -39,7 +39,8 @@ Camera3OutputStream::Camera3OutputStream(int id,
                             /*maxSize*/0, format, dataSpace, rotation),
         mConsumer(consumer),
         mTransform(0),
-        mTraceFirstBuffer(true) {
+        mTraceFirstBuffer(true),
+        mBatchSize(1) {
 
     if (mConsumer == NULL) {
         ALOGE("%s: Consumer is NULL!", __FUNCTION__);
@@ -55,7 +56,8 @@ Camera3OutputStream::Camera3OutputStream(int id,
                             format, dataSpace, rotation),
         mConsumer(consumer),
         mTransform(0),
-        mTraceFirstBuffer(true) {
+        mTraceFirstBuffer(true),
+        mBatchSize(1) {
 
     if (format != HAL_PIXEL_FORMAT_BLOB) {
         ALOGE("%s: Bad format for size-only stream: %d", __FUNCTION__,
@@ -77,7 +79,8 @@ Camera3OutputStream::Camera3OutputStream(int id, camera3_stream_type_t type,
         Camera3IOStreamBase(id, type, width, height,
                             /*maxSize*/0,
                             format, dataSpace, rotation),
-        mTransform(0) {
+        mTransform(0),
+        mBatchSize(1) {
 
     // Subclasses expected to initialize mConsumer themselves
 }
@@ -98,6 +101,21 @@ status_t Camera3OutputStream::getBufferLocked(camera3_stream_buffer *buffer) {
     ANativeWindowBuffer* anb;
     int fenceFd;
 
+    if (mBatchSize > 1 && mDequeuedBuffers.empty()) {
+        if ((res = dequeueBatchLocked()) != OK) {
+            return res;
+        }
+    }
+    if (!mDequeuedBuffers.empty()) {
+        anb = mDequeuedBuffers.back().buffer;
+        fenceFd = mDequeuedBuffers.back().fenceFd;
+        mDequeuedBuffers.pop_back();
+
+        handoutBufferLocked(*buffer, &(anb->handle), /*acquireFence*/fenceFd,
+                            /*releaseFence*/-1, CAMERA3_BUFFER_STATUS_OK, /*output*/true);
+        return OK;
+    }
+
     /**
      * Release the lock briefly to avoid deadlock for below scenario:
      * Thread 1: StreamingProcessor::startStream -> Camera3Stream::isConfiguring().
@@ -162,6 +180,35 @@ status_t Camera3OutputStream::returnBufferCheckedLocked(
     sp<Fence> releaseFence = new Fence(buffer.release_fence);
     int anwReleaseFence = releaseFence->dup();
 
+    if (mBatchSize > 1 && buffer.status != CAMERA3_BUFFER_STATUS_ERROR) {
+        /**
+         * Hold the buffer until a full batch is ready, or until it is the
+         * last one outstanding so that the stream never goes idle with
+         * buffers the consumer has not seen. The batch owns the fence.
+         */
+        Surface::BatchQueuedBuffer pending;
+        pending.buffer = container_of(buffer.buffer, ANativeWindowBuffer, handle);
+        pending.fenceFd = anwReleaseFence;
+        pending.timestamp = timestamp;
+        mPendingBuffers.push_back(pending);
+        mStreamUnpreparable = true;
+        *releaseFenceOut = releaseFence;
+
+        res = OK;
+        if (mPendingBuffers.size() >= mBatchSize || mHandoutTotalBufferCount <= 1) {
+            res = queuePendingBuffersLocked();
+        }
+        return res;
+    }
+
+    if (mBatchSize > 1 && mHandoutTotalBufferCount <= 1) {
+        /**
+         * The last outstanding buffer failed, e.g. on flush or when a high
+         * speed recording stops. Don't leave the held frames stranded.
+         */
+        queuePendingBuffersLocked();
+    }
+
     /**
      * Release the lock briefly to avoid deadlock with
      * StreamingProcessor::startStream -> Camera3Stream::isConfiguring (this
@@ -376,6 +423,12 @@ status_t Camera3OutputStream::disconnectLocked() {
         return res;
     }
 
+    // The last buffer returned normally queues the batch already. Anything
+    // still held can't be queued without dropping the lock here, so cancel it
+    // rather than leak the buffers and their fences.
+    cancelPendingBuffersLocked();
+    cancelDequeuedBuffersLocked();
+
     res = native_window_api_disconnect(mConsumer.get(),
                                        NATIVE_WINDOW_API_CAMERA);
 
@@ -437,6 +490,108 @@ bool Camera3OutputStream::isVideoStream() const {
     return (usage & GRALLOC_USAGE_HW_VIDEO_ENCODER) != 0;
 }
 
+status_t Camera3OutputStream::setBatchSize(size_t batchSize) {
+    ATRACE_CALL();
+    Mutex::Autolock l(mLock);
+    if (batchSize == 0) {
+        ALOGE("%s: Stream %d: Invalid batch size 0", __FUNCTION__, mId);
+        return BAD_VALUE;
+    }
+    if (batchSize == mBatchSize) {
+        return OK;
+    }
+
+    ALOGV("%s: Stream %d: batch size %zu", __FUNCTION__, mId, batchSize);
+    mBatchSize = batchSize;
+    if (mPendingBuffers.size() >= mBatchSize) {
+        return queuePendingBuffersLocked();
+    }
+    return OK;
+}
+
+status_t Camera3OutputStream::dequeueBatchLocked() {
+    ATRACE_CALL();
+    status_t res;
+
+    // The consumer may need the filled buffers back before it can free the
+    // ones we are about to ask for
+    queuePendingBuffersLocked();
+
+    // Never ask for more than the HAL may hold. Only the first buffer is
+    // waited for; the consumer's free buffers make up the rest of the batch
+    size_t count = mBatchSize;
+    size_t available = (camera3_stream::max_buffers > mHandoutTotalBufferCount) ?
+            camera3_stream::max_buffers - mHandoutTotalBufferCount : 1;
+    if (count > available) {
+        count = available;
+    }
+
+    std::vector<Surface::BatchBuffer> buffers(count);
+
+    // Release the lock briefly, see getBufferLocked
+    sp<Surface> currentConsumer = mConsumer;
+    mLock.unlock();
+    res = currentConsumer->dequeueBuffers(&buffers);
+    mLock.lock();
+    if (res != OK) {
+        ALOGE("%s: Stream %d: Can't dequeue %zu output buffers: %s (%d)",
+                __FUNCTION__, mId, count, strerror(-res), res);
+        return res;
+    }
+
+    // Hand out in dequeue order
+    mDequeuedBuffers.insert(mDequeuedBuffers.begin(), buffers.rbegin(),
+            buffers.rend());
+    return OK;
+}
+
+status_t Camera3OutputStream::queuePendingBuffersLocked() {
+    ATRACE_CALL();
+    if (mPendingBuffers.empty()) {
+        return OK;
+    }
+
+    std::vector<Surface::BatchQueuedBuffer> buffers;
+    buffers.swap(mPendingBuffers);
+
+    // Release the lock briefly, see returnBufferCheckedLocked
+    sp<Surface> currentConsumer = mConsumer;
+    mLock.unlock();
+    status_t res = currentConsumer->queueBuffers(buffers);
+    mLock.lock();
+    if (res != OK) {
+        ALOGE("%s: Stream %d: Error queueing %zu buffers to native window: "
+              "%s (%d)", __FUNCTION__, mId, buffers.size(), strerror(-res), res);
+    }
+    return res;
+}
+
+void Camera3OutputStream::cancelPendingBuffersLocked() {
+    sp<ANativeWindow> currentConsumer = mConsumer;
+    for (size_t i = 0; i < mPendingBuffers.size(); i++) {
+        status_t res = currentConsumer->cancelBuffer(currentConsumer.get(),
+                mPendingBuffers[i].buffer, mPendingBuffers[i].fenceFd);
+        if (res != OK) {
+            ALOGE("%s: Stream %d: Error cancelling buffer to native window:"
+                  " %s (%d)", __FUNCTION__, mId, strerror(-res), res);
+        }
+    }
+    mPendingBuffers.clear();
+}
+
+void Camera3OutputStream::cancelDequeuedBuffersLocked() {
+    sp<ANativeWindow> currentConsumer = mConsumer;
+    for (size_t i = 0; i < mDequeuedBuffers.size(); i++) {
+        status_t res = currentConsumer->cancelBuffer(currentConsumer.get(),
+                mDequeuedBuffers[i].buffer, mDequeuedBuffers[i].fenceFd);
+        if (res != OK) {
+            ALOGE("%s: Stream %d: Error cancelling buffer to native window:"
+                  " %s (%d)", __FUNCTION__, mId, strerror(-res), res);
+        }
+    }
+    mDequeuedBuffers.clear();
+}
+
 }; // namespace camera3
 
 }; // namespace android
@@ -20,6 +20,8 @@
 #include <utils/RefBase.h>
 #include <gui/Surface.h>
 
+#include <vector>
+
 #include "Camera3Stream.h"
 #include "Camera3IOStreamBase.h"
 #include "Camera3OutputStreamInterface.h"
@@ -69,6 +71,13 @@ class Camera3OutputStream :
      */
     bool isVideoStream() const;
 
+    /**
+     * Dequeue and queue up to batchSize buffers per call to the consumer.
+     * Queued buffers are held until a full batch is ready or no other buffer
+     * is outstanding. 1, the default, moves one buffer per call.
+     */
+    status_t         setBatchSize(size_t batchSize);
+
   protected:
     Camera3OutputStream(int id, camera3_stream_type_t type,
             uint32_t width, uint32_t height, int format,
@@ -97,6 +106,26 @@ class Camera3OutputStream :
     // Name of Surface consumer
     String8           mConsumerName;
 
+    // Buffers moved per call to the consumer
+    size_t            mBatchSize;
+    // Buffers dequeued ahead of time, handed out from the back
+    std::vector<Surface::BatchBuffer> mDequeuedBuffers;
+    // Filled buffers waiting to be queued as one batch
+    std::vector<Surface::BatchQueuedBuffer> mPendingBuffers;
+
+    /**
+     * Refill mDequeuedBuffers with one call to the consumer. Note that we
+     * release the lock briefly in this function
+     */
+    status_t          dequeueBatchLocked();
+    /**
+     * Queue mPendingBuffers with one call to the consumer. Note that we
+     * release the lock briefly in this function
+     */
+    status_t          queuePendingBuffersLocked();
+    void              cancelPendingBuffersLocked();
+    void              cancelDequeuedBuffersLocked();
+
     /**
      * Internal Camera3Stream interface
      */
@@ -39,6 +39,12 @@ class Camera3OutputStreamInterface : public virtual Camera3StreamInterface {
      * Return if this output stream is for video encoding.
      */
     virtual bool isVideoStream() const = 0;
+
+    /**
+     * Set how many buffers the stream moves to and from its consumer per
+     * call. 1 means one call per buffer.
+     */
+    virtual status_t setBatchSize(size_t batchSize) = 0;
 };
 
 } // namespace camera3
@@ -66,16 +66,15 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
     sp<PinnedBufferItem> pinnedBuffer;
 
     {
-        List<RingBufferItem>::iterator it, end, accIt;
+        RingBufferItemIterator it, accIt;
         BufferInfo acc, cur;
         BufferInfo* accPtr = NULL;
 
         Mutex::Autolock _l(mMutex);
 
-        for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-             it != end;
-             ++it) {
+        for (size_t i = 0; i < mTimestampIndex.size(); i++) {
 
+            it = mTimestampIndex.valueAt(i);
             const RingBufferItem& item = *it;
 
             cur.mCrop = item.mCrop;
@@ -106,17 +105,83 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
     } // end scope of mMutex autolock
 
     if (waitForFence) {
-        status_t err = pinnedBuffer->getBufferItem().mFence->waitForever(
-                "RingBufferConsumer::pinSelectedBuffer");
-        if (err != OK) {
-            BI_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
-                    strerror(-err), err);
+        waitForPinnedBufferFence(pinnedBuffer);
+    }
+
+    return pinnedBuffer;
+}
+
+sp<PinnedBufferItem> RingBufferConsumer::pinBufferByTimestamp(
+        nsecs_t timestamp,
+        bool waitForFence) {
+
+    sp<PinnedBufferItem> pinnedBuffer;
+
+    {
+        Mutex::Autolock _l(mMutex);
+
+        size_t count = mTimestampIndex.size();
+        if (count == 0) {
+            return NULL;
         }
+
+        size_t i = lowerBoundLocked(timestamp);
+        if ((i == count || mTimestampIndex.keyAt(i).mTimestamp != timestamp) &&
+                i > 0) {
+            // No exact match, take the closest lower timestamp
+            i--;
+        }
+        // Otherwise an exact match, or everything is newer and i is the
+        // closest higher timestamp
+
+        pinnedBuffer = new PinnedBufferItem(this, *mTimestampIndex.valueAt(i));
+        pinBufferLocked(pinnedBuffer->getBufferItem());
+
+    } // end scope of mMutex autolock
+
+    if (waitForFence) {
+        waitForPinnedBufferFence(pinnedBuffer);
     }
 
     return pinnedBuffer;
 }
 
+void RingBufferConsumer::waitForPinnedBufferFence(
+        const sp<PinnedBufferItem>& pinnedBuffer) {
+    status_t err = pinnedBuffer->getBufferItem().mFence->waitForever(
+            "RingBufferConsumer::pinSelectedBuffer");
+    if (err != OK) {
+        BI_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
+                strerror(-err), err);
+    }
+}
+
+size_t RingBufferConsumer::lowerBoundLocked(nsecs_t timestamp) const {
+    size_t lo = 0;
+    size_t hi = mTimestampIndex.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mTimestampIndex.keyAt(mid).mTimestamp < timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+RingBufferConsumer::RingBufferItemIterator RingBufferConsumer::findLocked(
+        const BufferItem& item) {
+    ssize_t idx = mTimestampIndex.indexOfKey(IndexKey(item));
+    if (idx >= 0) {
+        RingBufferItemIterator it = mTimestampIndex.valueAt(idx);
+        if (it->mGraphicBuffer == item.mGraphicBuffer) {
+            return it;
+        }
+    }
+    return mBufferItemList.end();
+}
+
 status_t RingBufferConsumer::clear() {
 
     status_t err;
@@ -162,23 +227,13 @@ nsecs_t RingBufferConsumer::getLatestTimestamp() {
 }
 
 void RingBufferConsumer::pinBufferLocked(const BufferItem& item) {
-    List<RingBufferItem>::iterator it, end;
-
-    for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-         it != end;
-         ++it) {
-
-        RingBufferItem& find = *it;
-        if (item.mGraphicBuffer == find.mGraphicBuffer) {
-            find.mPinCount++;
-            break;
-        }
-    }
+    RingBufferItemIterator it = findLocked(item);
 
-    if (it == end) {
+    if (it == mBufferItemList.end()) {
         BI_LOGE("Failed to pin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
                  item.mTimestamp, item.mFrameNumber);
     } else {
+        it->mPinCount++;
         BI_LOGV("Pinned buffer (frame %" PRIu64 ", timestamp %" PRId64 ")",
                 item.mFrameNumber, item.mTimestamp);
     }
@@ -187,13 +242,7 @@ void RingBufferConsumer::pinBufferLocked(const BufferItem& item) {
 status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
     status_t err = OK;
 
-    List<RingBufferItem>::iterator it, end, accIt;
-
-    it = mBufferItemList.begin();
-    end = mBufferItemList.end();
-    accIt = end;
-
-    if (it == end) {
+    if (mTimestampIndex.isEmpty()) {
         /**
          * This is fine. We really care about being able to acquire a buffer
          * successfully after this function completes, not about it releasing
@@ -204,23 +253,23 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
         return NOT_ENOUGH_DATA;
     }
 
-    for (; it != end; ++it) {
-        RingBufferItem& find = *it;
-
-        if (find.mPinCount > 0) {
+    // Walk from the oldest timestamp, so only pinned buffers older than the
+    // one released are visited (and counted in pinnedFrames)
+    ssize_t accIdx = -1;
+    for (size_t i = 0; i < mTimestampIndex.size(); i++) {
+        if (mTimestampIndex.valueAt(i)->mPinCount > 0) {
             if (pinnedFrames != NULL) {
                 ++(*pinnedFrames);
             }
             // Filter out pinned frame when searching for buffer to release
             continue;
         }
-
-        if (find.mTimestamp < accIt->mTimestamp || accIt == end) {
-            accIt = it;
-        }
+        accIdx = i;
+        break;
     }
 
-    if (accIt != end) {
+    if (accIdx >= 0) {
+        RingBufferItemIterator accIt = mTimestampIndex.valueAt(accIdx);
         RingBufferItem& item = *accIt;
 
         // In case the object was never pinned, pass the acquire fence
@@ -257,8 +306,10 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
                 item.mTimestamp, item.mFrameNumber);
 
         size_t currentSize = mBufferItemList.size();
+        mTimestampIndex.removeItemsAt(accIdx);
         mBufferItemList.erase(accIt);
         assert(mBufferItemList.size() == currentSize - 1);
+        assert(mTimestampIndex.size() == mBufferItemList.size());
     } else {
         BI_LOGW("All buffers pinned, could not find any to release");
         return NO_BUFFER_AVAILABLE;
@@ -319,6 +370,8 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
         mLatestTimestamp = item.mTimestamp;
 
         item.mGraphicBuffer = mSlots[item.mBuf].mGraphicBuffer;
+
+        mTimestampIndex.add(IndexKey(item), --mBufferItemList.end());
     } // end of mMutex lock
 
     ConsumerBase::onFrameAvailable(item);
@@ -327,34 +380,24 @@ void RingBufferConsumer::onFrameAvailable(const BufferItem& item) {
 void RingBufferConsumer::unpinBuffer(const BufferItem& item) {
     Mutex::Autolock _l(mMutex);
 
-    List<RingBufferItem>::iterator it, end, accIt;
-
-    for (it = mBufferItemList.begin(), end = mBufferItemList.end();
-         it != end;
-         ++it) {
-
-        RingBufferItem& find = *it;
-        if (item.mGraphicBuffer == find.mGraphicBuffer) {
-            status_t res = addReleaseFenceLocked(item.mBuf,
-                    item.mGraphicBuffer, item.mFence);
+    RingBufferItemIterator it = findLocked(item);
 
-            if (res != OK) {
-                BI_LOGE("Failed to add release fence to buffer "
-                        "(timestamp %" PRId64 ", framenumber %" PRIu64,
-                        item.mTimestamp, item.mFrameNumber);
-                return;
-            }
-
-            find.mPinCount--;
-            break;
-        }
-    }
-
-    if (it == end) {
+    if (it == mBufferItemList.end()) {
         // This should never happen. If it happens, we have a bug.
         BI_LOGE("Failed to unpin buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
                  item.mTimestamp, item.mFrameNumber);
     } else {
+        status_t res = addReleaseFenceLocked(item.mBuf,
+                item.mGraphicBuffer, item.mFence);
+
+        if (res != OK) {
+            BI_LOGE("Failed to add release fence to buffer "
+                    "(timestamp %" PRId64 ", framenumber %" PRIu64,
+                    item.mTimestamp, item.mFrameNumber);
+            return;
+        }
+
+        it->mPinCount--;
         BI_LOGV("Unpinned buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ")",
                  item.mTimestamp, item.mFrameNumber);
     }
@@ -22,6 +22,7 @@
 
 #include <ui/GraphicBuffer.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <utils/Vector.h>
 #include <utils/threads.h>
@@ -44,6 +45,10 @@ namespace android {
  *
  * Note that the 'oldest' buffer is the one with the smallest timestamp.
  *
+ * Buffers are indexed by timestamp, so lookups by timestamp and finding the
+ * oldest releasable buffer don't scan the whole ring; this keeps deep rings
+ * (long ZSL history) cheap.
+ *
  * Edge cases:
  *  - If ringbuffer is not full, no drops occur when a buffer is produced.
  *  - If all the buffers get filled or pinned then there will be no empty
@@ -155,6 +160,16 @@ class RingBufferConsumer : public ConsumerBase,
     sp<PinnedBufferItem> pinSelectedBuffer(const RingBufferComparator& filter,
                                            bool waitForFence = true);
 
+    // Find the buffer best matching the timestamp, then pin it before
+    // returning it. Match priority from best to worst:
+    //  1) Timestamps match.
+    //  2) Timestamp is closest to the needle (and lower).
+    //  3) Timestamp is closest to the needle (and higher).
+    //
+    // Returns NULL only if the ring buffer is empty.
+    sp<PinnedBufferItem> pinBufferByTimestamp(nsecs_t timestamp,
+                                              bool waitForFence = true);
+
     // Release all the non-pinned buffers in the ring buffer
     status_t clear();
 
@@ -168,6 +183,7 @@ class RingBufferConsumer : public ConsumerBase,
 
     void pinBufferLocked(const BufferItem& item);
     void unpinBuffer(const BufferItem& item);
+    void waitForPinnedBufferFence(const sp<PinnedBufferItem>& pinnedBuffer);
 
     // Releases oldest buffer. Returns NO_BUFFER_AVAILABLE
     // if all the buffers were pinned.
@@ -179,8 +195,38 @@ class RingBufferConsumer : public ConsumerBase,
         int mPinCount;
     };
 
+    typedef List<RingBufferItem>::iterator RingBufferItemIterator;
+
+    // Timestamp ordering of the ring buffer; the frame number only breaks
+    // ties between buffers that carry the same timestamp.
+    struct IndexKey {
+        nsecs_t  mTimestamp;
+        uint64_t mFrameNumber;
+
+        IndexKey() : mTimestamp(0), mFrameNumber(0) {}
+        IndexKey(const BufferItem& item) :
+                mTimestamp(item.mTimestamp),
+                mFrameNumber(item.mFrameNumber) {
+        }
+
+        bool operator<(const IndexKey& other) const {
+            return mTimestamp < other.mTimestamp ||
+                    (mTimestamp == other.mTimestamp &&
+                     mFrameNumber < other.mFrameNumber);
+        }
+    };
+
+    // Index of the first buffer with a timestamp >= timestamp
+    size_t lowerBoundLocked(nsecs_t timestamp) const;
+
+    // Ring buffer entry holding the same graphic buffer as item, or
+    // mBufferItemList.end()
+    RingBufferItemIterator findLocked(const BufferItem& item);
+
     // List of acquired buffers in our ring buffer
     List<RingBufferItem>       mBufferItemList;
+    // The same buffers, by timestamp
+    KeyedVector<IndexKey, RingBufferItemIterator> mTimestampIndex;
     const int                  mBufferCount;
 
     // Timestamp of latest buffer
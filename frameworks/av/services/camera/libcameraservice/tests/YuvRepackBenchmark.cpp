@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures the bandwidth of the preview callback copies for each format
+ * conversion CallbackProcessor performs, comparing the vectorized row
+ * kernels against the portable ones, and checks that both agree.
+ *
+ * usage: camera_yuv_repack_benchmark [-w width] [-h height] [-n iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils/YuvRepack.h"
+
+using namespace android;
+
+namespace {
+
+enum Conversion {
+    COPY_NV21,          // NV21 -> NV21, one memcpy
+    COPY_ROWS,          // padded semiplanar -> NV21, memcpy per row
+    SWAP_NV12,          // NV12 -> NV21
+    INTERLEAVE_I420,    // planar -> NV21
+    DEINTERLEAVE_NV21,  // NV21 -> YV12
+};
+
+struct Frame {
+    size_t width;
+    size_t height;
+    size_t stride;          // source row pitch, all planes
+    uint8_t *src;
+    uint8_t *dst;
+};
+
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Chroma plane pointers inside the source buffer
+uint8_t *chroma(const Frame &f, size_t plane) {
+    return f.src + f.stride * f.height + plane * f.stride * (f.height / 2);
+}
+
+void convert(const Frame &f, Conversion c, bool accelerated) {
+    size_t cw = f.width / 2;
+    size_t ch = f.height / 2;
+    uint8_t *dst = f.dst;
+
+    if (c == COPY_NV21) {
+        memcpy(dst, f.src, f.width * f.height * 3 / 2);
+        return;
+    }
+
+    // Luma always moves row by row
+    for (size_t row = 0; row < f.height; row++) {
+        memcpy(dst + row * f.width, f.src + row * f.stride, f.width);
+    }
+    dst += f.width * f.height;
+
+    for (size_t row = 0; row < ch; row++) {
+        const uint8_t *c0 = chroma(f, 0) + row * f.stride;
+        const uint8_t *c1 = chroma(f, 1) + row * f.stride;
+        switch (c) {
+            case COPY_ROWS:
+                memcpy(dst + row * f.width, c0, f.width);
+                break;
+            case SWAP_NV12:
+                if (accelerated) {
+                    YuvRepack::swapPairs(dst + row * f.width, c0, cw);
+                } else {
+                    YuvRepack::swapPairsGeneric(dst + row * f.width, c0, cw);
+                }
+                break;
+            case INTERLEAVE_I420:
+                if (accelerated) {
+                    YuvRepack::interleave(dst + row * f.width, c1, c0, cw);
+                } else {
+                    YuvRepack::interleaveGeneric(dst + row * f.width, c1, c0,
+                            cw);
+                }
+                break;
+            case DEINTERLEAVE_NV21:
+                if (accelerated) {
+                    YuvRepack::deinterleave(dst + row * cw,
+                            dst + (ch + row) * cw, c0, cw);
+                } else {
+                    YuvRepack::deinterleaveGeneric(dst + row * cw,
+                            dst + (ch + row) * cw, c0, cw);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+double run(const Frame &f, Conversion c, bool accelerated, int iterations) {
+    convert(f, c, accelerated);  // warm up caches and page tables
+    uint64_t start = nowNs();
+    for (int i = 0; i < iterations; i++) {
+        convert(f, c, accelerated);
+    }
+    uint64_t elapsed = nowNs() - start;
+    double bytes = (double)(f.width * f.height * 3 / 2) * iterations;
+    return bytes * 1e3 / (double)(elapsed ? elapsed : 1);  // MB/s
+}
+
+}; // anonymous namespace
+
+int main(int argc, char **argv) {
+    size_t width = 1920;
+    size_t height = 1080;
+    int iterations = 200;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:h:n:")) != -1) {
+        switch (c) {
+            case 'w':
+                width = (size_t)atoi(optarg);
+                break;
+            case 'h':
+                height = (size_t)atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-w width] [-h height] "
+                        "[-n iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (width < 2 || height < 2 || (width | height) & 1 || iterations <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    Frame f;
+    f.width = width;
+    f.height = height;
+    // Pad rows the way camera HALs typically do
+    f.stride = (width + 63) & ~(size_t)63;
+    size_t srcSize = f.stride * height * 2;
+    size_t dstSize = width * height * 3 / 2;
+    f.src = (uint8_t *)malloc(srcSize);
+    f.dst = (uint8_t *)malloc(dstSize);
+    uint8_t *ref = (uint8_t *)malloc(dstSize);
+    if (f.src == NULL || f.dst == NULL || ref == NULL) {
+        fprintf(stderr, "no memory\n");
+        return 1;
+    }
+    srand(1);
+    for (size_t i = 0; i < srcSize; i++) {
+        f.src[i] = (uint8_t)rand();
+    }
+
+    static const struct {
+        Conversion conversion;
+        const char *name;
+        bool hasKernel;
+    } kConversions[] = {
+        { COPY_NV21,         "NV21->NV21 memcpy",   false },
+        { COPY_ROWS,         "NV21->NV21 rows",     false },
+        { SWAP_NV12,         "NV12->NV21",          true },
+        { INTERLEAVE_I420,   "I420->NV21",          true },
+        { DEINTERLEAVE_NV21, "NV21->YV12",          true },
+    };
+
+    printf("%zux%zu, source stride %zu, %d iterations, kernels %s\n",
+            width, height, f.stride, iterations,
+            YuvRepack::isAccelerated() ? "NEON" : "generic");
+    printf("%-20s %12s %12s\n", "conversion", "generic MB/s", "kernel MB/s");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(kConversions) / sizeof(kConversions[0]);
+            i++) {
+        Conversion conv = kConversions[i].conversion;
+        double generic = run(f, conv, false, iterations);
+        memcpy(ref, f.dst, dstSize);
+        if (!kConversions[i].hasKernel) {
+            printf("%-20s %12.0f %12s\n", kConversions[i].name, generic, "-");
+            continue;
+        }
+        memset(f.dst, 0, dstSize);
+        double kernel = run(f, conv, true, iterations);
+        bool match = memcmp(ref, f.dst, dstSize) == 0;
+        printf("%-20s %12.0f %12.0f%s\n", kConversions[i].name, generic,
+                kernel, match ? "" : "  MISMATCH");
+        if (!match) failures++;
+    }
+
+    free(f.src);
+    free(f.dst);
+    free(ref);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_FRAMENUMBERMAP_H
+#define ANDROID_SERVERS_CAMERA_FRAMENUMBERMAP_H
+
+#include <utils/Errors.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace android {
+
+/**
+ * Map from capture frame number to T, stored as a circular table indexed by
+ * frameNumber modulo a power-of-two capacity.
+ *
+ * Frame numbers are handed out sequentially, so the keys in flight always
+ * form a window [oldest, newest]. As long as that window fits in the table,
+ * every key has its own slot and lookup, insert and removal are O(1). When
+ * a key outside the window would collide, the table doubles and rehashes.
+ *
+ * The oldest key still present is tracked, so entries can be walked in
+ * frame order, oldest first. This is the order results are expected to
+ * complete in.
+ *
+ * Indices returned by indexOfKey() stay valid until the next add() or
+ * removal. Not thread safe.
+ */
+template <class T>
+class FrameNumberMap {
+public:
+    static const size_t kDefaultCapacity = 32;
+
+    explicit FrameNumberMap(size_t capacity = kDefaultCapacity) :
+            mSize(0), mOldest(0), mNewest(0) {
+        mSlots.resize(roundUpCapacity(capacity));
+    }
+
+    /**
+     * Make room for at least minCapacity frames in flight. Never shrinks.
+     */
+    void setCapacity(size_t minCapacity) {
+        size_t capacity = roundUpCapacity(minCapacity);
+        if (capacity > mSlots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    /**
+     * Insert a new entry. Returns ALREADY_EXISTS if the frame number is
+     * already present.
+     */
+    status_t add(uint32_t frameNumber, const T& value) {
+        if (mSize == 0) {
+            mOldest = mNewest = frameNumber;
+        } else {
+            if (indexOfKey(frameNumber) >= 0) {
+                return ALREADY_EXISTS;
+            }
+            uint32_t oldest = before(frameNumber, mOldest) ? frameNumber : mOldest;
+            uint32_t newest = before(mNewest, frameNumber) ? frameNumber : mNewest;
+            size_t span = static_cast<size_t>(newest - oldest) + 1;
+            if (span > mSlots.size()) {
+                rehash(roundUpCapacity(span));
+            }
+            mOldest = oldest;
+            mNewest = newest;
+        }
+
+        Slot& slot = mSlots[slotOf(frameNumber)];
+        slot.used = true;
+        slot.key = frameNumber;
+        slot.value = value;
+        mSize++;
+        return OK;
+    }
+
+    /**
+     * Index of the slot holding frameNumber, or NAME_NOT_FOUND.
+     */
+    ssize_t indexOfKey(uint32_t frameNumber) const {
+        if (mSize == 0) {
+            return NAME_NOT_FOUND;
+        }
+        size_t idx = slotOf(frameNumber);
+        const Slot& slot = mSlots[idx];
+        if (!slot.used || slot.key != frameNumber) {
+            return NAME_NOT_FOUND;
+        }
+        return static_cast<ssize_t>(idx);
+    }
+
+    const T& valueAt(size_t index) const { return mSlots[index].value; }
+    T& editValueAt(size_t index) { return mSlots[index].value; }
+    uint32_t keyAt(size_t index) const { return mSlots[index].key; }
+
+    /**
+     * Remove the entry at index. The stored value is reset so that any
+     * buffers or metadata it owns are released right away.
+     */
+    void removeItemAt(size_t index) {
+        Slot& slot = mSlots[index];
+        if (!slot.used) {
+            return;
+        }
+        uint32_t key = slot.key;
+        slot.used = false;
+        slot.value = T();
+        mSize--;
+
+        if (mSize == 0) {
+            mOldest = mNewest = 0;
+        } else if (key == mOldest) {
+            // Completion in order: advance to the next frame still in flight
+            do {
+                mOldest++;
+            } while (!mSlots[slotOf(mOldest)].used ||
+                    mSlots[slotOf(mOldest)].key != mOldest);
+        } else if (key == mNewest) {
+            do {
+                mNewest--;
+            } while (!mSlots[slotOf(mNewest)].used ||
+                    mSlots[slotOf(mNewest)].key != mNewest);
+        }
+    }
+
+    /**
+     * Index of the oldest frame in flight, or NAME_NOT_FOUND if empty.
+     */
+    ssize_t oldestIndex() const {
+        if (mSize == 0) {
+            return NAME_NOT_FOUND;
+        }
+        return static_cast<ssize_t>(slotOf(mOldest));
+    }
+
+    /**
+     * Index of the next frame in flight after the one at index, in frame
+     * number order, or NAME_NOT_FOUND if it is the newest.
+     */
+    ssize_t nextIndex(size_t index) const {
+        uint32_t key = mSlots[index].key;
+        while (key != mNewest) {
+            key++;
+            size_t idx = slotOf(key);
+            if (mSlots[idx].used && mSlots[idx].key == key) {
+                return static_cast<ssize_t>(idx);
+            }
+        }
+        return NAME_NOT_FOUND;
+    }
+
+    size_t size() const { return mSize; }
+    bool isEmpty() const { return mSize == 0; }
+    size_t capacity() const { return mSlots.size(); }
+
+    void clear() {
+        for (size_t i = 0; i < mSlots.size(); i++) {
+            if (mSlots[i].used) {
+                mSlots[i].used = false;
+                mSlots[i].value = T();
+            }
+        }
+        mSize = 0;
+        mOldest = mNewest = 0;
+    }
+
+private:
+    struct Slot {
+        bool used;
+        uint32_t key;
+        T value;
+        Slot() : used(false), key(0) {}
+    };
+
+    static size_t roundUpCapacity(size_t n) {
+        size_t capacity = 1;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    // Wraparound-safe frame number ordering
+    static bool before(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) < 0;
+    }
+
+    size_t slotOf(uint32_t frameNumber) const {
+        return frameNumber & (mSlots.size() - 1);
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> slots(capacity);
+        size_t mask = capacity - 1;
+        for (size_t i = 0; i < mSlots.size(); i++) {
+            if (mSlots[i].used) {
+                Slot& dst = slots[mSlots[i].key & mask];
+                dst.used = true;
+                dst.key = mSlots[i].key;
+                dst.value = mSlots[i].value;
+            }
+        }
+        mSlots.swap(slots);
+    }
+
+    std::vector<Slot> mSlots;
+    size_t mSize;
+    uint32_t mOldest;
+    uint32_t mNewest;
+};
+
+}; // namespace android
+
+#endif
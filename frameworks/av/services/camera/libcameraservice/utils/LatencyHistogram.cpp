@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyHistogram.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace android {
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    mCount = 0;
+    mTotal = 0;
+    mMax = 0;
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+size_t LatencyHistogram::bucketOf(nsecs_t t) {
+    nsecs_t us = t / 1000;
+    size_t bucket = 0;
+    while (us > 0 && bucket < kNumBuckets - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void LatencyHistogram::record(nsecs_t t) {
+    mCount++;
+    mTotal += t;
+    if (t > mMax) {
+        mMax = t;
+    }
+    mBuckets[bucketOf(t)]++;
+}
+
+void LatencyHistogram::dumpBuckets(String8& lines, const char* label) const {
+    lines.appendFormat(" %s:", label);
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        if (mBuckets[i] == 0) continue;
+        if (i == kNumBuckets - 1) {
+            lines.appendFormat(" >=%zuus:%u", (size_t)1 << (i - 1), mBuckets[i]);
+        } else {
+            lines.appendFormat(" <%zuus:%u", (size_t)1 << i, mBuckets[i]);
+        }
+    }
+    lines.append("\n");
+}
+
+void LatencyHistogram::dump(String8& lines, const char* name, const char* indent) const {
+    lines.appendFormat("%s%s: %" PRIu64 " samples, avg %" PRId64 " us, max %" PRId64 " us\n",
+            indent, name, mCount, average() / 1000, mMax / 1000);
+    lines.append(indent);
+    dumpBuckets(lines, "histogram");
+}
+
+}; // namespace android
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_LATENCYHISTOGRAM_H
+#define ANDROID_SERVERS_CAMERA_LATENCYHISTOGRAM_H
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * Latency distribution with power-of-two microsecond buckets, plus sample
+ * count, total and maximum.
+ *
+ * Not thread safe; meant to be updated by a single thread (or under a lock
+ * the caller already holds). dump() may read it racily.
+ */
+class LatencyHistogram {
+public:
+    // Bucket 0 is < 1us, bucket i is < 2^i us, the last one is open ended
+    static const size_t kNumBuckets = 16;
+
+    LatencyHistogram();
+
+    void record(nsecs_t t);
+    void reset();
+
+    uint64_t count() const { return mCount; }
+    nsecs_t total() const { return mTotal; }
+    nsecs_t max() const { return mMax; }
+    nsecs_t average() const { return mCount ? mTotal / (nsecs_t)mCount : 0; }
+
+    /**
+     * Append " label: <1us:n <2us:n ...\n", skipping empty buckets.
+     */
+    void dumpBuckets(String8& lines, const char* label) const;
+
+    /**
+     * Append a one line summary followed by the buckets, prefixed by indent.
+     */
+    void dump(String8& lines, const char* name, const char* indent) const;
+
+private:
+    static size_t bucketOf(nsecs_t t);
+
+    uint64_t mCount;
+    nsecs_t mTotal;
+    nsecs_t mMax;
+    uint32_t mBuckets[kNumBuckets];
+};
+
+}; // namespace android
+
+#endif
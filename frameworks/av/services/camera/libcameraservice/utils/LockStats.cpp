@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LockStats.h"
+
+#include <inttypes.h>
+
+namespace android {
+
+LockStats::LockStats() {
+    reset();
+}
+
+void LockStats::reset() {
+    mAcquisitions = 0;
+    mContended = 0;
+    mTotalWait = 0;
+    mMaxWait = 0;
+    mWaitHistogram.reset();
+    mHoldHistogram.reset();
+}
+
+void LockStats::recordAcquire(nsecs_t waitTime, bool contended) {
+    mAcquisitions++;
+    if (contended) {
+        mContended++;
+        mTotalWait += waitTime;
+        if (waitTime > mMaxWait) {
+            mMaxWait = waitTime;
+        }
+    }
+    mWaitHistogram.record(waitTime);
+}
+
+void LockStats::recordRelease(nsecs_t holdTime) {
+    mHoldHistogram.record(holdTime);
+}
+
+void LockStats::dump(String8& lines, const char* name, const char* indent) const {
+    uint64_t acquisitions = mAcquisitions;
+    uint64_t contended = mContended;
+
+    lines.appendFormat("%s%s: %" PRIu64 " acquisitions, %" PRIu64 " contended (%.1f%%)",
+            indent, name, acquisitions, contended,
+            acquisitions ? 100.0 * contended / acquisitions : 0.0);
+    lines.appendFormat(", avg contended wait %" PRId64 " us, max wait %" PRId64
+            " us, max hold %" PRId64 " us\n",
+            contended ? mTotalWait / (nsecs_t)contended / 1000 : 0,
+            mMaxWait / 1000, mHoldHistogram.max() / 1000);
+    lines.append(indent);
+    mWaitHistogram.dumpBuckets(lines, "wait");
+    lines.append(indent);
+    mHoldHistogram.dumpBuckets(lines, "hold");
+}
+
+ProfiledAutolock::ProfiledAutolock(Mutex& mutex, LockStats& stats) :
+        mLock(mutex), mStats(stats) {
+    nsecs_t waitTime = 0;
+    bool contended = false;
+    if (mLock.tryLock() != NO_ERROR) {
+        nsecs_t start = systemTime();
+        mLock.lock();
+        contended = true;
+        mAcquireTime = systemTime();
+        waitTime = mAcquireTime - start;
+    } else {
+        mAcquireTime = systemTime();
+    }
+    mStats.recordAcquire(waitTime, contended);
+}
+
+ProfiledAutolock::~ProfiledAutolock() {
+    mStats.recordRelease(systemTime() - mAcquireTime);
+    mLock.unlock();
+}
+
+}; // namespace android
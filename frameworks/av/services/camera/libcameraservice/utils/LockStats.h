@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_LOCKSTATS_H
+#define ANDROID_SERVERS_CAMERA_LOCKSTATS_H
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "LatencyHistogram.h"
+
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * Contention and latency statistics for one Mutex. Wait time (from the
+ * lock request to acquisition) and hold time are kept as histograms with
+ * power-of-two microsecond buckets.
+ *
+ * The counters are only updated while the measured mutex is held, so they
+ * need no locking of their own; dump() may read them racily.
+ */
+class LockStats {
+public:
+    LockStats();
+
+    void recordAcquire(nsecs_t waitTime, bool contended);
+    void recordRelease(nsecs_t holdTime);
+    void reset();
+
+    /**
+     * Append a human readable summary, each line prefixed by indent.
+     */
+    void dump(String8& lines, const char* name, const char* indent) const;
+
+private:
+    uint64_t mAcquisitions;
+    uint64_t mContended;
+    nsecs_t mTotalWait;
+    nsecs_t mMaxWait;
+    LatencyHistogram mWaitHistogram;
+    LatencyHistogram mHoldHistogram;
+};
+
+/**
+ * Scoped lock like Mutex::Autolock that records into a LockStats. An
+ * uncontended acquisition costs a tryLock and two clock reads.
+ */
+class ProfiledAutolock {
+public:
+    ProfiledAutolock(Mutex& mutex, LockStats& stats);
+    ~ProfiledAutolock();
+
+private:
+    ProfiledAutolock(const ProfiledAutolock&);
+    ProfiledAutolock& operator=(const ProfiledAutolock&);
+
+    Mutex& mLock;
+    LockStats& mStats;
+    nsecs_t mAcquireTime;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define YUV_REPACK_NEON 1
+#endif
+
+#include "YuvRepack.h"
+
+namespace android {
+
+void YuvRepack::swapPairsGeneric(uint8_t *dst, const uint8_t *src,
+        size_t count) {
+    size_t i = 0;
+    // Four pairs at a time; memcpy keeps unaligned rows legal
+    for (; i + 4 <= count; i += 4) {
+        uint64_t v;
+        memcpy(&v, src + 2 * i, sizeof(v));
+        v = ((v & 0x00ff00ff00ff00ffULL) << 8) |
+                ((v >> 8) & 0x00ff00ff00ff00ffULL);
+        memcpy(dst + 2 * i, &v, sizeof(v));
+    }
+    for (; i < count; i++) {
+        dst[2 * i] = src[2 * i + 1];
+        dst[2 * i + 1] = src[2 * i];
+    }
+}
+
+void YuvRepack::interleaveGeneric(uint8_t *dst, const uint8_t *a,
+        const uint8_t *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[2 * i] = a[i];
+        dst[2 * i + 1] = b[i];
+    }
+}
+
+void YuvRepack::deinterleaveGeneric(uint8_t *a, uint8_t *b,
+        const uint8_t *src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        a[i] = src[2 * i];
+        b[i] = src[2 * i + 1];
+    }
+}
+
+#ifdef YUV_REPACK_NEON
+
+void YuvRepack::swapPairs(uint8_t *dst, const uint8_t *src, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t lo = vld1q_u8(src + 2 * i);
+        uint8x16_t hi = vld1q_u8(src + 2 * i + 16);
+        vst1q_u8(dst + 2 * i, vrev16q_u8(lo));
+        vst1q_u8(dst + 2 * i + 16, vrev16q_u8(hi));
+    }
+    swapPairsGeneric(dst + 2 * i, src + 2 * i, count - i);
+}
+
+void YuvRepack::interleave(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+        size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t v;
+        v.val[0] = vld1q_u8(a + i);
+        v.val[1] = vld1q_u8(b + i);
+        vst2q_u8(dst + 2 * i, v);
+    }
+    interleaveGeneric(dst + 2 * i, a + i, b + i, count - i);
+}
+
+void YuvRepack::deinterleave(uint8_t *a, uint8_t *b, const uint8_t *src,
+        size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t v = vld2q_u8(src + 2 * i);
+        vst1q_u8(a + i, v.val[0]);
+        vst1q_u8(b + i, v.val[1]);
+    }
+    deinterleaveGeneric(a + i, b + i, src + 2 * i, count - i);
+}
+
+bool YuvRepack::isAccelerated() {
+    return true;
+}
+
+#else
+
+void YuvRepack::swapPairs(uint8_t *dst, const uint8_t *src, size_t count) {
+    swapPairsGeneric(dst, src, count);
+}
+
+void YuvRepack::interleave(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+        size_t count) {
+    interleaveGeneric(dst, a, b, count);
+}
+
+void YuvRepack::deinterleave(uint8_t *a, uint8_t *b, const uint8_t *src,
+        size_t count) {
+    deinterleaveGeneric(a, b, src, count);
+}
+
+bool YuvRepack::isAccelerated() {
+    return false;
+}
+
+#endif
+
+}; // namespace android
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_YUVREPACK_H
+#define ANDROID_SERVERS_CAMERA_YUVREPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+/**
+ * Row kernels for repacking 4:2:0 chroma between the semiplanar and planar
+ * layouts used by NV21, NV12 and YV12. The default entry points use NEON
+ * when it is available; the *Generic variants are the portable reference
+ * versions and are exported for verification and benchmarking.
+ *
+ * Sources and destinations must not overlap.
+ */
+class YuvRepack {
+public:
+    // dst = { src[1], src[0], src[3], src[2], ... }, count byte pairs
+    static void swapPairs(uint8_t *dst, const uint8_t *src, size_t count);
+    // dst = { a[0], b[0], a[1], b[1], ... }, count byte pairs
+    static void interleave(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+            size_t count);
+    // a = { src[0], src[2], ... }, b = { src[1], src[3], ... }
+    static void deinterleave(uint8_t *a, uint8_t *b, const uint8_t *src,
+            size_t count);
+
+    static void swapPairsGeneric(uint8_t *dst, const uint8_t *src,
+            size_t count);
+    static void interleaveGeneric(uint8_t *dst, const uint8_t *a,
+            const uint8_t *b, size_t count);
+    static void deinterleaveGeneric(uint8_t *a, uint8_t *b,
+            const uint8_t *src, size_t count);
+
+    // True if the default entry points are vectorized
+    static bool isAccelerated();
+};
+
+}; // namespace android
+
+#endif
@@ -30,8 +30,7 @@
 #include <utils/Trace.h>
 #include <utils/Vector.h>
 
-#include <list>
-#include <set>
+#include <stdint.h>
 
 #define BQ_LOGV(x, ...) ALOGV("[%s] " x, mConsumerName.string(), ##__VA_ARGS__)
 #define BQ_LOGD(x, ...) ALOGD("[%s] " x, mConsumerName.string(), ##__VA_ARGS__)
@@ -47,6 +46,10 @@
         android::ScopedTrace ___bufTracer(ATRACE_TAG, ___traceBuf);  \
     }
 
+// Set to 1 to check the free lists and slot masks against mSlots after every
+// state change. The check walks all slots, so it is off in normal builds.
+#define BQ_VALIDATE_CONSISTENCY 0
+
 namespace android {
 
 class IConsumerListener;
@@ -79,6 +82,70 @@ public:
     virtual ~BufferQueueCore();
 
 private:
+    // SlotMask is a set of slot indices kept as a bitmask, so that adding and
+    // removing a slot, finding the lowest or highest slot and counting slots
+    // neither allocate nor walk mSlots.
+    class SlotMask {
+    public:
+        SlotMask() : mBits(0) {}
+
+        bool empty() const { return mBits == 0; }
+        bool contains(int slot) const { return (mBits & bit(slot)) != 0; }
+        void insert(int slot) { mBits |= bit(slot); }
+        void erase(int slot) { mBits &= ~bit(slot); }
+
+        // first and last return the lowest and highest slot in the set,
+        // which must not be empty
+        int first() const { return __builtin_ctzll(mBits); }
+        int last() const { return 63 - __builtin_clzll(mBits); }
+
+        // count returns the number of slots in the set, and countBelow the
+        // number of those lower than limit
+        int count() const { return __builtin_popcountll(mBits); }
+        int countBelow(int limit) const {
+            if (limit >= 64) {
+                return count();
+            }
+            return __builtin_popcountll(mBits & (bit(limit) - 1));
+        }
+
+        SlotMask operator|(const SlotMask& other) const {
+            SlotMask result;
+            result.mBits = mBits | other.mBits;
+            return result;
+        }
+
+    private:
+        static uint64_t bit(int slot) { return static_cast<uint64_t>(1) << slot; }
+        uint64_t mBits;
+    };
+
+    // SlotList is an ordered list of slot indices held in a fixed ring. Each
+    // slot appears at most once, so it never holds more than NUM_BUFFER_SLOTS
+    // entries and never allocates.
+    class SlotList {
+    public:
+        SlotList() : mHead(0), mSize(0) {}
+
+        bool empty() const { return mSize == 0; }
+        int size() const { return mSize; }
+        int front() const { return mEntries[mHead]; }
+        int at(int index) const {
+            return mEntries[(mHead + index) % BufferQueueDefs::NUM_BUFFER_SLOTS];
+        }
+
+        void push_front(int slot);
+        void push_back(int slot);
+        void pop_front();
+        void remove(int slot);
+        bool contains(int slot) const;
+
+    private:
+        int mEntries[BufferQueueDefs::NUM_BUFFER_SLOTS];
+        int mHead;
+        int mSize;
+    };
+
     // Dump our state in a string
     void dump(String8& result, const char* prefix) const;
 
@@ -111,6 +178,11 @@ private:
     // initial default is 2.
     status_t setDefaultMaxBufferCountLocked(int count);
 
+    // setBufferStateLocked moves the given slot to a new state, keeping
+    // mDequeuedSlots, mQueuedSlots and mAcquiredSlots in sync with mSlots. The
+    // caller is responsible for the free lists.
+    void setBufferStateLocked(int slot, BufferSlot::BufferState state);
+
     // freeBufferLocked frees the GraphicBuffer and sync resources for the
     // given slot.
     void freeBufferLocked(int slot);
@@ -126,8 +198,9 @@ private:
     // waitWhileAllocatingLocked blocks until mIsAllocating is false.
     void waitWhileAllocatingLocked() const;
 
-    // validateConsistencyLocked ensures that the free lists are in sync with
-    // the information stored in mSlots
+    // validateConsistencyLocked ensures that the free lists and slot masks are
+    // in sync with the information stored in mSlots. It does nothing unless
+    // BQ_VALIDATE_CONSISTENCY is set.
     void validateConsistencyLocked() const;
 
     // mAllocator is the connection to SurfaceFlinger that is used to allocate
@@ -185,12 +258,21 @@ private:
     Fifo mQueue;
 
     // mFreeSlots contains all of the slots which are FREE and do not currently
-    // have a buffer attached
-    std::set<int> mFreeSlots;
+    // have a buffer attached. New buffers go in the lowest of them.
+    SlotMask mFreeSlots;
 
     // mFreeBuffers contains all of the slots which are FREE and currently have
-    // a buffer attached
-    std::list<int> mFreeBuffers;
+    // a buffer attached. dequeueBuffer takes them from the front; buffers the
+    // producer gives back unused go on the front, released buffers on the
+    // back.
+    SlotList mFreeBuffers;
+
+    // mDequeuedSlots, mQueuedSlots and mAcquiredSlots contain the slots in
+    // each of those states, so that buffer counts don't need a walk of mSlots.
+    // They are only changed through setBufferStateLocked.
+    SlotMask mDequeuedSlots;
+    SlotMask mQueuedSlots;
+    SlotMask mAcquiredSlots;
 
     // mOverrideMaxBufferCount is the limit on the number of buffers that will
     // be allocated at one time. This value is set by the producer by calling
@@ -95,6 +95,13 @@ public:
             bool async, uint32_t width, uint32_t height, PixelFormat format,
             uint32_t usage);
 
+    // See IGraphicBufferProducer::dequeueBuffers. Only the first dequeue of
+    // the batch may block; the batch ends early at the first dequeue that
+    // would have to wait for the consumer.
+    virtual status_t dequeueBuffers(size_t count, bool async, uint32_t w,
+            uint32_t h, PixelFormat format, uint32_t usage,
+            std::vector<DequeueBufferOutput>* outputs);
+
     // See IGraphicBufferProducer::detachBuffer
     virtual status_t detachBuffer(int slot);
 
@@ -193,6 +200,11 @@ private:
     status_t waitForFreeSlotThenRelock(const char* caller, bool async,
             int* found, status_t* returnFlags) const;
 
+    // hasFreeSlotLocked returns whether waitForFreeSlotThenRelock would find a
+    // slot right away, rather than block or fail one of its buffer count
+    // checks. Must be called with mCore->mMutex locked.
+    bool hasFreeSlotLocked(bool async) const;
+
     sp<BufferQueueCore> mCore;
 
     // This references mCore->mSlots. Lock mCore->mMutex while accessing.
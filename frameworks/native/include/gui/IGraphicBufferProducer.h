@@ -30,6 +30,8 @@
 #include <ui/Rect.h>
 #include <ui/Region.h>
 
+#include <vector>
+
 namespace android {
 // ----------------------------------------------------------------------------
 
@@ -483,6 +485,68 @@ public:
 
     // Returns the name of the connected consumer.
     virtual String8 getConsumerName() const = 0;
+
+    // DequeueBufferOutput describes one buffer returned by dequeueBuffers.
+    struct DequeueBufferOutput {
+        DequeueBufferOutput() : slot(-1), result(NO_ERROR) { }
+        // slot - the dequeued slot
+        // result - the non-negative value dequeueBuffer returned for this
+        //          slot, with the BUFFER_NEEDS_REALLOCATION and
+        //          RELEASE_ALL_BUFFERS flags
+        // fence - the fence dequeueBuffer returned for this slot
+        // buffer - the buffer requestBuffer returned for this slot, set only
+        //          when result has BUFFER_NEEDS_REALLOCATION
+        int slot;
+        status_t result;
+        sp<Fence> fence;
+        sp<GraphicBuffer> buffer;
+    };
+
+    // dequeueBuffers dequeues up to count buffers in a single call, as if
+    // dequeueBuffer were called count times with the same arguments. For every
+    // slot that returns BUFFER_NEEDS_REALLOCATION it also requests the new
+    // buffer, so the client does not need to call requestBuffer.
+    //
+    // Each dequeue may block exactly as dequeueBuffer does, except that
+    // BufferQueue only lets the first one block and ends the batch early
+    // instead. Dequeuing stops at the first dequeue that fails; the buffers
+    // dequeued before it are still returned. If any of them has RELEASE_ALL_BUFFERS set, the client must
+    // release its mirrored slots before mapping any buffer of the batch.
+    //
+    // count must be in the range [1, NUM_BUFFER_SLOTS].
+    //
+    // Return of a value other than NO_ERROR means that no buffer was dequeued,
+    // and is the error the first dequeueBuffer or requestBuffer returned, or
+    // BAD_VALUE if count or outputs is invalid.
+    //
+    // The default implementation calls dequeueBuffer and requestBuffer.
+    virtual status_t dequeueBuffers(size_t count, bool async, uint32_t w,
+            uint32_t h, PixelFormat format, uint32_t usage,
+            std::vector<DequeueBufferOutput>* outputs);
+
+    // QueuedBuffer is one buffer for queueBuffers to queue.
+    struct QueuedBuffer {
+        QueuedBuffer(int slot, const QueueBufferInput& input)
+                : slot(slot), input(input) { }
+        int slot;
+        QueueBufferInput input;
+    };
+
+    // queueBuffers queues several buffers in a single call, as if
+    // queueBuffer were called for each of them in order. A buffer that fails
+    // to queue does not stop the following ones from being queued.
+    //
+    // results, if not NULL, is filled with the result of each queueBuffer,
+    // and output with the output of the last buffer queued successfully.
+    //
+    // The number of buffers must be in the range [1, NUM_BUFFER_SLOTS].
+    //
+    // Return of a value other than NO_ERROR is the first error any
+    // queueBuffer returned, or BAD_VALUE if the number of buffers is invalid.
+    //
+    // The default implementation calls queueBuffer.
+    virtual status_t queueBuffers(const std::vector<QueuedBuffer>& buffers,
+            std::vector<status_t>* results, QueueBufferOutput* output);
 };
 
 // ----------------------------------------------------------------------------
@@ -24,6 +24,8 @@
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -37,8 +39,45 @@ class IGraphicBufferProducer;
 // BufferQueue, where each buffer queued to the input is available to be
 // acquired by each of the outputs, and is able to be dequeued by the input
 // again only once all of the outputs have released it.
+//
+// Each output has a back-pressure policy that decides what happens when its
+// consumer falls behind. Only outputs with OUTPUT_POLICY_BLOCK hold back the
+// input; the others lose frames instead, so a slow consumer on one of them
+// never stalls the rest.
 class StreamSplitter : public BnConsumerListener {
 public:
+    enum OutputPolicy {
+        // The input waits for this output to release its buffers. This is the
+        // policy of outputs added without one.
+        OUTPUT_POLICY_BLOCK,
+        // Frames are queued as droppable, so a frame the consumer has not
+        // acquired yet is replaced by the next one. Once the output holds
+        // more than maxBuffers frames, new frames are skipped.
+        OUTPUT_POLICY_DROP_OLDEST,
+        // New frames are not sent to the output while it holds maxBuffers
+        // frames.
+        OUTPUT_POLICY_SKIP,
+    };
+
+    // OutputStats holds the counters of one output. Latencies are measured
+    // from the time a frame is queued to the output until the splitter gets
+    // the buffer back from it.
+    struct OutputStats {
+        OutputPolicy policy;
+        // Frames queued to the output
+        uint64_t queued;
+        // Frames the output's queue replaced before they were acquired. A
+        // replaced frame is only told apart from a released one once the
+        // release callback arrives, so this is exact while the output is idle.
+        uint64_t dropped;
+        // Frames not sent to the output because of its policy
+        uint64_t skipped;
+        // Buffers the output holds now
+        uint32_t outstanding;
+        nsecs_t meanLatency;
+        nsecs_t maxLatency;
+    };
+
     // createSplitter creates a new splitter, outSplitter, using inputQueue as
     // the input BufferQueue. Output BufferQueues must be added using addOutput
     // before queueing any buffers to the input.
@@ -63,6 +102,24 @@ public:
     // of other error codes.
     status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue);
 
+    // addOutput adds an output BufferQueue with the given back-pressure
+    // policy. maxBuffers is the number of buffers the output may hold before
+    // OUTPUT_POLICY_DROP_OLDEST or OUTPUT_POLICY_SKIP applies, and is ignored
+    // for OUTPUT_POLICY_BLOCK. Outputs are numbered in the order they are
+    // added, starting at 0.
+    //
+    // BAD_VALUE is also returned if policy is unknown, or if maxBuffers is
+    // less than 1 for a policy other than OUTPUT_POLICY_BLOCK.
+    status_t addOutput(const sp<IGraphicBufferProducer>& outputQueue,
+            OutputPolicy policy, int maxBuffers);
+
+    // getOutputStats fills outStats with the counters of the output at index.
+    // BAD_VALUE is returned if there is no such output or outStats is NULL.
+    status_t getOutputStats(size_t index, OutputStats* outStats) const;
+
+    // dump appends the policy and counters of each output to result
+    void dump(String8& result, const char* prefix) const;
+
     // setName sets the consumer name of the input queue
     void setName(const String8& name);
 
@@ -70,10 +127,10 @@ private:
     // From IConsumerListener
     //
     // During this callback, we store some tracking information, detach the
-    // buffer from the input, and attach it to each of the outputs. This call
-    // can block if there are too many outstanding buffers. If it blocks, it
-    // will resume when onBufferReleasedByOutput releases a buffer back to the
-    // input.
+    // buffer from the input, and attach it to each of the outputs whose policy
+    // allows it. This call can block if blocking outputs hold too many
+    // buffers. If it blocks, it will resume when the last blocking output
+    // releases one of them (see reclaimOutputBuffers).
     virtual void onFrameAvailable(const BufferItem& item);
 
     // From IConsumerListener
@@ -88,14 +145,18 @@ private:
 
     // This is the implementation of the onBufferReleased callback from
     // IProducerListener. It gets called from an OutputListener (see below), and
-    // 'from' is which producer interface from which the callback was received.
+    // 'index' is the output from which the callback was received.
     //
-    // During this callback, we detach the buffer from the output queue that
-    // generated the callback, update our state tracking to see if this is the
-    // last output releasing the buffer, and if so, release it to the input.
-    // If we release the buffer to the input, we allow a blocked
-    // onFrameAvailable call to proceed.
-    void onBufferReleasedByOutput(const sp<IGraphicBufferProducer>& from);
+    // During this callback, we reclaim the released buffers of that output
+    // (see reclaimOutputBuffers).
+    void onBufferReleasedByOutput(size_t index);
+
+    // Detach every free buffer of the output at index and drop the output's
+    // reference to it. Free buffers are those its consumer released and those
+    // its queue replaced. When the last output drops a buffer, it is released
+    // to the input, and when the last blocking output drops it, a blocked
+    // onFrameAvailable call may proceed. mMutex must not be held.
+    void reclaimOutputBuffers(size_t index);
 
     // When this is called, the splitter disconnects from (i.e., abandons) its
     // input queue and signals any waiting onFrameAvailable calls to wake up.
@@ -111,8 +172,7 @@ private:
     class OutputListener : public BnProducerListener,
                            public IBinder::DeathRecipient {
     public:
-        OutputListener(const sp<StreamSplitter>& splitter,
-                const sp<IGraphicBufferProducer>& output);
+        OutputListener(const sp<StreamSplitter>& splitter, size_t index);
         virtual ~OutputListener();
 
         // From IProducerListener
@@ -123,7 +183,7 @@ private:
 
     private:
         sp<StreamSplitter> mSplitter;
-        sp<IGraphicBufferProducer> mOutput;
+        size_t mIndex;
     };
 
     class BufferTracker : public LightRefBase<BufferTracker> {
@@ -135,9 +195,28 @@ private:
 
         void mergeFence(const sp<Fence>& with);
 
-        // Returns the new value
+        // Each output holding the buffer has a reference, and so does
+        // onFrameAvailable until it has queued the buffer to every output.
+        // References of blocking outputs are also counted apart.
         // Only called while mMutex is held
-        size_t incrementReleaseCountLocked() { return ++mReleaseCount; }
+        void incrementRefCountLocked(bool blocking) {
+            ++mRefCount;
+            if (blocking) {
+                ++mBlockingRefCount;
+            }
+        }
+
+        // Drops a reference. Sets *outLastBlocking if it was the last
+        // blocking one. Returns the number of references left.
+        // Only called while mMutex is held
+        size_t decrementRefCountLocked(bool blocking, bool* outLastBlocking) {
+            *outLastBlocking = blocking && --mBlockingRefCount == 0;
+            return --mRefCount;
+        }
+
+        // Time the buffer was queued to the outputs
+        nsecs_t getQueueTime() const { return mQueueTime; }
+        void setQueueTime(nsecs_t queueTime) { mQueueTime = queueTime; }
 
     private:
         // Only destroy through LightRefBase
@@ -150,15 +229,59 @@ private:
 
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
         sp<Fence> mMergedFence;
-        size_t mReleaseCount;
+        size_t mRefCount;
+        size_t mBlockingRefCount;
+        nsecs_t mQueueTime;
+    };
+
+    // Output is the state and counters of one output BufferQueue
+    struct Output {
+        Output() : policy(OUTPUT_POLICY_BLOCK), maxBuffers(0), outstanding(0),
+                queued(0), skipped(0), returned(0), releaseCallbacks(0),
+                totalLatency(0), maxLatency(0) {}
+
+        sp<IGraphicBufferProducer> producer;
+        OutputPolicy policy;
+        int maxBuffers;
+        // Buffers queued to the output and not reclaimed yet
+        int outstanding;
+
+        uint64_t queued;
+        uint64_t skipped;
+        // Buffers reclaimed from the output
+        uint64_t returned;
+        // onBufferReleased callbacks, one per buffer its consumer released
+        uint64_t releaseCallbacks;
+        nsecs_t totalLatency;
+        nsecs_t maxLatency;
     };
 
+    // Drop the reference output 'index' holds on a buffer it gave back.
+    // Returns the tracker if the buffer must now be released to the input.
+    // Must be called with mMutex locked.
+    sp<BufferTracker> onBufferReturnedLocked(size_t index,
+            const sp<GraphicBuffer>& buffer, const sp<Fence>& fence);
+
+    // Drop one reference on tracker, blocking if it belongs to onFrameAvailable
+    // or a blocking output. Returns true if the buffer must now be released to
+    // the input. Must be called with mMutex locked.
+    bool decrementRefCountLocked(const sp<BufferTracker>& tracker,
+            bool blocking);
+
+    // Attach a buffer no output holds any more to the input and release it.
+    // Takes mInputMutex; mMutex must not be held.
+    void releaseToInput(const sp<BufferTracker>& tracker);
+
+    // Must be called with mMutex locked
+    void getOutputStatsLocked(size_t index, OutputStats* outStats) const;
+
     // Only called from createSplitter
     StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue);
 
     // Must be accessed through RefBase
     virtual ~StreamSplitter();
 
+    // Buffers blocking outputs may hold before onFrameAvailable waits
     static const int MAX_OUTSTANDING_BUFFERS = 2;
 
     // mIsAbandoned is set to true when an output dies. Once the StreamSplitter
@@ -167,11 +290,17 @@ private:
     // communicate with it further.
     bool mIsAbandoned;
 
-    Mutex mMutex;
+    mutable Mutex mMutex;
+    // Serialises acquireBuffer/detachBuffer and attachBuffer/releaseBuffer on
+    // the input, so that at most one buffer is ever acquired from it. Buffers
+    // are returned from several threads at once and without mMutex. It may be
+    // taken with mMutex held, but mMutex must never be taken while holding it.
+    Mutex mInputMutex;
     Condition mReleaseCondition;
+    // Buffers that onFrameAvailable or a blocking output still holds
     int mOutstandingBuffers;
     sp<IGraphicBufferConsumer> mInput;
-    Vector<sp<IGraphicBufferProducer> > mOutputs;
+    Vector<Output> mOutputs;
 
     // Map of GraphicBuffer IDs (GraphicBuffer::getId()) to buffer tracking
     // objects (which are mostly for counting how many outputs have released the
@@ -27,6 +27,8 @@
 #include <utils/threads.h>
 #include <utils/KeyedVector.h>
 
+#include <vector>
+
 struct ANativeWindow_Buffer;
 
 namespace android {
@@ -191,6 +193,32 @@ public:
             sp<Fence>* outFence);
     virtual int attachBuffer(ANativeWindowBuffer*);
 
+    // BatchBuffer is one buffer returned by dequeueBuffers.
+    struct BatchBuffer {
+        ANativeWindowBuffer* buffer = nullptr;
+        int fenceFd = -1;
+    };
+
+    // Dequeue up to buffers->size() buffers with a single call to the
+    // IGraphicBufferProducer. On return buffers holds the buffers that were
+    // dequeued, which may be fewer than requested; an error is returned only
+    // if none were.
+    virtual int dequeueBuffers(std::vector<BatchBuffer>* buffers);
+
+    // BatchQueuedBuffer is one buffer for queueBuffers to queue. timestamp
+    // may be NATIVE_WINDOW_TIMESTAMP_AUTO.
+    struct BatchQueuedBuffer {
+        ANativeWindowBuffer* buffer = nullptr;
+        int fenceFd = -1;
+        int64_t timestamp = NATIVE_WINDOW_TIMESTAMP_AUTO;
+    };
+
+    // Queue several buffers with a single call to the IGraphicBufferProducer.
+    // All buffers share the current crop, transform, scaling mode, dataspace
+    // and surface damage. Takes ownership of the fences; returns the first
+    // error of any buffer.
+    virtual int queueBuffers(const std::vector<BatchQueuedBuffer>& buffers);
+
 protected:
     enum { NUM_BUFFER_SLOTS = BufferQueue::NUM_BUFFER_SLOTS };
     enum { DEFAULT_FORMAT = PIXEL_FORMAT_RGBA_8888 };
@@ -199,6 +227,14 @@ private:
     void freeAllBuffers();
     int getSlotFromBufferLocked(android_native_buffer_t* buffer) const;
 
+    // Build the QueueBufferInput for a buffer from the current state; takes
+    // ownership of fenceFd
+    IGraphicBufferProducer::QueueBufferInput getQueueBufferInputLocked(
+            android_native_buffer_t* buffer, int fenceFd, int64_t timestamp);
+    // Update the state the consumer reported after a successful queue
+    void onBufferQueuedLocked(
+            const IGraphicBufferProducer::QueueBufferOutput& output);
+
     struct BufferSlot {
         sp<GraphicBuffer> buffer;
         Region dirtyRegion;
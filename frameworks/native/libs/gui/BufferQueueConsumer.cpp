@@ -48,12 +48,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
         // buffers acquired. We allow the max buffer count to be exceeded by one
         // buffer so that the consumer can successfully set up the newly acquired
         // buffer before releasing the old one.
-        int numAcquiredBuffers = 0;
-        for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-            if (mSlots[s].mBufferState == BufferSlot::ACQUIRED) {
-                ++numAcquiredBuffers;
-            }
-        }
+        int numAcquiredBuffers = mCore->mAcquiredSlots.count();
         if (numAcquiredBuffers >= mCore->mMaxAcquiredBufferCount + 1) {
             BQ_LOGE("acquireBuffer: max acquired buffer count reached: %d (max %d)",
                     numAcquiredBuffers, mCore->mMaxAcquiredBufferCount);
@@ -130,7 +125,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                         desiredPresent, expectedPresent, mCore->mQueue.size());
                 if (mCore->stillTracking(front)) {
                     // Front buffer is still in mSlots, so mark the slot as free
-                    mSlots[front->mSlot].mBufferState = BufferSlot::FREE;
+                    mCore->setBufferStateLocked(front->mSlot, BufferSlot::FREE);
                     mCore->mFreeBuffers.push_back(front->mSlot);
                     listener = mCore->mConnectedProducerListener;
                     ++numDroppedBuffers;
@@ -172,7 +167,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
         if (mCore->stillTracking(front)) {
             mSlots[slot].mAcquireCalled = true;
             mSlots[slot].mNeedsCleanupOnRelease = false;
-            mSlots[slot].mBufferState = BufferSlot::ACQUIRED;
+            mCore->setBufferStateLocked(slot, BufferSlot::ACQUIRED);
             mSlots[slot].mFence = Fence::NO_FENCE;
         }
 
@@ -185,16 +180,16 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
 
         mCore->mQueue.erase(front);
 
-        // We might have freed a slot while dropping old buffers, or the producer
-        // may be blocked waiting for the number of buffers in the queue to
-        // decrease.
-        mCore->mDequeueCondition.broadcast();
-
         ATRACE_INT(mCore->mConsumerName.string(), mCore->mQueue.size());
 
         mCore->validateConsistencyLocked();
     }
 
+    // We might have freed a slot while dropping old buffers, or the producer
+    // may be blocked waiting for the number of buffers in the queue to
+    // decrease. Wake it up without mMutex held so it can run right away.
+    mCore->mDequeueCondition.broadcast();
+
     if (listener != NULL) {
         for (int i = 0; i < numDroppedBuffers; ++i) {
             listener->onBufferReleased();
@@ -247,12 +242,7 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
     Mutex::Autolock lock(mCore->mMutex);
 
     // Make sure we don't have too many acquired buffers
-    int numAcquiredBuffers = 0;
-    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-        if (mSlots[s].mBufferState == BufferSlot::ACQUIRED) {
-            ++numAcquiredBuffers;
-        }
-    }
+    int numAcquiredBuffers = mCore->mAcquiredSlots.count();
 
     if (numAcquiredBuffers >= mCore->mMaxAcquiredBufferCount + 1) {
         BQ_LOGE("attachBuffer(P): max acquired buffer count reached: %d "
@@ -271,12 +261,11 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
     // Find a free slot to put the buffer into
     int found = BufferQueueCore::INVALID_BUFFER_SLOT;
     if (!mCore->mFreeSlots.empty()) {
-        auto slot = mCore->mFreeSlots.begin();
-        found = *slot;
-        mCore->mFreeSlots.erase(slot);
+        found = mCore->mFreeSlots.first();
+        mCore->mFreeSlots.erase(found);
     } else if (!mCore->mFreeBuffers.empty()) {
         found = mCore->mFreeBuffers.front();
-        mCore->mFreeBuffers.remove(found);
+        mCore->mFreeBuffers.pop_front();
     }
     if (found == BufferQueueCore::INVALID_BUFFER_SLOT) {
         BQ_LOGE("attachBuffer(P): could not find free buffer slot");
@@ -288,7 +277,7 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
     BQ_LOGV("attachBuffer(C): returning slot %d", *outSlot);
 
     mSlots[*outSlot].mGraphicBuffer = buffer;
-    mSlots[*outSlot].mBufferState = BufferSlot::ACQUIRED;
+    mCore->setBufferStateLocked(*outSlot, BufferSlot::ACQUIRED);
     mSlots[*outSlot].mAttachedByConsumer = true;
     mSlots[*outSlot].mNeedsCleanupOnRelease = false;
     mSlots[*outSlot].mFence = Fence::NO_FENCE;
@@ -354,7 +343,7 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
             mSlots[slot].mEglDisplay = eglDisplay;
             mSlots[slot].mEglFence = eglFence;
             mSlots[slot].mFence = releaseFence;
-            mSlots[slot].mBufferState = BufferSlot::FREE;
+            mCore->setBufferStateLocked(slot, BufferSlot::FREE);
             mCore->mFreeBuffers.push_back(slot);
             listener = mCore->mConnectedProducerListener;
             BQ_LOGV("releaseBuffer: releasing slot %d", slot);
@@ -369,10 +358,12 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
             return BAD_VALUE;
         }
 
-        mCore->mDequeueCondition.broadcast();
         mCore->validateConsistencyLocked();
     } // Autolock scope
 
+    // Wake up dequeueBuffer without mMutex held so it can run right away
+    mCore->mDequeueCondition.broadcast();
+
     // Call back without lock held
     if (listener != NULL) {
         listener->onBufferReleased();
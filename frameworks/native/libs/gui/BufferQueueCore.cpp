@@ -55,6 +55,9 @@ BufferQueueCore::BufferQueueCore(const sp<IGraphicBufferAlloc>& allocator) :
     mQueue(),
     mFreeSlots(),
     mFreeBuffers(),
+    mDequeuedSlots(),
+    mQueuedSlots(),
+    mAcquiredSlots(),
     mOverrideMaxBufferCount(0),
     mDequeueCondition(),
     mUseAsyncBuffer(true),
@@ -88,6 +91,56 @@ BufferQueueCore::BufferQueueCore(const sp<IGraphicBufferAlloc>& allocator) :
 
 BufferQueueCore::~BufferQueueCore() {}
 
+static_assert(BufferQueueDefs::NUM_BUFFER_SLOTS <= 64,
+        "SlotMask holds at most 64 slots");
+
+void BufferQueueCore::SlotList::push_front(int slot) {
+    if (mSize == BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        ALOGE("SlotList::push_front: slot %d does not fit", slot);
+        return;
+    }
+    mHead = (mHead + BufferQueueDefs::NUM_BUFFER_SLOTS - 1) %
+            BufferQueueDefs::NUM_BUFFER_SLOTS;
+    mEntries[mHead] = slot;
+    ++mSize;
+}
+
+void BufferQueueCore::SlotList::push_back(int slot) {
+    if (mSize == BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        ALOGE("SlotList::push_back: slot %d does not fit", slot);
+        return;
+    }
+    mEntries[(mHead + mSize) % BufferQueueDefs::NUM_BUFFER_SLOTS] = slot;
+    ++mSize;
+}
+
+void BufferQueueCore::SlotList::pop_front() {
+    mHead = (mHead + 1) % BufferQueueDefs::NUM_BUFFER_SLOTS;
+    --mSize;
+}
+
+void BufferQueueCore::SlotList::remove(int slot) {
+    // Close the gap by moving the following entries down by one
+    int kept = 0;
+    for (int i = 0; i < mSize; ++i) {
+        int entry = at(i);
+        if (entry != slot) {
+            mEntries[(mHead + kept) % BufferQueueDefs::NUM_BUFFER_SLOTS] = entry;
+            ++kept;
+        }
+    }
+    mSize = kept;
+}
+
+bool BufferQueueCore::SlotList::contains(int slot) const {
+    for (int i = 0; i < mSize; ++i) {
+        if (at(i) == slot) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void BufferQueueCore::dump(String8& result, const char* prefix) const {
     Mutex::Autolock lock(mMutex);
 
@@ -170,11 +223,9 @@ int BufferQueueCore::getMaxBufferCountLocked(bool async) const {
     // waiting to be consumed need to have their slots preserved. Such buffers
     // will temporarily keep the max buffer count up until the slots no longer
     // need to be preserved.
-    for (int s = maxBufferCount; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-        BufferSlot::BufferState state = mSlots[s].mBufferState;
-        if (state == BufferSlot::QUEUED || state == BufferSlot::DEQUEUED) {
-            maxBufferCount = s + 1;
-        }
+    SlotMask preserved(mDequeuedSlots | mQueuedSlots);
+    if (!preserved.empty() && preserved.last() >= maxBufferCount) {
+        maxBufferCount = preserved.last() + 1;
     }
 
     return maxBufferCount;
@@ -196,6 +247,37 @@ status_t BufferQueueCore::setDefaultMaxBufferCountLocked(int count) {
     return NO_ERROR;
 }
 
+void BufferQueueCore::setBufferStateLocked(int slot,
+        BufferSlot::BufferState state) {
+    switch (mSlots[slot].mBufferState) {
+        case BufferSlot::DEQUEUED:
+            mDequeuedSlots.erase(slot);
+            break;
+        case BufferSlot::QUEUED:
+            mQueuedSlots.erase(slot);
+            break;
+        case BufferSlot::ACQUIRED:
+            mAcquiredSlots.erase(slot);
+            break;
+        default:
+            break;
+    }
+    switch (state) {
+        case BufferSlot::DEQUEUED:
+            mDequeuedSlots.insert(slot);
+            break;
+        case BufferSlot::QUEUED:
+            mQueuedSlots.insert(slot);
+            break;
+        case BufferSlot::ACQUIRED:
+            mAcquiredSlots.insert(slot);
+            break;
+        default:
+            break;
+    }
+    mSlots[slot].mBufferState = state;
+}
+
 void BufferQueueCore::freeBufferLocked(int slot) {
     BQ_LOGV("freeBufferLocked: slot %d", slot);
     bool hadBuffer = mSlots[slot].mGraphicBuffer != NULL;
@@ -211,7 +293,7 @@ void BufferQueueCore::freeBufferLocked(int slot) {
         mFreeBuffers.remove(slot);
         mFreeSlots.insert(slot);
     }
-    mSlots[slot].mBufferState = BufferSlot::FREE;
+    setBufferStateLocked(slot, BufferSlot::FREE);
     mSlots[slot].mAcquireCalled = false;
     mSlots[slot].mFrameNumber = 0;
 
@@ -255,12 +337,11 @@ void BufferQueueCore::waitWhileAllocatingLocked() const {
 }
 
 void BufferQueueCore::validateConsistencyLocked() const {
+#if BQ_VALIDATE_CONSISTENCY
     static const useconds_t PAUSE_TIME = 0;
     for (int slot = 0; slot < BufferQueueDefs::NUM_BUFFER_SLOTS; ++slot) {
-        bool isInFreeSlots = mFreeSlots.count(slot) != 0;
-        bool isInFreeBuffers =
-                std::find(mFreeBuffers.cbegin(), mFreeBuffers.cend(), slot) !=
-                mFreeBuffers.cend();
+        bool isInFreeSlots = mFreeSlots.contains(slot);
+        bool isInFreeBuffers = mFreeBuffers.contains(slot);
         if (mSlots[slot].mBufferState == BufferSlot::FREE) {
             if (mSlots[slot].mGraphicBuffer == NULL) {
                 if (!isInFreeSlots) {
@@ -295,7 +376,18 @@ void BufferQueueCore::validateConsistencyLocked() const {
                 usleep(PAUSE_TIME);
             }
         }
+
+        BufferSlot::BufferState state = mSlots[slot].mBufferState;
+        if (mDequeuedSlots.contains(slot) != (state == BufferSlot::DEQUEUED) ||
+                mQueuedSlots.contains(slot) != (state == BufferSlot::QUEUED) ||
+                mAcquiredSlots.contains(slot) !=
+                        (state == BufferSlot::ACQUIRED)) {
+            BQ_LOGE("Slot %d state masks do not match its state (%d)",
+                    slot, state);
+            usleep(PAUSE_TIME);
+        }
     }
+#endif
 }
 
 } // namespace android
@@ -93,11 +93,9 @@ status_t BufferQueueProducer::setBufferCount(int bufferCount) {
         }
 
         // There must be no dequeued buffers when changing the buffer count.
-        for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
-            if (mSlots[s].mBufferState == BufferSlot::DEQUEUED) {
-                BQ_LOGE("setBufferCount: buffer owned by producer");
-                return BAD_VALUE;
-            }
+        if (!mCore->mDequeuedSlots.empty()) {
+            BQ_LOGE("setBufferCount: buffer owned by producer");
+            return BAD_VALUE;
         }
 
         if (bufferCount == 0) {
@@ -161,20 +159,10 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(const char* caller,
             }
         }
 
-        int dequeuedCount = 0;
-        int acquiredCount = 0;
-        for (int s = 0; s < maxBufferCount; ++s) {
-            switch (mSlots[s].mBufferState) {
-                case BufferSlot::DEQUEUED:
-                    ++dequeuedCount;
-                    break;
-                case BufferSlot::ACQUIRED:
-                    ++acquiredCount;
-                    break;
-                default:
-                    break;
-            }
-        }
+        const int dequeuedCount =
+                mCore->mDequeuedSlots.countBelow(maxBufferCount);
+        const int acquiredCount =
+                mCore->mAcquiredSlots.countBelow(maxBufferCount);
 
         // Producers are not allowed to dequeue more than one buffer if they
         // did not set a buffer count
@@ -220,20 +208,18 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(const char* caller,
             bool need_alloc = false;
             if (!mCore->mFreeSlots.empty()
                         && !strcmp("FramebufferSurface" ,mConsumerName.string())) {
-                auto slot = mCore->mFreeSlots.begin();
-                if (*slot < maxBufferCount) {
+                if (mCore->mFreeSlots.first() < maxBufferCount) {
                     need_alloc = true;
                 }
             }
             if (!mCore->mFreeBuffers.empty() && !need_alloc) {
-                auto slot = mCore->mFreeBuffers.begin();
-                *found = *slot;
-                mCore->mFreeBuffers.erase(slot);
+                *found = mCore->mFreeBuffers.front();
+                mCore->mFreeBuffers.pop_front();
             } else if (mCore->mAllowAllocation && !mCore->mFreeSlots.empty()) {
-                auto slot = mCore->mFreeSlots.begin();
+                int slot = mCore->mFreeSlots.first();
                 // Only return free slots up to the max buffer count
-                if (*slot < maxBufferCount) {
-                    *found = *slot;
+                if (slot < maxBufferCount) {
+                    *found = slot;
                     mCore->mFreeSlots.erase(slot);
                 }
             }
@@ -266,18 +252,6 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
         sp<android::Fence> *outFence, bool async,
         uint32_t width, uint32_t height, PixelFormat format, uint32_t usage) {
     ATRACE_CALL();
-    { // Autolock scope
-        Mutex::Autolock lock(mCore->mMutex);
-        mConsumerName = mCore->mConsumerName;
-    } // Autolock scope
-
-    BQ_LOGV("dequeueBuffer: async=%s w=%u h=%u format=%#x, usage=%#x",
-            async ? "true" : "false", width, height, format, usage);
-
-    if ((width && !height) || (!width && height)) {
-        BQ_LOGE("dequeueBuffer: invalid size: w=%u h=%u", width, height);
-        return BAD_VALUE;
-    }
 
     status_t returnFlags = NO_ERROR;
     EGLDisplay eglDisplay = EGL_NO_DISPLAY;
@@ -286,6 +260,16 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
     { // Autolock scope
         Mutex::Autolock lock(mCore->mMutex);
+        mConsumerName = mCore->mConsumerName;
+
+        BQ_LOGV("dequeueBuffer: async=%s w=%u h=%u format=%#x, usage=%#x",
+                async ? "true" : "false", width, height, format, usage);
+
+        if ((width && !height) || (!width && height)) {
+            BQ_LOGE("dequeueBuffer: invalid size: w=%u h=%u", width, height);
+            return BAD_VALUE;
+        }
+
         mCore->waitWhileAllocatingLocked();
 
         if (format == 0) {
@@ -335,7 +319,7 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
         attachedByConsumer = mSlots[found].mAttachedByConsumer;
 
-        mSlots[found].mBufferState = BufferSlot::DEQUEUED;
+        mCore->setBufferStateLocked(found, BufferSlot::DEQUEUED);
 
         const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
         if ((buffer == NULL) ||
@@ -425,6 +409,78 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
     return returnFlags;
 }
 
+status_t BufferQueueProducer::dequeueBuffers(size_t count, bool async,
+        uint32_t width, uint32_t height, PixelFormat format, uint32_t usage,
+        std::vector<DequeueBufferOutput>* outputs) {
+    ATRACE_CALL();
+    if (outputs == NULL || count == 0 ||
+            count > BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        return BAD_VALUE;
+    }
+
+    // The first buffer is waited for like a single dequeueBuffer would
+    status_t result = IGraphicBufferProducer::dequeueBuffers(1, async, width,
+            height, format, usage, outputs);
+    if (result != NO_ERROR) {
+        return result;
+    }
+
+    // Take the rest only while free slots are left, so that the caller is not
+    // held up until the consumer has released a whole batch
+    while (outputs->size() < count) {
+        { // Autolock scope
+            Mutex::Autolock lock(mCore->mMutex);
+            if (!hasFreeSlotLocked(async)) {
+                break;
+            }
+        } // Autolock scope
+
+        std::vector<DequeueBufferOutput> next;
+        if (IGraphicBufferProducer::dequeueBuffers(1, async, width, height,
+                format, usage, &next) != NO_ERROR) {
+            // The error is reported by the next call
+            break;
+        }
+        outputs->push_back(next[0]);
+    }
+    return NO_ERROR;
+}
+
+bool BufferQueueProducer::hasFreeSlotLocked(bool async) const {
+    if (mCore->mIsAbandoned) {
+        return false;
+    }
+    const int maxBufferCount = mCore->getMaxBufferCountLocked(async);
+    if (async && mCore->mOverrideMaxBufferCount &&
+            mCore->mOverrideMaxBufferCount < maxBufferCount) {
+        return false;
+    }
+
+    // The limits waitForFreeSlotThenRelock fails on, without logging
+    const int dequeuedCount = mCore->mDequeuedSlots.countBelow(maxBufferCount);
+    if (!mCore->mOverrideMaxBufferCount && dequeuedCount) {
+        // Only one buffer may be dequeued without a buffer count set
+        return false;
+    }
+    if (dequeuedCount >= maxBufferCount) {
+        return false;
+    }
+    if (mCore->mBufferHasBeenQueued &&
+            maxBufferCount - (dequeuedCount + 1) <
+                mCore->getMinUndequeuedBufferCountLocked(async)) {
+        return false;
+    }
+
+    if (mCore->mQueue.size() > static_cast<size_t>(maxBufferCount)) {
+        return false;
+    }
+    if (!mCore->mFreeBuffers.empty()) {
+        return true;
+    }
+    return mCore->mAllowAllocation && !mCore->mFreeSlots.empty() &&
+            mCore->mFreeSlots.first() < maxBufferCount;
+}
+
 status_t BufferQueueProducer::detachBuffer(int slot) {
     ATRACE_CALL();
     ATRACE_BUFFER_INDEX(slot);
@@ -482,7 +538,7 @@ status_t BufferQueueProducer::detachNextBuffer(sp<GraphicBuffer>* outBuffer,
     }
 
     int found = mCore->mFreeBuffers.front();
-    mCore->mFreeBuffers.remove(found);
+    mCore->mFreeBuffers.pop_front();
 
     BQ_LOGV("detachNextBuffer detached slot %d", found);
 
@@ -539,7 +595,7 @@ status_t BufferQueueProducer::attachBuffer(int* outSlot,
             *outSlot, returnFlags);
 
     mSlots[*outSlot].mGraphicBuffer = buffer;
-    mSlots[*outSlot].mBufferState = BufferSlot::DEQUEUED;
+    mCore->setBufferStateLocked(*outSlot, BufferSlot::DEQUEUED);
     mSlots[*outSlot].mEglFence = EGL_NO_SYNC_KHR;
     mSlots[*outSlot].mFence = Fence::NO_FENCE;
     mSlots[*outSlot].mRequestBufferCalled = true;
@@ -643,7 +699,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mSlots[slot].mFence = fence;
-        mSlots[slot].mBufferState = BufferSlot::QUEUED;
+        mCore->setBufferStateLocked(slot, BufferSlot::QUEUED);
         ++mCore->mFrameCounter;
         mSlots[slot].mFrameNumber = mCore->mFrameCounter;
 
@@ -679,7 +735,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
                 // If the front queued buffer is still being tracked, we first
                 // mark it as freed
                 if (mCore->stillTracking(front)) {
-                    mSlots[front->mSlot].mBufferState = BufferSlot::FREE;
+                    mCore->setBufferStateLocked(front->mSlot, BufferSlot::FREE);
                     mCore->mFreeBuffers.push_front(front->mSlot);
                 }
                 // Overwrite the droppable buffer with the incoming one
@@ -692,7 +748,6 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mCore->mBufferHasBeenQueued = true;
-        mCore->mDequeueCondition.broadcast();
 
         output->inflate(mCore->mDefaultWidth, mCore->mDefaultHeight,
                 mCore->mTransformHint,
@@ -706,6 +761,10 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         mCore->validateConsistencyLocked();
     } // Autolock scope
 
+    // Wake up dequeueBuffer only now, so that it doesn't wake up just to block
+    // on mMutex
+    mCore->mDequeueCondition.broadcast();
+
     // Wait without lock held
     if (mCore->mConnectedApi == NATIVE_WINDOW_API_EGL) {
         // Waiting here allows for two full buffers to be queued but not a
@@ -765,7 +824,7 @@ void BufferQueueProducer::cancelBuffer(int slot, const sp<Fence>& fence) {
     }
 
     mCore->mFreeBuffers.push_front(slot);
-    mSlots[slot].mBufferState = BufferSlot::FREE;
+    mCore->setBufferStateLocked(slot, BufferSlot::FREE);
     mSlots[slot].mFence = fence;
     mCore->mDequeueCondition.broadcast();
     mCore->validateConsistencyLocked();
@@ -26,6 +26,7 @@
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
 
+#include <gui/BufferQueueDefs.h>
 #include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
 
@@ -49,6 +50,8 @@ enum {
     ALLOW_ALLOCATION,
     SET_GENERATION_NUMBER,
     GET_CONSUMER_NAME,
+    DEQUEUE_BUFFERS,
+    QUEUE_BUFFERS,
 };
 
 class BpGraphicBufferProducer : public BpInterface<IGraphicBufferProducer>
@@ -308,6 +311,94 @@ public:
         }
         return reply.readString8();
     }
+
+    virtual status_t dequeueBuffers(size_t count, bool async, uint32_t width,
+            uint32_t height, PixelFormat format, uint32_t usage,
+            std::vector<DequeueBufferOutput>* outputs) {
+        if (outputs == NULL || count == 0 ||
+                count > BufferQueueDefs::NUM_BUFFER_SLOTS) {
+            return BAD_VALUE;
+        }
+        outputs->clear();
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        data.writeUint32(static_cast<uint32_t>(count));
+        data.writeInt32(static_cast<int32_t>(async));
+        data.writeUint32(width);
+        data.writeUint32(height);
+        data.writeInt32(static_cast<int32_t>(format));
+        data.writeUint32(usage);
+        status_t result = remote()->transact(DEQUEUE_BUFFERS, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        uint32_t numOutputs = reply.readUint32();
+        if (numOutputs > count) {
+            ALOGE("dequeueBuffers: got %u buffers, asked for %zu",
+                    numOutputs, count);
+            return BAD_VALUE;
+        }
+        outputs->resize(numOutputs);
+        for (DequeueBufferOutput& output : *outputs) {
+            output.slot = reply.readInt32();
+            output.result = reply.readInt32();
+            bool nonNull = reply.readInt32();
+            if (nonNull) {
+                output.fence = new Fence();
+                reply.read(*output.fence);
+            }
+            nonNull = reply.readInt32();
+            if (nonNull) {
+                output.buffer = new GraphicBuffer();
+                result = reply.read(*output.buffer);
+                if (result != NO_ERROR) {
+                    output.buffer.clear();
+                }
+            }
+        }
+        result = reply.readInt32();
+        return result;
+    }
+
+    virtual status_t queueBuffers(const std::vector<QueuedBuffer>& buffers,
+            std::vector<status_t>* results, QueueBufferOutput* output) {
+        if (buffers.empty() ||
+                buffers.size() > BufferQueueDefs::NUM_BUFFER_SLOTS) {
+            return BAD_VALUE;
+        }
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        data.writeUint32(static_cast<uint32_t>(buffers.size()));
+        for (const QueuedBuffer& buffer : buffers) {
+            data.writeInt32(buffer.slot);
+            data.write(buffer.input);
+        }
+        status_t result = remote()->transact(QUEUE_BUFFERS, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        uint32_t numResults = reply.readUint32();
+        if (numResults > buffers.size()) {
+            ALOGE("queueBuffers: got %u results for %zu buffers",
+                    numResults, buffers.size());
+            return BAD_VALUE;
+        }
+        if (results != NULL) {
+            results->resize(numResults);
+        }
+        for (uint32_t i = 0; i < numResults; ++i) {
+            status_t bufferResult = reply.readInt32();
+            if (results != NULL) {
+                (*results)[i] = bufferResult;
+            }
+        }
+        const void* outputData = reply.readInplace(sizeof(QueueBufferOutput));
+        if (output != NULL && outputData != NULL) {
+            memcpy(output, outputData, sizeof(*output));
+        }
+        result = reply.readInt32();
+        return result;
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -484,12 +575,121 @@ status_t BnGraphicBufferProducer::onTransact(
             reply->writeString8(getConsumerName());
             return NO_ERROR;
         }
+        case DEQUEUE_BUFFERS: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            size_t count = data.readUint32();
+            bool async = static_cast<bool>(data.readInt32());
+            uint32_t width = data.readUint32();
+            uint32_t height = data.readUint32();
+            PixelFormat format = static_cast<PixelFormat>(data.readInt32());
+            uint32_t usage = data.readUint32();
+            std::vector<DequeueBufferOutput> outputs;
+            status_t result = dequeueBuffers(count, async, width, height,
+                    format, usage, &outputs);
+            reply->writeUint32(static_cast<uint32_t>(outputs.size()));
+            for (const DequeueBufferOutput& output : outputs) {
+                reply->writeInt32(output.slot);
+                reply->writeInt32(output.result);
+                reply->writeInt32(output.fence != NULL);
+                if (output.fence != NULL) {
+                    reply->write(*output.fence);
+                }
+                reply->writeInt32(output.buffer != NULL);
+                if (output.buffer != NULL) {
+                    reply->write(*output.buffer);
+                }
+            }
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
+        case QUEUE_BUFFERS: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            size_t count = data.readUint32();
+            std::vector<QueuedBuffer> buffers;
+            if (count <= BufferQueueDefs::NUM_BUFFER_SLOTS) {
+                buffers.reserve(count);
+                for (size_t i = 0; i < count; ++i) {
+                    int slot = data.readInt32();
+                    buffers.push_back(QueuedBuffer(slot, QueueBufferInput(data)));
+                }
+            }
+            std::vector<status_t> results;
+            QueueBufferOutput output;
+            memset(&output, 0, sizeof(output));
+            status_t result = queueBuffers(buffers, &results, &output);
+            reply->writeUint32(static_cast<uint32_t>(results.size()));
+            for (status_t bufferResult : results) {
+                reply->writeInt32(bufferResult);
+            }
+            memcpy(reply->writeInplace(sizeof(QueueBufferOutput)), &output,
+                    sizeof(output));
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
 
 // ----------------------------------------------------------------------------
 
+status_t IGraphicBufferProducer::dequeueBuffers(size_t count, bool async,
+        uint32_t width, uint32_t height, PixelFormat format, uint32_t usage,
+        std::vector<DequeueBufferOutput>* outputs) {
+    if (outputs == NULL || count == 0 ||
+            count > BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        return BAD_VALUE;
+    }
+    outputs->clear();
+    for (size_t i = 0; i < count; ++i) {
+        DequeueBufferOutput output;
+        status_t result = dequeueBuffer(&output.slot, &output.fence, async,
+                width, height, format, usage);
+        if (result >= 0 && (result & BUFFER_NEEDS_REALLOCATION)) {
+            status_t err = requestBuffer(output.slot, &output.buffer);
+            if (err != NO_ERROR) {
+                cancelBuffer(output.slot, output.fence);
+                result = err;
+            }
+        }
+        if (result < 0) {
+            // Keep what was dequeued; the error is reported by the next call
+            return outputs->empty() ? result : NO_ERROR;
+        }
+        output.result = result;
+        outputs->push_back(output);
+    }
+    return NO_ERROR;
+}
+
+status_t IGraphicBufferProducer::queueBuffers(
+        const std::vector<QueuedBuffer>& buffers,
+        std::vector<status_t>* results, QueueBufferOutput* output) {
+    if (buffers.empty() || buffers.size() > BufferQueueDefs::NUM_BUFFER_SLOTS) {
+        return BAD_VALUE;
+    }
+    if (results != NULL) {
+        results->clear();
+    }
+    status_t firstError = NO_ERROR;
+    for (const QueuedBuffer& buffer : buffers) {
+        QueueBufferOutput bufferOutput;
+        status_t result = queueBuffer(buffer.slot, buffer.input, &bufferOutput);
+        if (results != NULL) {
+            results->push_back(result);
+        }
+        if (result == NO_ERROR) {
+            if (output != NULL) {
+                *output = bufferOutput;
+            }
+        } else if (firstError == NO_ERROR) {
+            firstError = result;
+        }
+    }
+    return firstError;
+}
+
+// ----------------------------------------------------------------------------
+
 IGraphicBufferProducer::QueueBufferInput::QueueBufferInput(const Parcel& parcel) {
     parcel.read(*this);
 }
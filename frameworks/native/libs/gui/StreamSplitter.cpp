@@ -55,14 +55,13 @@ status_t StreamSplitter::createSplitter(
 }
 
 StreamSplitter::StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue)
-      : mIsAbandoned(false), mMutex(), mReleaseCondition(),
+      : mIsAbandoned(false), mMutex(), mInputMutex(), mReleaseCondition(),
         mOutstandingBuffers(0), mInput(inputQueue), mOutputs(), mBuffers() {}
 
 StreamSplitter::~StreamSplitter() {
     mInput->consumerDisconnect();
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
-    for (; output != mOutputs.end(); ++output) {
-        (*output)->disconnect(NATIVE_WINDOW_API_CPU);
+    for (size_t i = 0; i < mOutputs.size(); ++i) {
+        mOutputs[i].producer->disconnect(NATIVE_WINDOW_API_CPU);
     }
 
     if (mBuffers.size() > 0) {
@@ -72,15 +71,36 @@ StreamSplitter::~StreamSplitter() {
 
 status_t StreamSplitter::addOutput(
         const sp<IGraphicBufferProducer>& outputQueue) {
+    return addOutput(outputQueue, OUTPUT_POLICY_BLOCK, 0);
+}
+
+status_t StreamSplitter::addOutput(
+        const sp<IGraphicBufferProducer>& outputQueue, OutputPolicy policy,
+        int maxBuffers) {
     if (outputQueue == NULL) {
         ALOGE("addOutput: outputQueue must not be NULL");
         return BAD_VALUE;
     }
+    switch (policy) {
+        case OUTPUT_POLICY_BLOCK:
+            break;
+        case OUTPUT_POLICY_DROP_OLDEST:
+        case OUTPUT_POLICY_SKIP:
+            if (maxBuffers < 1) {
+                ALOGE("addOutput: maxBuffers must be at least 1 (%d)",
+                        maxBuffers);
+                return BAD_VALUE;
+            }
+            break;
+        default:
+            ALOGE("addOutput: unknown policy %d", policy);
+            return BAD_VALUE;
+    }
 
     Mutex::Autolock lock(mMutex);
 
     IGraphicBufferProducer::QueueBufferOutput queueBufferOutput;
-    sp<OutputListener> listener(new OutputListener(this, outputQueue));
+    sp<OutputListener> listener(new OutputListener(this, mOutputs.size()));
     IInterface::asBinder(outputQueue)->linkToDeath(listener);
     status_t status = outputQueue->connect(listener, NATIVE_WINDOW_API_CPU,
             /* producerControlledByApp */ false, &queueBufferOutput);
@@ -89,7 +109,11 @@ status_t StreamSplitter::addOutput(
         return status;
     }
 
-    mOutputs.push_back(outputQueue);
+    Output output;
+    output.producer = outputQueue;
+    output.policy = policy;
+    output.maxBuffers = maxBuffers;
+    mOutputs.push_back(output);
 
     return NO_ERROR;
 }
@@ -99,46 +123,164 @@ void StreamSplitter::setName(const String8 &name) {
     mInput->setConsumerName(name);
 }
 
-void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
-    ATRACE_CALL();
+status_t StreamSplitter::getOutputStats(size_t index,
+        OutputStats* outStats) const {
+    if (outStats == NULL) {
+        ALOGE("getOutputStats: outStats must not be NULL");
+        return BAD_VALUE;
+    }
+
     Mutex::Autolock lock(mMutex);
+    if (index >= mOutputs.size()) {
+        ALOGE("getOutputStats: no output %zu", index);
+        return BAD_VALUE;
+    }
+    getOutputStatsLocked(index, outStats);
+    return NO_ERROR;
+}
 
-    // The current policy is that if any one consumer is consuming buffers too
-    // slowly, the splitter will stall the rest of the outputs by not acquiring
-    // any more buffers from the input. This will cause back pressure on the
-    // input queue, slowing down its producer.
-
-    // If there are too many outstanding buffers, we block until a buffer is
-    // released back to the input in onBufferReleased
-    while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
-        mReleaseCondition.wait(mMutex);
-
-        // If the splitter is abandoned while we are waiting, the release
-        // condition variable will be broadcast, and we should just return
-        // without attempting to do anything more (since the input queue will
-        // also be abandoned).
-        if (mIsAbandoned) {
-            return;
-        }
+void StreamSplitter::getOutputStatsLocked(size_t index,
+        OutputStats* outStats) const {
+    const Output& output(mOutputs[index]);
+    outStats->policy = output.policy;
+    outStats->queued = output.queued;
+    outStats->skipped = output.skipped;
+    // Only a droppable frame can be replaced; every other buffer comes back
+    // with a release callback
+    outStats->dropped = 0;
+    if (output.policy == OUTPUT_POLICY_DROP_OLDEST &&
+            output.returned > output.releaseCallbacks) {
+        outStats->dropped = output.returned - output.releaseCallbacks;
     }
-    ++mOutstandingBuffers;
+    outStats->outstanding = static_cast<uint32_t>(output.outstanding);
+    outStats->meanLatency = output.returned > 0 ?
+            output.totalLatency / static_cast<nsecs_t>(output.returned) : 0;
+    outStats->maxLatency = output.maxLatency;
+}
 
-    // Acquire and detach the buffer from the input
-    BufferItem bufferItem;
-    status_t status = mInput->acquireBuffer(&bufferItem, /* presentWhen */ 0);
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "acquiring buffer from input failed (%d)", status);
+static const char* policyName(StreamSplitter::OutputPolicy policy) {
+    switch (policy) {
+        case StreamSplitter::OUTPUT_POLICY_BLOCK: return "block";
+        case StreamSplitter::OUTPUT_POLICY_DROP_OLDEST: return "drop-oldest";
+        case StreamSplitter::OUTPUT_POLICY_SKIP: return "skip";
+    }
+    return "unknown";
+}
 
-    ALOGV("acquired buffer %#" PRIx64 " from input",
-            bufferItem.mGraphicBuffer->getId());
+void StreamSplitter::dump(String8& result, const char* prefix) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("%sStreamSplitter: %zu outputs, %d outstanding "
+            "buffers%s\n", prefix, mOutputs.size(), mOutstandingBuffers,
+            mIsAbandoned ? " (abandoned)" : "");
+    for (size_t i = 0; i < mOutputs.size(); ++i) {
+        OutputStats stats;
+        getOutputStatsLocked(i, &stats);
+        result.appendFormat("%s  [%zu] %s max=%d queued=%" PRIu64
+                " dropped=%" PRIu64 " skipped=%" PRIu64 " outstanding=%u"
+                " latency mean=%.2fms max=%.2fms\n", prefix, i,
+                policyName(stats.policy), mOutputs[i].maxBuffers,
+                stats.queued, stats.dropped, stats.skipped, stats.outstanding,
+                stats.meanLatency / 1e6, stats.maxLatency / 1e6);
+    }
+}
 
-    status = mInput->detachBuffer(bufferItem.mBuf);
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "detaching buffer from input failed (%d)", status);
+void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
+    ATRACE_CALL();
 
-    // Initialize our reference count for this buffer
-    mBuffers.add(bufferItem.mGraphicBuffer->getId(),
-            new BufferTracker(bufferItem.mGraphicBuffer));
+    // Where the buffer goes is decided with mMutex held, but it is attached
+    // and queued to the outputs without it, so that an output which is slow to
+    // take it does not hold up the release callbacks of the others
+    struct Target {
+        size_t index;
+        sp<IGraphicBufferProducer> producer;
+        bool blocking;
+        bool droppable;
+    };
+    Vector<Target> targets;
+    sp<BufferTracker> tracker;
+    BufferItem bufferItem;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+
+        // The current policy is that if any one blocking consumer is consuming
+        // buffers too slowly, the splitter will stall the rest of the outputs
+        // by not acquiring any more buffers from the input. This will cause
+        // back pressure on the input queue, slowing down its producer. Outputs
+        // with other policies lose frames instead (see below).
+
+        // If there are too many outstanding buffers, we block until a buffer is
+        // released by the last blocking output in reclaimOutputBuffers
+        while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
+            mReleaseCondition.wait(mMutex);
+
+            // If the splitter is abandoned while we are waiting, the release
+            // condition variable will be broadcast, and we should just return
+            // without attempting to do anything more (since the input queue
+            // will also be abandoned).
+            if (mIsAbandoned) {
+                return;
+            }
+        }
+        ++mOutstandingBuffers;
+
+        { // Input lock scope
+            // Acquire and detach the buffer from the input. A buffer that is
+            // being returned concurrently is attached and released first.
+            Mutex::Autolock inputLock(mInputMutex);
+            status_t status = mInput->acquireBuffer(&bufferItem,
+                    /* presentWhen */ 0);
+            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                    "acquiring buffer from input failed (%d)", status);
+
+            ALOGV("acquired buffer %#" PRIx64 " from input",
+                    bufferItem.mGraphicBuffer->getId());
+
+            status = mInput->detachBuffer(bufferItem.mBuf);
+            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                    "detaching buffer from input failed (%d)", status);
+        } // Input lock scope
+
+        // Initialize our reference count for this buffer. We hold a blocking
+        // reference until it has been queued to every output.
+        tracker = new BufferTracker(bufferItem.mGraphicBuffer);
+        tracker->incrementRefCountLocked(/* blocking */ true);
+        tracker->setQueueTime(systemTime());
+        mBuffers.add(bufferItem.mGraphicBuffer->getId(), tracker);
+
+        for (size_t i = 0; i < mOutputs.size(); ++i) {
+            Output& output(mOutputs.editItemAt(i));
+            bool full = false;
+            switch (output.policy) {
+                case OUTPUT_POLICY_BLOCK:
+                    break;
+                case OUTPUT_POLICY_DROP_OLDEST:
+                    // One more frame may wait in the queue to be replaced
+                    full = output.outstanding > output.maxBuffers;
+                    break;
+                case OUTPUT_POLICY_SKIP:
+                    full = output.outstanding >= output.maxBuffers;
+                    break;
+            }
+            if (full) {
+                ALOGV("skipping buffer %#" PRIx64 " for output %zu",
+                        bufferItem.mGraphicBuffer->getId(), i);
+                ++output.skipped;
+                continue;
+            }
+
+            Target target;
+            target.index = i;
+            target.producer = output.producer;
+            target.blocking = output.policy == OUTPUT_POLICY_BLOCK;
+            target.droppable = output.policy == OUTPUT_POLICY_DROP_OLDEST ||
+                    bufferItem.mIsDroppable;
+            targets.push_back(target);
+
+            tracker->incrementRefCountLocked(target.blocking);
+            ++output.outstanding;
+            ++output.queued;
+        }
+    } // Autolock scope
 
     IGraphicBufferProducer::QueueBufferInput queueInput(
             bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
@@ -146,107 +288,196 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
             static_cast<int32_t>(bufferItem.mScalingMode),
             bufferItem.mTransform, bufferItem.mIsDroppable,
             bufferItem.mFence);
+    IGraphicBufferProducer::QueueBufferInput droppableInput(
+            bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
+            bufferItem.mDataSpace, bufferItem.mCrop,
+            static_cast<int32_t>(bufferItem.mScalingMode),
+            bufferItem.mTransform, /* async */ true,
+            bufferItem.mFence);
 
     // Attach and queue the buffer to each of the outputs
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
-    for (; output != mOutputs.end(); ++output) {
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const Target& target(targets[t]);
+
+        // Take back buffers the output has freed first, so that attachBuffer
+        // does not pick the slot of one we have not detached yet
+        reclaimOutputBuffers(target.index);
+
         int slot;
-        status = (*output)->attachBuffer(&slot, bufferItem.mGraphicBuffer);
-        if (status == NO_INIT) {
-            // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
-            onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
-            continue;
+        status_t status = target.producer->attachBuffer(&slot,
+                bufferItem.mGraphicBuffer);
+        if (status == NO_ERROR) {
+            IGraphicBufferProducer::QueueBufferOutput queueOutput;
+            status = target.producer->queueBuffer(slot,
+                    target.droppable ? droppableInput : queueInput,
+                    &queueOutput);
+            LOG_ALWAYS_FATAL_IF(status != NO_ERROR && status != NO_INIT,
+                    "queueing buffer to output failed (%d)", status);
         } else {
-            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+            LOG_ALWAYS_FATAL_IF(status != NO_INIT,
                     "attaching buffer to output failed (%d)", status);
         }
 
-        IGraphicBufferProducer::QueueBufferOutput queueOutput;
-        status = (*output)->queueBuffer(slot, queueInput, &queueOutput);
         if (status == NO_INIT) {
             // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
+            // that, drop its reference so that we still release this buffer
+            // eventually, and move on to the next output
+            Mutex::Autolock lock(mMutex);
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
+            --mOutputs.editItemAt(target.index).outstanding;
+            decrementRefCountLocked(tracker, target.blocking);
             continue;
-        } else {
-            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-                    "queueing buffer to output failed (%d)", status);
         }
 
-        ALOGV("queued buffer %#" PRIx64 " to output %p",
-                bufferItem.mGraphicBuffer->getId(), output->get());
+        ALOGV("queued buffer %#" PRIx64 " to output %zu",
+                bufferItem.mGraphicBuffer->getId(), target.index);
+
+        if (target.droppable) {
+            // The queue may have replaced the frame queued before this one
+            reclaimOutputBuffers(target.index);
+        }
+    }
+
+    bool release;
+    {
+        Mutex::Autolock lock(mMutex);
+        release = decrementRefCountLocked(tracker, /* blocking */ true);
+    }
+    if (release) {
+        releaseToInput(tracker);
     }
 }
 
-void StreamSplitter::onBufferReleasedByOutput(
-        const sp<IGraphicBufferProducer>& from) {
+void StreamSplitter::onBufferReleasedByOutput(size_t index) {
     ATRACE_CALL();
-    Mutex::Autolock lock(mMutex);
+    {
+        Mutex::Autolock lock(mMutex);
+        ++mOutputs.editItemAt(index).releaseCallbacks;
+    }
+    reclaimOutputBuffers(index);
+}
 
-    sp<GraphicBuffer> buffer;
-    sp<Fence> fence;
-    status_t status = from->detachNextBuffer(&buffer, &fence);
-    if (status == NO_INIT) {
-        // If we just discovered that this output has been abandoned, note that,
-        // but we can't do anything else, since buffer is invalid
-        onAbandonedLocked();
-        return;
-    } else {
-        LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-                "detaching buffer from output failed (%d)", status);
+void StreamSplitter::reclaimOutputBuffers(size_t index) {
+    sp<IGraphicBufferProducer> from;
+    {
+        Mutex::Autolock lock(mMutex);
+        from = mOutputs[index].producer;
     }
 
-    ALOGV("detached buffer %#" PRIx64 " from output %p",
-          buffer->getId(), from.get());
+    while (true) {
+        sp<GraphicBuffer> buffer;
+        sp<Fence> fence;
+        status_t status = from->detachNextBuffer(&buffer, &fence);
+        if (status == NO_MEMORY) {
+            // Nothing left to reclaim; an earlier call may already have
+            // detached the buffer this callback was for
+            return;
+        } else if (status == NO_INIT) {
+            // If we just discovered that this output has been abandoned, note
+            // that, but we can't do anything else, since buffer is invalid
+            Mutex::Autolock lock(mMutex);
+            onAbandonedLocked();
+            return;
+        } else {
+            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                    "detaching buffer from output failed (%d)", status);
+        }
+
+        ALOGV("detached buffer %#" PRIx64 " from output %zu",
+              buffer->getId(), index);
+
+        sp<BufferTracker> tracker;
+        {
+            Mutex::Autolock lock(mMutex);
+            tracker = onBufferReturnedLocked(index, buffer, fence);
+        }
+        if (tracker != NULL) {
+            releaseToInput(tracker);
+        }
+    }
+}
 
-    const sp<BufferTracker>& tracker = mBuffers.editValueFor(buffer->getId());
+sp<StreamSplitter::BufferTracker> StreamSplitter::onBufferReturnedLocked(
+        size_t index, const sp<GraphicBuffer>& buffer,
+        const sp<Fence>& fence) {
+    ssize_t trackerIndex = mBuffers.indexOfKey(buffer->getId());
+    if (trackerIndex < 0) {
+        ALOGE("output %zu returned untracked buffer %#" PRIx64, index,
+                buffer->getId());
+        return NULL;
+    }
+    sp<BufferTracker> tracker = mBuffers.valueAt(
+            static_cast<size_t>(trackerIndex));
 
     // Merge the release fence of the incoming buffer so that the fence we send
     // back to the input includes all of the outputs' fences
     tracker->mergeFence(fence);
 
-    // Check to see if this is the last outstanding reference to this buffer
-    size_t releaseCount = tracker->incrementReleaseCountLocked();
-    ALOGV("buffer %#" PRIx64 " reference count %zu (of %zu)", buffer->getId(),
-            releaseCount, mOutputs.size());
-    if (releaseCount < mOutputs.size()) {
-        return;
+    Output& output(mOutputs.editItemAt(index));
+    --output.outstanding;
+    ++output.returned;
+    nsecs_t latency = systemTime() - tracker->getQueueTime();
+    output.totalLatency += latency;
+    if (latency > output.maxLatency) {
+        output.maxLatency = latency;
     }
 
-    // If we've been abandoned, we can't return the buffer to the input, so just
-    // stop tracking it and move on
-    if (mIsAbandoned) {
-        mBuffers.removeItem(buffer->getId());
-        return;
+    if (!decrementRefCountLocked(tracker,
+            output.policy == OUTPUT_POLICY_BLOCK)) {
+        return NULL;
+    }
+    return tracker;
+}
+
+bool StreamSplitter::decrementRefCountLocked(
+        const sp<BufferTracker>& tracker, bool blocking) {
+    bool lastBlocking;
+    size_t refCount = tracker->decrementRefCountLocked(blocking,
+            &lastBlocking);
+    ALOGV("buffer %#" PRIx64 " reference count %zu",
+            tracker->getBuffer()->getId(), refCount);
+
+    if (lastBlocking) {
+        // Notify any waiting onFrameAvailable calls
+        --mOutstandingBuffers;
+        mReleaseCondition.signal();
     }
+    if (refCount > 0) {
+        return false;
+    }
+
+    // We no longer need to track the buffer once no output holds it. Stop
+    // tracking it before it is returned, since the input may queue it again
+    // right away.
+    mBuffers.removeItem(tracker->getBuffer()->getId());
+
+    // If we've been abandoned, we can't return the buffer to the input, so just
+    // move on
+    return !mIsAbandoned;
+}
 
-    // Attach and release the buffer back to the input
+void StreamSplitter::releaseToInput(const sp<BufferTracker>& tracker) {
+    // Attach and release the buffer back to the input. Every output and
+    // onFrameAvailable may get here at the same time, but the input only lets
+    // one more buffer than its max acquired count be attached.
+    Mutex::Autolock lock(mInputMutex);
     int consumerSlot;
-    status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
+    status_t status = mInput->attachBuffer(&consumerSlot,
+            tracker->getBuffer());
+    if (status == NO_INIT) {
+        // The splitter was abandoned since the buffer was last dropped
+        return;
+    }
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "attaching buffer to input failed (%d)", status);
 
     status = mInput->releaseBuffer(consumerSlot, /* frameNumber */ 0,
             EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, tracker->getMergedFence());
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+    LOG_ALWAYS_FATAL_IF(status != NO_ERROR && status != NO_INIT,
             "releasing buffer to input failed (%d)", status);
 
-    ALOGV("released buffer %#" PRIx64 " to input", buffer->getId());
-
-    // We no longer need to track the buffer once it has been returned to the
-    // input
-    mBuffers.removeItem(buffer->getId());
-
-    // Notify any waiting onFrameAvailable calls
-    --mOutstandingBuffers;
-    mReleaseCondition.signal();
+    ALOGV("released buffer %#" PRIx64 " to input",
+            tracker->getBuffer()->getId());
 }
 
 void StreamSplitter::onAbandonedLocked() {
@@ -259,14 +490,13 @@ void StreamSplitter::onAbandonedLocked() {
 }
 
 StreamSplitter::OutputListener::OutputListener(
-        const sp<StreamSplitter>& splitter,
-        const sp<IGraphicBufferProducer>& output)
-      : mSplitter(splitter), mOutput(output) {}
+        const sp<StreamSplitter>& splitter, size_t index)
+      : mSplitter(splitter), mIndex(index) {}
 
 StreamSplitter::OutputListener::~OutputListener() {}
 
 void StreamSplitter::OutputListener::onBufferReleased() {
-    mSplitter->onBufferReleasedByOutput(mOutput);
+    mSplitter->onBufferReleasedByOutput(mIndex);
 }
 
 void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
@@ -275,7 +505,8 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
 }
 
 StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
+      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mRefCount(0),
+        mBlockingRefCount(0), mQueueTime(0) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
@@ -312,16 +312,6 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
     ATRACE_CALL();
     ALOGV("Surface::queueBuffer");
     Mutex::Autolock lock(mMutex);
-    int64_t timestamp;
-    bool isAutoTimestamp = false;
-    if (mTimestamp == NATIVE_WINDOW_TIMESTAMP_AUTO) {
-        timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
-        isAutoTimestamp = true;
-        ALOGV("Surface::queueBuffer making up timestamp: %.2f ms",
-            timestamp / 1000000.f);
-    } else {
-        timestamp = mTimestamp;
-    }
     int i = getSlotFromBufferLocked(buffer);
     if (i < 0) {
         if (fenceFd >= 0) {
@@ -330,13 +320,32 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
         return i;
     }
 
+    IGraphicBufferProducer::QueueBufferOutput output;
+    IGraphicBufferProducer::QueueBufferInput input(
+            getQueueBufferInputLocked(buffer, fenceFd, mTimestamp));
+    status_t err = mGraphicBufferProducer->queueBuffer(i, input, &output);
+    if (err != OK)  {
+        ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
+    }
+    onBufferQueuedLocked(output);
+    return err;
+}
+
+IGraphicBufferProducer::QueueBufferInput Surface::getQueueBufferInputLocked(
+        android_native_buffer_t* buffer, int fenceFd, int64_t timestamp) {
+    bool isAutoTimestamp = false;
+    if (timestamp == NATIVE_WINDOW_TIMESTAMP_AUTO) {
+        timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+        isAutoTimestamp = true;
+        ALOGV("Surface::queueBuffer making up timestamp: %.2f ms",
+            timestamp / 1000000.f);
+    }
 
     // Make sure the crop rectangle is entirely inside the buffer.
     Rect crop;
     mCrop.intersect(Rect(buffer->width, buffer->height), &crop);
 
     sp<Fence> fence(fenceFd >= 0 ? new Fence(fenceFd) : Fence::NO_FENCE);
-    IGraphicBufferProducer::QueueBufferOutput output;
     IGraphicBufferProducer::QueueBufferInput input(timestamp, isAutoTimestamp,
             mDataSpace, crop, mScalingMode, mTransform ^ mStickyTransform,
             mSwapIntervalZero, fence, mStickyTransform);
@@ -404,10 +413,11 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
         input.setSurfaceDamage(flippedRegion);
     }
 
-    status_t err = mGraphicBufferProducer->queueBuffer(i, input, &output);
-    if (err != OK)  {
-        ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
-    }
+    return input;
+}
+
+void Surface::onBufferQueuedLocked(
+        const IGraphicBufferProducer::QueueBufferOutput& output) {
     uint32_t numPendingBuffers = 0;
     uint32_t hint = 0;
     output.deflate(&mDefaultWidth, &mDefaultHeight, &hint,
@@ -424,7 +434,158 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
         // Clear surface damage back to full-buffer
         mDirtyRegion = Region::INVALID_REGION;
     }
+}
+
+int Surface::dequeueBuffers(std::vector<BatchBuffer>* buffers) {
+    ATRACE_CALL();
+    ALOGV("Surface::dequeueBuffers");
+
+    if (buffers == NULL || buffers->empty() ||
+            buffers->size() > NUM_BUFFER_SLOTS) {
+        return BAD_VALUE;
+    }
+
+    uint32_t reqWidth;
+    uint32_t reqHeight;
+    bool swapIntervalZero;
+    PixelFormat reqFormat;
+    uint32_t reqUsage;
+
+    {
+        Mutex::Autolock lock(mMutex);
+
+        reqWidth = mReqWidth ? mReqWidth : mUserWidth;
+        reqHeight = mReqHeight ? mReqHeight : mUserHeight;
+
+        swapIntervalZero = mSwapIntervalZero;
+        reqFormat = mReqFormat;
+        reqUsage = mReqUsage;
+    } // Drop the lock so that we can still touch the Surface while blocking in IGBP::dequeueBuffers
+
+    std::vector<IGraphicBufferProducer::DequeueBufferOutput> outputs;
+    status_t result = mGraphicBufferProducer->dequeueBuffers(buffers->size(),
+            swapIntervalZero, reqWidth, reqHeight, reqFormat, reqUsage,
+            &outputs);
+
+    if (result < 0) {
+        ALOGV("dequeueBuffers: IGraphicBufferProducer::dequeueBuffers(%zu, %d, "
+             "%d, %d, %d, %d) failed: %d", buffers->size(), swapIntervalZero,
+             reqWidth, reqHeight, reqFormat, reqUsage, result);
+        buffers->clear();
+        return result;
+    }
+
+    Mutex::Autolock lock(mMutex);
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (outputs[i].result & IGraphicBufferProducer::RELEASE_ALL_BUFFERS) {
+            freeAllBuffers();
+            break;
+        }
+    }
+
+    size_t dequeued = 0;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const IGraphicBufferProducer::DequeueBufferOutput& output(outputs[i]);
+        sp<GraphicBuffer>& gbuf(mSlots[output.slot].buffer);
+
+        // this should never happen
+        ALOGE_IF(output.fence == NULL,
+                "Surface::dequeueBuffers: received null Fence! buf=%d",
+                output.slot);
+
+        if (output.buffer != NULL) {
+            gbuf = output.buffer;
+        } else if ((output.result &
+                IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) || gbuf == 0) {
+            result = mGraphicBufferProducer->requestBuffer(output.slot, &gbuf);
+            if (result != NO_ERROR) {
+                ALOGE("dequeueBuffers: IGraphicBufferProducer::requestBuffer "
+                        "failed: %d", result);
+                // Give back this buffer and the rest of the batch
+                for (size_t j = i; j < outputs.size(); j++) {
+                    mGraphicBufferProducer->cancelBuffer(outputs[j].slot,
+                            outputs[j].fence);
+                }
+                break;
+            }
+        }
+
+        BatchBuffer& out((*buffers)[dequeued++]);
+        if (output.fence != NULL && output.fence->isValid()) {
+            out.fenceFd = output.fence->dup();
+            if (out.fenceFd == -1) {
+                ALOGE("dequeueBuffers: error duping fence: %d", errno);
+                // dup() should never fail; see dequeueBuffer.
+            }
+        } else {
+            out.fenceFd = -1;
+        }
+        out.buffer = gbuf.get();
+    }
+
+    buffers->resize(dequeued);
+    return dequeued > 0 ? OK : result;
+}
+
+int Surface::queueBuffers(const std::vector<BatchQueuedBuffer>& buffers) {
+    ATRACE_CALL();
+    ALOGV("Surface::queueBuffers");
+    Mutex::Autolock lock(mMutex);
+
+    if (buffers.empty() || buffers.size() > NUM_BUFFER_SLOTS) {
+        for (size_t i = 0; i < buffers.size(); i++) {
+            if (buffers[i].fenceFd >= 0) {
+                close(buffers[i].fenceFd);
+            }
+        }
+        return BAD_VALUE;
+    }
+
+    status_t err = OK;
+    std::vector<IGraphicBufferProducer::QueuedBuffer> queued;
+    queued.reserve(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        const BatchQueuedBuffer& buffer(buffers[i]);
+        int slot = getSlotFromBufferLocked(buffer.buffer);
+        if (slot < 0) {
+            if (buffer.fenceFd >= 0) {
+                close(buffer.fenceFd);
+            }
+            if (err == OK) {
+                err = slot;
+            }
+            continue;
+        }
+        queued.push_back(IGraphicBufferProducer::QueuedBuffer(slot,
+                getQueueBufferInputLocked(buffer.buffer, buffer.fenceFd,
+                        buffer.timestamp)));
+    }
+    if (queued.empty()) {
+        return err;
+    }
+
+    IGraphicBufferProducer::QueueBufferOutput output;
+    std::vector<status_t> results;
+    status_t res = mGraphicBufferProducer->queueBuffers(queued, &results,
+            &output);
+    if (res != OK) {
+        ALOGE("queueBuffers: error queuing buffers to SurfaceTexture, %d", res);
+        if (err == OK) {
+            err = res;
+        }
+    }
 
+    bool anyQueued = false;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i] == OK) {
+            anyQueued = true;
+            break;
+        }
+    }
+    if (anyQueued) {
+        onBufferQueuedLocked(output);
+    }
     return err;
 }
 
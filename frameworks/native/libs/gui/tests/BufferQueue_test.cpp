@@ -25,15 +25,21 @@
 
 #include <ui/GraphicBuffer.h>
 
+#include <binder/Binder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 #include <binder/ProcessState.h>
 
+#include <cutils/atomic.h>
+
 #include <utils/String8.h>
 #include <utils/threads.h>
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace android {
 
 class BufferQueueTest : public ::testing::Test {
@@ -174,6 +180,58 @@ TEST_F(BufferQueueTest, AcquireBuffer_ExceedsMaxAcquireCount_Fails) {
     ASSERT_EQ(INVALID_OPERATION, mConsumer->acquireBuffer(&item, 0));
 }
 
+TEST_F(BufferQueueTest, DequeueBuffers_StopsInsteadOfBlocking) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mConsumer->consumerConnect(dc, false);
+    IGraphicBufferProducer::QueueBufferOutput qbo;
+    mProducer->connect(new DummyProducerListener, NATIVE_WINDOW_API_CPU, false,
+            &qbo);
+    mProducer->setBufferCount(4);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    IGraphicBufferProducer::QueueBufferInput qbi(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+
+    // Leave two buffers queued that the consumer does not acquire
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                mProducer->dequeueBuffer(&slot, &fence, false, 1, 1, 0,
+                    GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, qbi, &qbo));
+    }
+
+    // Only two slots are free; a third dequeue would wait for the consumer
+    std::vector<IGraphicBufferProducer::DequeueBufferOutput> dequeued;
+    ASSERT_EQ(OK, mProducer->dequeueBuffers(4, false, 1, 1, 0,
+            GRALLOC_USAGE_SW_READ_OFTEN, &dequeued));
+    ASSERT_EQ(2u, dequeued.size());
+    for (size_t i = 0; i < dequeued.size(); i++) {
+        ASSERT_GE(dequeued[i].result, OK);
+        ASSERT_TRUE(dequeued[i].buffer != NULL);
+    }
+}
+
+TEST_F(BufferQueueTest, DequeueBuffers_WithoutBufferCount_ReturnsOne) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mConsumer->consumerConnect(dc, false);
+    IGraphicBufferProducer::QueueBufferOutput qbo;
+    mProducer->connect(new DummyProducerListener, NATIVE_WINDOW_API_CPU, false,
+            &qbo);
+
+    // Only one buffer may be dequeued until a buffer count is set; the batch
+    // must stop there instead of failing the second dequeue
+    std::vector<IGraphicBufferProducer::DequeueBufferOutput> dequeued;
+    ASSERT_EQ(OK, mProducer->dequeueBuffers(3, false, 1, 1, 0,
+            GRALLOC_USAGE_SW_READ_OFTEN, &dequeued));
+    ASSERT_EQ(1u, dequeued.size());
+}
+
 TEST_F(BufferQueueTest, SetMaxAcquiredBufferCountWithIllegalValues_ReturnsError) {
     createBufferQueue();
     sp<DummyConsumer> dc(new DummyConsumer);
@@ -440,4 +498,267 @@ TEST_F(BufferQueueTest, TestGenerationNumbers) {
     ASSERT_EQ(OK, mConsumer->attachBuffer(&outSlot, buffer));
 }
 
+// LatencyStats collects the duration of each call to one BufferQueue method
+class LatencyStats {
+public:
+    void add(nsecs_t latency) { mSamples.push_back(latency); }
+
+    void report(const char* name) {
+        if (mSamples.empty()) {
+            printf("%-16s no samples\n", name);
+            return;
+        }
+        std::sort(mSamples.begin(), mSamples.end());
+        printf("%-16s n=%zu p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus\n",
+                name, mSamples.size(), percentile(50) / 1000.0,
+                percentile(90) / 1000.0, percentile(99) / 1000.0,
+                mSamples.back() / 1000.0);
+    }
+
+private:
+    // mSamples must be sorted
+    double percentile(int p) const {
+        size_t index = (mSamples.size() - 1) * p / 100;
+        return static_cast<double>(mSamples[index]);
+    }
+
+    std::vector<nsecs_t> mSamples;
+};
+
+// BenchmarkConsumer acquires and releases each queued frame on its own
+// thread, timing every acquireBuffer and releaseBuffer call
+class BenchmarkConsumer : public BnConsumerListener, public Thread {
+public:
+    BenchmarkConsumer(const sp<IGraphicBufferConsumer>& consumer, int frames) :
+            Thread(false), mConsumer(consumer), mFrames(frames),
+            mPendingFrames(0), mErrors(0) {}
+
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        mPendingFrames++;
+        mCondition.signal();
+    }
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+
+    int getErrors() const { return mErrors; }
+    LatencyStats& getAcquireStats() { return mAcquireStats; }
+    LatencyStats& getReleaseStats() { return mReleaseStats; }
+
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mFrames; ++i) {
+            {
+                Mutex::Autolock lock(mMutex);
+                while (mPendingFrames == 0) {
+                    mCondition.wait(mMutex);
+                }
+                mPendingFrames--;
+            }
+
+            BufferItem item;
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            status_t result = mConsumer->acquireBuffer(&item, 0);
+            mAcquireStats.add(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+            if (result != OK) {
+                ++mErrors;
+                continue;
+            }
+
+            start = systemTime(SYSTEM_TIME_MONOTONIC);
+            result = mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+            mReleaseStats.add(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+            if (result != OK) {
+                ++mErrors;
+            }
+        }
+        return false;
+    }
+
+    sp<IGraphicBufferConsumer> mConsumer;
+    const int mFrames;
+    int mPendingFrames;
+    int mErrors;
+    Mutex mMutex;
+    Condition mCondition;
+    LatencyStats mAcquireStats;
+    LatencyStats mReleaseStats;
+};
+
+// Runs the producer and consumer on separate threads, as a camera HAL and
+// its consumer would, and reports the latency of each BufferQueue call
+TEST_F(BufferQueueTest, DequeueQueueLatencyBenchmark) {
+    static const int FRAMES = 20000;
+    static const int BUFFER_COUNT = 5;
+
+    createBufferQueue();
+    sp<BenchmarkConsumer> bc(new BenchmarkConsumer(mConsumer, FRAMES));
+    ASSERT_EQ(OK, mConsumer->consumerConnect(bc, false));
+    ASSERT_EQ(OK, mConsumer->setMaxAcquiredBufferCount(2));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setBufferCount(BUFFER_COUNT));
+
+    IGraphicBufferProducer::QueueBufferInput input(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    LatencyStats dequeueStats;
+    LatencyStats queueStats;
+
+    ASSERT_EQ(OK, bc->run("BQBenchmarkConsumer"));
+    nsecs_t begin = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < FRAMES; ++i) {
+        int slot;
+        sp<Fence> fence;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        status_t result = mProducer->dequeueBuffer(&slot, &fence, false, 1, 1,
+                0, GRALLOC_USAGE_SW_READ_OFTEN);
+        nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        ASSERT_GE(result, OK);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            // Allocation time is not what we are measuring
+            sp<GraphicBuffer> buffer;
+            ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        } else {
+            dequeueStats.add(latency);
+        }
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+        queueStats.add(systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    }
+    ASSERT_EQ(OK, bc->join());
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - begin;
+
+    EXPECT_EQ(0, bc->getErrors());
+    printf("%d frames in %.1fms, %.0f frames/s\n", FRAMES, elapsed / 1e6,
+            FRAMES * 1e9 / elapsed);
+    dequeueStats.report("dequeueBuffer");
+    queueStats.report("queueBuffer");
+    bc->getAcquireStats().report("acquireBuffer");
+    bc->getReleaseStats().report("releaseBuffer");
+}
+
+// LoopbackBinder forwards every transaction to a local binder. A proxy built
+// on it marshals each call into Parcels and unmarshals it in the stub, as a
+// remote call would, without leaving the process.
+class LoopbackBinder : public BBinder {
+public:
+    LoopbackBinder(const sp<IBinder>& target) :
+            mTarget(target), mTransactions(0) {}
+
+    int getTransactions() const { return android_atomic_acquire_load(&mTransactions); }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags) {
+        android_atomic_inc(&mTransactions);
+        return mTarget->transact(code, data, reply, flags);
+    }
+
+private:
+    sp<IBinder> mTarget;
+    volatile int32_t mTransactions;
+};
+
+// Moves the same number of frames through a binder proxy BATCH buffers per
+// call and then one buffer per call, and reports the cost of each mode
+TEST_F(BufferQueueTest, BatchedDequeueQueueBenchmark) {
+    static const int WARMUP_FRAMES = 256;
+    static const int FRAMES = 8192;
+    static const int BATCH = 8;
+    static const int BUFFER_COUNT = 2 * BATCH + 2;
+
+    createBufferQueue();
+    sp<LoopbackBinder> loopback(new LoopbackBinder(
+            IInterface::asBinder(mProducer)));
+    sp<IGraphicBufferProducer> producer(
+            interface_cast<IGraphicBufferProducer>(loopback));
+    ASSERT_TRUE(producer != NULL);
+    ASSERT_NE(IInterface::asBinder(mProducer), IInterface::asBinder(producer));
+
+    sp<BenchmarkConsumer> bc(new BenchmarkConsumer(mConsumer,
+            WARMUP_FRAMES + 2 * FRAMES));
+    ASSERT_EQ(OK, mConsumer->consumerConnect(bc, false));
+    ASSERT_EQ(OK, mConsumer->setMaxAcquiredBufferCount(2));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, producer->connect(NULL, NATIVE_WINDOW_API_CPU, false,
+            &output));
+    ASSERT_EQ(OK, producer->setBufferCount(BUFFER_COUNT));
+
+    IGraphicBufferProducer::QueueBufferInput input(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    ASSERT_EQ(OK, bc->run("BQBatchBenchmarkConsumer"));
+
+    // Batched mode, after a warm-up that allocates every slot it uses
+    nsecs_t elapsed[2];
+    int transactions[2];
+    std::vector<IGraphicBufferProducer::DequeueBufferOutput> dequeued;
+    std::vector<IGraphicBufferProducer::QueuedBuffer> queued;
+    std::vector<status_t> results;
+    for (int i = -WARMUP_FRAMES; i < FRAMES; ) {
+        if (i == 0) {
+            elapsed[1] = systemTime(SYSTEM_TIME_MONOTONIC);
+            transactions[1] = loopback->getTransactions();
+        }
+        // A batch ends early rather than wait for the consumer; never cross
+        // the end of the warm-up
+        int count = (i < 0) ? -i : FRAMES - i;
+        if (count > BATCH) {
+            count = BATCH;
+        }
+        ASSERT_EQ(OK, producer->dequeueBuffers(count, false, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN, &dequeued));
+        ASSERT_GE(dequeued.size(), 1u);
+        ASSERT_LE(dequeued.size(), static_cast<size_t>(count));
+        i += static_cast<int>(dequeued.size());
+        queued.clear();
+        for (size_t j = 0; j < dequeued.size(); ++j) {
+            ASSERT_GE(dequeued[j].result, OK);
+            if (dequeued[j].result &
+                    IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                ASSERT_TRUE(dequeued[j].buffer != NULL);
+            }
+            queued.push_back(IGraphicBufferProducer::QueuedBuffer(
+                    dequeued[j].slot, input));
+        }
+        ASSERT_EQ(OK, producer->queueBuffers(queued, &results, &output));
+        ASSERT_EQ(dequeued.size(), results.size());
+    }
+    elapsed[1] = systemTime(SYSTEM_TIME_MONOTONIC) - elapsed[1];
+    transactions[1] = loopback->getTransactions() - transactions[1];
+
+    // Per-buffer mode
+    elapsed[0] = systemTime(SYSTEM_TIME_MONOTONIC);
+    transactions[0] = loopback->getTransactions();
+    for (int i = 0; i < FRAMES; ++i) {
+        int slot;
+        sp<Fence> fence;
+        status_t result = producer->dequeueBuffer(&slot, &fence, false, 1, 1,
+                0, GRALLOC_USAGE_SW_READ_OFTEN);
+        ASSERT_GE(result, OK);
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            ASSERT_EQ(OK, producer->requestBuffer(slot, &buffer));
+        }
+        ASSERT_EQ(OK, producer->queueBuffer(slot, input, &output));
+    }
+    elapsed[0] = systemTime(SYSTEM_TIME_MONOTONIC) - elapsed[0];
+    transactions[0] = loopback->getTransactions() - transactions[0];
+
+    ASSERT_EQ(OK, bc->join());
+    EXPECT_EQ(0, bc->getErrors());
+    EXPECT_LT(transactions[1], transactions[0]);
+
+    static const char* const modes[2] = { "per-buffer", "batched" };
+    for (int m = 0; m < 2; ++m) {
+        printf("%-10s %d frames in %.1fms, %.2fus/frame, %d transactions\n",
+                modes[m], FRAMES, elapsed[m] / 1e6,
+                elapsed[m] / 1e3 / FRAMES, transactions[m]);
+    }
+}
+
 } // namespace android
@@ -24,6 +24,8 @@
 #include <gui/StreamSplitter.h>
 #include <private/gui/ComposerService.h>
 
+#include <utils/threads.h>
+
 #include <gtest/gtest.h>
 
 namespace android {
@@ -208,6 +210,215 @@ TEST_F(StreamSplitterTest, OneInputMultipleOutputs) {
     ASSERT_EQ(1, allocator->getAllocCount());
 }
 
+TEST_F(StreamSplitterTest, OutputPolicies) {
+    const int NUM_FRAMES = 10;
+    enum { BLOCK_OUTPUT, SKIP_OUTPUT, DROP_OUTPUT, NUM_OUTPUTS };
+
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    sp<IGraphicBufferProducer> outputProducers[NUM_OUTPUTS] = {};
+    sp<IGraphicBufferConsumer> outputConsumers[NUM_OUTPUTS] = {};
+    for (int output = 0; output < NUM_OUTPUTS; ++output) {
+        BufferQueue::createBufferQueue(&outputProducers[output],
+                &outputConsumers[output]);
+        ASSERT_EQ(OK, outputConsumers[output]->consumerConnect(
+                    new DummyListener, false));
+    }
+
+    sp<StreamSplitter> splitter;
+    status_t status = StreamSplitter::createSplitter(inputConsumer, &splitter);
+    ASSERT_EQ(OK, status);
+    ASSERT_EQ(BAD_VALUE, splitter->addOutput(outputProducers[SKIP_OUTPUT],
+            StreamSplitter::OUTPUT_POLICY_SKIP, 0));
+    ASSERT_EQ(OK, splitter->addOutput(outputProducers[BLOCK_OUTPUT]));
+    ASSERT_EQ(OK, splitter->addOutput(outputProducers[SKIP_OUTPUT],
+            StreamSplitter::OUTPUT_POLICY_SKIP, 1));
+    ASSERT_EQ(OK, splitter->addOutput(outputProducers[DROP_OUTPUT],
+            StreamSplitter::OUTPUT_POLICY_DROP_OLDEST, 1));
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, inputProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbOutput));
+
+    IGraphicBufferProducer::QueueBufferInput qbInput(0, false,
+            HAL_DATASPACE_UNKNOWN,
+            Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false,
+            Fence::NO_FENCE);
+
+    // The skip output holds on to the first frame and the drop output never
+    // acquires any; neither may stall the input or the blocking output
+    BufferItem heldItem;
+    for (int frame = 0; frame < NUM_FRAMES; ++frame) {
+        int slot;
+        sp<Fence> fence;
+        status = inputProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+                GRALLOC_USAGE_SW_WRITE_OFTEN);
+        ASSERT_GE(status, OK);
+        if (status & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            ASSERT_EQ(OK, inputProducer->requestBuffer(slot, &buffer));
+        }
+        ASSERT_EQ(OK, inputProducer->queueBuffer(slot, qbInput, &qbOutput));
+
+        BufferItem item;
+        ASSERT_EQ(OK, outputConsumers[BLOCK_OUTPUT]->acquireBuffer(&item, 0));
+        ASSERT_EQ(OK, outputConsumers[BLOCK_OUTPUT]->releaseBuffer(item.mBuf,
+                    item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                    Fence::NO_FENCE));
+
+        if (frame == 0) {
+            ASSERT_EQ(OK, outputConsumers[SKIP_OUTPUT]->acquireBuffer(
+                    &heldItem, 0));
+        }
+    }
+
+    StreamSplitter::OutputStats stats;
+    ASSERT_EQ(OK, splitter->getOutputStats(BLOCK_OUTPUT, &stats));
+    ASSERT_EQ(StreamSplitter::OUTPUT_POLICY_BLOCK, stats.policy);
+    ASSERT_EQ(static_cast<uint64_t>(NUM_FRAMES), stats.queued);
+    ASSERT_EQ(0u, stats.skipped);
+    ASSERT_EQ(0u, stats.dropped);
+    ASSERT_EQ(0u, stats.outstanding);
+
+    ASSERT_EQ(OK, splitter->getOutputStats(SKIP_OUTPUT, &stats));
+    ASSERT_EQ(1u, stats.queued);
+    ASSERT_EQ(static_cast<uint64_t>(NUM_FRAMES - 1), stats.skipped);
+    ASSERT_EQ(1u, stats.outstanding);
+
+    ASSERT_EQ(OK, splitter->getOutputStats(DROP_OUTPUT, &stats));
+    ASSERT_EQ(static_cast<uint64_t>(NUM_FRAMES), stats.queued);
+    ASSERT_EQ(static_cast<uint64_t>(NUM_FRAMES - 1), stats.dropped);
+    ASSERT_EQ(0u, stats.skipped);
+    ASSERT_EQ(1u, stats.outstanding);
+
+    ASSERT_EQ(BAD_VALUE, splitter->getOutputStats(NUM_OUTPUTS, &stats));
+
+    String8 dump;
+    splitter->dump(dump, "");
+    ASSERT_FALSE(dump.isEmpty());
+
+    ASSERT_EQ(OK, outputConsumers[SKIP_OUTPUT]->releaseBuffer(heldItem.mBuf,
+                heldItem.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    ASSERT_EQ(OK, splitter->getOutputStats(SKIP_OUTPUT, &stats));
+    ASSERT_EQ(0u, stats.outstanding);
+}
+
+// ReleasingConsumer acquires and releases each frame of an output on its own
+// thread, so that the release callbacks of all outputs race with each other
+// and with the splitter queueing the next input frame
+class ReleasingConsumer : public BnConsumerListener, public Thread {
+public:
+    ReleasingConsumer(const sp<IGraphicBufferConsumer>& consumer, int frames) :
+            Thread(false), mConsumer(consumer), mFrames(frames),
+            mPendingFrames(0), mErrors(0) {}
+
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        mPendingFrames++;
+        mCondition.signal();
+    }
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+
+    int getErrors() const { return mErrors; }
+
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mFrames; ++i) {
+            {
+                Mutex::Autolock lock(mMutex);
+                while (mPendingFrames == 0) {
+                    mCondition.wait(mMutex);
+                }
+                mPendingFrames--;
+            }
+
+            BufferItem item;
+            if (mConsumer->acquireBuffer(&item, 0) != OK) {
+                ++mErrors;
+                continue;
+            }
+            if (mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE) != OK) {
+                ++mErrors;
+            }
+        }
+        return false;
+    }
+
+    sp<IGraphicBufferConsumer> mConsumer;
+    const int mFrames;
+    int mPendingFrames;
+    int mErrors;
+    Mutex mMutex;
+    Condition mCondition;
+};
+
+TEST_F(StreamSplitterTest, ConcurrentOutputReleases) {
+    const int NUM_OUTPUTS = 4;
+    const int NUM_FRAMES = 2000;
+
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    sp<IGraphicBufferProducer> outputProducers[NUM_OUTPUTS] = {};
+    sp<IGraphicBufferConsumer> outputConsumers[NUM_OUTPUTS] = {};
+    sp<ReleasingConsumer> consumers[NUM_OUTPUTS] = {};
+    for (int output = 0; output < NUM_OUTPUTS; ++output) {
+        BufferQueue::createBufferQueue(&outputProducers[output],
+                &outputConsumers[output]);
+        consumers[output] = new ReleasingConsumer(outputConsumers[output],
+                NUM_FRAMES);
+        ASSERT_EQ(OK, outputConsumers[output]->consumerConnect(
+                    consumers[output], false));
+    }
+
+    sp<StreamSplitter> splitter;
+    status_t status = StreamSplitter::createSplitter(inputConsumer, &splitter);
+    ASSERT_EQ(OK, status);
+    for (int output = 0; output < NUM_OUTPUTS; ++output) {
+        ASSERT_EQ(OK, splitter->addOutput(outputProducers[output]));
+    }
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, inputProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbOutput));
+
+    IGraphicBufferProducer::QueueBufferInput qbInput(0, false,
+            HAL_DATASPACE_UNKNOWN,
+            Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false,
+            Fence::NO_FENCE);
+
+    for (int output = 0; output < NUM_OUTPUTS; ++output) {
+        ASSERT_EQ(OK, consumers[output]->run("SplitterTestConsumer"));
+    }
+    for (int frame = 0; frame < NUM_FRAMES; ++frame) {
+        int slot;
+        sp<Fence> fence;
+        status = inputProducer->dequeueBuffer(&slot, &fence, false, 0, 0, 0,
+                GRALLOC_USAGE_SW_WRITE_OFTEN);
+        ASSERT_GE(status, OK);
+        if (status & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            sp<GraphicBuffer> buffer;
+            ASSERT_EQ(OK, inputProducer->requestBuffer(slot, &buffer));
+        }
+        ASSERT_EQ(OK, inputProducer->queueBuffer(slot, qbInput, &qbOutput));
+    }
+    for (int output = 0; output < NUM_OUTPUTS; ++output) {
+        ASSERT_EQ(OK, consumers[output]->join());
+        EXPECT_EQ(0, consumers[output]->getErrors());
+
+        StreamSplitter::OutputStats stats;
+        ASSERT_EQ(OK, splitter->getOutputStats(output, &stats));
+        EXPECT_EQ(static_cast<uint64_t>(NUM_FRAMES), stats.queued);
+        EXPECT_EQ(0u, stats.outstanding);
+    }
+}
+
 TEST_F(StreamSplitterTest, OutputAbandonment) {
     sp<IGraphicBufferProducer> inputProducer;
     sp<IGraphicBufferConsumer> inputConsumer;
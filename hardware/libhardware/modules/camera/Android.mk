@@ -22,18 +22,22 @@ LOCAL_MODULE_RELATIVE_PATH := hw
 LOCAL_C_INCLUDES += \
 	system/core/include \
 	system/media/camera/include \
+	system/core/libsync \
 
 LOCAL_SRC_FILES := \
 	CameraHAL.cpp \
 	Camera.cpp \
 	ExampleCamera.cpp \
+	FrameSource.cpp \
 	Metadata.cpp \
+	Pipeline.cpp \
 	Stream.cpp \
 	VendorTags.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
 	libcamera_metadata \
 	libcutils \
+	libhardware \
 	liblog \
 	libsync \
 	libutils \
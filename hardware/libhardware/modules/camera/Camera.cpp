@@ -16,8 +16,8 @@
 
 #include <cstdlib>
 #include <stdio.h>
+#include <cutils/properties.h>
 #include <hardware/camera3.h>
-#include <sync/sync.h>
 #include <system/camera_metadata.h>
 #include <system/graphics.h>
 #include <utils/Mutex.h>
@@ -34,7 +34,8 @@
 
 #include "Camera.h"
 
-#define CAMERA_SYNC_TIMEOUT 5000 // in msecs
+// Default number of pipeline workers filling buffers
+#define CAMERA_DEFAULT_WORKERS 2
 
 namespace default_camera_hal {
 
@@ -55,7 +56,8 @@ Camera::Camera(int id)
     mCallbackOps(NULL),
     mStreams(NULL),
     mNumStreams(0),
-    mSettings(NULL)
+    mSettings(NULL),
+    mPipeline(id)
 {
     memset(&mTemplates, 0, sizeof(mTemplates));
     memset(&mDevice, 0, sizeof(mDevice));
@@ -117,6 +119,7 @@ int Camera::close()
     }
 
     // TODO: close camera dev nodes, etc
+    mPipeline.stop();
     mBusy = false;
     return 0;
 }
@@ -133,9 +136,35 @@ int Camera::initialize(const camera3_callback_ops_t *callback_ops)
         ALOGE("%s:%d: Failed to initialize device!", __func__, mId);
         return res;
     }
+
+    int workers = property_get_int32("camera.default.workers",
+            CAMERA_DEFAULT_WORKERS);
+    res = mPipeline.start(callback_ops, createFrameSource(), getBlobSize(),
+            workers);
+    if (res != 0) {
+        ALOGE("%s:%d: Failed to start capture pipeline!", __func__, mId);
+        return res;
+    }
     return 0;
 }
 
+size_t Camera::getBlobSize()
+{
+    android::Mutex::Autolock al(mStaticInfoLock);
+    camera_metadata_ro_entry_t entry;
+
+    if (mStaticInfo == NULL) {
+        mStaticInfo = initStaticInfo();
+    }
+    if (find_camera_metadata_ro_entry(mStaticInfo, ANDROID_JPEG_MAX_SIZE,
+            &entry) != 0 || entry.count != 1) {
+        ALOGE("%s:%d: No android.jpeg.maxSize, BLOB output disabled",
+                __func__, mId);
+        return 0;
+    }
+    return entry.data.i32[0];
+}
+
 int Camera::configureStreams(camera3_stream_configuration_t *stream_config)
 {
     camera3_stream_t *astream;
@@ -145,6 +174,9 @@ int Camera::configureStreams(camera3_stream_configuration_t *stream_config)
     ATRACE_CALL();
     android::Mutex::Autolock al(mDeviceLock);
 
+    // Streams may be destroyed below, let in-flight requests finish
+    mPipeline.waitIdle();
+
     if (stream_config == NULL) {
         ALOGE("%s:%d: NULL stream configuration array", __func__, mId);
         return -EINVAL;
@@ -275,6 +307,8 @@ void Camera::setupStreams(Stream **streams, int count)
      *
      * In this demo HAL, we just set all streams to be the same dummy values;
      * real implementations will want to avoid USAGE_SW_{READ|WRITE}_OFTEN.
+     * The software pipeline keeps up to Pipeline::kMaxInflight requests in
+     * flight, each holding one buffer of every stream it outputs to.
      */
     for (int i = 0; i < count; i++) {
         uint32_t usage = 0;
@@ -287,7 +321,7 @@ void Camera::setupStreams(Stream **streams, int count)
                      GRALLOC_USAGE_HW_CAMERA_READ;
 
         streams[i]->setUsage(usage);
-        streams[i]->setMaxBuffers(1);
+        streams[i]->setMaxBuffers(Pipeline::kMaxInflight);
     }
 }
 
@@ -324,10 +358,9 @@ const camera_metadata_t* Camera::constructDefaultRequestSettings(int type)
 
 int Camera::processCaptureRequest(camera3_capture_request_t *request)
 {
-    camera3_capture_result result;
-
     ALOGV("%s:%d: request=%p", __func__, mId, request);
     ATRACE_CALL();
+    android::Mutex::Autolock al(mDeviceLock);
 
     if (request == NULL) {
         ALOGE("%s:%d: NULL request recieved", __func__, mId);
@@ -372,28 +405,10 @@ int Camera::processCaptureRequest(camera3_capture_request_t *request)
                 request->num_output_buffers);
         return -EINVAL;
     }
-    result.num_output_buffers = request->num_output_buffers;
-    result.output_buffers = new camera3_stream_buffer_t[result.num_output_buffers];
-    for (unsigned int i = 0; i < request->num_output_buffers; i++) {
-        int res = processCaptureBuffer(&request->output_buffers[i],
-                const_cast<camera3_stream_buffer_t*>(&result.output_buffers[i]));
-        if (res)
-            goto err_out;
-    }
 
-    result.frame_number = request->frame_number;
+    // The pipeline waits on the acquire fences and returns the result
     // TODO: return actual captured/reprocessed settings
-    result.result = request->settings;
-    // TODO: asynchronously return results
-    notifyShutter(request->frame_number, 0);
-    mCallbackOps->process_capture_result(mCallbackOps, &result);
-
-    return 0;
-
-err_out:
-    delete [] result.output_buffers;
-    // TODO: this should probably be a total device failure; transient for now
-    return -EINVAL;
+    return mPipeline.queueRequest(request, mSettings);
 }
 
 void Camera::setSettings(const camera_metadata_t *new_settings)
@@ -415,58 +430,6 @@ bool Camera::isValidReprocessSettings(const camera_metadata_t* /*settings*/)
     return false;
 }
 
-int Camera::processCaptureBuffer(const camera3_stream_buffer_t *in,
-        camera3_stream_buffer_t *out)
-{
-    if (in->acquire_fence != -1) {
-        int res = sync_wait(in->acquire_fence, CAMERA_SYNC_TIMEOUT);
-        if (res == -ETIME) {
-            ALOGE("%s:%d: Timeout waiting on buffer acquire fence",
-                    __func__, mId);
-            return res;
-        } else if (res) {
-            ALOGE("%s:%d: Error waiting on buffer acquire fence: %s(%d)",
-                    __func__, mId, strerror(-res), res);
-            return res;
-        }
-    }
-
-    out->stream = in->stream;
-    out->buffer = in->buffer;
-    out->status = CAMERA3_BUFFER_STATUS_OK;
-    // TODO: use driver-backed release fences
-    out->acquire_fence = -1;
-    out->release_fence = -1;
-
-    // TODO: lock and software-paint buffer
-    return 0;
-}
-
-void Camera::notifyShutter(uint32_t frame_number, uint64_t timestamp)
-{
-    int res;
-    struct timespec ts;
-
-    // If timestamp is 0, get timestamp from right now instead
-    if (timestamp == 0) {
-        ALOGW("%s:%d: No timestamp provided, using CLOCK_BOOTTIME",
-                __func__, mId);
-        res = clock_gettime(CLOCK_BOOTTIME, &ts);
-        if (res == 0) {
-            timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
-        } else {
-            ALOGE("%s:%d: No timestamp and failed to get CLOCK_BOOTTIME %s(%d)",
-                    __func__, mId, strerror(errno), errno);
-        }
-    }
-    camera3_notify_msg_t m;
-    memset(&m, 0, sizeof(m));
-    m.type = CAMERA3_MSG_SHUTTER;
-    m.message.shutter.frame_number = frame_number;
-    m.message.shutter.timestamp = timestamp;
-    mCallbackOps->notify(mCallbackOps, &m);
-}
-
 void Camera::dump(int fd)
 {
     ALOGV("%s:%d: Dumping to fd %d", __func__, mId, fd);
@@ -483,6 +446,14 @@ void Camera::dump(int fd)
         dprintf(fd, "Stream %d/%d:\n", i, mNumStreams);
         mStreams[i]->dump(fd);
     }
+    mPipeline.dump(fd);
+}
+
+int Camera::flush()
+{
+    ALOGV("%s:%d: Flushing", __func__, mId);
+    ATRACE_CALL();
+    return mPipeline.flush();
 }
 
 const char* Camera::templateToString(int type)
@@ -570,10 +541,9 @@ static void dump(const camera3_device_t *dev, int fd)
     camdev_to_camera(dev)->dump(fd);
 }
 
-static int flush(const camera3_device_t*)
+static int flush(const camera3_device_t *dev)
 {
-    ALOGE("%s: unimplemented.", __func__);
-    return -1;
+    return camdev_to_camera(dev)->flush();
 }
 
 } // extern "C"
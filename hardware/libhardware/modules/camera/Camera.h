@@ -20,7 +20,9 @@
 #include <hardware/hardware.h>
 #include <hardware/camera3.h>
 #include <utils/Mutex.h>
+#include "FrameSource.h"
 #include "Metadata.h"
+#include "Pipeline.h"
 #include "Stream.h"
 
 namespace default_camera_hal {
@@ -49,6 +51,7 @@ class Camera {
         const camera_metadata_t *constructDefaultRequestSettings(int type);
         int processCaptureRequest(camera3_capture_request_t *request);
         void dump(int fd);
+        int flush();
 
 
     protected:
@@ -58,6 +61,8 @@ class Camera {
         virtual bool isValidCaptureSettings(const camera_metadata_t *) = 0;
         // Separate initialization method for individual devices when opened
         virtual int initDevice() = 0;
+        // Create the source of captured image data when opened
+        virtual FrameSource *createFrameSource() = 0;
         // Accessor used by initDevice() to set the templates' metadata
         int setTemplate(int type, camera_metadata_t *static_info);
         // Prettyprint template names
@@ -78,11 +83,8 @@ class Camera {
         void setSettings(const camera_metadata_t *new_settings);
         // Verify settings are valid for reprocessing an input buffer
         bool isValidReprocessSettings(const camera_metadata_t *settings);
-        // Process an output buffer
-        int processCaptureBuffer(const camera3_stream_buffer_t *in,
-                camera3_stream_buffer_t *out);
-        // Send a shutter notify message with start of exposure time
-        void notifyShutter(uint32_t frame_number, uint64_t timestamp);
+        // Size of BLOB stream buffers, from android.jpeg.maxSize
+        size_t getBlobSize();
         // Is type a valid template type (and valid index into mTemplates)
         bool isValidTemplateType(int type);
 
@@ -111,6 +113,8 @@ class Camera {
         camera_metadata_t *mTemplates[CAMERA3_TEMPLATE_COUNT];
         // Most recent request settings seen, memoized to be reused
         camera_metadata_t *mSettings;
+        // Runs capture requests while the device is open
+        Pipeline mPipeline;
 };
 } // namespace default_camera_hal
 
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <cutils/properties.h>
 #include <system/camera_metadata.h>
 #include "Camera.h"
 
@@ -28,6 +30,10 @@
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
+// Pixel array size, also the size of generated frames
+#define SENSOR_WIDTH 640
+#define SENSOR_HEIGHT 480
+
 namespace default_camera_hal {
 
 ExampleCamera::ExampleCamera(int id) : Camera(id)
@@ -141,7 +147,8 @@ camera_metadata_t *ExampleCamera::initStaticInfo()
 
     /* android.sensor */
 
-    int32_t android_sensor_info_active_array_size[] = {0, 0, 640, 480};
+    int32_t android_sensor_info_active_array_size[] =
+            {0, 0, SENSOR_WIDTH, SENSOR_HEIGHT};
     m.addInt32(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE,
             ARRAY_SIZE(android_sensor_info_active_array_size),
             android_sensor_info_active_array_size);
@@ -162,7 +169,8 @@ camera_metadata_t *ExampleCamera::initStaticInfo()
             ARRAY_SIZE(android_sensor_info_physical_size),
             android_sensor_info_physical_size);
 
-    int32_t android_sensor_info_pixel_array_size[] = {640, 480};
+    int32_t android_sensor_info_pixel_array_size[] =
+            {SENSOR_WIDTH, SENSOR_HEIGHT};
     m.addInt32(ANDROID_SENSOR_INFO_PIXEL_ARRAY_SIZE,
             ARRAY_SIZE(android_sensor_info_pixel_array_size),
             android_sensor_info_pixel_array_size);
@@ -270,4 +278,28 @@ bool ExampleCamera::isValidCaptureSettings(const camera_metadata_t* settings)
     return true;
 }
 
+FrameSource *ExampleCamera::createFrameSource()
+{
+    char path[PROPERTY_VALUE_MAX];
+    char size[PROPERTY_VALUE_MAX];
+    uint32_t width, height;
+
+    if (property_get("camera.default.source", path, NULL) > 0) {
+        // Raw I420 frames, camera.default.source.size as WxH
+        property_get("camera.default.source.size", size, "640x480");
+        if (sscanf(size, "%ux%u", &width, &height) != 2 || width == 0 ||
+                height == 0) {
+            ALOGE("%s: Invalid frame size %s", __func__, size);
+            width = SENSOR_WIDTH;
+            height = SENSOR_HEIGHT;
+        }
+        FileSource *source = new FileSource(width, height);
+        if (source->open(path) == 0)
+            return source;
+        ALOGE("%s: Falling back to test pattern", __func__);
+        delete source;
+    }
+    return new PatternSource(SENSOR_WIDTH, SENSOR_HEIGHT);
+}
+
 } // namespace default_camera_hal
@@ -43,6 +43,8 @@ class ExampleCamera : public Camera {
         int setZslTemplate(Metadata m);
         // Verify settings are valid for a capture with this device
         bool isValidCaptureSettings(const camera_metadata_t* settings);
+        // Pattern, or raw frames from the file named by camera.default.source
+        FrameSource *createFrameSource();
 };
 } // namespace default_camera_hal
 
@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <hardware/camera3.h>
+#include <hardware/gralloc.h>
+#include <system/graphics.h>
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FrameSource"
+#include <cutils/log.h>
+
+#define ATRACE_TAG (ATRACE_TAG_CAMERA | ATRACE_TAG_HAL)
+#include <utils/Trace.h>
+
+#include "FrameSource.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+namespace default_camera_hal {
+
+// Flat grey 16x16 baseline JPEG written to BLOB buffers; this HAL does not
+// encode the captured frame
+static const uint8_t kPlaceholderJpeg[] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01,
+    0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43,
+    0x00, 0x10, 0x0b, 0x0c, 0x0e, 0x0c, 0x0a, 0x10, 0x0e, 0x0d, 0x0e, 0x12,
+    0x11, 0x10, 0x13, 0x18, 0x28, 0x1a, 0x18, 0x16, 0x16, 0x18, 0x31, 0x23,
+    0x25, 0x1d, 0x28, 0x3a, 0x33, 0x3d, 0x3c, 0x39, 0x33, 0x38, 0x37, 0x40,
+    0x48, 0x5c, 0x4e, 0x40, 0x44, 0x57, 0x45, 0x37, 0x38, 0x50, 0x6d, 0x51,
+    0x57, 0x5f, 0x62, 0x67, 0x68, 0x67, 0x3e, 0x4d, 0x71, 0x79, 0x70, 0x64,
+    0x78, 0x5c, 0x65, 0x67, 0x63, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x10,
+    0x00, 0x10, 0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x14, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xff, 0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xff, 0xda, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00,
+    0x00, 0xff, 0xd9,
+};
+
+static inline uint8_t clamp8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+FrameSource::FrameSource(uint32_t width, uint32_t height)
+  : mWidth(width),
+    mHeight(height)
+{
+}
+
+FrameSource::~FrameSource()
+{
+}
+
+size_t FrameSource::getFrameSize() const
+{
+    size_t chroma = ((mWidth + 1) / 2) * ((mHeight + 1) / 2);
+    return mWidth * mHeight + 2 * chroma;
+}
+
+int FrameSource::writeFrame(const gralloc_module_t *gralloc,
+        buffer_handle_t buffer, int format, uint32_t width, uint32_t height,
+        uint32_t stride, uint32_t usage, size_t blob_size, const uint8_t *frame)
+{
+    ATRACE_CALL();
+    void *vaddr = NULL;
+    int res;
+
+    switch (format) {
+    case HAL_PIXEL_FORMAT_YCbCr_420_888:
+    case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED:
+        if (gralloc->common.module_api_version >= GRALLOC_MODULE_API_VERSION_0_2
+                && gralloc->lock_ycbcr != NULL) {
+            android_ycbcr ycbcr;
+            memset(&ycbcr, 0, sizeof(ycbcr));
+            res = gralloc->lock_ycbcr(gralloc, buffer, usage, 0, 0, width,
+                    height, &ycbcr);
+            if (res == 0) {
+                writeYCbCr(ycbcr, width, height, frame);
+                return gralloc->unlock(gralloc, buffer);
+            }
+        }
+        if (format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
+            ALOGE("%s: Failed to lock flexible YCbCr buffer %p", __func__,
+                    buffer);
+            return -EINVAL;
+        }
+        // Implementation defined buffers gralloc will not map as YCbCr are
+        // treated as RGBA
+        // fall through
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+        res = gralloc->lock(gralloc, buffer, usage, 0, 0, width, height, &vaddr);
+        if (res)
+            break;
+        writeRGBA(static_cast<uint8_t*>(vaddr), width, height, stride, frame);
+        return gralloc->unlock(gralloc, buffer);
+    case HAL_PIXEL_FORMAT_RAW16:
+        res = gralloc->lock(gralloc, buffer, usage, 0, 0, width, height, &vaddr);
+        if (res)
+            break;
+        writeRaw16(static_cast<uint16_t*>(vaddr), width, height, stride,
+                frame);
+        return gralloc->unlock(gralloc, buffer);
+    case HAL_PIXEL_FORMAT_BLOB:
+        // BLOB buffers are allocated blob_size wide and 1 high
+        res = gralloc->lock(gralloc, buffer, usage, 0, 0, blob_size, 1, &vaddr);
+        if (res)
+            break;
+        writeBlob(static_cast<uint8_t*>(vaddr), blob_size);
+        return gralloc->unlock(gralloc, buffer);
+    default:
+        ALOGE("%s: Unsupported output format %#x", __func__, format);
+        return -EINVAL;
+    }
+
+    ALOGE("%s: Failed to lock buffer %p format %#x: %s(%d)", __func__, buffer,
+            format, strerror(-res), res);
+    return res;
+}
+
+// The writers below scale with nearest neighbour sampling. Rows start
+// stride pixels apart, or at the strides lock_ycbcr() reported.
+void FrameSource::writeYCbCr(const android_ycbcr &ycbcr, uint32_t width,
+        uint32_t height, const uint8_t *frame)
+{
+    const uint32_t cw = (mWidth + 1) / 2;
+    const uint32_t ch = (mHeight + 1) / 2;
+    const uint8_t *srcY = frame;
+    const uint8_t *srcU = frame + mWidth * mHeight;
+    const uint8_t *srcV = srcU + cw * ch;
+
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *src = srcY + (y * mHeight / height) * mWidth;
+        uint8_t *dst = static_cast<uint8_t*>(ycbcr.y) + y * ycbcr.ystride;
+        if (width == mWidth) {
+            memcpy(dst, src, width);
+            continue;
+        }
+        for (uint32_t x = 0; x < width; x++)
+            dst[x] = src[x * mWidth / width];
+    }
+
+    const uint32_t dcw = (width + 1) / 2;
+    const uint32_t dch = (height + 1) / 2;
+    for (uint32_t y = 0; y < dch; y++) {
+        uint32_t row = (y * ch / dch) * cw;
+        uint8_t *cb = static_cast<uint8_t*>(ycbcr.cb) + y * ycbcr.cstride;
+        uint8_t *cr = static_cast<uint8_t*>(ycbcr.cr) + y * ycbcr.cstride;
+        for (uint32_t x = 0; x < dcw; x++) {
+            uint32_t sx = row + x * cw / dcw;
+            cb[x * ycbcr.chroma_step] = srcU[sx];
+            cr[x * ycbcr.chroma_step] = srcV[sx];
+        }
+    }
+}
+
+void FrameSource::writeRGBA(uint8_t *dst, uint32_t width, uint32_t height,
+        uint32_t stride, const uint8_t *frame)
+{
+    const uint32_t cw = (mWidth + 1) / 2;
+    const uint8_t *srcY = frame;
+    const uint8_t *srcU = frame + mWidth * mHeight;
+    const uint8_t *srcV = srcU + cw * ((mHeight + 1) / 2);
+
+    for (uint32_t y = 0; y < height; y++) {
+        uint32_t sy = y * mHeight / height;
+        uint8_t *px = dst + y * stride * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t sx = x * mWidth / width;
+            // BT.601 limited range to full range RGB, 8-bit fixed point
+            int c = 298 * (srcY[sy * mWidth + sx] - 16);
+            int d = srcU[(sy / 2) * cw + sx / 2] - 128;
+            int e = srcV[(sy / 2) * cw + sx / 2] - 128;
+            px[0] = clamp8((c + 409 * e + 128) >> 8);
+            px[1] = clamp8((c - 100 * d - 208 * e + 128) >> 8);
+            px[2] = clamp8((c + 516 * d + 128) >> 8);
+            px[3] = 0xff;
+            px += 4;
+        }
+    }
+}
+
+void FrameSource::writeRaw16(uint16_t *dst, uint32_t width, uint32_t height,
+        uint32_t stride, const uint8_t *frame)
+{
+    // Luma only, as 10-bit samples
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *src = frame + (y * mHeight / height) * mWidth;
+        uint16_t *row = dst + y * stride;
+        for (uint32_t x = 0; x < width; x++)
+            row[x] = src[x * mWidth / width] << 2;
+    }
+}
+
+void FrameSource::writeBlob(uint8_t *dst, size_t blob_size)
+{
+    if (blob_size < sizeof(kPlaceholderJpeg) + sizeof(camera3_jpeg_blob)) {
+        ALOGE("%s: BLOB buffer of %zu bytes too small", __func__, blob_size);
+        return;
+    }
+    memcpy(dst, kPlaceholderJpeg, sizeof(kPlaceholderJpeg));
+
+    camera3_jpeg_blob blob;
+    blob.jpeg_blob_id = CAMERA3_JPEG_BLOB_ID;
+    blob.jpeg_size = sizeof(kPlaceholderJpeg);
+    memcpy(dst + blob_size - sizeof(blob), &blob, sizeof(blob));
+}
+
+PatternSource::PatternSource(uint32_t width, uint32_t height)
+  : FrameSource(width, height)
+{
+}
+
+PatternSource::~PatternSource()
+{
+}
+
+int PatternSource::getFrame(uint32_t frame_number, uint8_t *dst)
+{
+    ATRACE_CALL();
+    // 75% color bars: white, yellow, cyan, green, magenta, red, blue, black
+    static const uint8_t kBars[][3] = {
+        {180, 128, 128}, {162, 44, 142}, {131, 156, 44}, {112, 72, 58},
+        {84, 184, 198}, {65, 100, 212}, {35, 212, 114}, {16, 128, 128},
+    };
+    const uint32_t numBars = ARRAY_SIZE(kBars);
+    const uint32_t cw = (mWidth + 1) / 2;
+    const uint32_t ch = (mHeight + 1) / 2;
+    uint8_t *y = dst;
+    uint8_t *u = dst + mWidth * mHeight;
+    uint8_t *v = u + cw * ch;
+
+    // Bars scroll left by 4 pixels a frame. Every row is the same, so
+    // render one and copy it.
+    uint32_t shift = (frame_number * 4) % mWidth;
+    for (uint32_t x = 0; x < mWidth; x++)
+        y[x] = kBars[((x + shift) % mWidth) * numBars / mWidth][0];
+    for (uint32_t x = 0; x < cw; x++) {
+        uint32_t bar = ((2 * x + shift) % mWidth) * numBars / mWidth;
+        u[x] = kBars[bar][1];
+        v[x] = kBars[bar][2];
+    }
+    for (uint32_t row = 1; row < mHeight; row++)
+        memcpy(y + row * mWidth, y, mWidth);
+    for (uint32_t row = 1; row < ch; row++) {
+        memcpy(u + row * cw, u, cw);
+        memcpy(v + row * cw, v, cw);
+    }
+
+    // Frame number as 32 black/white blocks along the top, MSB first, so
+    // consumers can check which frame they received
+    uint32_t block = mWidth / 32;
+    uint32_t strip = mHeight / 16;
+    if (block == 0 || strip == 0)
+        return 0;
+    for (uint32_t bit = 0; bit < 32; bit++) {
+        uint8_t luma = (frame_number >> (31 - bit)) & 1 ? 235 : 16;
+        for (uint32_t row = 0; row < strip; row++)
+            memset(y + row * mWidth + bit * block, luma, block);
+        for (uint32_t row = 0; row < (strip + 1) / 2; row++) {
+            memset(u + row * cw + bit * block / 2, 128, (block + 1) / 2);
+            memset(v + row * cw + bit * block / 2, 128, (block + 1) / 2);
+        }
+    }
+    return 0;
+}
+
+FileSource::FileSource(uint32_t width, uint32_t height)
+  : FrameSource(width, height),
+    mFd(-1),
+    mNumFrames(0)
+{
+}
+
+FileSource::~FileSource()
+{
+    if (mFd >= 0)
+        close(mFd);
+}
+
+int FileSource::open(const char *path)
+{
+    struct stat st;
+
+    mFd = TEMP_FAILURE_RETRY(::open(path, O_RDONLY | O_CLOEXEC));
+    if (mFd < 0) {
+        ALOGE("%s: Failed to open %s: %s(%d)", __func__, path,
+                strerror(errno), errno);
+        return -errno;
+    }
+    if (fstat(mFd, &st) != 0) {
+        ALOGE("%s: Failed to stat %s: %s(%d)", __func__, path,
+                strerror(errno), errno);
+        return -errno;
+    }
+    mNumFrames = st.st_size / getFrameSize();
+    if (mNumFrames == 0) {
+        ALOGE("%s: %s holds no %ux%u I420 frame", __func__, path, mWidth,
+                mHeight);
+        return -EINVAL;
+    }
+    ALOGI("%s: Playing %u frames of %ux%u from %s", __func__, mNumFrames,
+            mWidth, mHeight, path);
+    return 0;
+}
+
+int FileSource::getFrame(uint32_t frame_number, uint8_t *dst)
+{
+    ATRACE_CALL();
+    size_t size = getFrameSize();
+    off64_t offset = (off64_t)(frame_number % mNumFrames) * size;
+
+    // pread keeps concurrent workers from sharing a file offset
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(pread64(mFd, dst, size, offset));
+        if (n <= 0) {
+            ALOGE("%s: Failed to read frame %u: %s(%d)", __func__,
+                    frame_number, n < 0 ? strerror(errno) : "EOF", errno);
+            return n < 0 ? -errno : -EIO;
+        }
+        dst += n;
+        offset += n;
+        size -= n;
+    }
+    return 0;
+}
+
+} // namespace default_camera_hal
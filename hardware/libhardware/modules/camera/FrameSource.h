@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAME_SOURCE_H_
+#define FRAME_SOURCE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <hardware/gralloc.h>
+#include <system/graphics.h>
+
+namespace default_camera_hal {
+// FrameSource produces the image content of captured frames. Frames are
+// 8-bit planar YUV 4:2:0 (I420) at the size returned by getWidth() and
+// getHeight(); writeFrame() scales and converts them into output buffers.
+// getFrame() is called concurrently from several pipeline workers.
+class FrameSource {
+    public:
+        FrameSource(uint32_t width, uint32_t height);
+        virtual ~FrameSource();
+
+        uint32_t getWidth() const { return mWidth; }
+        uint32_t getHeight() const { return mHeight; }
+        // Bytes needed for one I420 frame
+        size_t getFrameSize() const;
+
+        // Render frame number frame_number into dst (getFrameSize() bytes)
+        virtual int getFrame(uint32_t frame_number, uint8_t *dst) = 0;
+        virtual const char* getName() = 0;
+
+        // Write an I420 frame of this source into a locked output buffer.
+        // stride is the row pitch in pixels of RGBA and RAW16 buffers, which
+        // (*lock)() does not report. blob_size is the gralloc width of
+        // HAL_PIXEL_FORMAT_BLOB buffers.
+        int writeFrame(const gralloc_module_t *gralloc, buffer_handle_t buffer,
+                int format, uint32_t width, uint32_t height, uint32_t stride,
+                uint32_t usage, size_t blob_size, const uint8_t *frame);
+
+    protected:
+        const uint32_t mWidth;
+        const uint32_t mHeight;
+
+    private:
+        void writeYCbCr(const android_ycbcr &ycbcr, uint32_t width,
+                uint32_t height, const uint8_t *frame);
+        void writeRGBA(uint8_t *dst, uint32_t width, uint32_t height,
+                uint32_t stride, const uint8_t *frame);
+        void writeRaw16(uint16_t *dst, uint32_t width, uint32_t height,
+                uint32_t stride, const uint8_t *frame);
+        void writeBlob(uint8_t *dst, size_t blob_size);
+};
+
+// PatternSource renders moving color bars with a frame counter strip.
+class PatternSource : public FrameSource {
+    public:
+        PatternSource(uint32_t width, uint32_t height);
+        ~PatternSource();
+
+        int getFrame(uint32_t frame_number, uint8_t *dst);
+        const char* getName() { return "pattern"; }
+};
+
+// FileSource plays back raw I420 frames from a file, looping at the end.
+class FileSource : public FrameSource {
+    public:
+        FileSource(uint32_t width, uint32_t height);
+        ~FileSource();
+
+        // Open the file; fails if it does not hold at least one frame
+        int open(const char *path);
+
+        int getFrame(uint32_t frame_number, uint8_t *dst);
+        const char* getName() { return "file"; }
+
+    private:
+        int mFd;
+        // Number of whole frames in the file
+        uint32_t mNumFrames;
+};
+} // namespace default_camera_hal
+
+#endif // FRAME_SOURCE_H_
@@ -0,0 +1,673 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <hardware/camera3.h>
+#include <hardware/gralloc.h>
+#include <sw_sync.h>
+#include <sync/sync.h>
+#include <system/camera_metadata.h>
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "Pipeline"
+#include <cutils/log.h>
+
+#define ATRACE_TAG (ATRACE_TAG_CAMERA | ATRACE_TAG_HAL)
+#include <utils/Trace.h>
+
+#include "Pipeline.h"
+
+#define CAMERA_SYNC_TIMEOUT 5000 // in msecs
+
+namespace default_camera_hal {
+
+// Shutter timestamps use the same clock as the sensor would
+static nsecs_t bootTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+Pipeline::Pipeline(int id)
+  : mId(id),
+    mCallbackOps(NULL),
+    mSource(NULL),
+    mGralloc(NULL),
+    mAllocDev(NULL),
+    mBlobSize(0),
+    mTimeline(-1),
+    mFenceValue(0),
+    mWakeFd(-1),
+    mLastShutter(0),
+    mQueued(0),
+    mFlushing(false),
+    mExit(false),
+    mStarted(false),
+    mNumCompleted(0),
+    mNumCancelled(0),
+    mFenceErrors(0),
+    mFillErrors(0),
+    mMaxFenceWait(0),
+    mMaxLatency(0)
+{
+}
+
+Pipeline::~Pipeline()
+{
+    stop();
+}
+
+int Pipeline::start(const camera3_callback_ops_t *callback_ops,
+        FrameSource *source, size_t blob_size, int num_workers)
+{
+    const hw_module_t *module = NULL;
+    int res;
+
+    ALOGI("%s:%d: Starting with %s source and %d workers", __func__, mId,
+            source->getName(), num_workers);
+
+    mCallbackOps = callback_ops;
+    mSource = source;
+    mBlobSize = blob_size;
+    mExit = false;
+    mFlushing = false;
+
+    res = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module);
+    if (res) {
+        // Buffers are returned unpainted
+        ALOGE("%s:%d: Failed to load gralloc module: %s(%d)", __func__, mId,
+                strerror(-res), res);
+    } else {
+        mGralloc = reinterpret_cast<const gralloc_module_t*>(module);
+        res = gralloc_open(module, &mAllocDev);
+        if (res) {
+            ALOGW("%s:%d: Failed to open gralloc device, assuming packed "
+                    "rows: %s(%d)", __func__, mId, strerror(-res), res);
+            mAllocDev = NULL;
+        }
+    }
+
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mWakeFd < 0) {
+        res = -errno;
+        ALOGE("%s:%d: Failed to create eventfd: %s(%d)", __func__, mId,
+                strerror(-res), -res);
+        // stop() only cleans up after a successful start
+        if (mAllocDev != NULL) {
+            gralloc_close(mAllocDev);
+            mAllocDev = NULL;
+        }
+        delete mSource;
+        mSource = NULL;
+        return res;
+    }
+
+    mTimeline = sw_sync_timeline_create();
+    mFenceValue = 0;
+    if (mTimeline < 0) {
+        ALOGW("%s:%d: No sw_sync timeline (%s), filling buffers before "
+                "returning them", __func__, mId, strerror(errno));
+    }
+
+    // Workers are only needed when results go out ahead of the fill
+    for (int i = 0; mTimeline >= 0 && i < num_workers; i++) {
+        pthread_t worker;
+        res = pthread_create(&worker, NULL, workerThread, this);
+        if (res) {
+            ALOGE("%s:%d: Failed to start worker %d: %s(%d)", __func__, mId,
+                    i, strerror(res), res);
+            break;
+        }
+        mWorkers.push_back(worker);
+    }
+    if (mTimeline >= 0 && mWorkers.isEmpty()) {
+        // Nobody would fill or retire dispatched requests
+        close(mTimeline);
+        mTimeline = -1;
+    }
+
+    res = pthread_create(&mFenceThread, NULL, fenceThread, this);
+    if (res) {
+        ALOGE("%s:%d: Failed to start fence thread: %s(%d)", __func__, mId,
+                strerror(res), res);
+        {
+            android::Mutex::Autolock al(mLock);
+            mExit = true;
+            mQueueCond.broadcast();
+        }
+        for (size_t i = 0; i < mWorkers.size(); i++)
+            pthread_join(mWorkers[i], NULL);
+        mWorkers.clear();
+        if (mTimeline >= 0) {
+            close(mTimeline);
+            mTimeline = -1;
+        }
+        close(mWakeFd);
+        mWakeFd = -1;
+        if (mAllocDev != NULL) {
+            gralloc_close(mAllocDev);
+            mAllocDev = NULL;
+        }
+        delete mSource;
+        mSource = NULL;
+        return -res;
+    }
+    mStarted = true;
+    return 0;
+}
+
+void Pipeline::stop()
+{
+    if (!mStarted)
+        return;
+
+    flush();
+    {
+        android::Mutex::Autolock al(mLock);
+        mExit = true;
+        mQueueCond.broadcast();
+    }
+    pthread_join(mFenceThread, NULL);
+    for (size_t i = 0; i < mWorkers.size(); i++)
+        pthread_join(mWorkers[i], NULL);
+    mWorkers.clear();
+    mStarted = false;
+
+    if (mTimeline >= 0) {
+        close(mTimeline);
+        mTimeline = -1;
+    }
+    if (mWakeFd >= 0) {
+        close(mWakeFd);
+        mWakeFd = -1;
+    }
+    if (mAllocDev != NULL) {
+        gralloc_close(mAllocDev);
+        mAllocDev = NULL;
+    }
+    mStrides.clear();
+    delete mSource;
+    mSource = NULL;
+}
+
+int Pipeline::queueRequest(const camera3_capture_request_t *request,
+        const camera_metadata_t *settings)
+{
+    ATRACE_CALL();
+
+    Request *req = new Request();
+    req->frameNumber = request->frame_number;
+    req->numBuffers = request->num_output_buffers;
+    req->buffers = new camera3_stream_buffer_t[req->numBuffers];
+    memcpy(req->buffers, request->output_buffers,
+            req->numBuffers * sizeof(camera3_stream_buffer_t));
+    req->async = false;
+    req->fenceValue = 0;
+    req->done = false;
+    req->queueTime = bootTime();
+
+    // Room for the sensor timestamp added at dispatch
+    req->result = allocate_camera_metadata(
+            get_camera_metadata_entry_count(settings) + 1,
+            get_camera_metadata_data_count(settings) + sizeof(int64_t));
+    if (req->result == NULL ||
+            append_camera_metadata(req->result, settings) != 0) {
+        ALOGE("%s:%d: Failed to copy settings of frame %u", __func__, mId,
+                req->frameNumber);
+        // The caller returns an error, the fences stay with the framework
+        freeRequest(req);
+        return -ENOMEM;
+    }
+
+    android::Mutex::Autolock al(mLock);
+    mPending.push_back(req);
+    mQueued++;
+    mQueueCond.broadcast();
+    return 0;
+}
+
+int Pipeline::flush()
+{
+    ATRACE_CALL();
+    uint64_t wake = 1;
+
+    {
+        android::Mutex::Autolock al(mLock);
+        if (!mStarted)
+            return 0;
+        mFlushing = true;
+        mQueueCond.broadcast();
+    }
+    if (write(mWakeFd, &wake, sizeof(wake)) != sizeof(wake)) {
+        ALOGE("%s:%d: Failed to wake fence thread: %s(%d)", __func__, mId,
+                strerror(errno), errno);
+    }
+
+    waitIdle();
+
+    android::Mutex::Autolock al(mLock);
+    mFlushing = false;
+    // Rearm fence waits; the fence thread is idle
+    if (read(mWakeFd, &wake, sizeof(wake)) < 0 && errno != EAGAIN) {
+        ALOGE("%s:%d: Failed to clear eventfd: %s(%d)", __func__, mId,
+                strerror(errno), errno);
+    }
+    return 0;
+}
+
+void Pipeline::waitIdle()
+{
+    ATRACE_CALL();
+    android::Mutex::Autolock al(mLock);
+    while (mQueued > 0)
+        mIdleCond.wait(mLock);
+}
+
+void *Pipeline::fenceThread(void *data)
+{
+    static_cast<Pipeline*>(data)->fenceLoop();
+    return NULL;
+}
+
+void *Pipeline::workerThread(void *data)
+{
+    static_cast<Pipeline*>(data)->workerLoop();
+    return NULL;
+}
+
+void Pipeline::fenceLoop()
+{
+    // Frame for fills done on this thread when there is no timeline
+    uint8_t *frame = NULL;
+    if (mTimeline < 0)
+        frame = new uint8_t[mSource->getFrameSize()];
+
+    for (;;) {
+        Request *req;
+        bool flushing;
+        {
+            android::Mutex::Autolock al(mLock);
+            while (mPending.empty() && !mExit)
+                mQueueCond.wait(mLock);
+            if (mPending.empty())
+                break;
+            req = *mPending.begin();
+            mPending.erase(mPending.begin());
+            flushing = mFlushing;
+        }
+        if (flushing) {
+            cancel(req);
+            continue;
+        }
+
+        nsecs_t waitStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        bool cancelled = false;
+        for (uint32_t i = 0; i < req->numBuffers; i++) {
+            camera3_stream_buffer_t &buffer = req->buffers[i];
+            if (buffer.acquire_fence == -1)
+                continue;
+            int res = waitFence(buffer.acquire_fence);
+            if (res == -ECANCELED) {
+                cancelled = true;
+                break;
+            }
+            close(buffer.acquire_fence);
+            buffer.acquire_fence = -1;
+            if (res) {
+                ALOGE("%s:%d: Frame %u buffer %u acquire fence failed: %s(%d)",
+                        __func__, mId, req->frameNumber, i, strerror(-res),
+                        res);
+                buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+                android::Mutex::Autolock al(mLock);
+                mFenceErrors++;
+            }
+        }
+        if (cancelled) {
+            cancel(req);
+            continue;
+        }
+
+        nsecs_t waited = systemTime(SYSTEM_TIME_MONOTONIC) - waitStart;
+        {
+            android::Mutex::Autolock al(mLock);
+            if (waited > mMaxFenceWait)
+                mMaxFenceWait = waited;
+        }
+
+        if (mTimeline < 0) {
+            // Fill before the buffers go back, nothing can signal later
+            fill(req, frame);
+        }
+        dispatch(req);
+    }
+
+    delete [] frame;
+}
+
+void Pipeline::workerLoop()
+{
+    uint8_t *frame = new uint8_t[mSource->getFrameSize()];
+
+    for (;;) {
+        Request *req;
+        {
+            android::Mutex::Autolock al(mLock);
+            while (mWork.empty() && !mExit)
+                mQueueCond.wait(mLock);
+            if (mWork.empty())
+                break;
+            req = *mWork.begin();
+            mWork.erase(mWork.begin());
+        }
+
+        fill(req, frame);
+
+        android::Mutex::Autolock al(mLock);
+        complete_L(req);
+    }
+
+    delete [] frame;
+}
+
+int Pipeline::waitFence(int fd)
+{
+    ATRACE_CALL();
+    struct pollfd fds[2];
+
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = mWakeFd;
+    fds[1].events = POLLIN;
+
+    int res = TEMP_FAILURE_RETRY(poll(fds, 2, CAMERA_SYNC_TIMEOUT));
+    if (res < 0)
+        return -errno;
+    if (res == 0)
+        return -ETIME;
+    if (fds[1].revents & POLLIN)
+        return -ECANCELED;
+    if (fds[0].revents & (POLLERR | POLLNVAL))
+        return -EINVAL;
+    // The fence signaled; sync_wait reports whether it signaled an error
+    if (sync_wait(fd, 0) < 0)
+        return -errno;
+    return 0;
+}
+
+void Pipeline::dispatch(Request *req)
+{
+    ATRACE_CALL();
+    camera3_capture_result_t result;
+    camera3_notify_msg_t m;
+    camera_metadata_ro_entry_t entry;
+    nsecs_t now;
+
+    // Pace shutters to the requested frame duration, if any
+    now = bootTime();
+    if (find_camera_metadata_ro_entry(req->result,
+            ANDROID_SENSOR_FRAME_DURATION, &entry) == 0 && entry.count == 1 &&
+            mLastShutter != 0 && now < mLastShutter + entry.data.i64[0]) {
+        nsecs_t delay = mLastShutter + entry.data.i64[0] - now;
+        struct timespec ts;
+        ts.tv_sec = delay / 1000000000LL;
+        ts.tv_nsec = delay % 1000000000LL;
+        TEMP_FAILURE_RETRY(nanosleep(&ts, &ts));
+        now = bootTime();
+    }
+    mLastShutter = now;
+
+    int64_t timestamp = now;
+    if (add_camera_metadata_entry(req->result, ANDROID_SENSOR_TIMESTAMP,
+            &timestamp, 1) != 0) {
+        ALOGE("%s:%d: Failed to add timestamp to frame %u", __func__, mId,
+                req->frameNumber);
+    }
+
+    // Release fences are handed out in frame order on the fence thread, so
+    // they can be signaled by advancing the timeline as requests complete
+    if (mTimeline >= 0) {
+        req->async = true;
+        req->fenceValue = ++mFenceValue;
+    }
+    for (uint32_t i = 0; i < req->numBuffers; i++) {
+        camera3_stream_buffer_t &buffer = req->buffers[i];
+        buffer.release_fence = -1;
+        if (!req->async || buffer.status != CAMERA3_BUFFER_STATUS_OK)
+            continue;
+        buffer.release_fence = sw_sync_fence_create(mTimeline,
+                "camera-release", req->fenceValue);
+        if (buffer.release_fence < 0) {
+            // The consumer could read the buffer before it is filled
+            ALOGE("%s:%d: Failed to create release fence for frame %u: %s",
+                    __func__, mId, req->frameNumber, strerror(errno));
+            buffer.release_fence = -1;
+            buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+        }
+    }
+
+    memset(&m, 0, sizeof(m));
+    m.type = CAMERA3_MSG_SHUTTER;
+    m.message.shutter.frame_number = req->frameNumber;
+    m.message.shutter.timestamp = now;
+    mCallbackOps->notify(mCallbackOps, &m);
+
+    // Buffers failed by their acquire or release fence; the rest of the
+    // frame goes out normally
+    for (uint32_t i = 0; i < req->numBuffers; i++) {
+        if (req->buffers[i].status == CAMERA3_BUFFER_STATUS_OK)
+            continue;
+        memset(&m, 0, sizeof(m));
+        m.type = CAMERA3_MSG_ERROR;
+        m.message.error.frame_number = req->frameNumber;
+        m.message.error.error_stream = req->buffers[i].stream;
+        m.message.error.error_code = CAMERA3_MSG_ERROR_BUFFER;
+        mCallbackOps->notify(mCallbackOps, &m);
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.frame_number = req->frameNumber;
+    result.result = req->result;
+    result.num_output_buffers = req->numBuffers;
+    result.output_buffers = req->buffers;
+
+    mCallbackOps->process_capture_result(mCallbackOps, &result);
+
+    // Only the fence thread adds to mInflight, so it stays in fence order
+    android::Mutex::Autolock al(mLock);
+    mInflight.push_back(req);
+    if (req->async) {
+        mWork.push_back(req);
+        mQueueCond.broadcast();
+    } else {
+        complete_L(req);
+    }
+}
+
+void Pipeline::cancel(Request *req)
+{
+    ATRACE_CALL();
+    camera3_capture_result_t result;
+    camera3_notify_msg_t m;
+
+    memset(&m, 0, sizeof(m));
+    m.type = CAMERA3_MSG_ERROR;
+    m.message.error.frame_number = req->frameNumber;
+    m.message.error.error_code = CAMERA3_MSG_ERROR_REQUEST;
+    mCallbackOps->notify(mCallbackOps, &m);
+
+    // Fences not waited on go back as release fences
+    for (uint32_t i = 0; i < req->numBuffers; i++) {
+        camera3_stream_buffer_t &buffer = req->buffers[i];
+        buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+        buffer.release_fence = buffer.acquire_fence;
+        buffer.acquire_fence = -1;
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.frame_number = req->frameNumber;
+    result.result = NULL;
+    result.num_output_buffers = req->numBuffers;
+    result.output_buffers = req->buffers;
+    mCallbackOps->process_capture_result(mCallbackOps, &result);
+
+    android::Mutex::Autolock al(mLock);
+    mNumCancelled++;
+    mQueued--;
+    if (mQueued == 0)
+        mIdleCond.broadcast();
+    freeRequest(req);
+}
+
+void Pipeline::fill(Request *req, uint8_t *frame)
+{
+    ATRACE_CALL();
+    int res;
+    uint32_t errors = 0;
+
+    res = mSource->getFrame(req->frameNumber, frame);
+    for (uint32_t i = 0; i < req->numBuffers; i++) {
+        const camera3_stream_buffer_t &buffer = req->buffers[i];
+        if (buffer.status != CAMERA3_BUFFER_STATUS_OK)
+            continue;
+        if (res || mGralloc == NULL) {
+            errors++;
+            continue;
+        }
+        const camera3_stream_t *stream = buffer.stream;
+        if (mSource->writeFrame(mGralloc, *buffer.buffer, stream->format,
+                stream->width, stream->height, getStride(stream),
+                GRALLOC_USAGE_SW_WRITE_OFTEN, mBlobSize, frame)) {
+            errors++;
+        }
+    }
+
+    if (errors) {
+        ALOGE("%s:%d: Failed to fill %u buffers of frame %u", __func__, mId,
+                errors, req->frameNumber);
+        android::Mutex::Autolock al(mLock);
+        mFillErrors += errors;
+    }
+}
+
+uint32_t Pipeline::getStride(const camera3_stream_t *stream)
+{
+    {
+        android::Mutex::Autolock al(mLock);
+        for (size_t i = 0; i < mStrides.size(); i++) {
+            const StreamStride &s = mStrides[i];
+            if (s.stream == stream && s.width == stream->width &&
+                    s.height == stream->height && s.format == stream->format)
+                return s.stride;
+        }
+    }
+
+    // gralloc only reports strides on allocation. They depend on the
+    // format, size and usage, so a buffer allocated like the stream's has
+    // the same stride as the framework's buffers.
+    uint32_t stride = stream->width;
+    if (mAllocDev != NULL && stream->format != HAL_PIXEL_FORMAT_BLOB &&
+            stream->format != HAL_PIXEL_FORMAT_YCbCr_420_888) {
+        buffer_handle_t handle = NULL;
+        int probe = 0;
+        int res = mAllocDev->alloc(mAllocDev, stream->width, stream->height,
+                stream->format, stream->usage, &handle, &probe);
+        if (res) {
+            ALOGW("%s:%d: Failed to allocate %ux%u format %#x buffer, "
+                    "assuming packed rows: %s(%d)", __func__, mId,
+                    stream->width, stream->height, stream->format,
+                    strerror(-res), res);
+        } else {
+            mAllocDev->free(mAllocDev, handle);
+            if (probe > 0 && static_cast<uint32_t>(probe) >= stream->width)
+                stride = probe;
+        }
+    }
+
+    android::Mutex::Autolock al(mLock);
+    for (size_t i = 0; i < mStrides.size(); i++) {
+        if (mStrides[i].stream == stream) {
+            // Reconfigured, or the stream address was reused
+            mStrides.removeAt(i);
+            break;
+        }
+    }
+    StreamStride s = { stream, stream->width, stream->height, stream->format,
+            stride };
+    mStrides.push_back(s);
+    return stride;
+}
+
+void Pipeline::complete_L(Request *req)
+{
+    req->done = true;
+
+    nsecs_t now = bootTime();
+    while (!mInflight.empty() && (*mInflight.begin())->done) {
+        Request *head = *mInflight.begin();
+        mInflight.erase(mInflight.begin());
+        if (head->async) {
+            int res = sw_sync_timeline_inc(mTimeline, 1);
+            if (res) {
+                ALOGE("%s:%d: Failed to signal release fences of frame %u: "
+                        "%s(%d)", __func__, mId, head->frameNumber,
+                        strerror(errno), errno);
+            }
+        }
+        if (now - head->queueTime > mMaxLatency)
+            mMaxLatency = now - head->queueTime;
+        mNumCompleted++;
+        mQueued--;
+        freeRequest(head);
+    }
+    if (mQueued == 0)
+        mIdleCond.broadcast();
+}
+
+void Pipeline::freeRequest(Request *req)
+{
+    if (req->result != NULL)
+        free_camera_metadata(req->result);
+    delete [] req->buffers;
+    delete req;
+}
+
+void Pipeline::dump(int fd)
+{
+    android::Mutex::Autolock al(mLock);
+
+    dprintf(fd, "Pipeline: %s source, %zu workers, release fences %s\n",
+            mSource != NULL ? mSource->getName() : "no",
+            mWorkers.size(), mTimeline >= 0 ? "sw_sync" : "none");
+    dprintf(fd, "Requests: %" PRIu32 " queued, %zu waiting on fences, "
+            "%zu dispatched, %zu waiting for a worker\n", mQueued,
+            mPending.size(), mInflight.size(), mWork.size());
+    dprintf(fd, "Completed: %" PRIu64 " Cancelled: %" PRIu64
+            " Fence errors: %" PRIu64 " Fill errors: %" PRIu64 "\n",
+            mNumCompleted, mNumCancelled, mFenceErrors, mFillErrors);
+    dprintf(fd, "Max acquire fence wait: %.3f ms Max latency: %.3f ms\n",
+            mMaxFenceWait / 1000000.0, mMaxLatency / 1000000.0);
+}
+
+} // namespace default_camera_hal
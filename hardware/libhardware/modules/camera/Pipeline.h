@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <pthread.h>
+#include <hardware/camera3.h>
+#include <hardware/gralloc.h>
+#include <system/camera_metadata.h>
+#include <utils/Condition.h>
+#include <utils/List.h>
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include "FrameSource.h"
+
+namespace default_camera_hal {
+// Pipeline runs capture requests in software, several at a time.
+//
+// queueRequest() only copies the request. A fence thread then takes
+// requests in frame order, waits for the acquire fences of their output
+// buffers, sends the shutter and returns the result right away with
+// release fences from a sw_sync timeline. A pool of worker threads fills
+// the buffers from a FrameSource, and the timeline is advanced in frame
+// order as requests complete, which signals their release fences.
+//
+// Without sw_sync the fence thread fills the buffers itself before
+// returning each result.
+class Pipeline {
+    public:
+        // Requests in flight the framework may queue per stream
+        static const uint32_t kMaxInflight = 4;
+
+        Pipeline(int id);
+        ~Pipeline();
+
+        // Start the fence thread and num_workers workers. Takes ownership
+        // of source, also when it fails. blob_size is the size of BLOB
+        // stream buffers.
+        int start(const camera3_callback_ops_t *callback_ops,
+                FrameSource *source, size_t blob_size, int num_workers);
+        // Flush, then stop all threads
+        void stop();
+
+        // Queue a request with the settings it is captured with. Takes
+        // ownership of the output buffers' acquire fences.
+        int queueRequest(const camera3_capture_request_t *request,
+                const camera_metadata_t *settings);
+        // Return requests still waiting on acquire fences with errors, and
+        // wait for all others to complete
+        int flush();
+        // Block until every queued request has completed
+        void waitIdle();
+
+        void dump(int fd);
+
+    private:
+        struct Request {
+            uint32_t frameNumber;
+            // Copy of the settings, with room for the result entries
+            camera_metadata_t *result;
+            camera3_stream_buffer_t *buffers;
+            uint32_t numBuffers;
+            // Release fences were handed out; mTimeline must reach
+            // fenceValue once the buffers are filled
+            bool async;
+            uint32_t fenceValue;
+            bool done;
+            nsecs_t queueTime;
+        };
+
+        static void *fenceThread(void *data);
+        static void *workerThread(void *data);
+        void fenceLoop();
+        void workerLoop();
+
+        // Wait for an acquire fence; -ECANCELED when interrupted by flush
+        int waitFence(int fd);
+        // Send the shutter and result of a request whose fences signaled
+        void dispatch(Request *req);
+        // Return a request that never reached dispatch with errors
+        void cancel(Request *req);
+        // Fill the output buffers of a request, frame is scratch space
+        void fill(Request *req, uint8_t *frame);
+        // Retire completed requests in order. Must hold mLock.
+        void complete_L(Request *req);
+        // Row pitch in pixels of the buffers of stream
+        uint32_t getStride(const camera3_stream_t *stream);
+        void freeRequest(Request *req);
+
+        // Camera id, for logging
+        const int mId;
+        const camera3_callback_ops_t *mCallbackOps;
+        FrameSource *mSource;
+        const gralloc_module_t *mGralloc;
+        // Only used to look up buffer strides, NULL if it failed to open
+        alloc_device_t *mAllocDev;
+        size_t mBlobSize;
+        // sw_sync timeline backing release fences, -1 if unavailable
+        int mTimeline;
+        // Timeline value of the last release fence handed out
+        uint32_t mFenceValue;
+        // eventfd that interrupts acquire fence waits on flush
+        int mWakeFd;
+        // Shutter time of the last dispatched request, for pacing
+        nsecs_t mLastShutter;
+
+        // Lock protecting the queues and statistics below
+        android::Mutex mLock;
+        // Broadcast when mPending or mWork get a request, or on exit
+        android::Condition mQueueCond;
+        // Signaled when mQueued drops to 0
+        android::Condition mIdleCond;
+        // Requests waiting for their acquire fences, in frame order
+        android::List<Request*> mPending;
+        // Dispatched requests waiting for a worker
+        android::List<Request*> mWork;
+        // Dispatched requests, in frame order, until they complete
+        android::List<Request*> mInflight;
+        // Requests queued and not yet completed or cancelled
+        uint32_t mQueued;
+        // Strides found by getStride(), by stream and its configuration
+        struct StreamStride {
+            const camera3_stream_t *stream;
+            uint32_t width;
+            uint32_t height;
+            int format;
+            uint32_t stride;
+        };
+        android::Vector<StreamStride> mStrides;
+        bool mFlushing;
+        bool mExit;
+
+        pthread_t mFenceThread;
+        bool mStarted;
+        android::Vector<pthread_t> mWorkers;
+
+        // Statistics
+        uint64_t mNumCompleted;
+        uint64_t mNumCancelled;
+        uint64_t mFenceErrors;
+        uint64_t mFillErrors;
+        nsecs_t mMaxFenceWait;
+        nsecs_t mMaxLatency;
+};
+} // namespace default_camera_hal
+
+#endif // PIPELINE_H_
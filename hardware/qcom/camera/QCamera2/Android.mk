@@ -7,6 +7,11 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
         util/QCameraCmdThread.cpp \
         util/QCameraQueue.cpp \
+        util/QCameraRingQueue.cpp \
+        util/QCameraIonPool.cpp \
+        util/QCameraDumpService.cpp \
+        util/QCameraParamDiff.cpp \
+        util/QCameraFenceWaiter.cpp \
         QCamera2Hal.cpp \
         QCamera2Factory.cpp
 
@@ -15,6 +20,7 @@ LOCAL_SRC_FILES += \
         HAL3/QCamera3HWI.cpp \
         HAL3/QCamera3Mem.cpp \
         HAL3/QCamera3Stream.cpp \
+        HAL3/QCamera3AllocThreadPool.cpp \
         HAL3/QCamera3Channel.cpp \
         HAL3/QCamera3VendorTags.cpp \
         HAL3/QCamera3PostProc.cpp \
@@ -65,7 +71,7 @@ LOCAL_C_INCLUDES += \
 
 LOCAL_SHARED_LIBRARIES := libcamera_client liblog libhardware libutils libcutils libdl
 LOCAL_SHARED_LIBRARIES += libmmcamera_interface libmmjpeg_interface libui libcamera_metadata
-LOCAL_SHARED_LIBRARIES += libqdMetaData
+LOCAL_SHARED_LIBRARIES += libqdMetaData libsync
 
 LOCAL_MODULE_RELATIVE_PATH := hw
 LOCAL_MODULE := camera.$(TARGET_BOARD_PLATFORM)
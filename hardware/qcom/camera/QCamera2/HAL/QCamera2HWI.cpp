@@ -42,6 +42,7 @@
 
 #include "QCamera2HWI.h"
 #include "QCameraMem.h"
+#include "QCameraDumpService.h"
 
 #define MAP_TO_DRIVER_COORDINATE(val, base, scale, offset) \
   ((int32_t)val * (int32_t)scale / (int32_t)base + (int32_t)offset)
@@ -1716,7 +1717,10 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(
     case CAM_STREAM_TYPE_POSTVIEW:
         {
             if (isNoDisplayMode() || isPreviewRestartEnabled()) {
-                mem = new QCameraStreamMemory(mGetMemory, bCachedMem);
+                mem = new QCameraStreamMemory(mGetMemory,
+                        bCachedMem,
+                        (bPoolMem) ? &m_memoryPool : NULL,
+                        stream_type);
             } else {
                 cam_dimension_t dim;
                 QCameraGrallocMemory *grallocMemory =
@@ -1748,7 +1752,9 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(
                 bCachedMem = QCAMERA_ION_USE_NOCACHE;
             }
             CDBG_HIGH("%s: vidoe buf using cached memory = %d", __func__, bCachedMem);
-            mem = new QCameraVideoMemory(mGetMemory, bCachedMem);
+            mem = new QCameraVideoMemory(mGetMemory, bCachedMem,
+                    CAM_STREAM_BUF_TYPE_MPLANE,
+                    (bPoolMem) ? &m_memoryPool : NULL);
         }
         break;
     case CAM_STREAM_TYPE_DEFAULT:
@@ -4135,6 +4141,9 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+    dprintf(fd, "\n Memory pool:\n");
+    m_memoryPool.dump(fd);
+    QCameraDumpService::getInstance()->dump(fd);
     dprintf(fd, "\n Camera HAL information End \n");
 
     /* send UPDATE_DEBUG_LEVEL to the backend so that they can read the
@@ -6800,7 +6809,7 @@ int QCamera2HardwareInterface::updateParameters(const char *parms, bool &needRes
     pthread_mutex_lock(&m_parm_lock);
     String8 str = String8(parms);
     QCameraParameters param(str);
-    rc =  mParameters.updateParameters(param, needRestart);
+    rc =  mParameters.updateParameters(param, needRestart, parms);
 
     // update stream based parameter settings
     for (int i = 0; i < QCAMERA_CH_TYPE_MAX; i++) {
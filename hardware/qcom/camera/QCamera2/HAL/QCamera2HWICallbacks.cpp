@@ -38,6 +38,7 @@
 #include <utils/Timers.h>
 #include <QComOMXMetadata.h>
 #include "QCamera2HWI.h"
+#include "QCameraDumpService.h"
 
 namespace qcamera {
 
@@ -1939,17 +1940,21 @@ void QCamera2HardwareInterface::dumpJpegToFile(const void *data,
                     mBackendFileSize = size;
                 }
 
-                int file_fd = open(buf, O_RDWR | O_CREAT, 0777);
-                if (file_fd > 0) {
-                    ssize_t written_len = write(file_fd, data, size);
-                    fchmod(file_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+                qcamera_dump_seg_t seg = { data, size, size, 1 };
+                QCameraDumpService *dumper = QCameraDumpService::getInstance();
+                if (true == m_bIntJpegEvtPending) {
+                    // the backend reads the file once the event is sent
+                    ssize_t written_len = dumper->writeSync(
+                            QCAMERA_DUMP_STREAM_JPEG, buf, &seg, 1);
+                    if (written_len < 0) {
+                        ALOGE("%s: failed to write %s: %zd", __func__, buf,
+                                written_len);
+                        mBackendFileSize = 0;
+                    }
                     CDBG_HIGH("%s: written number of bytes %zd\n",
                             __func__, written_len);
-                    close(file_fd);
                 } else {
-                    ALOGE("%s: fail t open file for image dumping", __func__);
-                }
-                if (false == m_bIntJpegEvtPending) {
+                    dumper->submit(QCAMERA_DUMP_STREAM_JPEG, buf, &seg, 1);
                     mDumpFrmCnt++;
                 }
             }
@@ -2002,43 +2007,32 @@ void QCamera2HardwareInterface::dumpMetadataToFile(QCameraStream *stream,
             String8 filePath(timeBuf);
             snprintf(buf, sizeof(buf), "%um_%s_%d.bin", dumpFrmCnt, type, frame->frame_idx);
             filePath.append(buf);
-            int file_fd = open(filePath.string(), O_RDWR | O_CREAT, 0777);
-            if (file_fd > 0) {
-                ssize_t written_len = 0;
-                metadata->tuning_params.tuning_data_version = TUNING_DATA_VERSION;
-                void *data = (void *)((uint8_t *)&metadata->tuning_params.tuning_data_version);
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_sensor_data_size);
-                CDBG_HIGH("tuning_sensor_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_vfe_data_size);
-                CDBG_HIGH("tuning_vfe_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_cpp_data_size);
-                CDBG_HIGH("tuning_cpp_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_cac_data_size);
-                CDBG_HIGH("tuning_cac_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_cac_data_size2);
-                CDBG_HIGH("%s < skrajago >tuning_cac_data_size %d",__func__,(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                size_t total_size = metadata->tuning_params.tuning_sensor_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data);
-                written_len += write(file_fd, data, total_size);
-                total_size = metadata->tuning_params.tuning_vfe_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data[TUNING_VFE_DATA_OFFSET]);
-                written_len += write(file_fd, data, total_size);
-                total_size = metadata->tuning_params.tuning_cpp_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data[TUNING_CPP_DATA_OFFSET]);
-                written_len += write(file_fd, data, total_size);
-                total_size = metadata->tuning_params.tuning_cac_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data[TUNING_CAC_DATA_OFFSET]);
-                written_len += write(file_fd, data, total_size);
-                close(file_fd);
-            }else {
-                ALOGE("%s: fail t open file for image dumping", __func__);
-            }
+            tuning_params_t &tuning = metadata->tuning_params;
+            tuning.tuning_data_version = TUNING_DATA_VERSION;
+            CDBG_HIGH("tuning sensor %zu vfe %zu cpp %zu cac %zu cac2 %zu",
+                    tuning.tuning_sensor_data_size,
+                    tuning.tuning_vfe_data_size,
+                    tuning.tuning_cpp_data_size,
+                    tuning.tuning_cac_data_size,
+                    tuning.tuning_cac_data_size2);
+            qcamera_dump_seg_t segs[] = {
+                { &tuning.tuning_data_version, sizeof(uint32_t), 0, 1 },
+                { &tuning.tuning_sensor_data_size, sizeof(uint32_t), 0, 1 },
+                { &tuning.tuning_vfe_data_size, sizeof(uint32_t), 0, 1 },
+                { &tuning.tuning_cpp_data_size, sizeof(uint32_t), 0, 1 },
+                { &tuning.tuning_cac_data_size, sizeof(uint32_t), 0, 1 },
+                { &tuning.tuning_cac_data_size2, sizeof(uint32_t), 0, 1 },
+                { &tuning.data, tuning.tuning_sensor_data_size, 0, 1 },
+                { &tuning.data[TUNING_VFE_DATA_OFFSET],
+                        tuning.tuning_vfe_data_size, 0, 1 },
+                { &tuning.data[TUNING_CPP_DATA_OFFSET],
+                        tuning.tuning_cpp_data_size, 0, 1 },
+                { &tuning.data[TUNING_CAC_DATA_OFFSET],
+                        tuning.tuning_cac_data_size, 0, 1 },
+            };
+            QCameraDumpService::getInstance()->submit(
+                    QCAMERA_DUMP_STREAM_METADATA, filePath.string(), segs,
+                    sizeof(segs) / sizeof(segs[0]));
             dumpFrmCnt++;
         }
     }
@@ -2125,21 +2119,25 @@ void QCamera2HardwareInterface::dumpFrameToFile(QCameraStream *stream,
                                 QCAMERA_DUMP_FRM_LOCATION "%Y%m%d%H%M%S", timeinfo);
                     }
                     String8 filePath(timeBuf);
+                    qcamera_dump_stream_t dumpStream = QCAMERA_DUMP_STREAM_PREVIEW;
                     switch (dump_type) {
                     case QCAMERA_DUMP_FRM_PREVIEW:
                         {
+                            dumpStream = QCAMERA_DUMP_STREAM_PREVIEW;
                             snprintf(buf, sizeof(buf), "%dp_%dx%d_%d.yuv",
                                     dumpFrmCnt, dim.width, dim.height, frame->frame_idx);
                         }
                         break;
                     case QCAMERA_DUMP_FRM_THUMBNAIL:
                         {
+                            dumpStream = QCAMERA_DUMP_STREAM_THUMBNAIL;
                             snprintf(buf, sizeof(buf), "%dt_%dx%d_%d.yuv",
                                     dumpFrmCnt, dim.width, dim.height, frame->frame_idx);
                         }
                         break;
                     case QCAMERA_DUMP_FRM_SNAPSHOT:
                         {
+                            dumpStream = QCAMERA_DUMP_STREAM_SNAPSHOT;
                             mParameters.getStreamDimension(CAM_STREAM_TYPE_SNAPSHOT, dim);
                             snprintf(buf, sizeof(buf), "%ds_%dx%d_%d.yuv",
                                     dumpFrmCnt, dim.width, dim.height, frame->frame_idx);
@@ -2147,12 +2145,14 @@ void QCamera2HardwareInterface::dumpFrameToFile(QCameraStream *stream,
                         break;
                     case QCAMERA_DUMP_FRM_VIDEO:
                         {
+                            dumpStream = QCAMERA_DUMP_STREAM_VIDEO;
                             snprintf(buf, sizeof(buf), "%dv_%dx%d_%d.yuv",
                                     dumpFrmCnt, dim.width, dim.height, frame->frame_idx);
                         }
                         break;
                     case QCAMERA_DUMP_FRM_RAW:
                         {
+                            dumpStream = QCAMERA_DUMP_STREAM_RAW;
                             mParameters.getStreamDimension(CAM_STREAM_TYPE_RAW, dim);
                             snprintf(buf, sizeof(buf), "%dr_%dx%d_%d.raw",
                                     dumpFrmCnt, dim.width, dim.height, frame->frame_idx);
@@ -2160,6 +2160,7 @@ void QCamera2HardwareInterface::dumpFrameToFile(QCameraStream *stream,
                         break;
                     case QCAMERA_DUMP_FRM_JPEG:
                         {
+                            dumpStream = QCAMERA_DUMP_STREAM_JPEG;
                             mParameters.getStreamDimension(CAM_STREAM_TYPE_SNAPSHOT, dim);
                             snprintf(buf, sizeof(buf), "%dj_%dx%d_%d.yuv",
                                     dumpFrmCnt, dim.width, dim.height, frame->frame_idx);
@@ -2172,35 +2173,39 @@ void QCamera2HardwareInterface::dumpFrameToFile(QCameraStream *stream,
                     }
 
                     filePath.append(buf);
-                    int file_fd = open(filePath.string(), O_RDWR | O_CREAT, 0777);
-                    ssize_t written_len = 0;
-                    if (file_fd > 0) {
-                        void *data = NULL;
-
-                        fchmod(file_fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-                        for (uint32_t i = 0; i < offset.num_planes; i++) {
-                            uint32_t index = offset.mp[i].offset;
-                            if (i > 0) {
-                                index += offset.mp[i-1].len;
-                            }
-                            for (int j = 0; j < offset.mp[i].height; j++) {
-                                data = (void *)((uint8_t *)frame->buffer + index);
-                                written_len += write(file_fd, data,
-                                        (size_t)offset.mp[i].width);
-                                index += (uint32_t)offset.mp[i].stride;
-                            }
+                    qcamera_dump_seg_t segs[VIDEO_MAX_PLANES];
+                    uint32_t numSegs = 0;
+                    for (uint32_t i = 0; i < offset.num_planes &&
+                            numSegs < VIDEO_MAX_PLANES; i++) {
+                        uint32_t index = offset.mp[i].offset;
+                        if (i > 0) {
+                            index += offset.mp[i-1].len;
                         }
-
-                        CDBG_HIGH("%s: written number of bytes %ld\n",
-                            __func__, written_len);
-                        close(file_fd);
-                    } else {
-                        ALOGE("%s: fail t open file for image dumping", __func__);
+                        segs[numSegs].data = (uint8_t *)frame->buffer + index;
+                        segs[numSegs].width = (size_t)offset.mp[i].width;
+                        segs[numSegs].stride = (size_t)offset.mp[i].stride;
+                        segs[numSegs].rows = (uint32_t)offset.mp[i].height;
+                        numSegs++;
                     }
+
+                    QCameraDumpService *dumper = QCameraDumpService::getInstance();
                     if (true == m_bIntRawEvtPending) {
+                        // the backend reads the file once the event is sent
+                        ssize_t written_len = dumper->writeSync(dumpStream,
+                                filePath.string(), segs, numSegs);
+                        CDBG_HIGH("%s: written number of bytes %zd\n",
+                            __func__, written_len);
                         strlcpy(m_BackendFileName, filePath.string(), QCAMERA_MAX_FILEPATH_LENGTH);
-                        mBackendFileSize = (size_t)written_len;
+                        if (written_len < 0) {
+                            ALOGE("%s: failed to write %s: %zd", __func__,
+                                    filePath.string(), written_len);
+                            mBackendFileSize = 0;
+                        } else {
+                            mBackendFileSize = (size_t)written_len;
+                        }
                     } else {
+                        dumper->submit(dumpStream, filePath.string(), segs,
+                                numSegs);
                         dumpFrmCnt++;
                     }
                 }
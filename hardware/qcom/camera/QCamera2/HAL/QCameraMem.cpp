@@ -442,68 +442,8 @@ void QCameraMemory::dealloc()
 int QCameraMemory::allocOneBuffer(QCameraMemInfo &memInfo,
         unsigned int heap_id, size_t size, bool cached, uint32_t secure_mode)
 {
-    int rc = OK;
-    struct ion_handle_data handle_data;
-    struct ion_allocation_data alloc;
-    struct ion_fd_data ion_info_fd;
-    int main_ion_fd = 0;
-
-    main_ion_fd = open("/dev/ion", O_RDONLY);
-    if (main_ion_fd < 0) {
-        ALOGE("Ion dev open failed: %s\n", strerror(errno));
-        goto ION_OPEN_FAILED;
-    }
-
-    memset(&alloc, 0, sizeof(alloc));
-    alloc.len = size;
-    /* to make it page size aligned */
-    alloc.len = (alloc.len + 4095U) & (~4095U);
-    alloc.align = 4096;
-    if (cached) {
-        alloc.flags = ION_FLAG_CACHED;
-    }
-    alloc.heap_id_mask = heap_id;
-    if (secure_mode == SECURE) {
-        ALOGD("%s: Allocate secure buffer\n", __func__);
-        alloc.flags = ION_SECURE;
-        alloc.heap_id_mask = ION_HEAP(ION_CP_MM_HEAP_ID);
-        alloc.align = 1048576; // 1 MiB alignment to be able to protect later
-        alloc.len = (alloc.len + 1048575U) & (~1048575U);
-    }
-
-    rc = ioctl(main_ion_fd, ION_IOC_ALLOC, &alloc);
-    if (rc < 0) {
-        ALOGE("ION allocation failed: %s\n", strerror(errno));
-        goto ION_ALLOC_FAILED;
-    }
-
-    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
-    ion_info_fd.handle = alloc.handle;
-    rc = ioctl(main_ion_fd, ION_IOC_SHARE, &ion_info_fd);
-    if (rc < 0) {
-        ALOGE("ION map failed %s\n", strerror(errno));
-        goto ION_MAP_FAILED;
-    }
-
-    memInfo.main_ion_fd = main_ion_fd;
-    memInfo.fd = ion_info_fd.fd;
-    memInfo.handle = ion_info_fd.handle;
-    memInfo.size = alloc.len;
-    memInfo.cached = cached;
-    memInfo.heap_id = heap_id;
-
-    ALOGD("%s : ION buffer %lx with size %d allocated",
-            __func__, (unsigned long)memInfo.handle, alloc.len);
-    return OK;
-
-ION_MAP_FAILED:
-    memset(&handle_data, 0, sizeof(handle_data));
-    handle_data.handle = ion_info_fd.handle;
-    ioctl(main_ion_fd, ION_IOC_FREE, &handle_data);
-ION_ALLOC_FAILED:
-    close(main_ion_fd);
-ION_OPEN_FAILED:
-    return NO_MEMORY;
+    return QCameraIonPool::allocIonBuffer(memInfo, heap_id, size, cached,
+            secure_mode);
 }
 
 /*===========================================================================
@@ -518,22 +458,7 @@ ION_OPEN_FAILED:
  *==========================================================================*/
 void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
 {
-    struct ion_handle_data handle_data;
-
-    if (memInfo.fd > 0) {
-        close(memInfo.fd);
-        memInfo.fd = 0;
-    }
-
-    if (memInfo.main_ion_fd > 0) {
-        memset(&handle_data, 0, sizeof(handle_data));
-        handle_data.handle = memInfo.handle;
-        ioctl(memInfo.main_ion_fd, ION_IOC_FREE, &handle_data);
-        close(memInfo.main_ion_fd);
-        memInfo.main_ion_fd = 0;
-    }
-    memInfo.handle = 0;
-    memInfo.size = 0;
+    QCameraIonPool::freeIonBuffer(memInfo);
 }
 
 /*===========================================================================
@@ -547,7 +472,9 @@ void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
  *==========================================================================*/
 QCameraMemoryPool::QCameraMemoryPool()
 {
-    pthread_mutex_init(&mLock, NULL);
+    memset(mTypeHits, 0, sizeof(mTypeHits));
+    memset(mTypeMisses, 0, sizeof(mTypeMisses));
+    memset(mTypeReleases, 0, sizeof(mTypeReleases));
 }
 
 
@@ -562,14 +489,12 @@ QCameraMemoryPool::QCameraMemoryPool()
  *==========================================================================*/
 QCameraMemoryPool::~QCameraMemoryPool()
 {
-    clear();
-    pthread_mutex_destroy(&mLock);
 }
 
 /*===========================================================================
  * FUNCTION   : releaseBuffer
  *
- * DESCRIPTION: release one cached buffers
+ * DESCRIPTION: release one buffer into the pool, together with its mapping
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
@@ -578,46 +503,20 @@ QCameraMemoryPool::~QCameraMemoryPool()
  * RETURN     : none
  *==========================================================================*/
 void QCameraMemoryPool::releaseBuffer(
-        struct QCameraMemory::QCameraMemInfo &memInfo,
+        QCameraMemory::QCameraMemInfo &memInfo,
         cam_stream_type_t streamType)
 {
-    pthread_mutex_lock(&mLock);
-
-    mPools[streamType].push_back(memInfo);
-
-    pthread_mutex_unlock(&mLock);
-}
-
-/*===========================================================================
- * FUNCTION   : clear
- *
- * DESCRIPTION: clears all cached buffers
- *
- * PARAMETERS : none
- *
- * RETURN     : none
- *==========================================================================*/
-void QCameraMemoryPool::clear()
-{
-    pthread_mutex_lock(&mLock);
-
-    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++ ) {
-        List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-        it = mPools[i].begin();
-        for( ; it != mPools[i].end() ; it++) {
-            QCameraMemory::deallocOneBuffer(*it);
-        }
-
-        mPools[i].clear();
+    if (streamType < CAM_STREAM_TYPE_MAX) {
+        __atomic_add_fetch(&mTypeReleases[streamType], 1, __ATOMIC_RELAXED);
     }
-
-    pthread_mutex_unlock(&mLock);
+    QCameraIonPool::releaseBuffer(memInfo);
 }
 
 /*===========================================================================
- * FUNCTION   : findBufferLocked
+ * FUNCTION   : allocateBuffer
  *
- * DESCRIPTION: search for a appropriate cached buffer
+ * DESCRIPTION: allocates a buffer from the memory pool,
+ *              it will re-use cached buffers if possible
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
@@ -625,73 +524,52 @@ void QCameraMemoryPool::clear()
  *   @size    : size of the buffer
  *   @cached  : whether the buffer should be cached
  *   @streaType: type of stream this buffer belongs to
+ *   @secure_mode: SECURE for content protected buffers
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
-int QCameraMemoryPool::findBufferLocked(
-        struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
-        size_t size, bool cached, cam_stream_type_t streamType)
+int QCameraMemoryPool::allocateBuffer(
+        QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
+        size_t size, bool cached, cam_stream_type_t streamType,
+        uint32_t secure_mode)
 {
-    int rc = NAME_NOT_FOUND;
-
-    if (mPools[streamType].empty()) {
-        return NAME_NOT_FOUND;
+    bool reused = false;
+    int rc = QCameraIonPool::allocateBuffer(memInfo, heap_id, size, cached,
+            secure_mode, &reused);
+    if (rc == NO_ERROR && streamType < CAM_STREAM_TYPE_MAX) {
+        __atomic_add_fetch(reused ? &mTypeHits[streamType] :
+                &mTypeMisses[streamType], 1, __ATOMIC_RELAXED);
     }
-
-    List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-    it = mPools[streamType].begin();
-    for ( ; it != mPools[streamType].end() ; it++) {
-        if ( ((*it).size >= size) &&
-            ((*it).heap_id == heap_id) &&
-            ((*it).cached == cached) ) {
-            memInfo = *it;
-            mPools[streamType].erase(it);
-            rc = NO_ERROR;
-            break;
-        }
+    if (!reused) {
+        CDBG_HIGH("%s : Buffer not found!", __func__);
     }
-
     return rc;
 }
 
 /*===========================================================================
- * FUNCTION   : allocateBuffer
+ * FUNCTION   : dump
  *
- * DESCRIPTION: allocates a buffer from the memory pool,
- *              it will re-use cached buffers if possible
+ * DESCRIPTION: print pool statistics, including reuse per stream type
  *
  * PARAMETERS :
- *   @memInfo : reference to struct that stores additional memory allocation info
- *   @heap_id : type of heap
- *   @size    : size of the buffer
- *   @cached  : whether the buffer should be cached
- *   @streaType: type of stream this buffer belongs to
+ *   @fd      : file descriptor to print to
  *
- * RETURN     : int32_t type of status
- *              NO_ERROR  -- success
- *              none-zero failure code
+ * RETURN     : none
  *==========================================================================*/
-int QCameraMemoryPool::allocateBuffer(
-        struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
-        size_t size, bool cached, cam_stream_type_t streamType,
-        uint32_t secure_mode)
+void QCameraMemoryPool::dump(int fd)
 {
-    int rc = NO_ERROR;
-
-    pthread_mutex_lock(&mLock);
-
-    rc = findBufferLocked(memInfo, heap_id, size, cached, streamType);
-    if (NAME_NOT_FOUND == rc ) {
-        CDBG_HIGH("%s : Buffer not found!", __func__);
-        rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
-                 secure_mode);
+    QCameraIonPool::dump(fd);
+    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++) {
+        uint32_t hits = __atomic_load_n(&mTypeHits[i], __ATOMIC_RELAXED);
+        uint32_t misses = __atomic_load_n(&mTypeMisses[i], __ATOMIC_RELAXED);
+        uint32_t releases = __atomic_load_n(&mTypeReleases[i], __ATOMIC_RELAXED);
+        if (hits || misses || releases) {
+            dprintf(fd, "  stream type %d: reused %u new %u released %u\n",
+                    i, hits, misses, releases);
+        }
     }
-
-    pthread_mutex_unlock(&mLock);
-
-    return rc;
 }
 
 /*===========================================================================
@@ -999,7 +877,7 @@ int QCameraStreamMemory::allocate(uint8_t count, size_t size, uint32_t isSecure)
         if (isSecure == SECURE) {
             mCameraMemory[i] = 0;
         } else {
-            mCameraMemory[i] = mGetMemory(mMemInfo[i].fd, mMemInfo[i].size, 1, this);
+            mCameraMemory[i] = getCameraMemory(i);
         }
     }
     mBufferCount = count;
@@ -1029,13 +907,80 @@ int QCameraStreamMemory::allocateMore(uint8_t count, size_t size)
         return rc;
 
     for (int i = mBufferCount; i < mBufferCount + count; i++) {
-        mCameraMemory[i] = mGetMemory(mMemInfo[i].fd, mMemInfo[i].size, 1, this);
+        mCameraMemory[i] = getCameraMemory(i);
     }
     mBufferCount = (uint8_t)(mBufferCount + count);
     traceLogAllocEnd((size * count));
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : getCameraMemory
+ *
+ * DESCRIPTION: get the framework memory object of a freshly allocated
+ *              buffer. The one kept with a pooled buffer is reused, so a
+ *              recycled buffer does not need to be mapped again
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : camera memory pointer
+ *==========================================================================*/
+camera_memory_t *QCameraStreamMemory::getCameraMemory(uint32_t index)
+{
+    camera_memory_t *mem = (camera_memory_t *)
+            QCameraIonPool::takeMapping(mMemInfo[index], releaseCameraMemory);
+    if (mem == NULL) {
+        mem = mGetMemory(mMemInfo[index].fd, mMemInfo[index].size, 1, this);
+    }
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : putCameraMemory
+ *
+ * DESCRIPTION: hand the framework memory object of a buffer over to its
+ *              ion buffer. It is released together with the buffer, or
+ *              kept alive while the buffer sits in the memory pool
+ *
+ * PARAMETERS :
+ *   @index   : index of the buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStreamMemory::putCameraMemory(uint32_t index)
+{
+    camera_memory_t *mem = mCameraMemory[index];
+
+    mCameraMemory[index] = NULL;
+    if (mem == NULL) {
+        return;
+    }
+    mMemInfo[index].mapping = mem;
+    mMemInfo[index].vaddr = mem->data;
+    mMemInfo[index].unmap = releaseCameraMemory;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseCameraMemory
+ *
+ * DESCRIPTION: unmap function of framework memory objects kept with ion
+ *              buffers
+ *
+ * PARAMETERS :
+ *   @mapping : camera memory pointer
+ *   @vaddr   : mapped address, unused
+ *   @size    : mapped size, unused
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStreamMemory::releaseCameraMemory(void *mapping,
+        void * /*vaddr*/, size_t /*size*/)
+{
+    camera_memory_t *mem = (camera_memory_t *)mapping;
+    mem->release(mem);
+}
+
 /*===========================================================================
  * FUNCTION   : deallocate
  *
@@ -1048,9 +993,7 @@ int QCameraStreamMemory::allocateMore(uint8_t count, size_t size)
 void QCameraStreamMemory::deallocate()
 {
     for (int i = 0; i < mBufferCount; i ++) {
-        if (mCameraMemory[i])
-            mCameraMemory[i]->release(mCameraMemory[i]);
-        mCameraMemory[i] = NULL;
+        putCameraMemory(i);
     }
     dealloc();
     mBufferCount = 0;
@@ -1174,12 +1117,15 @@ void *QCameraStreamMemory::getPtr(uint32_t index) const
  * PARAMETERS :
  *   @memory    : camera memory request ops table
  *   @cached    : flag indicates if using cached ION memory
+ *   @bufType   : stream buffer type
+ *   @pool      : memory pool to recycle buffers through, may be NULL
  *
  * RETURN     : none
  *==========================================================================*/
 QCameraVideoMemory::QCameraVideoMemory(camera_request_memory memory,
-                                       bool cached, cam_stream_buf_type bufType)
-    : QCameraStreamMemory(memory, cached)
+                                       bool cached, cam_stream_buf_type bufType,
+                                       QCameraMemoryPool *pool)
+    : QCameraStreamMemory(memory, cached, pool, CAM_STREAM_TYPE_VIDEO, bufType)
 {
     memset(mMetadata, 0, sizeof(mMetadata));
     mMetaBufCount = 0;
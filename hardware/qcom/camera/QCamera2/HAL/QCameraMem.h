@@ -34,6 +34,7 @@
 #include <utils/Mutex.h>
 #include <utils/List.h>
 #include <qdMetaData.h>
+#include "QCameraIonPool.h"
 
 extern "C" {
 #include <sys/types.h>
@@ -96,53 +97,45 @@ protected:
 
     friend class QCameraMemoryPool;
 
-    struct QCameraMemInfo {
-        int fd;
-        int main_ion_fd;
-        ion_user_handle_t handle;
-        size_t size;
-        bool cached;
-        unsigned int heap_id;
-    };
+    typedef qcamera_ion_buf_t QCameraMemInfo;
 
     int alloc(int count, size_t size, unsigned int heap_id,
             uint32_t is_secure);
     void dealloc();
-    static int allocOneBuffer(struct QCameraMemInfo &memInfo,
+    static int allocOneBuffer(QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached, uint32_t is_secure);
-    static void deallocOneBuffer(struct QCameraMemInfo &memInfo);
+    static void deallocOneBuffer(QCameraMemInfo &memInfo);
     int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr);
 
     bool m_bCached;
     uint8_t mBufferCount;
-    struct QCameraMemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
+    QCameraMemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
     QCameraMemoryPool *mMemoryPool;
     cam_stream_type_t mStreamType;
     cam_stream_buf_type mBufType;
 };
 
-class QCameraMemoryPool {
+// Size class ion pool shared by the stream memories of one HAL instance,
+// with per stream type reuse statistics.
+class QCameraMemoryPool : public QCameraIonPool {
 
 public:
 
     QCameraMemoryPool();
     virtual ~QCameraMemoryPool();
 
-    int allocateBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
+    int allocateBuffer(QCameraMemory::QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached,
             cam_stream_type_t streamType, uint32_t is_secure);
-    void releaseBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
+    void releaseBuffer(QCameraMemory::QCameraMemInfo &memInfo,
             cam_stream_type_t streamType);
-    void clear();
+    void dump(int fd);
 
 protected:
 
-    int findBufferLocked(struct QCameraMemory::QCameraMemInfo &memInfo,
-            unsigned int heap_id, size_t size, bool cached,
-            cam_stream_type_t streamType);
-
-    android::List<QCameraMemory::QCameraMemInfo> mPools[CAM_STREAM_TYPE_MAX];
-    pthread_mutex_t mLock;
+    uint32_t mTypeHits[CAM_STREAM_TYPE_MAX];
+    uint32_t mTypeMisses[CAM_STREAM_TYPE_MAX];
+    uint32_t mTypeReleases[CAM_STREAM_TYPE_MAX];
 };
 
 // Internal heap memory is used for memories used internally
@@ -186,6 +179,10 @@ public:
     virtual void *getPtr(uint32_t index) const;
 
 protected:
+    static void releaseCameraMemory(void *mapping, void *vaddr, size_t size);
+    camera_memory_t *getCameraMemory(uint32_t index);
+    void putCameraMemory(uint32_t index);
+
     camera_request_memory mGetMemory;
     camera_memory_t *mCameraMemory[MM_CAMERA_MAX_NUM_FRAMES];
 };
@@ -195,7 +192,8 @@ protected:
 class QCameraVideoMemory : public QCameraStreamMemory {
 public:
     QCameraVideoMemory(camera_request_memory getMemory, bool cached,
-            cam_stream_buf_type bufType = CAM_STREAM_BUF_TYPE_MPLANE);
+            cam_stream_buf_type bufType = CAM_STREAM_BUF_TYPE_MPLANE,
+            QCameraMemoryPool *pool = NULL);
     virtual ~QCameraVideoMemory();
 
     virtual int allocate(uint8_t count, size_t size, uint32_t is_secure);
@@ -39,6 +39,7 @@
 #include <sys/sysinfo.h>
 #include "QCamera2HWI.h"
 #include "QCameraParameters.h"
+#include "QCameraParamDiff.h"
 
 #define ASPECT_TOLERANCE 0.001
 
@@ -746,6 +747,40 @@ const QCameraParameters::QCameraMap<int>
     { VIDEO_ROTATION_270, 270 }
 };
 
+// Key strings of qcamera_param_key_t
+static const struct {
+    qcamera_param_key_t id;
+    const char *key;
+} QCAMERA_PKEY_TABLE[] = {
+    { QCAMERA_PKEY_ZOOM,                CameraParameters::KEY_ZOOM },
+    { QCAMERA_PKEY_FOCUS_MODE,          CameraParameters::KEY_FOCUS_MODE },
+    { QCAMERA_PKEY_FLASH_MODE,          CameraParameters::KEY_FLASH_MODE },
+    { QCAMERA_PKEY_AEC_LOCK,            CameraParameters::KEY_AUTO_EXPOSURE_LOCK },
+    { QCAMERA_PKEY_AWB_LOCK,            CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK },
+    { QCAMERA_PKEY_WHITE_BALANCE,       CameraParameters::KEY_WHITE_BALANCE },
+    { QCAMERA_PKEY_ANTIBANDING,         CameraParameters::KEY_ANTIBANDING },
+    { QCAMERA_PKEY_EFFECT,              CameraParameters::KEY_EFFECT },
+    { QCAMERA_PKEY_SCENE_MODE,          CameraParameters::KEY_SCENE_MODE },
+    { QCAMERA_PKEY_RECORDING_HINT,      CameraParameters::KEY_RECORDING_HINT },
+    { QCAMERA_PKEY_ROTATION,            CameraParameters::KEY_ROTATION },
+    { QCAMERA_PKEY_ORIENTATION,         QCameraParameters::KEY_QC_ORIENTATION },
+    { QCAMERA_PKEY_CAMERA_MODE,         QCameraParameters::KEY_QC_CAMERA_MODE },
+    { QCAMERA_PKEY_AUTO_EXPOSURE,       QCameraParameters::KEY_QC_AUTO_EXPOSURE },
+    { QCAMERA_PKEY_BRIGHTNESS,          QCameraParameters::KEY_QC_BRIGHTNESS },
+    { QCAMERA_PKEY_SHARPNESS,           QCameraParameters::KEY_QC_SHARPNESS },
+    { QCAMERA_PKEY_SATURATION,          QCameraParameters::KEY_QC_SATURATION },
+    { QCAMERA_PKEY_CONTRAST,            QCameraParameters::KEY_QC_CONTRAST },
+    { QCAMERA_PKEY_SCE_FACTOR,          QCameraParameters::KEY_QC_SCE_FACTOR },
+    { QCAMERA_PKEY_MCE,                 QCameraParameters::KEY_QC_MEMORY_COLOR_ENHANCEMENT },
+    { QCAMERA_PKEY_DIS,                 QCameraParameters::KEY_QC_DIS },
+    { QCAMERA_PKEY_LENSSHADE,           QCameraParameters::KEY_QC_LENSSHADE },
+    { QCAMERA_PKEY_SELECTABLE_ZONE_AF,  QCameraParameters::KEY_QC_SELECTABLE_ZONE_AF },
+    { QCAMERA_PKEY_REDEYE_REDUCTION,    QCameraParameters::KEY_QC_REDEYE_REDUCTION },
+    { QCAMERA_PKEY_VIDEO_HDR,           QCameraParameters::KEY_QC_VIDEO_HDR },
+    { QCAMERA_PKEY_VT_ENABLE,           QCameraParameters::KEY_QC_VT_ENABLE },
+    { QCAMERA_PKEY_HDR_MODE,            QCameraParameters::KEY_QC_HDR_MODE },
+};
+
 #define DEFAULT_CAMERA_AREA "(0, 0, 0, 0, 0)"
 #define DATA_PTR(MEM_OBJ,INDEX) MEM_OBJ->getPtr( INDEX )
 #define TOTAL_RAM_SIZE_512MB 536870912
@@ -854,6 +889,9 @@ QCameraParameters::QCameraParameters()
     mCurPPCount = 0;
     mBufBatchCnt = 0;
     mRotation = 0;
+    memset(m_dirtyKeys, 0, sizeof(m_dirtyKeys));
+    m_bAllKeysDirty = true;
+    m_bFlattenedValid = false;
 }
 
 /*===========================================================================
@@ -937,6 +975,9 @@ QCameraParameters::QCameraParameters(const String8 &params)
     mParmZoomLevel = 0;
     mCurPPCount = 0;
     mRotation = 0;
+    memset(m_dirtyKeys, 0, sizeof(m_dirtyKeys));
+    m_bAllKeysDirty = true;
+    m_bFlattenedValid = false;
 }
 
 /*===========================================================================
@@ -953,6 +994,216 @@ QCameraParameters::~QCameraParameters()
     deinit();
 }
 
+/*===========================================================================
+ * FUNCTION   : flatten
+ *
+ * DESCRIPTION: parameters in string form. The result is kept until the next
+ *              change, getParameters is called far more often than
+ *              parameters change.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : parameters in string form
+ *==========================================================================*/
+String8 QCameraParameters::flatten()
+{
+    if (!m_bFlattenedValid) {
+        m_flattened = CameraParameters::flatten();
+        m_bFlattenedValid = true;
+    }
+    // String8 shares the buffer, this is a reference count bump
+    return m_flattened;
+}
+
+/*===========================================================================
+ * FUNCTION   : unflatten
+ *
+ * DESCRIPTION: replace all parameters with the ones in string form
+ *
+ * PARAMETERS :
+ *   @params  : parameters in string form
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::unflatten(const String8 &params)
+{
+    m_bFlattenedValid = false;
+    CameraParameters::unflatten(params);
+}
+
+/*===========================================================================
+ * FUNCTION   : set
+ *
+ * DESCRIPTION: set a parameter. Setting the value a key already has keeps
+ *              the cached flatten() result.
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *   @value   : parameter value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::set(const char *key, const char *value)
+{
+    const char *cur = get(key);
+    if (cur != NULL && value != NULL && strcmp(cur, value) == 0) {
+        return;
+    }
+    m_bFlattenedValid = false;
+    CameraParameters::set(key, value);
+}
+
+/*===========================================================================
+ * FUNCTION   : set
+ *
+ * DESCRIPTION: set an integer parameter
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *   @value   : parameter value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::set(const char *key, int value)
+{
+    char str[16];
+    snprintf(str, sizeof(str), "%d", value);
+    set(key, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setFloat
+ *
+ * DESCRIPTION: set a float parameter
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *   @value   : parameter value
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setFloat(const char *key, float value)
+{
+    char str[16];
+    snprintf(str, sizeof(str), "%g", value);
+    set(key, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : remove
+ *
+ * DESCRIPTION: remove a parameter
+ *
+ * PARAMETERS :
+ *   @key     : parameter key
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::remove(const char *key)
+{
+    m_bFlattenedValid = false;
+    CameraParameters::remove(key);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewSize
+ *
+ * DESCRIPTION: set preview size parameter
+ *
+ * PARAMETERS :
+ *   @width   : preview width
+ *   @height  : preview height
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPreviewSize(int width, int height)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%dx%d", width, height);
+    set(KEY_PREVIEW_SIZE, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setVideoSize
+ *
+ * DESCRIPTION: set video size parameter
+ *
+ * PARAMETERS :
+ *   @width   : video width
+ *   @height  : video height
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setVideoSize(int width, int height)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%dx%d", width, height);
+    set(KEY_VIDEO_SIZE, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPictureSize
+ *
+ * DESCRIPTION: set picture size parameter
+ *
+ * PARAMETERS :
+ *   @width   : picture width
+ *   @height  : picture height
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPictureSize(int width, int height)
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%dx%d", width, height);
+    set(KEY_PICTURE_SIZE, str);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewFormat
+ *
+ * DESCRIPTION: set preview format parameter
+ *
+ * PARAMETERS :
+ *   @format  : preview format string
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPreviewFormat(const char *format)
+{
+    set(KEY_PREVIEW_FORMAT, format);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPictureFormat
+ *
+ * DESCRIPTION: set picture format parameter
+ *
+ * PARAMETERS :
+ *   @format  : picture format string
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPictureFormat(const char *format)
+{
+    set(KEY_PICTURE_FORMAT, format);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPreviewFrameRate
+ *
+ * DESCRIPTION: set preview frame rate parameter
+ *
+ * PARAMETERS :
+ *   @fps     : preview frame rate
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::setPreviewFrameRate(int fps)
+{
+    set(KEY_PREVIEW_FRAME_RATE, fps);
+}
+
 /*===========================================================================
  * FUNCTION   : createSizesString
  *
@@ -1312,7 +1563,7 @@ int32_t QCameraParameters::setPreviewSize(const QCameraParameters& params)
             }
 
             // set the new value
-            CameraParameters::setPreviewSize(width, height);
+            setPreviewSize(width, height);
             return NO_ERROR;
         }
     }
@@ -1352,7 +1603,7 @@ int32_t QCameraParameters::setPictureSize(const QCameraParameters& params)
                 }
 
                 // set the new value
-                CameraParameters::setPictureSize(width, height);
+                setPictureSize(width, height);
                 return NO_ERROR;
             }
         }
@@ -1418,7 +1669,7 @@ int32_t QCameraParameters::setVideoSize(const QCameraParameters& params)
             }
 
             // set the new value
-            CameraParameters::setVideoSize(width, height);
+            setVideoSize(width, height);
             return NO_ERROR;
         }
     }
@@ -1610,7 +1861,7 @@ int32_t QCameraParameters::setPreviewFormat(const QCameraParameters& params)
     if (previewFormat != NAME_NOT_FOUND) {
         mPreviewFormat = (cam_format_t)previewFormat;
 
-        CameraParameters::setPreviewFormat(str);
+        setPreviewFormat(str);
         CDBG_HIGH("%s: format %d\n", __func__, mPreviewFormat);
         return NO_ERROR;
     }
@@ -1637,7 +1888,7 @@ int32_t QCameraParameters::setPictureFormat(const QCameraParameters& params)
     if (pictureFormat != NAME_NOT_FOUND) {
         mPictureFormat = pictureFormat;
 
-        CameraParameters::setPictureFormat(str);
+        setPictureFormat(str);
         CDBG_HIGH("%s: format %d\n", __func__, mPictureFormat);
         return NO_ERROR;
     }
@@ -4451,13 +4702,15 @@ int32_t QCameraParameters::setMobicat(const QCameraParameters& )
  * PARAMETERS :
  *   @params  : user setting parameters
  *   @needRestart : [output] if preview need restart upon setting changes
+ *   @flattened : user setting in string form, used to skip setters of
+ *                unchanged keys; NULL runs every setter
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
  *              none-zero failure code
  *==========================================================================*/
 int32_t QCameraParameters::updateParameters(QCameraParameters& params,
-        bool &needRestart)
+        bool &needRestart, const char *flattened)
 {
     int32_t final_rc = NO_ERROR;
     int32_t rc;
@@ -4469,63 +4722,92 @@ int32_t QCameraParameters::updateParameters(QCameraParameters& params,
         goto UPDATE_PARAM_DONE;
     }
 
+    markDirtyKeys(flattened);
+
     if ((rc = setPreviewSize(params)))                  final_rc = rc;
     if ((rc = setVideoSize(params)))                    final_rc = rc;
     if ((rc = setPictureSize(params)))                  final_rc = rc;
     if ((rc = setPreviewFormat(params)))                final_rc = rc;
     if ((rc = setPictureFormat(params)))                final_rc = rc;
     if ((rc = setJpegQuality(params)))                  final_rc = rc;
-    if ((rc = setOrientation(params)))                  final_rc = rc;
-    if ((rc = setRotation(params)))                     final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_ORIENTATION) &&
+            (rc = setOrientation(params)))              final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_ROTATION) &&
+            (rc = setRotation(params)))                 final_rc = rc;
     if ((rc = setVideoRotation(params)))                final_rc = rc;
     if ((rc = setNoDisplayMode(params)))                final_rc = rc;
     if ((rc = setZslMode(params)))                      final_rc = rc;
     if ((rc = setZslAttributes(params)))                final_rc = rc;
-    if ((rc = setCameraMode(params)))                   final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_CAMERA_MODE) &&
+            (rc = setCameraMode(params)))               final_rc = rc;
     if ((rc = setSceneSelectionMode(params)))           final_rc = rc;
-    if ((rc = setRecordingHint(params)))                final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_RECORDING_HINT) &&
+            (rc = setRecordingHint(params)))            final_rc = rc;
     if ((rc = setRdiMode(params)))                      final_rc = rc;
     if ((rc = setSecureMode(params)))                   final_rc = rc;
     if ((rc = setPreviewFrameRate(params)))             final_rc = rc;
     if ((rc = setPreviewFpsRange(params)))              final_rc = rc;
-    if ((rc = setAutoExposure(params)))                 final_rc = rc;
-    if ((rc = setEffect(params)))                       final_rc = rc;
-    if ((rc = setBrightness(params)))                   final_rc = rc;
-    if ((rc = setZoom(params)))                         final_rc = rc;
-    if ((rc = setSharpness(params)))                    final_rc = rc;
-    if ((rc = setSaturation(params)))                   final_rc = rc;
-    if ((rc = setContrast(params)))                     final_rc = rc;
-    if ((rc = setFocusMode(params)))                    final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_AUTO_EXPOSURE) &&
+            (rc = setAutoExposure(params)))             final_rc = rc;
+    if ((isKeyDirty(QCAMERA_PKEY_EFFECT) || m_bUpdateEffects) &&
+            (rc = setEffect(params)))                   final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_BRIGHTNESS) &&
+            (rc = setBrightness(params)))               final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_ZOOM) &&
+            (rc = setZoom(params)))                     final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_SHARPNESS) &&
+            (rc = setSharpness(params)))                final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_SATURATION) &&
+            (rc = setSaturation(params)))               final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_CONTRAST) &&
+            (rc = setContrast(params)))                 final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_FOCUS_MODE) &&
+            (rc = setFocusMode(params)))                final_rc = rc;
     if ((rc = setISOValue(params)))                     final_rc = rc;
     if ((rc = setContinuousISO(params)))                final_rc = rc;
     if ((rc = setExposureTime(params)))                 final_rc = rc;
-    if ((rc = setSkinToneEnhancement(params)))          final_rc = rc;
-    if ((rc = setFlash(params)))                        final_rc = rc;
-    if ((rc = setAecLock(params)))                      final_rc = rc;
-    if ((rc = setAwbLock(params)))                      final_rc = rc;
-    if ((rc = setLensShadeValue(params)))               final_rc = rc;
-    if ((rc = setMCEValue(params)))                     final_rc = rc;
-    if ((rc = setDISValue(params)))                     final_rc = rc;
-    if ((rc = setAntibanding(params)))                  final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_SCE_FACTOR) &&
+            (rc = setSkinToneEnhancement(params)))      final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_FLASH_MODE) &&
+            (rc = setFlash(params)))                    final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_AEC_LOCK) &&
+            (rc = setAecLock(params)))                  final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_AWB_LOCK) &&
+            (rc = setAwbLock(params)))                  final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_LENSSHADE) &&
+            (rc = setLensShadeValue(params)))           final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_MCE) &&
+            (rc = setMCEValue(params)))                 final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_DIS) &&
+            (rc = setDISValue(params)))                 final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_ANTIBANDING) &&
+            (rc = setAntibanding(params)))              final_rc = rc;
     if ((rc = setExposureCompensation(params)))         final_rc = rc;
-    if ((rc = setWhiteBalance(params)))                 final_rc = rc;
-    if ((rc = setHDRMode(params)))                      final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_WHITE_BALANCE) &&
+            (rc = setWhiteBalance(params)))             final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_HDR_MODE) &&
+            (rc = setHDRMode(params)))                  final_rc = rc;
     if ((rc = setHDRNeed1x(params)))                    final_rc = rc;
     if ((rc = setManualWhiteBalance(params)))           final_rc = rc;
-    if ((rc = setSceneMode(params)))                    final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_SCENE_MODE) &&
+            (rc = setSceneMode(params)))                final_rc = rc;
     if ((rc = setFocusAreas(params)))                   final_rc = rc;
     if ((rc = setFocusPosition(params)))                final_rc = rc;
     if ((rc = setMeteringAreas(params)))                final_rc = rc;
-    if ((rc = setSelectableZoneAf(params)))             final_rc = rc;
-    if ((rc = setRedeyeReduction(params)))              final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_SELECTABLE_ZONE_AF) &&
+            (rc = setSelectableZoneAf(params)))         final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_REDEYE_REDUCTION) &&
+            (rc = setRedeyeReduction(params)))          final_rc = rc;
     if ((rc = setAEBracket(params)))                    final_rc = rc;
     if ((rc = setAutoHDR(params)))                      final_rc = rc;
     if ((rc = setGpsLocation(params)))                  final_rc = rc;
     if ((rc = setWaveletDenoise(params)))               final_rc = rc;
     if ((rc = setFaceRecognition(params)))              final_rc = rc;
     if ((rc = setFlip(params)))                         final_rc = rc;
-    if ((rc = setVideoHDR(params)))                     final_rc = rc;
-    if ((rc = setVtEnable(params)))                     final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_VIDEO_HDR) &&
+            (rc = setVideoHDR(params)))                 final_rc = rc;
+    if (isKeyDirty(QCAMERA_PKEY_VT_ENABLE) &&
+            (rc = setVtEnable(params)))                 final_rc = rc;
     if ((rc = setAFBracket(params)))                    final_rc = rc;
     if ((rc = setReFocus(params)))                      final_rc = rc;
     if ((rc = setChromaFlash(params)))                  final_rc = rc;
@@ -4625,8 +4907,8 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_SUPPORTED_PREVIEW_SIZES, previewSizeValues.string());
         CDBG_HIGH("%s: supported preview sizes: %s", __func__, previewSizeValues.string());
         // Set default preview size
-        CameraParameters::setPreviewSize(m_pCapability->preview_sizes_tbl[0].width,
-                                         m_pCapability->preview_sizes_tbl[0].height);
+        setPreviewSize(m_pCapability->preview_sizes_tbl[0].width,
+                m_pCapability->preview_sizes_tbl[0].height);
     } else {
         ALOGE("%s: supported preview sizes cnt is 0 or exceeds max!!!", __func__);
     }
@@ -4639,8 +4921,8 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_SUPPORTED_VIDEO_SIZES, videoSizeValues.string());
         CDBG_HIGH("%s: supported video sizes: %s", __func__, videoSizeValues.string());
         // Set default video size
-        CameraParameters::setVideoSize(m_pCapability->video_sizes_tbl[0].width,
-                                       m_pCapability->video_sizes_tbl[0].height);
+        setVideoSize(m_pCapability->video_sizes_tbl[0].width,
+                m_pCapability->video_sizes_tbl[0].height);
 
         //Set preferred Preview size for video
         String8 vSize = createSizesString(&m_pCapability->preview_sizes_tbl[0], 1);
@@ -4657,7 +4939,7 @@ int32_t QCameraParameters::initDefaultParameters()
         set(KEY_SUPPORTED_PICTURE_SIZES, pictureSizeValues.string());
         CDBG_HIGH("%s: supported pic sizes: %s", __func__, pictureSizeValues.string());
         // Set default picture size to the smallest resolution
-        CameraParameters::setPictureSize(
+        setPictureSize(
            m_pCapability->picture_sizes_tbl[m_pCapability->picture_sizes_tbl_cnt-1].width,
            m_pCapability->picture_sizes_tbl[m_pCapability->picture_sizes_tbl_cnt-1].height);
     } else {
@@ -4715,7 +4997,7 @@ int32_t QCameraParameters::initDefaultParameters()
             PARAM_MAP_SIZE(PREVIEW_FORMATS_MAP));
     set(KEY_SUPPORTED_PREVIEW_FORMATS, previewFormatValues.string());
     // Set default preview format
-    CameraParameters::setPreviewFormat(PIXEL_FORMAT_YUV420SP);
+    setPreviewFormat(PIXEL_FORMAT_YUV420SP);
 
     // Set default Video Format
     set(KEY_VIDEO_FRAME_FORMAT, PIXEL_FORMAT_YUV420SP);
@@ -4734,7 +5016,7 @@ int32_t QCameraParameters::initDefaultParameters()
 
     set(KEY_SUPPORTED_PICTURE_FORMATS, pictureTypeValues.string());
     // Set default picture Format
-    CameraParameters::setPictureFormat(PIXEL_FORMAT_JPEG);
+    setPictureFormat(PIXEL_FORMAT_JPEG);
     // Set raw image size
     char raw_size_str[32];
     snprintf(raw_size_str, sizeof(raw_size_str), "%dx%d",
@@ -4768,7 +5050,7 @@ int32_t QCameraParameters::initDefaultParameters()
         String8 fpsValues = createFpsString(m_pCapability->fps_ranges_tbl[default_fps_index]);
         set(KEY_SUPPORTED_PREVIEW_FRAME_RATES, fpsValues.string());
         CDBG_HIGH("%s: supported fps rates: %s", __func__, fpsValues.string());
-        CameraParameters::setPreviewFrameRate(int(m_pCapability->fps_ranges_tbl[default_fps_index].max_fps));
+        setPreviewFrameRate(int(m_pCapability->fps_ranges_tbl[default_fps_index].max_fps));
     } else {
         ALOGE("%s: supported fps ranges cnt is 0 or exceeds max!!!", __func__);
     }
@@ -10554,6 +10836,80 @@ int32_t QCameraParameters::commitParamChanges()
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : markDirtyKeys
+ *
+ * DESCRIPTION: work out which keys of qcamera_param_key_t change with the
+ *              new user setting. Falls back to marking every key dirty if
+ *              the new setting doesn't line up with the current one key by
+ *              key (e.g. the app added a key).
+ *
+ * PARAMETERS :
+ *   @flattened : new user setting in string form, may be NULL
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::markDirtyKeys(const char *flattened)
+{
+    memset(m_dirtyKeys, 0, sizeof(m_dirtyKeys));
+    m_bAllKeysDirty = true;
+    if (NULL == flattened) {
+        return;
+    }
+
+    // flatten() is cached until the next change, so this is normally free
+    String8 current = flatten();
+    if (QCameraParamDiff::diff(current.string(), flattened,
+            onKeyChanged, this)) {
+        m_bAllKeysDirty = false;
+    }
+    CDBG("%s: all dirty %d, dirty mask 0x%x", __func__, m_bAllKeysDirty,
+            m_dirtyKeys[0]);
+}
+
+/*===========================================================================
+ * FUNCTION   : onKeyChanged
+ *
+ * DESCRIPTION: QCameraParamDiff callback, marks a tracked key dirty
+ *
+ * PARAMETERS :
+ *   @key       : changed key, not NUL terminated
+ *   @keyLen    : length of key
+ *   @user_data : QCameraParameters object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraParameters::onKeyChanged(const char *key, size_t keyLen,
+        void *user_data)
+{
+    QCameraParameters *pme = (QCameraParameters *)user_data;
+    for (size_t i = 0; i < PARAM_MAP_SIZE(QCAMERA_PKEY_TABLE); i++) {
+        const char *name = QCAMERA_PKEY_TABLE[i].key;
+        if (strncmp(name, key, keyLen) == 0 && name[keyLen] == '\0') {
+            uint32_t id = (uint32_t)QCAMERA_PKEY_TABLE[i].id;
+            pme->m_dirtyKeys[id / 32] |= 1U << (id % 32);
+            return;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : isKeyDirty
+ *
+ * DESCRIPTION: whether a tracked key changes in the current update
+ *
+ * PARAMETERS :
+ *   @key     : key id
+ *
+ * RETURN     : true if the key's setter has to run
+ *==========================================================================*/
+bool QCameraParameters::isKeyDirty(qcamera_param_key_t key) const
+{
+    uint32_t id = (uint32_t)key;
+    return m_bAllKeysDirty ||
+            (m_dirtyKeys[id / 32] & (1U << (id % 32))) != 0;
+}
+
 /*===========================================================================
  * FUNCTION   : QCameraReprocScaleParam
  *
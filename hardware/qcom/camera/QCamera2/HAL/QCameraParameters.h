@@ -46,6 +46,40 @@ static const char ExifUndefinedPrefix[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
 #define CAMERA_MIN_BATCH_COUNT           1
 
+/* Keys whose setters updateParameters() only runs when the key changed.
+ * Each of these setters is a no-op when the new value equals the current
+ * one and nothing else writes the key while parameters are updated. */
+typedef enum {
+    QCAMERA_PKEY_ZOOM,
+    QCAMERA_PKEY_FOCUS_MODE,
+    QCAMERA_PKEY_FLASH_MODE,
+    QCAMERA_PKEY_AEC_LOCK,
+    QCAMERA_PKEY_AWB_LOCK,
+    QCAMERA_PKEY_WHITE_BALANCE,
+    QCAMERA_PKEY_ANTIBANDING,
+    QCAMERA_PKEY_EFFECT,
+    QCAMERA_PKEY_SCENE_MODE,
+    QCAMERA_PKEY_RECORDING_HINT,
+    QCAMERA_PKEY_ROTATION,
+    QCAMERA_PKEY_ORIENTATION,
+    QCAMERA_PKEY_CAMERA_MODE,
+    QCAMERA_PKEY_AUTO_EXPOSURE,
+    QCAMERA_PKEY_BRIGHTNESS,
+    QCAMERA_PKEY_SHARPNESS,
+    QCAMERA_PKEY_SATURATION,
+    QCAMERA_PKEY_CONTRAST,
+    QCAMERA_PKEY_SCE_FACTOR,
+    QCAMERA_PKEY_MCE,
+    QCAMERA_PKEY_DIS,
+    QCAMERA_PKEY_LENSSHADE,
+    QCAMERA_PKEY_SELECTABLE_ZONE_AF,
+    QCAMERA_PKEY_REDEYE_REDUCTION,
+    QCAMERA_PKEY_VIDEO_HDR,
+    QCAMERA_PKEY_VT_ENABLE,
+    QCAMERA_PKEY_HDR_MODE,
+    QCAMERA_PKEY_MAX
+} qcamera_param_key_t;
+
 class QCameraAdjustFPS
 {
 public:
@@ -105,6 +139,11 @@ private:
     cam_dimension_t mPicSizeSetted;    // dimension that config vfe
 };
 
+// QCameraParameters caches its flatten() result. The CameraParameters
+// mutators are not virtual, so the cache only sees changes made through the
+// overrides below. Never modify a QCameraParameters through a
+// CameraParameters reference or pointer, or with explicitly qualified
+// CameraParameters:: calls; flatten() would keep returning the old values.
 class QCameraParameters: public CameraParameters
 {
 public:
@@ -112,6 +151,22 @@ public:
     QCameraParameters(const String8 &params);
     ~QCameraParameters();
 
+    // CameraParameters string ops. These shadow the base class ones so
+    // the flatten() result can be cached here until the next change. Every
+    // base class mutator must be shadowed here.
+    String8 flatten();
+    void unflatten(const String8 &params);
+    void set(const char *key, const char *value);
+    void set(const char *key, int value);
+    void setFloat(const char *key, float value);
+    void remove(const char *key);
+    void setPreviewSize(int width, int height);
+    void setVideoSize(int width, int height);
+    void setPictureSize(int width, int height);
+    void setPreviewFormat(const char *format);
+    void setPictureFormat(const char *format);
+    void setPreviewFrameRate(int fps);
+
     // Supported PREVIEW/RECORDING SIZES IN HIGH FRAME RATE recording, sizes in pixels.
     // Example value: "800x480,432x320". Read only.
     static const char KEY_QC_SUPPORTED_HFR_SIZES[];
@@ -587,7 +642,8 @@ public:
     void deinit();
     int32_t assign(QCameraParameters& params);
     int32_t initDefaultParameters();
-    int32_t updateParameters(QCameraParameters&, bool &needRestart);
+    int32_t updateParameters(QCameraParameters&, bool &needRestart,
+            const char *flattened = NULL);
     int32_t commitParameters();
     int getPreviewHalPixelFormat() const;
     int32_t getStreamRotation(cam_stream_type_t streamType,
@@ -935,6 +991,11 @@ private:
     int32_t updateParamEntry(const char *key, const char *value);
     int32_t commitParamChanges();
 
+    // change tracking of the keys in qcamera_param_key_t
+    void markDirtyKeys(const char *flattened);
+    bool isKeyDirty(qcamera_param_key_t key) const;
+    static void onKeyChanged(const char *key, size_t keyLen, void *user_data);
+
     // Map from strings to values
     static const cam_dimension_t THUMBNAIL_SIZES_MAP[];
     static const QCameraMap<cam_auto_exposure_mode_type> AUTO_EXPOSURE_MAP[];
@@ -1018,6 +1079,10 @@ private:
     bool m_bHDR1xExtraBufferNeeded;     // if extra frame with exposure compensation 0 during HDR is needed
     bool m_bHDROutputCropEnabled;     // if HDR output frame need to be scaled to user resolution
     DefaultKeyedVector<String8,String8> m_tempMap; // map for temororily store parameters to be set
+    uint32_t m_dirtyKeys[(QCAMERA_PKEY_MAX + 31) / 32]; // changed in current update
+    bool m_bAllKeysDirty;           // key changes unknown, run every setter
+    String8 m_flattened;            // cached flatten() result
+    bool m_bFlattenedValid;         // if m_flattened matches the parameters
     cam_fps_range_t m_default_fps_range;
     bool m_bAFBracketingOn;
     bool m_bReFocusOn;
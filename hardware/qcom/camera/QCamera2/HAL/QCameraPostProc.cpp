@@ -945,7 +945,8 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
         // Release jpeg job data
         m_ongoingJpegQ.flushNodes(matchJobId, (void*)&evt->jobId);
 
-        if (m_inputPPQ.getCurrentSize() > 0) {
+        if ((m_inputPPQ.getCurrentSize() > 0) ||
+                (m_inputJpegQ.getCurrentSize() > 0)) {
             m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
         }
         CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, evt->jobId);
@@ -2523,8 +2524,13 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
             {
                 CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
                 if (is_active == TRUE) {
-                    qcamera_jpeg_data_t *jpeg_job =
-                        (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
+                    // leave the job queued while the jpeg scheduler is
+                    // saturated, the next jpeg event kicks us again
+                    qcamera_jpeg_data_t *jpeg_job = NULL;
+                    if (!pme->isJpegBusy()) {
+                        jpeg_job =
+                            (qcamera_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
+                    }
 
                     if (NULL != jpeg_job) {
                         // To avoid any race conditions,
@@ -2912,6 +2918,32 @@ int32_t QCameraPostProcessor::setYUVFrameInfo(mm_camera_super_buf_t *recvd_frame
     return BAD_VALUE;
 }
 
+/*===========================================================================
+ * FUNCTION   : isJpegBusy
+ *
+ * DESCRIPTION: check whether the jpeg scheduler already holds as many jobs
+ *              of this client as it will accept. Further jobs are kept in
+ *              m_inputJpegQ until a jpeg event frees up a slot.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : true if no more jobs should be submitted for now
+ *==========================================================================*/
+bool QCameraPostProcessor::isJpegBusy()
+{
+    mm_jpeg_sched_status_t status;
+
+    if ((mJpegClientHandle <= 0) || (NULL == mJpegHandle.get_sched_status)) {
+        return false;
+    }
+    memset(&status, 0, sizeof(status));
+    if (0 != mJpegHandle.get_sched_status(mJpegClientHandle, &status)) {
+        return false;
+    }
+    return (status.max_pending_jobs > 0) &&
+            (status.pending_jobs >= status.max_pending_jobs);
+}
+
 bool QCameraPostProcessor::matchJobId(void *data, void *, void *match_data)
 {
   qcamera_jpeg_data_t * job = (qcamera_jpeg_data_t *) data;
@@ -179,6 +179,7 @@ private:
 
     int32_t doReprocess();
     int32_t stopCapture();
+    bool isJpegBusy();
 
 private:
     QCamera2HardwareInterface *m_parent;
@@ -285,7 +285,7 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
         mNumBufsNeedAlloc(0),
         mDataCB(NULL),
         mUserData(NULL),
-        mDataQ(releaseFrameData, this),
+        mDataQ(CAM_MAX_NUM_BUFS_PER_STREAM, releaseFrameData, this),
         mStreamInfoBuf(NULL),
         mMiscBuf(NULL),
         mStreamBufs(NULL),
@@ -774,6 +774,8 @@ int32_t QCameraStream::stop()
 {
     int32_t rc = 0;
     m_bActive = false;
+    // let the stream thread stop waiting for frames and take the exit cmd
+    mDataQ.interrupt();
     rc = mProcTh.exit();
     return rc;
 }
@@ -877,7 +879,12 @@ int32_t QCameraStream::processDataNotify(mm_camera_super_buf_t *frame)
 {
     CDBG("%s:\n", __func__);
     if (mDataQ.enqueue((void *)frame)) {
-        return mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        // the ring wakes the stream thread; commands are only needed when
+        // it has no wakeup fd
+        if (mDataQ.getWaitFd() < 0) {
+            return mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        }
+        return NO_ERROR;
     } else {
         CDBG_HIGH("%s: Stream thread is not active, no ops here", __func__);
         bufDone(frame->bufs[0]->buf_idx);
@@ -911,16 +918,43 @@ void QCameraStream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         return;
     }
 
-    mm_camera_super_buf_t *frame =
-        (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
-    if (frame == NULL) {
-        ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
-        stream->bufDone(recvd_frame->bufs[0]->buf_idx);
+    if (recvd_frame->num_bufs == 1) {
+        mm_camera_super_buf_t *frame =
+            (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
+        if (frame == NULL) {
+            ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
+            stream->bufDone(recvd_frame->bufs[0]->buf_idx);
+            return;
+        }
+        *frame = *recvd_frame;
+        stream->processDataNotify(frame);
         return;
     }
-    *frame = *recvd_frame;
-    stream->processDataNotify(frame);
-    return;
+
+    // several buffers of this stream dequeued together, queue each as its
+    // own frame
+    bool queued = false;
+    for (uint32_t i = 0; i < recvd_frame->num_bufs; i++) {
+        mm_camera_super_buf_t *frame =
+            (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
+        if (frame == NULL) {
+            ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
+            stream->bufDone(recvd_frame->bufs[i]->buf_idx);
+            continue;
+        }
+        *frame = *recvd_frame;
+        frame->num_bufs = 1;
+        frame->bufs[0] = recvd_frame->bufs[i];
+        if (stream->mDataQ.enqueue((void *)frame)) {
+            queued = true;
+        } else {
+            stream->bufDone(frame->bufs[0]->buf_idx);
+            free(frame);
+        }
+    }
+    if (queued && (stream->mDataQ.getWaitFd() < 0)) {
+        stream->mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    }
 }
 
 /*===========================================================================
@@ -943,6 +977,17 @@ void *QCameraStream::dataProcRoutine(void *data)
 
     CDBG("%s: E", __func__);
     do {
+        // Frames are picked up straight from the data ring, which wakes
+        // this thread itself. Commands are looked at once stop()
+        // interrupts the ring, or if the ring cannot wait.
+        if (pme->mDataQ.waitForData(-1)) {
+            pme->processDataQ();
+            continue;
+        }
+        if (!pme->mDataQ.isInterrupted() && (pme->mDataQ.getWaitFd() >= 0)) {
+            continue;
+        }
+
         do {
             ret = cam_sem_wait(&cmdThread->cmd_sem);
             if (ret != 0 && errno != EINVAL) {
@@ -956,20 +1001,8 @@ void *QCameraStream::dataProcRoutine(void *data)
         camera_cmd_type_t cmd = cmdThread->getCmd();
         switch (cmd) {
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                CDBG_HIGH("%s: Do next job", __func__);
-                mm_camera_super_buf_t *frame =
-                    (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
-                    if (pme->mDataCB != NULL) {
-                        pme->mDataCB(frame, pme, pme->mUserData);
-                    } else {
-                        // no data cb routine, return buf here
-                        pme->bufDone(frame->bufs[0]->buf_idx);
-                        free(frame);
-                    }
-                }
-            }
+            CDBG_HIGH("%s: Do next job", __func__);
+            pme->processDataQ();
             break;
         case CAMERA_CMD_TYPE_EXIT:
             CDBG_HIGH("%s: Exit", __func__);
@@ -985,6 +1018,32 @@ void *QCameraStream::dataProcRoutine(void *data)
     return NULL;
 }
 
+/*===========================================================================
+ * FUNCTION   : processDataQ
+ *
+ * DESCRIPTION: hand every frame queued in mDataQ to the stream's data
+ *              callback. Runs on the stream thread.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStream::processDataQ()
+{
+    mm_camera_super_buf_t *frame =
+        (mm_camera_super_buf_t *)mDataQ.dequeue();
+    while (NULL != frame) {
+        if (mDataCB != NULL) {
+            mDataCB(frame, this, mUserData);
+        } else {
+            // no data cb routine, return buf here
+            bufDone(frame->bufs[0]->buf_idx);
+            free(frame);
+        }
+        frame = (mm_camera_super_buf_t *)mDataQ.dequeue();
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : bufDone
  *
@@ -2165,6 +2224,7 @@ int32_t QCameraStream::configStream()
     stream_config.stream_cb = dataNotifyCB;
     stream_config.padding_info = mPaddingInfo;
     stream_config.userdata = this;
+    stream_config.cb_batch = MM_CAMERA_MAX_CB_BATCH;
     rc = mCamOps->config_stream(mCamHandle,
                 mChannelHandle, mHandle, &stream_config);
     if (rc < 0) {
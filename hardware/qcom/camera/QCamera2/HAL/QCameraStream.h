@@ -32,6 +32,7 @@
 
 #include <hardware/camera.h>
 #include "QCameraCmdThread.h"
+#include "QCameraRingQueue.h"
 #include "QCameraMem.h"
 #include "QCameraAllocator.h"
 
@@ -119,6 +120,8 @@ public:
     void cond_signal();
 
 private:
+    void processDataQ();
+
     uint32_t mCamHandle;
     uint32_t mChannelHandle;
     uint32_t mHandle; // stream handle from mm-camera-interface
@@ -132,7 +135,7 @@ private:
     stream_cb_routine mDataCB;
     void *mUserData;
 
-    QCameraQueue     mDataQ;
+    QCameraRingQueue mDataQ;
     QCameraCmdThread mProcTh; // thread for dataCB
 
     QCameraHeapMemory *mStreamInfoBuf;
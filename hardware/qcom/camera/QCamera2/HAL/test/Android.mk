@@ -0,0 +1,24 @@
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+# Parameter round trip benchmark: qcamera-params-bench
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_SRC_FILES := \
+        QCameraParamsBench.cpp \
+        ../../util/QCameraParamDiff.cpp
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libcamera_client
+
+LOCAL_MODULE := qcamera-params-bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+include $(BUILD_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
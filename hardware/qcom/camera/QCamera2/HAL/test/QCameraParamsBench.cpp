@@ -0,0 +1,209 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+/* Measures the HAL1 getParameters/setParameters string round trip:
+ * flatten() with and without the QCameraParameters cache, unflatten(), and
+ * change detection of the new setting by per-key compare (what every setter in
+ * QCameraParameters::updateParameters used to do) versus QCameraParamDiff.
+ * Each setParameters changes one key, as an app adjusting zoom does.
+ *
+ * usage: qcamera-params-bench [-n iterations] [-k keys]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <camera/CameraParameters.h>
+#include "QCameraParamDiff.h"
+
+using namespace android;
+using namespace qcamera;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void count_changed(const char *, size_t, void *user_data)
+{
+    (*(uint32_t *)user_data)++;
+}
+
+static void report(const char *name, uint64_t total_ns, uint32_t n)
+{
+    printf("%-28s %9.2f us/call\n", name, (double)total_ns / n / 1000.0);
+}
+
+/* Roughly the size and shape of a QCameraParameters setting */
+static void fill_params(CameraParameters &params, uint32_t num_keys)
+{
+    char key[32];
+    char value[64];
+
+    params.set(CameraParameters::KEY_ZOOM, 0);
+    params.set(CameraParameters::KEY_PREVIEW_SIZE, "1920x1080");
+    params.set(CameraParameters::KEY_FOCUS_MODE, "continuous-picture");
+    for (uint32_t i = 0; i < num_keys; i++) {
+        snprintf(key, sizeof(key), "vendor-key-%03u", i);
+        if (i % 4 == 0) {
+            snprintf(value, sizeof(value),
+                    "auto,off,on,torch,red-eye,value-%u", i);
+        } else {
+            snprintf(value, sizeof(value), "%u", i * 7);
+        }
+        params.set(key, value);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = 2000;
+    uint32_t num_keys = 150;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:k:")) != -1) {
+        switch (c) {
+        case 'n':
+            iterations = (uint32_t)atoi(optarg);
+            break;
+        case 'k':
+            num_keys = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-k keys]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    CameraParameters hal;
+    fill_params(hal, num_keys);
+    String8 flat = hal.flatten();
+    printf("keys %u, flattened %zu bytes, iterations %u\n",
+            num_keys + 3, flat.length(), iterations);
+
+    // getParameters after every setParameters: nothing cached
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        hal.set(CameraParameters::KEY_ZOOM, (int)(i % 30) + 1);
+        uint64_t start = now_ns();
+        String8 str = hal.flatten();
+        char *out = strdup(str.string());
+        total += now_ns() - start;
+        free(out);
+    }
+    report("getParameters (rebuild)", total, iterations);
+
+    // Repeated getParameters without changes hit the cache, which
+    // QCameraParameters keeps as a String8 next to the parameters
+    String8 cached = hal.flatten();
+    total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        String8 str = cached;
+        char *out = strdup(str.string());
+        total += now_ns() - start;
+        free(out);
+    }
+    report("getParameters (cached)", total, iterations);
+
+    // App side: edit one value of the string it got back
+    CameraParameters app(hal.flatten());
+    String8 *settings = new String8[iterations];
+    for (uint32_t i = 0; i < iterations; i++) {
+        app.set(CameraParameters::KEY_ZOOM, (int)(i % 30));
+        settings[i] = app.flatten();
+    }
+
+    total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        CameraParameters params(settings[i]);
+        total += now_ns() - start;
+    }
+    report("setParameters unflatten", total, iterations);
+
+    // Change detection, key by key through the maps
+    CameraParameters incoming(settings[iterations / 2]);
+    CameraParameters keys(hal.flatten());
+    String8 keyList = keys.flatten();
+    Vector<String8> keyNames;
+    const char *p = keyList.string();
+    while (*p != '\0') {
+        const char *eq = strchr(p, '=');
+        if (eq == NULL) break;
+        keyNames.push_back(String8(p, (size_t)(eq - p)));
+        p = strchr(eq, ';');
+        if (p == NULL) break;
+        p++;
+    }
+    uint32_t changed = 0;
+    total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        changed = 0;
+        for (size_t k = 0; k < keyNames.size(); k++) {
+            const char *next = incoming.get(keyNames[k].string());
+            const char *cur = hal.get(keyNames[k].string());
+            if (next != NULL && (cur == NULL || strcmp(next, cur) != 0)) {
+                changed++;
+            }
+        }
+        total += now_ns() - start;
+    }
+    report("change detect (per key)", total, iterations);
+    printf("%-28s %9u\n", "  changed keys", changed);
+
+    total = 0;
+    String8 current = hal.flatten();
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        changed = 0;
+        bool ok = QCameraParamDiff::diff(current.string(),
+                settings[iterations / 2].string(), count_changed, &changed);
+        total += now_ns() - start;
+        if (!ok) {
+            fprintf(stderr, "key sequences differ\n");
+            delete[] settings;
+            return 1;
+        }
+    }
+    report("change detect (diff)", total, iterations);
+    printf("%-28s %9u\n", "  changed keys", changed);
+
+    delete[] settings;
+    return 0;
+}
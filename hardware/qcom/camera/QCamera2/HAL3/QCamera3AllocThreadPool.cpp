@@ -0,0 +1,207 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_TAG "QCamera3AllocThreadPool"
+
+#include <stdio.h>
+#include <utils/Log.h>
+#include <utils/Errors.h>
+#include "QCamera3AllocThreadPool.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCamera3AllocThreadPool
+ *
+ * DESCRIPTION: constructor of QCamera3AllocThreadPool. No thread is started
+ *              before init
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3AllocThreadPool::QCamera3AllocThreadPool() :
+        mNumThreads(0),
+        mExit(false)
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mCond, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3AllocThreadPool
+ *
+ * DESCRIPTION: deconstructor of QCamera3AllocThreadPool
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3AllocThreadPool::~QCamera3AllocThreadPool()
+{
+    deinit();
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: start the worker threads. Calling it on a running pool is a
+ *              no-op
+ *
+ * PARAMETERS :
+ *   @numThreads : number of workers, capped to QCAMERA3_ALLOC_MAX_THREADS.
+ *                 0 leaves the pool disabled
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3AllocThreadPool::init(uint32_t numThreads)
+{
+    char name[16];
+
+    if (mNumThreads > 0) {
+        return NO_ERROR;
+    }
+    if (numThreads > QCAMERA3_ALLOC_MAX_THREADS) {
+        numThreads = QCAMERA3_ALLOC_MAX_THREADS;
+    }
+
+    mExit = false;
+    for (uint32_t i = 0; i < numThreads; i++) {
+        if (pthread_create(&mThreads[i], NULL, workerRoutine, this) != 0) {
+            ALOGE("%s: failed to start worker %u", __func__, i);
+            break;
+        }
+        snprintf(name, sizeof(name), "CAM_bufAlloc%u", i);
+        pthread_setname_np(mThreads[i], name);
+        mNumThreads++;
+    }
+
+    if (numThreads > 0 && mNumThreads == 0) {
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinit
+ *
+ * DESCRIPTION: run the jobs still queued and stop the worker threads
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3AllocThreadPool::deinit()
+{
+    if (mNumThreads == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mExit = true;
+    pthread_cond_broadcast(&mCond);
+    pthread_mutex_unlock(&mLock);
+
+    for (uint32_t i = 0; i < mNumThreads; i++) {
+        pthread_join(mThreads[i], NULL);
+    }
+    mNumThreads = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : submit
+ *
+ * DESCRIPTION: queue a job for the next idle worker
+ *
+ * PARAMETERS :
+ *   @fn      : job function
+ *   @data    : job data
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              NO_INIT   -- pool is not running, caller has to run the job
+ *==========================================================================*/
+int32_t QCamera3AllocThreadPool::submit(qcamera3_alloc_job_fn fn, void *data)
+{
+    alloc_job_t job;
+
+    if (mNumThreads == 0) {
+        return NO_INIT;
+    }
+
+    job.fn = fn;
+    job.data = data;
+    pthread_mutex_lock(&mLock);
+    mJobs.push_back(job);
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mLock);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: worker thread body. Queued jobs are drained before exiting
+ *
+ * PARAMETERS :
+ *   @data    : pool object
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCamera3AllocThreadPool::workerRoutine(void *data)
+{
+    QCamera3AllocThreadPool *pme = (QCamera3AllocThreadPool *)data;
+
+    pthread_mutex_lock(&pme->mLock);
+    while (true) {
+        while (pme->mJobs.empty() && !pme->mExit) {
+            pthread_cond_wait(&pme->mCond, &pme->mLock);
+        }
+        if (pme->mJobs.empty()) {
+            break;
+        }
+        alloc_job_t job = *pme->mJobs.begin();
+        pme->mJobs.erase(pme->mJobs.begin());
+        pthread_mutex_unlock(&pme->mLock);
+
+        job.fn(job.data);
+
+        pthread_mutex_lock(&pme->mLock);
+    }
+    pthread_mutex_unlock(&pme->mLock);
+    return NULL;
+}
+
+}; // namespace qcamera
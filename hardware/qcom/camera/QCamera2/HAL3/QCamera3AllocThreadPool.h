@@ -0,0 +1,74 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA3_ALLOC_THREAD_POOL_H__
+#define __QCAMERA3_ALLOC_THREAD_POOL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/List.h>
+
+namespace qcamera {
+
+#define QCAMERA3_ALLOC_MAX_THREADS 4
+
+typedef void (*qcamera3_alloc_job_fn)(void *data);
+
+/* Small pool of worker threads that allocate and map stream buffers off
+ * the framework thread. Jobs run in submission order, so buffers needed
+ * first are ready first. Completion is tracked by the submitter. */
+class QCamera3AllocThreadPool {
+public:
+    QCamera3AllocThreadPool();
+    virtual ~QCamera3AllocThreadPool();
+
+    int32_t init(uint32_t numThreads);
+    void deinit();
+    int32_t submit(qcamera3_alloc_job_fn fn, void *data);
+    uint32_t getNumThreads() const {return mNumThreads;}
+
+private:
+    typedef struct {
+        qcamera3_alloc_job_fn fn;
+        void *data;
+    } alloc_job_t;
+
+    static void *workerRoutine(void *data);
+
+    android::List<alloc_job_t> mJobs;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    pthread_t mThreads[QCAMERA3_ALLOC_MAX_THREADS];
+    uint32_t mNumThreads;
+    bool mExit;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3_ALLOC_THREAD_POOL_H__ */
@@ -42,8 +42,10 @@
 #include <utils/Errors.h>
 #include <utils/Trace.h>
 #include <cutils/properties.h>
+#include <camera/CameraFrameTrace.h>
 #include "QCamera3Channel.h"
 #include "QCamera3HWI.h"
+#include "QCameraDumpService.h"
 
 using namespace android;
 
@@ -503,6 +505,103 @@ void QCamera3Channel::streamCbRoutine(mm_camera_super_buf_t *super_frame,
     channel->streamCbRoutine(super_frame, stream);
 }
 
+/*===========================================================================
+ * FUNCTION   : prepareStreamBufs
+ *
+ * DESCRIPTION: allocate and map the buffers of all streams of the channel
+ *              on a worker pool ahead of start. Only for channels backed by
+ *              internal heap memory
+ *
+ * PARAMETERS :
+ *   @pool    : worker pool
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, buffers are allocated on start
+ *==========================================================================*/
+int32_t QCamera3Channel::prepareStreamBufs(QCamera3AllocThreadPool *pool)
+{
+    int32_t rc = NO_ERROR;
+
+    if (m_bIsActive) {
+        return INVALID_OPERATION;
+    }
+    for (uint32_t i = 0; i < m_numStreams; i++) {
+        if (mStreams[i] != NULL) {
+            rc |= mStreams[i]->prepareBufs(pool);
+        }
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePreparedStreamBufs
+ *
+ * DESCRIPTION: wait for the pending prepareStreamBufs of the channel and
+ *              release the buffers that were not handed over on start.
+ *              Must run before the channel frees its stream memory
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Channel::releasePreparedStreamBufs()
+{
+    for (uint32_t i = 0; i < m_numStreams; i++) {
+        if (mStreams[i] != NULL) {
+            mStreams[i]->releasePreparedBufs();
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpBufStats
+ *
+ * DESCRIPTION: print buffer allocation and map timings of the channel
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to print to
+ *   @name    : channel name
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Channel::dumpBufStats(int fd, const char *name)
+{
+    for (uint32_t i = 0; i < m_numStreams; i++) {
+        int64_t allocTime, mapTime;
+        uint8_t numBufs;
+        bool prepared;
+
+        if (mStreams[i] == NULL) {
+            continue;
+        }
+        mStreams[i]->getBufStats(allocTime, mapTime, numBufs, prepared);
+        dprintf(fd, " %-9s | %8x | %4u | %8.2f | %8.2f | %s\n",
+                name, getStreamTypeMask(), numBufs,
+                (double)allocTime / 1000000.0, (double)mapTime / 1000000.0,
+                prepared ? "worker" : "start");
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : getIonPool
+ *
+ * DESCRIPTION: ion pool of the session internal stream buffers are
+ *              recycled through
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : pointer to the ion pool, NULL if there is no HAL object
+ *==========================================================================*/
+QCameraIonPool *QCamera3Channel::getIonPool()
+{
+    QCamera3HardwareInterface *hal_obj = (QCamera3HardwareInterface *)mUserData;
+    if (NULL == hal_obj) {
+        return NULL;
+    }
+    return hal_obj->getIonPool();
+}
+
 /*===========================================================================
  * FUNCTION   : dumpYUV
  *
@@ -529,14 +628,9 @@ void QCamera3Channel::dumpYUV(mm_camera_buf_def_t *frame, cam_dimension_t dim,
     snprintf(buf, sizeof(buf), QCAMERA_DUMP_FRM_LOCATION"%d_%d_%d_%dx%d.yuv",
             name, counter, frame->frame_idx, dim.width, dim.height);
     counter++;
-    int file_fd = open(buf, O_RDWR| O_CREAT, 0644);
-    if (file_fd >= 0) {
-        ssize_t written_len = write(file_fd, frame->buffer, offset.frame_len);
-        ALOGE("%s: written number of bytes %d", __func__, written_len);
-        close(file_fd);
-    } else {
-        ALOGE("%s: failed to open file to dump image", __func__);
-    }
+    qcamera_dump_seg_t seg = { frame->buffer, offset.frame_len, 0, 1 };
+    QCameraDumpService::getInstance()->submit(QCAMERA_DUMP_STREAM_SNAPSHOT,
+            buf, &seg, 1);
 }
 
 /* QCamera3ProcessingChannel methods */
@@ -795,7 +889,7 @@ int32_t QCamera3ProcessingChannel::request(buffer_handle_t *buffer,
             free(src_frame);
             return rc;
         }
-        memcpy(meta_buf.buffer, metadata, sizeof(metadata_buffer_t));
+        copy_metadata_buffer((metadata_buffer_t *)meta_buf.buffer, metadata);
         src_frame->metadata_buffer = meta_buf;
         src_frame->reproc_config = reproc_cfg;
         src_frame->output_buffer = buffer;
@@ -1480,6 +1574,8 @@ QCamera3MetadataChannel::~QCamera3MetadataChannel()
     if (m_bIsActive)
         stop();
 
+    releasePreparedStreamBufs();
+
     if (mMemory) {
         mMemory->deallocate();
         delete mMemory;
@@ -1549,7 +1645,7 @@ QCamera3Memory* QCamera3MetadataChannel::getStreamBufs(uint32_t len)
                 sizeof(metadata_buffer_t));
         return NULL;
     }
-    mMemory = new QCamera3HeapMemory();
+    mMemory = new QCamera3HeapMemory(getIonPool());
     if (!mMemory) {
         ALOGE("%s: unable to create metadata memory", __func__);
         return NULL;
@@ -1652,14 +1748,9 @@ void QCamera3RawChannel::dumpRawSnapshot(mm_camera_buf_def_t *frame)
        snprintf(buf, sizeof(buf), QCAMERA_DUMP_FRM_LOCATION"r_%d_%dx%d.raw",
                 frame->frame_idx, offset.mp[0].stride, offset.mp[0].scanline);
 
-       int file_fd = open(buf, O_RDWR| O_CREAT, 0644);
-       if (file_fd >= 0) {
-          ssize_t written_len = write(file_fd, frame->buffer, frame->frame_len);
-          ALOGE("%s: written number of bytes %zd", __func__, written_len);
-          close(file_fd);
-       } else {
-          ALOGE("%s: failed to open file to dump image", __func__);
-       }
+       qcamera_dump_seg_t seg = { frame->buffer, frame->frame_len, 0, 1 };
+       QCameraDumpService::getInstance()->submit(QCAMERA_DUMP_STREAM_RAW,
+               buf, &seg, 1);
    } else {
        ALOGE("%s: Could not find stream", __func__);
    }
@@ -1820,6 +1911,17 @@ QCamera3RawDumpChannel::QCamera3RawDumpChannel(uint32_t cam_handle,
 
 QCamera3RawDumpChannel::~QCamera3RawDumpChannel()
 {
+    if (m_bIsActive)
+        stop();
+
+    // buffers may have been prepared without the channel ever starting.
+    // Unmap them while the memory and this object are still intact
+    releasePreparedStreamBufs();
+    if (mMemory) {
+        mMemory->deallocate();
+        delete mMemory;
+        mMemory = NULL;
+    }
 }
 
 /*===========================================================================
@@ -1862,15 +1964,9 @@ void QCamera3RawDumpChannel::dumpRawSnapshot(mm_camera_buf_def_t *frame)
                     timeinfo->tm_min, timeinfo->tm_sec,tv.tv_usec,
                     frame->frame_idx, dim.width, dim.height);
 
-            int file_fd = open(buf, O_RDWR| O_CREAT, 0777);
-            if (file_fd >= 0) {
-                ssize_t written_len =
-                        write(file_fd, frame->buffer, offset.frame_len);
-                CDBG("%s: written number of bytes %zd", __func__, written_len);
-                close(file_fd);
-            } else {
-                ALOGE("%s: failed to open file to dump image", __func__);
-            }
+            qcamera_dump_seg_t seg = { frame->buffer, offset.frame_len, 0, 1 };
+            QCameraDumpService::getInstance()->submit(QCAMERA_DUMP_STREAM_RAW,
+                    buf, &seg, 1);
         } else {
             ALOGE("%s: localtime_r() error", __func__);
         }
@@ -1922,7 +2018,7 @@ void QCamera3RawDumpChannel::streamCbRoutine(mm_camera_super_buf_t *super_frame,
 QCamera3Memory* QCamera3RawDumpChannel::getStreamBufs(uint32_t len)
 {
     int rc;
-    mMemory = new QCamera3HeapMemory();
+    mMemory = new QCamera3HeapMemory(getIonPool());
 
     if (!mMemory) {
         ALOGE("%s: unable to create heap memory", __func__);
@@ -2232,6 +2328,9 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
             resultBuffer =
                     (buffer_handle_t *)obj->mMemory.getBufferHandle(bufIdx);
             int32_t resultFrameNumber = obj->mMemory.getFrameNumber(bufIdx);
+            camera_frame_trace(CAMERA_FRAME_TRACE_JPEG_DONE,
+                    ((QCamera3HardwareInterface *)obj->mUserData)->getCameraId(),
+                    (uint32_t)resultFrameNumber, (uint32_t)status);
             int32_t rc = obj->mMemory.unregisterBuffer(bufIdx);
             if (NO_ERROR != rc) {
                 ALOGE("%s: Error %d unregistering stream buffer %d",
@@ -2272,6 +2371,11 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
                 ALOGE("%s: Snapshot buffer not found!", __func__);
             }
 
+            obj->updateJpegStats(job->jpeg_settings,
+                    (JPEG_JOB_STATUS_DONE == status) ?
+                    p_output->buf_filled_len : 0,
+                    CAMERA3_BUFFER_STATUS_OK == resultStatus);
+
             CDBG("%s: Issue Callback", __func__);
             obj->mChannelCB(NULL,
                     &result,
@@ -2295,6 +2399,63 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : updateJpegStats
+ *
+ * DESCRIPTION: account the capture request to blob return latency of a
+ *              finished jpeg job
+ *
+ * PARAMETERS :
+ *   @settings : jpeg settings of the job, carrying the request time
+ *   @jpegSize : size of the encoded bitstream, 0 on failure
+ *   @success  : whether the blob is returned with OK status
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3PicChannel::updateJpegStats(jpeg_settings_t *settings,
+        size_t jpegSize, bool success)
+{
+    Mutex::Autolock lock(mJpegStatsLock);
+    if (!success) {
+        mJpegErrors++;
+        return;
+    }
+    if ((NULL == settings) || (0 == settings->request_time)) {
+        return;
+    }
+    nsecs_t latency = systemTime(CLOCK_MONOTONIC) - settings->request_time;
+    mJpegCount++;
+    mJpegLatencyTotal += latency;
+    mJpegLatencyLast = latency;
+    if (latency > mJpegLatencyMax) {
+        mJpegLatencyMax = latency;
+    }
+    mJpegLastSize = jpegSize;
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpJpegStats
+ *
+ * DESCRIPTION: print capture request to blob return latency of the channel
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to print to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3PicChannel::dumpJpegStats(int fd)
+{
+    Mutex::Autolock lock(mJpegStatsLock);
+    dprintf(fd, " Blobs %u, errors %u, last %zu bytes\n",
+            mJpegCount, mJpegErrors, mJpegLastSize);
+    if (mJpegCount > 0) {
+        dprintf(fd, " Capture to blob ms: avg %.2f max %.2f last %.2f\n",
+                (double)(mJpegLatencyTotal / mJpegCount) / 1000000.0,
+                (double)mJpegLatencyMax / 1000000.0,
+                (double)mJpegLatencyLast / 1000000.0);
+    }
+}
+
 QCamera3PicChannel::QCamera3PicChannel(uint32_t cam_handle,
                     mm_camera_ops_t *cam_ops,
                     channel_cb_routine cb_routine,
@@ -2310,7 +2471,13 @@ QCamera3PicChannel::QCamera3PicChannel(uint32_t cam_handle,
                                 postprocess_mask, metadataChannel, numBuffers),
                         mNumSnapshotBufs(0),
                         mCurrentBufIndex(-1),
-                        mYuvMemory(NULL)
+                        mYuvMemory(NULL),
+                        mJpegCount(0),
+                        mJpegErrors(0),
+                        mJpegLatencyTotal(0),
+                        mJpegLatencyMax(0),
+                        mJpegLatencyLast(0),
+                        mJpegLastSize(0)
 {
     QCamera3HardwareInterface* hal_obj = (QCamera3HardwareInterface*)mUserData;
     m_max_pic_dim = hal_obj->calcMaxJpegDim();
@@ -2327,6 +2494,17 @@ QCamera3PicChannel::QCamera3PicChannel(uint32_t cam_handle,
 
 QCamera3PicChannel::~QCamera3PicChannel()
 {
+    if (m_bIsActive)
+        stop();
+
+    // buffers may have been prepared without the channel ever starting.
+    // Unmap them while the memory and this object are still intact
+    releasePreparedStreamBufs();
+    if (mYuvMemory) {
+        mYuvMemory->deallocate();
+        delete mYuvMemory;
+        mYuvMemory = NULL;
+    }
 }
 
 int32_t QCamera3PicChannel::initialize(cam_is_type_t isType)
@@ -2514,7 +2692,7 @@ int32_t QCamera3PicChannel::request(buffer_handle_t *buffer,
             free(src_frame);
             return rc;
         }
-        memcpy(meta_buf.buffer, metadata, sizeof(metadata_buffer_t));
+        copy_metadata_buffer((metadata_buffer_t *)meta_buf.buffer, metadata);
         src_frame->metadata_buffer = meta_buf;
         src_frame->reproc_config = reproc_cfg;
         src_frame->output_buffer = NULL;
@@ -2642,7 +2820,7 @@ QCamera3Memory* QCamera3PicChannel::getStreamBufs(uint32_t len)
 {
     int rc = 0;
 
-    mYuvMemory = new QCamera3HeapMemory();
+    mYuvMemory = new QCamera3HeapMemory(getIonPool());
     if (!mYuvMemory) {
         ALOGE("%s: unable to create metadata memory", __func__);
         return NULL;
@@ -2681,6 +2859,7 @@ int32_t QCamera3PicChannel::queueJpegSetting(uint32_t index, metadata_buffer_t *
     memset(settings, 0, sizeof(jpeg_settings_t));
 
     settings->out_buf_index = index;
+    settings->request_time = systemTime(CLOCK_MONOTONIC);
 
     settings->jpeg_orientation = 0;
     IF_META_AVAILABLE(int32_t, orientation, CAM_INTF_META_JPEG_ORIENTATION, metadata) {
@@ -2980,7 +3159,7 @@ QCamera3Memory* QCamera3ReprocessChannel::getStreamBufs(uint32_t len)
 {
     int rc = 0;
     if (mReprocessType == REPROCESS_TYPE_JPEG) {
-        mMemory = new QCamera3HeapMemory();
+        mMemory = new QCamera3HeapMemory(getIonPool());
         if (!mMemory) {
             ALOGE("%s: unable to create reproc memory", __func__);
             return NULL;
@@ -3635,6 +3814,8 @@ QCamera3SupportChannel::~QCamera3SupportChannel()
     if (m_bIsActive)
         stop();
 
+    releasePreparedStreamBufs();
+
     if (mMemory) {
         mMemory->deallocate();
         delete mMemory;
@@ -3687,7 +3868,7 @@ void QCamera3SupportChannel::streamCbRoutine(
 QCamera3Memory* QCamera3SupportChannel::getStreamBufs(uint32_t len)
 {
     int rc;
-    mMemory = new QCamera3HeapMemory();
+    mMemory = new QCamera3HeapMemory(getIonPool());
     if (!mMemory) {
         ALOGE("%s: unable to create heap memory", __func__);
         return NULL;
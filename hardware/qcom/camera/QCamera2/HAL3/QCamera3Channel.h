@@ -96,6 +96,9 @@ public:
                 QCamera3Stream *stream, void *userdata);
     void dumpYUV(mm_camera_buf_def_t *frame, cam_dimension_t dim,
             cam_frame_len_offset_t offset, uint8_t name);
+    int32_t prepareStreamBufs(QCamera3AllocThreadPool *pool);
+    void releasePreparedStreamBufs();
+    void dumpBufStats(int fd, const char *name);
 
     void *mUserData;
     cam_padding_info_t *mPaddingInfo;
@@ -114,6 +117,7 @@ protected:
                       cam_is_type_t isType,
                       uint32_t batchSize = 0);
     int32_t allocateStreamInfoBuf(camera3_stream_t *stream);
+    QCameraIonPool *getIonPool();
 
     uint32_t m_camHandle;
     mm_camera_ops_t *m_camOps;
@@ -400,9 +404,12 @@ public:
             void *userdata);
     static void dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
             void *userdata);
+    void dumpJpegStats(int fd);
 
 private:
     int32_t queueJpegSetting(uint32_t out_buf_index, metadata_buffer_t *metadata);
+    void updateJpegStats(jpeg_settings_t *settings, size_t jpegSize,
+            bool success);
 
 public:
     cam_dimension_t m_max_pic_dim;
@@ -415,6 +422,14 @@ private:
     // Keep a list of free buffers
     Mutex mFreeBuffersLock;
     List<uint32_t> mFreeBufferList;
+    // capture request to blob buffer return latency
+    Mutex mJpegStatsLock;
+    uint32_t mJpegCount;
+    uint32_t mJpegErrors;
+    nsecs_t mJpegLatencyTotal;
+    nsecs_t mJpegLatencyMax;
+    nsecs_t mJpegLatencyLast;
+    size_t mJpegLastSize;
 };
 
 // reprocess channel class
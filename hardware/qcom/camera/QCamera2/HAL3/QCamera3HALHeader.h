@@ -68,6 +68,7 @@ class QCamera3ProcessingChannel;
         uint8_t gps_coordinates_valid;
         double gps_coordinates[3];
         char gps_processing_method[GPS_PROCESSING_METHOD_SIZE];
+        int64_t request_time;   // CLOCK_MONOTONIC ns the blob was requested at
     } jpeg_settings_t;
 
     typedef struct {
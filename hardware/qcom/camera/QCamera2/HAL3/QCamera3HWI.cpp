@@ -35,6 +35,7 @@
 #include <cutils/properties.h>
 #include <hardware/camera3.h>
 #include <camera/CameraMetadata.h>
+#include <camera/CameraFrameTrace.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -49,6 +50,7 @@
 #include "QCamera3Channel.h"
 #include "QCamera3PostProc.h"
 #include "QCamera3VendorTags.h"
+#include "QCameraDumpService.h"
 
 using namespace android;
 
@@ -77,6 +79,9 @@ namespace qcamera {
 #define DEFAULT_VIDEO_FPS      (30.0)
 #define MAX_HFR_BATCH_SIZE     (4)
 #define REGIONS_TUPLE_COUNT    5
+/* Initial result metadata capacity, grown to the largest result seen */
+#define RESULT_META_ENTRY_HINT (96)
+#define RESULT_META_DATA_HINT  (4096)
 
 #define METADATA_MAP_SIZE(MAP) (sizeof(MAP)/sizeof(MAP[0]))
 
@@ -318,8 +323,21 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       mFirstConfiguration(true),
       mFlush(false),
       mParamHeap(NULL),
+      mFenceWaiter(fenceSignaledCb, releaseDeferredRequest, this),
       mParameters(NULL),
       mPrevParameters(NULL),
+      mCachedSettings(NULL),
+      mCachedSettingsSize(0),
+      mCachedSettingsAlloc(0),
+      mCachedSnapshotStreamId(0),
+      mSettingsCacheValid(false),
+      mCachedHalSettings(NULL),
+      mCachedSettingsInParms(false),
+      mCachedSettingsSent(false),
+      mSettingsCacheHits(0),
+      mSettingsCacheMisses(0),
+      mResultEntryHint(RESULT_META_ENTRY_HINT),
+      mResultDataHint(RESULT_META_DATA_HINT),
       m_bIsVideo(false),
       m_bIs4KVideo(false),
       m_bEisSupportedSize(false),
@@ -345,6 +363,7 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
     mCameraDevice.ops = &mCameraOps;
     mCameraDevice.priv = this;
     gCamCapability[cameraId]->version = CAM_HAL_V3;
+    memset(&mCachedStreamID, 0, sizeof(mCachedStreamID));
     // TODO: hardcode for now until mctl add support for min_num_pp_bufs
     //TBD - To see if this hardcoding is needed. Check by printing if this is filled by mctl to 3
     gCamCapability[cameraId]->min_num_pp_bufs = 3;
@@ -382,6 +401,9 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
 QCamera3HardwareInterface::~QCamera3HardwareInterface()
 {
     CDBG("%s: E", __func__);
+    /* Drop buffers still waiting on their fence before the channels go */
+    mFenceWaiter.deinit();
+
     /* We need to stop all streams before deleting any stream */
 
 
@@ -453,6 +475,8 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
         deinitParameters();
     }
 
+    mAllocPool.deinit();
+
     if (mCameraOpened)
         closeCamera();
 
@@ -578,6 +602,11 @@ int QCamera3HardwareInterface::openCamera()
 
     mCameraOpened = true;
 
+    /* Without the waiter, requests fall back to waiting on fences inline */
+    if (mFenceWaiter.init("CAM_fenceWait") != NO_ERROR) {
+        ALOGE("%s: Failed to start fence waiter", __func__);
+    }
+
     rc = mCameraHandle->ops->register_event_notify(mCameraHandle->camera_handle,
             camEvtHandle, (void *)this);
 
@@ -963,6 +992,9 @@ int QCamera3HardwareInterface::configureStreams(
     mOpMode = streamList->operation_mode;
     CDBG("%s: mOpMode: %d", __func__, mOpMode);
 
+    /* Channels may be deleted below, drop buffers waiting to be queued */
+    mFenceWaiter.cancelAll();
+
     /* first invalidate all the steams in the mStreamList
      * if they appear again, they will be validated */
     for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
@@ -990,6 +1022,7 @@ int QCamera3HardwareInterface::configureStreams(
     }
 
     pthread_mutex_lock(&mMutex);
+    mDeferredBufCnt.clear();
 
     /* Check whether we have video stream */
     m_bIs4KVideo = false;
@@ -1299,6 +1332,11 @@ int QCamera3HardwareInterface::configureStreams(
         }
     }
 
+    /* Translation depends on the stream configuration */
+    invalidateSettingsCache();
+    mResultEntryHint = RESULT_META_ENTRY_HINT;
+    mResultDataHint = RESULT_META_DATA_HINT;
+
     bool isRawStreamRequested = false;
     memset(&mStreamConfigInfo, 0, sizeof(cam_stream_size_info_t));
     /* Allocate channel objects for the requested streams */
@@ -2062,6 +2100,8 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
         urgent_frame_number_valid = *p_urgent_frame_number_valid;
         urgent_frame_number = *p_urgent_frame_number;
     }
+    camera_frame_trace(CAMERA_FRAME_TRACE_SOF, mCameraId,
+            metadata_buf->bufs[0]->frame_idx, 0);
     //Partial result on process_capture_result for timestamp
     if (urgent_frame_number_valid) {
         CDBG("%s: valid urgent frame_number = %u, capture_time = %lld",
@@ -2116,6 +2156,8 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
     }
     CDBG("%s: valid frame_number = %u, capture_time = %lld", __func__,
             frame_number, capture_time);
+    camera_frame_trace(CAMERA_FRAME_TRACE_FRAME_ID_MAP, mCameraId, frame_number,
+            metadata_buf->bufs[0]->frame_idx);
 
     for (List<PendingRequestInfo>::iterator i = mPendingRequestsList.begin();
         i != mPendingRequestsList.end() && i->frame_number <= frame_number;) {
@@ -2484,6 +2526,166 @@ void QCamera3HardwareInterface::handleBufferWithLock(
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : deferBufferRequest
+ *
+ * DESCRIPTION: Hand an output buffer whose acquire fence has not signaled,
+ *              or that follows such a buffer on its stream, to the fence
+ *              waiter. The buffer is queued to its channel from
+ *              handleDeferredBufferRequest, after the earlier deferred
+ *              buffers of its stream. Called with mMutex held.
+ *
+ * PARAMETERS : @channel: channel of the output stream
+ *              @output: output buffer of the request
+ *              @frameNumber: frame number of the request
+ *              @acquireFenceFd: fence fd or -1, ownership is taken
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::deferBufferRequest(QCamera3Channel *channel,
+        const camera3_stream_buffer_t &output, uint32_t frameNumber,
+        int acquireFenceFd)
+{
+    sp<Fence> acquireFence = new Fence(acquireFenceFd);
+    DeferredBufferRequest *req =
+            (DeferredBufferRequest *)malloc(sizeof(DeferredBufferRequest));
+    if (req != NULL) {
+        req->channel = channel;
+        req->stream = output.stream;
+        req->buffer = output.buffer;
+        req->frame_number = frameNumber;
+        if (mFenceWaiter.waitAsync(acquireFence->dup(), req,
+                (uint64_t)(uintptr_t)output.stream) == NO_ERROR) {
+            ssize_t idx = mDeferredBufCnt.indexOfKey(output.stream);
+            if (idx < 0) {
+                mDeferredBufCnt.add(output.stream, 1);
+            } else {
+                mDeferredBufCnt.editValueAt(idx)++;
+            }
+            return NO_ERROR;
+        }
+        free(req);
+    }
+    ALOGE("%s: Failed to defer frame %u, waiting inline", __func__,
+            frameNumber);
+
+    pthread_mutex_unlock(&mMutex);
+    int32_t rc = acquireFence->wait(Fence::TIMEOUT_NEVER);
+    pthread_mutex_lock(&mMutex);
+    if (rc != OK) {
+        ALOGE("%s: fence wait failed %d", __func__, rc);
+        return rc;
+    }
+    return channel->request(output.buffer, frameNumber);
+}
+
+/*===========================================================================
+ * FUNCTION   : handleDeferredBufferRequest
+ *
+ * DESCRIPTION: Queue a deferred output buffer to its channel now that its
+ *              acquire fence signaled, or return it with an error if the
+ *              fence failed. Runs on the fence waiter thread.
+ *
+ * PARAMETERS : @status: fence status reported by the waiter
+ *              @req: deferred buffer request
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::handleDeferredBufferRequest(int32_t status,
+        DeferredBufferRequest *req)
+{
+    ATRACE_CALL();
+    int32_t rc = NO_ERROR;
+
+    pthread_mutex_lock(&mMutex);
+    ssize_t idx = mDeferredBufCnt.indexOfKey(req->stream);
+    if ((idx >= 0) && (mDeferredBufCnt.valueAt(idx) > 0)) {
+        mDeferredBufCnt.editValueAt(idx)--;
+    }
+    // flush returns every pending buffer itself
+    bool pending = false;
+    if (!mFlush) {
+        for (List<PendingBufferInfo>::iterator k =
+                mPendingBuffersMap.mPendingBufferList.begin();
+                k != mPendingBuffersMap.mPendingBufferList.end(); k++) {
+            if ((k->buffer == req->buffer) &&
+                    (k->frame_number == req->frame_number)) {
+                pending = true;
+                break;
+            }
+        }
+    }
+
+    if (pending) {
+        if (status == NO_ERROR) {
+            rc = req->channel->request(req->buffer, req->frame_number);
+        }
+        if ((status != NO_ERROR) || (rc < 0)) {
+            ALOGE("%s: Frame %u buffer %p not queued, fence status %d rc %d",
+                    __func__, req->frame_number, req->buffer, status, rc);
+            camera3_notify_msg_t notify_msg;
+            memset(&notify_msg, 0, sizeof(camera3_notify_msg_t));
+            notify_msg.type = CAMERA3_MSG_ERROR;
+            notify_msg.message.error.error_code = CAMERA3_MSG_ERROR_BUFFER;
+            notify_msg.message.error.error_stream = req->stream;
+            notify_msg.message.error.frame_number = req->frame_number;
+            mCallbackOps->notify(mCallbackOps, &notify_msg);
+
+            camera3_stream_buffer_t buffer;
+            buffer.stream = req->stream;
+            buffer.buffer = req->buffer;
+            buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+            buffer.acquire_fence = -1;
+            buffer.release_fence = -1;
+            handleBufferWithLock(&buffer, req->frame_number);
+        }
+    }
+    pthread_mutex_unlock(&mMutex);
+    free(req);
+}
+
+/*===========================================================================
+ * FUNCTION   : fenceSignaledCb
+ *
+ * DESCRIPTION: Fence waiter callback for a deferred output buffer
+ *
+ * PARAMETERS : @status: fence status
+ *              @data: deferred buffer request
+ *              @user_data: QCamera3HardwareInterface object
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::fenceSignaledCb(int32_t status, void *data,
+        void *user_data)
+{
+    QCamera3HardwareInterface *hw = (QCamera3HardwareInterface *)user_data;
+    if (hw == NULL) {
+        ALOGE("%s: Invalid hardware interface", __func__);
+        free(data);
+        return;
+    }
+    hw->handleDeferredBufferRequest(status, (DeferredBufferRequest *)data);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseDeferredRequest
+ *
+ * DESCRIPTION: Free a deferred output buffer request dropped by the fence
+ *              waiter. The buffer itself stays in mPendingBuffersMap.
+ *
+ * PARAMETERS : @data: deferred buffer request
+ *              @user_data: QCamera3HardwareInterface object
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::releaseDeferredRequest(void *data,
+        void * /*user_data*/)
+{
+    free(data);
+}
+
 /*===========================================================================
  * FUNCTION   : unblockRequestIfNecessary
  *
@@ -2532,6 +2734,57 @@ int QCamera3HardwareInterface::processCaptureRequest(
         pthread_mutex_unlock(&mMutex);
         return rc;
     }
+    camera_frame_trace(CAMERA_FRAME_TRACE_HAL_REQUEST, mCameraId,
+            request->frame_number, 0);
+
+    // Wait for the fences that can't be deferred before any state is
+    // changed. mMutex is dropped while waiting so that results and flush
+    // are not stalled, and they must not see a half built request.
+
+    // Fences still pending on buffers that are queued to their channel by
+    // mFenceWaiter. Holding the sp<Fence> closes the fd on every return path.
+    Vector<sp<Fence> > deferredFences;
+    deferredFences.insertAt(sp<Fence>(), 0, request->num_output_buffers);
+    for (size_t i = 0; i < request->num_output_buffers; i++) {
+        const camera3_stream_buffer_t& output = request->output_buffers[i];
+        sp<Fence> acquireFence = new Fence(output.acquire_fence);
+
+        // Snapshot, YUV and batched video requests consume this request's
+        // parameters when queued, so only plain stream buffers can be
+        // handed to the waiter
+        bool deferrable = (output.stream->format != HAL_PIXEL_FORMAT_BLOB) &&
+                (output.stream->format != HAL_PIXEL_FORMAT_YCbCr_420_888) &&
+                !mBatchSize && (request->input_buffer == NULL);
+        if (deferrable) {
+            // Dropped below if it turns out not to need deferring
+            deferredFences.editItemAt(i) = acquireFence;
+        } else if (acquireFence->wait(0) != OK) {
+            // The consumer still owns the buffer
+            pthread_mutex_unlock(&mMutex);
+            rc = acquireFence->wait(Fence::TIMEOUT_NEVER);
+            pthread_mutex_lock(&mMutex);
+            if (rc != OK) {
+                ALOGE("%s: fence wait failed %d", __func__, rc);
+                pthread_mutex_unlock(&mMutex);
+                return rc;
+            }
+        }
+    }
+    if (request->input_buffer != NULL) {
+        sp<Fence> acquireFence = new Fence(request->input_buffer->acquire_fence);
+
+        rc = acquireFence->wait(0);
+        if (rc != OK) {
+            pthread_mutex_unlock(&mMutex);
+            rc = acquireFence->wait(Fence::TIMEOUT_NEVER);
+            pthread_mutex_lock(&mMutex);
+        }
+        if (rc != OK) {
+            ALOGE("%s: input buffer fence wait failed %d", __func__, rc);
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
+    }
 
     meta = request->settings;
 
@@ -2727,11 +2980,35 @@ int QCamera3HardwareInterface::processCaptureRequest(
             }
         }
 
+        /* Allocate and map the internal buffers on the worker pool, in the
+         * order the channels are started below. Each start only waits for
+         * the buffers of its own channel. Channels that fail to prepare
+         * allocate on start as before */
+        char prop[PROPERTY_VALUE_MAX];
+        property_get("persist.camera.alloc.threads", prop, "2");
+        if (mAllocPool.init((uint32_t)atoi(prop)) == NO_ERROR &&
+                mAllocPool.getNumThreads() > 0) {
+            mMetadataChannel->prepareStreamBufs(&mAllocPool);
+            if (mAnalysisChannel) {
+                mAnalysisChannel->prepareStreamBufs(&mAllocPool);
+            }
+            if (mSupportChannel) {
+                mSupportChannel->prepareStreamBufs(&mAllocPool);
+            }
+            if (mPictureChannel) {
+                mPictureChannel->prepareStreamBufs(&mAllocPool);
+            }
+            if (mRawDumpChannel) {
+                mRawDumpChannel->prepareStreamBufs(&mAllocPool);
+            }
+        }
+
         //Then start them.
         CDBG_HIGH("%s: Start META Channel", __func__);
         rc = mMetadataChannel->start();
         if (rc < 0) {
             ALOGE("%s: META channel start failed", __func__);
+            releasePreparedChannelBufs();
             pthread_mutex_unlock(&mMutex);
             return rc;
         }
@@ -2741,6 +3018,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
             if (rc < 0) {
                 ALOGE("%s: Analysis channel start failed", __func__);
                 mMetadataChannel->stop();
+                releasePreparedChannelBufs();
                 pthread_mutex_unlock(&mMutex);
                 return rc;
             }
@@ -2756,6 +3034,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 if (mAnalysisChannel) {
                     mAnalysisChannel->stop();
                 }
+                releasePreparedChannelBufs();
                 pthread_mutex_unlock(&mMutex);
                 return rc;
             }
@@ -2768,6 +3047,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
             rc = channel->start();
             if (rc < 0) {
                 ALOGE("%s: channel start failed", __func__);
+                releasePreparedChannelBufs();
                 pthread_mutex_unlock(&mMutex);
                 return rc;
             }
@@ -2792,6 +3072,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                     mAnalysisChannel->stop();
                 }
                 mMetadataChannel->stop();
+                releasePreparedChannelBufs();
                 pthread_mutex_unlock(&mMutex);
                 return rc;
             }
@@ -2831,7 +3112,6 @@ int QCamera3HardwareInterface::processCaptureRequest(
     for (size_t i = 0; i < request->num_output_buffers; i++) {
         const camera3_stream_buffer_t& output = request->output_buffers[i];
         QCamera3Channel *channel = (QCamera3Channel *)output.stream->priv;
-        sp<Fence> acquireFence = new Fence(output.acquire_fence);
 
         if (output.stream->format == HAL_PIXEL_FORMAT_BLOB) {
             //Call function to store local copy of jpeg data for encode params.
@@ -2839,11 +3119,15 @@ int QCamera3HardwareInterface::processCaptureRequest(
             snapshotStreamId = channel->getStreamID(channel->getStreamTypeMask());
         }
 
-        rc = acquireFence->wait(Fence::TIMEOUT_NEVER);
-        if (rc != OK) {
-            ALOGE("%s: fence wait failed %d", __func__, rc);
-            pthread_mutex_unlock(&mMutex);
-            return rc;
+        if (deferredFences[i] != NULL) {
+            // A buffer is deferred while an earlier buffer of its stream is
+            // still waiting on its fence, even if its own signaled
+            ssize_t deferredIdx = mDeferredBufCnt.indexOfKey(output.stream);
+            bool behindDeferred = (deferredIdx >= 0) &&
+                    (mDeferredBufCnt.valueAt(deferredIdx) > 0);
+            if (!behindDeferred && (deferredFences[i]->wait(0) == OK)) {
+                deferredFences.editItemAt(i).clear();
+            }
         }
 
         streamID.streamID[streamID.num_streams] =
@@ -2887,15 +3171,6 @@ int QCamera3HardwareInterface::processCaptureRequest(
             ALOGE("%s: Failed to set the frame number in the parameters", __func__);
             return BAD_VALUE;
         }
-    } else {
-        sp<Fence> acquireFence = new Fence(request->input_buffer->acquire_fence);
-
-        rc = acquireFence->wait(Fence::TIMEOUT_NEVER);
-        if (rc != OK) {
-            ALOGE("%s: input buffer fence wait failed %d", __func__, rc);
-            pthread_mutex_unlock(&mMutex);
-            return rc;
-        }
     }
 
     /* Update pending request list and pending buffers map */
@@ -3014,7 +3289,12 @@ int QCamera3HardwareInterface::processCaptureRequest(
         } else {
             CDBG("%s: %d, request with buffer %p, frame_number %d", __func__,
                 __LINE__, output.buffer, frameNumber);
-            rc = channel->request(output.buffer, frameNumber);
+            if (deferredFences[i] != NULL) {
+                rc = deferBufferRequest(channel, output, frameNumber,
+                        deferredFences[i]->dup());
+            } else {
+                rc = channel->request(output.buffer, frameNumber);
+            }
             if (((1U << CAM_STREAM_TYPE_VIDEO) == channel->getStreamTypeMask())
                     && mBatchSize) {
                 mToBeQueuedVidBufs++;
@@ -3042,11 +3322,21 @@ int QCamera3HardwareInterface::processCaptureRequest(
             CDBG("%s: set_parms  batchSz: %d IsVidBufReq: %d vidBufTobeQd: %d ",
                     __func__, mBatchSize, isVidBufRequested,
                     mToBeQueuedVidBufs);
+            if (mCachedSettingsInParms && mCachedSettingsSent) {
+                /* The backend keeps the settings it already has, as for
+                 * requests without settings. Send only the per frame
+                 * entries, and the triggers which act once per request */
+                stripCachedSettings(mParameters);
+            }
             rc = mCameraHandle->ops->set_parms(mCameraHandle->camera_handle,
                     mParameters);
             if (rc < 0) {
                 ALOGE("%s: set_parms failed", __func__);
+                invalidateSettingsCache();
+            } else if (mCachedSettingsInParms) {
+                mCachedSettingsSent = true;
             }
+            mCachedSettingsInParms = false;
             /* reset to zero coz, the batch is queued */
             mToBeQueuedVidBufs = 0;
         }
@@ -3151,6 +3441,48 @@ void QCamera3HardwareInterface::dump(int fd)
     }
     dprintf(fd, "-------+-----------\n");
 
+    dprintf(fd, "\nSettings translation cache: hits %u misses %u\n",
+            mSettingsCacheHits, mSettingsCacheMisses);
+    dprintf(fd, "Result metadata presize: %zu entries, %zu data bytes\n",
+            mResultEntryHint, mResultDataHint);
+
+    dprintf(fd, "\nStream buffer allocation:\n");
+    dprintf(fd, "-----------+----------+------+----------+----------+-------\n");
+    dprintf(fd, " Channel   | Stream   | Bufs | Alloc ms | Map ms   | Where \n");
+    dprintf(fd, "-----------+----------+------+----------+----------+-------\n");
+    if (mMetadataChannel) {
+        mMetadataChannel->dumpBufStats(fd, "metadata");
+    }
+    if (mAnalysisChannel) {
+        mAnalysisChannel->dumpBufStats(fd, "analysis");
+    }
+    if (mSupportChannel) {
+        mSupportChannel->dumpBufStats(fd, "support");
+    }
+    for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+        if (channel) {
+            channel->dumpBufStats(fd, "stream");
+        }
+    }
+    if (mRawDumpChannel) {
+        mRawDumpChannel->dumpBufStats(fd, "raw dump");
+    }
+    dprintf(fd, "-----------+----------+------+----------+----------+-------\n");
+
+    dprintf(fd, "\nInternal buffer pool:\n");
+    mIonPool.dump(fd);
+
+    dprintf(fd, "\nOutput buffer fence waits:\n");
+    mFenceWaiter.dump(fd);
+    QCameraDumpService::getInstance()->dump(fd);
+
+    if (mPictureChannel) {
+        dprintf(fd, "\nJpeg blob stream:\n");
+        mPictureChannel->dumpJpegStats(fd);
+    }
+
     dprintf(fd, "\n Camera HAL3 information End \n");
 
     /* use dumpsys media.camera as trigger to send update debug level event */
@@ -3182,6 +3514,10 @@ int QCamera3HardwareInterface::flush()
     mFlush = true;
     pthread_mutex_unlock(&mMutex);
 
+    // Buffers still waiting on their fence stay in mPendingBuffersMap and
+    // are returned with an error below
+    mFenceWaiter.cancelAll();
+
     memset(&result, 0, sizeof(camera3_capture_result_t));
 
     // Stop the Streams/Channels
@@ -3208,6 +3544,8 @@ int QCamera3HardwareInterface::flush()
 
     // Mutex Lock
     pthread_mutex_lock(&mMutex);
+    mDeferredBufCnt.clear();
+    invalidateSettingsCache();
 
     // Unblock process_capture_request
     mPendingRequest = 0;
@@ -3551,8 +3889,15 @@ void QCamera3HardwareInterface::clearInputBuffer(camera3_stream_buffer_t *input_
 }
 
 /*===========================================================================
+ * FUNCTION   : translateFromHalMetadata
  *
- * DESCRIPTION:
+ * DESCRIPTION: translate the backend metadata of one frame into a complete
+ *              framework result. Results are not built incrementally from
+ *              the previous frame's: every result must carry the full tag
+ *              set, most tags (timestamps, exposure, 3A state, statistics)
+ *              change per frame, and detecting the unchanged ones would
+ *              mean comparing every backend entry, which costs as much as
+ *              the single update() per tag into the presized buffer.
  *
  * PARAMETERS :
  *   @metadata : metadata information from callback
@@ -3572,7 +3917,8 @@ QCamera3HardwareInterface::translateFromHalMetadata(
                                  uint8_t pipeline_depth,
                                  uint8_t capture_intent)
 {
-    CameraMetadata camMetadata;
+    /* Presize from earlier results so the buffer is not regrown per tag */
+    CameraMetadata camMetadata(mResultEntryHint, mResultDataHint);
     camera_metadata_t *resultMetadata;
 
     if (jpegMetadata.entryCount())
@@ -4232,6 +4578,12 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     resultMetadata = camMetadata.release();
+    if (NULL != resultMetadata) {
+        mResultEntryHint = MAX(mResultEntryHint,
+                get_camera_metadata_entry_count(resultMetadata));
+        mResultDataHint = MAX(mResultDataHint,
+                get_camera_metadata_data_count(resultMetadata));
+    }
     return resultMetadata;
 }
 
@@ -4308,90 +4660,117 @@ QCamera3HardwareInterface::translateCbUrgentMetadataToResultMetadata
 {
     CameraMetadata camMetadata;
     camera_metadata_t *resultMetadata;
-
-    IF_META_AVAILABLE(uint32_t, afState, CAM_INTF_META_AF_STATE, metadata) {
-        uint8_t fwk_afState = (uint8_t) *afState;
-        camMetadata.update(ANDROID_CONTROL_AF_STATE, &fwk_afState, 1);
-        CDBG("%s: urgent Metadata : ANDROID_CONTROL_AF_STATE %u", __func__, *afState);
-    }
-
-    IF_META_AVAILABLE(float, focusDistance, CAM_INTF_META_LENS_FOCUS_DISTANCE, metadata) {
-        camMetadata.update(ANDROID_LENS_FOCUS_DISTANCE , focusDistance, 1);
-    }
-
-    IF_META_AVAILABLE(float, focusRange, CAM_INTF_META_LENS_FOCUS_RANGE, metadata) {
-        camMetadata.update(ANDROID_LENS_FOCUS_RANGE , focusRange, 2);
-    }
-
-    IF_META_AVAILABLE(uint32_t, whiteBalanceState, CAM_INTF_META_AWB_STATE, metadata) {
-        uint8_t fwk_whiteBalanceState = (uint8_t) *whiteBalanceState;
-        camMetadata.update(ANDROID_CONTROL_AWB_STATE, &fwk_whiteBalanceState, 1);
-        CDBG("%s: urgent Metadata : ANDROID_CONTROL_AWB_STATE %u", __func__, *whiteBalanceState);
-    }
-
-    IF_META_AVAILABLE(cam_trigger_t, aecTrigger, CAM_INTF_META_AEC_PRECAPTURE_TRIGGER, metadata) {
-        camMetadata.update(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
-                &aecTrigger->trigger, 1);
-        camMetadata.update(ANDROID_CONTROL_AE_PRECAPTURE_ID,
-                &aecTrigger->trigger_id, 1);
-        CDBG("%s: urgent Metadata : CAM_INTF_META_AEC_PRECAPTURE_TRIGGER: %d",
-                __func__, aecTrigger->trigger);
-        CDBG("%s: urgent Metadata : ANDROID_CONTROL_AE_PRECAPTURE_ID: %d", __func__,
-                aecTrigger->trigger_id);
-    }
-
-    IF_META_AVAILABLE(uint32_t, ae_state, CAM_INTF_META_AEC_STATE, metadata) {
-        uint8_t fwk_ae_state = (uint8_t) *ae_state;
-        camMetadata.update(ANDROID_CONTROL_AE_STATE, &fwk_ae_state, 1);
-        CDBG("%s: urgent Metadata : ANDROID_CONTROL_AE_STATE %u", __func__, *ae_state);
-    }
-
-    IF_META_AVAILABLE(uint32_t, focusMode, CAM_INTF_PARM_FOCUS_MODE, metadata) {
-        int val = lookupFwkName(FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP), *focusMode);
-        if (NAME_NOT_FOUND != val) {
-            uint8_t fwkAfMode = (uint8_t)val;
-            camMetadata.update(ANDROID_CONTROL_AF_MODE, &fwkAfMode, 1);
-            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AF_MODE", __func__);
-        } else {
-            CDBG_HIGH("%s: urgent Metadata not found : ANDROID_CONTROL_AF_MODE %d", __func__,
-                    val);
-        }
-    }
-
-    IF_META_AVAILABLE(cam_trigger_t, af_trigger, CAM_INTF_META_AF_TRIGGER, metadata) {
-        camMetadata.update(ANDROID_CONTROL_AF_TRIGGER,
-                &af_trigger->trigger, 1);
-        CDBG("%s: urgent Metadata : CAM_INTF_META_AF_TRIGGER = %d",
-                __func__, af_trigger->trigger);
-        camMetadata.update(ANDROID_CONTROL_AF_TRIGGER_ID, &af_trigger->trigger_id, 1);
-        CDBG("%s: urgent Metadata : ANDROID_CONTROL_AF_TRIGGER_ID = %d", __func__,
-                af_trigger->trigger_id);
-    }
-
-    IF_META_AVAILABLE(int32_t, whiteBalance, CAM_INTF_PARM_WHITE_BALANCE, metadata) {
-        int val = lookupFwkName(WHITE_BALANCE_MODES_MAP,
-                METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP), *whiteBalance);
-        if (NAME_NOT_FOUND != val) {
-            uint8_t fwkWhiteBalanceMode = (uint8_t)val;
-            camMetadata.update(ANDROID_CONTROL_AWB_MODE, &fwkWhiteBalanceMode, 1);
-            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AWB_MODE %d", __func__, val);
-        } else {
-            CDBG_HIGH("%s: urgent Metadata not found : ANDROID_CONTROL_AWB_MODE", __func__);
-        }
-    }
-
     uint8_t fwk_aeMode = ANDROID_CONTROL_AE_MODE_OFF;
     uint32_t aeMode = CAM_AE_MODE_MAX;
     int32_t flashMode = CAM_FLASH_MODE_MAX;
     int32_t redeye = -1;
-    IF_META_AVAILABLE(uint32_t, pAeMode, CAM_INTF_META_AEC_MODE, metadata) {
-        aeMode = *pAeMode;
-    }
-    IF_META_AVAILABLE(int32_t, pFlashMode, CAM_INTF_PARM_LED_MODE, metadata) {
-        flashMode = *pFlashMode;
-    }
-    IF_META_AVAILABLE(int32_t, pRedeye, CAM_INTF_PARM_REDEYE_REDUCTION, metadata) {
-        redeye = *pRedeye;
+    cam_meta_iter_t iter;
+    uint32_t metaId, metaSize;
+    const void *metaData;
+
+    /* Walk only the entries set in this frame instead of probing every
+     * urgent tag */
+    cam_meta_iter_init_dense(&iter, metadata);
+    while (cam_meta_iter_next(&iter, &metaId, &metaData, &metaSize)) {
+        switch (metaId) {
+        case CAM_INTF_META_AF_STATE: {
+            const uint32_t *afState = (const uint32_t *)metaData;
+            uint8_t fwk_afState = (uint8_t) *afState;
+            camMetadata.update(ANDROID_CONTROL_AF_STATE, &fwk_afState, 1);
+            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AF_STATE %u", __func__, *afState);
+            break;
+        }
+        case CAM_INTF_META_LENS_FOCUS_DISTANCE:
+            camMetadata.update(ANDROID_LENS_FOCUS_DISTANCE,
+                    (const float *)metaData, 1);
+            break;
+        case CAM_INTF_META_LENS_FOCUS_RANGE:
+            camMetadata.update(ANDROID_LENS_FOCUS_RANGE,
+                    (const float *)metaData, 2);
+            break;
+        case CAM_INTF_META_AWB_STATE: {
+            const uint32_t *whiteBalanceState = (const uint32_t *)metaData;
+            uint8_t fwk_whiteBalanceState = (uint8_t) *whiteBalanceState;
+            camMetadata.update(ANDROID_CONTROL_AWB_STATE, &fwk_whiteBalanceState, 1);
+            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AWB_STATE %u", __func__,
+                    *whiteBalanceState);
+            break;
+        }
+        case CAM_INTF_META_AEC_PRECAPTURE_TRIGGER: {
+            const cam_trigger_t *aecTrigger = (const cam_trigger_t *)metaData;
+            camMetadata.update(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
+                    &aecTrigger->trigger, 1);
+            camMetadata.update(ANDROID_CONTROL_AE_PRECAPTURE_ID,
+                    &aecTrigger->trigger_id, 1);
+            CDBG("%s: urgent Metadata : CAM_INTF_META_AEC_PRECAPTURE_TRIGGER: %d",
+                    __func__, aecTrigger->trigger);
+            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AE_PRECAPTURE_ID: %d", __func__,
+                    aecTrigger->trigger_id);
+            break;
+        }
+        case CAM_INTF_META_AEC_STATE: {
+            const uint32_t *ae_state = (const uint32_t *)metaData;
+            uint8_t fwk_ae_state = (uint8_t) *ae_state;
+            camMetadata.update(ANDROID_CONTROL_AE_STATE, &fwk_ae_state, 1);
+            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AE_STATE %u", __func__, *ae_state);
+            break;
+        }
+        case CAM_INTF_PARM_FOCUS_MODE: {
+            const uint32_t *focusMode = (const uint32_t *)metaData;
+            int val = lookupFwkName(FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP),
+                    *focusMode);
+            if (NAME_NOT_FOUND != val) {
+                uint8_t fwkAfMode = (uint8_t)val;
+                camMetadata.update(ANDROID_CONTROL_AF_MODE, &fwkAfMode, 1);
+                CDBG("%s: urgent Metadata : ANDROID_CONTROL_AF_MODE", __func__);
+            } else {
+                CDBG_HIGH("%s: urgent Metadata not found : ANDROID_CONTROL_AF_MODE %d",
+                        __func__, val);
+            }
+            break;
+        }
+        case CAM_INTF_META_AF_TRIGGER: {
+            const cam_trigger_t *af_trigger = (const cam_trigger_t *)metaData;
+            camMetadata.update(ANDROID_CONTROL_AF_TRIGGER,
+                    &af_trigger->trigger, 1);
+            CDBG("%s: urgent Metadata : CAM_INTF_META_AF_TRIGGER = %d",
+                    __func__, af_trigger->trigger);
+            camMetadata.update(ANDROID_CONTROL_AF_TRIGGER_ID, &af_trigger->trigger_id, 1);
+            CDBG("%s: urgent Metadata : ANDROID_CONTROL_AF_TRIGGER_ID = %d", __func__,
+                    af_trigger->trigger_id);
+            break;
+        }
+        case CAM_INTF_PARM_WHITE_BALANCE: {
+            const int32_t *whiteBalance = (const int32_t *)metaData;
+            int val = lookupFwkName(WHITE_BALANCE_MODES_MAP,
+                    METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP), *whiteBalance);
+            if (NAME_NOT_FOUND != val) {
+                uint8_t fwkWhiteBalanceMode = (uint8_t)val;
+                camMetadata.update(ANDROID_CONTROL_AWB_MODE, &fwkWhiteBalanceMode, 1);
+                CDBG("%s: urgent Metadata : ANDROID_CONTROL_AWB_MODE %d", __func__, val);
+            } else {
+                CDBG_HIGH("%s: urgent Metadata not found : ANDROID_CONTROL_AWB_MODE",
+                        __func__);
+            }
+            break;
+        }
+        case CAM_INTF_META_AEC_MODE:
+            aeMode = *(const uint32_t *)metaData;
+            break;
+        case CAM_INTF_PARM_LED_MODE:
+            flashMode = *(const int32_t *)metaData;
+            break;
+        case CAM_INTF_PARM_REDEYE_REDUCTION:
+            redeye = *(const int32_t *)metaData;
+            break;
+        case CAM_INTF_META_LENS_STATE: {
+            uint8_t fwk_lensState = *(const cam_af_lens_state_t *)metaData;
+            camMetadata.update(ANDROID_LENS_STATE , &fwk_lensState, 1);
+            break;
+        }
+        default:
+            break;
+        }
     }
 
     if (1 == redeye) {
@@ -4418,11 +4797,6 @@ QCamera3HardwareInterface::translateCbUrgentMetadataToResultMetadata
                 __func__, redeye, flashMode, aeMode);
     }
 
-    IF_META_AVAILABLE(cam_af_lens_state_t, lensState, CAM_INTF_META_LENS_STATE, metadata) {
-        uint8_t fwk_lensState = *lensState;
-        camMetadata.update(ANDROID_LENS_STATE , &fwk_lensState, 1);
-    }
-
     resultMetadata = camMetadata.release();
     return resultMetadata;
 }
@@ -4501,44 +4875,56 @@ void QCamera3HardwareInterface::dumpMetadataToFile(tuning_params_t &meta,
                 type,
                 frameNumber);
         filePath.append(buf);
-        int file_fd = open(filePath.string(), O_RDWR | O_CREAT, 0777);
-        if (file_fd >= 0) {
-            ssize_t written_len = 0;
-            meta.tuning_data_version = TUNING_DATA_VERSION;
-            void *data = (void *)((uint8_t *)&meta.tuning_data_version);
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_sensor_data_size);
-            CDBG("tuning_sensor_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_vfe_data_size);
-            CDBG("tuning_vfe_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_cpp_data_size);
-            CDBG("tuning_cpp_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_cac_data_size);
-            CDBG("tuning_cac_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            meta.tuning_mod3_data_size = 0;
-            data = (void *)((uint8_t *)&meta.tuning_mod3_data_size);
-            CDBG("tuning_mod3_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            size_t total_size = meta.tuning_sensor_data_size;
-            data = (void *)((uint8_t *)&meta.data);
-            written_len += write(file_fd, data, total_size);
-            total_size = meta.tuning_vfe_data_size;
-            data = (void *)((uint8_t *)&meta.data[TUNING_VFE_DATA_OFFSET]);
-            written_len += write(file_fd, data, total_size);
-            total_size = meta.tuning_cpp_data_size;
-            data = (void *)((uint8_t *)&meta.data[TUNING_CPP_DATA_OFFSET]);
-            written_len += write(file_fd, data, total_size);
-            total_size = meta.tuning_cac_data_size;
-            data = (void *)((uint8_t *)&meta.data[TUNING_CAC_DATA_OFFSET]);
-            written_len += write(file_fd, data, total_size);
-            close(file_fd);
-        }else {
-            ALOGE("%s: fail to open file for metadata dumping", __func__);
-        }
+        meta.tuning_data_version = TUNING_DATA_VERSION;
+        meta.tuning_mod3_data_size = 0;
+        CDBG("%s: tuning sensor %zu vfe %zu cpp %zu cac %zu", __func__,
+                meta.tuning_sensor_data_size, meta.tuning_vfe_data_size,
+                meta.tuning_cpp_data_size, meta.tuning_cac_data_size);
+        qcamera_dump_seg_t segs[] = {
+            { &meta.tuning_data_version, sizeof(uint32_t), 0, 1 },
+            { &meta.tuning_sensor_data_size, sizeof(uint32_t), 0, 1 },
+            { &meta.tuning_vfe_data_size, sizeof(uint32_t), 0, 1 },
+            { &meta.tuning_cpp_data_size, sizeof(uint32_t), 0, 1 },
+            { &meta.tuning_cac_data_size, sizeof(uint32_t), 0, 1 },
+            { &meta.tuning_mod3_data_size, sizeof(uint32_t), 0, 1 },
+            { &meta.data, meta.tuning_sensor_data_size, 0, 1 },
+            { &meta.data[TUNING_VFE_DATA_OFFSET],
+                    meta.tuning_vfe_data_size, 0, 1 },
+            { &meta.data[TUNING_CPP_DATA_OFFSET],
+                    meta.tuning_cpp_data_size, 0, 1 },
+            { &meta.data[TUNING_CAC_DATA_OFFSET],
+                    meta.tuning_cac_data_size, 0, 1 },
+        };
+        QCameraDumpService::getInstance()->submit(QCAMERA_DUMP_STREAM_METADATA,
+                filePath.string(), segs, sizeof(segs) / sizeof(segs[0]));
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePreparedChannelBufs
+ *
+ * DESCRIPTION: release the buffers prepared on mAllocPool for the internal
+ *              channels that did not get to start
+ *
+ * PARAMETERS : None
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::releasePreparedChannelBufs()
+{
+    if (mMetadataChannel) {
+        mMetadataChannel->releasePreparedStreamBufs();
+    }
+    if (mAnalysisChannel) {
+        mAnalysisChannel->releasePreparedStreamBufs();
+    }
+    if (mSupportChannel) {
+        mSupportChannel->releasePreparedStreamBufs();
+    }
+    if (mPictureChannel) {
+        mPictureChannel->releasePreparedStreamBufs();
+    }
+    if (mRawDumpChannel) {
+        mRawDumpChannel->releasePreparedStreamBufs();
     }
 }
 
@@ -4894,6 +5280,12 @@ int QCamera3HardwareInterface::initParameters()
     mParameters = (metadata_buffer_t *) DATA_PTR(mParamHeap,0);
 
     mPrevParameters = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+
+    mCachedHalSettings = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+    if (mCachedHalSettings) {
+        clear_metadata_buffer(mCachedHalSettings);
+    }
+    invalidateSettingsCache();
     return rc;
 }
 
@@ -4919,6 +5311,13 @@ void QCamera3HardwareInterface::deinitParameters()
 
     free(mPrevParameters);
     mPrevParameters = NULL;
+
+    invalidateSettingsCache();
+    free(mCachedHalSettings);
+    mCachedHalSettings = NULL;
+    free(mCachedSettings);
+    mCachedSettings = NULL;
+    mCachedSettingsAlloc = 0;
 }
 
 /*===========================================================================
@@ -6591,6 +6990,7 @@ int QCamera3HardwareInterface::setFrameParameters(
     int32_t hal_version = CAM_HAL_V3;
 
     clear_metadata_buffer(mParameters);
+    mCachedSettingsInParms = false;
     if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_HAL_VERSION, hal_version)) {
         ALOGE("%s: Failed to set hal version in the parameters", __func__);
         return BAD_VALUE;
@@ -6622,14 +7022,147 @@ int QCamera3HardwareInterface::setFrameParameters(
     }
 
     if(request->settings != NULL){
-        rc = translateToHalMetadata(request, mParameters, snapshotStreamId);
+        if (lookupSettingsCache(request->settings, streamID, snapshotStreamId)) {
+            merge_metadata_buffer(mParameters, mCachedHalSettings);
+            mCachedSettingsInParms = true;
+            mSettingsCacheHits++;
+        } else {
+            mSettingsCacheMisses++;
+            rc = translateToHalMetadata(request, mParameters, snapshotStreamId);
+            if (NO_ERROR == rc) {
+                updateSettingsCache(request->settings, streamID, snapshotStreamId);
+                mCachedSettingsInParms = mSettingsCacheValid;
+            } else {
+                invalidateSettingsCache();
+            }
+        }
         if (blob_request)
-            memcpy(mPrevParameters, mParameters, sizeof(metadata_buffer_t));
+            copy_metadata_buffer(mPrevParameters, mParameters);
     }
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : lookupSettingsCache
+ *
+ * DESCRIPTION: check whether request settings are identical to the last
+ *              translated ones. Translation also depends on the requested
+ *              streams and the snapshot stream, so those are compared too
+ *
+ * PARAMETERS :
+ *   @settings         : request settings from framework
+ *   @streamID         : stream IDs of the request
+ *   @snapshotStreamId : snapshot stream ID
+ *
+ * RETURN     : true if mCachedHalSettings can be used as the translation
+ *==========================================================================*/
+bool QCamera3HardwareInterface::lookupSettingsCache(
+        const camera_metadata_t *settings, cam_stream_ID_t &streamID,
+        uint32_t snapshotStreamId)
+{
+    if (!mSettingsCacheValid || (NULL == settings)) {
+        return false;
+    }
+    size_t size = get_camera_metadata_size(settings);
+    if ((size != mCachedSettingsSize) ||
+            (snapshotStreamId != mCachedSnapshotStreamId) ||
+            (streamID.num_streams != mCachedStreamID.num_streams) ||
+            memcmp(streamID.streamID, mCachedStreamID.streamID,
+                    streamID.num_streams * sizeof(streamID.streamID[0]))) {
+        return false;
+    }
+    return (0 == memcmp(settings, mCachedSettings, size));
+}
+
+/*===========================================================================
+ * FUNCTION   : updateSettingsCache
+ *
+ * DESCRIPTION: remember request settings and the entries translateToHalMetadata
+ *              produced for them. Must be called right after translation,
+ *              while mParameters still holds its output
+ *
+ * PARAMETERS :
+ *   @settings         : request settings from framework
+ *   @streamID         : stream IDs of the request
+ *   @snapshotStreamId : snapshot stream ID
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::updateSettingsCache(
+        const camera_metadata_t *settings, cam_stream_ID_t &streamID,
+        uint32_t snapshotStreamId)
+{
+    mSettingsCacheValid = false;
+    mCachedSettingsSent = false;
+    if ((NULL == settings) || (NULL == mCachedHalSettings)) {
+        return;
+    }
+
+    size_t size = get_camera_metadata_size(settings);
+    if (size > mCachedSettingsAlloc) {
+        void *buf = realloc(mCachedSettings, size);
+        if (NULL == buf) {
+            return;
+        }
+        mCachedSettings = (camera_metadata_t *)buf;
+        mCachedSettingsAlloc = size;
+    }
+    memcpy(mCachedSettings, settings, size);
+    mCachedSettingsSize = size;
+    mCachedStreamID = streamID;
+    mCachedSnapshotStreamId = snapshotStreamId;
+
+    /* Keep only the translated entries, the per frame ones set by
+     * setFrameParameters are filled in for every request */
+    copy_metadata_buffer(mCachedHalSettings, mParameters);
+    mCachedHalSettings->is_valid[CAM_INTF_PARM_HAL_VERSION] = 0;
+    mCachedHalSettings->is_valid[CAM_INTF_META_FRAME_NUMBER] = 0;
+    mCachedHalSettings->is_valid[CAM_INTF_META_STREAM_ID] = 0;
+    mCachedHalSettings->is_valid[CAM_INTF_PARM_UPDATE_DEBUG_LEVEL] = 0;
+    mSettingsCacheValid = true;
+}
+
+/*===========================================================================
+ * FUNCTION   : stripCachedSettings
+ *
+ * DESCRIPTION: drop the cached translated entries from a parameter batch
+ *              whose settings the backend already has. AF and precapture
+ *              triggers stay, they start an action on every request that
+ *              carries them
+ *
+ * PARAMETERS :
+ *   @params : parameter batch about to be sent with set_parms
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::stripCachedSettings(metadata_buffer_t *params)
+{
+    uint8_t afTrigger = params->is_valid[CAM_INTF_META_AF_TRIGGER];
+    uint8_t aecTrigger = params->is_valid[CAM_INTF_META_AEC_PRECAPTURE_TRIGGER];
+
+    strip_metadata_buffer(params, mCachedHalSettings);
+    params->is_valid[CAM_INTF_META_AF_TRIGGER] = afTrigger;
+    params->is_valid[CAM_INTF_META_AEC_PRECAPTURE_TRIGGER] = aecTrigger;
+}
+
+/*===========================================================================
+ * FUNCTION   : invalidateSettingsCache
+ *
+ * DESCRIPTION: drop the cached settings translation
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::invalidateSettingsCache()
+{
+    mSettingsCacheValid = false;
+    mCachedSettingsSize = 0;
+    mCachedSettingsInParms = false;
+    mCachedSettingsSent = false;
+}
+
 /*===========================================================================
  * FUNCTION   : setReprocParameters
  *
@@ -38,6 +38,7 @@
 #include "QCamera3HALHeader.h"
 #include "QCamera3Channel.h"
 #include "QCamera3CropRegionMapper.h"
+#include "QCameraFenceWaiter.h"
 
 #include <hardware/power.h>
 
@@ -164,6 +165,12 @@ public:
             metadata_buffer_t *reprocParam, uint32_t snapshotStreamId);
     int translateToHalMetadata(const camera3_capture_request_t *request,
             metadata_buffer_t *parm, uint32_t snapshotStreamId);
+    bool lookupSettingsCache(const camera_metadata_t *settings,
+            cam_stream_ID_t &streamID, uint32_t snapshotStreamId);
+    void updateSettingsCache(const camera_metadata_t *settings,
+            cam_stream_ID_t &streamID, uint32_t snapshotStreamId);
+    void invalidateSettingsCache();
+    void stripCachedSettings(metadata_buffer_t *params);
     camera_metadata_t* translateCbUrgentMetadataToResultMetadata (
                              metadata_buffer_t *metadata);
     camera_metadata_t* translateFromHalMetadata(metadata_buffer_t *metadata,
@@ -187,6 +194,8 @@ public:
     QCamera3Exif *getExifData();
     mm_jpeg_exif_params_t get3AExifParams();
     uint8_t getMobicatMask();
+    QCameraIonPool *getIonPool() { return &mIonPool; }
+    uint32_t getCameraId() const { return mCameraId; }
 
     template <typename fwkType, typename halType> struct QCameraMap {
         fwkType fwk_name;
@@ -224,6 +233,7 @@ private:
     static void getLogLevel();
 
     void cleanAndSortStreamInfo();
+    void releasePreparedChannelBufs();
     void extractJpegMetadata(CameraMetadata& jpegMetadata,
             const camera3_capture_request_t *request);
 
@@ -264,8 +274,36 @@ private:
     bool mFlush;
     bool mEnableRawDump;
     QCamera3HeapMemory *mParamHeap;
+    /* Recycles internal stream buffers across configureStreams */
+    QCameraIonPool mIonPool;
+    /* Allocates internal stream buffers ahead of channel start */
+    QCamera3AllocThreadPool mAllocPool;
+    /* Queues output buffers to their channel once their acquire fence
+     * signals, so processCaptureRequest does not block on consumers */
+    QCameraFenceWaiter mFenceWaiter;
+    /* Deferred buffers not queued yet, per stream. Later buffers of such a
+     * stream are deferred behind them to keep the stream in FIFO order. */
+    KeyedVector<camera3_stream_t *, uint32_t> mDeferredBufCnt;
     metadata_buffer_t* mParameters;
     metadata_buffer_t* mPrevParameters;
+    /* Last translated request settings and their translation, replayed
+     * into mParameters when a request carries identical settings */
+    camera_metadata_t *mCachedSettings;
+    size_t mCachedSettingsSize;
+    size_t mCachedSettingsAlloc;
+    cam_stream_ID_t mCachedStreamID;
+    uint32_t mCachedSnapshotStreamId;
+    bool mSettingsCacheValid;
+    metadata_buffer_t* mCachedHalSettings;
+    /* mParameters holds the mCachedHalSettings entries */
+    bool mCachedSettingsInParms;
+    /* The backend got the mCachedHalSettings entries and keeps them */
+    bool mCachedSettingsSent;
+    uint32_t mSettingsCacheHits;
+    uint32_t mSettingsCacheMisses;
+    /* Largest result metadata seen, used to presize the next result */
+    size_t mResultEntryHint;
+    size_t mResultDataHint;
     bool m_bIsVideo;
     bool m_bIs4KVideo;
     bool m_bEisSupportedSize;
@@ -321,6 +359,22 @@ private:
 
     typedef KeyedVector<uint32_t, Vector<PendingBufferInfo> > FlushMap;
 
+    /* Output buffer held back until its acquire fence signals */
+    typedef struct {
+        QCamera3Channel *channel;
+        camera3_stream_t *stream;
+        buffer_handle_t *buffer;
+        uint32_t frame_number;
+    } DeferredBufferRequest;
+
+    int32_t deferBufferRequest(QCamera3Channel *channel,
+            const camera3_stream_buffer_t &output, uint32_t frameNumber,
+            int acquireFenceFd);
+    void handleDeferredBufferRequest(int32_t status,
+            DeferredBufferRequest *req);
+    static void fenceSignaledCb(int32_t status, void *data, void *user_data);
+    static void releaseDeferredRequest(void *data, void *user_data);
+
     List<PendingReprocessResult> mPendingReprocessResultList;
     List<PendingRequestInfo> mPendingRequestsList;
     List<PendingFrameDropInfo> mPendingFrameDropList;
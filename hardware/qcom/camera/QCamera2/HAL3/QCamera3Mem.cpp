@@ -61,12 +61,7 @@ namespace qcamera {
 QCamera3Memory::QCamera3Memory()
 {
     mBufferCount = 0;
-    for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
-        mMemInfo[i].fd = 0;
-        mMemInfo[i].main_ion_fd = 0;
-        mMemInfo[i].handle = 0;
-        mMemInfo[i].size = 0;
-    }
+    memset(mMemInfo, 0, sizeof(mMemInfo));
 }
 
 /*===========================================================================
@@ -254,12 +249,15 @@ int32_t QCamera3Memory::getBufDef(const cam_frame_len_offset_t &offset,
  *
  * DESCRIPTION: constructor of QCamera3HeapMemory for ion memory used internally in HAL
  *
- * PARAMETERS : none
+ * PARAMETERS :
+ *   @pool    : ion pool to recycle buffers through, may be NULL
  *
  * RETURN     : none
  *==========================================================================*/
-QCamera3HeapMemory::QCamera3HeapMemory()
-    : QCamera3Memory()
+QCamera3HeapMemory::QCamera3HeapMemory(QCameraIonPool *pool)
+    : QCamera3Memory(),
+      mQueueAll(false),
+      mPool(pool)
 {
     for (int i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i ++)
         mPtr[i] = NULL;
@@ -305,7 +303,12 @@ int QCamera3HeapMemory::alloc(uint32_t count, size_t size, unsigned int heap_id)
     }
 
     for (uint32_t i = 0; i < count; i ++) {
-        rc = allocOneBuffer(mMemInfo[i], heap_id, size);
+        if (NULL != mPool) {
+            rc = mPool->allocateBuffer(mMemInfo[i], heap_id, size, true,
+                    NON_SECURE);
+        } else {
+            rc = allocOneBuffer(mMemInfo[i], heap_id, size);
+        }
         if (rc < 0) {
             ALOGE("AllocateIonMemory failed");
             for (int32_t j = (int32_t)(i - 1); j >= 0; j--)
@@ -348,60 +351,15 @@ void QCamera3HeapMemory::dealloc()
 int QCamera3HeapMemory::allocOneBuffer(QCamera3MemInfo &memInfo,
         unsigned int heap_id, size_t size)
 {
-    int rc = OK;
-    struct ion_handle_data handle_data;
-    struct ion_allocation_data allocData;
-    struct ion_fd_data ion_info_fd;
-    int main_ion_fd = 0;
-
-    main_ion_fd = open("/dev/ion", O_RDONLY);
-    if (main_ion_fd < 0) {
-        ALOGE("Ion dev open failed: %s\n", strerror(errno));
-        goto ION_OPEN_FAILED;
-    }
-
-    memset(&allocData, 0, sizeof(allocData));
-    allocData.len = size;
-    /* to make it page size aligned */
-    allocData.len = (allocData.len + 4095U) & (~4095U);
-    allocData.align = 4096;
-    allocData.flags = ION_FLAG_CACHED;
-    allocData.heap_id_mask = heap_id;
-    rc = ioctl(main_ion_fd, ION_IOC_ALLOC, &allocData);
-    if (rc < 0) {
-        ALOGE("ION allocation for len %d failed: %s\n", allocData.len,
-            strerror(errno));
-        goto ION_ALLOC_FAILED;
-    }
-
-    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
-    ion_info_fd.handle = allocData.handle;
-    rc = ioctl(main_ion_fd, ION_IOC_SHARE, &ion_info_fd);
-    if (rc < 0) {
-        ALOGE("ION map failed %s\n", strerror(errno));
-        goto ION_MAP_FAILED;
-    }
-
-    memInfo.main_ion_fd = main_ion_fd;
-    memInfo.fd = ion_info_fd.fd;
-    memInfo.handle = ion_info_fd.handle;
-    memInfo.size = allocData.len;
-    return OK;
-
-ION_MAP_FAILED:
-    memset(&handle_data, 0, sizeof(handle_data));
-    handle_data.handle = ion_info_fd.handle;
-    ioctl(main_ion_fd, ION_IOC_FREE, &handle_data);
-ION_ALLOC_FAILED:
-    close(main_ion_fd);
-ION_OPEN_FAILED:
-    return NO_MEMORY;
+    return QCameraIonPool::allocIonBuffer(memInfo, heap_id, size, true,
+            NON_SECURE);
 }
 
 /*===========================================================================
  * FUNCTION   : deallocOneBuffer
  *
- * DESCRIPTION: impl of deallocating one buffers
+ * DESCRIPTION: impl of deallocating one buffers, returns it to the ion
+ *              pool if there is one
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
@@ -410,22 +368,11 @@ ION_OPEN_FAILED:
  *==========================================================================*/
 void QCamera3HeapMemory::deallocOneBuffer(QCamera3MemInfo &memInfo)
 {
-    struct ion_handle_data handle_data;
-
-    if (memInfo.fd > 0) {
-        close(memInfo.fd);
-        memInfo.fd = 0;
-    }
-
-    if (memInfo.main_ion_fd > 0) {
-        memset(&handle_data, 0, sizeof(handle_data));
-        handle_data.handle = memInfo.handle;
-        ioctl(memInfo.main_ion_fd, ION_IOC_FREE, &handle_data);
-        close(memInfo.main_ion_fd);
-        memInfo.main_ion_fd = 0;
+    if (NULL != mPool) {
+        mPool->releaseBuffer(memInfo);
+    } else {
+        QCameraIonPool::freeIonBuffer(memInfo);
     }
-    memInfo.handle = 0;
-    memInfo.size = 0;
 }
 
 /*===========================================================================
@@ -484,22 +431,29 @@ int QCamera3HeapMemory::allocate(uint32_t count, size_t size, bool queueAll)
         return rc;
 
     for (uint32_t i = 0; i < count; i ++) {
-        void *vaddr = mmap(NULL,
+        // a recycled buffer comes with its mapping still in place
+        void *vaddr = QCameraIonPool::takeMapping(mMemInfo[i], NULL);
+        if (vaddr == NULL) {
+            vaddr = mmap(NULL,
                     mMemInfo[i].size,
                     PROT_READ | PROT_WRITE,
                     MAP_SHARED,
                     mMemInfo[i].fd, 0);
+        }
         if (vaddr == MAP_FAILED) {
+            ALOGE("%s: mmap failed for buffer %u", __func__, i);
             for (int32_t j = (int32_t)(i - 1); j >= 0; j --) {
-                munmap(mPtr[i], mMemInfo[i].size);
-                rc = NO_MEMORY;
-                break;
+                munmap(mPtr[j], mMemInfo[j].size);
+                mPtr[j] = NULL;
             }
-        } else
-            mPtr[i] = vaddr;
+            mBufferCount = count;
+            dealloc();
+            mBufferCount = 0;
+            return NO_MEMORY;
+        }
+        mPtr[i] = vaddr;
     }
-    if (rc == 0)
-        mBufferCount = count;
+    mBufferCount = count;
 
     mQueueAll = queueAll;
     return OK;
@@ -517,7 +471,12 @@ int QCamera3HeapMemory::allocate(uint32_t count, size_t size, bool queueAll)
 void QCamera3HeapMemory::deallocate()
 {
     for (uint32_t i = 0; i < mBufferCount; i++) {
-        munmap(mPtr[i], mMemInfo[i].size);
+        if (NULL != mPool) {
+            // keep the mapping with the buffer while it is pooled
+            mMemInfo[i].vaddr = mPtr[i];
+        } else {
+            munmap(mPtr[i], mMemInfo[i].size);
+        }
         mPtr[i] = NULL;
     }
     dealloc();
@@ -748,7 +707,7 @@ int32_t QCamera3GrallocMemory::unregisterBufferLocked(size_t idx)
         ALOGE("ion free failed");
     }
     close(mMemInfo[idx].main_ion_fd);
-    memset(&mMemInfo[idx], 0, sizeof(struct QCamera3MemInfo));
+    memset(&mMemInfo[idx], 0, sizeof(QCamera3MemInfo));
     mBufferHandle[idx] = NULL;
     mPrivateHandle[idx] = NULL;
     mBufferCount--;
@@ -31,6 +31,7 @@
 #define __QCAMERA3HWI_MEM_H__
 #include <hardware/camera3.h>
 #include <utils/Mutex.h>
+#include "QCameraIonPool.h"
 
 extern "C" {
 #include <sys/types.h>
@@ -74,18 +75,13 @@ public:
             mm_camera_buf_def_t &bufDef, uint32_t index);
 
 protected:
-    struct QCamera3MemInfo {
-        int fd;
-        int main_ion_fd;
-        ion_user_handle_t handle;
-        size_t size;
-    };
+    typedef qcamera_ion_buf_t QCamera3MemInfo;
 
     int cacheOpsInternal(uint32_t index, unsigned int cmd, void *vaddr);
     virtual void *getPtrLocked(uint32_t index) = 0;
 
     uint32_t mBufferCount;
-    struct QCamera3MemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
+    QCamera3MemInfo mMemInfo[MM_CAMERA_MAX_NUM_FRAMES];
     void *mPtr[MM_CAMERA_MAX_NUM_FRAMES];
     Mutex mLock;
 };
@@ -95,7 +91,7 @@ protected:
 // parameters, metadata, and internal YUV data for jpeg encoding.
 class QCamera3HeapMemory : public QCamera3Memory {
 public:
-    QCamera3HeapMemory();
+    QCamera3HeapMemory(QCameraIonPool *pool = NULL);
     virtual ~QCamera3HeapMemory();
 
     int allocate(uint32_t count, size_t size, bool queueAll);
@@ -111,10 +107,11 @@ private:
     int alloc(uint32_t count, size_t size, unsigned int heap_id);
     void dealloc();
 
-    int allocOneBuffer(struct QCamera3MemInfo &memInfo,
+    int allocOneBuffer(QCamera3MemInfo &memInfo,
             unsigned int heap_id, size_t size);
-    void deallocOneBuffer(struct QCamera3MemInfo &memInfo);
+    void deallocOneBuffer(QCamera3MemInfo &memInfo);
     bool mQueueAll;
+    QCameraIonPool *mPool;
 };
 
 // Gralloc Memory shared with frameworks
@@ -35,6 +35,7 @@
 #include <utils/Errors.h>
 #include <utils/Trace.h>
 #include <cutils/properties.h>
+#include <camera/CameraFrameTrace.h>
 
 #include "QCamera3PostProc.h"
 #include "QCamera3HWI.h"
@@ -522,6 +523,8 @@ on_error:
 int32_t QCamera3PostProcessor::processData(mm_camera_super_buf_t *frame)
 {
     QCamera3HardwareInterface* hal_obj = (QCamera3HardwareInterface*)m_parent->mUserData;
+    camera_frame_trace(CAMERA_FRAME_TRACE_POSTPROC, hal_obj->getCameraId(),
+            frame->bufs[0]->frame_idx, 0);
     pthread_mutex_lock(&mReprocJobLock);
     // enqueue to post proc input queue
     m_inputPPQ.enqueue((void *)frame);
@@ -1488,6 +1491,11 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
     if (ret == NO_ERROR) {
         // remember job info
         jpeg_job_data->jobId = jobId;
+        // Stamp with the capture's backend frame index, not the reprocess one
+        mm_camera_super_buf_t *src_frame = (NULL != jpeg_job_data->src_reproc_frame) ?
+                jpeg_job_data->src_reproc_frame : recvd_frame;
+        camera_frame_trace(CAMERA_FRAME_TRACE_JPEG_START, hal_obj->getCameraId(),
+                src_frame->bufs[0]->frame_idx, jobId);
     }
 
     CDBG("%s : X", __func__);
@@ -2360,7 +2368,8 @@ QCamera3Exif *QCamera3PostProcessor::getExifData(metadata_buffer_t *metadata,
  * RETURN     : None
  *==========================================================================*/
 QCamera3Exif::QCamera3Exif()
-    : m_nNumEntries(0)
+    : m_nNumEntries(0),
+      m_nArenaUsed(0)
 {
     memset(m_Entries, 0, sizeof(m_Entries));
 }
@@ -2382,7 +2391,7 @@ QCamera3Exif::~QCamera3Exif()
                 {
                     if (m_Entries[i].tag_entry.count > 1 &&
                             m_Entries[i].tag_entry.data._bytes != NULL) {
-                        free(m_Entries[i].tag_entry.data._bytes);
+                        freeValue(m_Entries[i].tag_entry.data._bytes);
                         m_Entries[i].tag_entry.data._bytes = NULL;
                     }
                 }
@@ -2390,7 +2399,7 @@ QCamera3Exif::~QCamera3Exif()
             case EXIF_ASCII:
                 {
                     if (m_Entries[i].tag_entry.data._ascii != NULL) {
-                        free(m_Entries[i].tag_entry.data._ascii);
+                        freeValue(m_Entries[i].tag_entry.data._ascii);
                         m_Entries[i].tag_entry.data._ascii = NULL;
                     }
                 }
@@ -2399,7 +2408,7 @@ QCamera3Exif::~QCamera3Exif()
                 {
                     if (m_Entries[i].tag_entry.count > 1 &&
                             m_Entries[i].tag_entry.data._shorts != NULL) {
-                        free(m_Entries[i].tag_entry.data._shorts);
+                        freeValue(m_Entries[i].tag_entry.data._shorts);
                         m_Entries[i].tag_entry.data._shorts = NULL;
                     }
                 }
@@ -2408,7 +2417,7 @@ QCamera3Exif::~QCamera3Exif()
                 {
                     if (m_Entries[i].tag_entry.count > 1 &&
                             m_Entries[i].tag_entry.data._longs != NULL) {
-                        free(m_Entries[i].tag_entry.data._longs);
+                        freeValue(m_Entries[i].tag_entry.data._longs);
                         m_Entries[i].tag_entry.data._longs = NULL;
                     }
                 }
@@ -2417,7 +2426,7 @@ QCamera3Exif::~QCamera3Exif()
                 {
                     if (m_Entries[i].tag_entry.count > 1 &&
                             m_Entries[i].tag_entry.data._rats != NULL) {
-                        free(m_Entries[i].tag_entry.data._rats);
+                        freeValue(m_Entries[i].tag_entry.data._rats);
                         m_Entries[i].tag_entry.data._rats = NULL;
                     }
                 }
@@ -2425,7 +2434,7 @@ QCamera3Exif::~QCamera3Exif()
             case EXIF_UNDEFINED:
                 {
                     if (m_Entries[i].tag_entry.data._undefined != NULL) {
-                        free(m_Entries[i].tag_entry.data._undefined);
+                        freeValue(m_Entries[i].tag_entry.data._undefined);
                         m_Entries[i].tag_entry.data._undefined = NULL;
                     }
                 }
@@ -2434,7 +2443,7 @@ QCamera3Exif::~QCamera3Exif()
                 {
                     if (m_Entries[i].tag_entry.count > 1 &&
                             m_Entries[i].tag_entry.data._slongs != NULL) {
-                        free(m_Entries[i].tag_entry.data._slongs);
+                        freeValue(m_Entries[i].tag_entry.data._slongs);
                         m_Entries[i].tag_entry.data._slongs = NULL;
                     }
                 }
@@ -2443,7 +2452,7 @@ QCamera3Exif::~QCamera3Exif()
                 {
                     if (m_Entries[i].tag_entry.count > 1 &&
                             m_Entries[i].tag_entry.data._srats != NULL) {
-                        free(m_Entries[i].tag_entry.data._srats);
+                        freeValue(m_Entries[i].tag_entry.data._srats);
                         m_Entries[i].tag_entry.data._srats = NULL;
                     }
                 }
@@ -2455,6 +2464,48 @@ QCamera3Exif::~QCamera3Exif()
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : allocValue
+ *
+ * DESCRIPTION: carve storage for a tag value out of the preallocated arena,
+ *              falling back to heap memory once the arena is exhausted
+ *
+ * PARAMETERS :
+ *   @size    : number of bytes needed
+ *
+ * RETURN     : ptr to value storage, NULL if out of memory
+ *==========================================================================*/
+void *QCamera3Exif::allocValue(size_t size)
+{
+    size_t aligned = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    if (m_nArenaUsed + aligned > sizeof(m_Arena)) {
+        CDBG_HIGH("%s: exif arena full (%zu/%zu), using heap for %zu bytes",
+                __func__, m_nArenaUsed, sizeof(m_Arena), size);
+        return malloc(size);
+    }
+    void *value = (uint8_t *)m_Arena + m_nArenaUsed;
+    m_nArenaUsed += aligned;
+    return value;
+}
+
+/*===========================================================================
+ * FUNCTION   : freeValue
+ *
+ * DESCRIPTION: release tag value storage obtained from allocValue
+ *
+ * PARAMETERS :
+ *   @value   : value ptr
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3Exif::freeValue(void *value)
+{
+    uint8_t *p = (uint8_t *)value;
+    if (p < (uint8_t *)m_Arena || p >= (uint8_t *)m_Arena + sizeof(m_Arena)) {
+        free(value);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : addEntry
  *
@@ -2489,7 +2540,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_BYTE:
             {
                 if (count > 1) {
-                    uint8_t *values = (uint8_t *)malloc(count);
+                    uint8_t *values = (uint8_t *)allocValue(count);
                     if (values == NULL) {
                         ALOGE("%s: No memory for byte array", __func__);
                         rc = NO_MEMORY;
@@ -2506,7 +2557,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_ASCII:
             {
                 char *str = NULL;
-                str = (char *)malloc(count + 1);
+                str = (char *)allocValue(count + 1);
                 if (str == NULL) {
                     ALOGE("%s: No memory for ascii string", __func__);
                     rc = NO_MEMORY;
@@ -2521,7 +2572,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             {
                 if (count > 1) {
                     uint16_t *values =
-                        (uint16_t *)malloc(count * sizeof(uint16_t));
+                        (uint16_t *)allocValue(count * sizeof(uint16_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for short array", __func__);
                         rc = NO_MEMORY;
@@ -2539,7 +2590,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             {
                 if (count > 1) {
                     uint32_t *values =
-                        (uint32_t *)malloc(count * sizeof(uint32_t));
+                        (uint32_t *)allocValue(count * sizeof(uint32_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for long array", __func__);
                         rc = NO_MEMORY;
@@ -2556,7 +2607,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_RATIONAL:
             {
                 if (count > 1) {
-                    rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
+                    rat_t *values = (rat_t *)allocValue(count * sizeof(rat_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for rational array", __func__);
                         rc = NO_MEMORY;
@@ -2572,7 +2623,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             break;
         case EXIF_UNDEFINED:
             {
-                uint8_t *values = (uint8_t *)malloc(count);
+                uint8_t *values = (uint8_t *)allocValue(count);
                 if (values == NULL) {
                     ALOGE("%s: No memory for undefined array", __func__);
                     rc = NO_MEMORY;
@@ -2586,7 +2637,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
             {
                 if (count > 1) {
                     int32_t *values =
-                        (int32_t *)malloc(count * sizeof(int32_t));
+                        (int32_t *)allocValue(count * sizeof(int32_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for signed long array", __func__);
                         rc = NO_MEMORY;
@@ -2603,7 +2654,7 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         case EXIF_SRATIONAL:
             {
                 if (count > 1) {
-                    srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
+                    srat_t *values = (srat_t *)allocValue(count * sizeof(srat_t));
                     if (values == NULL) {
                         ALOGE("%s: No memory for sign rational array",__func__);
                         rc = NO_MEMORY;
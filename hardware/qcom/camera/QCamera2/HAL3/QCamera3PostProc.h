@@ -82,6 +82,7 @@ typedef struct {
 } qcamera_hal3_pp_data_t;
 
 #define MAX_HAL3_EXIF_TABLE_ENTRIES 22
+#define MAX_HAL3_EXIF_ARENA_SIZE    1024
 class QCamera3Exif
 {
 public:
@@ -96,8 +97,15 @@ public:
     QEXIF_INFO_DATA *getEntries() {return m_Entries;};
 
 private:
+    void *allocValue(size_t size);
+    void freeValue(void *value);
+
     QEXIF_INFO_DATA m_Entries[MAX_HAL3_EXIF_TABLE_ENTRIES];  // exif tags for JPEG encoder
     uint32_t  m_nNumEntries;                            // number of valid entries
+    // backing store for tag values, so a capture's exif costs no allocations
+    // beyond the object itself; values that do not fit fall back to malloc
+    uint64_t m_Arena[MAX_HAL3_EXIF_ARENA_SIZE / sizeof(uint64_t)];
+    size_t m_nArenaUsed;
 };
 
 class QCamera3PostProcessor
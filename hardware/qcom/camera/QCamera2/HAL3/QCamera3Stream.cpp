@@ -32,6 +32,7 @@
 
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <utils/Timers.h>
 #include "QCamera3HWI.h"
 #include "QCamera3Stream.h"
 #include "QCamera3Channel.h"
@@ -230,7 +231,7 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
         mNumBufs(0),
         mDataCB(NULL),
         mUserData(NULL),
-        mDataQ(releaseFrameData, this),
+        mDataQ(CAM_MAX_NUM_BUFS_PER_STREAM, releaseFrameData, this),
         mStreamInfoBuf(NULL),
         mStreamBufs(NULL),
         mBufDefs(NULL),
@@ -241,7 +242,12 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
         mBatchBufDefs(NULL),
         mCurrentBatchBufDef(NULL),
         mBufsStaged(0),
-        mFreeBatchBufQ(NULL, this)
+        mFreeBatchBufQ(NULL, this),
+        mPrepareState(BUFS_NOT_PREPARED),
+        mPreparedRegFlags(NULL),
+        mAllocTime(0),
+        mMapTime(0),
+        mBufsPrepared(false)
 {
     mMemVtbl.user_data = this;
     mMemVtbl.get_bufs = get_bufs;
@@ -263,6 +269,14 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
  *==========================================================================*/
 QCamera3Stream::~QCamera3Stream()
 {
+    // buffers prepared for a stream that never started. Channels owning
+    // heap memory release them first, see releasePreparedStreamBufs
+    waitForPreparedBufs();
+    {
+        Mutex::Autolock lock(mLock);
+        releasePreparedBufsLocked(false, NULL);
+    }
+
     if (mStreamInfoBuf != NULL) {
         int rc = mCamOps->unmap_stream_buf(mCamHandle,
                     mChannelHandle, mHandle, CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
@@ -398,6 +412,7 @@ int32_t QCamera3Stream::init(cam_stream_type_t streamType,
     stream_config.mem_vtbl = mMemVtbl;
     stream_config.padding_info = mPaddingInfo;
     stream_config.userdata = this;
+    stream_config.cb_batch = MM_CAMERA_MAX_CB_BATCH;
     stream_config.stream_cb = dataNotifyCB;
 
     rc = mCamOps->config_stream(mCamHandle,
@@ -445,6 +460,9 @@ int32_t QCamera3Stream::start()
 {
     int32_t rc = 0;
 
+    // mm-camera asks for the buffers while holding the channel lock, which
+    // the preparing worker needs for mapping. Wait here, before that.
+    waitForPreparedBufs();
     mDataQ.init();
     if (mBatchSize)
         mFreeBatchBufQ.init();
@@ -466,6 +484,8 @@ int32_t QCamera3Stream::start()
 int32_t QCamera3Stream::stop()
 {
     int32_t rc = 0;
+    // let the stream thread stop waiting for frames and take the exit cmd
+    mDataQ.interrupt();
     rc = mProcTh.exit();
     return rc;
 }
@@ -487,7 +507,12 @@ int32_t QCamera3Stream::processDataNotify(mm_camera_super_buf_t *frame)
     CDBG("%s: E\n", __func__);
     int32_t rc;
     if (mDataQ.enqueue((void *)frame)) {
-        rc = mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        // the ring wakes the stream thread; commands are only needed when
+        // it has no wakeup fd
+        rc = NO_ERROR;
+        if (mDataQ.getWaitFd() < 0) {
+            rc = mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        }
     } else {
         ALOGD("%s: Stream thread is not active, no ops here", __func__);
         bufDone(frame->bufs[0]->buf_idx);
@@ -523,16 +548,43 @@ void QCamera3Stream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         return;
     }
 
-    mm_camera_super_buf_t *frame =
-        (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
-    if (frame == NULL) {
-        ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
-        stream->bufDone(recvd_frame->bufs[0]->buf_idx);
+    if (recvd_frame->num_bufs == 1) {
+        mm_camera_super_buf_t *frame =
+            (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
+        if (frame == NULL) {
+            ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
+            stream->bufDone(recvd_frame->bufs[0]->buf_idx);
+            return;
+        }
+        *frame = *recvd_frame;
+        stream->processDataNotify(frame);
         return;
     }
-    *frame = *recvd_frame;
-    stream->processDataNotify(frame);
-    return;
+
+    // several buffers of this stream dequeued together, queue each as its
+    // own frame
+    bool queued = false;
+    for (uint32_t i = 0; i < recvd_frame->num_bufs; i++) {
+        mm_camera_super_buf_t *frame =
+            (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
+        if (frame == NULL) {
+            ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
+            stream->bufDone(recvd_frame->bufs[i]->buf_idx);
+            continue;
+        }
+        *frame = *recvd_frame;
+        frame->num_bufs = 1;
+        frame->bufs[0] = recvd_frame->bufs[i];
+        if (stream->mDataQ.enqueue((void *)frame)) {
+            queued = true;
+        } else {
+            stream->bufDone(frame->bufs[0]->buf_idx);
+            free(frame);
+        }
+    }
+    if (queued && (stream->mDataQ.getWaitFd() < 0)) {
+        stream->mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    }
 }
 
 /*===========================================================================
@@ -555,6 +607,17 @@ void *QCamera3Stream::dataProcRoutine(void *data)
 
     CDBG("%s: E", __func__);
     do {
+        // Frames are picked up straight from the data ring, which wakes
+        // this thread itself. Commands are looked at once stop()
+        // interrupts the ring, or if the ring cannot wait.
+        if (pme->mDataQ.waitForData(-1)) {
+            pme->processDataQ();
+            continue;
+        }
+        if (!pme->mDataQ.isInterrupted() && (pme->mDataQ.getWaitFd() >= 0)) {
+            continue;
+        }
+
         do {
             ret = cam_sem_wait(&cmdThread->cmd_sem);
             if (ret != 0 && errno != EINVAL) {
@@ -568,22 +631,8 @@ void *QCamera3Stream::dataProcRoutine(void *data)
         camera_cmd_type_t cmd = cmdThread->getCmd();
         switch (cmd) {
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                CDBG("%s: Do next job", __func__);
-                mm_camera_super_buf_t *frame =
-                    (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
-                    if (UNLIKELY(frame->bufs[0]->buf_type ==
-                            CAM_STREAM_BUF_TYPE_USERPTR)) {
-                        pme->handleBatchBuffer(frame);
-                    } else if (pme->mDataCB != NULL) {
-                        pme->mDataCB(frame, pme, pme->mUserData);
-                    } else {
-                        // no data cb routine, return buf here
-                        pme->bufDone(frame->bufs[0]->buf_idx);
-                    }
-                }
-            }
+            CDBG("%s: Do next job", __func__);
+            pme->processDataQ();
             break;
         case CAMERA_CMD_TYPE_EXIT:
             CDBG_HIGH("%s: Exit", __func__);
@@ -600,6 +649,34 @@ void *QCamera3Stream::dataProcRoutine(void *data)
     return NULL;
 }
 
+/*===========================================================================
+ * FUNCTION   : processDataQ
+ *
+ * DESCRIPTION: hand every frame queued in mDataQ to the stream's data
+ *              callback. Runs on the stream thread.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::processDataQ()
+{
+    mm_camera_super_buf_t *frame =
+        (mm_camera_super_buf_t *)mDataQ.dequeue();
+    while (NULL != frame) {
+        if (UNLIKELY(frame->bufs[0]->buf_type ==
+                CAM_STREAM_BUF_TYPE_USERPTR)) {
+            handleBatchBuffer(frame);
+        } else if (mDataCB != NULL) {
+            mDataCB(frame, this, mUserData);
+        } else {
+            // no data cb routine, return buf here
+            bufDone(frame->bufs[0]->buf_idx);
+        }
+        frame = (mm_camera_super_buf_t *)mDataQ.dequeue();
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : bufDone
  *
@@ -736,26 +813,93 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
         return INVALID_OPERATION;
     }
 
-    mFrameLenOffset = *offset;
+    if (mPrepareState == BUFS_PREPARING) {
+        // waiting here would deadlock with the worker, see start()
+        ALOGE("%s: stream buffers are still being prepared", __func__);
+        return INVALID_OPERATION;
+    }
+
     mMemOps = ops_tbl;
 
+    if (mPrepareState == BUFS_PREPARED) {
+        if (offset->frame_len <= mFrameLenOffset.frame_len) {
+            if (0 != memcmp(offset, &mFrameLenOffset, sizeof(mFrameLenOffset))) {
+                // backend changed the plane layout, buffers are big enough
+                mFrameLenOffset = *offset;
+                for (uint32_t i = 0; i < mStreamBufs->getCnt(); i++) {
+                    mStreamBufs->getBufDef(mFrameLenOffset, mBufDefs[i], i);
+                }
+            }
+            *num_bufs = mNumBufs;
+            *initial_reg_flag = mPreparedRegFlags;
+            *bufs = mBufDefs;
+            mPreparedRegFlags = NULL;
+            mPrepareState = BUFS_NOT_PREPARED;
+            return NO_ERROR;
+        }
+        ALOGW("%s: prepared buffers too small (%u < %u), reallocating",
+                __func__, mFrameLenOffset.frame_len, offset->frame_len);
+        // getBufs runs under the channel lock of mm-camera-interface, which
+        // unmapBuf takes as well; unmap through the ops it handed us instead
+        releasePreparedBufsLocked(true, ops_tbl);
+    }
+
+    mFrameLenOffset = *offset;
+    mBufsPrepared = false;
+    rc = allocAndMapBufs(ops_tbl, &regFlags);
+    if (rc != NO_ERROR) {
+        return rc;
+    }
+
+    *num_bufs = mNumBufs;
+    *initial_reg_flag = regFlags;
+    *bufs = mBufDefs;
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocAndMapBufs
+ *
+ * DESCRIPTION: allocate the stream buffers for mFrameLenOffset from the
+ *              channel and map them to the backend
+ *
+ * PARAMETERS :
+ *   @ops_tbl    : ptr to buf mapping/unmapping ops of mm-camera-interface,
+ *                 NULL to map through the camera ops table
+ *   @regFlags   : [output] initial reg flags, to be freed by the consumer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Stream::allocAndMapBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                     uint8_t **regFlags)
+{
+    int rc = NO_ERROR;
+    nsecs_t start = systemTime(CLOCK_MONOTONIC);
+
     mStreamBufs = mChannel->getStreamBufs(mFrameLenOffset.frame_len);
     if (!mStreamBufs) {
         ALOGE("%s: Failed to allocate stream buffers", __func__);
         return NO_MEMORY;
     }
+    nsecs_t allocated = systemTime(CLOCK_MONOTONIC);
 
     uint32_t registeredBuffers = mStreamBufs->getCnt();
     for (uint32_t i = 0; i < registeredBuffers; i++) {
         ssize_t bufSize = mStreamBufs->getSize(i);
         if (BAD_INDEX != bufSize) {
-            rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
-                    (size_t)bufSize, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
+            if (ops_tbl) {
+                rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
+                        (size_t)bufSize, CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+                        ops_tbl->userdata);
+            } else {
+                rc = mapBuf(CAM_MAPPING_BUF_TYPE_STREAM_BUF, i, -1,
+                        mStreamBufs->getFd(i), (size_t)bufSize);
+            }
             if (rc < 0) {
                 ALOGE("%s: map_stream_buf failed: %d", __func__, rc);
-                for (uint32_t j = 0; j < i; j++) {
-                    ops_tbl->unmap_ops(j, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
-                }
+                unmapStreamBufs(i, ops_tbl);
                 return INVALID_OPERATION;
             }
         } else {
@@ -763,26 +907,24 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
             return INVALID_OPERATION;
         }
     }
+    mAllocTime = allocated - start;
+    mMapTime = systemTime(CLOCK_MONOTONIC) - allocated;
 
     //regFlags array is allocated by us, but consumed and freed by mm-camera-interface
-    regFlags = (uint8_t *)malloc(sizeof(uint8_t) * mNumBufs);
-    if (!regFlags) {
+    *regFlags = (uint8_t *)malloc(sizeof(uint8_t) * mNumBufs);
+    if (!*regFlags) {
         ALOGE("%s: Out of memory", __func__);
-        for (uint32_t i = 0; i < registeredBuffers; i++) {
-            ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
-        }
+        unmapStreamBufs(registeredBuffers, ops_tbl);
         return NO_MEMORY;
     }
-    memset(regFlags, 0, sizeof(uint8_t) * mNumBufs);
+    memset(*regFlags, 0, sizeof(uint8_t) * mNumBufs);
 
     mBufDefs = (mm_camera_buf_def_t *)malloc(mNumBufs * sizeof(mm_camera_buf_def_t));
     if (mBufDefs == NULL) {
         ALOGE("%s: Failed to allocate mm_camera_buf_def_t %d", __func__, rc);
-        for (uint32_t i = 0; i < registeredBuffers; i++) {
-            ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
-        }
-        free(regFlags);
-        regFlags = NULL;
+        unmapStreamBufs(registeredBuffers, ops_tbl);
+        free(*regFlags);
+        *regFlags = NULL;
         return INVALID_OPERATION;
     }
     memset(mBufDefs, 0, mNumBufs * sizeof(mm_camera_buf_def_t));
@@ -790,25 +932,205 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
         mStreamBufs->getBufDef(mFrameLenOffset, mBufDefs[i], i);
     }
 
-    rc = mStreamBufs->getRegFlags(regFlags);
+    rc = mStreamBufs->getRegFlags(*regFlags);
     if (rc < 0) {
         ALOGE("%s: getRegFlags failed %d", __func__, rc);
-        for (uint32_t i = 0; i < registeredBuffers; i++) {
-            ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
-        }
+        unmapStreamBufs(registeredBuffers, ops_tbl);
         free(mBufDefs);
         mBufDefs = NULL;
-        free(regFlags);
-        regFlags = NULL;
+        free(*regFlags);
+        *regFlags = NULL;
         return INVALID_OPERATION;
     }
 
-    *num_bufs = mNumBufs;
-    *initial_reg_flag = regFlags;
-    *bufs = mBufDefs;
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : unmapStreamBufs
+ *
+ * DESCRIPTION: unmap the first count stream buffers from the backend
+ *
+ * PARAMETERS :
+ *   @count      : number of buffers to unmap
+ *   @ops_tbl    : ptr to buf mapping/unmapping ops of mm-camera-interface,
+ *                 NULL to unmap through the camera ops table
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::unmapStreamBufs(uint32_t count,
+        mm_camera_map_unmap_ops_tbl_t *ops_tbl)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (ops_tbl) {
+            ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+                    ops_tbl->userdata);
+        } else {
+            unmapBuf(CAM_MAPPING_BUF_TYPE_STREAM_BUF, i, -1);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : prepareBufs
+ *
+ * DESCRIPTION: allocate and map the stream buffers on a worker thread, so
+ *              that getBufs only hands them over when the channel starts.
+ *              Only meant for channels allocating their own heap buffers;
+ *              batch streams keep allocating in getBufs
+ *
+ * PARAMETERS :
+ *   @pool       : worker pool to run the allocation on
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, buffers are allocated in getBufs
+ *==========================================================================*/
+int32_t QCamera3Stream::prepareBufs(QCamera3AllocThreadPool *pool)
+{
+    Mutex::Autolock lock(mLock);
+
+    if (NULL == pool || NULL == mStreamInfo || mBatchSize ||
+            NULL != mBufDefs) {
+        return INVALID_OPERATION;
+    }
+    if (mPrepareState != BUFS_NOT_PREPARED) {
+        return NO_ERROR;
+    }
+
+    // filled in by mm-camera-interface when the stream was configured
+    mFrameLenOffset = mStreamInfo->buf_planes.plane_info;
+    mPrepareState = BUFS_PREPARING;
+    int32_t rc = pool->submit(prepareBufsRoutine, this);
+    if (rc != NO_ERROR) {
+        mPrepareState = BUFS_NOT_PREPARED;
+        memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : prepareBufsRoutine
+ *
+ * DESCRIPTION: worker side of prepareBufs
+ *
+ * PARAMETERS :
+ *   @data       : stream object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::prepareBufsRoutine(void *data)
+{
+    QCamera3Stream *pme = (QCamera3Stream *)data;
+    Mutex::Autolock lock(pme->mLock);
+
+    int32_t rc = pme->allocAndMapBufs(NULL, &pme->mPreparedRegFlags);
+    if (rc == NO_ERROR) {
+        pme->mPrepareState = BUFS_PREPARED;
+        pme->mBufsPrepared = true;
+    } else {
+        ALOGE("%s: failed %d, allocating on start", __func__, rc);
+        if (pme->mStreamBufs) {
+            pme->mChannel->putStreamBufs();
+            pme->mStreamBufs = NULL;
+        }
+        memset(&pme->mFrameLenOffset, 0, sizeof(pme->mFrameLenOffset));
+        pme->mPrepareState = BUFS_NOT_PREPARED;
+    }
+    pme->mPrepareCond.broadcast();
+}
+
+/*===========================================================================
+ * FUNCTION   : waitForPreparedBufs
+ *
+ * DESCRIPTION: block until a pending prepareBufs has finished
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::waitForPreparedBufs()
+{
+    Mutex::Autolock lock(mLock);
+    while (mPrepareState == BUFS_PREPARING) {
+        mPrepareCond.wait(mLock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePreparedBufs
+ *
+ * DESCRIPTION: wait for a pending prepareBufs and return its buffers to the
+ *              channel if the stream never handed them to mm-camera-interface
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::releasePreparedBufs()
+{
+    waitForPreparedBufs();
+    Mutex::Autolock lock(mLock);
+    releasePreparedBufsLocked(true, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePreparedBufsLocked
+ *
+ * DESCRIPTION: drop prepared buffers that were not handed over to
+ *              mm-camera-interface
+ *
+ * PARAMETERS :
+ *   @putChannelBufs : return the memory to the channel as well
+ *   @ops_tbl        : ptr to buf mapping/unmapping ops of mm-camera-interface,
+ *                     NULL when not called from within mm-camera-interface
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::releasePreparedBufsLocked(bool putChannelBufs,
+        mm_camera_map_unmap_ops_tbl_t *ops_tbl)
+{
+    if (mPrepareState != BUFS_PREPARED) {
+        return;
+    }
+
+    unmapStreamBufs(mStreamBufs->getCnt(), ops_tbl);
+    free(mBufDefs);
+    mBufDefs = NULL;
+    free(mPreparedRegFlags);
+    mPreparedRegFlags = NULL;
+    if (putChannelBufs) {
+        mChannel->putStreamBufs();
+    }
+    mStreamBufs = NULL;
+    memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
+    mBufsPrepared = false;
+    mPrepareState = BUFS_NOT_PREPARED;
+}
+
+/*===========================================================================
+ * FUNCTION   : getBufStats
+ *
+ * DESCRIPTION: timings of the last stream buffer allocation
+ *
+ * PARAMETERS :
+ *   @allocTime  : [output] ns spent allocating
+ *   @mapTime    : [output] ns spent mapping to the backend
+ *   @numBufs    : [output] number of buffers
+ *   @prepared   : [output] whether they were prepared on a worker
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::getBufStats(int64_t &allocTime, int64_t &mapTime,
+        uint8_t &numBufs, bool &prepared)
+{
+    Mutex::Autolock lock(mLock);
+    allocTime = mAllocTime;
+    mapTime = mMapTime;
+    numBufs = mNumBufs;
+    prepared = mBufsPrepared;
+}
+
 /*===========================================================================
  * FUNCTION   : putBufs
  *
@@ -32,8 +32,11 @@
 
 #include <hardware/camera3.h>
 #include "utils/Mutex.h"
+#include <utils/Condition.h>
 #include "QCameraCmdThread.h"
+#include "QCameraRingQueue.h"
 #include "QCamera3Mem.h"
+#include "QCamera3AllocThreadPool.h"
 
 extern "C" {
 #include <mm_camera_interface.h>
@@ -90,9 +93,18 @@ public:
     int32_t unmapBuf(uint8_t buf_type, uint32_t buf_idx, int32_t plane_idx);
     int32_t setParameter(cam_stream_parm_buffer_t &param);
 
+    // Allocate and map the stream buffers ahead of start() on a worker
+    int32_t prepareBufs(QCamera3AllocThreadPool *pool);
+    void waitForPreparedBufs();
+    void releasePreparedBufs();
+    void getBufStats(int64_t &allocTime, int64_t &mapTime, uint8_t &numBufs,
+            bool &prepared);
+
     static void releaseFrameData(void *data, void *user_data);
 
 private:
+    void processDataQ();
+
     uint32_t mCamHandle;
     uint32_t mChannelHandle;
     uint32_t mHandle; // stream handle from mm-camera-interface
@@ -104,7 +116,7 @@ private:
     hal3_stream_cb_routine mDataCB;
     void *mUserData;
 
-    QCameraQueue     mDataQ;
+    QCameraRingQueue mDataQ;
     QCameraCmdThread mProcTh; // thread for dataCB
 
     QCamera3HeapMemory *mStreamInfoBuf;
@@ -125,6 +137,18 @@ private:
                              //currentBatchBufDef
     QCameraQueue mFreeBatchBufQ; //Buffer queue containing empty batch buffers
 
+    typedef enum {
+        BUFS_NOT_PREPARED,
+        BUFS_PREPARING,
+        BUFS_PREPARED,
+    } buf_prepare_state_t;
+    buf_prepare_state_t mPrepareState; // protected by mLock
+    Condition mPrepareCond;
+    uint8_t *mPreparedRegFlags;
+    int64_t mAllocTime; // ns spent allocating the current buffers
+    int64_t mMapTime;   // ns spent mapping them to the backend
+    bool mBufsPrepared; // current buffers came from prepareBufs
+
     static int32_t get_bufs(
                      cam_frame_len_offset_t *offset,
                      uint8_t *num_bufs,
@@ -144,6 +168,12 @@ private:
                      mm_camera_buf_def_t **bufs,
                      mm_camera_map_unmap_ops_tbl_t *ops_tbl);
     int32_t putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    int32_t allocAndMapBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl,
+                     uint8_t **regFlags);
+    void unmapStreamBufs(uint32_t count, mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    void releasePreparedBufsLocked(bool putChannelBufs,
+            mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    static void prepareBufsRoutine(void *data);
     int32_t invalidateBuf(uint32_t index);
     int32_t cleanInvalidateBuf(uint32_t index);
     int32_t getBatchBufs(
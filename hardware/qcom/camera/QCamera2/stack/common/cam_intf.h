@@ -818,6 +818,82 @@ static inline void clear_metadata_buffer(metadata_buffer_t *meta)
     meta->is_statsdebug_stats_params_valid = 0;
 }
 
+/*****************************************************************************
+ *                      Sparse (tag list) metadata format                    *
+ ****************************************************************************/
+
+/* Pseudo IDs carrying the blocks of metadata_buffer_t that live outside
+ * metadata_data_t. Update together with clear_metadata_buffer() */
+typedef enum {
+    CAM_META_EXT_TUNING_PARAMS = CAM_INTF_PARM_MAX,
+    CAM_META_EXT_MOBICAT_AEC_PARAMS,
+    CAM_META_EXT_STATSDEBUG_AE,
+    CAM_META_EXT_STATSDEBUG_AWB,
+    CAM_META_EXT_STATSDEBUG_AF,
+    CAM_META_EXT_STATSDEBUG_ASD,
+    CAM_META_EXT_STATSDEBUG_STATS,
+    CAM_META_ID_MAX
+} cam_meta_ext_id_t;
+
+#define CAM_SPARSE_META_MAGIC    0x534d4554 /* "SMET" */
+#define CAM_SPARSE_META_ALIGN    8
+#define CAM_SPARSE_META_PAD(SIZE) \
+        (((SIZE) + CAM_SPARSE_META_ALIGN - 1) & ~(CAM_SPARSE_META_ALIGN - 1))
+
+/* Header of a sparse metadata buffer. It is followed by num_entries
+ * cam_sparse_meta_entry_t records, each immediately followed by its payload
+ * padded to CAM_SPARSE_META_ALIGN. Only entries set for the frame are
+ * present, so the buffer size scales with the number of valid tags */
+typedef struct {
+    uint32_t magic;
+    uint32_t num_entries;
+    uint32_t used;           /* payload bytes used after the header */
+    uint32_t capacity;       /* payload bytes available after the header */
+} cam_sparse_meta_t;
+
+typedef struct {
+    uint32_t meta_id;        /* cam_intf_parm_type_t or cam_meta_ext_id_t */
+    uint32_t size;           /* unpadded payload size */
+} cam_sparse_meta_entry_t;
+
+/* Iterator over the valid entries of either a dense metadata_buffer_t or a
+ * sparse buffer, so translation code can be written once for both */
+typedef struct {
+    const metadata_buffer_t *dense;
+    const cam_sparse_meta_t *sparse;
+    uint32_t pos;            /* next meta id (dense) or byte offset (sparse) */
+    uint32_t index;          /* entries returned so far */
+} cam_meta_iter_t;
+
+#define CAM_SPARSE_META_SIZE(SPARSE_PTR) \
+        ((uint32_t)sizeof(cam_sparse_meta_t) + (SPARSE_PTR)->used)
+
+void *get_pointer_of(cam_intf_parm_type_t meta_id,
+        const metadata_buffer_t* metadata);
+uint32_t get_size_of(cam_intf_parm_type_t param_id);
+
+uint32_t cam_sparse_meta_max_size(void);
+int32_t cam_sparse_meta_init(cam_sparse_meta_t *sparse, uint32_t buf_size);
+int32_t cam_sparse_meta_add(cam_sparse_meta_t *sparse, uint32_t meta_id,
+        const void *data, uint32_t size);
+int32_t cam_sparse_meta_from_dense(cam_sparse_meta_t *sparse,
+        const metadata_buffer_t *meta);
+int32_t cam_sparse_meta_to_dense(metadata_buffer_t *meta,
+        const cam_sparse_meta_t *sparse);
+uint32_t copy_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src);
+uint32_t merge_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src);
+void strip_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src);
+
+void cam_meta_iter_init_dense(cam_meta_iter_t *iter,
+        const metadata_buffer_t *meta);
+void cam_meta_iter_init_sparse(cam_meta_iter_t *iter,
+        const cam_sparse_meta_t *sparse);
+int32_t cam_meta_iter_next(cam_meta_iter_t *iter, uint32_t *meta_id,
+        const void **data, uint32_t *size);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -144,6 +144,9 @@ typedef struct mm_camera_buf_def {
 *              exceeds MAX_STREAM_NUM_IN_BUNDLE
 *    @bufs : array of buffers in the bundle
 **/
+/* max buffers of one stream delivered in a single stream_cb */
+#define MM_CAMERA_MAX_CB_BATCH MAX_STREAM_NUM_IN_BUNDLE
+
 typedef struct {
     uint32_t camera_handle;
     uint32_t ch_id;
@@ -256,6 +259,9 @@ typedef struct {
 *              allocating/deallocating stream buffers
 *    @stream_cb : callback handling stream frame notify
 *    @userdata : user data pointer
+*    @cb_batch : max number of buffers of the stream that stream_cb
+*              accepts in one super buf, up to MM_CAMERA_MAX_CB_BATCH.
+*              0 or 1 delivers one buffer per call
 **/
 typedef struct {
     cam_stream_info_t *stream_info;
@@ -263,6 +269,7 @@ typedef struct {
     mm_camera_stream_mem_vtbl_t mem_vtbl;
     mm_camera_buf_notify_t stream_cb;
     void *userdata;
+    uint8_t cb_batch;
 } mm_camera_stream_config_t;
 
 /** mm_camera_super_buf_notify_mode_t: enum for super uffer
@@ -270,6 +270,15 @@ typedef struct {
   uint32_t h;
 } mm_dimension;
 
+typedef struct {
+  /* jobs of the client queued or in the encoder */
+  uint32_t pending_jobs;
+
+  /* back-pressure watermark, hold new jobs while pending_jobs
+   * is at or above it */
+  uint32_t max_pending_jobs;
+} mm_jpeg_sched_status_t;
+
 typedef struct {
   /* config a job -- async call */
   int (*start_job)(mm_jpeg_job_t* job, uint32_t* job_id);
@@ -286,6 +295,13 @@ typedef struct {
 
   /* close a jpeg client -- sync call */
   int (*close) (uint32_t clientHdl);
+
+  /* get the scheduler load of a client -- sync call */
+  int (*get_sched_status)(uint32_t client_hdl,
+    mm_jpeg_sched_status_t *p_status);
+
+  /* dump scheduler queue depth and latency histograms -- sync call */
+  int (*dump_sched_stats)(int fd);
 } mm_jpeg_ops_t;
 
 typedef struct {
@@ -306,12 +322,24 @@ typedef struct {
   int (*close) (uint32_t clientHdl);
 } mm_jpegdec_ops_t;
 
+typedef enum {
+  /* persist.camera.jpeg.backend ("hw"/"sw"), else OMX if present */
+  MM_JPEG_BACKEND_AUTO,
+  MM_JPEG_BACKEND_OMX,
+  MM_JPEG_BACKEND_SW
+} mm_jpeg_backend_t;
+
 /* open a jpeg client -- sync call
  * returns client_handle.
  * failed if client_handle=0
  * jpeg ops tbl will be filled in if open succeeds */
 uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_dimension picture_size);
 
+/* open a jpeg client of the given encoder backend -- sync call
+ * same contract as jpeg_open, which uses MM_JPEG_BACKEND_AUTO */
+uint32_t jpeg_open_backend(mm_jpeg_ops_t *ops, mm_dimension picture_size,
+  mm_jpeg_backend_t backend);
+
 /* open a jpeg client -- sync call
  * returns client_handle.
  * failed if client_handle=0
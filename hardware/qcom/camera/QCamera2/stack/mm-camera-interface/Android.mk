@@ -8,9 +8,11 @@ MM_CAM_FILES := \
         src/mm_camera_interface.c \
         src/mm_camera.c \
         src/mm_camera_channel.c \
+        src/mm_camera_superbuf_idx.c \
         src/mm_camera_stream.c \
         src/mm_camera_thread.c \
-        src/mm_camera_sock.c
+        src/mm_camera_sock.c \
+        src/cam_intf.c
 
 ifeq ($(strip $(TARGET_USES_ION)),true)
     LOCAL_CFLAGS += -DUSE_ION
@@ -33,8 +33,10 @@
 #include <cam_semaphore.h>
 
 #include "mm_camera_interface.h"
+#include "mm_camera_superbuf_idx.h"
 #include <hardware/camera.h>
 #include <utils/Timers.h>
+#include <camera/CameraFrameTrace.h>
 
 /**********************************************************************************
 * Data structure declare
@@ -77,6 +79,7 @@ typedef enum
     MM_CAMERA_CMD_TYPE_STOP_ZSL, /* stop zsl snapshot for channel */
     MM_CAMERA_CMD_TYPE_FLUSH_QUEUE, /* flush queue */
     MM_CAMERA_CMD_TYPE_GENERAL,  /* general cmd */
+    MM_CAMERA_CMD_TYPE_DATA_BATCH_CB, /* dataCB for several bufs of a stream */
     MM_CAMERA_CMD_TYPE_MAX
 } mm_camera_cmdcb_type_t;
 
@@ -87,6 +90,11 @@ typedef struct {
     mm_camera_buf_def_t *buf; /* ref to buf */
 } mm_camera_buf_info_t;
 
+typedef struct {
+    uint8_t num_bufs;
+    mm_camera_buf_info_t bufs[MM_CAMERA_MAX_CB_BATCH];
+} mm_camera_buf_batch_t;
+
 typedef struct {
     uint32_t num_buf_requested;
     uint32_t num_retro_buf_requested;
@@ -112,6 +120,7 @@ typedef struct {
     mm_camera_cmdcb_type_t cmd_type;
     union {
         mm_camera_buf_info_t buf;    /* frame buf if dataCB */
+        mm_camera_buf_batch_t buf_batch; /* frame bufs if batch dataCB */
         mm_camera_event_t evt;       /* evt if evtCB */
         mm_camera_super_buf_t superbuf; /* superbuf if superbuf dataCB*/
         mm_camera_req_buf_t req_buf; /* num of buf requested */
@@ -155,13 +164,12 @@ typedef struct {
      * for MM_CAMERA_POLL_TYPE_EVT, only index 0 is valid;
      * for MM_CAMERA_POLL_TYPE_DATA, depends on valid stream fd */
     mm_camera_poll_entry_t poll_entries[MAX_STREAM_NUM_IN_BUNDLE];
-    int32_t pfds[2];
+    int32_t epoll_fd; /* epoll set of the entry fds and ctl_fd */
+    int32_t ctl_fd;   /* eventfd to wake up the poll thread for exit */
     pthread_t pid;
     int32_t state;
     int timeoutms;
-    uint32_t cmd;
-    struct pollfd poll_fds[MAX_STREAM_NUM_IN_BUNDLE + 1];
-    uint8_t num_fds;
+    int32_t active_idx; /* entry whose notify_cb is running, -1 if none */
     pthread_mutex_t mutex;
     pthread_cond_t cond_v;
     int32_t status;
@@ -273,6 +281,12 @@ typedef struct mm_stream {
     /*latest timestamp of this stream frame received & last frameID*/
     uint32_t prev_frameID;
     nsecs_t prev_timestamp;
+
+    /* max bufs per stream_cb call, see mm_camera_stream_config_t */
+    uint8_t cb_batch;
+    /* time and size of the last data notify, to pace buffer batching */
+    nsecs_t last_notify_ts;
+    uint8_t last_notify_bufs;
 } mm_stream_t;
 
 /* mm_channel */
@@ -351,6 +365,10 @@ typedef struct {
     uint8_t matched;
     uint8_t expected;
     uint32_t frame_idx;
+    uint32_t stream_mask; /* bit per bundled stream whose buf has arrived */
+    uint8_t idx_collided; /* counted as a collision in unmatched_idx */
+    cam_node_t *q_node; /* node holding this superbuf in the superbuf queue */
+    struct cam_list state_list; /* link in matched or unmatched list */
 } mm_channel_queue_node_t;
 
 typedef struct {
@@ -368,6 +386,13 @@ typedef struct {
     uint32_t once;
     uint32_t frame_skip_count;
     uint32_t nomatch_frame_id;
+    /* superbufs waiting for bundled bufs, in queue order */
+    struct cam_list unmatched_list;
+    uint32_t unmatched_cnt;
+    /* completed superbufs, in order of completion */
+    struct cam_list matched_list;
+    /* frame_idx keyed index of unmatched superbufs */
+    mm_superbuf_idx_t unmatched_idx;
 } mm_channel_queue_t;
 
 typedef struct {
@@ -661,6 +686,19 @@ uint32_t mm_camera_util_generate_handler(uint8_t index);
 const char * mm_camera_util_get_dev_name(uint32_t cam_handler);
 uint8_t mm_camera_util_get_index_by_handler(uint32_t handler);
 
+/* per-frame trace points. The trace ring lives in libcamera_client, which
+ * this library does not link against; stamps are dropped unless the
+ * process hosting the HAL already has it loaded */
+#pragma weak camera_frame_trace
+#define MM_CAMERA_FRAME_TRACE(stage, cam_hdl, frame_idx, aux) \
+    do { \
+        if (camera_frame_trace) { \
+            camera_frame_trace(stage, \
+                    mm_camera_util_get_index_by_handler(cam_hdl), \
+                    frame_idx, aux); \
+        } \
+    } while (0)
+
 /* poll/cmd thread functions */
 extern int32_t mm_camera_poll_thread_launch(
                                 mm_camera_poll_thread_t * poll_cb,
@@ -0,0 +1,75 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_CAMERA_SUPERBUF_IDX_H__
+#define __MM_CAMERA_SUPERBUF_IDX_H__
+
+#include <stdint.h>
+
+/* Number of slots in the frame_idx keyed superbuf index. Only superbufs
+ * still waiting for bundled buffers are indexed, so this only needs to
+ * cover max_unmatched_frames plus the frames in flight between streams. */
+#define MM_SUPERBUF_IDX_SLOTS 64
+
+typedef struct {
+    uint32_t frame_idx;
+    void *data;
+} mm_superbuf_idx_slot_t;
+
+typedef struct {
+    mm_superbuf_idx_slot_t slots[MM_SUPERBUF_IDX_SLOTS];
+    uint32_t count;      /* number of occupied slots */
+    uint32_t collisions; /* entries that could not be indexed */
+} mm_superbuf_idx_t;
+
+void mm_superbuf_idx_init(mm_superbuf_idx_t *idx);
+int32_t mm_superbuf_idx_insert(mm_superbuf_idx_t *idx,
+                               uint32_t frame_idx,
+                               void *data);
+void *mm_superbuf_idx_lookup(mm_superbuf_idx_t *idx, uint32_t frame_idx);
+void mm_superbuf_idx_remove(mm_superbuf_idx_t *idx,
+                            uint32_t frame_idx,
+                            void *data,
+                            uint8_t collided);
+
+/* per-stream arrival bitmask helpers */
+static inline uint32_t mm_superbuf_stream_bit(uint8_t buf_s_idx)
+{
+    return (uint32_t)1 << buf_s_idx;
+}
+
+static inline uint8_t mm_superbuf_mask_complete(uint32_t stream_mask,
+                                                uint8_t num_streams)
+{
+    uint32_t full = (num_streams >= 32) ? 0xFFFFFFFF :
+            (((uint32_t)1 << num_streams) - 1);
+    return (stream_mask & full) == full;
+}
+
+#endif /* __MM_CAMERA_SUPERBUF_IDX_H__ */
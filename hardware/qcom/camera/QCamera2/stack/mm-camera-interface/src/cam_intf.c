@@ -27,11 +27,26 @@
  *
  */
 
+#include <pthread.h>
+#include <stdlib.h>
 #include "cam_intf.h"
 
+/* Offset and size of each metadata_data_t entry, resolved once from the
+ * switches below so per-entry walks avoid them */
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} meta_layout_t;
+
+static meta_layout_t g_meta_layout[CAM_INTF_PARM_MAX];
+static uint8_t g_meta_layout_ready = 0;
+static pthread_once_t g_meta_layout_once = PTHREAD_ONCE_INIT;
+
 void *get_pointer_of(cam_intf_parm_type_t meta_id,
-        const metadata_buffer_t* metadata)
+        const metadata_buffer_t* meta_buf)
 {
+    metadata_buffer_t *metadata = (metadata_buffer_t *)meta_buf;
+
     switch(meta_id) {
         case CAM_INTF_META_HISTOGRAM:
             return POINTER_OF_META(CAM_INTF_META_HISTOGRAM, metadata);
@@ -371,6 +386,24 @@ void *get_pointer_of(cam_intf_parm_type_t meta_id,
           return POINTER_OF_META(CAM_INTF_META_IMGLIB, metadata);
         case CAM_INTF_META_USE_AV_TIMER:
             return POINTER_OF_META(CAM_INTF_META_USE_AV_TIMER, metadata);
+        case CAM_INTF_META_CURRENT_SCENE:
+            return POINTER_OF_META(CAM_INTF_META_CURRENT_SCENE, metadata);
+        case CAM_INTF_PARM_SENSOR_HDR:
+            return POINTER_OF_META(CAM_INTF_PARM_SENSOR_HDR, metadata);
+        case CAM_INTF_PARM_CAPTURE_FRAME_CONFIG:
+            return POINTER_OF_META(CAM_INTF_PARM_CAPTURE_FRAME_CONFIG, metadata);
+        case CAM_INTF_PARM_FLIP:
+            return POINTER_OF_META(CAM_INTF_PARM_FLIP, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_AE:
+            return POINTER_OF_META(CAM_INTF_META_EXIF_DEBUG_AE, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_AWB:
+            return POINTER_OF_META(CAM_INTF_META_EXIF_DEBUG_AWB, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_AF:
+            return POINTER_OF_META(CAM_INTF_META_EXIF_DEBUG_AF, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_ASD:
+            return POINTER_OF_META(CAM_INTF_META_EXIF_DEBUG_ASD, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_STATS:
+            return POINTER_OF_META(CAM_INTF_META_EXIF_DEBUG_STATS, metadata);
         default:
             return NULL;
     }
@@ -718,8 +751,596 @@ uint32_t get_size_of(cam_intf_parm_type_t param_id)
           return SIZE_OF_PARAM(CAM_INTF_META_IMGLIB, metadata);
         case CAM_INTF_META_USE_AV_TIMER:
             return SIZE_OF_PARAM(CAM_INTF_META_USE_AV_TIMER, metadata);
+        case CAM_INTF_META_CURRENT_SCENE:
+            return SIZE_OF_PARAM(CAM_INTF_META_CURRENT_SCENE, metadata);
+        case CAM_INTF_PARM_SENSOR_HDR:
+            return SIZE_OF_PARAM(CAM_INTF_PARM_SENSOR_HDR, metadata);
+        case CAM_INTF_PARM_CAPTURE_FRAME_CONFIG:
+            return SIZE_OF_PARAM(CAM_INTF_PARM_CAPTURE_FRAME_CONFIG, metadata);
+        case CAM_INTF_PARM_FLIP:
+            return SIZE_OF_PARAM(CAM_INTF_PARM_FLIP, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_AE:
+            return SIZE_OF_PARAM(CAM_INTF_META_EXIF_DEBUG_AE, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_AWB:
+            return SIZE_OF_PARAM(CAM_INTF_META_EXIF_DEBUG_AWB, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_AF:
+            return SIZE_OF_PARAM(CAM_INTF_META_EXIF_DEBUG_AF, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_ASD:
+            return SIZE_OF_PARAM(CAM_INTF_META_EXIF_DEBUG_ASD, metadata);
+        case CAM_INTF_META_EXIF_DEBUG_STATS:
+            return SIZE_OF_PARAM(CAM_INTF_META_EXIF_DEBUG_STATS, metadata);
         default:
             return 0;
     }
     return 0;
 }
+
+/*===========================================================================
+ * FUNCTION   : get_ext_block_of
+ *
+ * DESCRIPTION: locate a block of metadata_buffer_t that lives outside
+ *              metadata_data_t, together with its valid flag
+ *
+ * PARAMETERS :
+ *   @meta_id : cam_meta_ext_id_t of the block
+ *   @meta    : dense metadata buffer
+ *   @valid   : [output] pointer to the is_xxx_valid flag of the block
+ *   @size    : [output] size of the block
+ *
+ * RETURN     : pointer to the block, NULL if meta_id is not an ext id
+ *==========================================================================*/
+static void *get_ext_block_of(uint32_t meta_id,
+        const metadata_buffer_t *meta_buf, uint8_t **valid, uint32_t *size)
+{
+    metadata_buffer_t *meta = (metadata_buffer_t *)meta_buf;
+
+    switch (meta_id) {
+    case CAM_META_EXT_TUNING_PARAMS:
+        *valid = &meta->is_tuning_params_valid;
+        *size = sizeof(meta->tuning_params);
+        return &meta->tuning_params;
+    case CAM_META_EXT_MOBICAT_AEC_PARAMS:
+        *valid = &meta->is_mobicat_aec_params_valid;
+        *size = sizeof(meta->mobicat_aec_params);
+        return &meta->mobicat_aec_params;
+    case CAM_META_EXT_STATSDEBUG_AE:
+        *valid = &meta->is_statsdebug_ae_params_valid;
+        *size = sizeof(meta->statsdebug_ae_data);
+        return &meta->statsdebug_ae_data;
+    case CAM_META_EXT_STATSDEBUG_AWB:
+        *valid = &meta->is_statsdebug_awb_params_valid;
+        *size = sizeof(meta->statsdebug_awb_data);
+        return &meta->statsdebug_awb_data;
+    case CAM_META_EXT_STATSDEBUG_AF:
+        *valid = &meta->is_statsdebug_af_params_valid;
+        *size = sizeof(meta->statsdebug_af_data);
+        return &meta->statsdebug_af_data;
+    case CAM_META_EXT_STATSDEBUG_ASD:
+        *valid = &meta->is_statsdebug_asd_params_valid;
+        *size = sizeof(meta->statsdebug_asd_data);
+        return &meta->statsdebug_asd_data;
+    case CAM_META_EXT_STATSDEBUG_STATS:
+        *valid = &meta->is_statsdebug_stats_params_valid;
+        *size = sizeof(meta->statsdebug_stats_buffer_data);
+        return &meta->statsdebug_stats_buffer_data;
+    default:
+        *valid = NULL;
+        *size = 0;
+        return NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : init_meta_layout
+ *
+ * DESCRIPTION: one time fill of g_meta_layout
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void init_meta_layout(void)
+{
+    metadata_buffer_t *meta;
+    uint8_t *ptr;
+    uint32_t id;
+
+    /* Pages are never touched, only addresses are taken */
+    meta = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+    if (NULL == meta) {
+        return;
+    }
+    for (id = 0; id < CAM_INTF_PARM_MAX; id++) {
+        ptr = (uint8_t *)get_pointer_of((cam_intf_parm_type_t)id, meta);
+        g_meta_layout[id].offset = (NULL != ptr) ?
+                (uint32_t)(ptr - (uint8_t *)meta) : 0;
+        g_meta_layout[id].size = (NULL != ptr) ?
+                get_size_of((cam_intf_parm_type_t)id) : 0;
+    }
+    free(meta);
+    g_meta_layout_ready = 1;
+}
+
+/*===========================================================================
+ * FUNCTION   : get_data_entry_of
+ *
+ * DESCRIPTION: locate a metadata_data_t entry through the layout table,
+ *              falling back to the switches if the table is unavailable.
+ *              init_meta_layout must have been run
+ *
+ * PARAMETERS :
+ *   @meta_id : cam_intf_parm_type_t
+ *   @meta    : dense metadata buffer
+ *   @size    : [output] size of the entry
+ *
+ * RETURN     : pointer to the entry, NULL if meta_id has no storage
+ *==========================================================================*/
+static void *get_data_entry_of(uint32_t meta_id,
+        const metadata_buffer_t *meta, uint32_t *size)
+{
+    if (g_meta_layout_ready) {
+        *size = g_meta_layout[meta_id].size;
+        return (0 != *size) ?
+                ((uint8_t *)meta + g_meta_layout[meta_id].offset) : NULL;
+    }
+    *size = get_size_of((cam_intf_parm_type_t)meta_id);
+    return get_pointer_of((cam_intf_parm_type_t)meta_id, meta);
+}
+
+/*===========================================================================
+ * FUNCTION   : next_valid_id
+ *
+ * DESCRIPTION: find the next set is_valid flag at or after start. The flag
+ *              table is scanned a word at a time since most entries are
+ *              not set in a given frame. The lowest set bit of a nonzero
+ *              word gives the index of the first set flag in it
+ *
+ * PARAMETERS :
+ *   @meta  : dense metadata buffer
+ *   @start : first meta id to consider
+ *
+ * RETURN     : meta id of the next valid entry, CAM_INTF_PARM_MAX if none
+ *==========================================================================*/
+static uint32_t next_valid_id(const metadata_buffer_t *meta, uint32_t start)
+{
+    uint32_t id = start;
+    uint64_t word;
+
+    while (id + sizeof(word) <= CAM_INTF_PARM_MAX) {
+        memcpy(&word, &meta->is_valid[id], sizeof(word));
+        if (0 != word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return id + ((uint32_t)__builtin_ctzll(word) >> 3);
+#else
+            break;
+#endif
+        }
+        id += (uint32_t)sizeof(word);
+    }
+    while (id < CAM_INTF_PARM_MAX) {
+        if (meta->is_valid[id]) {
+            return id;
+        }
+        id++;
+    }
+    return CAM_INTF_PARM_MAX;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_sparse_meta_max_size
+ *
+ * DESCRIPTION: worst case size of a sparse buffer, i.e. with every entry
+ *              of metadata_buffer_t set
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : size in bytes
+ *==========================================================================*/
+uint32_t cam_sparse_meta_max_size(void)
+{
+    static uint32_t max_size = 0;
+    metadata_buffer_t *meta = NULL;
+    const uint32_t ext_sizes[] = {
+        sizeof(meta->tuning_params),
+        sizeof(meta->mobicat_aec_params),
+        sizeof(meta->statsdebug_ae_data),
+        sizeof(meta->statsdebug_awb_data),
+        sizeof(meta->statsdebug_af_data),
+        sizeof(meta->statsdebug_asd_data),
+        sizeof(meta->statsdebug_stats_buffer_data),
+    };
+    uint32_t id, size, total;
+
+    if (max_size) {
+        return max_size;
+    }
+
+    total = (uint32_t)sizeof(cam_sparse_meta_t);
+    for (id = 0; id < CAM_META_ID_MAX; id++) {
+        if (id < CAM_INTF_PARM_MAX) {
+            size = get_size_of((cam_intf_parm_type_t)id);
+        } else {
+            size = ext_sizes[id - CAM_INTF_PARM_MAX];
+        }
+        if (size) {
+            total += (uint32_t)sizeof(cam_sparse_meta_entry_t) +
+                    CAM_SPARSE_META_PAD(size);
+        }
+    }
+    max_size = total;
+    return max_size;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_sparse_meta_init
+ *
+ * DESCRIPTION: initialize an empty sparse buffer in place
+ *
+ * PARAMETERS :
+ *   @sparse   : buffer to initialize, CAM_SPARSE_META_ALIGN aligned
+ *   @buf_size : total size of the buffer including the header
+ *
+ * RETURN     : 0 -- success
+ *              -1 -- buffer too small
+ *==========================================================================*/
+int32_t cam_sparse_meta_init(cam_sparse_meta_t *sparse, uint32_t buf_size)
+{
+    if ((NULL == sparse) || (buf_size < sizeof(cam_sparse_meta_t))) {
+        return -1;
+    }
+    sparse->magic = CAM_SPARSE_META_MAGIC;
+    sparse->num_entries = 0;
+    sparse->used = 0;
+    sparse->capacity = buf_size - (uint32_t)sizeof(cam_sparse_meta_t);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_sparse_meta_add
+ *
+ * DESCRIPTION: append one entry to a sparse buffer. If the same meta id is
+ *              added twice the later entry wins when applied
+ *
+ * PARAMETERS :
+ *   @sparse  : sparse buffer
+ *   @meta_id : cam_intf_parm_type_t or cam_meta_ext_id_t
+ *   @data    : payload
+ *   @size    : payload size
+ *
+ * RETURN     : 0 -- success
+ *              -1 -- invalid argument or out of space
+ *==========================================================================*/
+int32_t cam_sparse_meta_add(cam_sparse_meta_t *sparse, uint32_t meta_id,
+        const void *data, uint32_t size)
+{
+    cam_sparse_meta_entry_t *entry;
+    uint32_t need;
+
+    if ((NULL == sparse) || (CAM_SPARSE_META_MAGIC != sparse->magic) ||
+            (meta_id >= CAM_META_ID_MAX) || (NULL == data)) {
+        return -1;
+    }
+    need = (uint32_t)sizeof(cam_sparse_meta_entry_t) + CAM_SPARSE_META_PAD(size);
+    if (sparse->capacity - sparse->used < need) {
+        return -1;
+    }
+
+    entry = (cam_sparse_meta_entry_t *)((uint8_t *)(sparse + 1) + sparse->used);
+    entry->meta_id = meta_id;
+    entry->size = size;
+    memcpy(entry + 1, data, size);
+    sparse->used += need;
+    sparse->num_entries++;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_sparse_meta_from_dense
+ *
+ * DESCRIPTION: encode the valid entries of a dense buffer, e.g. one filled
+ *              by an existing backend, into a sparse buffer. The sparse
+ *              buffer must have been initialized; its contents are replaced
+ *
+ * PARAMETERS :
+ *   @sparse : sparse buffer
+ *   @meta   : dense metadata buffer
+ *
+ * RETURN     : 0 -- success
+ *              -1 -- invalid argument or out of space
+ *==========================================================================*/
+int32_t cam_sparse_meta_from_dense(cam_sparse_meta_t *sparse,
+        const metadata_buffer_t *meta)
+{
+    cam_meta_iter_t iter;
+    uint32_t meta_id, size;
+    const void *data;
+
+    if ((NULL == sparse) || (CAM_SPARSE_META_MAGIC != sparse->magic) ||
+            (NULL == meta)) {
+        return -1;
+    }
+    sparse->num_entries = 0;
+    sparse->used = 0;
+
+    cam_meta_iter_init_dense(&iter, meta);
+    while (cam_meta_iter_next(&iter, &meta_id, &data, &size)) {
+        if (cam_sparse_meta_add(sparse, meta_id, data, size)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_sparse_meta_to_dense
+ *
+ * DESCRIPTION: expand a sparse buffer into a dense metadata_buffer_t for
+ *              consumers that still expect the dense layout. All valid
+ *              flags of the destination are reset first
+ *
+ * PARAMETERS :
+ *   @meta   : dense metadata buffer
+ *   @sparse : sparse buffer
+ *
+ * RETURN     : 0 -- success
+ *              -1 -- malformed sparse buffer or unknown entry
+ *==========================================================================*/
+int32_t cam_sparse_meta_to_dense(metadata_buffer_t *meta,
+        const cam_sparse_meta_t *sparse)
+{
+    cam_meta_iter_t iter;
+    uint32_t meta_id, size, dst_size;
+    const void *data;
+    uint8_t *valid;
+    void *dst;
+
+    if ((NULL == meta) || (NULL == sparse) ||
+            (CAM_SPARSE_META_MAGIC != sparse->magic)) {
+        return -1;
+    }
+    clear_metadata_buffer(meta);
+    pthread_once(&g_meta_layout_once, init_meta_layout);
+
+    cam_meta_iter_init_sparse(&iter, sparse);
+    while (cam_meta_iter_next(&iter, &meta_id, &data, &size)) {
+        if (meta_id < CAM_INTF_PARM_MAX) {
+            dst = get_data_entry_of(meta_id, meta, &dst_size);
+            valid = &meta->is_valid[meta_id];
+        } else {
+            dst = get_ext_block_of(meta_id, meta, &valid, &dst_size);
+        }
+        if ((NULL == dst) || (size > dst_size)) {
+            return -1;
+        }
+        memcpy(dst, data, size);
+        *valid = 1;
+    }
+    return (iter.index == sparse->num_entries) ? 0 : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : copy_metadata_buffer
+ *
+ * DESCRIPTION: copy only the valid entries of one dense buffer into
+ *              another. Entries that are not valid in src are left
+ *              untouched in dst but flagged invalid
+ *
+ * PARAMETERS :
+ *   @dst : destination dense buffer
+ *   @src : source dense buffer
+ *
+ * RETURN     : number of payload bytes copied
+ *==========================================================================*/
+uint32_t copy_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src)
+{
+    cam_meta_iter_t iter;
+    uint32_t meta_id, size, copied = 0;
+    const void *data;
+
+    if ((NULL == dst) || (NULL == src) || (dst == src)) {
+        return 0;
+    }
+
+    cam_meta_iter_init_dense(&iter, src);
+    while (cam_meta_iter_next(&iter, &meta_id, &data, &size)) {
+        memcpy((uint8_t *)dst + ((const uint8_t *)data - (const uint8_t *)src),
+                data, size);
+        copied += size;
+    }
+    memcpy(dst->is_valid, src->is_valid, CAM_INTF_PARM_MAX);
+    dst->is_tuning_params_valid = src->is_tuning_params_valid;
+    dst->is_mobicat_aec_params_valid = src->is_mobicat_aec_params_valid;
+    dst->is_statsdebug_ae_params_valid = src->is_statsdebug_ae_params_valid;
+    dst->is_statsdebug_awb_params_valid = src->is_statsdebug_awb_params_valid;
+    dst->is_statsdebug_af_params_valid = src->is_statsdebug_af_params_valid;
+    dst->is_statsdebug_asd_params_valid = src->is_statsdebug_asd_params_valid;
+    dst->is_statsdebug_stats_params_valid =
+            src->is_statsdebug_stats_params_valid;
+    return copied;
+}
+
+/*===========================================================================
+ * FUNCTION   : merge_metadata_buffer
+ *
+ * DESCRIPTION: copy the valid entries of src over dst and flag them valid.
+ *              Entries valid only in dst are kept
+ *
+ * PARAMETERS :
+ *   @dst : destination dense buffer
+ *   @src : source dense buffer
+ *
+ * RETURN     : number of payload bytes copied
+ *==========================================================================*/
+uint32_t merge_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src)
+{
+    cam_meta_iter_t iter;
+    uint32_t meta_id, size, copied = 0;
+    const void *data;
+    uint8_t *valid;
+    uint32_t offset;
+
+    if ((NULL == dst) || (NULL == src) || (dst == src)) {
+        return 0;
+    }
+
+    cam_meta_iter_init_dense(&iter, src);
+    while (cam_meta_iter_next(&iter, &meta_id, &data, &size)) {
+        offset = (uint32_t)((const uint8_t *)data - (const uint8_t *)src);
+        memcpy((uint8_t *)dst + offset, data, size);
+        if (meta_id < CAM_INTF_PARM_MAX) {
+            dst->is_valid[meta_id] = 1;
+        } else if (NULL != get_ext_block_of(meta_id, dst, &valid, &size)) {
+            *valid = 1;
+        }
+        copied += size;
+    }
+    return copied;
+}
+
+/*===========================================================================
+ * FUNCTION   : strip_metadata_buffer
+ *
+ * DESCRIPTION: flag invalid in dst the entries that are valid in src.
+ *              Counterpart of merge_metadata_buffer
+ *
+ * PARAMETERS :
+ *   @dst : destination dense buffer
+ *   @src : source dense buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void strip_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src)
+{
+    cam_meta_iter_t iter;
+    uint32_t meta_id, size;
+    const void *data;
+    uint8_t *valid;
+
+    if ((NULL == dst) || (NULL == src) || (dst == src)) {
+        return;
+    }
+
+    cam_meta_iter_init_dense(&iter, src);
+    while (cam_meta_iter_next(&iter, &meta_id, &data, &size)) {
+        if (meta_id < CAM_INTF_PARM_MAX) {
+            dst->is_valid[meta_id] = 0;
+        } else if (NULL != get_ext_block_of(meta_id, dst, &valid, &size)) {
+            *valid = 0;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_meta_iter_init_dense
+ *
+ * DESCRIPTION: start iterating the valid entries of a dense buffer
+ *
+ * PARAMETERS :
+ *   @iter : iterator
+ *   @meta : dense metadata buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_meta_iter_init_dense(cam_meta_iter_t *iter,
+        const metadata_buffer_t *meta)
+{
+    pthread_once(&g_meta_layout_once, init_meta_layout);
+    iter->dense = meta;
+    iter->sparse = NULL;
+    iter->pos = 0;
+    iter->index = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_meta_iter_init_sparse
+ *
+ * DESCRIPTION: start iterating the entries of a sparse buffer
+ *
+ * PARAMETERS :
+ *   @iter   : iterator
+ *   @sparse : sparse buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_meta_iter_init_sparse(cam_meta_iter_t *iter,
+        const cam_sparse_meta_t *sparse)
+{
+    iter->dense = NULL;
+    iter->sparse = sparse;
+    iter->pos = 0;
+    iter->index = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_meta_iter_next
+ *
+ * DESCRIPTION: return the next valid entry. Dense buffers yield entries in
+ *              meta id order followed by the ext blocks; sparse buffers
+ *              yield entries in the order they were added
+ *
+ * PARAMETERS :
+ *   @iter    : iterator
+ *   @meta_id : [output] cam_intf_parm_type_t or cam_meta_ext_id_t
+ *   @data    : [output] pointer to the payload
+ *   @size    : [output] payload size
+ *
+ * RETURN     : 1 -- an entry was returned
+ *              0 -- no more entries
+ *==========================================================================*/
+int32_t cam_meta_iter_next(cam_meta_iter_t *iter, uint32_t *meta_id,
+        const void **data, uint32_t *size)
+{
+    const cam_sparse_meta_entry_t *entry;
+    uint8_t *valid;
+    void *ptr;
+
+    if (NULL != iter->sparse) {
+        const cam_sparse_meta_t *sparse = iter->sparse;
+
+        if ((iter->index >= sparse->num_entries) ||
+                (iter->pos + sizeof(*entry) > sparse->used)) {
+            return 0;
+        }
+        entry = (const cam_sparse_meta_entry_t *)
+                ((const uint8_t *)(sparse + 1) + iter->pos);
+        if (iter->pos + sizeof(*entry) + CAM_SPARSE_META_PAD(entry->size) >
+                sparse->used) {
+            return 0;
+        }
+        *meta_id = entry->meta_id;
+        *data = entry + 1;
+        *size = entry->size;
+        iter->pos += (uint32_t)sizeof(*entry) + CAM_SPARSE_META_PAD(entry->size);
+        iter->index++;
+        return 1;
+    }
+
+    if (NULL == iter->dense) {
+        return 0;
+    }
+    while (iter->pos < CAM_INTF_PARM_MAX) {
+        iter->pos = next_valid_id(iter->dense, iter->pos);
+        if (iter->pos >= CAM_INTF_PARM_MAX) {
+            break;
+        }
+        *meta_id = iter->pos;
+        *data = get_data_entry_of(iter->pos++, iter->dense, size);
+        if (NULL != *data) {
+            iter->index++;
+            return 1;
+        }
+    }
+    while (iter->pos < CAM_META_ID_MAX) {
+        ptr = get_ext_block_of(iter->pos, iter->dense, &valid, size);
+        *meta_id = iter->pos++;
+        if ((NULL != ptr) && *valid) {
+            *data = ptr;
+            iter->index++;
+            return 1;
+        }
+    }
+    return 0;
+}
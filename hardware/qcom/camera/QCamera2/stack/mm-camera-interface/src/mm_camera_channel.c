@@ -216,6 +216,14 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                         ch_obj,
                         &ch_obj->bundle.superbuf_queue,
                         &cmd_cb->u.buf);
+    } else if (MM_CAMERA_CMD_TYPE_DATA_BATCH_CB == cmd_cb->cmd_type) {
+        /* several frames of one stream, match them all before dispatching */
+        for (i = 0; i < cmd_cb->u.buf_batch.num_bufs; i++) {
+            mm_channel_superbuf_comp_and_enqueue(
+                            ch_obj,
+                            &ch_obj->bundle.superbuf_queue,
+                            &cmd_cb->u.buf_batch.bufs[i]);
+        }
     } else if (MM_CAMERA_CMD_TYPE_REQ_DATA_CB  == cmd_cb->cmd_type) {
         /* skip frames if needed */
         ch_obj->pending_cnt = cmd_cb->u.req_buf.num_buf_requested;
@@ -2004,6 +2012,11 @@ int32_t mm_channel_unmap_stream_buf(mm_channel_t *my_obj,
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
 {
+    cam_list_init(&queue->unmatched_list);
+    cam_list_init(&queue->matched_list);
+    queue->unmatched_cnt = 0;
+    queue->match_cnt = 0;
+    mm_superbuf_idx_init(&queue->unmatched_idx);
     return cam_queue_init(&queue->que);
 }
 
@@ -2021,7 +2034,227 @@ int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t * queue)
 {
-    return cam_queue_deinit(&queue->que);
+    int32_t rc = cam_queue_deinit(&queue->que);
+    cam_list_init(&queue->unmatched_list);
+    cam_list_init(&queue->matched_list);
+    queue->unmatched_cnt = 0;
+    queue->match_cnt = 0;
+    mm_superbuf_idx_init(&queue->unmatched_idx);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_set_matched
+ *
+ * DESCRIPTION: move a superbuf whose bundled bufs have all arrived from the
+ *              unmatched list and index to the matched list
+ *
+ * PARAMETERS :
+ *   @ch_obj    : channel object
+ *   @queue     : superbuf queue
+ *   @super_buf : superbuf that just became complete
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_set_matched(mm_channel_t *ch_obj,
+                                            mm_channel_queue_t *queue,
+                                            mm_channel_queue_node_t *super_buf)
+{
+    MM_CAMERA_FRAME_TRACE(CAMERA_FRAME_TRACE_SUPERBUF_MATCH,
+            ch_obj->cam_obj->my_hdl, super_buf->frame_idx, ch_obj->my_hdl);
+
+    cam_list_del_node(&super_buf->state_list);
+    mm_superbuf_idx_remove(&queue->unmatched_idx,
+            super_buf->frame_idx, super_buf, super_buf->idx_collided);
+    super_buf->idx_collided = 0;
+    queue->unmatched_cnt--;
+
+    super_buf->matched = 1;
+    cam_list_add_tail_node(&super_buf->state_list, &queue->matched_list);
+    queue->match_cnt++;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_unlink
+ *
+ * DESCRIPTION: remove a superbuf from the superbuf queue, its state list and
+ *              the unmatched index. Caller owns super_buf afterwards.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @super_buf : superbuf to be removed
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_unlink(mm_channel_queue_t *queue,
+                                       mm_channel_queue_node_t *super_buf)
+{
+    cam_list_del_node(&super_buf->state_list);
+    if (super_buf->matched) {
+        queue->match_cnt--;
+    } else {
+        mm_superbuf_idx_remove(&queue->unmatched_idx,
+                super_buf->frame_idx, super_buf, super_buf->idx_collided);
+        super_buf->idx_collided = 0;
+        queue->unmatched_cnt--;
+    }
+
+    if (NULL != super_buf->q_node) {
+        cam_list_del_node(&super_buf->q_node->list);
+        free(super_buf->q_node);
+        super_buf->q_node = NULL;
+        queue->que.size--;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_release
+ *
+ * DESCRIPTION: remove a superbuf from the superbuf queue, return its
+ *              arrived bufs to kernel and free it
+ *
+ * PARAMETERS :
+ *   @ch_obj    : channel object
+ *   @queue     : superbuf queue
+ *   @super_buf : superbuf to be released
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_release(mm_channel_t *ch_obj,
+                                        mm_channel_queue_t *queue,
+                                        mm_channel_queue_node_t *super_buf)
+{
+    uint8_t i;
+
+    mm_channel_superbuf_unlink(queue, super_buf);
+    for (i = 0; i < super_buf->num_of_bufs; i++) {
+        if (super_buf->super_buf[i].frame_idx != 0) {
+            mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
+        }
+    }
+    free(super_buf);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_find_unmatched
+ *
+ * DESCRIPTION: find the unmatched superbuf for a frame idx. Uses the frame
+ *              idx index, and only walks the unmatched list if entries
+ *              could not be indexed due to slot collisions.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @frame_idx : frame idx to look up
+ *
+ * RETURN     : ptr to unmatched superbuf, NULL if none
+ *==========================================================================*/
+static mm_channel_queue_node_t* mm_channel_superbuf_find_unmatched(
+        mm_channel_queue_t *queue, uint32_t frame_idx)
+{
+    struct cam_list *pos = NULL;
+    mm_channel_queue_node_t *super_buf = NULL;
+
+    super_buf = (mm_channel_queue_node_t *)mm_superbuf_idx_lookup(
+            &queue->unmatched_idx, frame_idx);
+    if ((NULL != super_buf) || (0 == queue->unmatched_idx.collisions)) {
+        return super_buf;
+    }
+
+    for (pos = queue->unmatched_list.next; pos != &queue->unmatched_list;
+            pos = pos->next) {
+        super_buf = member_of(pos, mm_channel_queue_node_t, state_list);
+        if (super_buf->frame_idx == frame_idx) {
+            return super_buf;
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_oldest_unmatched
+ *
+ * DESCRIPTION: find the first unmatched superbuf in queue order which is
+ *              older than a frame idx. The unmatched list is kept in
+ *              frame idx order, so only its head needs checking.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @frame_idx : frame idx to compare with
+ *
+ * RETURN     : ptr to unmatched superbuf, NULL if none
+ *==========================================================================*/
+static mm_channel_queue_node_t* mm_channel_superbuf_oldest_unmatched(
+        mm_channel_queue_t *queue, uint32_t frame_idx)
+{
+    mm_channel_queue_node_t *head = NULL;
+
+    if (queue->unmatched_list.next == &queue->unmatched_list) {
+        return NULL;
+    }
+    head = member_of(queue->unmatched_list.next,
+            mm_channel_queue_node_t, state_list);
+    return (head->frame_idx < frame_idx) ? head : NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_next_unmatched
+ *
+ * DESCRIPTION: find the unmatched superbuf a new superbuf for a frame idx
+ *              has to be inserted before, i.e. the first one newer than
+ *              the frame idx. In-order arrivals are resolved from the list
+ *              ends, others by probing the frame idx index. The list is
+ *              only walked if not every unmatched superbuf is indexed.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @frame_idx : frame idx to compare with
+ *
+ * RETURN     : ptr to unmatched superbuf, NULL to append at the tail
+ *==========================================================================*/
+static mm_channel_queue_node_t* mm_channel_superbuf_next_unmatched(
+        mm_channel_queue_t *queue, uint32_t frame_idx)
+{
+    struct cam_list *pos = NULL;
+    mm_channel_queue_node_t *super_buf = NULL;
+    mm_channel_queue_node_t *tail = NULL;
+    uint32_t probe;
+
+    if (queue->unmatched_list.next == &queue->unmatched_list) {
+        return NULL;
+    }
+    tail = member_of(queue->unmatched_list.prev,
+            mm_channel_queue_node_t, state_list);
+    if (tail->frame_idx <= frame_idx) {
+        return NULL;
+    }
+    super_buf = member_of(queue->unmatched_list.next,
+            mm_channel_queue_node_t, state_list);
+    if (super_buf->frame_idx > frame_idx) {
+        return super_buf;
+    }
+
+    /* Frame idxs less than MM_SUPERBUF_IDX_SLOTS apart never share a slot,
+     * so without collisions the first hit is the closest newer superbuf */
+    if ((0 == queue->unmatched_idx.collisions) &&
+            (tail->frame_idx - frame_idx < MM_SUPERBUF_IDX_SLOTS)) {
+        for (probe = frame_idx + 1; probe < tail->frame_idx; probe++) {
+            super_buf = (mm_channel_queue_node_t *)mm_superbuf_idx_lookup(
+                    &queue->unmatched_idx, probe);
+            if (NULL != super_buf) {
+                return super_buf;
+            }
+        }
+        return tail;
+    }
+
+    for (pos = queue->unmatched_list.next; pos != &queue->unmatched_list;
+            pos = pos->next) {
+        super_buf = member_of(pos, mm_channel_queue_node_t, state_list);
+        if (super_buf->frame_idx > frame_idx) {
+            return super_buf;
+        }
+    }
+    return NULL;
 }
 
 /*===========================================================================
@@ -2301,12 +2534,14 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                         mm_channel_queue_t *queue,
                         mm_camera_buf_info_t *buf_info)
 {
-    cam_node_t* node = NULL;
-    struct cam_list *head = NULL;
     struct cam_list *pos = NULL;
+    struct cam_list *stop = NULL;
     mm_channel_queue_node_t* super_buf = NULL;
-    uint8_t buf_s_idx, i, found_super_buf, unmatched_bundles;
-    struct cam_list *last_buf, *insert_before_buf, *last_buf_ptr;
+    mm_channel_queue_node_t* node_buf = NULL;
+    mm_channel_queue_node_t* last_buf = NULL;
+    mm_channel_queue_node_t* insert_before_buf = NULL;
+    uint8_t buf_s_idx;
+    uint32_t buf_bit;
 
     CDBG("%s: E", __func__);
 
@@ -2348,62 +2583,44 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
     /* comp */
     pthread_mutex_lock(&queue->que.lock);
-    head = &queue->que.head.list;
-    /* get the last one in the queue which is possibly having no matching */
-    pos = head->next;
-
-    found_super_buf = 0;
-    unmatched_bundles = 0;
-    last_buf = NULL;
-    insert_before_buf = NULL;
-    last_buf_ptr = NULL;
-
-    while (pos != head) {
-        node = member_of(pos, cam_node_t, list);
-        super_buf = (mm_channel_queue_node_t*)node->data;
-
-        if (NULL != super_buf) {
-            if (super_buf->matched) {
-                /* find a matched super buf, move to next one */
-                pos = pos->next;
-                continue;
-            } else if ( buf_info->frame_idx == super_buf->frame_idx
+    buf_bit = mm_superbuf_stream_bit(buf_s_idx);
+
+    if (((queue->nomatch_frame_id != 0)
+            && (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA))
+            || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
+            && (buf_info->buf->stream_type != CAM_STREAM_TYPE_METADATA))) {
+        /* relaxed bundling, first unmatched superbuf in queue order wins */
+        super_buf = NULL;
+        for (pos = queue->unmatched_list.next; pos != &queue->unmatched_list;
+                pos = pos->next) {
+            node_buf = member_of(pos, mm_channel_queue_node_t, state_list);
+            if ( buf_info->frame_idx == node_buf->frame_idx
                     /*Pick metadata greater than available frameID*/
                     || ((queue->nomatch_frame_id != 0)
                     && (queue->nomatch_frame_id <= buf_info->frame_idx)
-                    && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
+                    && !(node_buf->stream_mask & buf_bit)
                     && (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA))
                     /*Pick available metadata closest to frameID*/
                     || ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
                     && (buf_info->buf->stream_type != CAM_STREAM_TYPE_METADATA)
-                    && (super_buf->super_buf[buf_s_idx].frame_idx == 0)
-                    && (super_buf->frame_idx > buf_info->frame_idx))){
-                /*super buffer frame IDs matching OR In low priority bundling
-                metadata frameID greater than avialbale super buffer frameID  OR
-                metadata frame closest to incoming frameID will be bundled*/
-                found_super_buf = 1;
-                queue->nomatch_frame_id = 0;
+                    && !(node_buf->stream_mask & buf_bit)
+                    && (node_buf->frame_idx > buf_info->frame_idx))){
+                super_buf = node_buf;
                 break;
-            } else {
-                unmatched_bundles++;
-                if ( NULL == last_buf ) {
-                    if ( super_buf->frame_idx < buf_info->frame_idx ) {
-                        last_buf = pos;
-                    }
-                }
-                if ( NULL == insert_before_buf ) {
-                    if ( super_buf->frame_idx > buf_info->frame_idx ) {
-                        insert_before_buf = pos;
-                    }
-                }
-                pos = pos->next;
             }
         }
+    } else {
+        super_buf = mm_channel_superbuf_find_unmatched(queue,
+                buf_info->frame_idx);
     }
 
-    if ( found_super_buf ) {
+    if (NULL != super_buf) {
+        /*super buffer frame IDs matching OR In low priority bundling
+        metadata frameID greater than avialbale super buffer frameID  OR
+        metadata frame closest to incoming frameID will be bundled*/
+        queue->nomatch_frame_id = 0;
 
-        if(super_buf->super_buf[buf_s_idx].frame_idx != 0) {
+        if (super_buf->stream_mask & buf_bit) {
             //This can cause frame drop. We are overwriting same memory.
             pthread_mutex_unlock(&queue->que.lock);
             //CDBG_FATAL("FATAL: frame is already in camera ZSL queue");
@@ -2414,17 +2631,18 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
         /*Insert incoming buffer to super buffer*/
         super_buf->super_buf[buf_s_idx] = *buf_info;
+        super_buf->stream_mask |= buf_bit;
 
         /* check if superbuf is all matched */
-        super_buf->matched = 1;
-        for (i=0; i < super_buf->num_of_bufs; i++) {
-            if (super_buf->super_buf[i].frame_idx == 0) {
-                super_buf->matched = 0;
-                break;
-            }
-        }
+        if (mm_superbuf_mask_complete(super_buf->stream_mask,
+                super_buf->num_of_bufs)) {
+            /* older unmatched superbufs queued ahead of this one */
+            last_buf = mm_channel_superbuf_oldest_unmatched(queue,
+                    buf_info->frame_idx);
+            stop = super_buf->state_list.next;
+
+            mm_channel_superbuf_set_matched(ch_obj, queue, super_buf);
 
-        if (super_buf->matched) {
             if(ch_obj->isFlashBracketingEnabled) {
                queue->expected_frame_id =
                    queue->expected_frame_id_without_led;
@@ -2443,29 +2661,12 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                     __func__, buf_info->frame_idx,
                     queue->attr.post_frame_skip, queue->expected_frame_id);
 
-            queue->match_cnt++;
-
             /* Any older unmatched buffer need to be released */
-            if ( last_buf ) {
-                while ( last_buf != pos ) {
-                    node = member_of(last_buf, cam_node_t, list);
-                    super_buf = (mm_channel_queue_node_t*)node->data;
-                    if (NULL != super_buf) {
-                        for (i=0; i<super_buf->num_of_bufs; i++) {
-                            if (super_buf->super_buf[i].frame_idx != 0) {
-                                mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
-                            }
-                        }
-                        queue->que.size--;
-                        last_buf = last_buf->next;
-                        cam_list_del_node(&node->list);
-                        free(node);
-                        free(super_buf);
-                    } else {
-                        CDBG_ERROR(" %s : Invalid superbuf in queue!", __func__);
-                        break;
-                    }
-                }
+            pos = (NULL != last_buf) ? &last_buf->state_list : stop;
+            while (pos != stop) {
+                node_buf = member_of(pos, mm_channel_queue_node_t, state_list);
+                pos = pos->next;
+                mm_channel_superbuf_release(ch_obj, queue, node_buf);
             }
         }else {
             if (ch_obj->diverted_frame_id == buf_info->frame_idx) {
@@ -2474,46 +2675,35 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
             }
         }
     } else {
-        if ((queue->attr.max_unmatched_frames < unmatched_bundles)
+        last_buf = mm_channel_superbuf_oldest_unmatched(queue,
+                buf_info->frame_idx);
+        insert_before_buf = mm_channel_superbuf_next_unmatched(queue,
+                buf_info->frame_idx);
+
+        if ((queue->attr.max_unmatched_frames < queue->unmatched_cnt)
                 && ( NULL == last_buf )) {
             /* incoming frame is older than the last bundled one */
             mm_channel_qbuf(ch_obj, buf_info->buf);
         } else {
-            last_buf_ptr = last_buf;
-
             /* Loop to remove unmatched frames */
-            while ((queue->attr.max_unmatched_frames < unmatched_bundles)
-                    && (last_buf_ptr != NULL && last_buf_ptr != pos)) {
-                node = member_of(last_buf_ptr, cam_node_t, list);
-                super_buf = (mm_channel_queue_node_t*)node->data;
-                if (NULL != super_buf && super_buf->expected == FALSE
-                        && (&node->list != insert_before_buf)) {
-                    for (i=0; i<super_buf->num_of_bufs; i++) {
-                        if (super_buf->super_buf[i].frame_idx != 0) {
-                            mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
-                        }
-                    }
-                    queue->que.size--;
-                    cam_list_del_node(&node->list);
-                    free(node);
-                    free(super_buf);
-                    unmatched_bundles--;
+            pos = (NULL != last_buf) ? &last_buf->state_list :
+                    &queue->unmatched_list;
+            while ((queue->attr.max_unmatched_frames < queue->unmatched_cnt)
+                    && (pos != &queue->unmatched_list)) {
+                node_buf = member_of(pos, mm_channel_queue_node_t, state_list);
+                pos = pos->next;
+                if (node_buf->expected == FALSE
+                        && node_buf != insert_before_buf) {
+                    mm_channel_superbuf_release(ch_obj, queue, node_buf);
                 }
-                last_buf_ptr = last_buf_ptr->next;
             }
 
-            if (queue->attr.max_unmatched_frames < unmatched_bundles) {
-                node = member_of(last_buf, cam_node_t, list);
-                super_buf = (mm_channel_queue_node_t*)node->data;
-                for (i=0; i<super_buf->num_of_bufs; i++) {
-                    if (super_buf->super_buf[i].frame_idx != 0) {
-                        mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
-                    }
+            if (queue->attr.max_unmatched_frames < queue->unmatched_cnt) {
+                node_buf = mm_channel_superbuf_oldest_unmatched(queue,
+                        buf_info->frame_idx);
+                if (NULL != node_buf) {
+                    mm_channel_superbuf_release(ch_obj, queue, node_buf);
                 }
-                queue->que.size--;
-                cam_list_del_node(&node->list);
-                free(node);
-                free(super_buf);
             }
 
             /* insert the new frame at the appropriate position. */
@@ -2527,8 +2717,10 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                 memset(new_buf, 0, sizeof(mm_channel_queue_node_t));
                 memset(new_node, 0, sizeof(cam_node_t));
                 new_node->data = (void *)new_buf;
+                new_buf->q_node = new_node;
                 new_buf->num_of_bufs = queue->num_streams;
                 new_buf->super_buf[buf_s_idx] = *buf_info;
+                new_buf->stream_mask = buf_bit;
                 new_buf->frame_idx = buf_info->frame_idx;
 
                 if (ch_obj->diverted_frame_id == buf_info->frame_idx) {
@@ -2538,17 +2730,24 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
                 /* enqueue */
                 if ( insert_before_buf ) {
-                    cam_list_insert_before_node(&new_node->list, insert_before_buf);
+                    cam_list_insert_before_node(&new_node->list,
+                            &insert_before_buf->q_node->list);
+                    cam_list_insert_before_node(&new_buf->state_list,
+                            &insert_before_buf->state_list);
                 } else {
                     cam_list_add_tail_node(&new_node->list, &queue->que.head.list);
+                    cam_list_add_tail_node(&new_buf->state_list,
+                            &queue->unmatched_list);
                 }
                 queue->que.size++;
+                queue->unmatched_cnt++;
+                new_buf->idx_collided = (0 != mm_superbuf_idx_insert(
+                        &queue->unmatched_idx, new_buf->frame_idx, new_buf));
 
                 if(queue->num_streams == 1) {
-                    new_buf->matched = 1;
+                    mm_channel_superbuf_set_matched(ch_obj, queue, new_buf);
                     new_buf->expected = FALSE;
                     queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
-                    queue->match_cnt++;
                 }
 
                 if ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
@@ -2610,18 +2809,39 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(mm_channel_queue_t
         }
         if (NULL != super_buf) {
             /* remove from the queue */
-            cam_list_del_node(&node->list);
-            queue->que.size--;
-            if (super_buf->matched == TRUE) {
-                queue->match_cnt--;
-            }
-            free(node);
+            mm_channel_superbuf_unlink(queue, super_buf);
         }
     }
 
     return super_buf;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_dequeue_oldest_matched
+ *
+ * DESCRIPTION: dequeue the head of the superbuf queue if it is matched,
+ *              otherwise the earliest completed superbuf
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *
+ * RETURN     : ptr to a node from superbuf queue, NULL if none matched
+ *==========================================================================*/
+static mm_channel_queue_node_t* mm_channel_superbuf_dequeue_oldest_matched(
+        mm_channel_queue_t * queue)
+{
+    mm_channel_queue_node_t* super_buf = NULL;
+
+    super_buf = mm_channel_superbuf_dequeue_internal(queue, TRUE);
+    if ((NULL == super_buf) &&
+            (queue->matched_list.next != &queue->matched_list)) {
+        super_buf = member_of(queue->matched_list.next,
+                mm_channel_queue_node_t, state_list);
+        mm_channel_superbuf_unlink(queue, super_buf);
+    }
+    return super_buf;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_superbuf_dequeue
  *
@@ -2672,15 +2892,16 @@ int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t* my_obj,
     /* bufdone overflowed bufs */
     pthread_mutex_lock(&queue->que.lock);
     while (queue->match_cnt > queue->attr.water_mark) {
-        super_buf = mm_channel_superbuf_dequeue_internal(queue, TRUE);
-        if (NULL != super_buf) {
-            for (i=0; i<super_buf->num_of_bufs; i++) {
-                if (NULL != super_buf->super_buf[i].buf) {
-                    mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
-                }
+        super_buf = mm_channel_superbuf_dequeue_oldest_matched(queue);
+        if (NULL == super_buf) {
+            break;
+        }
+        for (i=0; i<super_buf->num_of_bufs; i++) {
+            if (NULL != super_buf->super_buf[i].buf) {
+                mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
             }
-            free(super_buf);
         }
+        free(super_buf);
     }
     pthread_mutex_unlock(&queue->que.lock);
     CDBG("%s: after match_cnt=%d, water_mark=%d",
@@ -2716,15 +2937,16 @@ int32_t mm_channel_superbuf_skip(mm_channel_t* my_obj,
     /* bufdone overflowed bufs */
     pthread_mutex_lock(&queue->que.lock);
     while (queue->match_cnt > queue->attr.look_back) {
-        super_buf = mm_channel_superbuf_dequeue_internal(queue, TRUE);
-        if (NULL != super_buf) {
-            for (i=0; i<super_buf->num_of_bufs; i++) {
-                if (NULL != super_buf->super_buf[i].buf) {
-                    mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
-                }
+        super_buf = mm_channel_superbuf_dequeue_oldest_matched(queue);
+        if (NULL == super_buf) {
+            break;
+        }
+        for (i=0; i<super_buf->num_of_bufs; i++) {
+            if (NULL != super_buf->super_buf[i].buf) {
+                mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
             }
-            free(super_buf);
         }
+        free(super_buf);
     }
     pthread_mutex_unlock(&queue->que.lock);
 
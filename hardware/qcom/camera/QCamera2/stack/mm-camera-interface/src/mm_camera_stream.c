@@ -45,6 +45,10 @@
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
 
+/* data notifies closer than this per buffer dequeue several buffers at once,
+ * i.e. streams running above 100fps */
+#define MM_STREAM_BATCH_MAX_INTERVAL_NS 10000000LL
+
 /* internal function decalre */
 int32_t mm_stream_qbuf(mm_stream_t *my_obj,
                        mm_camera_buf_def_t *buf);
@@ -136,23 +140,25 @@ uint32_t mm_stream_get_v4l2_fmt(cam_format_t fmt);
 /*===========================================================================
  * FUNCTION   : mm_stream_notify_channel
  *
- * DESCRIPTION: function to notify channel object on received buffer
+ * DESCRIPTION: function to notify channel object on received buffers
  *
  * PARAMETERS :
  *   @ch_obj  : channel object
- *   @buf_info: ptr to struct storing buffer information
+ *   @buf_info: array of structs storing buffer information
+ *   @num_bufs: number of buffers in buf_info
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              0> -- failure
  *==========================================================================*/
 int32_t mm_stream_notify_channel(struct mm_channel* ch_obj,
-        mm_camera_buf_info_t *buf_info)
+        mm_camera_buf_info_t *buf_info, uint8_t num_bufs)
 {
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    if ((NULL == ch_obj) || (NULL == buf_info)) {
+    if ((NULL == ch_obj) || (NULL == buf_info) || (0 == num_bufs) ||
+            (num_bufs > MM_CAMERA_MAX_CB_BATCH)) {
         CDBG_ERROR("%s : Invalid channel/buffer", __func__);
         return -ENODEV;
     }
@@ -162,8 +168,15 @@ int32_t mm_stream_notify_channel(struct mm_channel* ch_obj,
     node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
     if (NULL != node) {
         memset(node, 0, sizeof(mm_camera_cmdcb_t));
-        node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
-        node->u.buf = *buf_info;
+        if (1 == num_bufs) {
+            node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
+            node->u.buf = *buf_info;
+        } else {
+            node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_BATCH_CB;
+            node->u.buf_batch.num_bufs = num_bufs;
+            memcpy(node->u.buf_batch.bufs, buf_info,
+                    num_bufs * sizeof(mm_camera_buf_info_t));
+        }
 
         /* enqueue to cmd thread */
         cam_queue_enq(&(ch_obj->cmd_thread.cmd_queue), node);
@@ -181,25 +194,37 @@ int32_t mm_stream_notify_channel(struct mm_channel* ch_obj,
 /*===========================================================================
  * FUNCTION   : mm_stream_handle_rcvd_buf
  *
- * DESCRIPTION: function to handle newly received stream buffer
+ * DESCRIPTION: function to handle newly received stream buffers. Buffers
+ *              read in one data notify are passed on with a single command
+ *              to each cmd thread
  *
  * PARAMETERS :
  *   @cam_obj : stream object
- *   @buf_info: ptr to struct storing buffer information
+ *   @buf_info: array of structs storing buffer information
+ *   @num_bufs: number of buffers in buf_info
+ *   @has_cb  : whether there is a stream data callback registered
  *
  * RETURN     : none
  *==========================================================================*/
 void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
                                mm_camera_buf_info_t *buf_info,
+                               uint8_t num_bufs,
                                uint8_t has_cb)
 {
     int32_t rc = 0;
-    CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
-         __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
+    uint8_t i;
+    CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d, num_bufs = %d",
+         __func__, my_obj->my_hdl, my_obj->fd, my_obj->state, num_bufs);
+
+    for (i = 0; i < num_bufs; i++) {
+        MM_CAMERA_FRAME_TRACE(CAMERA_FRAME_TRACE_STREAM_BUF,
+                my_obj->ch_obj->cam_obj->my_hdl, buf_info[i].frame_idx,
+                (uint32_t)buf_info[i].buf->stream_type);
+    }
 
     /* enqueue to super buf thread */
     if (my_obj->is_bundled) {
-        rc = mm_stream_notify_channel(my_obj->ch_obj, buf_info);
+        rc = mm_stream_notify_channel(my_obj->ch_obj, buf_info, num_bufs);
         if (rc < 0) {
             CDBG_ERROR("%s: Unable to notify channel", __func__);
         }
@@ -208,9 +233,11 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
     pthread_mutex_lock(&my_obj->buf_lock);
     if(my_obj->is_linked) {
         /* need to add into super buf for linking, add ref count */
-        my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt++;
+        for (i = 0; i < num_bufs; i++) {
+            my_obj->buf_status[buf_info[i].buf->buf_idx].buf_refcnt++;
+        }
 
-        rc = mm_stream_notify_channel(my_obj->linked_obj, buf_info);
+        rc = mm_stream_notify_channel(my_obj->linked_obj, buf_info, num_bufs);
         if (rc < 0) {
             CDBG_ERROR("%s: Unable to notify channel", __func__);
         }
@@ -224,8 +251,15 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
         node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
         if (NULL != node) {
             memset(node, 0, sizeof(mm_camera_cmdcb_t));
-            node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
-            node->u.buf = *buf_info;
+            if (1 == num_bufs) {
+                node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
+                node->u.buf = *buf_info;
+            } else {
+                node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_BATCH_CB;
+                node->u.buf_batch.num_bufs = num_bufs;
+                memcpy(node->u.buf_batch.bufs, buf_info,
+                        num_bufs * sizeof(mm_camera_buf_info_t));
+            }
 
             /* enqueue to cmd thread */
             cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
@@ -238,6 +272,44 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_get_notify_batch
+ *
+ * DESCRIPTION: decide how many buffers to dequeue in one data notify. At
+ *              high frame rates the poll thread often finds several buffers
+ *              done, reading them together saves a wakeup of the channel
+ *              and stream cmd threads per buffer. At normal rates only one
+ *              is read, so no extra DQBUF is spent on an empty queue
+ *
+ * PARAMETERS :
+ *   @my_obj  : stream object
+ *
+ * RETURN     : max number of buffers to dequeue
+ *==========================================================================*/
+static uint8_t mm_stream_get_notify_batch(mm_stream_t *my_obj)
+{
+    struct timespec ts;
+    nsecs_t now, interval;
+    uint8_t batch = 1;
+
+    if ((my_obj->cb_batch <= 1) ||
+            (my_obj->stream_info->streaming_mode == CAM_STREAMING_MODE_BATCH)) {
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (nsecs_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    if ((my_obj->last_notify_ts != 0) && (my_obj->last_notify_bufs != 0)) {
+        /* average frame interval seen by the last data notify */
+        interval = (now - my_obj->last_notify_ts) / my_obj->last_notify_bufs;
+        if (interval < MM_STREAM_BATCH_MAX_INTERVAL_NS) {
+            batch = my_obj->cb_batch;
+        }
+    }
+    my_obj->last_notify_ts = now;
+    return batch;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_data_notify
  *
@@ -252,8 +324,8 @@ static void mm_stream_data_notify(void* user_data)
 {
     mm_stream_t *my_obj = (mm_stream_t*)user_data;
     int32_t i, rc;
-    uint8_t has_cb = 0, length = 0;
-    mm_camera_buf_info_t buf_info;
+    uint8_t has_cb = 0, length = 0, num_bufs = 0, max_bufs;
+    mm_camera_buf_info_t buf_info[MM_CAMERA_MAX_CB_BATCH];
 
     if (NULL == my_obj) {
         return;
@@ -275,13 +347,22 @@ static void mm_stream_data_notify(void* user_data)
         length = my_obj->frame_offset.num_planes;
     }
 
-    memset(&buf_info, 0, sizeof(mm_camera_buf_info_t));
-    rc = mm_stream_read_msm_frame(my_obj, &buf_info,
+    max_bufs = mm_stream_get_notify_batch(my_obj);
+    memset(buf_info, 0, sizeof(buf_info));
+    rc = mm_stream_read_msm_frame(my_obj, &buf_info[0],
         (uint8_t)length);
     if (rc != 0) {
+        my_obj->last_notify_bufs = 0;
         return;
     }
-    uint32_t idx = buf_info.buf->buf_idx;
+    num_bufs = 1;
+    /* the fd is non-blocking, stop at the first empty DQBUF */
+    while ((num_bufs < max_bufs) &&
+            (0 == mm_stream_read_msm_frame(my_obj, &buf_info[num_bufs],
+                    (uint8_t)length))) {
+        num_bufs++;
+    }
+    my_obj->last_notify_bufs = num_bufs;
 
     pthread_mutex_lock(&my_obj->cb_lock);
     for (i = 0; i < MM_CAMERA_STREAM_BUF_CB_MAX; i++) {
@@ -294,25 +375,31 @@ static void mm_stream_data_notify(void* user_data)
     pthread_mutex_unlock(&my_obj->cb_lock);
 
     pthread_mutex_lock(&my_obj->buf_lock);
-    /* update buffer location */
-    my_obj->buf_status[idx].in_kernel = 0;
+    for (i = 0; i < num_bufs; i++) {
+        uint32_t idx = buf_info[i].buf->buf_idx;
 
-    /* update buf ref count */
-    if (my_obj->is_bundled) {
-        /* need to add into super buf since bundled, add ref count */
-        my_obj->buf_status[idx].buf_refcnt++;
+        /* update buffer location */
+        my_obj->buf_status[idx].in_kernel = 0;
+
+        /* update buf ref count */
+        if (my_obj->is_bundled) {
+            /* need to add into super buf since bundled, add ref count */
+            my_obj->buf_status[idx].buf_refcnt++;
+        }
+        my_obj->buf_status[idx].buf_refcnt =
+            (uint8_t)(my_obj->buf_status[idx].buf_refcnt + has_cb);
     }
-    my_obj->buf_status[idx].buf_refcnt =
-        (uint8_t)(my_obj->buf_status[idx].buf_refcnt + has_cb);
     pthread_mutex_unlock(&my_obj->buf_lock);
 
-    mm_stream_handle_rcvd_buf(my_obj, &buf_info, has_cb);
+    mm_stream_handle_rcvd_buf(my_obj, buf_info, num_bufs, has_cb);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_stream_dispatch_app_data
  *
- * DESCRIPTION: dispatch stream buffer to registered users
+ * DESCRIPTION: dispatch stream buffers to registered users. The callback
+ *              given at config time gets up to cb_batch buffers per call,
+ *              callbacks registered later always get one
  *
  * PARAMETERS :
  *   @cmd_cb  : ptr storing stream buffer information
@@ -324,6 +411,7 @@ static void mm_stream_dispatch_app_data(mm_camera_cmdcb_t *cmd_cb,
                                         void* user_data)
 {
     int i;
+    uint8_t j, k, num_bufs, per_call;
     mm_stream_t * my_obj = (mm_stream_t *)user_data;
     mm_camera_buf_info_t* buf_info = NULL;
     mm_camera_super_buf_t super_buf;
@@ -335,30 +423,43 @@ static void mm_stream_dispatch_app_data(mm_camera_cmdcb_t *cmd_cb,
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
-    if (MM_CAMERA_CMD_TYPE_DATA_CB != cmd_cb->cmd_type) {
+    if (MM_CAMERA_CMD_TYPE_DATA_CB == cmd_cb->cmd_type) {
+        buf_info = &cmd_cb->u.buf;
+        num_bufs = 1;
+    } else if (MM_CAMERA_CMD_TYPE_DATA_BATCH_CB == cmd_cb->cmd_type) {
+        buf_info = cmd_cb->u.buf_batch.bufs;
+        num_bufs = cmd_cb->u.buf_batch.num_bufs;
+    } else {
         CDBG_ERROR("%s: Wrong cmd_type (%d) for dataCB",
                    __func__, cmd_cb->cmd_type);
         return;
     }
 
-    buf_info = &cmd_cb->u.buf;
     memset(&super_buf, 0, sizeof(mm_camera_super_buf_t));
-    super_buf.num_bufs = 1;
-    super_buf.bufs[0] = buf_info->buf;
     super_buf.camera_handle = my_obj->ch_obj->cam_obj->my_hdl;
     super_buf.ch_id = my_obj->ch_obj->my_hdl;
 
     pthread_mutex_lock(&my_obj->cb_lock);
     for(i = 0; i < MM_CAMERA_STREAM_BUF_CB_MAX; i++) {
-        if(NULL != my_obj->buf_cb[i].cb) {
+        per_call = ((0 == i) && (my_obj->cb_batch > 1)) ? num_bufs : 1;
+        for (j = 0; j < num_bufs; j = (uint8_t)(j + per_call)) {
+            if(NULL == my_obj->buf_cb[i].cb) {
+                break;
+            }
             if (my_obj->buf_cb[i].cb_count != 0) {
                 /* if <0, means infinite CB
                  * if >0, means CB for certain times
                  * both case we need to call CB */
+                super_buf.num_bufs = per_call;
+                for (k = 0; k < per_call; k++) {
+                    super_buf.bufs[k] = buf_info[j + k].buf;
+                }
 
                 /* increase buf ref cnt */
                 pthread_mutex_lock(&my_obj->buf_lock);
-                my_obj->buf_status[buf_info->buf->buf_idx].buf_refcnt++;
+                for (k = 0; k < per_call; k++) {
+                    my_obj->buf_status[buf_info[j + k].buf->buf_idx].buf_refcnt++;
+                }
                 pthread_mutex_unlock(&my_obj->buf_lock);
 
                 /* callback */
@@ -380,7 +481,9 @@ static void mm_stream_dispatch_app_data(mm_camera_cmdcb_t *cmd_cb,
     pthread_mutex_unlock(&my_obj->cb_lock);
 
     /* do buf_done since we increased refcnt by one when has_cb */
-    mm_stream_buf_done(my_obj, buf_info->buf);
+    for (j = 0; j < num_bufs; j++) {
+        mm_stream_buf_done(my_obj, buf_info[j].buf);
+    }
 }
 
 /*===========================================================================
@@ -904,6 +1007,12 @@ int32_t mm_stream_config(mm_stream_t *my_obj,
     my_obj->buf_cb[0].cb = config->stream_cb;
     my_obj->buf_cb[0].user_data = config->userdata;
     my_obj->buf_cb[0].cb_count = -1; /* infinite by default */
+    my_obj->cb_batch = config->cb_batch;
+    if (my_obj->cb_batch > MM_CAMERA_MAX_CB_BATCH) {
+        my_obj->cb_batch = MM_CAMERA_MAX_CB_BATCH;
+    }
+    my_obj->last_notify_ts = 0;
+    my_obj->last_notify_bufs = 0;
 
     rc = mm_stream_sync_info(my_obj);
     if (rc == 0) {
@@ -1243,8 +1352,14 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
 
     rc = ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
     if (0 > rc) {
-        CDBG_ERROR("%s: VIDIOC_DQBUF ioctl call failed on stream type %d (rc=%d): %s",
-            __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
+        if (EAGAIN == errno) {
+            /* expected when draining several buffers in one data notify */
+            CDBG("%s: no buffer ready on stream type %d", __func__,
+                my_obj->stream_info->stream_type);
+        } else {
+            CDBG_ERROR("%s: VIDIOC_DQBUF ioctl call failed on stream type %d (rc=%d): %s",
+                __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
+        }
     } else {
         pthread_mutex_lock(&my_obj->buf_lock);
         my_obj->queued_buffer_count--;
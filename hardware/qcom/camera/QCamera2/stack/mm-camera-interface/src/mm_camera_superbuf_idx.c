@@ -0,0 +1,136 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <string.h>
+#include "mm_camera_superbuf_idx.h"
+
+/*===========================================================================
+ * FUNCTION   : mm_superbuf_idx_init
+ *
+ * DESCRIPTION: reset the frame_idx keyed superbuf index
+ *
+ * PARAMETERS :
+ *   @idx     : ptr to index
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_superbuf_idx_init(mm_superbuf_idx_t *idx)
+{
+    memset(idx, 0, sizeof(mm_superbuf_idx_t));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_superbuf_idx_insert
+ *
+ * DESCRIPTION: index an entry by frame_idx. The index is direct mapped, so
+ *              an entry whose slot is already taken by a different frame is
+ *              not indexed and counted as a collision; callers must then
+ *              fall back to a list walk for lookups.
+ *
+ * PARAMETERS :
+ *   @idx       : ptr to index
+ *   @frame_idx : frame idx key
+ *   @data      : entry to be indexed
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- slot collision, entry not indexed
+ *==========================================================================*/
+int32_t mm_superbuf_idx_insert(mm_superbuf_idx_t *idx,
+                               uint32_t frame_idx,
+                               void *data)
+{
+    mm_superbuf_idx_slot_t *slot =
+            &idx->slots[frame_idx % MM_SUPERBUF_IDX_SLOTS];
+
+    if (NULL != slot->data) {
+        idx->collisions++;
+        return -1;
+    }
+    slot->frame_idx = frame_idx;
+    slot->data = data;
+    idx->count++;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_superbuf_idx_lookup
+ *
+ * DESCRIPTION: find the indexed entry for a frame_idx
+ *
+ * PARAMETERS :
+ *   @idx       : ptr to index
+ *   @frame_idx : frame idx key
+ *
+ * RETURN     : indexed entry, NULL if not found
+ *==========================================================================*/
+void *mm_superbuf_idx_lookup(mm_superbuf_idx_t *idx, uint32_t frame_idx)
+{
+    mm_superbuf_idx_slot_t *slot =
+            &idx->slots[frame_idx % MM_SUPERBUF_IDX_SLOTS];
+
+    if ((NULL != slot->data) && (slot->frame_idx == frame_idx)) {
+        return slot->data;
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_superbuf_idx_remove
+ *
+ * DESCRIPTION: drop an entry from the index. Entries that were never indexed
+ *              because of a collision release their collision count. Entries
+ *              that are not in the index otherwise are ignored.
+ *
+ * PARAMETERS :
+ *   @idx       : ptr to index
+ *   @frame_idx : frame idx key
+ *   @data      : entry to be removed
+ *   @collided  : mm_superbuf_idx_insert returned a collision for the entry
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_superbuf_idx_remove(mm_superbuf_idx_t *idx,
+                            uint32_t frame_idx,
+                            void *data,
+                            uint8_t collided)
+{
+    mm_superbuf_idx_slot_t *slot =
+            &idx->slots[frame_idx % MM_SUPERBUF_IDX_SLOTS];
+
+    if (collided) {
+        if (idx->collisions > 0) {
+            idx->collisions--;
+        }
+    } else if ((slot->data == data) && (slot->frame_idx == frame_idx)) {
+        slot->data = NULL;
+        slot->frame_idx = 0;
+        idx->count--;
+    }
+}
@@ -34,239 +34,158 @@
 #include <sys/stat.h>
 #include <sys/prctl.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <cam_semaphore.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
 
-typedef enum {
-    /* poll entries updated */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED,
-    /* poll entries updated asynchronous */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC,
-    /* commit updates */
-    MM_CAMERA_PIPE_CMD_COMMIT,
-    /* exit */
-    MM_CAMERA_PIPE_CMD_EXIT,
-    /* max count */
-    MM_CAMERA_PIPE_CMD_MAX
-} mm_camera_pipe_cmd_type_t;
-
 typedef enum {
     MM_CAMERA_POLL_TASK_STATE_STOPPED,
     MM_CAMERA_POLL_TASK_STATE_POLL,     /* polling pid in polling state. */
     MM_CAMERA_POLL_TASK_STATE_MAX
 } mm_camera_poll_task_state_type_t;
 
-typedef struct {
-    uint32_t cmd;
-    mm_camera_event_t event;
-} mm_camera_sig_evt_t;
-
+/* epoll data of the control eventfd, entries use their index */
+#define MM_CAMERA_POLL_CTL_IDX MAX_STREAM_NUM_IN_BUNDLE
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig_async
+ * FUNCTION   : mm_camera_poll_set_state
  *
- * DESCRIPTION: Asynchoronous call to send a command through pipe.
+ * DESCRIPTION: set a polling state
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @poll_cb : ptr to poll thread object
+ *   @state   : polling state (stopped/polling)
  *
- * RETURN     : int32_t type of status
- *              0  -- success
- *              -1 -- failure
+ * RETURN     : none
  *==========================================================================*/
-static int32_t mm_camera_poll_sig_async(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
+                                     mm_camera_poll_task_state_type_t state)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
-
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-
-    /* send cmd to worker */
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if (len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
-    }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
+    poll_cb->state = state;
 }
 
-
-
-
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_is_self
  *
- * DESCRIPTION: synchorinzed call to send a command through pipe.
+ * DESCRIPTION: check if the caller runs on the polling thread, i.e. from
+ *              within a notify_cb
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @poll_cb : ptr to poll thread object
  *
- * RETURN     : int32_t type of status
- *              0  -- success
- *              -1 -- failure
+ * RETURN     : TRUE if called from the polling thread
  *==========================================================================*/
-static int32_t mm_camera_poll_sig(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+static int mm_camera_poll_is_self(mm_camera_poll_thread_t *poll_cb)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
+    return pthread_equal(pthread_self(), poll_cb->pid);
+}
 
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-    /* send cmd to worker */
-
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if(len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_wait_idle
+ *
+ * DESCRIPTION: wait until no notify_cb of the given entry is running. Must
+ *              be called with poll_cb->mutex held
+ *
+ * PARAMETERS :
+ *   @poll_cb : ptr to poll thread object
+ *   @idx     : entry index, -1 for any entry
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_poll_wait_idle(mm_camera_poll_thread_t *poll_cb,
+                                     int32_t idx)
+{
+    if (mm_camera_poll_is_self(poll_cb)) {
+        /* the callback in flight is our caller */
+        return;
     }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    /* wait till worker task gives positive signal */
-    if (FALSE == poll_cb->status) {
-        CDBG("%s: wait", __func__);
+    while ((poll_cb->active_idx >= 0) &&
+            ((idx < 0) || (poll_cb->active_idx == idx))) {
         pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
     }
-    /* done */
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_get_events
  *
- * DESCRIPTION: signal the status of done
+ * DESCRIPTION: epoll events to watch on entry fds
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
  *
- * RETURN     : none
+ * RETURN     : epoll event mask
  *==========================================================================*/
-static void mm_camera_poll_sig_done(mm_camera_poll_thread_t *poll_cb)
+static uint32_t mm_camera_poll_get_events(mm_camera_poll_thread_t *poll_cb)
 {
-    pthread_mutex_lock(&poll_cb->mutex);
-    poll_cb->status = TRUE;
-    pthread_cond_signal(&poll_cb->cond_v);
-    CDBG("%s: done, in mutex", __func__);
-    pthread_mutex_unlock(&poll_cb->mutex);
+    if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type) {
+        return EPOLLPRI;
+    }
+    return EPOLLIN | EPOLLRDNORM;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_set_state
+ * FUNCTION   : mm_camera_poll_proc_ctl
  *
- * DESCRIPTION: set a polling state
+ * DESCRIPTION: polling thread routine to process the control eventfd. It
+ *              is only signalled to exit the thread
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
- *   @state   : polling state (stopped/polling)
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
-                                     mm_camera_poll_task_state_type_t state)
+static void mm_camera_poll_proc_ctl(mm_camera_poll_thread_t *poll_cb)
 {
-    poll_cb->state = state;
+    uint64_t val = 0;
+    ssize_t read_len = read(poll_cb->ctl_fd, &val, sizeof(val));
+    CDBG("%s: ctl_fd = %d, read_len = %d, val = %llu", __func__,
+         poll_cb->ctl_fd, (int)read_len, (unsigned long long)val);
+    if (read_len == sizeof(val)) {
+        mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_proc_pipe
+ * FUNCTION   : mm_camera_poll_dispatch
  *
- * DESCRIPTION: polling thread routine to process pipe
+ * DESCRIPTION: polling thread routine to call the notify_cb of an entry.
+ *              Entries deleted after epoll_wait returned are skipped
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
+ *   @idx     : entry index
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
+static void mm_camera_poll_dispatch(mm_camera_poll_thread_t *poll_cb,
+                                    uint32_t idx)
 {
-    ssize_t read_len;
-    int i;
-    mm_camera_sig_evt_t cmd_evt;
-    read_len = read(poll_cb->pfds[0], &cmd_evt, sizeof(cmd_evt));
-    CDBG("%s: read_fd = %d, read_len = %d, expect_len = %d cmd = %d",
-         __func__, poll_cb->pfds[0], (int)read_len, (int)sizeof(cmd_evt), cmd_evt.cmd);
-    switch (cmd_evt.cmd) {
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED:
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC:
-        /* we always have index 0 for pipe read */
-        poll_cb->num_fds = 0;
-        poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->pfds[0];
-        poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-        poll_cb->num_fds++;
-
-        if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type &&
-                poll_cb->num_fds < MAX_STREAM_NUM_IN_BUNDLE) {
-            if (poll_cb->poll_entries[0].fd > 0) {
-                /* fd is valid, we update poll_fds */
-                poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[0].fd;
-                poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                poll_cb->num_fds++;
-            }
-        } else if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type &&
-                poll_cb->num_fds <= MAX_STREAM_NUM_IN_BUNDLE) {
-            for(i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
-                if(poll_cb->poll_entries[i].fd > 0) {
-                    /* fd is valid, we update poll_fds to this fd */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[i].fd;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                    poll_cb->num_fds++;
-                } else {
-                    /* fd is invalid, we set the entry to -1 to prevent polling.
-                     * According to spec, polling will not poll on entry with fd=-1.
-                     * If this is not the case, we need to skip these invalid fds
-                     * when updating this array.
-                     * We still keep fd=-1 in this array because this makes easier to
-                     * map cb associated with this fd once incoming data avail by directly
-                     * using the index-1(0 is reserved for pipe read, so need to reduce index by 1) */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = -1;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = 0;
-                    poll_cb->num_fds++;
-                }
-            }
-        }
-        if (cmd_evt.cmd != MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC)
-            mm_camera_poll_sig_done(poll_cb);
-        break;
-
-    case MM_CAMERA_PIPE_CMD_COMMIT:
-        mm_camera_poll_sig_done(poll_cb);
-        break;
-    case MM_CAMERA_PIPE_CMD_EXIT:
-    default:
-        mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
-        mm_camera_poll_sig_done(poll_cb);
-        break;
+    mm_camera_poll_entry_t entry;
+
+    if (idx >= MAX_STREAM_NUM_IN_BUNDLE) {
+        return;
     }
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    entry = poll_cb->poll_entries[idx];
+    if ((entry.fd <= 0) || (NULL == entry.notify_cb)) {
+        pthread_mutex_unlock(&poll_cb->mutex);
+        return;
+    }
+    poll_cb->active_idx = (int32_t)idx;
+    pthread_mutex_unlock(&poll_cb->mutex);
+
+    entry.notify_cb(entry.user_data);
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    poll_cb->active_idx = -1;
+    pthread_cond_broadcast(&poll_cb->cond_v);
+    pthread_mutex_unlock(&poll_cb->mutex);
 }
 
 /*===========================================================================
@@ -281,53 +200,41 @@ static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
  *==========================================================================*/
 static void *mm_camera_poll_fn(mm_camera_poll_thread_t *poll_cb)
 {
+    struct epoll_event events[MAX_STREAM_NUM_IN_BUNDLE + 1];
+    uint32_t mask;
     int rc = 0, i;
 
     if (NULL == poll_cb) {
         CDBG_ERROR("%s: poll_cb is NULL!\n", __func__);
         return NULL;
     }
-    CDBG("%s: poll type = %d, num_fd = %d poll_cb = %p\n",
-         __func__, poll_cb->poll_type, poll_cb->num_fds,poll_cb);
+    CDBG("%s: poll type = %d, epoll_fd = %d poll_cb = %p\n",
+         __func__, poll_cb->poll_type, poll_cb->epoll_fd, poll_cb);
+    mask = mm_camera_poll_get_events(poll_cb);
     do {
-         for(i = 0; i < poll_cb->num_fds; i++) {
-            poll_cb->poll_fds[i].events = POLLIN|POLLRDNORM|POLLPRI;
-         }
-
-         rc = poll(poll_cb->poll_fds, poll_cb->num_fds, poll_cb->timeoutms);
-         if(rc > 0) {
-            if ((poll_cb->poll_fds[0].revents & POLLIN) &&
-                (poll_cb->poll_fds[0].revents & POLLRDNORM)) {
-                /* if we have data on pipe, we only process pipe in this iteration */
-                CDBG("%s: cmd received on pipe\n", __func__);
-                mm_camera_poll_proc_pipe(poll_cb);
-            } else {
-                for(i=1; i<poll_cb->num_fds; i++) {
-                    /* Checking for ctrl events */
-                    if ((poll_cb->poll_type == MM_CAMERA_POLL_TYPE_EVT) &&
-                        (poll_cb->poll_fds[i].revents & POLLPRI)) {
-                        CDBG("%s: mm_camera_evt_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-
-                    if ((MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) &&
-                        (poll_cb->poll_fds[i].revents & POLLIN) &&
-                        (poll_cb->poll_fds[i].revents & POLLRDNORM)) {
-                        CDBG("%s: mm_stream_data_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-                }
+        rc = epoll_wait(poll_cb->epoll_fd, events,
+                (int)(sizeof(events) / sizeof(events[0])), poll_cb->timeoutms);
+        if (rc < 0) {
+            if (errno != EINTR) {
+                /* in error case sleep 10 us and then continue. hard coded here */
+                usleep(10);
             }
-        } else {
-            /* in error case sleep 10 us and then continue. hard coded here */
-            usleep(10);
             continue;
         }
-    } while ((poll_cb != NULL) && (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL));
+
+        for (i = 0; i < rc; i++) {
+            if (MM_CAMERA_POLL_CTL_IDX == events[i].data.u32) {
+                CDBG("%s: cmd received on ctl fd\n", __func__);
+                mm_camera_poll_proc_ctl(poll_cb);
+                continue;
+            }
+            /* for data both IN and RDNORM, for ctrl events PRI */
+            if ((events[i].events & mask) == mask) {
+                CDBG("%s: notify entry %u\n", __func__, events[i].data.u32);
+                mm_camera_poll_dispatch(poll_cb, events[i].data.u32);
+            }
+        }
+    } while (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL);
     return NULL;
 }
 
@@ -346,19 +253,20 @@ static void *mm_camera_poll_thread(void *data)
     prctl(PR_SET_NAME, (unsigned long)"mm_cam_poll_th", 0, 0, 0);
     mm_camera_poll_thread_t *poll_cb = (mm_camera_poll_thread_t *)data;
 
-    /* add pipe read fd into poll first */
-    poll_cb->poll_fds[poll_cb->num_fds++].fd = poll_cb->pfds[0];
-
-    mm_camera_poll_sig_done(poll_cb);
+    pthread_mutex_lock(&poll_cb->mutex);
     mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_POLL);
+    poll_cb->status = TRUE;
+    pthread_cond_signal(&poll_cb->cond_v);
+    pthread_mutex_unlock(&poll_cb->mutex);
     return mm_camera_poll_fn(poll_cb);
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_thread
+ * FUNCTION   : mm_camera_poll_thread_notify_entries_updated
  *
  * DESCRIPTION: notify the polling thread that entries for polling fd have
- *              been updated
+ *              been updated. Updates take effect when they are made, this
+ *              only waits for a notify in flight
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
@@ -367,14 +275,16 @@ static void *mm_camera_poll_thread(void *data)
  *==========================================================================*/
 int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * poll_cb)
 {
-    /* send poll entries updated signal to poll thread */
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
+    return mm_camera_poll_thread_commit_updates(poll_cb);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_commit_updates
  *
- * DESCRIPTION: sync with all previously pending async updates
+ * DESCRIPTION: sync with all previously pending async updates. Entries are
+ *              added to and removed from the epoll set by the caller, so
+ *              this only waits for a notify_cb that may still be running
+ *              for a removed entry
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
@@ -385,13 +295,17 @@ int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * p
  *==========================================================================*/
 int32_t mm_camera_poll_thread_commit_updates(mm_camera_poll_thread_t * poll_cb)
 {
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_COMMIT);
+    pthread_mutex_lock(&poll_cb->mutex);
+    mm_camera_poll_wait_idle(poll_cb, -1);
+    pthread_mutex_unlock(&poll_cb->mutex);
+    return 0;
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_add_poll_fd
  *
- * DESCRIPTION: add a new fd into polling thread
+ * DESCRIPTION: add a new fd into polling thread. The fd is added to the
+ *              epoll set right away, the polling thread is not woken up
  *
  * PARAMETERS :
  *   @poll_cb   : ptr to poll thread object
@@ -413,6 +327,8 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
 {
     int32_t rc = -1;
     uint8_t idx = 0;
+    int32_t old_fd;
+    struct epoll_event ev;
 
     if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
         /* get stream idx from handler if CH type */
@@ -423,16 +339,39 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
     }
 
     if (MAX_STREAM_NUM_IN_BUNDLE > idx) {
-        poll_cb->poll_entries[idx].fd = fd;
-        poll_cb->poll_entries[idx].handler = handler;
-        poll_cb->poll_entries[idx].notify_cb = notify_cb;
-        poll_cb->poll_entries[idx].user_data = userdata;
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
+        memset(&ev, 0, sizeof(ev));
+        ev.events = mm_camera_poll_get_events(poll_cb);
+        ev.data.u32 = idx;
+
+        pthread_mutex_lock(&poll_cb->mutex);
+        old_fd = poll_cb->poll_entries[idx].fd;
+        if ((old_fd > 0) && (old_fd != fd)) {
+            epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_DEL, old_fd, NULL);
+        }
+        rc = epoll_ctl(poll_cb->epoll_fd,
+                (old_fd == fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+        if ((rc < 0) && (EEXIST == errno)) {
+            rc = epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        } else if ((rc < 0) && (ENOENT == errno)) {
+            rc = epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+        if (rc < 0) {
+            CDBG_ERROR("%s: epoll_ctl fd %d failed: %s",
+                       __func__, fd, strerror(errno));
+            poll_cb->poll_entries[idx].fd = -1;
+            poll_cb->poll_entries[idx].handler = 0;
+            poll_cb->poll_entries[idx].notify_cb = NULL;
         } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
+            poll_cb->poll_entries[idx].fd = fd;
+            poll_cb->poll_entries[idx].handler = handler;
+            poll_cb->poll_entries[idx].notify_cb = notify_cb;
+            poll_cb->poll_entries[idx].user_data = userdata;
+            if (call_type == mm_camera_sync_call) {
+                /* a notify of the previous owner may still be running */
+                mm_camera_poll_wait_idle(poll_cb, idx);
+            }
         }
+        pthread_mutex_unlock(&poll_cb->mutex);
     } else {
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
@@ -443,7 +382,9 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_del_poll_fd
  *
- * DESCRIPTION: delete a fd from polling thread
+ * DESCRIPTION: delete a fd from polling thread. The fd is removed from the
+ *              epoll set right away. A sync call also waits for its
+ *              notify_cb to return if the polling thread is running it
  *
  * PARAMETERS :
  *   @poll_cb   : ptr to poll thread object
@@ -469,24 +410,32 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
         idx = 0;
     }
 
-    if ((MAX_STREAM_NUM_IN_BUNDLE > idx) &&
-        (handler == poll_cb->poll_entries[idx].handler)) {
+    if (MAX_STREAM_NUM_IN_BUNDLE <= idx) {
+        CDBG_ERROR("%s: invalid handler %d (%d)",
+                   __func__, handler, idx);
+        return -1;
+    }
+
+    pthread_mutex_lock(&poll_cb->mutex);
+    if (handler == poll_cb->poll_entries[idx].handler) {
+        if (poll_cb->poll_entries[idx].fd > 0) {
+            epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_DEL,
+                    poll_cb->poll_entries[idx].fd, NULL);
+        }
         /* reset poll entry */
         poll_cb->poll_entries[idx].fd = -1; /* set fd to invalid */
         poll_cb->poll_entries[idx].handler = 0;
         poll_cb->poll_entries[idx].notify_cb = NULL;
 
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
+        if (call_type == mm_camera_sync_call) {
+            mm_camera_poll_wait_idle(poll_cb, idx);
         }
+        rc = 0;
     } else {
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
-        return -1;
     }
+    pthread_mutex_unlock(&poll_cb->mutex);
 
     return rc;
 }
@@ -495,21 +444,41 @@ int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
                                      mm_camera_poll_thread_type_t poll_type)
 {
     int32_t rc = 0;
+    struct epoll_event ev;
+
     poll_cb->poll_type = poll_type;
+    poll_cb->active_idx = -1;
 
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
-    rc = pipe(poll_cb->pfds);
-    if(rc < 0) {
-        CDBG_ERROR("%s: pipe open rc=%d\n", __func__, rc);
+    poll_cb->epoll_fd = epoll_create(MAX_STREAM_NUM_IN_BUNDLE + 1);
+    if (poll_cb->epoll_fd < 0) {
+        CDBG_ERROR("%s: epoll_create failed: %s\n", __func__, strerror(errno));
+        return -1;
+    }
+    poll_cb->ctl_fd = eventfd(0, EFD_NONBLOCK);
+    if (poll_cb->ctl_fd < 0) {
+        CDBG_ERROR("%s: eventfd failed: %s\n", __func__, strerror(errno));
+        close(poll_cb->epoll_fd);
+        poll_cb->epoll_fd = -1;
+        return -1;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = MM_CAMERA_POLL_CTL_IDX;
+    rc = epoll_ctl(poll_cb->epoll_fd, EPOLL_CTL_ADD, poll_cb->ctl_fd, &ev);
+    if (rc < 0) {
+        CDBG_ERROR("%s: epoll_ctl ctl fd failed: %s\n", __func__, strerror(errno));
+        close(poll_cb->ctl_fd);
+        close(poll_cb->epoll_fd);
+        poll_cb->ctl_fd = -1;
+        poll_cb->epoll_fd = -1;
         return -1;
     }
 
     poll_cb->timeoutms = -1;  /* Infinite seconds */
 
-    CDBG("%s: poll_type = %d, read fd = %d, write fd = %d timeout = %d",
+    CDBG("%s: poll_type = %d, epoll fd = %d, ctl fd = %d timeout = %d",
         __func__, poll_cb->poll_type,
-        poll_cb->pfds[0], poll_cb->pfds[1],poll_cb->timeoutms);
+        poll_cb->epoll_fd, poll_cb->ctl_fd, poll_cb->timeoutms);
 
     pthread_mutex_init(&poll_cb->mutex, NULL);
     pthread_cond_init(&poll_cb->cond_v, NULL);
@@ -518,7 +487,7 @@ int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
     pthread_mutex_lock(&poll_cb->mutex);
     poll_cb->status = 0;
     pthread_create(&poll_cb->pid, NULL, mm_camera_poll_thread, (void *)poll_cb);
-    if(!poll_cb->status) {
+    while (!poll_cb->status) {
         pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
     }
     if (!poll_cb->threadName) {
@@ -528,37 +497,40 @@ int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
     }
     pthread_mutex_unlock(&poll_cb->mutex);
     CDBG("%s: End",__func__);
-    return rc;
+    return 0;
 }
 
 int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb)
 {
     int32_t rc = 0;
+    uint64_t val = 1;
     if(MM_CAMERA_POLL_TASK_STATE_STOPPED == poll_cb->state) {
         CDBG_ERROR("%s: err, poll thread is not running.\n", __func__);
         return rc;
     }
 
     /* send exit signal to poll thread */
-    mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_EXIT);
+    if (write(poll_cb->ctl_fd, &val, sizeof(val)) != sizeof(val)) {
+        CDBG_ERROR("%s: exit signal failed: %s\n", __func__, strerror(errno));
+    }
     /* wait until poll thread exits */
     if (pthread_join(poll_cb->pid, NULL) != 0) {
         CDBG_ERROR("%s: pthread dead already\n", __func__);
     }
 
-    /* close pipe */
-    if(poll_cb->pfds[0] >= 0) {
-        close(poll_cb->pfds[0]);
+    if (poll_cb->ctl_fd >= 0) {
+        close(poll_cb->ctl_fd);
     }
-    if(poll_cb->pfds[1] >= 0) {
-        close(poll_cb->pfds[1]);
+    if (poll_cb->epoll_fd >= 0) {
+        close(poll_cb->epoll_fd);
     }
 
     pthread_mutex_destroy(&poll_cb->mutex);
     pthread_cond_destroy(&poll_cb->cond_v);
     memset(poll_cb, 0, sizeof(mm_camera_poll_thread_t));
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
+    poll_cb->epoll_fd = -1;
+    poll_cb->ctl_fd = -1;
+    poll_cb->active_idx = -1;
     return rc;
 }
 
@@ -586,6 +558,7 @@ static void *mm_camera_cmd_thread(void *data)
             switch (node->cmd_type) {
             case MM_CAMERA_CMD_TYPE_EVT_CB:
             case MM_CAMERA_CMD_TYPE_DATA_CB:
+            case MM_CAMERA_CMD_TYPE_DATA_BATCH_CB:
             case MM_CAMERA_CMD_TYPE_REQ_DATA_CB:
             case MM_CAMERA_CMD_TYPE_SUPER_BUF_DATA_CB:
             case MM_CAMERA_CMD_TYPE_CONFIG_NOTIFY:
@@ -0,0 +1,84 @@
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+# Host test for the superbuf frame_idx index: mm-camera-superbuf-idx-test
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_SRC_FILES := \
+        mm_camera_superbuf_idx_test.c \
+        ../src/mm_camera_superbuf_idx.c
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../inc
+
+LOCAL_MODULE := mm-camera-superbuf-idx-test
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Sparse vs dense metadata benchmark: mm-camera-meta-bench
+include $(LOCAL_PATH)/../../../../common.mk
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror -D_ANDROID_
+
+LOCAL_SRC_FILES := mm_camera_meta_bench.c
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/../inc \
+        $(LOCAL_PATH)/../../common \
+        system/media/camera/include
+LOCAL_C_INCLUDES += $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_SHARED_LIBRARIES := libmmcamera_interface
+LOCAL_MODULE := mm-camera-meta-bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+
+include $(BUILD_EXECUTABLE)
+
+# Poll thread semantics and latency: mm-camera-poll-thread-test
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror -D_ANDROID_
+
+LOCAL_SRC_FILES := mm_camera_poll_thread_test.c
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/../inc \
+        $(LOCAL_PATH)/../../common \
+        system/media/camera/include
+LOCAL_C_INCLUDES += $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_SHARED_LIBRARIES := libmmcamera_interface
+LOCAL_MODULE := mm-camera-poll-thread-test
+LOCAL_MODULE_TAGS := optional
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+
+include $(BUILD_EXECUTABLE)
+
+# Superbuf matching of the real channel code: mm-camera-superbuf-comp-test
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror -D_ANDROID_
+
+LOCAL_SRC_FILES := mm_camera_superbuf_comp_test.c
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/../inc \
+        $(LOCAL_PATH)/../../common \
+        system/media/camera/include
+LOCAL_C_INCLUDES += $(kernel_includes)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+
+LOCAL_SHARED_LIBRARIES := libmmcamera_interface
+LOCAL_MODULE := mm-camera-superbuf-comp-test
+LOCAL_MODULE_TAGS := optional
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+
+include $(BUILD_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
@@ -0,0 +1,290 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Compares the dense metadata_buffer_t paths against the sparse tag list
+ * format on recorded metadata buffers: full memcpy vs copying valid
+ * entries, probing every tag vs walking the iterator, and encode/decode
+ * cost of the conversion shim.
+ *
+ * Each input file holds one raw metadata_buffer_t, as written from the
+ * metadata stream of the same build. Without input files a synthetic
+ * frame with -t valid tags is used.
+ *
+ * usage: mm-camera-meta-bench [-n iterations] [-t tags] [file ...]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cam_intf.h"
+
+typedef struct {
+    metadata_buffer_t **frames;
+    uint32_t num_frames;
+    uint32_t iterations;
+    metadata_buffer_t *dst;
+    cam_sparse_meta_t *sparse;
+    uint32_t sparse_size;
+} bench_ctx_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static metadata_buffer_t *load_frame(const char *path)
+{
+    metadata_buffer_t *meta;
+    size_t len;
+    FILE *fp = fopen(path, "rb");
+
+    if (NULL == fp) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return NULL;
+    }
+    meta = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+    if (NULL == meta) {
+        fclose(fp);
+        return NULL;
+    }
+    len = fread(meta, 1, sizeof(metadata_buffer_t), fp);
+    fclose(fp);
+    if (len != sizeof(metadata_buffer_t)) {
+        fprintf(stderr, "%s: %zu bytes, expected %zu (different build?)\n",
+                path, len, sizeof(metadata_buffer_t));
+        free(meta);
+        return NULL;
+    }
+    return meta;
+}
+
+static metadata_buffer_t *synth_frame(uint32_t num_tags)
+{
+    metadata_buffer_t *meta;
+    uint32_t i, id;
+
+    meta = (metadata_buffer_t *)calloc(1, sizeof(metadata_buffer_t));
+    if (NULL == meta) {
+        return NULL;
+    }
+    srand(1);
+    for (i = 0; i < num_tags && i < CAM_INTF_PARM_MAX; ) {
+        id = (uint32_t)rand() % CAM_INTF_PARM_MAX;
+        if (!meta->is_valid[id] && get_size_of((cam_intf_parm_type_t)id)) {
+            meta->is_valid[id] = 1;
+            i++;
+        }
+    }
+    return meta;
+}
+
+static void report(const char *name, const bench_ctx_t *ctx, uint64_t ns,
+        uint64_t bytes, uint32_t sum)
+{
+    uint64_t n = (uint64_t)ctx->iterations * ctx->num_frames;
+    printf("%-22s %9llu ns/frame  %9llu bytes/frame  (%u)\n", name,
+            (unsigned long long)(ns / n), (unsigned long long)(bytes / n),
+            sum & 0xff);
+}
+
+static int bench_run(bench_ctx_t *ctx)
+{
+    cam_meta_iter_t iter;
+    uint32_t it, f, id, size, sum;
+    uint64_t start, bytes;
+    const void *data;
+
+    /* memcpy of the whole dense struct */
+    sum = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        for (f = 0; f < ctx->num_frames; f++) {
+            memcpy(ctx->dst, ctx->frames[f], sizeof(metadata_buffer_t));
+            sum += ctx->dst->is_valid[f % CAM_INTF_PARM_MAX];
+        }
+    }
+    report("dense memcpy", ctx, now_ns() - start,
+            (uint64_t)sizeof(metadata_buffer_t) * ctx->iterations *
+            ctx->num_frames, sum);
+
+    /* copy of valid entries only */
+    sum = 0;
+    bytes = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        for (f = 0; f < ctx->num_frames; f++) {
+            bytes += copy_metadata_buffer(ctx->dst, ctx->frames[f]);
+            sum += ctx->dst->is_valid[f % CAM_INTF_PARM_MAX];
+        }
+    }
+    report("copy_metadata_buffer", ctx, now_ns() - start, bytes, sum);
+
+    /* dense -> sparse */
+    bytes = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        for (f = 0; f < ctx->num_frames; f++) {
+            if (cam_sparse_meta_from_dense(ctx->sparse, ctx->frames[f])) {
+                fprintf(stderr, "sparse encode failed on frame %u\n", f);
+                return -1;
+            }
+            bytes += CAM_SPARSE_META_SIZE(ctx->sparse);
+        }
+    }
+    report("sparse encode", ctx, now_ns() - start, bytes,
+            ctx->sparse->num_entries);
+
+    /* sparse -> dense, verified against the source on the last frame */
+    sum = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        if (cam_sparse_meta_to_dense(ctx->dst, ctx->sparse)) {
+            fprintf(stderr, "sparse decode failed\n");
+            return -1;
+        }
+        sum += ctx->dst->is_valid[it % CAM_INTF_PARM_MAX];
+    }
+    report("sparse decode", ctx, (now_ns() - start) * ctx->num_frames,
+            0, sum);
+    if (memcmp(ctx->dst->is_valid, ctx->frames[ctx->num_frames - 1]->is_valid,
+            CAM_INTF_PARM_MAX)) {
+        fprintf(stderr, "sparse round trip mismatch\n");
+        return -1;
+    }
+
+    /* translation access pattern: probe every tag */
+    sum = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        for (f = 0; f < ctx->num_frames; f++) {
+            const metadata_buffer_t *meta = ctx->frames[f];
+            for (id = 0; id < CAM_INTF_PARM_MAX; id++) {
+                if (meta->is_valid[id]) {
+                    data = get_pointer_of((cam_intf_parm_type_t)id, meta);
+                    sum += (NULL != data) ? *(const uint8_t *)data : 0;
+                }
+            }
+        }
+    }
+    report("probe all tags", ctx, now_ns() - start, 0, sum);
+
+    /* translation access pattern: dense iterator */
+    sum = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        for (f = 0; f < ctx->num_frames; f++) {
+            cam_meta_iter_init_dense(&iter, ctx->frames[f]);
+            while (cam_meta_iter_next(&iter, &id, &data, &size)) {
+                sum += (id < CAM_INTF_PARM_MAX) ? *(const uint8_t *)data : 0;
+            }
+        }
+    }
+    report("dense iterator", ctx, now_ns() - start, 0, sum);
+
+    /* translation access pattern: sparse iterator on the last encoding */
+    sum = 0;
+    start = now_ns();
+    for (it = 0; it < ctx->iterations; it++) {
+        cam_meta_iter_init_sparse(&iter, ctx->sparse);
+        while (cam_meta_iter_next(&iter, &id, &data, &size)) {
+            sum += (id < CAM_INTF_PARM_MAX) ? *(const uint8_t *)data : 0;
+        }
+    }
+    report("sparse iterator", ctx, (now_ns() - start) * ctx->num_frames,
+            0, sum);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bench_ctx_t ctx;
+    uint32_t num_tags = 40;
+    uint32_t f;
+    int c, rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.iterations = 1000;
+
+    while ((c = getopt(argc, argv, "n:t:")) != -1) {
+        switch (c) {
+        case 'n':
+            ctx.iterations = (uint32_t)atoi(optarg);
+            break;
+        case 't':
+            num_tags = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-t tags] [file ...]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (0 == ctx.iterations) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    ctx.num_frames = (argc > optind) ? (uint32_t)(argc - optind) : 1;
+    ctx.frames = (metadata_buffer_t **)calloc(ctx.num_frames,
+            sizeof(metadata_buffer_t *));
+    ctx.dst = (metadata_buffer_t *)calloc(1, sizeof(metadata_buffer_t));
+    ctx.sparse_size = cam_sparse_meta_max_size();
+    ctx.sparse = (cam_sparse_meta_t *)malloc(ctx.sparse_size);
+    if ((NULL == ctx.frames) || (NULL == ctx.dst) || (NULL == ctx.sparse)) {
+        fprintf(stderr, "no memory\n");
+        return 1;
+    }
+    cam_sparse_meta_init(ctx.sparse, ctx.sparse_size);
+
+    for (f = 0; f < ctx.num_frames; f++) {
+        ctx.frames[f] = (argc > optind) ? load_frame(argv[optind + (int)f]) :
+                synth_frame(num_tags);
+        if (NULL == ctx.frames[f]) {
+            return 1;
+        }
+    }
+
+    printf("frames %u, iterations %u, dense %zu bytes, sparse max %u bytes\n",
+            ctx.num_frames, ctx.iterations, sizeof(metadata_buffer_t),
+            ctx.sparse_size);
+    rc = bench_run(&ctx);
+
+    for (f = 0; f < ctx.num_frames; f++) {
+        free(ctx.frames[f]);
+    }
+    free(ctx.frames);
+    free(ctx.dst);
+    free(ctx.sparse);
+    return rc ? 1 : 0;
+}
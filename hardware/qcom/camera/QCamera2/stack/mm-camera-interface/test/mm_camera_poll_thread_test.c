@@ -0,0 +1,339 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Drives mm_camera_poll_thread with pipes standing in for V4L2 stream
+ * fds, which likewise report POLLIN|POLLRDNORM when a buffer is done.
+ * Checks the add/del semantics the stream code relies on, then measures
+ * fd registration (stream start/stop) time and the latency from an fd
+ * becoming readable to its notify callback, with every channel poll
+ * thread fully populated.
+ *
+ * usage: mm-camera-poll-thread-test [-c channels] [-n wakeups]
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+#define TEST_MAX_CHANNELS 32
+
+typedef struct {
+    mm_camera_poll_thread_t *poll_cb;
+    uint32_t handler;
+    int fd;                   /* read end, polled */
+    int wr_fd;
+    uint64_t signal_ns;
+    uint64_t lat_ns;
+    uint32_t notified;
+    uint32_t sleep_us;        /* time spent in the callback */
+    int del_in_cb;            /* remove itself async, like a drained stream */
+    sem_t done;
+} test_stream_t;
+
+static int g_failures = 0;
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        g_failures++; \
+    } \
+} while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* stands in for mm_stream_data_notify: "dequeue" and hand off */
+static void test_notify(void *user_data)
+{
+    test_stream_t *s = (test_stream_t *)user_data;
+    uint8_t val;
+
+    if (read(s->fd, &val, sizeof(val)) != sizeof(val)) {
+        return;
+    }
+    s->lat_ns = now_ns() - s->signal_ns;
+    __atomic_add_fetch(&s->notified, 1, __ATOMIC_RELEASE);
+    if (s->sleep_us) {
+        usleep(s->sleep_us);
+    }
+    if (s->del_in_cb) {
+        mm_camera_poll_thread_del_poll_fd(s->poll_cb, s->handler,
+                mm_camera_async_call);
+    }
+    sem_post(&s->done);
+}
+
+static int test_stream_init(test_stream_t *s, mm_camera_poll_thread_t *poll_cb,
+        uint32_t ch, uint32_t idx)
+{
+    int fds[2];
+
+    memset(s, 0, sizeof(*s));
+    s->poll_cb = poll_cb;
+    /* the data poll thread takes the entry index from the low byte */
+    s->handler = ((ch + 1) << 8) | idx;
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    s->fd = fds[0];
+    s->wr_fd = fds[1];
+    sem_init(&s->done, 0, 0);
+    return s->fd;
+}
+
+static void test_stream_deinit(test_stream_t *s)
+{
+    close(s->fd);
+    close(s->wr_fd);
+    sem_destroy(&s->done);
+}
+
+static void test_signal(test_stream_t *s)
+{
+    uint8_t val = 1;
+    s->signal_ns = now_ns();
+    if (write(s->wr_fd, &val, sizeof(val)) != sizeof(val)) {
+        printf("pipe write failed\n");
+    }
+}
+
+static int test_wait(test_stream_t *s, uint32_t timeout_ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return sem_timedwait(&s->done, &ts);
+}
+
+static int test_add(test_stream_t *s, mm_camera_call_type_t call_type)
+{
+    return mm_camera_poll_thread_add_poll_fd(s->poll_cb, s->handler, s->fd,
+            test_notify, s, call_type);
+}
+
+static void test_semantics(void)
+{
+    mm_camera_poll_thread_t poll_cb;
+    test_stream_t s[2];
+
+    memset(&poll_cb, 0, sizeof(poll_cb));
+    TEST_CHECK(0 == mm_camera_poll_thread_launch(&poll_cb,
+            MM_CAMERA_POLL_TYPE_DATA));
+    TEST_CHECK(test_stream_init(&s[0], &poll_cb, 0, 0) >= 0);
+    TEST_CHECK(test_stream_init(&s[1], &poll_cb, 0, 1) >= 0);
+
+    /* async add is effective on return */
+    TEST_CHECK(0 == test_add(&s[0], mm_camera_async_call));
+    test_signal(&s[0]);
+    TEST_CHECK(0 == test_wait(&s[0], 1000));
+    TEST_CHECK(1 == s[0].notified);
+
+    /* no notify after a sync del, even with data pending */
+    TEST_CHECK(0 == mm_camera_poll_thread_del_poll_fd(&poll_cb, s[0].handler,
+            mm_camera_sync_call));
+    test_signal(&s[0]);
+    TEST_CHECK(0 != test_wait(&s[0], 50));
+    TEST_CHECK(1 == s[0].notified);
+    /* deleting twice fails, as the stream code expects */
+    TEST_CHECK(0 > mm_camera_poll_thread_del_poll_fd(&poll_cb, s[0].handler,
+            mm_camera_sync_call));
+
+    /* re-add picks up the pending data */
+    TEST_CHECK(0 == test_add(&s[0], mm_camera_async_call));
+    TEST_CHECK(0 == test_wait(&s[0], 1000));
+    TEST_CHECK(2 == s[0].notified);
+
+    /* the callback removes its own fd without deadlocking */
+    s[0].del_in_cb = 1;
+    test_signal(&s[0]);
+    TEST_CHECK(0 == test_wait(&s[0], 1000));
+    test_signal(&s[0]);
+    TEST_CHECK(0 != test_wait(&s[0], 50));
+    TEST_CHECK(3 == s[0].notified);
+    /* streamoff after that: del fails, commit syncs */
+    TEST_CHECK(0 > mm_camera_poll_thread_del_poll_fd(&poll_cb, s[0].handler,
+            mm_camera_sync_call));
+    TEST_CHECK(0 == mm_camera_poll_thread_commit_updates(&poll_cb));
+
+    /* a sync del returns only after a running callback is done */
+    s[1].sleep_us = 50000;
+    TEST_CHECK(0 == test_add(&s[1], mm_camera_async_call));
+    test_signal(&s[1]);
+    while (0 == __atomic_load_n(&s[1].notified, __ATOMIC_ACQUIRE)) {
+        usleep(100);
+    }
+    TEST_CHECK(0 == mm_camera_poll_thread_del_poll_fd(&poll_cb, s[1].handler,
+            mm_camera_sync_call));
+    TEST_CHECK(0 == sem_trywait(&s[1].done));
+
+    mm_camera_poll_thread_release(&poll_cb);
+    test_stream_deinit(&s[0]);
+    test_stream_deinit(&s[1]);
+}
+
+static void test_bench(uint32_t num_channels, uint32_t num_wakeups)
+{
+    mm_camera_poll_thread_t *poll_cbs;
+    test_stream_t *streams;
+    uint64_t *lat_ns;
+    uint32_t num_streams = num_channels * MAX_STREAM_NUM_IN_BUNDLE;
+    uint32_t ch, i;
+    uint64_t start, start_ns, stop_ns, launch_ns;
+
+    poll_cbs = (mm_camera_poll_thread_t *)calloc(num_channels,
+            sizeof(mm_camera_poll_thread_t));
+    streams = (test_stream_t *)calloc(num_streams, sizeof(test_stream_t));
+    lat_ns = (uint64_t *)calloc(num_wakeups, sizeof(uint64_t));
+    if (NULL == poll_cbs || NULL == streams || NULL == lat_ns) {
+        printf("no memory\n");
+        g_failures++;
+        goto done;
+    }
+
+    start = now_ns();
+    for (ch = 0; ch < num_channels; ch++) {
+        mm_camera_poll_thread_launch(&poll_cbs[ch], MM_CAMERA_POLL_TYPE_DATA);
+        for (i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
+            test_stream_init(&streams[ch * MAX_STREAM_NUM_IN_BUNDLE + i],
+                    &poll_cbs[ch], ch, i);
+        }
+    }
+    launch_ns = now_ns() - start;
+
+    /* stream start registers the fd with the first queued buffer */
+    start = now_ns();
+    for (i = 0; i < num_streams; i++) {
+        TEST_CHECK(0 == test_add(&streams[i], mm_camera_async_call));
+    }
+    start_ns = now_ns() - start;
+
+    for (i = 0; i < num_wakeups; i++) {
+        test_stream_t *s = &streams[(uint32_t)rand() % num_streams];
+        test_signal(s);
+        if (0 != test_wait(s, 1000)) {
+            printf("wakeup %u lost\n", i);
+            g_failures++;
+            break;
+        }
+        lat_ns[i] = s->lat_ns;
+    }
+
+    /* stream stop removes the fd synchronously */
+    start = now_ns();
+    for (i = 0; i < num_streams; i++) {
+        TEST_CHECK(0 == mm_camera_poll_thread_del_poll_fd(
+                streams[i].poll_cb, streams[i].handler, mm_camera_sync_call));
+    }
+    stop_ns = now_ns() - start;
+
+    qsort(lat_ns, num_wakeups, sizeof(uint64_t), cmp_u64);
+    printf("channels %u streams %u: launch %llu us, start %llu ns/stream, "
+            "stop %llu ns/stream\n", num_channels, num_streams,
+            (unsigned long long)(launch_ns / 1000),
+            (unsigned long long)(start_ns / num_streams),
+            (unsigned long long)(stop_ns / num_streams));
+    printf("wakeups %u: lat p50 %llu ns  p99 %llu ns  max %llu ns\n",
+            num_wakeups,
+            (unsigned long long)lat_ns[num_wakeups / 2],
+            (unsigned long long)lat_ns[(uint64_t)num_wakeups * 99 / 100],
+            (unsigned long long)lat_ns[num_wakeups - 1]);
+
+    for (ch = 0; ch < num_channels; ch++) {
+        mm_camera_poll_thread_release(&poll_cbs[ch]);
+    }
+    for (i = 0; i < num_streams; i++) {
+        test_stream_deinit(&streams[i]);
+    }
+
+done:
+    free(poll_cbs);
+    free(streams);
+    free(lat_ns);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t num_channels = 4;
+    uint32_t num_wakeups = 20000;
+    int c;
+
+    while ((c = getopt(argc, argv, "c:n:")) != -1) {
+        switch (c) {
+        case 'c':
+            num_channels = (uint32_t)atoi(optarg);
+            break;
+        case 'n':
+            num_wakeups = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c channels] [-n wakeups]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_channels == 0 || num_channels > TEST_MAX_CHANNELS ||
+            num_wakeups == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    srand(1);
+    test_semantics();
+    test_bench(num_channels, num_wakeups);
+
+    if (g_failures) {
+        printf("FAILED: %d checks\n", g_failures);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,403 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Drives mm_channel_superbuf_comp_and_enqueue itself with buffers from
+ * several bundled streams arriving with out of order frame_idx, and checks
+ * the superbufs it completes, its unmatched list order and frame_idx index,
+ * and its pruning against a plain reference model. Streams are left in the
+ * INITED state, so buffers the channel drops are never queued to a kernel
+ * driver. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+extern int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t *queue);
+extern int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t *queue);
+extern int32_t mm_channel_superbuf_comp_and_enqueue(mm_channel_t *ch_obj,
+        mm_channel_queue_t *queue, mm_camera_buf_info_t *buf_info);
+extern mm_channel_queue_node_t* mm_channel_superbuf_dequeue(
+        mm_channel_queue_t *queue);
+
+#define TEST_NUM_STREAMS 3
+#define TEST_MAX_FRAMES  512
+#define TEST_STREAM_HDL(s) (0x100 + (uint32_t)(s))
+
+static int g_failures = 0;
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        g_failures++; \
+    } \
+} while (0)
+
+typedef struct {
+    mm_camera_obj_t *cam_obj;
+    mm_channel_t *ch_obj;
+    mm_channel_queue_t *queue;
+    cam_stream_info_t info[TEST_NUM_STREAMS];
+    mm_camera_buf_def_t bufs[TEST_NUM_STREAMS][TEST_MAX_FRAMES];
+    uint32_t completed[TEST_MAX_FRAMES];
+    uint32_t num_completed;
+} test_channel_t;
+
+/* what the channel is expected to do, without lists or index */
+typedef struct {
+    uint32_t expected_frame_id;
+    uint32_t max_unmatched;
+    uint8_t num_streams;
+    uint32_t mask[TEST_MAX_FRAMES];    /* arrived streams of unmatched frames */
+    uint8_t unmatched[TEST_MAX_FRAMES];
+    uint32_t completed[TEST_MAX_FRAMES];
+    uint32_t num_completed;
+} test_model_t;
+
+static const cam_stream_type_t g_stream_types[TEST_NUM_STREAMS] = {
+    CAM_STREAM_TYPE_PREVIEW,
+    CAM_STREAM_TYPE_SNAPSHOT,
+    CAM_STREAM_TYPE_POSTVIEW,
+};
+
+static int test_channel_init(test_channel_t *t, uint8_t num_streams,
+                             uint32_t max_unmatched)
+{
+    uint8_t s;
+    uint32_t f;
+
+    memset(t, 0, sizeof(*t));
+    t->cam_obj = (mm_camera_obj_t *)calloc(1, sizeof(mm_camera_obj_t));
+    t->ch_obj = (mm_channel_t *)calloc(1, sizeof(mm_channel_t));
+    if ((NULL == t->cam_obj) || (NULL == t->ch_obj)) {
+        free(t->cam_obj);
+        free(t->ch_obj);
+        return -1;
+    }
+    t->ch_obj->cam_obj = t->cam_obj;
+    t->queue = &t->ch_obj->bundle.superbuf_queue;
+    mm_channel_superbuf_queue_init(t->queue);
+    t->queue->num_streams = num_streams;
+    t->queue->attr.notify_mode = MM_CAMERA_SUPER_BUF_NOTIFY_CONTINUOUS;
+    t->queue->attr.priority = MM_CAMERA_SUPER_BUF_PRIORITY_NORMAL;
+    t->queue->attr.max_unmatched_frames = max_unmatched;
+
+    for (s = 0; s < num_streams; s++) {
+        mm_stream_t *stream = &t->ch_obj->streams[s];
+        stream->my_hdl = TEST_STREAM_HDL(s);
+        stream->state = MM_STREAM_STATE_INITED;
+        stream->ch_obj = t->ch_obj;
+        stream->stream_info = &t->info[s];
+        t->info[s].stream_type = g_stream_types[s];
+        t->queue->bundled_streams[s] = TEST_STREAM_HDL(s);
+        for (f = 0; f < TEST_MAX_FRAMES; f++) {
+            t->bufs[s][f].stream_id = TEST_STREAM_HDL(s);
+            t->bufs[s][f].stream_type = g_stream_types[s];
+            t->bufs[s][f].frame_idx = f;
+            t->bufs[s][f].buf_idx = f;
+        }
+    }
+    return 0;
+}
+
+static void test_channel_deinit(test_channel_t *t)
+{
+    mm_channel_queue_node_t *super_buf;
+
+    while (NULL != (super_buf = mm_channel_superbuf_dequeue(t->queue))) {
+        free(super_buf);
+    }
+    /* whatever is left unmatched */
+    while (t->queue->unmatched_list.next != &t->queue->unmatched_list) {
+        super_buf = member_of(t->queue->unmatched_list.next,
+                mm_channel_queue_node_t, state_list);
+        cam_list_del_node(&super_buf->state_list);
+        cam_list_del_node(&super_buf->q_node->list);
+        free(super_buf->q_node);
+        free(super_buf);
+    }
+    mm_channel_superbuf_queue_deinit(t->queue);
+    free(t->ch_obj);
+    free(t->cam_obj);
+}
+
+/* unmatched list in ascending frame_idx order, counted and indexed */
+static void test_check_unmatched(test_channel_t *t)
+{
+    mm_channel_queue_t *queue = t->queue;
+    struct cam_list *pos;
+    uint32_t cnt = 0;
+    uint32_t prev = 0;
+
+    for (pos = queue->unmatched_list.next; pos != &queue->unmatched_list;
+            pos = pos->next) {
+        mm_channel_queue_node_t *super_buf =
+                member_of(pos, mm_channel_queue_node_t, state_list);
+        TEST_CHECK(!super_buf->matched);
+        TEST_CHECK((0 == cnt) || (super_buf->frame_idx > prev));
+        if (0 == queue->unmatched_idx.collisions) {
+            TEST_CHECK(super_buf == mm_superbuf_idx_lookup(
+                    &queue->unmatched_idx, super_buf->frame_idx));
+        }
+        prev = super_buf->frame_idx;
+        cnt++;
+    }
+    TEST_CHECK(cnt == queue->unmatched_cnt);
+    TEST_CHECK(cnt == queue->unmatched_idx.count +
+            queue->unmatched_idx.collisions);
+}
+
+/* dequeue completed superbufs and check they hold the right buffers */
+static void test_drain(test_channel_t *t)
+{
+    mm_channel_queue_node_t *super_buf;
+    uint8_t s;
+
+    while (NULL != (super_buf = mm_channel_superbuf_dequeue(t->queue))) {
+        TEST_CHECK(super_buf->frame_idx < TEST_MAX_FRAMES);
+        for (s = 0; s < t->queue->num_streams; s++) {
+            TEST_CHECK(super_buf->super_buf[s].frame_idx ==
+                    super_buf->frame_idx);
+            TEST_CHECK(super_buf->super_buf[s].buf ==
+                    &t->bufs[s][super_buf->frame_idx]);
+        }
+        if (t->num_completed < TEST_MAX_FRAMES) {
+            t->completed[t->num_completed++] = super_buf->frame_idx;
+        }
+        free(super_buf);
+    }
+}
+
+static void test_arrive(test_channel_t *t, uint8_t s, uint32_t f)
+{
+    mm_camera_buf_info_t buf_info;
+
+    memset(&buf_info, 0, sizeof(buf_info));
+    buf_info.stream_id = TEST_STREAM_HDL(s);
+    buf_info.frame_idx = f;
+    buf_info.buf = &t->bufs[s][f];
+    mm_channel_superbuf_comp_and_enqueue(t->ch_obj, t->queue, &buf_info);
+    test_check_unmatched(t);
+    test_drain(t);
+}
+
+static void test_model_init(test_model_t *m, uint8_t num_streams,
+                            uint32_t max_unmatched)
+{
+    memset(m, 0, sizeof(*m));
+    m->num_streams = num_streams;
+    m->max_unmatched = max_unmatched;
+}
+
+static uint32_t test_model_unmatched_cnt(test_model_t *m)
+{
+    uint32_t f, cnt = 0;
+    for (f = 0; f < TEST_MAX_FRAMES; f++) {
+        cnt += m->unmatched[f];
+    }
+    return cnt;
+}
+
+static void test_model_arrive(test_model_t *m, uint8_t s, uint32_t f)
+{
+    uint32_t full = ((uint32_t)1 << m->num_streams) - 1;
+    uint32_t oldest = TEST_MAX_FRAMES;
+    uint32_t i;
+
+    if (f < m->expected_frame_id) {
+        return;
+    }
+    if (m->unmatched[f]) {
+        m->mask[f] |= (uint32_t)1 << s;
+        if (m->mask[f] == full) {
+            /* complete, older unmatched frames are given up on */
+            m->unmatched[f] = 0;
+            m->completed[m->num_completed++] = f;
+            m->expected_frame_id = f;
+            for (i = 0; i < f; i++) {
+                m->unmatched[i] = 0;
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < TEST_MAX_FRAMES; i++) {
+        if (m->unmatched[i]) {
+            oldest = i;
+            break;
+        }
+    }
+    if ((m->max_unmatched < test_model_unmatched_cnt(m)) && (oldest > f)) {
+        /* older than everything still waiting */
+        return;
+    }
+    while (m->max_unmatched < test_model_unmatched_cnt(m)) {
+        for (i = 0; i < TEST_MAX_FRAMES; i++) {
+            if (m->unmatched[i]) {
+                m->unmatched[i] = 0;
+                break;
+            }
+        }
+    }
+    m->unmatched[f] = 1;
+    m->mask[f] = (uint32_t)1 << s;
+    if (m->mask[f] == full) {
+        m->unmatched[f] = 0;
+        m->completed[m->num_completed++] = f;
+        m->expected_frame_id = f;
+    }
+}
+
+static void test_compare(test_channel_t *t, test_model_t *m)
+{
+    struct cam_list *pos = t->queue->unmatched_list.next;
+    uint32_t f, i;
+
+    TEST_CHECK(t->num_completed == m->num_completed);
+    for (i = 0; (i < t->num_completed) && (i < m->num_completed); i++) {
+        TEST_CHECK(t->completed[i] == m->completed[i]);
+    }
+    for (f = 0; f < TEST_MAX_FRAMES; f++) {
+        if (!m->unmatched[f]) {
+            continue;
+        }
+        TEST_CHECK(pos != &t->queue->unmatched_list);
+        if (pos == &t->queue->unmatched_list) {
+            return;
+        }
+        TEST_CHECK(member_of(pos, mm_channel_queue_node_t,
+                state_list)->frame_idx == f);
+        pos = pos->next;
+    }
+    TEST_CHECK(pos == &t->queue->unmatched_list);
+}
+
+/* every stream delivers each frame once; each stream is shuffled within a
+ * window of its own, so bundled bufs of a frame show up far apart */
+static void test_out_of_order(uint32_t num_frames, uint32_t window)
+{
+    static test_channel_t t;
+    test_model_t m;
+    uint32_t order[TEST_NUM_STREAMS][TEST_MAX_FRAMES];
+    uint32_t next[TEST_NUM_STREAMS];
+    uint32_t i, j, arrived = 0;
+    uint8_t s;
+
+    if (test_channel_init(&t, TEST_NUM_STREAMS, 32) != 0) {
+        TEST_CHECK(0);
+        return;
+    }
+    test_model_init(&m, TEST_NUM_STREAMS, 32);
+
+    for (s = 0; s < TEST_NUM_STREAMS; s++) {
+        for (i = 0; i < num_frames; i++) {
+            order[s][i] = i + 1;
+        }
+        for (i = 0; i < num_frames; i++) {
+            j = i + (uint32_t)rand() % window;
+            if (j < num_frames) {
+                uint32_t tmp = order[s][i];
+                order[s][i] = order[s][j];
+                order[s][j] = tmp;
+            }
+        }
+        next[s] = 0;
+    }
+
+    while (arrived < num_frames * TEST_NUM_STREAMS) {
+        s = (uint8_t)(rand() % TEST_NUM_STREAMS);
+        if (next[s] == num_frames) {
+            continue;
+        }
+        test_arrive(&t, s, order[s][next[s]]);
+        test_model_arrive(&m, s, order[s][next[s]]);
+        next[s]++;
+        arrived++;
+        test_compare(&t, &m);
+    }
+
+    for (i = 1; i < t.num_completed; i++) {
+        TEST_CHECK(t.completed[i] > t.completed[i - 1]);
+    }
+    printf("out of order: frames %u window %u -> completed %u\n",
+            num_frames, window, t.num_completed);
+    test_channel_deinit(&t);
+}
+
+/* one stream of a pair keeps delivering, so nothing completes and new
+ * superbufs are inserted mid list and pruned from the oldest end,
+ * including frame idxs sharing an index slot */
+static void test_insert_and_prune(void)
+{
+    static test_channel_t t;
+    test_model_t m;
+    const uint32_t frames[] = {
+        10, 12, 11, 10 + MM_SUPERBUF_IDX_SLOTS, 40, 5, 50, 45, 13,
+        60, 46, 47, 48, 20,
+    };
+    uint32_t i;
+
+    if (test_channel_init(&t, 2, 4) != 0) {
+        TEST_CHECK(0);
+        return;
+    }
+    test_model_init(&m, 2, 4);
+
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        test_arrive(&t, 0, frames[i]);
+        test_model_arrive(&m, 0, frames[i]);
+        test_compare(&t, &m);
+        TEST_CHECK(t.queue->unmatched_cnt <= 4 + 1);
+    }
+
+    /* the other stream completes one in the middle, older ones go */
+    test_arrive(&t, 1, 47);
+    test_model_arrive(&m, 1, 47);
+    test_compare(&t, &m);
+    TEST_CHECK(1 == t.num_completed);
+    test_channel_deinit(&t);
+}
+
+int main(void)
+{
+    srand(1);
+    test_out_of_order(400, 1);
+    test_out_of_order(400, 4);
+    test_out_of_order(400, 12);
+    test_insert_and_prune();
+
+    if (g_failures) {
+        printf("FAILED: %d checks\n", g_failures);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,263 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Host side harness for the superbuf frame_idx index. Synthetic buffers
+ * from several bundled streams arrive out of order and are matched the
+ * same way mm_channel_superbuf_comp_and_enqueue does on its fast path:
+ * lookup by frame_idx, set the stream bit, complete when all bits are set.
+ * Results are cross checked against a linear scan of the pending list. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mm_camera_superbuf_idx.h"
+
+#define TEST_MAX_PENDING 256
+#define TEST_NUM_STREAMS 5
+
+typedef struct {
+    uint32_t frame_idx;
+    uint32_t stream_mask;
+    uint8_t in_use;
+    uint8_t idx_collided;
+} test_superbuf_t;
+
+typedef struct {
+    mm_superbuf_idx_t idx;
+    test_superbuf_t pending[TEST_MAX_PENDING];
+    uint8_t num_streams;
+    uint32_t completed;
+    uint32_t duplicates;
+    uint32_t last_completed;
+} test_matcher_t;
+
+static int g_failures = 0;
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        g_failures++; \
+    } \
+} while (0)
+
+static test_superbuf_t *test_linear_find(test_matcher_t *m, uint32_t frame_idx)
+{
+    int i;
+    for (i = 0; i < TEST_MAX_PENDING; i++) {
+        if (m->pending[i].in_use && m->pending[i].frame_idx == frame_idx) {
+            return &m->pending[i];
+        }
+    }
+    return NULL;
+}
+
+static test_superbuf_t *test_find(test_matcher_t *m, uint32_t frame_idx)
+{
+    test_superbuf_t *sb = (test_superbuf_t *)mm_superbuf_idx_lookup(&m->idx,
+            frame_idx);
+    if ((NULL == sb) && (m->idx.collisions > 0)) {
+        sb = test_linear_find(m, frame_idx);
+    }
+    return sb;
+}
+
+static void test_arrive(test_matcher_t *m, uint32_t frame_idx, uint8_t s_idx)
+{
+    uint32_t bit = mm_superbuf_stream_bit(s_idx);
+    test_superbuf_t *sb = test_find(m, frame_idx);
+    int i;
+
+    TEST_CHECK(sb == test_linear_find(m, frame_idx));
+
+    if (NULL == sb) {
+        for (i = 0; i < TEST_MAX_PENDING; i++) {
+            if (!m->pending[i].in_use) {
+                sb = &m->pending[i];
+                break;
+            }
+        }
+        TEST_CHECK(NULL != sb);
+        if (NULL == sb) {
+            return;
+        }
+        memset(sb, 0, sizeof(*sb));
+        sb->in_use = 1;
+        sb->frame_idx = frame_idx;
+        sb->idx_collided =
+                (0 != mm_superbuf_idx_insert(&m->idx, frame_idx, sb));
+    } else if (sb->stream_mask & bit) {
+        m->duplicates++;
+        return;
+    }
+
+    sb->stream_mask |= bit;
+    if (mm_superbuf_mask_complete(sb->stream_mask, m->num_streams)) {
+        mm_superbuf_idx_remove(&m->idx, frame_idx, sb, sb->idx_collided);
+        sb->in_use = 0;
+        m->completed++;
+        m->last_completed = frame_idx;
+    }
+}
+
+static void test_matcher_init(test_matcher_t *m, uint8_t num_streams)
+{
+    memset(m, 0, sizeof(*m));
+    mm_superbuf_idx_init(&m->idx);
+    m->num_streams = num_streams;
+}
+
+/* every stream delivers each frame once, shuffled within a window */
+static void test_out_of_order(uint32_t first_frame, uint32_t num_frames,
+                              uint32_t window)
+{
+    test_matcher_t m;
+    uint32_t total = num_frames * TEST_NUM_STREAMS;
+    uint32_t *order = (uint32_t *)malloc(total * sizeof(uint32_t));
+    uint32_t i;
+
+    TEST_CHECK(NULL != order);
+    if (NULL == order) {
+        return;
+    }
+    test_matcher_init(&m, TEST_NUM_STREAMS);
+
+    for (i = 0; i < total; i++) {
+        order[i] = i;
+    }
+    for (i = 0; i < total; i++) {
+        uint32_t span = window * TEST_NUM_STREAMS;
+        uint32_t j = i + (uint32_t)rand() % span;
+        if (j < total) {
+            uint32_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    for (i = 0; i < total; i++) {
+        uint32_t frame_idx = first_frame + order[i] / TEST_NUM_STREAMS;
+        if (0 == frame_idx) {
+            /* frame idx 0 is never bundled */
+            continue;
+        }
+        test_arrive(&m, frame_idx, (uint8_t)(order[i] % TEST_NUM_STREAMS));
+    }
+
+    for (i = 0; i < TEST_MAX_PENDING; i++) {
+        TEST_CHECK(!m.pending[i].in_use);
+    }
+    TEST_CHECK(0 == m.idx.count);
+    TEST_CHECK(0 == m.idx.collisions);
+    TEST_CHECK(0 == m.duplicates);
+    printf("out of order: first %u frames %u window %u -> completed %u\n",
+            first_frame, num_frames, window, m.completed);
+    free(order);
+}
+
+static void test_duplicates(void)
+{
+    test_matcher_t m;
+
+    test_matcher_init(&m, 3);
+    test_arrive(&m, 10, 0);
+    test_arrive(&m, 10, 0);
+    test_arrive(&m, 10, 1);
+    test_arrive(&m, 10, 2);
+    TEST_CHECK(1 == m.duplicates);
+    TEST_CHECK(1 == m.completed);
+    TEST_CHECK(10 == m.last_completed);
+}
+
+static void test_collisions(void)
+{
+    test_matcher_t m;
+
+    /* frames that map to the same slot stay matchable via the fallback */
+    test_matcher_init(&m, 2);
+    test_arrive(&m, 7, 0);
+    test_arrive(&m, 7 + MM_SUPERBUF_IDX_SLOTS, 0);
+    test_arrive(&m, 7 + 2 * MM_SUPERBUF_IDX_SLOTS, 1);
+    TEST_CHECK(2 == m.idx.collisions);
+    test_arrive(&m, 7 + MM_SUPERBUF_IDX_SLOTS, 1);
+    TEST_CHECK(1 == m.completed);
+    test_arrive(&m, 7, 1);
+    test_arrive(&m, 7 + 2 * MM_SUPERBUF_IDX_SLOTS, 0);
+    TEST_CHECK(3 == m.completed);
+    TEST_CHECK(0 == m.idx.count);
+    TEST_CHECK(0 == m.idx.collisions);
+}
+
+static void test_remove_not_indexed(void)
+{
+    mm_superbuf_idx_t idx;
+    int a, b, c;
+
+    /* removing entries that are not indexed leaves the counts alone */
+    mm_superbuf_idx_init(&idx);
+    TEST_CHECK(0 == mm_superbuf_idx_insert(&idx, 3, &a));
+    TEST_CHECK(0 != mm_superbuf_idx_insert(&idx,
+            3 + MM_SUPERBUF_IDX_SLOTS, &b));
+    TEST_CHECK(1 == idx.count);
+    TEST_CHECK(1 == idx.collisions);
+
+    mm_superbuf_idx_remove(&idx, 5, &c, 0);
+    mm_superbuf_idx_remove(&idx, 3 + 2 * MM_SUPERBUF_IDX_SLOTS, &c, 0);
+    TEST_CHECK(1 == idx.count);
+    TEST_CHECK(1 == idx.collisions);
+
+    /* double remove of an indexed entry */
+    mm_superbuf_idx_remove(&idx, 3, &a, 0);
+    mm_superbuf_idx_remove(&idx, 3, &a, 0);
+    TEST_CHECK(0 == idx.count);
+    TEST_CHECK(1 == idx.collisions);
+    TEST_CHECK(NULL == mm_superbuf_idx_lookup(&idx, 3));
+
+    mm_superbuf_idx_remove(&idx, 3 + MM_SUPERBUF_IDX_SLOTS, &b, 1);
+    TEST_CHECK(0 == idx.collisions);
+}
+
+int main(void)
+{
+    srand(1);
+    test_out_of_order(1, 1000, 1);
+    test_out_of_order(1, 1000, 4);
+    test_out_of_order(1, 5000, 10);
+    /* frame idx rollover */
+    test_out_of_order(0xFFFFFFFF - 500, 1000, 8);
+    test_duplicates();
+    test_collisions();
+    test_remove_not_indexed();
+
+    if (g_failures) {
+        printf("FAILED: %d checks\n", g_failures);
+        return 1;
+    }
+    printf("PASSED\n");
+    return 0;
+}
@@ -48,6 +48,10 @@ LOCAL_SRC_FILES := \
     src/mm_jpeg_queue.c \
     src/mm_jpeg_exif.c \
     src/mm_jpeg.c \
+    src/mm_jpeg_sched.c \
+    src/mm_jpeg_sw.c \
+    src/mm_jpeg_sw_enc.c \
+    src/mm_jpeg_sw_exif.c \
     src/mm_jpeg_interface.c \
     src/mm_jpeg_ionbuf.c \
     src/mm_jpegdec_interface.c \
@@ -44,6 +44,7 @@
 #define MM_JPEG_CIRQ_SIZE 30
 #define MM_JPEG_MAX_SESSION 10
 #define MAX_EXIF_TABLE_ENTRIES 50
+#define MM_JPEG_EXIF_ARENA_SIZE 1024
 #define MAX_JPEG_SIZE 20000000
 #define MAX_OMX_HANDLES (5)
 #define ASPECT_TOLERANCE 0.001
@@ -67,6 +68,17 @@ typedef enum {
  * Current, only one per time */
 #define NUM_MAX_JPEG_CNCURRENT_JOBS 2
 
+/* upper bound for persist.camera.jpeg.jobs, the number of jobs the
+ * scheduler keeps in the OMX engine and of worker threads dispatching them */
+#define MM_JPEG_MAX_CONCURRENT_JOBS 4
+
+/* jobs whose main image is at most this size (thumbnail, preview callback
+ * and video snapshot JPEGs) are scheduled ahead of full resolution ones */
+#define MM_JPEG_PRIO_HIGH_MAX_PIXELS (1920 * 1088)
+
+/* number of buckets in the scheduler histograms */
+#define MM_JPEG_HIST_BINS 12
+
 #define JOB_ID_MAGICVAL 0x1
 #define JOB_HIST_MAX 10000
 
@@ -265,6 +277,31 @@ typedef enum {
   MM_JPEG_CMD_TYPE_MAX
 } mm_jpeg_cmd_type_t;
 
+/** mm_jpeg_job_prio_t:
+ *  @MM_JPEG_JOB_PRIO_NORMAL: full resolution job
+ *  @MM_JPEG_JOB_PRIO_HIGH: small job, dispatched ahead of normal ones
+ *
+ *  Scheduling priority of a job in the todo queue
+ **/
+typedef enum {
+  MM_JPEG_JOB_PRIO_NORMAL,
+  MM_JPEG_JOB_PRIO_HIGH,
+  MM_JPEG_JOB_PRIO_MAX
+} mm_jpeg_job_prio_t;
+
+/** mm_jpeg_exif_arena_t:
+ *  @used: bytes handed out
+ *  @data: storage
+ *
+ *  Storage for the values of the EXIF entries parsed from the metadata
+ *  of one job. The encoder copies the entries when they are set, so the
+ *  arena is rewound rather than the entries being freed one by one.
+ **/
+typedef struct {
+  size_t used;
+  uint64_t data[MM_JPEG_EXIF_ARENA_SIZE / sizeof(uint64_t)];
+} mm_jpeg_exif_arena_t;
+
 typedef struct mm_jpeg_job_session {
   uint32_t client_hdl;           /* client handler */
   uint32_t jobId;                /* job ID */
@@ -301,6 +338,7 @@ typedef struct mm_jpeg_job_session {
 
   QEXIF_INFO_DATA exif_info_local[MAX_EXIF_TABLE_ENTRIES];  //all exif tags for JPEG encoder
   int exif_count_local;
+  mm_jpeg_exif_arena_t exif_arena;
 
   mm_jpeg_cirq_t cb_q;
   int32_t ebd_count;
@@ -343,6 +381,7 @@ typedef struct {
   mm_jpeg_encode_job_t encode_job;
   uint32_t job_id;
   uint32_t client_handle;
+  mm_jpeg_job_session_t *p_session; /* OMX session claimed for the job */
 } mm_jpeg_encode_job_info_t;
 
 typedef struct {
@@ -353,6 +392,9 @@ typedef struct {
 
 typedef struct {
   mm_jpeg_cmd_type_t type;
+  mm_jpeg_job_prio_t prio;
+  uint64_t enq_ts;                /* ns, when queued to the todo queue */
+  uint64_t dispatch_ts;           /* ns, when handed to the codec */
   union {
     mm_jpeg_encode_job_info_t enc_info;
     mm_jpeg_decode_job_info_t dec_info;
@@ -366,10 +408,56 @@ typedef struct {
   pthread_mutex_t lock;           /* job lock */
 } mm_jpeg_client_t;
 
+/** mm_jpeg_job_claim_t:
+ *
+ * Reserves the codec resources of a queued job. Called with the job lock
+ * held; returns 0 if the job can be dispatched now, a positive value if
+ * its session is busy and a negative value if the job has to be dropped.
+ **/
+typedef int32_t (*mm_jpeg_job_claim_t)(void *user_data,
+  mm_jpeg_job_q_node_t *node);
+
+/** mm_jpeg_job_unclaim_t:
+ *
+ * Gives back what a successful claim reserved, for a job that could not
+ * be dispatched after all. Called with the job lock held.
+ **/
+typedef void (*mm_jpeg_job_unclaim_t)(void *user_data,
+  mm_jpeg_job_q_node_t *node);
+
+/** mm_jpeg_job_run_t:
+ *
+ * Hands a claimed job to the codec. Called without the job lock held.
+ **/
+typedef int32_t (*mm_jpeg_job_run_t)(void *user_data,
+  mm_jpeg_job_q_node_t *node);
+
+typedef struct {
+  uint32_t depth_hist[MM_JPEG_HIST_BINS];  /* todo queue depth at enqueue */
+  uint32_t wait_hist[MM_JPEG_HIST_BINS];   /* enqueue to dispatch, log2 ms */
+  uint32_t encode_hist[MM_JPEG_HIST_BINS]; /* dispatch to done, log2 ms */
+  uint32_t num_jobs[MM_JPEG_JOB_PRIO_MAX];
+  uint32_t num_done;
+  uint32_t num_busy;                       /* claims refused by a session */
+  uint32_t max_depth;
+} mm_jpeg_sched_stats_t;
+
 typedef struct {
-  pthread_t pid;                  /* job cmd thread ID */
+  pthread_t pid[MM_JPEG_MAX_CONCURRENT_JOBS]; /* job cmd worker thread IDs */
+  uint32_t num_workers;
+  uint32_t max_ongoing;           /* max jobs in the codec at once */
   cam_semaphore_t job_sem;        /* semaphore for job cmd thread */
   mm_jpeg_queue_t job_queue;      /* queue for job to do */
+  pthread_mutex_t *p_job_lock;    /* owner's job lock */
+  mm_jpeg_queue_t *p_ongoing_q;   /* owner's ongoing job queue */
+  pthread_cond_t dispatch_cond;   /* signalled when a dispatch completes */
+  uint32_t num_dispatching;       /* workers running a job outside the lock */
+  mm_jpeg_job_claim_t claim;
+  mm_jpeg_job_unclaim_t unclaim;
+  mm_jpeg_job_run_t run;
+  void *user_data;
+  pthread_mutex_t stats_lock;
+  mm_jpeg_sched_stats_t stats;
 } mm_jpeg_job_cmd_thread_t;
 
 #define MAX_JPEG_CLIENT_NUM 8
@@ -443,6 +531,30 @@ extern int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
 int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj,
     mm_jpeg_job_q_node_t* job_node);
 
+/* job scheduler, runs jobs of independent sessions on a worker pool */
+extern int32_t mm_jpeg_sched_init(mm_jpeg_job_cmd_thread_t *sched,
+  pthread_mutex_t *p_job_lock,
+  mm_jpeg_queue_t *p_ongoing_q,
+  mm_jpeg_job_claim_t claim,
+  mm_jpeg_job_unclaim_t unclaim,
+  mm_jpeg_job_run_t run,
+  void *user_data,
+  uint32_t max_jobs);
+extern int32_t mm_jpeg_sched_deinit(mm_jpeg_job_cmd_thread_t *sched);
+extern int32_t mm_jpeg_sched_enq(mm_jpeg_job_cmd_thread_t *sched,
+  mm_jpeg_job_q_node_t *node);
+extern void mm_jpeg_sched_wait_dispatch(mm_jpeg_job_cmd_thread_t *sched);
+extern void mm_jpeg_sched_job_done(mm_jpeg_job_cmd_thread_t *sched,
+  mm_jpeg_job_q_node_t *node);
+extern void mm_jpeg_sched_get_status(mm_jpeg_job_cmd_thread_t *sched,
+  uint32_t client_hdl,
+  mm_jpeg_sched_status_t *p_status);
+extern void mm_jpeg_sched_dump(mm_jpeg_job_cmd_thread_t *sched, int fd);
+extern int32_t mm_jpeg_get_sched_status(mm_jpeg_obj *my_obj,
+  uint32_t client_hdl,
+  mm_jpeg_sched_status_t *p_status);
+extern int32_t mm_jpeg_dump_sched_stats(mm_jpeg_obj *my_obj, int fd);
+
 /* utiltity fucntion declared in mm-camera-inteface2.c
  * and need be used by mm-camera and below*/
 uint32_t mm_jpeg_util_generate_handler(uint8_t index);
@@ -459,12 +571,13 @@ extern int32_t mm_jpeg_queue_deinit(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_flush(mm_jpeg_queue_t* queue);
 extern uint32_t mm_jpeg_queue_get_size(mm_jpeg_queue_t* queue);
 extern mm_jpeg_q_data_t mm_jpeg_queue_peek(mm_jpeg_queue_t* queue);
-extern int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
+extern int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
   exif_tag_type_t type, uint32_t count, void *data);
 extern int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data);
 extern int process_meta_data(metadata_buffer_t *p_meta,
   QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_params_t *p_cam3a_params,
-  cam_hal_version_t hal_version);
+  cam_hal_version_t hal_version, mm_jpeg_exif_arena_t *p_arena);
 
 OMX_ERRORTYPE mm_jpeg_session_change_state(mm_jpeg_job_session_t* p_session,
   OMX_STATETYPE new_state,
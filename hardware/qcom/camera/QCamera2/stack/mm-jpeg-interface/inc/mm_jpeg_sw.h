@@ -0,0 +1,251 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef MM_JPEG_SW_H_
+#define MM_JPEG_SW_H_
+
+#include "mm_jpeg.h"
+
+/* upper bound for persist.camera.jpeg.sw.threads */
+#define MM_JPEG_SW_MAX_THREADS 8
+
+/* stripes per encoder thread, more stripes balance the load better at the
+ * cost of one restart marker each */
+#define MM_JPEG_SW_STRIPES_PER_THREAD 4
+
+/* the restart interval is written to the 16 bit DRI field */
+#define MM_JPEG_SW_MAX_RESTART_INTERVAL 0xFFFF
+
+/* a marker segment, APP1 included, can be at most 64KB long */
+#define MM_JPEG_SW_MAX_SEGMENT_LEN 0xFFFF
+
+/* SOF, DQT, DHT, DRI and SOS */
+#define MM_JPEG_SW_MAX_HDR_LEN 1024
+
+/* max entries in one EXIF IFD */
+#define MM_JPEG_SW_MAX_EXIF_TAGS 128
+
+#define MM_JPEG_SW_MAX_COMPS 3
+
+/* smallest window of the destination worth encoding a stripe into */
+#define MM_JPEG_SW_MIN_WINDOW (8 * 1024)
+
+/** mm_jpeg_sw_buf_t:
+ *  @p_data: where the stripe is written, its window of the destination
+ *           or @p_heap
+ *  @size: capacity at @p_data
+ *  @len: filled length
+ *  @p_heap: owned buffer, used without a destination or once the stripe
+ *           outgrows its window
+ *  @heap_size: allocated size of @p_heap
+ *  @done: the stripe is encoded, protected by the pool lock
+ *
+ *  Output of one stripe
+ **/
+typedef struct {
+  uint8_t *p_data;
+  size_t size;
+  size_t len;
+  uint8_t *p_heap;
+  size_t heap_size;
+  uint8_t done;
+} mm_jpeg_sw_buf_t;
+
+/** mm_jpeg_sw_comp_t:
+ *  @p_base: first source sample of the component
+ *  @p_col: byte offset of each output column from @p_base, padded to
+ *          the MCU size by repeating the last column
+ *  @p_row: byte offset of each output row from @p_base, padded likewise
+ *  @linear_cols: leading entries of @p_col that advance by @step
+ *  @step: byte distance of horizontally adjacent source samples
+ *  @num_cols: entries in @p_col
+ *  @num_rows: entries in @p_row
+ *  @h_samp: horizontal sampling factor
+ *  @v_samp: vertical sampling factor
+ *  @tbl: quantization and huffman table index
+ *
+ *  Maps output samples of one component to the source buffer. Crop,
+ *  scaling and rotation are folded into the two offset tables.
+ **/
+typedef struct {
+  const uint8_t *p_base;
+  int32_t *p_col;
+  int32_t *p_row;
+  uint32_t linear_cols;
+  int32_t step;
+  uint32_t num_cols;
+  uint32_t num_rows;
+  uint32_t h_samp;
+  uint32_t v_samp;
+  uint32_t tbl;
+} mm_jpeg_sw_comp_t;
+
+/** mm_jpeg_sw_src_t:
+ *  @p_buf: source buffer
+ *  @color_format: source color format
+ *  @p_dim: source dimension, crop and output size before rotation
+ *  @rotation: clockwise rotation in degrees
+ *  @quality: 1 ~ 100
+ *  @p_qtable: luma and chroma tables in natural order, used as they are;
+ *             NULL entries select the standard tables scaled by @quality
+ *
+ *  Image to encode
+ **/
+typedef struct {
+  mm_jpeg_buf_t *p_buf;
+  mm_jpeg_color_format color_format;
+  mm_jpeg_dim_t *p_dim;
+  uint32_t rotation;
+  uint32_t quality;
+  const OMX_U8 *p_qtable[QTABLE_MAX];
+} mm_jpeg_sw_src_t;
+
+/** mm_jpeg_sw_enc_t:
+ *
+ *  Encoder state of one image. It is owned by a session and reused from
+ *  job to job so that the tables and stripe buffers are allocated only
+ *  when the image grows.
+ **/
+typedef struct {
+  struct cam_list list;           /* entry in the pool's active list */
+
+  uint32_t width;                 /* output, after rotation */
+  uint32_t height;
+  uint32_t num_comps;
+  mm_jpeg_sw_comp_t comp[MM_JPEG_SW_MAX_COMPS];
+  uint32_t mcu_cols;
+  uint32_t mcu_rows;
+
+  uint8_t qtbl[QTABLE_MAX][QUANT_SIZE];  /* zigzag order, as in DQT */
+  float qdiv[QTABLE_MAX][QUANT_SIZE];    /* AAN scaled reciprocals */
+
+  uint8_t hdr[MM_JPEG_SW_MAX_HDR_LEN];   /* DQT to SOS */
+  size_t hdr_len;
+
+  uint32_t stripe_rows;           /* MCU rows per stripe */
+  uint32_t num_stripes;
+  mm_jpeg_sw_buf_t *p_stripe;
+  uint32_t max_stripes;
+
+  /* Destination written in place. Each stripe is encoded into its own
+   * window of it and slid down behind the previous one once that is
+   * committed, so the file needs no gather pass. */
+  uint8_t *p_out;
+  size_t out_size;
+  size_t out_len;                 /* header and committed stripes */
+
+  /* protected by the pool lock */
+  uint32_t next_stripe;
+  uint32_t num_done;
+  uint32_t num_committed;
+  uint8_t committing;             /* a thread is moving stripes */
+  int32_t error;
+  const volatile int *p_abort;    /* stop early when set */
+} mm_jpeg_sw_enc_t;
+
+/** mm_jpeg_sw_pool_t:
+ *
+ *  Threads encoding the stripes of all images in flight. The thread that
+ *  starts an image encodes stripes of it as well.
+ **/
+typedef struct {
+  pthread_t tid[MM_JPEG_SW_MAX_THREADS];
+  uint32_t num_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  struct cam_list active;         /* images with stripes left to encode */
+  int running;
+} mm_jpeg_sw_pool_t;
+
+/** mm_jpeg_sw_session_t:
+ *
+ *  Software encoder session
+ **/
+typedef struct {
+  uint8_t active;
+  uint8_t busy;                   /* a job of the session is dispatched */
+  volatile int abort;
+  uint32_t session_id;
+  uint32_t client_hdl;
+  uint32_t job_id;                /* job being encoded */
+  uint32_t job_hist;
+  uint32_t next_out_buf;
+  mm_jpeg_encode_params_t params;
+  mm_jpeg_sw_enc_t main_enc;
+  mm_jpeg_sw_enc_t thumb_enc;
+  uint8_t *p_app1;                /* MM_JPEG_SW_MAX_SEGMENT_LEN + 2 */
+  uint8_t *p_thumb;               /* MM_JPEG_SW_MAX_SEGMENT_LEN */
+  QEXIF_INFO_DATA exif_info_local[MAX_EXIF_TABLE_ENTRIES];
+  mm_jpeg_exif_arena_t exif_arena;
+} mm_jpeg_sw_session_t;
+
+typedef struct {
+  uint8_t is_used;
+  uint32_t client_handle;
+  mm_jpeg_sw_session_t session[MM_JPEG_MAX_SESSION];
+} mm_jpeg_sw_client_t;
+
+typedef struct {
+  int num_clients;
+  mm_jpeg_sw_client_t clnt_mgr[MAX_JPEG_CLIENT_NUM];
+  pthread_mutex_t job_lock;
+  pthread_cond_t job_done_cond;   /* a session went idle */
+  mm_jpeg_job_cmd_thread_t job_mgr;
+  mm_jpeg_queue_t ongoing_job_q;
+  mm_jpeg_sw_pool_t pool;
+} mm_jpeg_sw_obj;
+
+/* software backend, same contract as jpeg_open */
+extern uint32_t mm_jpeg_sw_open(mm_jpeg_ops_t *ops, mm_dimension picture_size);
+
+/* striped encoder */
+extern int32_t mm_jpeg_sw_pool_init(mm_jpeg_sw_pool_t *p_pool,
+  uint32_t num_threads);
+extern void mm_jpeg_sw_pool_deinit(mm_jpeg_sw_pool_t *p_pool);
+extern int32_t mm_jpeg_sw_encode(mm_jpeg_sw_pool_t *p_pool,
+  mm_jpeg_sw_enc_t *p_enc,
+  mm_jpeg_sw_src_t *p_src,
+  uint8_t *p_dst, size_t dst_size, size_t *p_len);
+extern void mm_jpeg_sw_get_dim(const mm_jpeg_dim_t *p_dim, uint32_t rotation,
+  uint32_t *p_width, uint32_t *p_height);
+extern size_t mm_jpeg_sw_get_size(mm_jpeg_sw_enc_t *p_enc, size_t app1_len);
+extern size_t mm_jpeg_sw_write(mm_jpeg_sw_enc_t *p_enc,
+  const uint8_t *p_app1, size_t app1_len,
+  uint8_t *p_dst, size_t dst_size);
+extern void mm_jpeg_sw_enc_release(mm_jpeg_sw_enc_t *p_enc);
+
+/* APP1 segment with the EXIF tags and the thumbnail */
+extern int32_t mm_jpeg_sw_exif_write(QOMX_EXIF_INFO **pp_info,
+  uint32_t num_info,
+  uint32_t width, uint32_t height,
+  const uint8_t *p_thumb, size_t thumb_len,
+  uint8_t *p_dst, size_t dst_size, size_t *p_len);
+
+#endif /* MM_JPEG_SW_H_ */
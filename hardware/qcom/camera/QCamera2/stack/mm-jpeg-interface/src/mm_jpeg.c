@@ -38,6 +38,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <cutils/trace.h>
+#include <cutils/properties.h>
 #include <math.h>
 
 #include "mm_jpeg_dbg.h"
@@ -294,6 +295,7 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   p_session->encode_pid = -1;
   p_session->config = OMX_FALSE;
   p_session->exif_count_local = 0;
+  p_session->exif_arena.used = 0;
   p_session->auto_out_buf = OMX_FALSE;
 
   p_session->omx_callbacks.EmptyBufferDone = mm_jpeg_ebd;
@@ -1251,8 +1253,10 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
   /*parse aditional exif data from the metadata*/
   exif_info.numOfEntries = 0;
   exif_info.exif_data = &p_session->exif_info_local[0];
+  p_session->exif_arena.used = 0;
   process_meta_data(p_jobparams->p_metadata, &exif_info,
-    &p_jobparams->cam_exif_params, p_jobparams->hal_version);
+    &p_jobparams->cam_exif_params, p_jobparams->hal_version,
+    &p_session->exif_arena);
   /* After Parse metadata */
   p_session->exif_count_local = (int)exif_info.numOfEntries;
 
@@ -1592,24 +1596,24 @@ error:
   return ret;
 }
 
-/** mm_jpeg_process_encoding_job:
+/** mm_jpeg_claim_encoding_job:
  *
  *  Arguments:
  *    @my_obj: jpeg client
  *    @job_node: job node
  *
  *  Return:
- *       0 for success -1 otherwise
+ *       0 if the job can start, 1 if its session is busy, -1 on error
  *
  *  Description:
- *       Start the encoding job
+ *       Reserves an OMX handle and an output buffer of the session for
+ *       the job. Called by the scheduler with the job lock held.
  *
  **/
-int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
+static int32_t mm_jpeg_claim_encoding_job(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t* job_node)
 {
   mm_jpeg_q_data_t qdata;
-  int32_t rc = 0;
-  OMX_ERRORTYPE ret = OMX_ErrorNone;
   mm_jpeg_job_session_t *p_session = NULL;
   uint32_t buf_idx;
 
@@ -1621,25 +1625,13 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
     return -1;
   }
 
-  CDBG("%s:%d] before dequeue session %d",
-                __func__, __LINE__, ret);
-
   /* dequeue available omx handle */
   qdata = mm_jpeg_queue_deq(p_session->session_handle_q);
-  p_session = qdata.p;
-
-  if (NULL == p_session) {
-    CDBG_HIGH("%s:%d] No available sessions %d",
-          __func__, __LINE__, ret);
-    /* No available handles */
-    qdata.p = job_node;
-    mm_jpeg_queue_enq_head(&my_obj->job_mgr.job_queue, qdata);
-
-    CDBG_HIGH("%s:%d]end enqueue %d",
-              __func__, __LINE__, ret);
-    return rc;
-
+  if (NULL == qdata.p) {
+    CDBG("%s:%d] No available sessions", __func__, __LINE__);
+    return 1;
   }
+  p_session = qdata.p;
 
   p_session->auto_out_buf = OMX_FALSE;
   if (job_node->enc_info.encode_job.dst_index < 0) {
@@ -1648,9 +1640,11 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
     buf_idx = qdata.u32;
 
     if (0U == buf_idx) {
-      CDBG_ERROR("%s:%d] No available output buffers %d",
-          __func__, __LINE__, ret);
-      return OMX_ErrorUndefined;
+      CDBG_HIGH("%s:%d] No available output buffers", __func__, __LINE__);
+      /* wait for a buffer to be returned by a running job */
+      qdata.p = p_session;
+      mm_jpeg_queue_enq_head(p_session->session_handle_q, qdata);
+      return 1;
     }
 
     buf_idx--;
@@ -1658,15 +1652,32 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
     job_node->enc_info.encode_job.dst_index = (int32_t)buf_idx;
     p_session->auto_out_buf = OMX_TRUE;
   }
+  job_node->enc_info.p_session = p_session;
 
-  /* sent encode cmd to OMX, queue job into ongoing queue */
-  qdata.p = job_node;
-  rc = mm_jpeg_queue_enq(&my_obj->ongoing_job_q, qdata);
-  if (rc) {
-    CDBG_ERROR("%s:%d] jpeg enqueue failed %d",
-      __func__, __LINE__, ret);
-    goto error;
-  }
+  return 0;
+}
+
+/** mm_jpeg_process_encoding_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg client
+ *    @job_node: job node
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Start the encoding job on the OMX session claimed for it. The
+ *       job is already in the ongoing queue.
+ *
+ **/
+int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
+{
+  int32_t rc = 0;
+  OMX_ERRORTYPE ret = OMX_ErrorNone;
+  mm_jpeg_job_session_t *p_session = job_node->enc_info.p_session;
+
+  CDBG("%s:%d] E session %p", __func__, __LINE__, p_session);
 
   p_session->encode_job = job_node->enc_info.encode_job;
   p_session->jobId = job_node->enc_info.job_id;
@@ -1700,74 +1711,97 @@ error:
   return rc;
 }
 
+/** mm_jpeg_job_claim:
+ *
+ *  Arguments:
+ *    @user_data: jpeg object
+ *    @node: job node
+ *
+ *  Return:
+ *       0 if the job can start, >0 if busy, <0 to drop the job
+ *
+ *  Description:
+ *       Scheduler claim callback
+ *
+ **/
+static int32_t mm_jpeg_job_claim(void *user_data, mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *)user_data;
+
+  switch (node->type) {
+  case MM_JPEG_CMD_TYPE_JOB:
+    return mm_jpeg_claim_encoding_job(my_obj, node);
+  case MM_JPEG_CMD_TYPE_DECODE_JOB:
+    if (NULL == mm_jpeg_get_session(my_obj, node->dec_info.job_id)) {
+      CDBG_ERROR("%s:%d] invalid job id %x", __func__, __LINE__,
+        node->dec_info.job_id);
+      return -1;
+    }
+    return 0;
+  default:
+    return -1;
+  }
+}
 
-
-/** mm_jpeg_jobmgr_thread:
+/** mm_jpeg_job_unclaim:
  *
  *  Arguments:
- *    @my_obj: jpeg object
+ *    @user_data: jpeg object
+ *    @node: job node
  *
  *  Return:
- *       0 for success else failure
+ *       none
  *
  *  Description:
- *       job manager thread main function
+ *       Scheduler unclaim callback, returns the OMX handle and the
+ *       output buffer reserved by mm_jpeg_claim_encoding_job
  *
  **/
-static void *mm_jpeg_jobmgr_thread(void *data)
+static void mm_jpeg_job_unclaim(void *user_data, mm_jpeg_job_q_node_t *node)
 {
+  mm_jpeg_job_session_t *p_session;
   mm_jpeg_q_data_t qdata;
-  int rc = 0;
-  int running = 1;
-  uint32_t num_ongoing_jobs = 0;
-  mm_jpeg_obj *my_obj = (mm_jpeg_obj*)data;
-  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
-  mm_jpeg_job_q_node_t* node = NULL;
-  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_thread", 0, 0, 0);
 
-  do {
-    do {
-      rc = cam_sem_wait(&cmd_thread->job_sem);
-      if (rc != 0 && errno != EINVAL) {
-        CDBG_ERROR("%s: cam_sem_wait error (%s)",
-          __func__, strerror(errno));
-        return NULL;
-      }
-    } while (rc != 0);
-
-    /* check ongoing q size */
-    num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
-    if (num_ongoing_jobs >= NUM_MAX_JPEG_CNCURRENT_JOBS) {
-      CDBG("%s:%d] ongoing job already reach max %d", __func__,
-        __LINE__, num_ongoing_jobs);
-      continue;
-    }
+  (void)user_data;
+  if (MM_JPEG_CMD_TYPE_JOB != node->type) {
+    return;
+  }
+  p_session = node->enc_info.p_session;
+  if (NULL == p_session) {
+    return;
+  }
 
-    pthread_mutex_lock(&my_obj->job_lock);
-    /* can go ahead with new work */
-    qdata = mm_jpeg_queue_deq(&cmd_thread->job_queue);
-    node = (mm_jpeg_job_q_node_t*)qdata.p;
-    if (node != NULL) {
-      switch (node->type) {
-      case MM_JPEG_CMD_TYPE_JOB:
-        rc = mm_jpeg_process_encoding_job(my_obj, node);
-        break;
-      case MM_JPEG_CMD_TYPE_DECODE_JOB:
-        rc = mm_jpegdec_process_decoding_job(my_obj, node);
-        break;
-      case MM_JPEG_CMD_TYPE_EXIT:
-      default:
-        /* free node */
-        free(node);
-        /* set running flag to false */
-        running = 0;
-        break;
-      }
-    }
-    pthread_mutex_unlock(&my_obj->job_lock);
+  if (p_session->auto_out_buf) {
+    qdata.u32 = (uint32_t)(node->enc_info.encode_job.dst_index + 1);
+    mm_jpeg_queue_enq_head(p_session->out_buf_q, qdata);
+    p_session->auto_out_buf = OMX_FALSE;
+  }
+  qdata.p = p_session;
+  mm_jpeg_queue_enq_head(p_session->session_handle_q, qdata);
+  node->enc_info.p_session = NULL;
+}
 
-  } while (running);
-  return NULL;
+/** mm_jpeg_job_run:
+ *
+ *  Arguments:
+ *    @user_data: jpeg object
+ *    @node: job node
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Scheduler run callback
+ *
+ **/
+static int32_t mm_jpeg_job_run(void *user_data, mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *)user_data;
+
+  if (MM_JPEG_CMD_TYPE_DECODE_JOB == node->type) {
+    return mm_jpegdec_process_decoding_job(my_obj, node);
+  }
+  return mm_jpeg_process_encoding_job(my_obj, node);
 }
 
 /** mm_jpeg_jobmgr_thread_launch:
@@ -1779,24 +1813,25 @@ static void *mm_jpeg_jobmgr_thread(void *data)
  *       0 for success else failure
  *
  *  Description:
- *       launches the job manager thread
+ *       launches the job manager worker threads
  *
  **/
 int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
 {
-  int32_t rc = 0;
-  mm_jpeg_job_cmd_thread_t *job_mgr = &my_obj->job_mgr;
+  char prop[PROPERTY_VALUE_MAX];
+  int max_jobs;
 
-  cam_sem_init(&job_mgr->job_sem, 0);
-  mm_jpeg_queue_init(&job_mgr->job_queue);
+  property_get("persist.camera.jpeg.jobs", prop, "0");
+  max_jobs = atoi(prop);
+  if (max_jobs <= 0) {
+    max_jobs = NUM_MAX_JPEG_CNCURRENT_JOBS;
+  } else if (max_jobs > MM_JPEG_MAX_CONCURRENT_JOBS) {
+    max_jobs = MM_JPEG_MAX_CONCURRENT_JOBS;
+  }
 
-  /* launch the thread */
-  pthread_create(&job_mgr->pid,
-    NULL,
-    mm_jpeg_jobmgr_thread,
-    (void *)my_obj);
-  pthread_setname_np(job_mgr->pid, "CAM_jpeg_jobmgr");
-  return rc;
+  return mm_jpeg_sched_init(&my_obj->job_mgr, &my_obj->job_lock,
+    &my_obj->ongoing_job_q, mm_jpeg_job_claim, mm_jpeg_job_unclaim,
+    mm_jpeg_job_run, (void *)my_obj, (uint32_t)max_jobs);
 }
 
 /** mm_jpeg_jobmgr_thread_release:
@@ -1808,37 +1843,12 @@ int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
  *       0 for success else failure
  *
  *  Description:
- *       Releases the job manager thread
+ *       Releases the job manager worker threads
  *
  **/
 int32_t mm_jpeg_jobmgr_thread_release(mm_jpeg_obj * my_obj)
 {
-  mm_jpeg_q_data_t qdata;
-  int32_t rc = 0;
-  mm_jpeg_job_cmd_thread_t * cmd_thread = &my_obj->job_mgr;
-  mm_jpeg_job_q_node_t* node =
-    (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
-  if (NULL == node) {
-    CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
-    return -1;
-  }
-
-  memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
-  node->type = MM_JPEG_CMD_TYPE_EXIT;
-
-  qdata.p = node;
-  mm_jpeg_queue_enq(&cmd_thread->job_queue, qdata);
-  cam_sem_post(&cmd_thread->job_sem);
-
-  /* wait until cmd thread exits */
-  if (pthread_join(cmd_thread->pid, NULL) != 0) {
-    CDBG("%s: pthread dead already", __func__);
-  }
-  mm_jpeg_queue_deinit(&cmd_thread->job_queue);
-
-  cam_sem_destroy(&cmd_thread->job_sem);
-  memset(cmd_thread, 0, sizeof(mm_jpeg_job_cmd_thread_t));
-  return rc;
+  return mm_jpeg_sched_deinit(&my_obj->job_mgr);
 }
 
 /** mm_jpeg_init:
@@ -2052,7 +2062,6 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
   mm_jpeg_job_t *job,
   uint32_t *job_id)
 {
-  mm_jpeg_q_data_t qdata;
   int32_t rc = -1;
   uint8_t session_idx = 0;
   uint8_t client_idx = 0;
@@ -2112,13 +2121,15 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
   node->enc_info.job_id = *job_id;
   node->enc_info.client_handle = p_session->client_hdl;
   node->type = MM_JPEG_CMD_TYPE_JOB;
+  if ((uint64_t)node->enc_info.encode_job.main_dim.dst_dim.width *
+    (uint64_t)node->enc_info.encode_job.main_dim.dst_dim.height <=
+    MM_JPEG_PRIO_HIGH_MAX_PIXELS) {
+    node->prio = MM_JPEG_JOB_PRIO_HIGH;
+  }
 
-
-
-  qdata.p = node;
-  rc = mm_jpeg_queue_enq(&my_obj->job_mgr.job_queue, qdata);
-  if (0 == rc) {
-      cam_sem_post(&my_obj->job_mgr.job_sem);
+  rc = mm_jpeg_sched_enq(&my_obj->job_mgr, node);
+  if (0 != rc) {
+    free(node);
   }
 
   CDBG_HIGH("%s:%d] X", __func__, __LINE__);
@@ -2151,6 +2162,7 @@ int32_t mm_jpeg_abort_job(mm_jpeg_obj *my_obj,
 
   CDBG("%s:%d] ", __func__, __LINE__);
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_sched_wait_dispatch(&my_obj->job_mgr);
 
   /* abort job if in todo queue */
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue, jobId);
@@ -2181,6 +2193,56 @@ abort_done:
 }
 
 
+/** mm_jpeg_get_sched_status:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @client_hdl: client handle
+ *    @p_status: filled with the scheduler load of the client
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Reports how many jobs of the client are pending, so that the
+ *       client can hold new jobs back while the encoder is saturated
+ *
+ **/
+int32_t mm_jpeg_get_sched_status(mm_jpeg_obj *my_obj,
+  uint32_t client_hdl,
+  mm_jpeg_sched_status_t *p_status)
+{
+  uint8_t clnt_idx = mm_jpeg_util_get_index_by_handler(client_hdl);
+
+  if ((clnt_idx >= MAX_JPEG_CLIENT_NUM) ||
+    (0 == my_obj->clnt_mgr[clnt_idx].is_used)) {
+    CDBG_ERROR("%s: invalid client with handler (%d)", __func__, client_hdl);
+    return -1;
+  }
+
+  mm_jpeg_sched_get_status(&my_obj->job_mgr, client_hdl, p_status);
+  return 0;
+}
+
+/** mm_jpeg_dump_sched_stats:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @fd: file descriptor
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Dumps the scheduler queue depth and latency histograms
+ *
+ **/
+int32_t mm_jpeg_dump_sched_stats(mm_jpeg_obj *my_obj, int fd)
+{
+  mm_jpeg_sched_dump(&my_obj->job_mgr, fd);
+  return 0;
+}
+
 #ifdef MM_JPEG_READ_META_KEYFILE
 static int32_t mm_jpeg_read_meta_keyfile(mm_jpeg_job_session_t *p_session,
     const char *filename)
@@ -2431,20 +2493,15 @@ error2:
 static int32_t mm_jpegenc_destroy_job(mm_jpeg_job_session_t *p_session)
 {
   mm_jpeg_encode_job_t *p_jobparams = &p_session->encode_job;
-  int i = 0, rc = 0;
 
-  CDBG_HIGH("%s:%d] Exif entry count %d %d", __func__, __LINE__,
-    (int)p_jobparams->exif_info.numOfEntries,
-    (int)p_session->exif_count_local);
-  for (i = 0; i < p_session->exif_count_local; i++) {
-    rc = releaseExifEntry(&p_session->exif_info_local[i]);
-    if (rc) {
-      CDBG_ERROR("%s:%d] Exif release failed (%d)", __func__, __LINE__, rc);
-    }
-  }
+  CDBG_HIGH("%s:%d] Exif entry count %d %d, arena %zu bytes", __func__,
+    __LINE__, (int)p_jobparams->exif_info.numOfEntries,
+    (int)p_session->exif_count_local, p_session->exif_arena.used);
+  /* the local entries live in the arena */
   p_session->exif_count_local = 0;
+  p_session->exif_arena.used = 0;
 
-  return rc;
+  return 0;
 }
 
 /** mm_jpeg_session_encode:
@@ -2472,6 +2529,7 @@ static void mm_jpegenc_job_done(mm_jpeg_job_session_t *p_session)
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
     p_session->jobId);
   if (node) {
+    mm_jpeg_sched_job_done(&my_obj->job_mgr, node);
     free(node);
   }
   p_session->encoding = OMX_FALSE;
@@ -2521,6 +2579,7 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
   session_id = p_session->sessionId;
 
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_sched_wait_dispatch(&my_obj->job_mgr);
 
   /* abort job if in todo queue */
   CDBG_HIGH("%s:%d] abort todo jobs", __func__, __LINE__);
@@ -2685,6 +2744,7 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
 
   /* abort all jobs from the client */
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_sched_wait_dispatch(&my_obj->job_mgr);
 
   CDBG("%s:%d] ", __func__, __LINE__);
 
@@ -2828,148 +2888,3 @@ OMX_ERRORTYPE mm_jpeg_event_handler(OMX_HANDLETYPE hComponent,
   CDBG("%s:%d]", __func__, __LINE__);
   return OMX_ErrorNone;
 }
-
-
-
-/* remove the first job from the queue with matching client handle */
-mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_client_id(
-  mm_jpeg_queue_t* queue, uint32_t client_hdl)
-{
-  mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
-  mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
-
-  pthread_mutex_lock(&queue->lock);
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if (data && (data->enc_info.client_handle == client_hdl)) {
-      CDBG_HIGH("%s:%d] found matching client handle", __func__, __LINE__);
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      CDBG_HIGH("%s: queue size = %d", __func__, queue->size);
-      break;
-    }
-    pos = pos->next;
-  }
-
-  pthread_mutex_unlock(&queue->lock);
-
-  return job_node;
-}
-
-/* remove the first job from the queue with matching session id */
-mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_session_id(
-  mm_jpeg_queue_t* queue, uint32_t session_id)
-{
-  mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
-  mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
-
-  pthread_mutex_lock(&queue->lock);
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if (data && (data->enc_info.encode_job.session_id == session_id)) {
-      CDBG_HIGH("%s:%d] found matching session id", __func__, __LINE__);
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      CDBG_HIGH("%s: queue size = %d", __func__, queue->size);
-      break;
-    }
-    pos = pos->next;
-  }
-
-  pthread_mutex_unlock(&queue->lock);
-
-  return job_node;
-}
-
-/* remove job from the queue with matching job id */
-mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_job_id(
-  mm_jpeg_queue_t* queue, uint32_t job_id)
-{
-  mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
-  mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
-  uint32_t lq_job_id;
-
-  pthread_mutex_lock(&queue->lock);
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if(NULL == data) {
-      CDBG_ERROR("%s:%d] Data is NULL", __func__, __LINE__);
-      pthread_mutex_unlock(&queue->lock);
-      return NULL;
-    }
-
-    if (data->type == MM_JPEG_CMD_TYPE_DECODE_JOB) {
-      lq_job_id = data->dec_info.job_id;
-    } else {
-      lq_job_id = data->enc_info.job_id;
-    }
-
-    if (data && (lq_job_id == job_id)) {
-      CDBG_HIGH("%s:%d] found matching job id", __func__, __LINE__);
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      break;
-    }
-    pos = pos->next;
-  }
-
-  pthread_mutex_unlock(&queue->lock);
-
-  return job_node;
-}
-
-/* remove job from the queue with matching job id */
-mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_unlk(
-  mm_jpeg_queue_t* queue, uint32_t job_id)
-{
-  mm_jpeg_q_node_t* node = NULL;
-  mm_jpeg_job_q_node_t* data = NULL;
-  mm_jpeg_job_q_node_t* job_node = NULL;
-  struct cam_list *head = NULL;
-  struct cam_list *pos = NULL;
-
-  head = &queue->head.list;
-  pos = head->next;
-  while(pos != head) {
-    node = member_of(pos, mm_jpeg_q_node_t, list);
-    data = (mm_jpeg_job_q_node_t *)node->data.p;
-
-    if (data && (data->enc_info.job_id == job_id)) {
-      job_node = data;
-      cam_list_del_node(&node->list);
-      queue->size--;
-      free(node);
-      break;
-    }
-    pos = pos->next;
-  }
-
-  return job_node;
-}
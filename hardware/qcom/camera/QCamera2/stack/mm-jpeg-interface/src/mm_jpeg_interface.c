@@ -29,17 +29,27 @@
 
 #include <stdlib.h>
 #include <pthread.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <dlfcn.h>
 #include <cutils/properties.h>
 #include <stdlib.h>
 
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg.h"
+#include "mm_jpeg_sw.h"
+
+/* OMX component library the qomx core loads for the encoder */
+#ifdef MM_JPEG_USE_PIPELINE
+#define MM_JPEG_OMX_ENC_LIB "libqomx_jpegenc_pipe.so"
+#else
+#define MM_JPEG_OMX_ENC_LIB "libqomx_jpegenc.so"
+#endif
 
 static pthread_mutex_t g_intf_lock = PTHREAD_MUTEX_INITIALIZER;
 static mm_jpeg_obj* g_jpeg_obj = NULL;
@@ -277,43 +287,87 @@ static int32_t mm_jpeg_intf_close(uint32_t client_hdl)
   return rc;
 }
 
-/** jpeg_open:
+/** mm_jpeg_intf_get_sched_status:
+ *
+ *  Arguments:
+ *    @client_hdl: client handle
+ *    @p_status: scheduler load of the client
+ *
+ *  Return:
+ *       0 success, failure otherwise
+ *
+ *  Description:
+ *       Query the pending jobs of the client for back-pressure
+ *
+ **/
+static int32_t mm_jpeg_intf_get_sched_status(uint32_t client_hdl,
+    mm_jpeg_sched_status_t *p_status)
+{
+  int32_t rc = -1;
+
+  if (0 == client_hdl || NULL == p_status) {
+    CDBG_ERROR("%s:%d] invalid parameters", __func__, __LINE__);
+    return rc;
+  }
+
+  pthread_mutex_lock(&g_intf_lock);
+  if (NULL == g_jpeg_obj) {
+    /* mm_jpeg obj not exists, return error */
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    pthread_mutex_unlock(&g_intf_lock);
+    return rc;
+  }
+  rc = mm_jpeg_get_sched_status(g_jpeg_obj, client_hdl, p_status);
+  pthread_mutex_unlock(&g_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_intf_dump_sched_stats:
+ *
+ *  Arguments:
+ *    @fd: file descriptor
+ *
+ *  Return:
+ *       0 success, failure otherwise
+ *
+ *  Description:
+ *       Dump the job scheduler statistics
+ *
+ **/
+static int32_t mm_jpeg_intf_dump_sched_stats(int fd)
+{
+  int32_t rc = -1;
+
+  pthread_mutex_lock(&g_intf_lock);
+  if (NULL == g_jpeg_obj) {
+    /* mm_jpeg obj not exists, return error */
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    pthread_mutex_unlock(&g_intf_lock);
+    return rc;
+  }
+  rc = mm_jpeg_dump_sched_stats(g_jpeg_obj, fd);
+  pthread_mutex_unlock(&g_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_omx_open:
  *
  *  Arguments:
  *    @ops: ops table pointer
+ *    @picture_size: max picture size
  *
  *  Return:
  *       0 failure, success otherwise
  *
  *  Description:
- *       Open a jpeg client
+ *       Open a client of the OMX encoder
  *
  **/
-uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
+static uint32_t mm_jpeg_omx_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
 {
   int32_t rc = 0;
   uint32_t clnt_hdl = 0;
   mm_jpeg_obj* jpeg_obj = NULL;
-  char prop[PROPERTY_VALUE_MAX];
-  uint32_t globalLogLevel = 0;
-
-  memset(prop, 0x0, sizeof(prop));
-  property_get("persist.camera.hal.debug", prop, "0");
-  int val = atoi(prop);
-  if (0 <= val) {
-      gMmJpegIntfLogLevel = (uint32_t)val;
-  }
-  property_get("persist.camera.global.debug", prop, "0");
-  val = atoi(prop);
-  if (0 <= val) {
-      globalLogLevel = (uint32_t)val;
-  }
-
-  /* Highest log level among hal.logs and global.logs is selected */
-  if (gMmJpegIntfLogLevel < globalLogLevel)
-      gMmJpegIntfLogLevel = globalLogLevel;
-  if (gMmJpegIntfLogLevel < MINIMUM_JPEG_LOG_LEVEL)
-      gMmJpegIntfLogLevel = MINIMUM_JPEG_LOG_LEVEL;
 
   pthread_mutex_lock(&g_intf_lock);
   /* first time open */
@@ -355,6 +409,8 @@ uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
       ops->create_session = mm_jpeg_intf_create_session;
       ops->destroy_session = mm_jpeg_intf_destroy_session;
       ops->close = mm_jpeg_intf_close;
+      ops->get_sched_status = mm_jpeg_intf_get_sched_status;
+      ops->dump_sched_stats = mm_jpeg_intf_dump_sched_stats;
     }
   } else {
     /* failed new client */
@@ -371,3 +427,117 @@ uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
   pthread_mutex_unlock(&g_intf_lock);
   return clnt_hdl;
 }
+
+/** mm_jpeg_select_backend:
+ *
+ *  Arguments:
+ *    @backend: requested backend
+ *
+ *  Return:
+ *       backend to open
+ *
+ *  Description:
+ *       Resolves MM_JPEG_BACKEND_AUTO. The qomx core only loads the
+ *       encoder component when a session is created, so its library is
+ *       probed here to fall back to the software encoder on targets
+ *       that do not ship it.
+ *
+ **/
+static mm_jpeg_backend_t mm_jpeg_select_backend(mm_jpeg_backend_t backend)
+{
+  char prop[PROPERTY_VALUE_MAX];
+  void *lib_handle;
+
+  if (MM_JPEG_BACKEND_AUTO != backend) {
+    return backend;
+  }
+
+  property_get("persist.camera.jpeg.backend", prop, "auto");
+  if (!strcmp(prop, "sw")) {
+    return MM_JPEG_BACKEND_SW;
+  } else if (!strcmp(prop, "hw")) {
+    return MM_JPEG_BACKEND_OMX;
+  }
+
+  lib_handle = dlopen(MM_JPEG_OMX_ENC_LIB, RTLD_NOW);
+  if (NULL == lib_handle) {
+    CDBG_HIGH("%s:%d] %s not available, using software encoder", __func__,
+      __LINE__, MM_JPEG_OMX_ENC_LIB);
+    return MM_JPEG_BACKEND_SW;
+  }
+  dlclose(lib_handle);
+  return MM_JPEG_BACKEND_OMX;
+}
+
+/** jpeg_open_backend:
+ *
+ *  Arguments:
+ *    @ops: ops table pointer
+ *    @picture_size: max picture size
+ *    @backend: encoder backend
+ *
+ *  Return:
+ *       0 failure, success otherwise
+ *
+ *  Description:
+ *       Open a jpeg client of the given backend. With
+ *       MM_JPEG_BACKEND_AUTO a client of the software encoder is opened
+ *       if the OMX encoder cannot be initialized.
+ *
+ **/
+uint32_t jpeg_open_backend(mm_jpeg_ops_t *ops, mm_dimension picture_size,
+  mm_jpeg_backend_t backend)
+{
+  uint32_t clnt_hdl = 0;
+  mm_jpeg_backend_t selected;
+  char prop[PROPERTY_VALUE_MAX];
+  uint32_t globalLogLevel = 0;
+
+  memset(prop, 0x0, sizeof(prop));
+  property_get("persist.camera.hal.debug", prop, "0");
+  int val = atoi(prop);
+  if (0 <= val) {
+      gMmJpegIntfLogLevel = (uint32_t)val;
+  }
+  property_get("persist.camera.global.debug", prop, "0");
+  val = atoi(prop);
+  if (0 <= val) {
+      globalLogLevel = (uint32_t)val;
+  }
+
+  /* Highest log level among hal.logs and global.logs is selected */
+  if (gMmJpegIntfLogLevel < globalLogLevel)
+      gMmJpegIntfLogLevel = globalLogLevel;
+  if (gMmJpegIntfLogLevel < MINIMUM_JPEG_LOG_LEVEL)
+      gMmJpegIntfLogLevel = MINIMUM_JPEG_LOG_LEVEL;
+
+  selected = mm_jpeg_select_backend(backend);
+  if (MM_JPEG_BACKEND_SW == selected) {
+    return mm_jpeg_sw_open(ops, picture_size);
+  }
+
+  clnt_hdl = mm_jpeg_omx_open(ops, picture_size);
+  if ((0 == clnt_hdl) && (MM_JPEG_BACKEND_AUTO == backend)) {
+    CDBG_ERROR("%s:%d] OMX encoder failed, using software encoder",
+      __func__, __LINE__);
+    clnt_hdl = mm_jpeg_sw_open(ops, picture_size);
+  }
+  return clnt_hdl;
+}
+
+/** jpeg_open:
+ *
+ *  Arguments:
+ *    @ops: ops table pointer
+ *
+ *  Return:
+ *       0 failure, success otherwise
+ *
+ *  Description:
+ *       Open a jpeg client
+ *
+ **/
+uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
+{
+  return jpeg_open_backend(ops, picture_size, MM_JPEG_BACKEND_AUTO);
+}
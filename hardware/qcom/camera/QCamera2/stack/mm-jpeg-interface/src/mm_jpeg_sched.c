@@ -0,0 +1,590 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+
+#include "mm_jpeg_dbg.h"
+#include "mm_jpeg.h"
+
+/** mm_jpeg_sched_now:
+ *
+ *  Return:
+ *       monotonic time in ns
+ **/
+static inline uint64_t mm_jpeg_sched_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/** mm_jpeg_sched_lat_bin:
+ *
+ *  Arguments:
+ *    @ns: latency in ns
+ *
+ *  Return:
+ *       histogram bucket, 0 for < 1ms and n for [2^(n-1), 2^n) ms
+ **/
+static uint32_t mm_jpeg_sched_lat_bin(uint64_t ns)
+{
+  uint64_t ms = ns / 1000000ULL;
+  uint32_t bin = 0;
+
+  while (ms && (bin < MM_JPEG_HIST_BINS - 1)) {
+    ms >>= 1;
+    bin++;
+  }
+  return bin;
+}
+
+/** mm_jpeg_sched_pick:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *
+ *  Return:
+ *       job to run, NULL if none of the queued jobs can run now
+ *
+ *  Description:
+ *       Walks the todo queue in priority order and takes the first job
+ *       whose session can accept it, so that a busy session does not
+ *       hold back jobs of the other sessions. Must be called with the
+ *       job lock held.
+ **/
+static mm_jpeg_job_q_node_t *mm_jpeg_sched_pick(mm_jpeg_job_cmd_thread_t *sched)
+{
+  mm_jpeg_queue_t *queue = &sched->job_queue;
+  mm_jpeg_q_node_t *node = NULL;
+  mm_jpeg_job_q_node_t *job = NULL;
+  mm_jpeg_job_q_node_t *picked = NULL;
+  struct cam_list *head = NULL;
+  struct cam_list *pos = NULL;
+  uint32_t num_busy = 0;
+  int32_t rc;
+  int full;
+
+  full = (mm_jpeg_queue_get_size(sched->p_ongoing_q) >= sched->max_ongoing);
+
+  pthread_mutex_lock(&queue->lock);
+  head = &queue->head.list;
+  pos = head->next;
+  while (pos != head) {
+    node = member_of(pos, mm_jpeg_q_node_t, list);
+    job = (mm_jpeg_job_q_node_t *)node->data.p;
+    pos = pos->next;
+
+    if (MM_JPEG_CMD_TYPE_EXIT == job->type) {
+      rc = 0;
+    } else if (full) {
+      continue;
+    } else {
+      rc = sched->claim(sched->user_data, job);
+    }
+
+    if (rc > 0) {
+      num_busy++;
+      continue;
+    }
+
+    cam_list_del_node(&node->list);
+    queue->size--;
+    free(node);
+    if (rc < 0) {
+      CDBG_ERROR("%s:%d] dropping job type %d", __func__, __LINE__, job->type);
+      free(job);
+      continue;
+    }
+    picked = job;
+    break;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  if (num_busy) {
+    pthread_mutex_lock(&sched->stats_lock);
+    sched->stats.num_busy += num_busy;
+    pthread_mutex_unlock(&sched->stats_lock);
+  }
+  return picked;
+}
+
+/** mm_jpeg_sched_thread:
+ *
+ *  Arguments:
+ *    @data: scheduler
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Worker main function. Claims a job under the job lock, then hands
+ *       it to the codec without the lock so that workers can set up jobs
+ *       of different sessions concurrently.
+ **/
+static void *mm_jpeg_sched_thread(void *data)
+{
+  mm_jpeg_job_cmd_thread_t *sched = (mm_jpeg_job_cmd_thread_t *)data;
+  mm_jpeg_job_q_node_t *node = NULL;
+  mm_jpeg_q_data_t qdata;
+  uint64_t now;
+  int running = 1;
+  int rc = 0;
+
+  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_thread", 0, 0, 0);
+
+  do {
+    do {
+      rc = cam_sem_wait(&sched->job_sem);
+      if (rc != 0 && errno != EINVAL) {
+        CDBG_ERROR("%s: cam_sem_wait error (%s)",
+          __func__, strerror(errno));
+        return NULL;
+      }
+    } while (rc != 0);
+
+    pthread_mutex_lock(sched->p_job_lock);
+    node = mm_jpeg_sched_pick(sched);
+    if (NULL == node) {
+      pthread_mutex_unlock(sched->p_job_lock);
+      continue;
+    }
+
+    if (MM_JPEG_CMD_TYPE_EXIT == node->type) {
+      pthread_mutex_unlock(sched->p_job_lock);
+      free(node);
+      running = 0;
+      continue;
+    }
+
+    now = mm_jpeg_sched_now();
+    node->dispatch_ts = now;
+    qdata.p = node;
+    rc = mm_jpeg_queue_enq(sched->p_ongoing_q, qdata);
+    if (rc) {
+      CDBG_ERROR("%s:%d] ongoing enqueue failed", __func__, __LINE__);
+      sched->unclaim(sched->user_data, node);
+      pthread_mutex_unlock(sched->p_job_lock);
+      free(node);
+      /* jobs refused for the released resources may run now */
+      cam_sem_post(&sched->job_sem);
+      continue;
+    }
+    sched->num_dispatching++;
+    pthread_mutex_unlock(sched->p_job_lock);
+
+    pthread_mutex_lock(&sched->stats_lock);
+    sched->stats.wait_hist[mm_jpeg_sched_lat_bin(now - node->enq_ts)]++;
+    pthread_mutex_unlock(&sched->stats_lock);
+
+    /* node may be completed and freed by the codec before run returns */
+    sched->run(sched->user_data, node);
+
+    pthread_mutex_lock(sched->p_job_lock);
+    sched->num_dispatching--;
+    pthread_cond_broadcast(&sched->dispatch_cond);
+    pthread_mutex_unlock(sched->p_job_lock);
+  } while (running);
+
+  return NULL;
+}
+
+/** mm_jpeg_sched_init:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *    @p_job_lock: lock serializing dispatch against abort/destroy
+ *    @p_ongoing_q: queue receiving dispatched jobs
+ *    @claim: reserves the resources of a job
+ *    @unclaim: releases them if the claimed job can't be dispatched
+ *    @run: hands a claimed job to the codec
+ *    @user_data: passed to @claim, @unclaim and @run
+ *    @max_jobs: jobs allowed in the codec at once, also the number of
+ *               worker threads
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Initializes the todo queue and launches the worker threads
+ **/
+int32_t mm_jpeg_sched_init(mm_jpeg_job_cmd_thread_t *sched,
+  pthread_mutex_t *p_job_lock,
+  mm_jpeg_queue_t *p_ongoing_q,
+  mm_jpeg_job_claim_t claim,
+  mm_jpeg_job_unclaim_t unclaim,
+  mm_jpeg_job_run_t run,
+  void *user_data,
+  uint32_t max_jobs)
+{
+  char name[16];
+  uint32_t i;
+
+  if ((NULL == claim) || (NULL == unclaim) || (NULL == run) ||
+    (0 == max_jobs)) {
+    CDBG_ERROR("%s:%d] invalid parameters", __func__, __LINE__);
+    return -1;
+  }
+  if (max_jobs > MM_JPEG_MAX_CONCURRENT_JOBS) {
+    max_jobs = MM_JPEG_MAX_CONCURRENT_JOBS;
+  }
+
+  memset(sched, 0, sizeof(*sched));
+  sched->p_job_lock = p_job_lock;
+  sched->p_ongoing_q = p_ongoing_q;
+  sched->claim = claim;
+  sched->unclaim = unclaim;
+  sched->run = run;
+  sched->user_data = user_data;
+  sched->max_ongoing = max_jobs;
+  cam_sem_init(&sched->job_sem, 0);
+  mm_jpeg_queue_init(&sched->job_queue);
+  pthread_cond_init(&sched->dispatch_cond, NULL);
+  pthread_mutex_init(&sched->stats_lock, NULL);
+
+  for (i = 0; i < max_jobs; i++) {
+    if (pthread_create(&sched->pid[i], NULL, mm_jpeg_sched_thread,
+        (void *)sched)) {
+      CDBG_ERROR("%s:%d] worker %u create failed", __func__, __LINE__, i);
+      break;
+    }
+    snprintf(name, sizeof(name), "CAM_jpeg_job%u", i);
+    pthread_setname_np(sched->pid[i], name);
+  }
+  sched->num_workers = i;
+
+  if (0 == sched->num_workers) {
+    pthread_mutex_destroy(&sched->stats_lock);
+    pthread_cond_destroy(&sched->dispatch_cond);
+    mm_jpeg_queue_deinit(&sched->job_queue);
+    cam_sem_destroy(&sched->job_sem);
+    return -1;
+  }
+  CDBG_HIGH("%s:%d] %u jpeg workers", __func__, __LINE__, sched->num_workers);
+  return 0;
+}
+
+/** mm_jpeg_sched_deinit:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Stops the worker threads and releases the todo queue
+ **/
+int32_t mm_jpeg_sched_deinit(mm_jpeg_job_cmd_thread_t *sched)
+{
+  mm_jpeg_job_q_node_t *node = NULL;
+  int32_t rc = 0;
+  uint32_t i;
+
+  for (i = 0; i < sched->num_workers; i++) {
+    node = (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
+    if (NULL == node) {
+      CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
+      rc = -1;
+      break;
+    }
+    memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
+    node->type = MM_JPEG_CMD_TYPE_EXIT;
+    if (mm_jpeg_sched_enq(sched, node)) {
+      free(node);
+      rc = -1;
+      break;
+    }
+  }
+  if (rc) {
+    /* cannot stop the workers */
+    return rc;
+  }
+
+  /* wait until the workers exit */
+  for (i = 0; i < sched->num_workers; i++) {
+    if (pthread_join(sched->pid[i], NULL) != 0) {
+      CDBG("%s: pthread dead already", __func__);
+    }
+  }
+
+  mm_jpeg_queue_deinit(&sched->job_queue);
+  cam_sem_destroy(&sched->job_sem);
+  pthread_cond_destroy(&sched->dispatch_cond);
+  pthread_mutex_destroy(&sched->stats_lock);
+  memset(sched, 0, sizeof(*sched));
+  return rc;
+}
+
+/** mm_jpeg_sched_enq:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *    @node: job node, owned by the scheduler on success
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Queues a job behind the jobs of the same or higher priority and
+ *       wakes up a worker
+ **/
+int32_t mm_jpeg_sched_enq(mm_jpeg_job_cmd_thread_t *sched,
+  mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_queue_t *queue = &sched->job_queue;
+  mm_jpeg_q_node_t *q_node = NULL;
+  mm_jpeg_job_q_node_t *job = NULL;
+  struct cam_list *head = NULL;
+  struct cam_list *pos = NULL;
+  uint32_t depth;
+
+  q_node = (mm_jpeg_q_node_t *)malloc(sizeof(mm_jpeg_q_node_t));
+  if (NULL == q_node) {
+    CDBG_ERROR("%s: No memory for mm_jpeg_q_node_t", __func__);
+    return -1;
+  }
+  memset(q_node, 0, sizeof(mm_jpeg_q_node_t));
+  q_node->data.p = node;
+  node->enq_ts = mm_jpeg_sched_now();
+
+  pthread_mutex_lock(&queue->lock);
+  head = &queue->head.list;
+  if (MM_JPEG_JOB_PRIO_HIGH == node->prio) {
+    pos = head->next;
+    while (pos != head) {
+      job = (mm_jpeg_job_q_node_t *)
+        member_of(pos, mm_jpeg_q_node_t, list)->data.p;
+      if (MM_JPEG_JOB_PRIO_HIGH != job->prio) {
+        break;
+      }
+      pos = pos->next;
+    }
+    cam_list_insert_before_node(&q_node->list, pos);
+  } else {
+    cam_list_add_tail_node(&q_node->list, head);
+  }
+  depth = ++queue->size;
+  pthread_mutex_unlock(&queue->lock);
+
+  if (MM_JPEG_CMD_TYPE_EXIT != node->type) {
+    pthread_mutex_lock(&sched->stats_lock);
+    sched->stats.depth_hist[(depth < MM_JPEG_HIST_BINS) ?
+      depth - 1 : MM_JPEG_HIST_BINS - 1]++;
+    if (depth > sched->stats.max_depth) {
+      sched->stats.max_depth = depth;
+    }
+    sched->stats.num_jobs[node->prio]++;
+    pthread_mutex_unlock(&sched->stats_lock);
+  }
+
+  cam_sem_post(&sched->job_sem);
+  return 0;
+}
+
+/** mm_jpeg_sched_wait_dispatch:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Waits until no worker is handing a job to the codec. Called with
+ *       the job lock held before aborting or destroying sessions, so they
+ *       never race with a job that is claimed but not yet started.
+ **/
+void mm_jpeg_sched_wait_dispatch(mm_jpeg_job_cmd_thread_t *sched)
+{
+  while (sched->num_dispatching) {
+    pthread_cond_wait(&sched->dispatch_cond, sched->p_job_lock);
+  }
+}
+
+/** mm_jpeg_sched_job_done:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *    @node: completed job, removed from the ongoing queue
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Accounts the codec latency of a completed job
+ **/
+void mm_jpeg_sched_job_done(mm_jpeg_job_cmd_thread_t *sched,
+  mm_jpeg_job_q_node_t *node)
+{
+  uint64_t now = mm_jpeg_sched_now();
+
+  if (0 == node->dispatch_ts) {
+    return;
+  }
+  pthread_mutex_lock(&sched->stats_lock);
+  sched->stats.encode_hist[mm_jpeg_sched_lat_bin(now - node->dispatch_ts)]++;
+  sched->stats.num_done++;
+  pthread_mutex_unlock(&sched->stats_lock);
+}
+
+/** mm_jpeg_sched_count_client:
+ *
+ *  Arguments:
+ *    @queue: job queue
+ *    @client_hdl: client handle
+ *
+ *  Return:
+ *       number of jobs of the client in the queue
+ **/
+static uint32_t mm_jpeg_sched_count_client(mm_jpeg_queue_t *queue,
+  uint32_t client_hdl)
+{
+  mm_jpeg_job_q_node_t *job = NULL;
+  struct cam_list *head = NULL;
+  struct cam_list *pos = NULL;
+  uint32_t cnt = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  head = &queue->head.list;
+  for (pos = head->next; pos != head; pos = pos->next) {
+    job = (mm_jpeg_job_q_node_t *)
+      member_of(pos, mm_jpeg_q_node_t, list)->data.p;
+    if ((NULL == job) || (MM_JPEG_CMD_TYPE_EXIT == job->type)) {
+      continue;
+    }
+    if (((MM_JPEG_CMD_TYPE_DECODE_JOB == job->type) ?
+        job->dec_info.client_handle : job->enc_info.client_handle) ==
+        client_hdl) {
+      cnt++;
+    }
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return cnt;
+}
+
+/** mm_jpeg_sched_get_status:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *    @client_hdl: client handle
+ *    @p_status: filled with the client's load
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Reports the jobs of a client that are queued or in the codec.
+ *       A client is expected to hold new jobs while it has more pending
+ *       than the codec can take plus one queued behind them; its own job
+ *       completions then tell it when to resume.
+ **/
+void mm_jpeg_sched_get_status(mm_jpeg_job_cmd_thread_t *sched,
+  uint32_t client_hdl,
+  mm_jpeg_sched_status_t *p_status)
+{
+  p_status->pending_jobs =
+    mm_jpeg_sched_count_client(&sched->job_queue, client_hdl) +
+    mm_jpeg_sched_count_client(sched->p_ongoing_q, client_hdl);
+  p_status->max_pending_jobs = sched->max_ongoing + 1;
+}
+
+/** mm_jpeg_sched_dump_hist:
+ *
+ *  Arguments:
+ *    @fd: file descriptor
+ *    @name: histogram name
+ *    @hist: histogram buckets
+ *    @is_lat: buckets are log2 ms latencies rather than queue depths
+ *
+ *  Return:
+ *       none
+ **/
+static void mm_jpeg_sched_dump_hist(int fd, const char *name,
+  const uint32_t *hist, int is_lat)
+{
+  char line[512];
+  size_t len;
+  uint32_t i;
+
+  len = (size_t)snprintf(line, sizeof(line), "  %-12s", name);
+  for (i = 0; (i < MM_JPEG_HIST_BINS) && (len < sizeof(line)); i++) {
+    if (is_lat) {
+      if (i == MM_JPEG_HIST_BINS - 1) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " >=%u:%u",
+          1U << (i - 1), hist[i]);
+      } else {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " <%u:%u",
+          1U << i, hist[i]);
+      }
+    } else {
+      len += (size_t)snprintf(line + len, sizeof(line) - len, " %u%s:%u",
+        i + 1, (i == MM_JPEG_HIST_BINS - 1) ? "+" : "", hist[i]);
+    }
+  }
+  dprintf(fd, "%s\n", line);
+}
+
+/** mm_jpeg_sched_dump:
+ *
+ *  Arguments:
+ *    @sched: scheduler
+ *    @fd: file descriptor
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Prints the queue depth and latency histograms
+ **/
+void mm_jpeg_sched_dump(mm_jpeg_job_cmd_thread_t *sched, int fd)
+{
+  mm_jpeg_sched_stats_t stats;
+
+  pthread_mutex_lock(&sched->stats_lock);
+  stats = sched->stats;
+  pthread_mutex_unlock(&sched->stats_lock);
+
+  dprintf(fd, "JPEG scheduler: workers %u, max ongoing %u, queued %u, "
+    "ongoing %u\n", sched->num_workers, sched->max_ongoing,
+    mm_jpeg_queue_get_size(&sched->job_queue),
+    mm_jpeg_queue_get_size(sched->p_ongoing_q));
+  dprintf(fd, "  jobs high %u normal %u, done %u, busy skips %u, "
+    "max depth %u\n", stats.num_jobs[MM_JPEG_JOB_PRIO_HIGH],
+    stats.num_jobs[MM_JPEG_JOB_PRIO_NORMAL], stats.num_done,
+    stats.num_busy, stats.max_depth);
+  mm_jpeg_sched_dump_hist(fd, "depth", stats.depth_hist, 0);
+  mm_jpeg_sched_dump_hist(fd, "wait(ms)", stats.wait_hist, 1);
+  mm_jpeg_sched_dump_hist(fd, "encode(ms)", stats.encode_hist, 1);
+}
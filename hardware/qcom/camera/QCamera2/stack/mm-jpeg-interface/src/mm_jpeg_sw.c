@@ -0,0 +1,955 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+
+#include "mm_jpeg_dbg.h"
+#include "mm_jpeg_interface.h"
+#include "mm_jpeg_sw.h"
+
+/* Software JPEG backend. It implements mm_jpeg_ops_t on top of the job
+ * scheduler and the striped encoder in mm_jpeg_sw_enc.c, so that the
+ * camera stack runs on targets and hosts without the OMX encoder. */
+
+static pthread_mutex_t g_sw_intf_lock = PTHREAD_MUTEX_INITIALIZER;
+static mm_jpeg_sw_obj *g_sw_obj = NULL;
+
+/** mm_jpeg_sw_get_session:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *    @id: session or job id
+ *
+ *  Return:
+ *       active session of the id or NULL
+ **/
+static mm_jpeg_sw_session_t *mm_jpeg_sw_get_session(mm_jpeg_sw_obj *my_obj,
+  uint32_t id)
+{
+  uint32_t client_idx = GET_CLIENT_IDX(id);
+  uint32_t session_idx = GET_SESSION_IDX(id);
+  mm_jpeg_sw_session_t *p_session;
+
+  if ((session_idx >= MM_JPEG_MAX_SESSION) ||
+    (client_idx >= MAX_JPEG_CLIENT_NUM)) {
+    CDBG_ERROR("%s:%d] invalid id %x", __func__, __LINE__, id);
+    return NULL;
+  }
+  p_session = &my_obj->clnt_mgr[client_idx].session[session_idx];
+  if (!p_session->active) {
+    return NULL;
+  }
+  return p_session;
+}
+
+/** mm_jpeg_sw_encode_image:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *    @p_session: session
+ *    @p_enc: encoder
+ *    @p_buf: source buffer
+ *    @color_format: source format
+ *    @p_dim: dimensions, crop and output size
+ *    @rotation: clockwise rotation
+ *    @quality: jpeg quality
+ *    @p_job: job with the custom quantization tables
+ *    @p_dst: destination after SOI and APP1, NULL to keep the stripes
+ *    @dst_size: size of the destination
+ *    @p_len: bytes written to @p_dst
+ *
+ *  Return:
+ *       0 on success, negative errno otherwise
+ **/
+static int32_t mm_jpeg_sw_encode_image(mm_jpeg_sw_obj *my_obj,
+  mm_jpeg_sw_session_t *p_session, mm_jpeg_sw_enc_t *p_enc,
+  mm_jpeg_buf_t *p_buf, mm_jpeg_color_format color_format,
+  mm_jpeg_dim_t *p_dim, uint32_t rotation, uint32_t quality,
+  mm_jpeg_encode_job_t *p_job, uint8_t *p_dst, size_t dst_size,
+  size_t *p_len)
+{
+  mm_jpeg_sw_src_t src;
+  uint32_t i;
+
+  memset(&src, 0, sizeof(src));
+  src.p_buf = p_buf;
+  src.color_format = color_format;
+  src.p_dim = p_dim;
+  src.rotation = rotation;
+  src.quality = quality;
+  for (i = 0; (NULL != p_job) && (i < QTABLE_MAX); i++) {
+    if (p_job->qtable_set[i]) {
+      src.p_qtable[i] = p_job->qtable[i].nQuantizationMatrix;
+    }
+  }
+  p_enc->p_abort = &p_session->abort;
+
+  return mm_jpeg_sw_encode(&my_obj->pool, p_enc, &src, p_dst, dst_size, p_len);
+}
+
+/** mm_jpeg_sw_encode_thumbnail:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *    @p_session: session
+ *    @p_job: encode job
+ *
+ *  Return:
+ *       size of the thumbnail in the session's thumbnail buffer, 0 if
+ *       there is none
+ **/
+static size_t mm_jpeg_sw_encode_thumbnail(mm_jpeg_sw_obj *my_obj,
+  mm_jpeg_sw_session_t *p_session, mm_jpeg_encode_job_t *p_job)
+{
+  mm_jpeg_encode_params_t *p_params = &p_session->params;
+  mm_jpeg_dim_t thumb_dim = p_job->thumb_dim;
+  mm_jpeg_buf_t *p_buf;
+  size_t len;
+  int32_t rc;
+
+  if (!p_params->encode_thumbnail) {
+    return 0;
+  }
+  if ((0 == thumb_dim.dst_dim.width) || (0 == thumb_dim.dst_dim.height) ||
+    (0 == thumb_dim.src_dim.width) || (0 == thumb_dim.src_dim.height)) {
+    CDBG_ERROR("%s:%d] invalid thumbnail dim %dx%d -> %dx%d", __func__,
+      __LINE__, thumb_dim.src_dim.width, thumb_dim.src_dim.height,
+      thumb_dim.dst_dim.width, thumb_dim.dst_dim.height);
+    return 0;
+  }
+  if ((thumb_dim.dst_dim.width > thumb_dim.src_dim.width) ||
+    (thumb_dim.dst_dim.height > thumb_dim.src_dim.height)) {
+    thumb_dim.dst_dim = thumb_dim.src_dim;
+  }
+
+  if (p_job->thumb_index < p_params->num_tmb_bufs) {
+    p_buf = &p_params->src_thumb_buf[p_job->thumb_index];
+  } else {
+    p_buf = &p_params->src_main_buf[p_job->src_index];
+  }
+
+  p_session->p_thumb[0] = 0xFF;
+  p_session->p_thumb[1] = 0xD8;
+  rc = mm_jpeg_sw_encode_image(my_obj, p_session, &p_session->thumb_enc,
+    p_buf, p_params->thumb_color_format, &thumb_dim,
+    p_params->thumb_rotation, p_params->thumb_quality, NULL,
+    p_session->p_thumb + 2, MM_JPEG_SW_MAX_SEGMENT_LEN - 2, &len);
+  if (-ENOSPC == rc) {
+    CDBG_ERROR("%s:%d] thumbnail dropped, larger than APP1", __func__,
+      __LINE__);
+    return 0;
+  } else if (rc) {
+    CDBG_ERROR("%s:%d] thumbnail encode failed %d", __func__, __LINE__, rc);
+    return 0;
+  }
+  return len + 2;
+}
+
+/** mm_jpeg_sw_process_job:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *    @p_session: session claimed for the job
+ *    @node: job node
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Encodes the thumbnail, builds the EXIF segment and encodes the
+ *       main image. When the client hands out its output buffer up
+ *       front, APP1 and the main image are written straight into it.
+ *       With get_memory the size has to be known first, so the image is
+ *       assembled once encoded.
+ **/
+static int32_t mm_jpeg_sw_process_job(mm_jpeg_sw_obj *my_obj,
+  mm_jpeg_sw_session_t *p_session, mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_encode_params_t *p_params = &p_session->params;
+  mm_jpeg_encode_job_t *p_job = &node->enc_info.encode_job;
+  mm_jpeg_buf_t *p_dst_buf = &p_params->dest_buf[p_job->dst_index];
+  mm_jpeg_buf_t *p_src_buf = &p_params->src_main_buf[p_job->src_index];
+  mm_jpeg_output_t out_data;
+  QOMX_EXIF_INFO meta_exif;
+  QOMX_EXIF_INFO *exif_list[2];
+  omx_jpeg_ouput_buf_t *p_out_buf = NULL;
+  size_t thumb_len, app1_len = 0, app1_size, jpeg_len, body_len;
+  uint8_t *p_app1;
+  uint8_t *p_dst = NULL;
+  size_t dst_size = 0;
+  uint32_t width, height;
+  int32_t rc;
+
+  if (NULL == p_params->get_memory) {
+    p_dst = p_dst_buf->buf_vaddr;
+    dst_size = p_dst_buf->buf_size;
+    if ((NULL == p_dst) || (dst_size < 4)) {
+      CDBG_ERROR("%s:%d] invalid output buffer %p/%zu", __func__, __LINE__,
+        p_dst, dst_size);
+      return -EINVAL;
+    }
+    p_app1 = p_dst + 2;
+    app1_size = dst_size - 2;
+    if (app1_size > MM_JPEG_SW_MAX_SEGMENT_LEN + 2) {
+      app1_size = MM_JPEG_SW_MAX_SEGMENT_LEN + 2;
+    }
+  } else {
+    p_app1 = p_session->p_app1;
+    app1_size = MM_JPEG_SW_MAX_SEGMENT_LEN + 2;
+  }
+
+  thumb_len = mm_jpeg_sw_encode_thumbnail(my_obj, p_session, p_job);
+
+  /* tags from the HAL and from the metadata, as the OMX path sets them */
+  memset(&p_session->exif_info_local[0], 0,
+    sizeof(p_session->exif_info_local));
+  meta_exif.numOfEntries = 0;
+  meta_exif.exif_data = &p_session->exif_info_local[0];
+  p_session->exif_arena.used = 0;
+  process_meta_data(p_job->p_metadata, &meta_exif, &p_job->cam_exif_params,
+    p_job->hal_version, &p_session->exif_arena);
+  exif_list[0] = &p_job->exif_info;
+  exif_list[1] = &meta_exif;
+
+  /* APP1 goes first, the image size tags are known up front */
+  mm_jpeg_sw_get_dim(&p_job->main_dim, p_job->rotation, &width, &height);
+  rc = mm_jpeg_sw_exif_write(exif_list, 2, width, height,
+    p_session->p_thumb, thumb_len, p_app1, app1_size, &app1_len);
+  if ((-EFBIG == rc) && thumb_len) {
+    CDBG_ERROR("%s:%d] EXIF too large, thumbnail dropped", __func__,
+      __LINE__);
+    rc = mm_jpeg_sw_exif_write(exif_list, 2, width, height, NULL, 0,
+      p_app1, app1_size, &app1_len);
+  }
+  p_session->exif_arena.used = 0;
+  if (rc) {
+    CDBG_ERROR("%s:%d] EXIF failed %d, written without", __func__, __LINE__,
+      rc);
+    app1_len = 0;
+  }
+
+  if (NULL != p_dst) {
+    p_dst[0] = 0xFF;
+    p_dst[1] = 0xD8;
+    rc = mm_jpeg_sw_encode_image(my_obj, p_session, &p_session->main_enc,
+      p_src_buf, p_params->color_format, &p_job->main_dim, p_job->rotation,
+      p_params->quality, p_job, p_dst + 2 + app1_len,
+      dst_size - 2 - app1_len, &body_len);
+    jpeg_len = 2 + app1_len + body_len;
+  } else {
+    rc = mm_jpeg_sw_encode_image(my_obj, p_session, &p_session->main_enc,
+      p_src_buf, p_params->color_format, &p_job->main_dim, p_job->rotation,
+      p_params->quality, p_job, NULL, 0, NULL);
+    if (0 == rc) {
+      /* the client allocates the output once the size is known */
+      jpeg_len = mm_jpeg_sw_get_size(&p_session->main_enc, app1_len);
+      p_out_buf = (omx_jpeg_ouput_buf_t *)p_dst_buf->buf_vaddr;
+      p_out_buf->size = jpeg_len;
+      if (p_params->get_memory(p_out_buf) || (NULL == p_out_buf->vaddr)) {
+        CDBG_ERROR("%s:%d] get_memory failed for %zu bytes", __func__,
+          __LINE__, jpeg_len);
+        return -ENOMEM;
+      }
+      jpeg_len = mm_jpeg_sw_write(&p_session->main_enc, p_app1, app1_len,
+        (uint8_t *)p_out_buf->vaddr, jpeg_len);
+    }
+  }
+  if (rc) {
+    CDBG_ERROR("%s:%d] main image encode failed %d", __func__, __LINE__, rc);
+    return rc;
+  }
+
+  CDBG_HIGH("%s:%d] job %x, %dx%d, %zu bytes, thumbnail %zu", __func__,
+    __LINE__, node->enc_info.job_id, p_session->main_enc.width,
+    p_session->main_enc.height, jpeg_len, thumb_len);
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  rc = p_session->abort ? -ECANCELED : 0;
+  pthread_mutex_unlock(&my_obj->job_lock);
+  if ((0 == rc) && (NULL != p_params->jpeg_cb)) {
+    out_data.buf_vaddr = p_dst_buf->buf_vaddr;
+    out_data.buf_filled_len = jpeg_len;
+    out_data.fd = 0;
+    p_params->jpeg_cb(JPEG_JOB_STATUS_DONE, p_session->client_hdl,
+      node->enc_info.job_id, &out_data, p_params->userdata);
+  }
+  return 0;
+}
+
+/** mm_jpeg_sw_job_claim:
+ *
+ *  Arguments:
+ *    @user_data: software jpeg object
+ *    @node: job node
+ *
+ *  Return:
+ *       0 if the job can start, 1 if its session is busy, -1 on error
+ *
+ *  Description:
+ *       Scheduler claim callback, one job per session at a time
+ **/
+static int32_t mm_jpeg_sw_job_claim(void *user_data,
+  mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_sw_obj *my_obj = (mm_jpeg_sw_obj *)user_data;
+  mm_jpeg_sw_session_t *p_session;
+
+  if (MM_JPEG_CMD_TYPE_JOB != node->type) {
+    return -1;
+  }
+  p_session = mm_jpeg_sw_get_session(my_obj, node->enc_info.job_id);
+  if (NULL == p_session) {
+    CDBG_ERROR("%s:%d] invalid job id %x", __func__, __LINE__,
+      node->enc_info.job_id);
+    return -1;
+  }
+  if (p_session->busy) {
+    return 1;
+  }
+
+  if (node->enc_info.encode_job.dst_index < 0) {
+    node->enc_info.encode_job.dst_index =
+      (int32_t)(p_session->next_out_buf++ % p_session->params.num_dst_bufs);
+  }
+  p_session->busy = 1;
+  p_session->abort = 0;
+  p_session->job_id = node->enc_info.job_id;
+  return 0;
+}
+
+/** mm_jpeg_sw_job_unclaim:
+ *
+ *  Arguments:
+ *    @user_data: software jpeg object
+ *    @node: job node
+ *
+ *  Description:
+ *       Scheduler unclaim callback, frees the session for its next job
+ **/
+static void mm_jpeg_sw_job_unclaim(void *user_data,
+  mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_sw_obj *my_obj = (mm_jpeg_sw_obj *)user_data;
+  mm_jpeg_sw_session_t *p_session;
+
+  p_session = mm_jpeg_sw_get_session(my_obj, node->enc_info.job_id);
+  if (NULL == p_session) {
+    return;
+  }
+  p_session->busy = 0;
+  p_session->abort = 0;
+  p_session->job_id = 0;
+  pthread_cond_broadcast(&my_obj->job_done_cond);
+}
+
+/** mm_jpeg_sw_job_run:
+ *
+ *  Arguments:
+ *    @user_data: software jpeg object
+ *    @node: job node
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Scheduler run callback. The job is encoded on the scheduler
+ *       thread and the encoder pool, then completed.
+ **/
+static int32_t mm_jpeg_sw_job_run(void *user_data, mm_jpeg_job_q_node_t *node)
+{
+  mm_jpeg_sw_obj *my_obj = (mm_jpeg_sw_obj *)user_data;
+  mm_jpeg_sw_session_t *p_session;
+  uint32_t job_id = node->enc_info.job_id;
+  int32_t rc;
+
+  /* the session stays valid while busy, destroy waits for it */
+  p_session = &my_obj->clnt_mgr[GET_CLIENT_IDX(job_id)]
+    .session[GET_SESSION_IDX(job_id)];
+
+  rc = mm_jpeg_sw_process_job(my_obj, p_session, node);
+  if (rc && (-ECANCELED != rc) && (NULL != p_session->params.jpeg_cb)) {
+    p_session->params.jpeg_cb(JPEG_JOB_STATUS_ERROR, p_session->client_hdl,
+      job_id, NULL, p_session->params.userdata);
+  }
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q, job_id);
+  if (node) {
+    mm_jpeg_sched_job_done(&my_obj->job_mgr, node);
+    free(node);
+  }
+  p_session->busy = 0;
+  p_session->abort = 0;
+  p_session->job_id = 0;
+  pthread_cond_broadcast(&my_obj->job_done_cond);
+  pthread_mutex_unlock(&my_obj->job_lock);
+
+  /* a job of this session may be waiting */
+  cam_sem_post(&my_obj->job_mgr.job_sem);
+  return rc;
+}
+
+/** mm_jpeg_sw_wait_idle:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *    @p_session: session
+ *
+ *  Description:
+ *       Aborts the running job of the session and waits for it to
+ *       complete. Called with the job lock held.
+ **/
+static void mm_jpeg_sw_wait_idle(mm_jpeg_sw_obj *my_obj,
+  mm_jpeg_sw_session_t *p_session)
+{
+  while (p_session->busy) {
+    p_session->abort = 1;
+    pthread_cond_wait(&my_obj->job_done_cond, &my_obj->job_lock);
+  }
+}
+
+/** mm_jpeg_sw_start_job:
+ *
+ *  Arguments:
+ *    @job: encode job
+ *    @job_id: job id
+ *
+ *  Return:
+ *       0 for success else failure
+ **/
+static int32_t mm_jpeg_sw_start_job(mm_jpeg_job_t *job, uint32_t *job_id)
+{
+  mm_jpeg_sw_obj *my_obj;
+  mm_jpeg_sw_session_t *p_session;
+  mm_jpeg_encode_job_t *p_jobparams;
+  mm_jpeg_job_q_node_t *node;
+  int32_t rc = -1;
+
+  if ((NULL == job) || (NULL == job_id)) {
+    CDBG_ERROR("%s:%d] invalid parameters for job or jobId", __func__,
+      __LINE__);
+    return rc;
+  }
+  *job_id = 0;
+  p_jobparams = &job->encode_job;
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  my_obj = g_sw_obj;
+  if (NULL == my_obj) {
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    goto end;
+  }
+
+  p_session = mm_jpeg_sw_get_session(my_obj, p_jobparams->session_id);
+  if (NULL == p_session) {
+    CDBG_ERROR("%s:%d] session not active %x", __func__, __LINE__,
+      p_jobparams->session_id);
+    goto end;
+  }
+  if ((p_jobparams->src_index < 0) ||
+    (p_jobparams->src_index >= (int32_t)p_session->params.num_src_bufs) ||
+    (p_jobparams->dst_index >= (int32_t)p_session->params.num_dst_bufs)) {
+    CDBG_ERROR("%s:%d] invalid buffer indices", __func__, __LINE__);
+    goto end;
+  }
+
+  node = (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
+  if (NULL == node) {
+    CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
+    goto end;
+  }
+
+  *job_id = p_jobparams->session_id |
+    ((p_session->job_hist++ % JOB_HIST_MAX) << 16);
+
+  memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
+  node->enc_info.encode_job = *p_jobparams;
+  node->enc_info.job_id = *job_id;
+  node->enc_info.client_handle = p_session->client_hdl;
+  node->type = MM_JPEG_CMD_TYPE_JOB;
+  if ((uint64_t)p_jobparams->main_dim.dst_dim.width *
+    (uint64_t)p_jobparams->main_dim.dst_dim.height <=
+    MM_JPEG_PRIO_HIGH_MAX_PIXELS) {
+    node->prio = MM_JPEG_JOB_PRIO_HIGH;
+  }
+
+  rc = mm_jpeg_sched_enq(&my_obj->job_mgr, node);
+  if (0 != rc) {
+    free(node);
+  }
+
+end:
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_sw_abort_job:
+ *
+ *  Arguments:
+ *    @job_id: job id
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Drops the job if it is queued, stops it if it is encoding. No
+ *       callback is sent for an aborted job.
+ **/
+static int32_t mm_jpeg_sw_abort_job(uint32_t job_id)
+{
+  mm_jpeg_sw_obj *my_obj;
+  mm_jpeg_sw_session_t *p_session;
+  mm_jpeg_job_q_node_t *node;
+  int32_t rc = -1;
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  my_obj = g_sw_obj;
+  if ((NULL == my_obj) || (0 == job_id)) {
+    CDBG_ERROR("%s:%d] invalid job id %x", __func__, __LINE__, job_id);
+    pthread_mutex_unlock(&g_sw_intf_lock);
+    return rc;
+  }
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue,
+    job_id);
+  if (NULL != node) {
+    free(node);
+    rc = 0;
+  } else {
+    p_session = mm_jpeg_sw_get_session(my_obj, job_id);
+    if ((NULL != p_session) && p_session->busy &&
+      (p_session->job_id == job_id)) {
+      mm_jpeg_sw_wait_idle(my_obj, p_session);
+      rc = 0;
+    }
+  }
+  pthread_mutex_unlock(&my_obj->job_lock);
+
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_sw_create_session:
+ *
+ *  Arguments:
+ *    @client_hdl: client handle
+ *    @p_params: encode parameters
+ *    @p_session_id: session id
+ *
+ *  Return:
+ *       0 for success else failure
+ **/
+static int32_t mm_jpeg_sw_create_session(uint32_t client_hdl,
+  mm_jpeg_encode_params_t *p_params,
+  uint32_t *p_session_id)
+{
+  mm_jpeg_sw_obj *my_obj;
+  mm_jpeg_sw_client_t *p_client;
+  mm_jpeg_sw_session_t *p_session = NULL;
+  uint8_t clnt_idx;
+  uint32_t i;
+  int32_t rc = -1;
+
+  if ((0 == client_hdl) || (NULL == p_params) || (NULL == p_session_id)) {
+    CDBG_ERROR("%s:%d] invalid client_hdl or jobId", __func__, __LINE__);
+    return rc;
+  }
+  *p_session_id = 0;
+
+  if ((p_params->num_src_bufs > MM_JPEG_MAX_BUF) ||
+    (p_params->num_dst_bufs > MM_JPEG_MAX_BUF) ||
+    (p_params->num_tmb_bufs > MM_JPEG_MAX_BUF) ||
+    (0 == p_params->num_src_bufs) || (0 == p_params->num_dst_bufs)) {
+    CDBG_ERROR("%s:%d] invalid num buffers", __func__, __LINE__);
+    return rc;
+  }
+  if ((p_params->color_format >= MM_JPEG_COLOR_FORMAT_BITSTREAM_H2V2) ||
+    (p_params->encode_thumbnail &&
+    (p_params->thumb_color_format >= MM_JPEG_COLOR_FORMAT_BITSTREAM_H2V2))) {
+    CDBG_ERROR("%s:%d] color format %d/%d not supported", __func__,
+      __LINE__, p_params->color_format, p_params->thumb_color_format);
+    return rc;
+  }
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  my_obj = g_sw_obj;
+  clnt_idx = mm_jpeg_util_get_index_by_handler(client_hdl);
+  if ((NULL == my_obj) || (clnt_idx >= MAX_JPEG_CLIENT_NUM) ||
+    (!my_obj->clnt_mgr[clnt_idx].is_used)) {
+    CDBG_ERROR("%s: invalid client with handler (%d)", __func__, client_hdl);
+    goto end;
+  }
+  p_client = &my_obj->clnt_mgr[clnt_idx];
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    if (!p_client->session[i].active) {
+      p_session = &p_client->session[i];
+      break;
+    }
+  }
+  if (NULL == p_session) {
+    pthread_mutex_unlock(&my_obj->job_lock);
+    CDBG_ERROR("%s:%d] no free session", __func__, __LINE__);
+    goto end;
+  }
+
+  memset(p_session, 0, sizeof(*p_session));
+  p_session->p_app1 = (uint8_t *)malloc(MM_JPEG_SW_MAX_SEGMENT_LEN + 2);
+  p_session->p_thumb = (uint8_t *)malloc(MM_JPEG_SW_MAX_SEGMENT_LEN);
+  if ((NULL == p_session->p_app1) || (NULL == p_session->p_thumb)) {
+    pthread_mutex_unlock(&my_obj->job_lock);
+    CDBG_ERROR("%s:%d] no memory", __func__, __LINE__);
+    free(p_session->p_app1);
+    free(p_session->p_thumb);
+    memset(p_session, 0, sizeof(*p_session));
+    goto end;
+  }
+  p_session->params = *p_params;
+  p_session->client_hdl = client_hdl;
+  p_session->session_id = (JOB_ID_MAGICVAL << 24) | (i << 8) | clnt_idx;
+  p_session->active = 1;
+  *p_session_id = p_session->session_id;
+  pthread_mutex_unlock(&my_obj->job_lock);
+
+  CDBG_HIGH("%s:%d] session id %x", __func__, __LINE__, *p_session_id);
+  rc = 0;
+
+end:
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_sw_destroy_session_unlocked:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *    @p_session: session
+ *
+ *  Description:
+ *       Drops the queued jobs of the session, stops the running one and
+ *       frees the session. Called with the job lock held.
+ **/
+static void mm_jpeg_sw_destroy_session_unlocked(mm_jpeg_sw_obj *my_obj,
+  mm_jpeg_sw_session_t *p_session)
+{
+  mm_jpeg_job_q_node_t *node;
+
+  while (NULL != (node = mm_jpeg_queue_remove_job_by_session_id(
+    &my_obj->job_mgr.job_queue, p_session->session_id))) {
+    free(node);
+  }
+  mm_jpeg_sw_wait_idle(my_obj, p_session);
+
+  mm_jpeg_sw_enc_release(&p_session->main_enc);
+  mm_jpeg_sw_enc_release(&p_session->thumb_enc);
+  free(p_session->p_app1);
+  free(p_session->p_thumb);
+  memset(p_session, 0, sizeof(*p_session));
+}
+
+/** mm_jpeg_sw_destroy_session:
+ *
+ *  Arguments:
+ *    @session_id: session id
+ *
+ *  Return:
+ *       0 for success else failure
+ **/
+static int32_t mm_jpeg_sw_destroy_session(uint32_t session_id)
+{
+  mm_jpeg_sw_obj *my_obj;
+  mm_jpeg_sw_session_t *p_session;
+  int32_t rc = -1;
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  my_obj = g_sw_obj;
+  if (NULL == my_obj) {
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    pthread_mutex_unlock(&g_sw_intf_lock);
+    return rc;
+  }
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  p_session = mm_jpeg_sw_get_session(my_obj, session_id);
+  if ((NULL != p_session) && (p_session->session_id == session_id)) {
+    mm_jpeg_sw_destroy_session_unlocked(my_obj, p_session);
+    rc = 0;
+  } else {
+    CDBG_ERROR("%s:%d] invalid session %x", __func__, __LINE__, session_id);
+  }
+  pthread_mutex_unlock(&my_obj->job_lock);
+
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_sw_deinit:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *
+ *  Description:
+ *       Stops the scheduler and the encoder pool
+ **/
+static void mm_jpeg_sw_deinit(mm_jpeg_sw_obj *my_obj)
+{
+  mm_jpeg_sched_deinit(&my_obj->job_mgr);
+  mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
+  mm_jpeg_sw_pool_deinit(&my_obj->pool);
+  pthread_cond_destroy(&my_obj->job_done_cond);
+  pthread_mutex_destroy(&my_obj->job_lock);
+}
+
+/** mm_jpeg_sw_close:
+ *
+ *  Arguments:
+ *    @client_hdl: client handle
+ *
+ *  Return:
+ *       0 for success else failure
+ **/
+static int32_t mm_jpeg_sw_close(uint32_t client_hdl)
+{
+  mm_jpeg_sw_obj *my_obj;
+  mm_jpeg_sw_client_t *p_client;
+  uint8_t clnt_idx;
+  uint32_t i;
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  my_obj = g_sw_obj;
+  clnt_idx = mm_jpeg_util_get_index_by_handler(client_hdl);
+  if ((NULL == my_obj) || (clnt_idx >= MAX_JPEG_CLIENT_NUM) ||
+    (my_obj->clnt_mgr[clnt_idx].client_handle != client_hdl)) {
+    CDBG_ERROR("%s: invalid client with handler (%d)", __func__, client_hdl);
+    pthread_mutex_unlock(&g_sw_intf_lock);
+    return -1;
+  }
+  p_client = &my_obj->clnt_mgr[clnt_idx];
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    if (p_client->session[i].active) {
+      mm_jpeg_sw_destroy_session_unlocked(my_obj, &p_client->session[i]);
+    }
+  }
+  memset(p_client, 0, sizeof(*p_client));
+  my_obj->num_clients--;
+  pthread_mutex_unlock(&my_obj->job_lock);
+
+  if (0 == my_obj->num_clients) {
+    mm_jpeg_sw_deinit(my_obj);
+    free(my_obj);
+    g_sw_obj = NULL;
+  }
+
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return 0;
+}
+
+/** mm_jpeg_sw_get_sched_status:
+ *
+ *  Arguments:
+ *    @client_hdl: client handle
+ *    @p_status: scheduler load of the client
+ *
+ *  Return:
+ *       0 for success else failure
+ **/
+static int32_t mm_jpeg_sw_get_sched_status(uint32_t client_hdl,
+  mm_jpeg_sched_status_t *p_status)
+{
+  mm_jpeg_sw_obj *my_obj;
+  uint8_t clnt_idx = mm_jpeg_util_get_index_by_handler(client_hdl);
+  int32_t rc = -1;
+
+  if (NULL == p_status) {
+    return rc;
+  }
+  pthread_mutex_lock(&g_sw_intf_lock);
+  my_obj = g_sw_obj;
+  if ((NULL != my_obj) && (clnt_idx < MAX_JPEG_CLIENT_NUM) &&
+    my_obj->clnt_mgr[clnt_idx].is_used) {
+    mm_jpeg_sched_get_status(&my_obj->job_mgr, client_hdl, p_status);
+    rc = 0;
+  }
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_sw_dump_sched_stats:
+ *
+ *  Arguments:
+ *    @fd: file descriptor
+ *
+ *  Return:
+ *       0 for success else failure
+ **/
+static int32_t mm_jpeg_sw_dump_sched_stats(int fd)
+{
+  int32_t rc = -1;
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  if (NULL != g_sw_obj) {
+    dprintf(fd, "software encoder, %u threads\n",
+      g_sw_obj->pool.num_threads + 1);
+    mm_jpeg_sched_dump(&g_sw_obj->job_mgr, fd);
+    rc = 0;
+  }
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return rc;
+}
+
+/** mm_jpeg_sw_init:
+ *
+ *  Arguments:
+ *    @my_obj: software jpeg object
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Starts the encoder pool and the scheduler. The thread count
+ *       comes from persist.camera.jpeg.sw.threads, by default one per
+ *       online CPU; the scheduler thread running a job is one of them.
+ **/
+static int32_t mm_jpeg_sw_init(mm_jpeg_sw_obj *my_obj)
+{
+  char prop[PROPERTY_VALUE_MAX];
+  long num_threads;
+  int32_t rc;
+
+  property_get("persist.camera.jpeg.sw.threads", prop, "0");
+  num_threads = atoi(prop);
+  if (num_threads <= 0) {
+    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (num_threads <= 0) {
+    num_threads = 1;
+  } else if (num_threads > MM_JPEG_SW_MAX_THREADS) {
+    num_threads = MM_JPEG_SW_MAX_THREADS;
+  }
+
+  pthread_mutex_init(&my_obj->job_lock, NULL);
+  pthread_cond_init(&my_obj->job_done_cond, NULL);
+  mm_jpeg_queue_init(&my_obj->ongoing_job_q);
+
+  rc = mm_jpeg_sw_pool_init(&my_obj->pool, (uint32_t)num_threads - 1);
+  if (0 == rc) {
+    rc = mm_jpeg_sched_init(&my_obj->job_mgr, &my_obj->job_lock,
+      &my_obj->ongoing_job_q, mm_jpeg_sw_job_claim, mm_jpeg_sw_job_unclaim,
+      mm_jpeg_sw_job_run, (void *)my_obj, NUM_MAX_JPEG_CNCURRENT_JOBS);
+    if (rc) {
+      mm_jpeg_sw_pool_deinit(&my_obj->pool);
+    }
+  }
+  if (rc) {
+    CDBG_ERROR("%s:%d] init failed %d", __func__, __LINE__, rc);
+    mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
+    pthread_cond_destroy(&my_obj->job_done_cond);
+    pthread_mutex_destroy(&my_obj->job_lock);
+  }
+  return rc;
+}
+
+/** mm_jpeg_sw_open:
+ *
+ *  Arguments:
+ *    @ops: ops table pointer
+ *    @picture_size: max picture size, unused
+ *
+ *  Return:
+ *       0 failure, success otherwise
+ *
+ *  Description:
+ *       Opens a client of the software backend
+ **/
+uint32_t mm_jpeg_sw_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
+{
+  mm_jpeg_sw_obj *my_obj;
+  uint32_t clnt_hdl = 0;
+  uint8_t idx;
+
+  pthread_mutex_lock(&g_sw_intf_lock);
+  if (NULL == g_sw_obj) {
+    my_obj = (mm_jpeg_sw_obj *)calloc(1, sizeof(mm_jpeg_sw_obj));
+    if (NULL == my_obj) {
+      CDBG_ERROR("%s:%d] no mem", __func__, __LINE__);
+      goto end;
+    }
+    if (mm_jpeg_sw_init(my_obj)) {
+      free(my_obj);
+      goto end;
+    }
+    g_sw_obj = my_obj;
+  }
+  my_obj = g_sw_obj;
+
+  pthread_mutex_lock(&my_obj->job_lock);
+  for (idx = 0; idx < MAX_JPEG_CLIENT_NUM; idx++) {
+    if (!my_obj->clnt_mgr[idx].is_used) {
+      break;
+    }
+  }
+  if (idx < MAX_JPEG_CLIENT_NUM) {
+    clnt_hdl = mm_jpeg_util_generate_handler(idx);
+    my_obj->clnt_mgr[idx].is_used = 1;
+    my_obj->clnt_mgr[idx].client_handle = clnt_hdl;
+    my_obj->num_clients++;
+  }
+  pthread_mutex_unlock(&my_obj->job_lock);
+
+  if (0 == clnt_hdl) {
+    CDBG_ERROR("%s:%d] num of clients reached limit", __func__, __LINE__);
+    if (0 == my_obj->num_clients) {
+      mm_jpeg_sw_deinit(my_obj);
+      free(my_obj);
+      g_sw_obj = NULL;
+    }
+  } else if (NULL != ops) {
+    ops->start_job = mm_jpeg_sw_start_job;
+    ops->abort_job = mm_jpeg_sw_abort_job;
+    ops->create_session = mm_jpeg_sw_create_session;
+    ops->destroy_session = mm_jpeg_sw_destroy_session;
+    ops->close = mm_jpeg_sw_close;
+    ops->get_sched_status = mm_jpeg_sw_get_sched_status;
+    ops->dump_sched_stats = mm_jpeg_sw_dump_sched_stats;
+  }
+
+end:
+  pthread_mutex_unlock(&g_sw_intf_lock);
+  return clnt_hdl;
+}
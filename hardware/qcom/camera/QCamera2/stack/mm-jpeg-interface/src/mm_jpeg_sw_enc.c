@@ -0,0 +1,1536 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+#include "mm_jpeg_dbg.h"
+#include "mm_jpeg_sw.h"
+
+/* Baseline sequential JPEG encoder. The image is cut into stripes of whole
+ * MCU rows, each stripe is a restart interval of its own and is entropy
+ * coded independently by the pool threads; the stripes are stitched
+ * together with RSTn markers when the output is written. */
+
+/* eight floats, lowered to NEON on ARM and SSE/AVX on x86 */
+typedef float mm_jpeg_sw_v8f_t __attribute__((vector_size(32)));
+
+typedef union {
+  mm_jpeg_sw_v8f_t v[8];
+  float f[QUANT_SIZE];
+} mm_jpeg_sw_block_t;
+
+typedef struct {
+  const uint8_t *p_bits;          /* codes of each length 1..16 */
+  const uint8_t *p_vals;
+  uint32_t num_vals;
+  uint16_t code[256];
+  uint8_t size[256];
+} mm_jpeg_sw_huff_t;
+
+typedef struct {
+  mm_jpeg_sw_buf_t *p_out;
+  uint32_t acc;
+  uint32_t nbits;
+} mm_jpeg_sw_bits_t;
+
+/* natural order index of the k-th zigzag coefficient */
+static const uint8_t mm_jpeg_sw_zigzag[QUANT_SIZE] = {
+  0,  1,  8, 16,  9,  2,  3, 10,
+  17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34,
+  27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36,
+  29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46,
+  53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* ITU-T T.81 tables K.1 and K.2, natural order */
+static const uint8_t mm_jpeg_sw_std_qtable[QTABLE_MAX][QUANT_SIZE] = {
+  {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99
+  },
+  {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+  }
+};
+
+/* ITU-T T.81 tables K.3 to K.6 */
+static const uint8_t mm_jpeg_sw_dc_luma_bits[16] = {
+  0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0
+};
+static const uint8_t mm_jpeg_sw_dc_chroma_bits[16] = {
+  0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
+};
+static const uint8_t mm_jpeg_sw_dc_vals[12] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+static const uint8_t mm_jpeg_sw_ac_luma_bits[16] = {
+  0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d
+};
+static const uint8_t mm_jpeg_sw_ac_luma_vals[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+  0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+  0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+  0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+  0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+  0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+  0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+  0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+  0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+  0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+  0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+static const uint8_t mm_jpeg_sw_ac_chroma_bits[16] = {
+  0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77
+};
+static const uint8_t mm_jpeg_sw_ac_chroma_vals[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+  0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+  0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+  0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+  0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+  0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+  0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+  0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+  0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+  0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+  0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+/* luma DC, luma AC, chroma DC, chroma AC */
+static mm_jpeg_sw_huff_t mm_jpeg_sw_huff[4] = {
+  { mm_jpeg_sw_dc_luma_bits, mm_jpeg_sw_dc_vals, 12, {0}, {0} },
+  { mm_jpeg_sw_ac_luma_bits, mm_jpeg_sw_ac_luma_vals, 162, {0}, {0} },
+  { mm_jpeg_sw_dc_chroma_bits, mm_jpeg_sw_dc_vals, 12, {0}, {0} },
+  { mm_jpeg_sw_ac_chroma_bits, mm_jpeg_sw_ac_chroma_vals, 162, {0}, {0} },
+};
+
+/* position of the k-th zigzag coefficient in the transposed output of
+ * mm_jpeg_sw_fdct */
+static uint8_t mm_jpeg_sw_zigzag_t[QUANT_SIZE];
+
+static pthread_once_t mm_jpeg_sw_tables_once = PTHREAD_ONCE_INIT;
+
+/** mm_jpeg_sw_init_tables:
+ *
+ *  Description:
+ *       Derives the huffman codes (T.81 annex C) and the transposed
+ *       zigzag order
+ **/
+static void mm_jpeg_sw_init_tables(void)
+{
+  uint32_t t, l, i, k;
+  uint32_t code;
+
+  for (t = 0; t < 4; t++) {
+    mm_jpeg_sw_huff_t *p_huff = &mm_jpeg_sw_huff[t];
+    code = 0;
+    k = 0;
+    for (l = 1; l <= 16; l++) {
+      for (i = 0; i < p_huff->p_bits[l - 1]; i++) {
+        uint8_t sym = p_huff->p_vals[k++];
+        p_huff->code[sym] = (uint16_t)code;
+        p_huff->size[sym] = (uint8_t)l;
+        code++;
+      }
+      code <<= 1;
+    }
+  }
+
+  for (k = 0; k < QUANT_SIZE; k++) {
+    uint32_t n = mm_jpeg_sw_zigzag[k];
+    mm_jpeg_sw_zigzag_t[k] = (uint8_t)((n % 8) * 8 + n / 8);
+  }
+}
+
+/** mm_jpeg_sw_init_qtables:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @p_src: image with the quality and optional custom tables
+ *
+ *  Description:
+ *       Builds the zigzag tables written to DQT and the reciprocals the
+ *       forward DCT output is multiplied with. Custom tables are used as
+ *       they are, the standard ones are scaled by the quality like the
+ *       IJG encoder does.
+ **/
+static void mm_jpeg_sw_init_qtables(mm_jpeg_sw_enc_t *p_enc,
+  mm_jpeg_sw_src_t *p_src)
+{
+  static const float aan[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+    1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+  };
+  uint32_t quality = p_src->quality;
+  uint32_t scale;
+  uint32_t t, n, k;
+
+  if (quality < 1) {
+    quality = 1;
+  } else if (quality > 100) {
+    quality = 100;
+  }
+  scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+
+  for (t = 0; t < QTABLE_MAX; t++) {
+    uint32_t q[QUANT_SIZE];
+
+    for (n = 0; n < QUANT_SIZE; n++) {
+      if (NULL != p_src->p_qtable[t]) {
+        q[n] = p_src->p_qtable[t][n];
+      } else {
+        q[n] = (mm_jpeg_sw_std_qtable[t][n] * scale + 50) / 100;
+      }
+      if (q[n] < 1) {
+        q[n] = 1;
+      } else if (q[n] > 255) {
+        q[n] = 255;
+      }
+      p_enc->qdiv[t][(n % 8) * 8 + n / 8] = 1.0f /
+        ((float)q[n] * aan[n / 8] * aan[n % 8] * 8.0f);
+    }
+    for (k = 0; k < QUANT_SIZE; k++) {
+      p_enc->qtbl[t][k] = (uint8_t)q[mm_jpeg_sw_zigzag[k]];
+    }
+  }
+}
+
+/** mm_jpeg_sw_fdct_pass:
+ *
+ *  Arguments:
+ *    @d: eight rows of the block
+ *
+ *  Description:
+ *       One dimensional AAN forward DCT down the columns, all eight
+ *       columns at once
+ **/
+static inline void mm_jpeg_sw_fdct_pass(mm_jpeg_sw_v8f_t *d)
+{
+  mm_jpeg_sw_v8f_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  mm_jpeg_sw_v8f_t tmp10, tmp11, tmp12, tmp13;
+  mm_jpeg_sw_v8f_t z1, z2, z3, z4, z5, z11, z13;
+
+  tmp0 = d[0] + d[7];
+  tmp7 = d[0] - d[7];
+  tmp1 = d[1] + d[6];
+  tmp6 = d[1] - d[6];
+  tmp2 = d[2] + d[5];
+  tmp5 = d[2] - d[5];
+  tmp3 = d[3] + d[4];
+  tmp4 = d[3] - d[4];
+
+  /* even part */
+  tmp10 = tmp0 + tmp3;
+  tmp13 = tmp0 - tmp3;
+  tmp11 = tmp1 + tmp2;
+  tmp12 = tmp1 - tmp2;
+
+  d[0] = tmp10 + tmp11;
+  d[4] = tmp10 - tmp11;
+
+  z1 = (tmp12 + tmp13) * 0.707106781f;
+  d[2] = tmp13 + z1;
+  d[6] = tmp13 - z1;
+
+  /* odd part */
+  tmp10 = tmp4 + tmp5;
+  tmp11 = tmp5 + tmp6;
+  tmp12 = tmp6 + tmp7;
+
+  z5 = (tmp10 - tmp12) * 0.382683433f;
+  z2 = tmp10 * 0.541196100f + z5;
+  z4 = tmp12 * 1.306562965f + z5;
+  z3 = tmp11 * 0.707106781f;
+
+  z11 = tmp7 + z3;
+  z13 = tmp7 - z3;
+
+  d[5] = z13 + z2;
+  d[3] = z13 - z2;
+  d[1] = z11 + z4;
+  d[7] = z11 - z4;
+}
+
+/** mm_jpeg_sw_fdct_quant:
+ *
+ *  Arguments:
+ *    @p_blk: level shifted samples, destroyed
+ *    @p_qdiv: quantization reciprocals
+ *    @p_coef: quantized coefficients, transposed natural order
+ *
+ *  Description:
+ *       2D forward DCT and quantization of one block
+ **/
+static void mm_jpeg_sw_fdct_quant(mm_jpeg_sw_block_t *p_blk,
+  const float *p_qdiv, int16_t *p_coef)
+{
+  uint32_t r, c, i;
+
+  mm_jpeg_sw_fdct_pass(p_blk->v);
+  for (r = 0; r < 8; r++) {
+    for (c = r + 1; c < 8; c++) {
+      float tmp = p_blk->f[r * 8 + c];
+      p_blk->f[r * 8 + c] = p_blk->f[c * 8 + r];
+      p_blk->f[c * 8 + r] = tmp;
+    }
+  }
+  mm_jpeg_sw_fdct_pass(p_blk->v);
+
+  for (i = 0; i < QUANT_SIZE; i++) {
+    float val = p_blk->f[i] * p_qdiv[i];
+    p_coef[i] = (int16_t)((int32_t)(val + 16384.5f) - 16384);
+  }
+}
+
+/** mm_jpeg_sw_fetch:
+ *
+ *  Arguments:
+ *    @p_comp: component
+ *    @x0: first column of the block
+ *    @y0: first row of the block
+ *    @p_blk: level shifted samples
+ *
+ *  Description:
+ *       Loads one 8x8 block. Blocks that map to consecutive source
+ *       samples take a plain strided load the compiler vectorizes, which
+ *       also deinterleaves the CbCr plane; rotated, scaled and edge
+ *       blocks go through the offset tables.
+ **/
+static inline void mm_jpeg_sw_fetch(const mm_jpeg_sw_comp_t *p_comp,
+  uint32_t x0, uint32_t y0, mm_jpeg_sw_block_t *p_blk)
+{
+  const int32_t *p_col = p_comp->p_col + x0;
+  const int32_t *p_row = p_comp->p_row + y0;
+  uint32_t r, c;
+
+  if (x0 + 8 <= p_comp->linear_cols) {
+    if (1 == p_comp->step) {
+      for (r = 0; r < 8; r++) {
+        const uint8_t *p = p_comp->p_base + p_row[r] + p_col[0];
+        for (c = 0; c < 8; c++) {
+          p_blk->f[r * 8 + c] = (float)p[c] - 128.0f;
+        }
+      }
+    } else {
+      for (r = 0; r < 8; r++) {
+        const uint8_t *p = p_comp->p_base + p_row[r] + p_col[0];
+        for (c = 0; c < 8; c++) {
+          p_blk->f[r * 8 + c] = (float)p[c * 2] - 128.0f;
+        }
+      }
+    }
+    return;
+  }
+
+  for (r = 0; r < 8; r++) {
+    const uint8_t *p = p_comp->p_base + p_row[r];
+    for (c = 0; c < 8; c++) {
+      p_blk->f[r * 8 + c] = (float)p[p_col[c]] - 128.0f;
+    }
+  }
+}
+
+/** mm_jpeg_sw_put_bits:
+ *
+ *  Arguments:
+ *    @p_bits: bit writer
+ *    @code: bits to write, right aligned
+ *    @size: number of bits, up to 16
+ *
+ *  Description:
+ *       Appends bits to the entropy coded segment, stuffing a zero
+ *       byte after every 0xFF
+ **/
+static inline void mm_jpeg_sw_put_bits(mm_jpeg_sw_bits_t *p_bits,
+  uint32_t code, uint32_t size)
+{
+  mm_jpeg_sw_buf_t *p_out = p_bits->p_out;
+
+  p_bits->acc = (p_bits->acc << size) | (code & ((1U << size) - 1));
+  p_bits->nbits += size;
+  while (p_bits->nbits >= 8) {
+    uint8_t byte = (uint8_t)(p_bits->acc >> (p_bits->nbits - 8));
+    p_out->p_data[p_out->len++] = byte;
+    if (0xFF == byte) {
+      p_out->p_data[p_out->len++] = 0;
+    }
+    p_bits->nbits -= 8;
+  }
+}
+
+/** mm_jpeg_sw_nbits:
+ *
+ *  Return:
+ *       magnitude category of a coefficient
+ **/
+static inline uint32_t mm_jpeg_sw_nbits(uint32_t val)
+{
+  return val ? (uint32_t)(32 - __builtin_clz(val)) : 0;
+}
+
+/** mm_jpeg_sw_encode_block:
+ *
+ *  Arguments:
+ *    @p_bits: bit writer
+ *    @p_coef: quantized coefficients
+ *    @p_pred: DC predictor of the component
+ *    @p_dc: DC huffman table
+ *    @p_ac: AC huffman table
+ *
+ *  Description:
+ *       Huffman codes one block (T.81 F.1.2)
+ **/
+static void mm_jpeg_sw_encode_block(mm_jpeg_sw_bits_t *p_bits,
+  const int16_t *p_coef, int32_t *p_pred,
+  const mm_jpeg_sw_huff_t *p_dc, const mm_jpeg_sw_huff_t *p_ac)
+{
+  int32_t val, diff;
+  uint32_t mag, nbits, run = 0, k;
+
+  diff = p_coef[0] - *p_pred;
+  *p_pred = p_coef[0];
+  mag = (uint32_t)((diff < 0) ? -diff : diff);
+  if (diff < 0) {
+    diff--;
+  }
+  nbits = mm_jpeg_sw_nbits(mag);
+  mm_jpeg_sw_put_bits(p_bits, p_dc->code[nbits], p_dc->size[nbits]);
+  if (nbits) {
+    mm_jpeg_sw_put_bits(p_bits, (uint32_t)diff, nbits);
+  }
+
+  for (k = 1; k < QUANT_SIZE; k++) {
+    val = p_coef[mm_jpeg_sw_zigzag_t[k]];
+    if (0 == val) {
+      run++;
+      continue;
+    }
+    /* baseline AC coefficients are limited to 10 bits */
+    if (val > 1023) {
+      val = 1023;
+    } else if (val < -1023) {
+      val = -1023;
+    }
+    while (run > 15) {
+      mm_jpeg_sw_put_bits(p_bits, p_ac->code[0xF0], p_ac->size[0xF0]);
+      run -= 16;
+    }
+    mag = (uint32_t)((val < 0) ? -val : val);
+    if (val < 0) {
+      val--;
+    }
+    nbits = mm_jpeg_sw_nbits(mag);
+    mm_jpeg_sw_put_bits(p_bits, p_ac->code[(run << 4) + nbits],
+      p_ac->size[(run << 4) + nbits]);
+    mm_jpeg_sw_put_bits(p_bits, (uint32_t)val, nbits);
+    run = 0;
+  }
+  if (run) {
+    mm_jpeg_sw_put_bits(p_bits, p_ac->code[0x00], p_ac->size[0x00]);
+  }
+}
+
+/** mm_jpeg_sw_grow:
+ *
+ *  Arguments:
+ *    @p_buf: stripe buffer
+ *    @size: capacity needed
+ *
+ *  Return:
+ *       0 on success, -ENOMEM otherwise
+ *
+ *  Description:
+ *       Continues the stripe in its own buffer of at least @size bytes,
+ *       moving it out of its window of the destination if needed
+ **/
+static int32_t mm_jpeg_sw_grow(mm_jpeg_sw_buf_t *p_buf, size_t size)
+{
+  int in_window = (p_buf->p_data != p_buf->p_heap);
+  uint8_t *p_data;
+
+  if (size > p_buf->heap_size) {
+    if (in_window) {
+      p_data = (uint8_t *)malloc(size);
+      if (NULL != p_data) {
+        free(p_buf->p_heap);
+      }
+    } else {
+      p_data = (uint8_t *)realloc(p_buf->p_heap, size);
+    }
+    if (NULL == p_data) {
+      CDBG_ERROR("%s:%d] cannot grow stripe to %zu", __func__, __LINE__, size);
+      return -ENOMEM;
+    }
+    p_buf->p_heap = p_data;
+    p_buf->heap_size = size;
+  }
+  if (in_window) {
+    memcpy(p_buf->p_heap, p_buf->p_data, p_buf->len);
+  }
+  p_buf->p_data = p_buf->p_heap;
+  p_buf->size = p_buf->heap_size;
+  return 0;
+}
+
+/** mm_jpeg_sw_reserve:
+ *
+ *  Arguments:
+ *    @p_buf: stripe buffer
+ *    @len: bytes needed
+ *
+ *  Return:
+ *       0 on success, -ENOMEM otherwise
+ **/
+static int32_t mm_jpeg_sw_reserve(mm_jpeg_sw_buf_t *p_buf, size_t len)
+{
+  size_t size;
+
+  if (p_buf->size - p_buf->len >= len) {
+    return 0;
+  }
+  size = p_buf->heap_size ? p_buf->heap_size : 64 * 1024;
+  while (size - p_buf->len < len) {
+    size *= 2;
+  }
+  return mm_jpeg_sw_grow(p_buf, size);
+}
+
+/** mm_jpeg_sw_encode_stripe:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @stripe: stripe index
+ *
+ *  Return:
+ *       0 on success, negative errno otherwise
+ *
+ *  Description:
+ *       Entropy codes the MCU rows of one stripe into its own buffer.
+ *       Every stripe starts with reset DC predictors and ends byte
+ *       aligned, as a restart interval does.
+ **/
+static int32_t mm_jpeg_sw_encode_stripe(mm_jpeg_sw_enc_t *p_enc,
+  uint32_t stripe)
+{
+  /* worst case of one block is well below 512 bytes after stuffing */
+  const size_t max_block_len = 512;
+  mm_jpeg_sw_buf_t *p_out = &p_enc->p_stripe[stripe];
+  mm_jpeg_sw_bits_t bits;
+  mm_jpeg_sw_block_t blk;
+  int16_t coef[QUANT_SIZE];
+  int32_t pred[MM_JPEG_SW_MAX_COMPS] = {0, 0, 0};
+  uint32_t row_start = stripe * p_enc->stripe_rows;
+  uint32_t row_end = row_start + p_enc->stripe_rows;
+  uint32_t blocks_per_mcu = 0;
+  uint32_t my, mx, c, h, v;
+  int32_t rc;
+
+  if (row_end > p_enc->mcu_rows) {
+    row_end = p_enc->mcu_rows;
+  }
+  for (c = 0; c < p_enc->num_comps; c++) {
+    blocks_per_mcu += p_enc->comp[c].h_samp * p_enc->comp[c].v_samp;
+  }
+
+  p_out->len = 0;
+  if (p_out->p_data == p_out->p_heap) {
+    /* size the heap buffer for a typical stripe up front */
+    rc = mm_jpeg_sw_reserve(p_out, (size_t)(row_end - row_start) *
+      p_enc->mcu_cols * blocks_per_mcu * 64);
+    if (rc) {
+      return rc;
+    }
+  }
+  bits.p_out = p_out;
+  bits.acc = 0;
+  bits.nbits = 0;
+
+  for (my = row_start; my < row_end; my++) {
+    if (p_enc->p_abort && *p_enc->p_abort) {
+      return -ECANCELED;
+    }
+    for (mx = 0; mx < p_enc->mcu_cols; mx++) {
+      rc = mm_jpeg_sw_reserve(p_out, blocks_per_mcu * max_block_len);
+      if (rc) {
+        return rc;
+      }
+      for (c = 0; c < p_enc->num_comps; c++) {
+        const mm_jpeg_sw_comp_t *p_comp = &p_enc->comp[c];
+        const mm_jpeg_sw_huff_t *p_dc = &mm_jpeg_sw_huff[p_comp->tbl * 2];
+        const mm_jpeg_sw_huff_t *p_ac = &mm_jpeg_sw_huff[p_comp->tbl * 2 + 1];
+
+        for (v = 0; v < p_comp->v_samp; v++) {
+          for (h = 0; h < p_comp->h_samp; h++) {
+            mm_jpeg_sw_fetch(p_comp, (mx * p_comp->h_samp + h) * 8,
+              (my * p_comp->v_samp + v) * 8, &blk);
+            mm_jpeg_sw_fdct_quant(&blk, p_enc->qdiv[p_comp->tbl], coef);
+            mm_jpeg_sw_encode_block(&bits, coef, &pred[c], p_dc, p_ac);
+          }
+        }
+      }
+    }
+  }
+
+  /* pad the last byte with ones */
+  if (bits.nbits) {
+    rc = mm_jpeg_sw_reserve(p_out, 2);
+    if (rc) {
+      return rc;
+    }
+    mm_jpeg_sw_put_bits(&bits, 0x7F, 8 - bits.nbits);
+  }
+  return 0;
+}
+
+/** mm_jpeg_sw_map:
+ *
+ *  Arguments:
+ *    @o: output coordinate along one axis
+ *    @out_len: output length along the axis, before rotation
+ *    @src_start: first source sample of the crop along the source axis
+ *    @src_len: crop length along the source axis
+ *    @reverse: the axis is mirrored by the rotation
+ *
+ *  Return:
+ *       nearest source coordinate
+ **/
+static uint32_t mm_jpeg_sw_map(uint32_t o, uint32_t out_len,
+  uint32_t src_start, uint32_t src_len, int reverse)
+{
+  uint32_t u;
+
+  if (o >= out_len) {
+    o = out_len - 1;
+  }
+  u = reverse ? (out_len - 1 - o) : o;
+  return src_start +
+    (uint32_t)(((uint64_t)(2 * u + 1) * src_len) / (2 * (uint64_t)out_len));
+}
+
+/** mm_jpeg_sw_axis_t:
+ *
+ *  Source axis an output axis walks along
+ **/
+typedef struct {
+  uint32_t out_len;
+  uint32_t src_start;
+  uint32_t src_len;
+  int reverse;
+  int is_y;
+} mm_jpeg_sw_axis_t;
+
+/** mm_jpeg_sw_build_tab:
+ *
+ *  Arguments:
+ *    @pp_tab: table, grown as needed
+ *    @p_size: entries allocated in @pp_tab
+ *    @n: entries needed
+ *    @p_axis: source axis
+ *    @out_scale: output luma samples per component sample
+ *    @sub: source luma samples per component sample along the axis
+ *    @step: source bytes per component sample along the axis
+ *
+ *  Return:
+ *       0 on success, -ENOMEM otherwise
+ **/
+static int32_t mm_jpeg_sw_build_tab(int32_t **pp_tab, uint32_t *p_size,
+  uint32_t n, const mm_jpeg_sw_axis_t *p_axis, uint32_t out_scale,
+  uint32_t sub, int32_t step)
+{
+  uint32_t i;
+
+  if (*p_size < n) {
+    int32_t *p_tab = (int32_t *)realloc(*pp_tab, n * sizeof(int32_t));
+    if (NULL == p_tab) {
+      return -ENOMEM;
+    }
+    *pp_tab = p_tab;
+    *p_size = n;
+  }
+  for (i = 0; i < n; i++) {
+    uint32_t s = mm_jpeg_sw_map(i * out_scale, p_axis->out_len,
+      p_axis->src_start, p_axis->src_len, p_axis->reverse);
+    (*pp_tab)[i] = (int32_t)(s / sub) * step;
+  }
+  return 0;
+}
+
+/** mm_jpeg_sw_setup:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @p_src: image
+ *    @num_threads: pool threads, sets the number of stripes
+ *
+ *  Return:
+ *       0 on success, negative errno otherwise
+ *
+ *  Description:
+ *       Validates the source and derives the component sampling tables,
+ *       the MCU grid and the stripes
+ **/
+static int32_t mm_jpeg_sw_setup(mm_jpeg_sw_enc_t *p_enc,
+  mm_jpeg_sw_src_t *p_src, uint32_t num_threads)
+{
+  mm_jpeg_buf_t *p_buf = p_src->p_buf;
+  mm_jpeg_dim_t *p_dim = p_src->p_dim;
+  cam_rect_t crop = p_dim->crop;
+  uint32_t src_w = (uint32_t)p_dim->src_dim.width;
+  uint32_t src_h = (uint32_t)p_dim->src_dim.height;
+  uint32_t out_w = (uint32_t)p_dim->dst_dim.width;
+  uint32_t out_h = (uint32_t)p_dim->dst_dim.height;
+  uint32_t stride = (uint32_t)p_buf->offset.mp[0].stride;
+  uint32_t scanline = (uint32_t)p_buf->offset.mp[0].scanline;
+  uint32_t hsub = 2, vsub = 2;
+  int cb_first = 0;
+  mm_jpeg_sw_axis_t ax_x, ax_y;
+  const mm_jpeg_sw_axis_t *p_col_axis, *p_row_axis;
+  uint32_t max_h, max_v, target, c, i;
+  size_t needed;
+  int32_t rc;
+
+  switch (p_src->color_format) {
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V2:
+    cb_first = 1;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2:
+    hsub = 2;
+    vsub = 2;
+    break;
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V1:
+    cb_first = 1;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V1:
+    hsub = 2;
+    vsub = 1;
+    break;
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H1V2:
+    cb_first = 1;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H1V2:
+    hsub = 1;
+    vsub = 2;
+    break;
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H1V1:
+    cb_first = 1;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H1V1:
+    hsub = 1;
+    vsub = 1;
+    break;
+  case MM_JPEG_COLOR_FORMAT_MONOCHROME:
+    break;
+  default:
+    CDBG_ERROR("%s:%d] unsupported color format %d", __func__, __LINE__,
+      p_src->color_format);
+    return -EINVAL;
+  }
+
+  if ((NULL == p_buf->buf_vaddr) || (0 == src_w) || (0 == src_h)) {
+    CDBG_ERROR("%s:%d] invalid source %p %dx%d", __func__, __LINE__,
+      p_buf->buf_vaddr, src_w, src_h);
+    return -EINVAL;
+  }
+  if ((0 == crop.width) || (0 == crop.height)) {
+    crop.left = 0;
+    crop.top = 0;
+    crop.width = (int32_t)src_w;
+    crop.height = (int32_t)src_h;
+  }
+  if ((crop.left < 0) || (crop.top < 0) ||
+    ((uint32_t)(crop.left + crop.width) > src_w) ||
+    ((uint32_t)(crop.top + crop.height) > src_h)) {
+    CDBG_ERROR("%s:%d] invalid crop (%d, %d) %dx%d of %dx%d", __func__,
+      __LINE__, crop.left, crop.top, crop.width, crop.height, src_w, src_h);
+    return -EINVAL;
+  }
+  if ((0 == out_w) || (0 == out_h)) {
+    out_w = (uint32_t)crop.width;
+    out_h = (uint32_t)crop.height;
+  }
+  if ((out_w > 0xFFFF) || (out_h > 0xFFFF)) {
+    CDBG_ERROR("%s:%d] output %dx%d too large", __func__, __LINE__,
+      out_w, out_h);
+    return -EINVAL;
+  }
+  if (stride < src_w) {
+    stride = src_w;
+  }
+  if (scanline < src_h) {
+    scanline = src_h;
+  }
+  needed = (size_t)stride * scanline;
+  if (MM_JPEG_COLOR_FORMAT_MONOCHROME != p_src->color_format) {
+    needed = (size_t)p_buf->offset.mp[0].len + p_buf->offset.mp[1].offset +
+      (size_t)stride * ((scanline + vsub - 1) / vsub) * 2 / hsub;
+  }
+  if (p_buf->buf_size && (needed > p_buf->buf_size)) {
+    CDBG_ERROR("%s:%d] buffer size %zu, need %zu", __func__, __LINE__,
+      p_buf->buf_size, needed);
+    return -EINVAL;
+  }
+
+  /* the output axes walk the source x and y axes depending on the
+   * clockwise rotation */
+  ax_x.out_len = out_w;
+  ax_x.src_start = (uint32_t)crop.left;
+  ax_x.src_len = (uint32_t)crop.width;
+  ax_x.is_y = 0;
+  ax_y.out_len = out_h;
+  ax_y.src_start = (uint32_t)crop.top;
+  ax_y.src_len = (uint32_t)crop.height;
+  ax_y.is_y = 1;
+  switch (p_src->rotation) {
+  case 0:
+    ax_x.reverse = 0;
+    ax_y.reverse = 0;
+    p_col_axis = &ax_x;
+    p_row_axis = &ax_y;
+    break;
+  case 90:
+    ax_x.reverse = 0;
+    ax_y.reverse = 1;
+    p_col_axis = &ax_y;
+    p_row_axis = &ax_x;
+    break;
+  case 180:
+    ax_x.reverse = 1;
+    ax_y.reverse = 1;
+    p_col_axis = &ax_x;
+    p_row_axis = &ax_y;
+    break;
+  case 270:
+    ax_x.reverse = 1;
+    ax_y.reverse = 0;
+    p_col_axis = &ax_y;
+    p_row_axis = &ax_x;
+    break;
+  default:
+    CDBG_ERROR("%s:%d] unsupported rotation %d", __func__, __LINE__,
+      p_src->rotation);
+    return -EINVAL;
+  }
+  p_enc->width = p_col_axis->out_len;
+  p_enc->height = p_row_axis->out_len;
+
+  if (MM_JPEG_COLOR_FORMAT_MONOCHROME == p_src->color_format) {
+    p_enc->num_comps = 1;
+    max_h = max_v = 1;
+    p_enc->comp[0].h_samp = p_enc->comp[0].v_samp = 1;
+  } else {
+    p_enc->num_comps = 3;
+    max_h = max_v = 2;
+    p_enc->comp[0].h_samp = p_enc->comp[0].v_samp = 2;
+    p_enc->comp[1].h_samp = p_enc->comp[1].v_samp = 1;
+    p_enc->comp[2].h_samp = p_enc->comp[2].v_samp = 1;
+  }
+  p_enc->mcu_cols = (p_enc->width + max_h * 8 - 1) / (max_h * 8);
+  p_enc->mcu_rows = (p_enc->height + max_v * 8 - 1) / (max_v * 8);
+
+  for (c = 0; c < p_enc->num_comps; c++) {
+    mm_jpeg_sw_comp_t *p_comp = &p_enc->comp[c];
+    uint32_t num_cols = p_enc->mcu_cols * p_comp->h_samp * 8;
+    uint32_t num_rows = p_enc->mcu_rows * p_comp->v_samp * 8;
+    uint32_t col_sub = 1, row_sub = 1;
+    int32_t col_step = 1, row_step = (int32_t)stride;
+
+    p_comp->tbl = c ? 1 : 0;
+    p_comp->p_base = p_buf->buf_vaddr + p_buf->offset.mp[0].offset;
+    if (c) {
+      /* CbCr interleaved plane */
+      p_comp->p_base = p_buf->buf_vaddr + p_buf->offset.mp[0].len +
+        p_buf->offset.mp[1].offset + (((1 == c) == cb_first) ? 0 : 1);
+      col_sub = p_col_axis->is_y ? vsub : hsub;
+      row_sub = p_row_axis->is_y ? vsub : hsub;
+      col_step = p_col_axis->is_y ? (int32_t)stride : 2;
+      row_step = p_row_axis->is_y ? (int32_t)stride : 2;
+    } else {
+      col_step = p_col_axis->is_y ? (int32_t)stride : 1;
+      row_step = p_row_axis->is_y ? (int32_t)stride : 1;
+    }
+
+    rc = mm_jpeg_sw_build_tab(&p_comp->p_col, &p_comp->num_cols, num_cols,
+      p_col_axis, max_h / p_comp->h_samp, col_sub, col_step);
+    if (0 == rc) {
+      rc = mm_jpeg_sw_build_tab(&p_comp->p_row, &p_comp->num_rows, num_rows,
+        p_row_axis, max_v / p_comp->v_samp, row_sub, row_step);
+    }
+    if (rc) {
+      CDBG_ERROR("%s:%d] no memory for sampling tables", __func__, __LINE__);
+      return rc;
+    }
+
+    /* length of the run of consecutive samples for the fast path */
+    p_comp->step = c ? 2 : 1;
+    for (i = 1; i < num_cols; i++) {
+      if (p_comp->p_col[i] != p_comp->p_col[0] + (int32_t)i * p_comp->step) {
+        break;
+      }
+    }
+    p_comp->linear_cols = i;
+  }
+
+  /* stripes of whole MCU rows, several per thread for load balance */
+  target = (num_threads + 1) * MM_JPEG_SW_STRIPES_PER_THREAD;
+  p_enc->stripe_rows = (p_enc->mcu_rows + target - 1) / target;
+  if (p_enc->stripe_rows * p_enc->mcu_cols > MM_JPEG_SW_MAX_RESTART_INTERVAL) {
+    p_enc->stripe_rows = MM_JPEG_SW_MAX_RESTART_INTERVAL / p_enc->mcu_cols;
+  }
+  if (0 == p_enc->stripe_rows) {
+    p_enc->stripe_rows = 1;
+  }
+  p_enc->num_stripes = (p_enc->mcu_rows + p_enc->stripe_rows - 1) /
+    p_enc->stripe_rows;
+  if (p_enc->num_stripes > p_enc->max_stripes) {
+    mm_jpeg_sw_buf_t *p_stripe = (mm_jpeg_sw_buf_t *)realloc(p_enc->p_stripe,
+      p_enc->num_stripes * sizeof(mm_jpeg_sw_buf_t));
+    if (NULL == p_stripe) {
+      CDBG_ERROR("%s:%d] no memory for %d stripes", __func__, __LINE__,
+        p_enc->num_stripes);
+      return -ENOMEM;
+    }
+    memset(&p_stripe[p_enc->max_stripes], 0,
+      (p_enc->num_stripes - p_enc->max_stripes) * sizeof(mm_jpeg_sw_buf_t));
+    p_enc->p_stripe = p_stripe;
+    p_enc->max_stripes = p_enc->num_stripes;
+  }
+
+  mm_jpeg_sw_init_qtables(p_enc, p_src);
+  return 0;
+}
+
+/** mm_jpeg_sw_put_u16:
+ *
+ *  Description:
+ *       writes a big endian 16 bit value
+ **/
+static inline uint8_t *mm_jpeg_sw_put_u16(uint8_t *p, uint32_t val)
+{
+  p[0] = (uint8_t)(val >> 8);
+  p[1] = (uint8_t)val;
+  return p + 2;
+}
+
+/** mm_jpeg_sw_write_hdr:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *
+ *  Description:
+ *       Writes DQT, SOF0, DHT, DRI and SOS into the encoder's header
+ *       buffer
+ **/
+static void mm_jpeg_sw_write_hdr(mm_jpeg_sw_enc_t *p_enc)
+{
+  uint8_t *p = p_enc->hdr;
+  uint32_t num_tbl = (p_enc->num_comps > 1) ? 2 : 1;
+  uint32_t len, t, c, i;
+
+  /* DQT */
+  p = mm_jpeg_sw_put_u16(p, 0xFFDB);
+  p = mm_jpeg_sw_put_u16(p, 2 + (1 + QUANT_SIZE) * num_tbl);
+  for (t = 0; t < num_tbl; t++) {
+    *p++ = (uint8_t)t;
+    memcpy(p, p_enc->qtbl[t], QUANT_SIZE);
+    p += QUANT_SIZE;
+  }
+
+  /* SOF0 */
+  p = mm_jpeg_sw_put_u16(p, 0xFFC0);
+  p = mm_jpeg_sw_put_u16(p, 8 + 3 * p_enc->num_comps);
+  *p++ = 8;
+  p = mm_jpeg_sw_put_u16(p, p_enc->height);
+  p = mm_jpeg_sw_put_u16(p, p_enc->width);
+  *p++ = (uint8_t)p_enc->num_comps;
+  for (c = 0; c < p_enc->num_comps; c++) {
+    *p++ = (uint8_t)(c + 1);
+    *p++ = (uint8_t)((p_enc->comp[c].h_samp << 4) | p_enc->comp[c].v_samp);
+    *p++ = (uint8_t)p_enc->comp[c].tbl;
+  }
+
+  /* DHT */
+  len = 2;
+  for (t = 0; t < num_tbl * 2; t++) {
+    len += 1 + 16 + mm_jpeg_sw_huff[t].num_vals;
+  }
+  p = mm_jpeg_sw_put_u16(p, 0xFFC4);
+  p = mm_jpeg_sw_put_u16(p, len);
+  for (t = 0; t < num_tbl * 2; t++) {
+    const mm_jpeg_sw_huff_t *p_huff = &mm_jpeg_sw_huff[t];
+    /* table class in the high nibble, destination in the low one */
+    *p++ = (uint8_t)(((t & 1) << 4) | (t >> 1));
+    for (i = 0; i < 16; i++) {
+      *p++ = p_huff->p_bits[i];
+    }
+    memcpy(p, p_huff->p_vals, p_huff->num_vals);
+    p += p_huff->num_vals;
+  }
+
+  /* DRI, one restart interval per stripe */
+  if (p_enc->num_stripes > 1) {
+    p = mm_jpeg_sw_put_u16(p, 0xFFDD);
+    p = mm_jpeg_sw_put_u16(p, 4);
+    p = mm_jpeg_sw_put_u16(p, p_enc->stripe_rows * p_enc->mcu_cols);
+  }
+
+  /* SOS */
+  p = mm_jpeg_sw_put_u16(p, 0xFFDA);
+  p = mm_jpeg_sw_put_u16(p, 6 + 2 * p_enc->num_comps);
+  *p++ = (uint8_t)p_enc->num_comps;
+  for (c = 0; c < p_enc->num_comps; c++) {
+    *p++ = (uint8_t)(c + 1);
+    *p++ = (uint8_t)((p_enc->comp[c].tbl << 4) | p_enc->comp[c].tbl);
+  }
+  *p++ = 0;
+  *p++ = 63;
+  *p++ = 0;
+
+  p_enc->hdr_len = (size_t)(p - p_enc->hdr);
+}
+
+/** mm_jpeg_sw_commit:
+ *
+ *  Arguments:
+ *    @p_pool: pool, locked
+ *    @p_enc: encoder writing in place
+ *
+ *  Description:
+ *       Moves finished stripes that follow the committed part of the
+ *       destination behind it, each after its restart marker. One thread
+ *       commits at a time and drops the lock while moving. A stripe that
+ *       left its window stops the commits, the rest is gathered once the
+ *       image is done.
+ *
+ *       Windows are 2 bytes larger than the stripes they can hold, so a
+ *       committed stripe never reaches into the window of the next one.
+ **/
+static void mm_jpeg_sw_commit(mm_jpeg_sw_pool_t *p_pool,
+  mm_jpeg_sw_enc_t *p_enc)
+{
+  mm_jpeg_sw_buf_t *p_buf;
+  uint8_t *p;
+  uint32_t i;
+
+  if (p_enc->committing) {
+    return;
+  }
+  p_enc->committing = 1;
+  while (p_enc->num_committed < p_enc->num_stripes) {
+    i = p_enc->num_committed;
+    p_buf = &p_enc->p_stripe[i];
+    if (!p_buf->done || (p_buf->p_data == p_buf->p_heap)) {
+      break;
+    }
+    pthread_mutex_unlock(&p_pool->lock);
+
+    p = p_enc->p_out + p_enc->out_len;
+    if (i) {
+      p = mm_jpeg_sw_put_u16(p, 0xFFD0 + ((i - 1) & 7));
+    }
+    if (p != p_buf->p_data) {
+      memmove(p, p_buf->p_data, p_buf->len);
+    }
+    p_enc->out_len = (size_t)(p - p_enc->p_out) + p_buf->len;
+
+    pthread_mutex_lock(&p_pool->lock);
+    p_enc->num_committed++;
+  }
+  p_enc->committing = 0;
+}
+
+/** mm_jpeg_sw_stripe_done:
+ *
+ *  Arguments:
+ *    @p_pool: pool, locked
+ *    @p_enc: encoder
+ *    @stripe: stripe index
+ *    @rc: result of the stripe
+ *
+ *  Description:
+ *       Accounts a finished stripe and wakes the thread waiting for the
+ *       image once nothing is left to encode or to move
+ **/
+static void mm_jpeg_sw_stripe_done(mm_jpeg_sw_pool_t *p_pool,
+  mm_jpeg_sw_enc_t *p_enc, uint32_t stripe, int32_t rc)
+{
+  if (rc) {
+    p_enc->error = rc;
+  }
+  p_enc->p_stripe[stripe].done = 1;
+  p_enc->num_done++;
+  if (p_enc->p_out && !p_enc->error) {
+    mm_jpeg_sw_commit(p_pool, p_enc);
+  }
+  if ((p_enc->num_done == p_enc->num_stripes) && !p_enc->committing) {
+    pthread_cond_broadcast(&p_pool->done_cond);
+  }
+}
+
+/** mm_jpeg_sw_gather:
+ *
+ *  Arguments:
+ *    @p_enc: encoder writing in place, all stripes done
+ *
+ *  Return:
+ *       0 on success, negative errno otherwise
+ *
+ *  Description:
+ *       Appends the stripes left after a stripe outgrew its window and
+ *       terminates the file
+ **/
+static int32_t mm_jpeg_sw_gather(mm_jpeg_sw_enc_t *p_enc)
+{
+  mm_jpeg_sw_buf_t *p_buf;
+  uint8_t *p = p_enc->p_out + p_enc->out_len;
+  uint32_t i;
+  int32_t rc;
+
+  /* the gather may overwrite later windows, take their stripes out */
+  for (i = p_enc->num_committed; i < p_enc->num_stripes; i++) {
+    p_buf = &p_enc->p_stripe[i];
+    if (p_buf->p_data != p_buf->p_heap) {
+      rc = mm_jpeg_sw_grow(p_buf, p_buf->len + 1);
+      if (rc) {
+        return rc;
+      }
+    }
+  }
+  if (p_enc->num_committed < p_enc->num_stripes) {
+    CDBG_HIGH("%s:%d] gathering %d of %d stripes", __func__, __LINE__,
+      p_enc->num_stripes - p_enc->num_committed, p_enc->num_stripes);
+  }
+
+  for (i = p_enc->num_committed; i < p_enc->num_stripes; i++) {
+    p_buf = &p_enc->p_stripe[i];
+    if ((size_t)(p - p_enc->p_out) + 2 + p_buf->len + 2 > p_enc->out_size) {
+      CDBG_ERROR("%s:%d] jpeg exceeds buffer %zu", __func__, __LINE__,
+        p_enc->out_size);
+      return -ENOSPC;
+    }
+    if (i) {
+      p = mm_jpeg_sw_put_u16(p, 0xFFD0 + ((i - 1) & 7));
+    }
+    memcpy(p, p_buf->p_data, p_buf->len);
+    p += p_buf->len;
+  }
+  p = mm_jpeg_sw_put_u16(p, 0xFFD9);
+  p_enc->num_committed = p_enc->num_stripes;
+  p_enc->out_len = (size_t)(p - p_enc->p_out);
+  return 0;
+}
+
+/** mm_jpeg_sw_worker:
+ *
+ *  Arguments:
+ *    @data: pool
+ *
+ *  Description:
+ *       Encodes stripes of the images in the pool's active list
+ **/
+static void *mm_jpeg_sw_worker(void *data)
+{
+  mm_jpeg_sw_pool_t *p_pool = (mm_jpeg_sw_pool_t *)data;
+  mm_jpeg_sw_enc_t *p_enc;
+  uint32_t stripe;
+  int32_t rc;
+  char name[16];
+  uint32_t i;
+
+  pthread_mutex_lock(&p_pool->lock);
+  for (i = 0; i < p_pool->num_threads; i++) {
+    if (pthread_equal(p_pool->tid[i], pthread_self())) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+  snprintf(name, sizeof(name), "CAM_jpeg_sw%u", i);
+  prctl(PR_SET_NAME, (unsigned long)name, 0, 0, 0);
+
+  pthread_mutex_lock(&p_pool->lock);
+  while (p_pool->running) {
+    if (p_pool->active.next == &p_pool->active) {
+      pthread_cond_wait(&p_pool->work_cond, &p_pool->lock);
+      continue;
+    }
+    p_enc = member_of(p_pool->active.next, mm_jpeg_sw_enc_t, list);
+    stripe = p_enc->next_stripe++;
+    if (p_enc->next_stripe == p_enc->num_stripes) {
+      cam_list_del_node(&p_enc->list);
+    }
+    pthread_mutex_unlock(&p_pool->lock);
+
+    rc = mm_jpeg_sw_encode_stripe(p_enc, stripe);
+
+    pthread_mutex_lock(&p_pool->lock);
+    mm_jpeg_sw_stripe_done(p_pool, p_enc, stripe, rc);
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+  return NULL;
+}
+
+/** mm_jpeg_sw_pool_init:
+ *
+ *  Arguments:
+ *    @p_pool: pool
+ *    @num_threads: worker threads besides the callers, may be 0
+ *
+ *  Return:
+ *       0 on success, -1 otherwise
+ **/
+int32_t mm_jpeg_sw_pool_init(mm_jpeg_sw_pool_t *p_pool, uint32_t num_threads)
+{
+  uint32_t i;
+
+  pthread_once(&mm_jpeg_sw_tables_once, mm_jpeg_sw_init_tables);
+
+  if (num_threads > MM_JPEG_SW_MAX_THREADS) {
+    num_threads = MM_JPEG_SW_MAX_THREADS;
+  }
+  memset(p_pool, 0, sizeof(*p_pool));
+  pthread_mutex_init(&p_pool->lock, NULL);
+  pthread_cond_init(&p_pool->work_cond, NULL);
+  pthread_cond_init(&p_pool->done_cond, NULL);
+  cam_list_init(&p_pool->active);
+  p_pool->running = 1;
+
+  pthread_mutex_lock(&p_pool->lock);
+  for (i = 0; i < num_threads; i++) {
+    if (pthread_create(&p_pool->tid[i], NULL, mm_jpeg_sw_worker, p_pool)) {
+      CDBG_ERROR("%s:%d] cannot create worker %d", __func__, __LINE__, i);
+      break;
+    }
+    p_pool->num_threads++;
+  }
+  pthread_mutex_unlock(&p_pool->lock);
+
+  CDBG_HIGH("%s:%d] %d encoder threads", __func__, __LINE__,
+    p_pool->num_threads);
+  return 0;
+}
+
+/** mm_jpeg_sw_pool_deinit:
+ *
+ *  Arguments:
+ *    @p_pool: pool
+ *
+ *  Description:
+ *       Stops the workers. No image may be in flight.
+ **/
+void mm_jpeg_sw_pool_deinit(mm_jpeg_sw_pool_t *p_pool)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&p_pool->lock);
+  p_pool->running = 0;
+  pthread_cond_broadcast(&p_pool->work_cond);
+  pthread_mutex_unlock(&p_pool->lock);
+
+  for (i = 0; i < p_pool->num_threads; i++) {
+    pthread_join(p_pool->tid[i], NULL);
+  }
+  pthread_cond_destroy(&p_pool->work_cond);
+  pthread_cond_destroy(&p_pool->done_cond);
+  pthread_mutex_destroy(&p_pool->lock);
+}
+
+/** mm_jpeg_sw_encode:
+ *
+ *  Arguments:
+ *    @p_pool: pool
+ *    @p_enc: encoder
+ *    @p_src: image
+ *    @p_dst: destination of everything after SOI and APP1, or NULL
+ *    @dst_size: size of the destination
+ *    @p_len: bytes written to @p_dst
+ *
+ *  Return:
+ *       0 on success, negative errno otherwise
+ *
+ *  Description:
+ *       Encodes the image on the pool and the calling thread. With a
+ *       destination, the stripes are entropy coded straight into it and
+ *       the file is complete on return. Without one, the encoder keeps
+ *       the stripes for mm_jpeg_sw_write.
+ **/
+int32_t mm_jpeg_sw_encode(mm_jpeg_sw_pool_t *p_pool,
+  mm_jpeg_sw_enc_t *p_enc,
+  mm_jpeg_sw_src_t *p_src,
+  uint8_t *p_dst, size_t dst_size, size_t *p_len)
+{
+  mm_jpeg_sw_buf_t *p_buf;
+  size_t window = 0;
+  uint32_t stripe, in_place;
+  int32_t rc;
+
+  rc = mm_jpeg_sw_setup(p_enc, p_src, p_pool->num_threads);
+  if (rc) {
+    return rc;
+  }
+  mm_jpeg_sw_write_hdr(p_enc);
+
+  p_enc->p_out = p_dst;
+  p_enc->out_size = dst_size;
+  p_enc->out_len = 0;
+  if (NULL != p_dst) {
+    if (p_enc->hdr_len + 2 > dst_size) {
+      CDBG_ERROR("%s:%d] buffer %zu too small", __func__, __LINE__, dst_size);
+      return -ENOSPC;
+    }
+    memcpy(p_dst, p_enc->hdr, p_enc->hdr_len);
+    p_enc->out_len = p_enc->hdr_len;
+    /* room between the header and EOI, split evenly */
+    window = (dst_size - p_enc->hdr_len - 2) / p_enc->num_stripes;
+    if (window < MM_JPEG_SW_MIN_WINDOW) {
+      window = 0;
+    }
+  }
+  for (stripe = 0; stripe < p_enc->num_stripes; stripe++) {
+    p_buf = &p_enc->p_stripe[stripe];
+    if (window) {
+      p_buf->p_data = p_dst + p_enc->hdr_len + stripe * window;
+      p_buf->size = window - 2;
+    } else {
+      p_buf->p_data = p_buf->p_heap;
+      p_buf->size = p_buf->heap_size;
+    }
+    p_buf->len = 0;
+    p_buf->done = 0;
+  }
+
+  pthread_mutex_lock(&p_pool->lock);
+  p_enc->next_stripe = 0;
+  p_enc->num_done = 0;
+  p_enc->num_committed = 0;
+  p_enc->committing = 0;
+  p_enc->error = 0;
+  if (p_enc->num_stripes > 1) {
+    cam_list_add_tail_node(&p_enc->list, &p_pool->active);
+    pthread_cond_broadcast(&p_pool->work_cond);
+  }
+  while (p_enc->next_stripe < p_enc->num_stripes) {
+    stripe = p_enc->next_stripe++;
+    if ((p_enc->next_stripe == p_enc->num_stripes) &&
+      (p_enc->num_stripes > 1)) {
+      cam_list_del_node(&p_enc->list);
+    }
+    pthread_mutex_unlock(&p_pool->lock);
+
+    rc = mm_jpeg_sw_encode_stripe(p_enc, stripe);
+
+    pthread_mutex_lock(&p_pool->lock);
+    mm_jpeg_sw_stripe_done(p_pool, p_enc, stripe, rc);
+  }
+  while ((p_enc->num_done < p_enc->num_stripes) || p_enc->committing) {
+    pthread_cond_wait(&p_pool->done_cond, &p_pool->lock);
+  }
+  rc = p_enc->error;
+  pthread_mutex_unlock(&p_pool->lock);
+
+  in_place = p_enc->num_committed;
+  if ((0 == rc) && (NULL != p_dst)) {
+    rc = mm_jpeg_sw_gather(p_enc);
+  }
+  if (p_len) {
+    *p_len = (0 == rc) ? p_enc->out_len : 0;
+  }
+
+  CDBG("%s:%d] %dx%d, %d stripes of %d MCU rows, %d in place, rc %d",
+    __func__, __LINE__, p_enc->width, p_enc->height, p_enc->num_stripes,
+    p_enc->stripe_rows, in_place, rc);
+  p_enc->p_out = NULL;
+  return rc;
+}
+
+/** mm_jpeg_sw_get_dim:
+ *
+ *  Arguments:
+ *    @p_dim: source dimension, crop and output size before rotation
+ *    @rotation: clockwise rotation in degrees
+ *    @p_width: output width
+ *    @p_height: output height
+ *
+ *  Description:
+ *       Size of the image mm_jpeg_sw_encode produces, applying the same
+ *       defaults for a missing crop and output size
+ **/
+void mm_jpeg_sw_get_dim(const mm_jpeg_dim_t *p_dim, uint32_t rotation,
+  uint32_t *p_width, uint32_t *p_height)
+{
+  uint32_t w = (uint32_t)p_dim->dst_dim.width;
+  uint32_t h = (uint32_t)p_dim->dst_dim.height;
+
+  if ((0 == w) || (0 == h)) {
+    w = (uint32_t)p_dim->crop.width;
+    h = (uint32_t)p_dim->crop.height;
+    if ((0 == w) || (0 == h)) {
+      w = (uint32_t)p_dim->src_dim.width;
+      h = (uint32_t)p_dim->src_dim.height;
+    }
+  }
+  if ((90 == rotation) || (270 == rotation)) {
+    *p_width = h;
+    *p_height = w;
+  } else {
+    *p_width = w;
+    *p_height = h;
+  }
+}
+
+/** mm_jpeg_sw_get_size:
+ *
+ *  Arguments:
+ *    @p_enc: encoder holding an encoded image
+ *    @app1_len: length of the APP1 segment
+ *
+ *  Return:
+ *       size of the JPEG file
+ **/
+size_t mm_jpeg_sw_get_size(mm_jpeg_sw_enc_t *p_enc, size_t app1_len)
+{
+  size_t size = 2 + app1_len + p_enc->hdr_len + 2;
+  uint32_t i;
+
+  for (i = 0; i < p_enc->num_stripes; i++) {
+    size += p_enc->p_stripe[i].len;
+  }
+  return size + 2 * (p_enc->num_stripes - 1);
+}
+
+/** mm_jpeg_sw_write:
+ *
+ *  Arguments:
+ *    @p_enc: encoder holding an encoded image
+ *    @p_app1: APP1 segment, marker included, or NULL
+ *    @app1_len: length of the APP1 segment
+ *    @p_dst: destination
+ *    @dst_size: size of the destination
+ *
+ *  Return:
+ *       bytes written, 0 if the destination is too small
+ *
+ *  Description:
+ *       Stitches the headers and the stripes into a JPEG file, stripes
+ *       are separated by RST0 to RST7
+ **/
+size_t mm_jpeg_sw_write(mm_jpeg_sw_enc_t *p_enc,
+  const uint8_t *p_app1, size_t app1_len,
+  uint8_t *p_dst, size_t dst_size)
+{
+  size_t size = mm_jpeg_sw_get_size(p_enc, app1_len);
+  uint8_t *p = p_dst;
+  uint32_t i;
+
+  if (size > dst_size) {
+    CDBG_ERROR("%s:%d] jpeg size %zu exceeds buffer %zu", __func__, __LINE__,
+      size, dst_size);
+    return 0;
+  }
+
+  p = mm_jpeg_sw_put_u16(p, 0xFFD8);
+  if (app1_len) {
+    memcpy(p, p_app1, app1_len);
+    p += app1_len;
+  }
+  memcpy(p, p_enc->hdr, p_enc->hdr_len);
+  p += p_enc->hdr_len;
+  for (i = 0; i < p_enc->num_stripes; i++) {
+    if (i) {
+      p = mm_jpeg_sw_put_u16(p, 0xFFD0 + ((i - 1) & 7));
+    }
+    memcpy(p, p_enc->p_stripe[i].p_data, p_enc->p_stripe[i].len);
+    p += p_enc->p_stripe[i].len;
+  }
+  p = mm_jpeg_sw_put_u16(p, 0xFFD9);
+
+  return (size_t)(p - p_dst);
+}
+
+/** mm_jpeg_sw_enc_release:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *
+ *  Description:
+ *       Frees the tables and stripe buffers of an encoder
+ **/
+void mm_jpeg_sw_enc_release(mm_jpeg_sw_enc_t *p_enc)
+{
+  uint32_t i;
+
+  for (i = 0; i < MM_JPEG_SW_MAX_COMPS; i++) {
+    free(p_enc->comp[i].p_col);
+    free(p_enc->comp[i].p_row);
+  }
+  for (i = 0; i < p_enc->max_stripes; i++) {
+    free(p_enc->p_stripe[i].p_heap);
+  }
+  free(p_enc->p_stripe);
+  memset(p_enc, 0, sizeof(*p_enc));
+}
@@ -0,0 +1,496 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm_jpeg_dbg.h"
+#include "mm_jpeg_sw.h"
+
+/* EXIF 2.2 APP1 writer of the software backend. The tags the HAL hands
+ * to the encoder are sorted into IFD0, the Exif and the GPS IFD; IFD1 and
+ * the IFD pointers are generated. TIFF data is written little endian. */
+
+#define MM_JPEG_SW_TIFF_HDR_LEN 8
+#define MM_JPEG_SW_EXIF_ID_LEN 6
+
+#define MM_JPEG_SW_TAG_EXIF_IFD 0x8769
+#define MM_JPEG_SW_TAG_GPS_IFD 0x8825
+#define MM_JPEG_SW_TAG_COMPRESSION 0x0103
+#define MM_JPEG_SW_TAG_JPEG_IF 0x0201
+#define MM_JPEG_SW_TAG_JPEG_IF_LEN 0x0202
+
+/** mm_jpeg_sw_exif_tag_t:
+ *  @tag: 16 bit tag
+ *  @type: exif_tag_type_t
+ *  @count: number of values
+ *  @p_val: values in host order, NULL to use @val
+ *  @val: single SHORT or LONG value of generated tags
+ **/
+typedef struct {
+  uint16_t tag;
+  uint16_t type;
+  uint32_t count;
+  const void *p_val;
+  uint32_t val;
+} mm_jpeg_sw_exif_tag_t;
+
+typedef struct {
+  mm_jpeg_sw_exif_tag_t tag[MM_JPEG_SW_MAX_EXIF_TAGS];
+  uint32_t num_tags;
+} mm_jpeg_sw_ifd_t;
+
+typedef enum {
+  MM_JPEG_SW_IFD0,
+  MM_JPEG_SW_IFD_EXIF,
+  MM_JPEG_SW_IFD_GPS,
+  MM_JPEG_SW_IFD1,
+  MM_JPEG_SW_IFD_MAX
+} mm_jpeg_sw_ifd_idx_t;
+
+/** mm_jpeg_sw_exif_type_size:
+ *
+ *  Return:
+ *       size of one value of the type, 0 if unknown
+ **/
+static uint32_t mm_jpeg_sw_exif_type_size(uint32_t type)
+{
+  switch (type) {
+  case EXIF_BYTE:
+  case EXIF_ASCII:
+  case EXIF_UNDEFINED:
+    return 1;
+  case EXIF_SHORT:
+    return 2;
+  case EXIF_LONG:
+  case EXIF_SLONG:
+    return 4;
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/** mm_jpeg_sw_exif_value:
+ *
+ *  Arguments:
+ *    @p_entry: tag entry
+ *
+ *  Return:
+ *       values of the entry, see exif_tag_entry_t
+ **/
+static const void *mm_jpeg_sw_exif_value(const exif_tag_entry_t *p_entry)
+{
+  int multi = (p_entry->count > 1);
+
+  switch (p_entry->type) {
+  case EXIF_BYTE:
+    return multi ? (const void *)p_entry->data._bytes :
+      (const void *)&p_entry->data._byte;
+  case EXIF_ASCII:
+    return p_entry->data._ascii;
+  case EXIF_SHORT:
+    return multi ? (const void *)p_entry->data._shorts :
+      (const void *)&p_entry->data._short;
+  case EXIF_LONG:
+    return multi ? (const void *)p_entry->data._longs :
+      (const void *)&p_entry->data._long;
+  case EXIF_RATIONAL:
+    return multi ? (const void *)p_entry->data._rats :
+      (const void *)&p_entry->data._rat;
+  case EXIF_UNDEFINED:
+    return p_entry->data._undefined;
+  case EXIF_SLONG:
+    return multi ? (const void *)p_entry->data._slongs :
+      (const void *)&p_entry->data._slong;
+  case EXIF_SRATIONAL:
+    return multi ? (const void *)p_entry->data._srats :
+      (const void *)&p_entry->data._srat;
+  default:
+    return NULL;
+  }
+}
+
+/** mm_jpeg_sw_exif_find:
+ *
+ *  Return:
+ *       entry of the tag or NULL
+ **/
+static mm_jpeg_sw_exif_tag_t *mm_jpeg_sw_exif_find(mm_jpeg_sw_ifd_t *p_ifd,
+  uint16_t tag)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_ifd->num_tags; i++) {
+    if (p_ifd->tag[i].tag == tag) {
+      return &p_ifd->tag[i];
+    }
+  }
+  return NULL;
+}
+
+/** mm_jpeg_sw_exif_add:
+ *
+ *  Arguments:
+ *    @p_ifd: IFD
+ *    @tag: 16 bit tag
+ *    @type: value type
+ *    @count: number of values
+ *    @p_val: values, NULL for a generated SHORT or LONG
+ *    @val: value of a generated tag
+ *    @replace: overwrite an existing entry of the tag
+ *
+ *  Description:
+ *       Adds a tag keeping the IFD sorted by tag as TIFF requires
+ **/
+static void mm_jpeg_sw_exif_add(mm_jpeg_sw_ifd_t *p_ifd, uint16_t tag,
+  uint16_t type, uint32_t count, const void *p_val, uint32_t val,
+  int replace)
+{
+  mm_jpeg_sw_exif_tag_t *p_tag = mm_jpeg_sw_exif_find(p_ifd, tag);
+  uint32_t i;
+
+  if (NULL == p_tag) {
+    if (p_ifd->num_tags >= MM_JPEG_SW_MAX_EXIF_TAGS) {
+      CDBG_ERROR("%s:%d] IFD full, tag 0x%x dropped", __func__, __LINE__, tag);
+      return;
+    }
+    for (i = p_ifd->num_tags; (i > 0) && (p_ifd->tag[i - 1].tag > tag); i--) {
+      p_ifd->tag[i] = p_ifd->tag[i - 1];
+    }
+    p_tag = &p_ifd->tag[i];
+    p_ifd->num_tags++;
+  } else if (!replace) {
+    return;
+  }
+  p_tag->tag = tag;
+  p_tag->type = type;
+  p_tag->count = count;
+  p_tag->p_val = p_val;
+  p_tag->val = val;
+}
+
+/** mm_jpeg_sw_exif_ifd_size:
+ *
+ *  Return:
+ *       bytes taken by the IFD and its out of line values
+ **/
+static uint32_t mm_jpeg_sw_exif_ifd_size(mm_jpeg_sw_ifd_t *p_ifd)
+{
+  uint32_t size = 2 + 12 * p_ifd->num_tags + 4;
+  uint32_t i, len;
+
+  for (i = 0; i < p_ifd->num_tags; i++) {
+    len = p_ifd->tag[i].count *
+      mm_jpeg_sw_exif_type_size(p_ifd->tag[i].type);
+    if (len > 4) {
+      size += (len + 1) & ~1U;
+    }
+  }
+  return size;
+}
+
+static inline void mm_jpeg_sw_put_le16(uint8_t *p, uint32_t val)
+{
+  p[0] = (uint8_t)val;
+  p[1] = (uint8_t)(val >> 8);
+}
+
+static inline void mm_jpeg_sw_put_le32(uint8_t *p, uint32_t val)
+{
+  p[0] = (uint8_t)val;
+  p[1] = (uint8_t)(val >> 8);
+  p[2] = (uint8_t)(val >> 16);
+  p[3] = (uint8_t)(val >> 24);
+}
+
+/** mm_jpeg_sw_exif_put_value:
+ *
+ *  Arguments:
+ *    @p: destination
+ *    @p_tag: tag
+ *
+ *  Description:
+ *       Writes the values of a tag in TIFF byte order
+ **/
+static void mm_jpeg_sw_exif_put_value(uint8_t *p,
+  const mm_jpeg_sw_exif_tag_t *p_tag)
+{
+  uint32_t i;
+
+  if (NULL == p_tag->p_val) {
+    if (EXIF_SHORT == p_tag->type) {
+      mm_jpeg_sw_put_le16(p, p_tag->val);
+    } else {
+      mm_jpeg_sw_put_le32(p, p_tag->val);
+    }
+    return;
+  }
+
+  switch (p_tag->type) {
+  case EXIF_SHORT: {
+    const uint16_t *p_val = (const uint16_t *)p_tag->p_val;
+    for (i = 0; i < p_tag->count; i++) {
+      mm_jpeg_sw_put_le16(p + 2 * i, p_val[i]);
+    }
+    break;
+  }
+  case EXIF_LONG:
+  case EXIF_SLONG:
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL: {
+    /* rationals are pairs of 32 bit words */
+    const uint32_t *p_val = (const uint32_t *)p_tag->p_val;
+    uint32_t words = p_tag->count *
+      mm_jpeg_sw_exif_type_size(p_tag->type) / 4;
+    for (i = 0; i < words; i++) {
+      mm_jpeg_sw_put_le32(p + 4 * i, p_val[i]);
+    }
+    break;
+  }
+  default:
+    memcpy(p, p_tag->p_val, p_tag->count);
+    break;
+  }
+}
+
+/** mm_jpeg_sw_exif_put_ifd:
+ *
+ *  Arguments:
+ *    @p_tiff: start of the TIFF header
+ *    @offset: offset of the IFD from @p_tiff
+ *    @p_ifd: IFD
+ *    @next: offset of the next IFD, 0 for none
+ *
+ *  Return:
+ *       offset past the IFD and its values
+ **/
+static uint32_t mm_jpeg_sw_exif_put_ifd(uint8_t *p_tiff, uint32_t offset,
+  mm_jpeg_sw_ifd_t *p_ifd, uint32_t next)
+{
+  uint8_t *p = p_tiff + offset;
+  uint32_t data = offset + 2 + 12 * p_ifd->num_tags + 4;
+  uint32_t i, len;
+
+  mm_jpeg_sw_put_le16(p, p_ifd->num_tags);
+  p += 2;
+  for (i = 0; i < p_ifd->num_tags; i++) {
+    mm_jpeg_sw_exif_tag_t *p_tag = &p_ifd->tag[i];
+
+    len = p_tag->count * mm_jpeg_sw_exif_type_size(p_tag->type);
+    mm_jpeg_sw_put_le16(p, p_tag->tag);
+    mm_jpeg_sw_put_le16(p + 2, p_tag->type);
+    mm_jpeg_sw_put_le32(p + 4, p_tag->count);
+    memset(p + 8, 0, 4);
+    if (len <= 4) {
+      mm_jpeg_sw_exif_put_value(p + 8, p_tag);
+    } else {
+      mm_jpeg_sw_put_le32(p + 8, data);
+      mm_jpeg_sw_exif_put_value(p_tiff + data, p_tag);
+      if (len & 1) {
+        p_tiff[data + len] = 0;
+      }
+      data += (len + 1) & ~1U;
+    }
+    p += 12;
+  }
+  mm_jpeg_sw_put_le32(p, next);
+  return data;
+}
+
+/** mm_jpeg_sw_exif_write:
+ *
+ *  Arguments:
+ *    @pp_info: tag lists, later lists override earlier ones
+ *    @num_info: number of lists
+ *    @width: image width
+ *    @height: image height
+ *    @p_thumb: JPEG thumbnail or NULL
+ *    @thumb_len: thumbnail size
+ *    @p_dst: destination
+ *    @dst_size: size of the destination
+ *    @p_len: length of the APP1 segment
+ *
+ *  Return:
+ *       0 on success, -EFBIG if the segment does not fit, -EINVAL for
+ *       bad arguments
+ *
+ *  Description:
+ *       Writes the APP1 segment, marker included
+ **/
+int32_t mm_jpeg_sw_exif_write(QOMX_EXIF_INFO **pp_info,
+  uint32_t num_info,
+  uint32_t width, uint32_t height,
+  const uint8_t *p_thumb, size_t thumb_len,
+  uint8_t *p_dst, size_t dst_size, size_t *p_len)
+{
+  static const uint8_t exif_version[4] = {'0', '2', '2', '0'};
+  mm_jpeg_sw_ifd_t *p_ifd;
+  uint32_t off[MM_JPEG_SW_IFD_MAX];
+  uint32_t tiff_len, end, i, j;
+  uint8_t *p_tiff;
+  int32_t rc = 0;
+
+  if ((NULL == p_dst) || (NULL == p_len)) {
+    return -EINVAL;
+  }
+  p_ifd = (mm_jpeg_sw_ifd_t *)calloc(MM_JPEG_SW_IFD_MAX,
+    sizeof(mm_jpeg_sw_ifd_t));
+  if (NULL == p_ifd) {
+    return -ENOMEM;
+  }
+
+  for (i = 0; i < num_info; i++) {
+    if (NULL == pp_info[i]) {
+      continue;
+    }
+    for (j = 0; j < pp_info[i]->numOfEntries; j++) {
+      QEXIF_INFO_DATA *p_data = &pp_info[i]->exif_data[j];
+      exif_tag_entry_t *p_entry = &p_data->tag_entry;
+      uint32_t offset = p_data->tag_id >> 16;
+      uint16_t tag = (uint16_t)(p_data->tag_id & 0xFFFF);
+      const void *p_val = mm_jpeg_sw_exif_value(p_entry);
+      mm_jpeg_sw_ifd_idx_t idx;
+
+      if ((NULL == p_val) || (0 == p_entry->count) ||
+        (0 == mm_jpeg_sw_exif_type_size(p_entry->type))) {
+        continue;
+      }
+      if (offset <= GPS_DIFFERENTIAL) {
+        idx = MM_JPEG_SW_IFD_GPS;
+      } else if (offset < TN_IMAGE_WIDTH) {
+        if ((EXIF_IFD == offset) || (GPS_IFD == offset)) {
+          continue;
+        }
+        idx = MM_JPEG_SW_IFD0;
+      } else if (offset < EXPOSURE_TIME) {
+        /* IFD1 describes the thumbnail written here */
+        continue;
+      } else {
+        if (INTEROP == offset) {
+          continue;
+        }
+        idx = MM_JPEG_SW_IFD_EXIF;
+      }
+      mm_jpeg_sw_exif_add(&p_ifd[idx], tag, (uint16_t)p_entry->type,
+        p_entry->count, p_val, 0, 1);
+    }
+  }
+
+  mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD_EXIF],
+    _ID_EXIF_VERSION, EXIF_UNDEFINED, 4, exif_version, 0, 0);
+  mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD_EXIF],
+    _ID_EXIF_PIXEL_X_DIMENSION, EXIF_LONG, 1, NULL, width, 0);
+  mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD_EXIF],
+    _ID_EXIF_PIXEL_Y_DIMENSION, EXIF_LONG, 1, NULL, height, 0);
+  mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD0],
+    MM_JPEG_SW_TAG_EXIF_IFD, EXIF_LONG, 1, NULL, 0, 1);
+  if (p_ifd[MM_JPEG_SW_IFD_GPS].num_tags) {
+    mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD0],
+      MM_JPEG_SW_TAG_GPS_IFD, EXIF_LONG, 1, NULL, 0, 1);
+  }
+  if (p_thumb && thumb_len) {
+    mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD1],
+      MM_JPEG_SW_TAG_COMPRESSION, EXIF_SHORT, 1, NULL, 6, 1);
+    mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD1],
+      MM_JPEG_SW_TAG_JPEG_IF, EXIF_LONG, 1, NULL, 0, 1);
+    mm_jpeg_sw_exif_add(&p_ifd[MM_JPEG_SW_IFD1],
+      MM_JPEG_SW_TAG_JPEG_IF_LEN, EXIF_LONG, 1, NULL, (uint32_t)thumb_len, 1);
+  }
+
+  /* the IFDs and their values do not change size once the offsets are
+   * filled in, lay them out first */
+  end = MM_JPEG_SW_TIFF_HDR_LEN;
+  for (i = 0; i < MM_JPEG_SW_IFD_MAX; i++) {
+    off[i] = 0;
+    if (p_ifd[i].num_tags) {
+      off[i] = end;
+      end += mm_jpeg_sw_exif_ifd_size(&p_ifd[i]);
+    }
+  }
+  tiff_len = end;
+  if (p_ifd[MM_JPEG_SW_IFD1].num_tags) {
+    tiff_len += (uint32_t)thumb_len;
+  }
+  if ((tiff_len + MM_JPEG_SW_EXIF_ID_LEN + 2 > MM_JPEG_SW_MAX_SEGMENT_LEN) ||
+    (tiff_len + MM_JPEG_SW_EXIF_ID_LEN + 4 > dst_size)) {
+    CDBG_HIGH("%s:%d] APP1 of %d bytes does not fit", __func__, __LINE__,
+      tiff_len + MM_JPEG_SW_EXIF_ID_LEN + 4);
+    rc = -EFBIG;
+    goto end;
+  }
+
+  mm_jpeg_sw_exif_find(&p_ifd[MM_JPEG_SW_IFD0],
+    MM_JPEG_SW_TAG_EXIF_IFD)->val = off[MM_JPEG_SW_IFD_EXIF];
+  if (off[MM_JPEG_SW_IFD_GPS]) {
+    mm_jpeg_sw_exif_find(&p_ifd[MM_JPEG_SW_IFD0],
+      MM_JPEG_SW_TAG_GPS_IFD)->val = off[MM_JPEG_SW_IFD_GPS];
+  }
+  if (off[MM_JPEG_SW_IFD1]) {
+    mm_jpeg_sw_exif_find(&p_ifd[MM_JPEG_SW_IFD1],
+      MM_JPEG_SW_TAG_JPEG_IF)->val = end;
+  }
+
+  /* APP1 marker, length and identifier */
+  p_dst[0] = 0xFF;
+  p_dst[1] = 0xE1;
+  p_dst[2] = (uint8_t)((tiff_len + MM_JPEG_SW_EXIF_ID_LEN + 2) >> 8);
+  p_dst[3] = (uint8_t)(tiff_len + MM_JPEG_SW_EXIF_ID_LEN + 2);
+  memcpy(p_dst + 4, "Exif\0\0", MM_JPEG_SW_EXIF_ID_LEN);
+  p_tiff = p_dst + 4 + MM_JPEG_SW_EXIF_ID_LEN;
+
+  /* TIFF header, little endian, IFD0 follows it */
+  p_tiff[0] = 'I';
+  p_tiff[1] = 'I';
+  mm_jpeg_sw_put_le16(p_tiff + 2, 42);
+  mm_jpeg_sw_put_le32(p_tiff + 4, MM_JPEG_SW_TIFF_HDR_LEN);
+
+  /* only IFD0 links to IFD1, the others are reached via pointer tags */
+  mm_jpeg_sw_exif_put_ifd(p_tiff, off[MM_JPEG_SW_IFD0],
+    &p_ifd[MM_JPEG_SW_IFD0], off[MM_JPEG_SW_IFD1]);
+  mm_jpeg_sw_exif_put_ifd(p_tiff, off[MM_JPEG_SW_IFD_EXIF],
+    &p_ifd[MM_JPEG_SW_IFD_EXIF], 0);
+  if (off[MM_JPEG_SW_IFD_GPS]) {
+    mm_jpeg_sw_exif_put_ifd(p_tiff, off[MM_JPEG_SW_IFD_GPS],
+      &p_ifd[MM_JPEG_SW_IFD_GPS], 0);
+  }
+  if (off[MM_JPEG_SW_IFD1]) {
+    mm_jpeg_sw_exif_put_ifd(p_tiff, off[MM_JPEG_SW_IFD1],
+      &p_ifd[MM_JPEG_SW_IFD1], 0);
+    memcpy(p_tiff + end, p_thumb, thumb_len);
+  }
+  *p_len = tiff_len + MM_JPEG_SW_EXIF_ID_LEN + 4;
+
+end:
+  free(p_ifd);
+  return rc;
+}
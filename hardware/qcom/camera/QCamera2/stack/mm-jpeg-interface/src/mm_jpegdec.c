@@ -97,6 +97,7 @@ static void mm_jpegdec_job_done(mm_jpeg_job_session_t *p_session)
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
     p_session->jobId);
   if (node) {
+    mm_jpeg_sched_job_done(&my_obj->job_mgr, node);
     free(node);
   }
   p_session->encoding = OMX_FALSE;
@@ -663,7 +664,6 @@ error:
  **/
 int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
 {
-  mm_jpeg_q_data_t qdata;
   int32_t rc = 0;
   OMX_ERRORTYPE ret = OMX_ErrorNone;
   mm_jpeg_job_session_t *p_session = NULL;
@@ -676,15 +676,7 @@ int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_
     return -1;
   }
 
-  /* sent encode cmd to OMX, queue job into ongoing queue */
-  qdata.p = job_node;
-  rc = mm_jpeg_queue_enq(&my_obj->ongoing_job_q, qdata);
-  if (rc) {
-    CDBG_ERROR("%s:%d] jpeg enqueue failed %d",
-      __func__, __LINE__, ret);
-    goto error;
-  }
-
+  /* the scheduler already queued the job into ongoing queue */
   p_session->decode_job = job_node->dec_info.decode_job;
   p_session->jobId = job_node->dec_info.job_id;
   ret = mm_jpegdec_session_decode(p_session);
@@ -736,7 +728,6 @@ int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   mm_jpeg_job_t *job,
   uint32_t *job_id)
 {
-  mm_jpeg_q_data_t qdata;
   int32_t rc = -1;
   uint8_t session_idx = 0;
   uint8_t client_idx = 0;
@@ -788,10 +779,9 @@ int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   node->dec_info.client_handle = p_session->client_hdl;
   node->type = MM_JPEG_CMD_TYPE_DECODE_JOB;
 
-  qdata.p = node;
-  rc = mm_jpeg_queue_enq(&my_obj->job_mgr.job_queue, qdata);
-  if (0 == rc) {
-    cam_sem_post(&my_obj->job_mgr.job_sem);
+  rc = mm_jpeg_sched_enq(&my_obj->job_mgr, node);
+  if (0 != rc) {
+    free(node);
   }
 
   return rc;
@@ -889,6 +879,7 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
   }
   uint32_t session_id = p_session->sessionId;
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_sched_wait_dispatch(&my_obj->job_mgr);
 
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
@@ -1080,6 +1071,7 @@ int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
 
   CDBG("%s:%d] ", __func__, __LINE__);
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_sched_wait_dispatch(&my_obj->job_mgr);
 
   /* abort job if in todo queue */
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue, jobId);
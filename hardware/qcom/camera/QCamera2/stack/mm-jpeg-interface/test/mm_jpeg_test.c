@@ -29,6 +29,7 @@
 
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg_ionbuf.h"
+#include "mm_jpeg.h"
 #include <sys/time.h>
 #include <stdlib.h>
 
@@ -41,6 +42,7 @@
  *
  *  dump the image to the file
  **/
+#undef DUMP_TO_FILE
 #define DUMP_TO_FILE(filename, p_addr, len) ({ \
   FILE *fp = fopen(filename, "w+"); \
   if (fp) { \
@@ -72,6 +74,8 @@ typedef struct {
   int tmb_height;
   int main_quality;
   int thumb_quality;
+  uint32_t sched_sessions;
+  uint32_t sw_backend;
 } jpeg_test_input_t;
 
 /* Static constants */
@@ -136,7 +140,7 @@ static const mm_jpeg_intf_test_colfmt_t color_formats[] =
 
 static jpeg_test_input_t jpeg_input[] = {
   { QCAMERA_DUMP_FRM_LOCATION"test_1.yuv", 4000, 3008, QCAMERA_DUMP_FRM_LOCATION"test_1.jpg", 0, 0,
-  { MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2, {3, 2}, "YCRCBLP_H2V2" }, 0, 320, 240, 80, 80}
+  { MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2, {3, 2}, "YCRCBLP_H2V2" }, 0, 320, 240, 80, 80, 0}
 };
 
 static void mm_jpeg_encode_callback(jpeg_job_status_t status,
@@ -257,7 +261,7 @@ static int encode_init(jpeg_test_input_t *p_input, mm_jpeg_intf_test_t *p_obj)
     p_obj->width = p_input->width;
     p_obj->height = p_input->height;
     p_obj->out_filename[i] = p_in->out_filename;
-    p_obj->use_ion = 1;
+    p_obj->use_ion = !p_input->sw_backend;
     p_obj->min_out_bufs = p_input->min_out_bufs;
 
     /* allocate buffers */
@@ -411,7 +415,8 @@ static int encode_test(jpeg_test_input_t *p_input)
   pic_size.w = (uint32_t)p_input->width;
   pic_size.h = (uint32_t)p_input->height;
 
-  jpeg_obj.handle = jpeg_open(&jpeg_obj.ops, pic_size);
+  jpeg_obj.handle = jpeg_open_backend(&jpeg_obj.ops, pic_size,
+    p_input->sw_backend ? MM_JPEG_BACKEND_SW : MM_JPEG_BACKEND_AUTO);
   if (jpeg_obj.handle == 0) {
     CDBG_ERROR("%s:%d] Error",__func__, __LINE__);
     goto end;
@@ -472,6 +477,326 @@ end:
   return 0;
 }
 
+#define SCHED_TEST_MAX_SESSIONS (8)
+#define SCHED_TEST_JOBS_PER_SESSION (24)
+#define SCHED_TEST_SMALL_US (2000)
+#define SCHED_TEST_LARGE_US (8000)
+
+/** jpeg_sched_test_t:
+ *
+ *  Drives the mm-jpeg job scheduler with several sessions against a
+ *  software codec stand-in. Each session owns a single codec handle, the
+ *  codec runs jobs asynchronously on its own threads and completes them
+ *  the way mm_jpegenc_job_done does.
+ **/
+typedef struct {
+  mm_jpeg_job_cmd_thread_t sched;
+  pthread_mutex_t job_lock;
+  mm_jpeg_queue_t ongoing_q;
+  mm_jpeg_queue_t codec_q;
+  cam_semaphore_t codec_sem;
+  pthread_t codec_tid[MM_JPEG_MAX_CONCURRENT_JOBS];
+  uint32_t num_codec;
+  uint32_t num_sessions;
+  /* claimed by the scheduler, protected by job_lock */
+  uint8_t claimed[SCHED_TEST_MAX_SESSIONS];
+  /* protected by lock */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint8_t in_codec[SCHED_TEST_MAX_SESSIONS];
+  uint32_t outstanding[SCHED_TEST_MAX_SESSIONS];
+  uint32_t next_seq[SCHED_TEST_MAX_SESSIONS];
+  uint32_t num_in_codec;
+  uint32_t max_in_codec;
+  uint32_t max_pending;
+  uint32_t num_done;
+  uint32_t num_errors;
+  uint64_t wait_ns[MM_JPEG_JOB_PRIO_MAX];
+  uint32_t wait_cnt[MM_JPEG_JOB_PRIO_MAX];
+} jpeg_sched_test_t;
+
+typedef struct {
+  jpeg_sched_test_t *p_test;
+  uint32_t session;
+} jpeg_sched_test_session_t;
+
+static int32_t jpeg_sched_test_claim(void *user_data,
+  mm_jpeg_job_q_node_t *node)
+{
+  jpeg_sched_test_t *p_test = (jpeg_sched_test_t *)user_data;
+  uint32_t s = node->enc_info.encode_job.session_id;
+
+  if (p_test->claimed[s]) {
+    return 1;
+  }
+  p_test->claimed[s] = 1;
+  return 0;
+}
+
+static void jpeg_sched_test_unclaim(void *user_data,
+  mm_jpeg_job_q_node_t *node)
+{
+  jpeg_sched_test_t *p_test = (jpeg_sched_test_t *)user_data;
+
+  p_test->claimed[node->enc_info.encode_job.session_id] = 0;
+}
+
+static int32_t jpeg_sched_test_run(void *user_data,
+  mm_jpeg_job_q_node_t *node)
+{
+  jpeg_sched_test_t *p_test = (jpeg_sched_test_t *)user_data;
+  mm_jpeg_q_data_t qdata;
+
+  /* asynchronous, like OMX_EmptyThisBuffer */
+  qdata.p = node;
+  mm_jpeg_queue_enq(&p_test->codec_q, qdata);
+  cam_sem_post(&p_test->codec_sem);
+  return 0;
+}
+
+static void *jpeg_sched_test_codec(void *data)
+{
+  jpeg_sched_test_t *p_test = (jpeg_sched_test_t *)data;
+  mm_jpeg_job_q_node_t *node;
+  mm_jpeg_job_q_node_t *done;
+  mm_jpeg_q_data_t qdata;
+  uint32_t s, seq;
+
+  while (1) {
+    cam_sem_wait(&p_test->codec_sem);
+    qdata = mm_jpeg_queue_deq(&p_test->codec_q);
+    node = (mm_jpeg_job_q_node_t *)qdata.p;
+    if (NULL == node) {
+      break;
+    }
+    s = node->enc_info.encode_job.session_id;
+    seq = node->enc_info.job_id & 0xFFFF;
+
+    pthread_mutex_lock(&p_test->lock);
+    if (p_test->in_codec[s]) {
+      fprintf(stderr, "session %u has two jobs in the codec\n", s);
+      p_test->num_errors++;
+    }
+    p_test->in_codec[s] = 1;
+    if (++p_test->num_in_codec > p_test->max_in_codec) {
+      p_test->max_in_codec = p_test->num_in_codec;
+    }
+    p_test->wait_ns[node->prio] += node->dispatch_ts - node->enq_ts;
+    p_test->wait_cnt[node->prio]++;
+    pthread_mutex_unlock(&p_test->lock);
+
+    /* software stand-in, cost follows the image size */
+    usleep((MM_JPEG_JOB_PRIO_HIGH == node->prio) ?
+      SCHED_TEST_SMALL_US : SCHED_TEST_LARGE_US);
+
+    pthread_mutex_lock(&p_test->lock);
+    p_test->in_codec[s] = 0;
+    p_test->num_in_codec--;
+    pthread_mutex_unlock(&p_test->lock);
+
+    /* job done: remove from ongoing, release the session, wake workers */
+    done = mm_jpeg_queue_remove_job_by_job_id(&p_test->ongoing_q,
+      node->enc_info.job_id);
+    if (done != node) {
+      fprintf(stderr, "job %x not in ongoing queue\n", node->enc_info.job_id);
+      p_test->num_errors++;
+    }
+    mm_jpeg_sched_job_done(&p_test->sched, node);
+    free(node);
+    pthread_mutex_lock(&p_test->job_lock);
+    p_test->claimed[s] = 0;
+    pthread_mutex_unlock(&p_test->job_lock);
+    cam_sem_post(&p_test->sched.job_sem);
+
+    pthread_mutex_lock(&p_test->lock);
+    if (seq != p_test->next_seq[s]) {
+      fprintf(stderr, "session %u completed job %u, expected %u\n",
+        s, seq, p_test->next_seq[s]);
+      p_test->num_errors++;
+    }
+    p_test->next_seq[s] = seq + 1;
+    p_test->outstanding[s]--;
+    p_test->num_done++;
+    pthread_cond_broadcast(&p_test->cond);
+    pthread_mutex_unlock(&p_test->lock);
+  }
+  return NULL;
+}
+
+static void *jpeg_sched_test_submit(void *data)
+{
+  jpeg_sched_test_session_t *p_sess = (jpeg_sched_test_session_t *)data;
+  jpeg_sched_test_t *p_test = p_sess->p_test;
+  uint32_t s = p_sess->session;
+  mm_jpeg_sched_status_t status;
+  mm_jpeg_job_q_node_t *node;
+  uint32_t i;
+
+  for (i = 0; i < SCHED_TEST_JOBS_PER_SESSION; i++) {
+    /* back-pressure, as QCameraPostProcessor does before encodeData */
+    pthread_mutex_lock(&p_test->lock);
+    while (1) {
+      mm_jpeg_sched_get_status(&p_test->sched, s + 1, &status);
+      if (status.pending_jobs > p_test->outstanding[s]) {
+        fprintf(stderr, "session %u pending %u > outstanding %u\n",
+          s, status.pending_jobs, p_test->outstanding[s]);
+        p_test->num_errors++;
+      }
+      if (status.pending_jobs < status.max_pending_jobs) {
+        break;
+      }
+      pthread_cond_wait(&p_test->cond, &p_test->lock);
+    }
+    p_test->outstanding[s]++;
+    if (status.pending_jobs + 1 > p_test->max_pending) {
+      p_test->max_pending = status.pending_jobs + 1;
+    }
+    pthread_mutex_unlock(&p_test->lock);
+
+    node = (mm_jpeg_job_q_node_t *)calloc(1, sizeof(*node));
+    if (NULL == node) {
+      break;
+    }
+    node->type = MM_JPEG_CMD_TYPE_JOB;
+    /* session 0 stands for preview callback JPEGs, others for captures */
+    node->prio = (0 == s) ? MM_JPEG_JOB_PRIO_HIGH : MM_JPEG_JOB_PRIO_NORMAL;
+    node->enc_info.encode_job.session_id = s;
+    node->enc_info.job_id = (s << 16) | i;
+    node->enc_info.client_handle = s + 1;
+    if (mm_jpeg_sched_enq(&p_test->sched, node)) {
+      free(node);
+      break;
+    }
+  }
+  return NULL;
+}
+
+/** sched_test:
+ *
+ *  Arguments:
+ *    @num_sessions: number of concurrent sessions
+ *
+ *  Return:
+ *       0 on success
+ *
+ *  Description:
+ *       Checks that the scheduler keeps jobs of a session in order and one
+ *       at a time while running sessions concurrently, dispatches small
+ *       jobs first and honours the back-pressure watermark. Prints the
+ *       scheduler histograms.
+ **/
+static int sched_test(uint32_t num_sessions)
+{
+  jpeg_sched_test_t *p_test;
+  jpeg_sched_test_session_t sess[SCHED_TEST_MAX_SESSIONS];
+  pthread_t submit_tid[SCHED_TEST_MAX_SESSIONS];
+  uint32_t total, i;
+  uint64_t avg_wait[MM_JPEG_JOB_PRIO_MAX];
+  struct timeval start, end;
+  int rc = 0;
+
+  if (num_sessions < 1 || num_sessions > SCHED_TEST_MAX_SESSIONS) {
+    fprintf(stderr, "sessions must be 1..%d\n", SCHED_TEST_MAX_SESSIONS);
+    return -1;
+  }
+
+  p_test = (jpeg_sched_test_t *)calloc(1, sizeof(*p_test));
+  if (NULL == p_test) {
+    return -1;
+  }
+  p_test->num_sessions = num_sessions;
+  pthread_mutex_init(&p_test->job_lock, NULL);
+  pthread_mutex_init(&p_test->lock, NULL);
+  pthread_cond_init(&p_test->cond, NULL);
+  mm_jpeg_queue_init(&p_test->ongoing_q);
+  mm_jpeg_queue_init(&p_test->codec_q);
+  cam_sem_init(&p_test->codec_sem, 0);
+
+  rc = mm_jpeg_sched_init(&p_test->sched, &p_test->job_lock,
+    &p_test->ongoing_q, jpeg_sched_test_claim, jpeg_sched_test_unclaim,
+    jpeg_sched_test_run, p_test, NUM_MAX_JPEG_CNCURRENT_JOBS);
+  if (rc) {
+    fprintf(stderr, "scheduler init failed\n");
+    goto end;
+  }
+  for (i = 0; i < p_test->sched.max_ongoing; i++) {
+    if (pthread_create(&p_test->codec_tid[i], NULL, jpeg_sched_test_codec,
+        p_test)) {
+      break;
+    }
+  }
+  p_test->num_codec = i;
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < num_sessions; i++) {
+    sess[i].p_test = p_test;
+    sess[i].session = i;
+    pthread_create(&submit_tid[i], NULL, jpeg_sched_test_submit, &sess[i]);
+  }
+  for (i = 0; i < num_sessions; i++) {
+    pthread_join(submit_tid[i], NULL);
+  }
+
+  total = num_sessions * SCHED_TEST_JOBS_PER_SESSION;
+  pthread_mutex_lock(&p_test->lock);
+  while (p_test->num_done < total) {
+    pthread_cond_wait(&p_test->cond, &p_test->lock);
+  }
+  pthread_mutex_unlock(&p_test->lock);
+  gettimeofday(&end, NULL);
+
+  mm_jpeg_sched_dump(&p_test->sched, STDOUT_FILENO);
+
+  for (i = 0; i < MM_JPEG_JOB_PRIO_MAX; i++) {
+    avg_wait[i] = p_test->wait_cnt[i] ?
+      p_test->wait_ns[i] / p_test->wait_cnt[i] : 0;
+  }
+  fprintf(stderr, "%u sessions, %u jobs in %ld ms, max in codec %u, "
+    "max pending %u, avg wait high %llu us normal %llu us\n",
+    num_sessions, total,
+    (long)((end.tv_sec - start.tv_sec) * 1000 +
+      (end.tv_usec - start.tv_usec) / 1000),
+    p_test->max_in_codec, p_test->max_pending,
+    (unsigned long long)(avg_wait[MM_JPEG_JOB_PRIO_HIGH] / 1000),
+    (unsigned long long)(avg_wait[MM_JPEG_JOB_PRIO_NORMAL] / 1000));
+
+  if (p_test->num_errors) {
+    rc = -1;
+  }
+  if ((num_sessions > 1) && (p_test->sched.max_ongoing > 1) &&
+    (p_test->max_in_codec < 2)) {
+    fprintf(stderr, "sessions did not run concurrently\n");
+    rc = -1;
+  }
+  if (p_test->max_pending > p_test->sched.max_ongoing + 1) {
+    fprintf(stderr, "back-pressure watermark exceeded\n");
+    rc = -1;
+  }
+  if ((num_sessions > p_test->sched.max_ongoing) &&
+    (avg_wait[MM_JPEG_JOB_PRIO_HIGH] >= avg_wait[MM_JPEG_JOB_PRIO_NORMAL])) {
+    fprintf(stderr, "high priority jobs were not scheduled first\n");
+    rc = -1;
+  }
+
+  mm_jpeg_sched_deinit(&p_test->sched);
+  for (i = 0; i < p_test->num_codec; i++) {
+    cam_sem_post(&p_test->codec_sem);
+  }
+  for (i = 0; i < p_test->num_codec; i++) {
+    pthread_join(p_test->codec_tid[i], NULL);
+  }
+
+end:
+  cam_sem_destroy(&p_test->codec_sem);
+  mm_jpeg_queue_deinit(&p_test->codec_q);
+  mm_jpeg_queue_deinit(&p_test->ongoing_q);
+  pthread_cond_destroy(&p_test->cond);
+  pthread_mutex_destroy(&p_test->lock);
+  pthread_mutex_destroy(&p_test->job_lock);
+  free(p_test);
+  return rc;
+}
+
 #define MAX_FILE_CNT (20)
 static int mm_jpeg_test_get_input(int argc, char *argv[],
     jpeg_test_input_t *p_test)
@@ -484,7 +809,7 @@ static int mm_jpeg_test_get_input(int argc, char *argv[],
   char *in_files[MAX_FILE_CNT];
   char *out_files[MAX_FILE_CNT];
 
-  while ((c = getopt(argc, argv, "-I:O:W:H:F:BTx:y:Q:q:")) != -1) {
+  while ((c = getopt(argc, argv, "-I:O:W:H:F:BTx:y:Q:q:S:s")) != -1) {
     switch (c) {
     case 'B':
       fprintf(stderr, "%-25s\n", "Using burst mode");
@@ -546,6 +871,15 @@ static int mm_jpeg_test_get_input(int argc, char *argv[],
       p_test->thumb_quality = atoi(optarg);
       fprintf(stderr, "%-25s%d\n", "Thumb quality: ", p_test->thumb_quality);
       break;
+    case 'S':
+      p_test->sched_sessions = (uint32_t)atoi(optarg);
+      fprintf(stderr, "%-25s%u\n", "Scheduler sessions: ",
+        p_test->sched_sessions);
+      break;
+    case 's':
+      p_test->sw_backend = 1;
+      fprintf(stderr, "%-25s\n", "Using software encoder");
+      break;
     default:;
     }
   }
@@ -601,6 +935,9 @@ static void mm_jpeg_test_print_usage()
   fprintf(stderr, "  -B \t\tBurst mode. Utilize both encoder engines on"
           "supported targets\n");
   fprintf(stderr, "  -M \t\tUse minimum number of output buffers \n");
+  fprintf(stderr, "  -S SESSIONS\t\tRun the job scheduler test with "
+          "SESSIONS concurrent sessions on a software codec stand-in\n");
+  fprintf(stderr, "  -s \t\tUse the software encoder backend\n");
   fprintf(stderr, "\n");
 }
 
@@ -637,7 +974,11 @@ int main(int argc, char* argv[])
     mm_jpeg_test_print_usage();
     return 1;
   }
-  ret = encode_test(p_test_input);
+  if (p_test_input->sched_sessions) {
+    ret = sched_test(p_test_input->sched_sessions);
+  } else {
+    ret = encode_test(p_test_input);
+  }
 
 exit:
   if (!ret) {
@@ -0,0 +1,627 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_TAG "QCameraDumpService"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cutils/properties.h>
+#include <utils/Log.h>
+#include "QCameraDumpService.h"
+
+using namespace android;
+
+namespace qcamera {
+
+#define DUMP_DEFAULT_BUDGET_MB 64
+#define DUMP_WRITER_IDLE_SEC   2
+
+static const char *dump_stream_names[QCAMERA_DUMP_STREAM_MAX] = {
+    "preview",
+    "video",
+    "snapshot",
+    "thumbnail",
+    "raw",
+    "jpeg",
+    "metadata",
+};
+
+/*===========================================================================
+ * FUNCTION   : getInstance
+ *
+ * DESCRIPTION: process wide dump service, created on first use
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : ptr to the dump service
+ *==========================================================================*/
+QCameraDumpService *QCameraDumpService::getInstance()
+{
+    // never destroyed, the writer may outlive any camera session
+    static QCameraDumpService *instance = new QCameraDumpService();
+    return instance;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraDumpService
+ *
+ * DESCRIPTION: constructor of QCameraDumpService. The memory budget comes
+ *              from persist.camera.dump.budget (MB), O_DIRECT writes from
+ *              persist.camera.dump.odirect and per stream type sampling
+ *              intervals from persist.camera.dump.sample
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDumpService::QCameraDumpService()
+    : mQueuedBytes(0),
+      mPeakBytes(0),
+      mWriterActive(false)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    memset(mStats, 0, sizeof(mStats));
+    memset(mQueuedCount, 0, sizeof(mQueuedCount));
+    memset(mOffered, 0, sizeof(mOffered));
+
+    property_get("persist.camera.dump.budget", value, "0");
+    int budget = atoi(value);
+    mBudget = (size_t)(budget > 0 ? budget : DUMP_DEFAULT_BUDGET_MB) << 20;
+    property_get("persist.camera.dump.odirect", value, "0");
+    mDirectIO = atoi(value) > 0;
+
+    for (uint32_t i = 0; i < QCAMERA_DUMP_STREAM_MAX; i++) {
+        mPolicy[i].sampleEvery = 1;
+        mPolicy[i].maxQueued = 0;
+        // streaming frames give way to stills and metadata
+        mPolicy[i].preempt = (i != QCAMERA_DUMP_STREAM_PREVIEW) &&
+                (i != QCAMERA_DUMP_STREAM_VIDEO) &&
+                (i != QCAMERA_DUMP_STREAM_RAW);
+    }
+
+    // e.g. "preview:4,video:2" dumps every 4th preview and 2nd video frame
+    property_get("persist.camera.dump.sample", value, "");
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(value, ",", &saveptr); tok != NULL;
+            tok = strtok_r(NULL, ",", &saveptr)) {
+        char *sep = strchr(tok, ':');
+        if (sep == NULL) {
+            continue;
+        }
+        *sep = '\0';
+        int sample = atoi(sep + 1);
+        for (uint32_t i = 0; i < QCAMERA_DUMP_STREAM_MAX; i++) {
+            if (sample > 0 && !strcmp(tok, dump_stream_names[i])) {
+                mPolicy[i].sampleEvery = (uint32_t)sample;
+            }
+        }
+    }
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mCond, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraDumpService
+ *
+ * DESCRIPTION: deconstructor of QCameraDumpService
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDumpService::~QCameraDumpService()
+{
+    releaseEntries(mQueue);
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : setPolicy
+ *
+ * DESCRIPTION: override the sampling and drop policy of a stream type
+ *
+ * PARAMETERS :
+ *   @type    : stream type
+ *   @policy  : new policy
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpService::setPolicy(qcamera_dump_stream_t type,
+        const qcamera_dump_policy_t &policy)
+{
+    if (type >= QCAMERA_DUMP_STREAM_MAX) {
+        return;
+    }
+    pthread_mutex_lock(&mLock);
+    mPolicy[type] = policy;
+    if (mPolicy[type].sampleEvery == 0) {
+        mPolicy[type].sampleEvery = 1;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : segsLength
+ *
+ * DESCRIPTION: number of bytes a dump of the given segments takes
+ *
+ * PARAMETERS :
+ *   @segs    : source segments
+ *   @numSegs : number of segments
+ *
+ * RETURN     : length in bytes
+ *==========================================================================*/
+size_t QCameraDumpService::segsLength(const qcamera_dump_seg_t *segs,
+        uint32_t numSegs)
+{
+    size_t len = 0;
+    for (uint32_t i = 0; i < numSegs; i++) {
+        if (segs[i].data != NULL) {
+            len += segs[i].width * segs[i].rows;
+        }
+    }
+    return len;
+}
+
+/*===========================================================================
+ * FUNCTION   : gather
+ *
+ * DESCRIPTION: copy the rows of all segments back to back into dst
+ *
+ * PARAMETERS :
+ *   @dst     : destination, at least segsLength() bytes
+ *   @segs    : source segments
+ *   @numSegs : number of segments
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpService::gather(uint8_t *dst, const qcamera_dump_seg_t *segs,
+        uint32_t numSegs)
+{
+    for (uint32_t i = 0; i < numSegs; i++) {
+        const uint8_t *src = (const uint8_t *)segs[i].data;
+        if (src == NULL) {
+            continue;
+        }
+        if (segs[i].rows <= 1 || segs[i].stride == segs[i].width) {
+            size_t len = segs[i].width * segs[i].rows;
+            memcpy(dst, src, len);
+            dst += len;
+            continue;
+        }
+        for (uint32_t row = 0; row < segs[i].rows; row++) {
+            memcpy(dst, src, segs[i].width);
+            dst += segs[i].width;
+            src += segs[i].stride;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : makeRoomLocked
+ *
+ * DESCRIPTION: check that charge more bytes fit the budget, evicting the
+ *              oldest queued non-preempt frames if the stream type may
+ *              preempt. Nothing is evicted unless that makes enough room.
+ *              Must be called with mLock held.
+ *
+ * PARAMETERS :
+ *   @type    : stream type of the new frame
+ *   @charge  : bytes the new frame is accounted for
+ *   @evicted : list the evicted entries are moved to, to be released
+ *              outside the lock
+ *
+ * RETURN     : true if the frame fits
+ *==========================================================================*/
+bool QCameraDumpService::makeRoomLocked(qcamera_dump_stream_t type,
+        size_t charge, List<dump_entry_t> &evicted)
+{
+    if (mQueuedBytes + charge <= mBudget) {
+        return true;
+    }
+    if (!mPolicy[type].preempt || charge > mBudget) {
+        return false;
+    }
+
+    size_t evictable = 0;
+    for (List<dump_entry_t>::iterator it = mQueue.begin();
+            it != mQueue.end(); it++) {
+        if (!mPolicy[it->type].preempt) {
+            evictable += it->charge;
+        }
+    }
+    if (mQueuedBytes - evictable + charge > mBudget) {
+        return false;
+    }
+
+    List<dump_entry_t>::iterator it = mQueue.begin();
+    while (mQueuedBytes + charge > mBudget && it != mQueue.end()) {
+        if (mPolicy[it->type].preempt) {
+            it++;
+            continue;
+        }
+        mQueuedBytes -= it->charge;
+        mQueuedCount[it->type]--;
+        mStats[it->type].preempted++;
+        evicted.push_back(*it);
+        it = mQueue.erase(it);
+    }
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseEntries
+ *
+ * DESCRIPTION: free the frame copies of a list of entries and empty it
+ *
+ * PARAMETERS :
+ *   @entries : entries to release
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpService::releaseEntries(List<dump_entry_t> &entries)
+{
+    for (List<dump_entry_t>::iterator it = entries.begin();
+            it != entries.end(); it++) {
+        free(it->data);
+    }
+    entries.clear();
+}
+
+/*===========================================================================
+ * FUNCTION   : submit
+ *
+ * DESCRIPTION: copy a frame and queue it to be written to path by the
+ *              writer thread. Never blocks on file I/O.
+ *
+ * PARAMETERS :
+ *   @type    : stream type the frame belongs to
+ *   @path    : file to write
+ *   @segs    : source segments
+ *   @numSegs : number of segments
+ *
+ * RETURN     : true if the frame was queued, false if it was sampled out
+ *              or dropped
+ *==========================================================================*/
+bool QCameraDumpService::submit(qcamera_dump_stream_t type, const char *path,
+        const qcamera_dump_seg_t *segs, uint32_t numSegs)
+{
+    List<dump_entry_t> evicted;
+    dump_entry_t entry;
+
+    if (type >= QCAMERA_DUMP_STREAM_MAX || path == NULL || segs == NULL) {
+        return false;
+    }
+    memset(&entry, 0, sizeof(entry));
+    entry.type = type;
+    strlcpy(entry.path, path, sizeof(entry.path));
+    entry.len = segsLength(segs, numSegs);
+    entry.charge = mDirectIO ?
+            (entry.len + DIRECT_ALIGN - 1) & ~(DIRECT_ALIGN - 1) : entry.len;
+    if (entry.len == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mLock);
+    dump_stats_t &stats = mStats[type];
+    stats.offered++;
+    if (mOffered[type]++ % mPolicy[type].sampleEvery != 0) {
+        stats.sampledOut++;
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+    if (mPolicy[type].maxQueued != 0 &&
+            mQueuedCount[type] >= mPolicy[type].maxQueued) {
+        stats.droppedQueue++;
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+    if (!makeRoomLocked(type, entry.charge, evicted)) {
+        uint32_t dropped = ++stats.droppedBudget;
+        pthread_mutex_unlock(&mLock);
+        if ((dropped & (dropped - 1)) == 0) {
+            ALOGW("%s: %s dump dropped, %u so far (budget %zu KB)", __func__,
+                    dump_stream_names[type], dropped, mBudget >> 10);
+        }
+        return false;
+    }
+    // reserve the bytes while copying outside the lock
+    mQueuedBytes += entry.charge;
+    mQueuedCount[type]++;
+    pthread_mutex_unlock(&mLock);
+
+    releaseEntries(evicted);
+
+    if (mDirectIO) {
+        void *data = NULL;
+        if (posix_memalign(&data, DIRECT_ALIGN, entry.charge) == 0) {
+            entry.data = (uint8_t *)data;
+        }
+    } else {
+        entry.data = (uint8_t *)malloc(entry.len);
+    }
+
+    nsecs_t start = systemTime(CLOCK_MONOTONIC);
+    if (entry.data != NULL) {
+        gather(entry.data, segs, numSegs);
+    }
+    nsecs_t copyTime = systemTime(CLOCK_MONOTONIC) - start;
+
+    pthread_mutex_lock(&mLock);
+    if (entry.data == NULL) {
+        mQueuedBytes -= entry.charge;
+        mQueuedCount[type]--;
+        stats.failed++;
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: no memory for %zu byte %s dump", __func__, entry.len,
+                dump_stream_names[type]);
+        return false;
+    }
+    stats.queued++;
+    stats.copyTime += copyTime;
+    if (mQueuedBytes > mPeakBytes) {
+        mPeakBytes = mQueuedBytes;
+    }
+    mQueue.push_back(entry);
+    if (!mWriterActive) {
+        pthread_t tid;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, writerRoutine, this) == 0) {
+            mWriterActive = true;
+        } else {
+            ALOGE("%s: cannot start dump writer", __func__);
+        }
+        pthread_attr_destroy(&attr);
+    } else {
+        pthread_cond_signal(&mCond);
+    }
+    pthread_mutex_unlock(&mLock);
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : writeSync
+ *
+ * DESCRIPTION: write a frame to path in the calling thread, for dumps the
+ *              caller hands over to somebody else right away. Bypasses
+ *              sampling and the budget but is counted in the statistics.
+ *
+ * PARAMETERS :
+ *   @type    : stream type the frame belongs to
+ *   @path    : file to write
+ *   @segs    : source segments
+ *   @numSegs : number of segments
+ *
+ * RETURN     : number of bytes written, negative on failure
+ *==========================================================================*/
+ssize_t QCameraDumpService::writeSync(qcamera_dump_stream_t type,
+        const char *path, const qcamera_dump_seg_t *segs, uint32_t numSegs)
+{
+    dump_entry_t entry;
+
+    if (type >= QCAMERA_DUMP_STREAM_MAX || path == NULL || segs == NULL) {
+        return -EINVAL;
+    }
+    memset(&entry, 0, sizeof(entry));
+    entry.type = type;
+    strlcpy(entry.path, path, sizeof(entry.path));
+    entry.len = segsLength(segs, numSegs);
+
+    nsecs_t start = systemTime(CLOCK_MONOTONIC);
+    ssize_t written;
+    if (numSegs == 1 && segs[0].rows <= 1) {
+        entry.data = (uint8_t *)segs[0].data;
+        written = writeEntry(entry);
+        entry.data = NULL;
+    } else {
+        entry.data = (uint8_t *)malloc(entry.len);
+        if (entry.data != NULL) {
+            gather(entry.data, segs, numSegs);
+            written = writeEntry(entry);
+            free(entry.data);
+        } else {
+            written = -ENOMEM;
+        }
+    }
+    nsecs_t writeTime = systemTime(CLOCK_MONOTONIC) - start;
+
+    pthread_mutex_lock(&mLock);
+    mStats[type].offered++;
+    if (written == (ssize_t)entry.len) {
+        mStats[type].written++;
+        mStats[type].bytes += entry.len;
+        mStats[type].writeTime += writeTime;
+    } else {
+        mStats[type].failed++;
+    }
+    pthread_mutex_unlock(&mLock);
+    return written;
+}
+
+/*===========================================================================
+ * FUNCTION   : writeEntry
+ *
+ * DESCRIPTION: write a frame copy to its file with a single write call.
+ *              With O_DIRECT the page aligned body bypasses the page cache
+ *              and the tail is written after clearing the flag.
+ *
+ * PARAMETERS :
+ *   @entry   : frame to write
+ *
+ * RETURN     : number of bytes written, negative on failure
+ *==========================================================================*/
+ssize_t QCameraDumpService::writeEntry(const dump_entry_t &entry)
+{
+    size_t direct = 0;
+    int fd = -1;
+
+    if (mDirectIO && ((uintptr_t)entry.data & (DIRECT_ALIGN - 1)) == 0) {
+        direct = entry.len & ~(DIRECT_ALIGN - 1);
+    }
+    if (direct > 0) {
+        fd = open(entry.path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (fd < 0) {
+            // file system without O_DIRECT support
+            direct = 0;
+        }
+    }
+    if (fd < 0) {
+        fd = open(entry.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+        ALOGE("%s: cannot open %s: %s", __func__, entry.path, strerror(errno));
+        return -errno;
+    }
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    ssize_t written = 0;
+    if (direct > 0) {
+        written = write(fd, entry.data, direct);
+        if (written == (ssize_t)direct && direct < entry.len) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            ssize_t tail = write(fd, entry.data + direct, entry.len - direct);
+            written = tail < 0 ? tail : written + tail;
+        }
+    } else {
+        written = write(fd, entry.data, entry.len);
+    }
+    if (written < 0) {
+        written = -errno;
+        ALOGE("%s: write to %s failed: %s", __func__, entry.path,
+                strerror(errno));
+    }
+    close(fd);
+    return written;
+}
+
+/*===========================================================================
+ * FUNCTION   : writerRoutine
+ *
+ * DESCRIPTION: writer thread. Drains the queue in submission order and
+ *              exits after DUMP_WRITER_IDLE_SEC without work.
+ *
+ * PARAMETERS :
+ *   @data    : ptr to the dump service
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCameraDumpService::writerRoutine(void *data)
+{
+    QCameraDumpService *pme = (QCameraDumpService *)data;
+
+    pthread_setname_np(pthread_self(), "CAM_dump");
+    pthread_mutex_lock(&pme->mLock);
+    while (true) {
+        if (pme->mQueue.empty()) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += DUMP_WRITER_IDLE_SEC;
+            int rc = pthread_cond_timedwait(&pme->mCond, &pme->mLock, &ts);
+            if (rc == ETIMEDOUT && pme->mQueue.empty()) {
+                break;
+            }
+            continue;
+        }
+
+        dump_entry_t entry = *pme->mQueue.begin();
+        pme->mQueue.erase(pme->mQueue.begin());
+        pthread_mutex_unlock(&pme->mLock);
+
+        nsecs_t start = systemTime(CLOCK_MONOTONIC);
+        ssize_t written = pme->writeEntry(entry);
+        nsecs_t writeTime = systemTime(CLOCK_MONOTONIC) - start;
+        free(entry.data);
+
+        pthread_mutex_lock(&pme->mLock);
+        dump_stats_t &stats = pme->mStats[entry.type];
+        pme->mQueuedBytes -= entry.charge;
+        pme->mQueuedCount[entry.type]--;
+        if (written == (ssize_t)entry.len) {
+            stats.written++;
+            stats.bytes += entry.len;
+            stats.writeTime += writeTime;
+        } else {
+            stats.failed++;
+        }
+    }
+    pme->mWriterActive = false;
+    pthread_mutex_unlock(&pme->mLock);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print budget usage and per stream type dump counters
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to print to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpService::dump(int fd)
+{
+    pthread_mutex_lock(&mLock);
+    dprintf(fd, "\nFrame dumps: %zu queued, %zu KB in use (peak %zu KB,"
+            " budget %zu KB)%s\n",
+            mQueue.size(), mQueuedBytes >> 10, mPeakBytes >> 10,
+            mBudget >> 10, mDirectIO ? ", O_DIRECT" : "");
+    dprintf(fd, " Stream    | Offered | Sampled | Written | Budget | Queue |"
+            " Preempt | Failed |    KB    | Copy us | Write ms\n");
+    for (uint32_t i = 0; i < QCAMERA_DUMP_STREAM_MAX; i++) {
+        dump_stats_t &stats = mStats[i];
+        if (stats.offered == 0) {
+            continue;
+        }
+        dprintf(fd, " %-9s | %7u | %7u | %7u | %6u | %5u | %7u | %6u |"
+                " %8llu | %7.1f | %8.2f\n",
+                dump_stream_names[i], stats.offered, stats.sampledOut,
+                stats.written, stats.droppedBudget, stats.droppedQueue,
+                stats.preempted, stats.failed,
+                (unsigned long long)(stats.bytes >> 10),
+                stats.queued ?
+                        (double)stats.copyTime / stats.queued / 1000.0 : 0.0,
+                stats.written ?
+                        (double)stats.writeTime / stats.written / 1000000.0 :
+                        0.0);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+}; // namespace qcamera
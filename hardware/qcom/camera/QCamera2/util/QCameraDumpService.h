@@ -0,0 +1,141 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_DUMP_SERVICE_H__
+#define __QCAMERA_DUMP_SERVICE_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/List.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+typedef enum {
+    QCAMERA_DUMP_STREAM_PREVIEW,
+    QCAMERA_DUMP_STREAM_VIDEO,
+    QCAMERA_DUMP_STREAM_SNAPSHOT,
+    QCAMERA_DUMP_STREAM_THUMBNAIL,
+    QCAMERA_DUMP_STREAM_RAW,
+    QCAMERA_DUMP_STREAM_JPEG,
+    QCAMERA_DUMP_STREAM_METADATA,
+    QCAMERA_DUMP_STREAM_MAX
+} qcamera_dump_stream_t;
+
+/* one source region of a dump; rows of width bytes, stride bytes apart.
+ * Contiguous data is a single row (stride is then ignored). */
+typedef struct {
+    const void *data;
+    size_t width;
+    size_t stride;
+    uint32_t rows;
+} qcamera_dump_seg_t;
+
+typedef struct {
+    uint32_t sampleEvery;   // queue one out of every N offered frames
+    uint32_t maxQueued;     // queued frames of this type, 0 = no limit
+    bool preempt;           // may evict queued non-preempt frames to fit
+} qcamera_dump_policy_t;
+
+/* Process wide writer for debug dumps of HAL1 and HAL3. Stream callbacks
+ * only copy the frame (dropping stride padding) into memory charged to a
+ * bounded budget and return; a background thread, started on demand and
+ * exiting when idle, writes each frame with a single write call, through
+ * O_DIRECT when enabled. Frames that do not fit the budget or the per type
+ * queue limit are dropped, or displace queued frames of non-preempt types
+ * (streaming frames by default) to make room for stills. Counters of
+ * every outcome are kept per stream type. */
+class QCameraDumpService {
+public:
+    static QCameraDumpService *getInstance();
+
+    bool submit(qcamera_dump_stream_t type, const char *path,
+            const qcamera_dump_seg_t *segs, uint32_t numSegs);
+    ssize_t writeSync(qcamera_dump_stream_t type, const char *path,
+            const qcamera_dump_seg_t *segs, uint32_t numSegs);
+    void setPolicy(qcamera_dump_stream_t type,
+            const qcamera_dump_policy_t &policy);
+    void dump(int fd);
+
+private:
+    QCameraDumpService();
+    virtual ~QCameraDumpService();
+
+    static const size_t PATH_LEN = 128;
+    static const size_t DIRECT_ALIGN = 4096;
+
+    typedef struct {
+        qcamera_dump_stream_t type;
+        char path[PATH_LEN];
+        uint8_t *data;
+        size_t len;
+        size_t charge;          // bytes accounted against the budget
+    } dump_entry_t;
+
+    typedef struct {
+        uint32_t offered;
+        uint32_t sampledOut;
+        uint32_t queued;
+        uint32_t written;
+        uint32_t droppedBudget;
+        uint32_t droppedQueue;
+        uint32_t preempted;
+        uint32_t failed;
+        uint64_t bytes;
+        nsecs_t copyTime;
+        nsecs_t writeTime;
+    } dump_stats_t;
+
+    static void *writerRoutine(void *data);
+    static size_t segsLength(const qcamera_dump_seg_t *segs, uint32_t numSegs);
+    static void gather(uint8_t *dst, const qcamera_dump_seg_t *segs,
+            uint32_t numSegs);
+    bool makeRoomLocked(qcamera_dump_stream_t type, size_t charge,
+            android::List<dump_entry_t> &evicted);
+    void releaseEntries(android::List<dump_entry_t> &entries);
+    ssize_t writeEntry(const dump_entry_t &entry);
+
+    android::List<dump_entry_t> mQueue;
+    qcamera_dump_policy_t mPolicy[QCAMERA_DUMP_STREAM_MAX];
+    dump_stats_t mStats[QCAMERA_DUMP_STREAM_MAX];
+    uint32_t mQueuedCount[QCAMERA_DUMP_STREAM_MAX];
+    uint32_t mOffered[QCAMERA_DUMP_STREAM_MAX];  // sampling phase
+    size_t mBudget;
+    size_t mQueuedBytes;
+    size_t mPeakBytes;
+    bool mDirectIO;
+    bool mWriterActive;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;       // signalled when work is queued
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_DUMP_SERVICE_H__ */
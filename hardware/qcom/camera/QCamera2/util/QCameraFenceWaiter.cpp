@@ -0,0 +1,508 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCameraFenceWaiter"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sync/sync.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+#include "QCameraFenceWaiter.h"
+
+using namespace android;
+
+namespace qcamera {
+
+#define FENCE_WAITER_MAX_EVENTS 16
+/* epoll data of the wakeup eventfd; fence waits use ids from 1 */
+#define FENCE_WAITER_WAKE_ID    0
+
+/*===========================================================================
+ * FUNCTION   : QCameraFenceWaiter
+ *
+ * DESCRIPTION: constructor of QCameraFenceWaiter
+ *
+ * PARAMETERS :
+ *   @signal_fn   : called on the waiter thread when a fence signals
+ *   @data_rel_fn : releases the data of waits dropped by cancelAll/deinit
+ *   @user_data   : user data ptr passed to both functions
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraFenceWaiter::QCameraFenceWaiter(fence_signaled_fn signal_fn,
+        release_data_fn data_rel_fn, void *user_data)
+    : m_signalFn(signal_fn),
+      m_dataFn(data_rel_fn),
+      m_userData(user_data),
+      m_epollFd(-1),
+      m_wakeFd(-1),
+      m_bRunning(false),
+      m_bExit(false),
+      m_nextId(FENCE_WAITER_WAKE_ID + 1),
+      m_signaledCnt(0),
+      m_errorCnt(0),
+      m_maxWaitTime(0)
+{
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_mutex_init(&m_signalLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraFenceWaiter
+ *
+ * DESCRIPTION: deconstructor of QCameraFenceWaiter
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraFenceWaiter::~QCameraFenceWaiter()
+{
+    deinit();
+    pthread_mutex_destroy(&m_lock);
+    pthread_mutex_destroy(&m_signalLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: create the epoll set and launch the waiter thread
+ *
+ * PARAMETERS :
+ *   @name    : thread name
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraFenceWaiter::init(const char *name)
+{
+    struct epoll_event ev;
+
+    if (m_bRunning) {
+        return NO_ERROR;
+    }
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        ALOGE("%s: epoll_create1 failed: %s", __func__, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wakeFd < 0) {
+        ALOGE("%s: eventfd failed: %s", __func__, strerror(errno));
+        close(m_epollFd);
+        m_epollFd = -1;
+        return UNKNOWN_ERROR;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = FENCE_WAITER_WAKE_ID;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev) < 0) {
+        ALOGE("%s: cannot poll wakeup fd: %s", __func__, strerror(errno));
+        close(m_wakeFd);
+        close(m_epollFd);
+        m_wakeFd = m_epollFd = -1;
+        return UNKNOWN_ERROR;
+    }
+
+    m_bExit = false;
+    if (pthread_create(&m_thread, NULL, waitRoutine, this) != 0) {
+        ALOGE("%s: cannot create waiter thread", __func__);
+        close(m_wakeFd);
+        close(m_epollFd);
+        m_wakeFd = m_epollFd = -1;
+        return UNKNOWN_ERROR;
+    }
+    if (name != NULL) {
+        pthread_setname_np(m_thread, name);
+    }
+    m_bRunning = true;
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinit
+ *
+ * DESCRIPTION: stop the waiter thread and drop all pending waits
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraFenceWaiter::deinit()
+{
+    if (!m_bRunning) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_bExit = true;
+    pthread_mutex_unlock(&m_lock);
+    wake();
+    pthread_join(m_thread, NULL);
+    m_bRunning = false;
+
+    cancelAll();
+    close(m_wakeFd);
+    close(m_epollFd);
+    m_wakeFd = m_epollFd = -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : waitAsync
+ *
+ * DESCRIPTION: start waiting on a fence. signal_fn is called with data once
+ *              it signals and every earlier wait with the same order key
+ *              has been signalled, unless the wait is cancelled first.
+ *
+ * PARAMETERS :
+ *   @fence_fd  : sync fence fd, owned by the waiter from now on. -1 if
+ *                there is nothing to wait for but order_key.
+ *   @data      : opaque data handed back to signal_fn
+ *   @order_key : waits with the same non-zero key signal in order
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, fence_fd is closed and data is
+ *              not released
+ *==========================================================================*/
+int32_t QCameraFenceWaiter::waitAsync(int fence_fd, void *data,
+        uint64_t order_key)
+{
+    struct epoll_event ev;
+    fence_wait_t wait;
+
+    if ((fence_fd < 0) && (order_key == 0)) {
+        return BAD_VALUE;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_bRunning || m_bExit) {
+        pthread_mutex_unlock(&m_lock);
+        close(fence_fd);
+        return NO_INIT;
+    }
+
+    wait.fd = fence_fd;
+    wait.data = data;
+    wait.start = systemTime(SYSTEM_TIME_MONOTONIC);
+    wait.key = order_key;
+    wait.signaled = (fence_fd < 0);
+    wait.status = NO_ERROR;
+    uint64_t id = m_nextId++;
+    m_waits.add(id, wait);
+
+    if (fence_fd < 0) {
+        // Nothing to poll, let the thread signal it in turn. Going through
+        // the thread keeps it behind a callback that may be running now.
+        pthread_mutex_unlock(&m_lock);
+        wake();
+        return NO_ERROR;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = id;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fence_fd, &ev) < 0) {
+        ALOGE("%s: cannot poll fence fd %d: %s", __func__, fence_fd,
+                strerror(errno));
+        m_waits.removeItem(id);
+        pthread_mutex_unlock(&m_lock);
+        close(fence_fd);
+        return UNKNOWN_ERROR;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : cancelAll
+ *
+ * DESCRIPTION: drop all pending waits; their data is handed to data_rel_fn
+ *              and their fence fds are closed
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraFenceWaiter::cancelAll()
+{
+    pthread_mutex_lock(&m_signalLock);
+    pthread_mutex_lock(&m_lock);
+    for (size_t i = 0; i < m_waits.size(); i++) {
+        fence_wait_t &wait = m_waits.editValueAt(i);
+        releaseWaitLocked(wait);
+        if (m_dataFn != NULL) {
+            m_dataFn(wait.data, m_userData);
+        }
+    }
+    m_waits.clear();
+    pthread_mutex_unlock(&m_lock);
+    pthread_mutex_unlock(&m_signalLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getPendingCount
+ *
+ * DESCRIPTION: number of fences still being waited on
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : pending count
+ *==========================================================================*/
+uint32_t QCameraFenceWaiter::getPendingCount()
+{
+    pthread_mutex_lock(&m_lock);
+    uint32_t cnt = (uint32_t)m_waits.size();
+    pthread_mutex_unlock(&m_lock);
+    return cnt;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print counters and the pending fences with their age
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraFenceWaiter::dump(int fd)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    pthread_mutex_lock(&m_lock);
+    dprintf(fd, "\nAcquire fence waiter: %zu pending, %u signaled, %u errors,"
+            " max wait %lld us\n", m_waits.size(), m_signaledCnt, m_errorCnt,
+            (long long)(m_maxWaitTime / 1000));
+    for (size_t i = 0; i < m_waits.size(); i++) {
+        const fence_wait_t &wait = m_waits.valueAt(i);
+        if (wait.signaled) {
+            dprintf(fd, "  signaled, held behind key %llu for %lld us\n",
+                    (unsigned long long)wait.key,
+                    (long long)((now - wait.start) / 1000));
+            continue;
+        }
+        struct sync_fence_info_data *info = sync_fence_info(wait.fd);
+        dprintf(fd, "  fence %-24s status %2d waiting %lld us\n",
+                (info != NULL) ? info->name : "?",
+                (info != NULL) ? info->status : 0,
+                (long long)((now - wait.start) / 1000));
+        if (info != NULL) {
+            sync_fence_info_free(info);
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : waitRoutine
+ *
+ * DESCRIPTION: waiter thread, dispatches fence signals until deinit
+ *
+ * PARAMETERS :
+ *   @data    : QCameraFenceWaiter object
+ *
+ * RETURN     : NULL
+ *==========================================================================*/
+void *QCameraFenceWaiter::waitRoutine(void *data)
+{
+    QCameraFenceWaiter *pme = (QCameraFenceWaiter *)data;
+    struct epoll_event events[FENCE_WAITER_MAX_EVENTS];
+    bool running = true;
+
+    while (running) {
+        int n = epoll_wait(pme->m_epollFd, events, FENCE_WAITER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("%s: epoll_wait failed: %s", __func__, strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n && running; i++) {
+            running = pme->handleEvent(events[i].data.u64, events[i].events);
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : handleEvent
+ *
+ * DESCRIPTION: handle one epoll event on the waiter thread
+ *
+ * PARAMETERS :
+ *   @id      : wait id, or FENCE_WAITER_WAKE_ID
+ *   @events  : epoll event mask
+ *
+ * RETURN     : false once the thread should exit
+ *==========================================================================*/
+bool QCameraFenceWaiter::handleEvent(uint64_t id, uint32_t events)
+{
+    if (id == FENCE_WAITER_WAKE_ID) {
+        uint64_t cnt;
+        if (read(m_wakeFd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) {
+            ALOGE("%s: wakeup read failed: %s", __func__, strerror(errno));
+        }
+        pthread_mutex_lock(&m_lock);
+        bool exit = m_bExit;
+        pthread_mutex_unlock(&m_lock);
+        if (!exit) {
+            signalReady();
+        }
+        return !exit;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    ssize_t idx = m_waits.indexOfKey(id);
+    if (idx < 0) {
+        // cancelled after epoll_wait returned
+        pthread_mutex_unlock(&m_lock);
+        return true;
+    }
+    fence_wait_t &wait = m_waits.editValueAt(idx);
+    if ((events & (EPOLLERR | EPOLLHUP)) || sync_wait(wait.fd, 0) < 0) {
+        ALOGE("%s: fence fd %d signaled with error", __func__, wait.fd);
+        wait.status = UNKNOWN_ERROR;
+        m_errorCnt++;
+    } else {
+        m_signaledCnt++;
+    }
+    nsecs_t waitTime = systemTime(SYSTEM_TIME_MONOTONIC) - wait.start;
+    if (waitTime > m_maxWaitTime) {
+        m_maxWaitTime = waitTime;
+    }
+    wait.signaled = true;
+    releaseWaitLocked(wait);
+    pthread_mutex_unlock(&m_lock);
+
+    signalReady();
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : signalReady
+ *
+ * DESCRIPTION: invoke signal_fn for every signaled wait that no earlier
+ *              wait of the same order key holds back, oldest first
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraFenceWaiter::signalReady()
+{
+    Vector<uint64_t> blockedKeys;
+
+    while (true) {
+        pthread_mutex_lock(&m_signalLock);
+        pthread_mutex_lock(&m_lock);
+        // m_waits is sorted by id, which is the order waits were added in
+        blockedKeys.clear();
+        ssize_t ready = -1;
+        for (size_t i = 0; i < m_waits.size(); i++) {
+            const fence_wait_t &wait = m_waits.valueAt(i);
+            bool blocked = false;
+            for (size_t k = 0; k < blockedKeys.size(); k++) {
+                if (blockedKeys[k] == wait.key) {
+                    blocked = true;
+                    break;
+                }
+            }
+            if (wait.signaled && !blocked) {
+                ready = (ssize_t)i;
+                break;
+            }
+            if (!wait.signaled && (wait.key != 0) && !blocked) {
+                blockedKeys.push_back(wait.key);
+            }
+        }
+        if (ready < 0) {
+            pthread_mutex_unlock(&m_lock);
+            pthread_mutex_unlock(&m_signalLock);
+            return;
+        }
+        fence_wait_t wait = m_waits.valueAt((size_t)ready);
+        m_waits.removeItemsAt((size_t)ready);
+        pthread_mutex_unlock(&m_lock);
+
+        m_signalFn(wait.status, wait.data, m_userData);
+        pthread_mutex_unlock(&m_signalLock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseWaitLocked
+ *
+ * DESCRIPTION: stop polling a fence and close it. m_lock must be held.
+ *
+ * PARAMETERS :
+ *   @wait    : wait entry
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraFenceWaiter::releaseWaitLocked(fence_wait_t &wait)
+{
+    if (wait.fd < 0) {
+        return;
+    }
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, wait.fd, NULL);
+    close(wait.fd);
+    wait.fd = -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : wake
+ *
+ * DESCRIPTION: wake the waiter thread up
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraFenceWaiter::wake()
+{
+    uint64_t one = 1;
+    if (write(m_wakeFd, &one, sizeof(one)) < 0) {
+        ALOGE("%s: wakeup write failed: %s", __func__, strerror(errno));
+    }
+}
+
+}; // namespace qcamera
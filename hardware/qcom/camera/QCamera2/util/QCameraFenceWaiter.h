@@ -0,0 +1,109 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_FENCE_WAITER_H__
+#define __QCAMERA_FENCE_WAITER_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+#include "QCameraQueue.h"
+
+namespace qcamera {
+
+/* status is NO_ERROR when the fence signaled, or an error code when the
+ * fence fd reported an error */
+typedef void (*fence_signaled_fn)(int32_t status, void *data, void *user_data);
+
+/* Waits on sync fence fds from a single epoll thread so that callers never
+ * block on a consumer's fence. Once a fence signals, its fd is closed and
+ * the signal callback is invoked on the waiter thread with no internal lock
+ * held, so it may take the caller's locks. Waits sharing a non-zero order
+ * key are signalled in the order they were added, whichever fence signals
+ * first. */
+class QCameraFenceWaiter {
+public:
+    QCameraFenceWaiter(fence_signaled_fn signal_fn,
+            release_data_fn data_rel_fn, void *user_data);
+    virtual ~QCameraFenceWaiter();
+    int32_t init(const char *name);
+    void deinit();
+    /* Takes ownership of fence_fd in all cases. With a non-zero order_key,
+     * fence_fd may be -1 to only queue data behind earlier waits of the
+     * same key. */
+    int32_t waitAsync(int fence_fd, void *data, uint64_t order_key = 0);
+    /* Drops all pending waits without signalling them. Returns once no
+     * signal callback is running. Must not be called from the callback. */
+    void cancelAll();
+    /* Waits not signalled yet, including ones held back by order */
+    uint32_t getPendingCount();
+    void dump(int fd);
+
+private:
+    typedef struct {
+        int fd;
+        void *data;
+        nsecs_t start;
+        uint64_t key;
+        bool signaled;
+        int32_t status;
+    } fence_wait_t;
+
+    static void *waitRoutine(void *data);
+    bool handleEvent(uint64_t id, uint32_t events);
+    void signalReady();
+    void releaseWaitLocked(fence_wait_t &wait);
+    void wake();
+
+    fence_signaled_fn m_signalFn;
+    release_data_fn m_dataFn;
+    void *m_userData;
+
+    int m_epollFd;
+    int m_wakeFd;
+    pthread_t m_thread;
+    bool m_bRunning;
+    bool m_bExit;
+
+    /* protects m_waits and m_nextId */
+    pthread_mutex_t m_lock;
+    /* held while a signal callback runs, so cancelAll can wait it out */
+    pthread_mutex_t m_signalLock;
+    android::KeyedVector<uint64_t, fence_wait_t> m_waits;
+    uint64_t m_nextId;
+
+    uint32_t m_signaledCnt;
+    uint32_t m_errorCnt;
+    nsecs_t m_maxWaitTime;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_FENCE_WAITER_H__ */
@@ -0,0 +1,614 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_TAG "QCameraIonPool"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <cutils/properties.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include "QCameraIonPool.h"
+
+extern "C" {
+#include <cam_types.h>
+}
+
+using namespace android;
+
+namespace qcamera {
+
+#define ION_POOL_DEFAULT_MAX_MB        64
+#define ION_POOL_DEFAULT_MAX_PER_CLASS 16
+
+/*===========================================================================
+ * FUNCTION   : QCameraIonPool
+ *
+ * DESCRIPTION: constructor of QCameraIonPool. High-water marks default to
+ *              persist.camera.mem.pool.maxmb and .maxperclass
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraIonPool::QCameraIonPool()
+    : mCachedBytes(0),
+      mPeakCachedBytes(0),
+      mCachedCount(0),
+      mSeq(0),
+      mHits(0),
+      mMisses(0),
+      mEvictions(0),
+      mPressureTrims(0),
+      mReusedBytes(0),
+      mAllocatedBytes(0)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    memset(mClassCount, 0, sizeof(mClassCount));
+    property_get("persist.camera.mem.pool.maxmb", value, "");
+    mMaxBytes = (size_t)(value[0] ? atoi(value) : ION_POOL_DEFAULT_MAX_MB) << 20;
+    property_get("persist.camera.mem.pool.maxperclass", value, "");
+    mMaxPerClass = (uint32_t)(value[0] ? atoi(value) : ION_POOL_DEFAULT_MAX_PER_CLASS);
+    pthread_mutex_init(&mLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraIonPool
+ *
+ * DESCRIPTION: deconstructor of QCameraIonPool, frees all pooled buffers
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraIonPool::~QCameraIonPool()
+{
+    clear();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : sizeClassOf
+ *
+ * DESCRIPTION: map a buffer size to its size class. Each power of two of
+ *              the page count is split into 4 classes, so buffers within
+ *              one class differ by less than 25%
+ *
+ * PARAMETERS :
+ *   @size    : buffer size in bytes
+ *
+ * RETURN     : size class index
+ *==========================================================================*/
+uint32_t QCameraIonPool::sizeClassOf(size_t size)
+{
+    size_t pages = (size + 4095U) >> 12;
+    if (pages < 4) {
+        return (uint32_t)pages;
+    }
+
+    uint32_t order = 0;
+    while ((pages >> order) > 1) {
+        order++;
+    }
+    uint32_t cls = order * 4 + (uint32_t)((pages >> (order - 2)) & 3);
+    return (cls < NUM_SIZE_CLASSES) ? cls : NUM_SIZE_CLASSES - 1;
+}
+
+/*===========================================================================
+ * FUNCTION   : sizeClassBase
+ *
+ * DESCRIPTION: smallest size that maps to a size class, for dumping
+ *
+ * PARAMETERS :
+ *   @cls     : size class index
+ *
+ * RETURN     : size in bytes
+ *==========================================================================*/
+size_t QCameraIonPool::sizeClassBase(uint32_t cls)
+{
+    if (cls < 4) {
+        return (size_t)cls << 12;
+    }
+    uint32_t order = cls / 4;
+    return ((size_t)(4 + (cls & 3)) << (order - 2)) << 12;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocIonBuffer
+ *
+ * DESCRIPTION: allocate one ion buffer and share it as an fd
+ *
+ * PARAMETERS :
+ *   @buf     : [output] allocated buffer
+ *   @heap_id : heap id mask to allocate from
+ *   @size    : length of the buffer, rounded up to a page
+ *   @cached  : whether the buffer should be cached
+ *   @secure_mode : SECURE for content protected buffers
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraIonPool::allocIonBuffer(qcamera_ion_buf_t &buf,
+        unsigned int heap_id, size_t size, bool cached, uint32_t secure_mode)
+{
+    int rc = OK;
+    struct ion_handle_data handle_data;
+    struct ion_allocation_data alloc;
+    struct ion_fd_data ion_info_fd;
+    int main_ion_fd = 0;
+
+    main_ion_fd = open("/dev/ion", O_RDONLY);
+    if (main_ion_fd < 0) {
+        ALOGE("Ion dev open failed: %s\n", strerror(errno));
+        goto ION_OPEN_FAILED;
+    }
+
+    memset(&alloc, 0, sizeof(alloc));
+    alloc.len = size;
+    /* to make it page size aligned */
+    alloc.len = (alloc.len + 4095U) & (~4095U);
+    alloc.align = 4096;
+    if (cached) {
+        alloc.flags = ION_FLAG_CACHED;
+    }
+    alloc.heap_id_mask = heap_id;
+    if (secure_mode == SECURE) {
+        ALOGD("%s: Allocate secure buffer\n", __func__);
+        alloc.flags = ION_SECURE;
+        alloc.heap_id_mask = ION_HEAP(ION_CP_MM_HEAP_ID);
+        alloc.align = 1048576; // 1 MiB alignment to be able to protect later
+        alloc.len = (alloc.len + 1048575U) & (~1048575U);
+    }
+
+    rc = ioctl(main_ion_fd, ION_IOC_ALLOC, &alloc);
+    if (rc < 0) {
+        ALOGE("ION allocation for len %zu failed: %s\n", (size_t)alloc.len,
+                strerror(errno));
+        goto ION_ALLOC_FAILED;
+    }
+
+    memset(&ion_info_fd, 0, sizeof(ion_info_fd));
+    ion_info_fd.handle = alloc.handle;
+    rc = ioctl(main_ion_fd, ION_IOC_SHARE, &ion_info_fd);
+    if (rc < 0) {
+        ALOGE("ION map failed %s\n", strerror(errno));
+        goto ION_MAP_FAILED;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    buf.main_ion_fd = main_ion_fd;
+    buf.fd = ion_info_fd.fd;
+    buf.handle = ion_info_fd.handle;
+    buf.size = alloc.len;
+    buf.cached = cached;
+    buf.heap_id = heap_id;
+    buf.secure_mode = secure_mode;
+
+    ALOGD("%s : ION buffer %lx with size %zu allocated",
+            __func__, (unsigned long)buf.handle, buf.size);
+    return OK;
+
+ION_MAP_FAILED:
+    memset(&handle_data, 0, sizeof(handle_data));
+    handle_data.handle = ion_info_fd.handle;
+    ioctl(main_ion_fd, ION_IOC_FREE, &handle_data);
+ION_ALLOC_FAILED:
+    close(main_ion_fd);
+ION_OPEN_FAILED:
+    return NO_MEMORY;
+}
+
+/*===========================================================================
+ * FUNCTION   : freeIonBuffer
+ *
+ * DESCRIPTION: unmap and free one ion buffer
+ *
+ * PARAMETERS :
+ *   @buf     : buffer to be freed
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::freeIonBuffer(qcamera_ion_buf_t &buf)
+{
+    struct ion_handle_data handle_data;
+
+    if (buf.unmap != NULL) {
+        buf.unmap(buf.mapping, buf.vaddr, buf.size);
+    } else if (buf.vaddr != NULL) {
+        munmap(buf.vaddr, buf.size);
+    }
+    buf.vaddr = NULL;
+    buf.mapping = NULL;
+    buf.unmap = NULL;
+
+    if (buf.fd > 0) {
+        close(buf.fd);
+        buf.fd = 0;
+    }
+
+    if (buf.main_ion_fd > 0) {
+        memset(&handle_data, 0, sizeof(handle_data));
+        handle_data.handle = buf.handle;
+        ioctl(buf.main_ion_fd, ION_IOC_FREE, &handle_data);
+        close(buf.main_ion_fd);
+        buf.main_ion_fd = 0;
+    }
+    buf.handle = 0;
+    buf.size = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : takeMapping
+ *
+ * DESCRIPTION: hand the CPU mapping kept with a pooled buffer over to its
+ *              new owner. A mapping of a different kind than the caller
+ *              expects is released instead
+ *
+ * PARAMETERS :
+ *   @buf     : buffer from allocateBuffer
+ *   @unmap   : unmap function identifying the expected kind of mapping,
+ *              NULL for a plain mmap
+ *
+ * RETURN     : mapping object, or vaddr for a plain mmap
+ *              NULL if the buffer has no usable mapping
+ *==========================================================================*/
+void *QCameraIonPool::takeMapping(qcamera_ion_buf_t &buf,
+        qcamera_ion_unmap_fn unmap)
+{
+    void *mapping = NULL;
+
+    if (buf.unmap == unmap && buf.vaddr != NULL) {
+        mapping = (unmap != NULL) ? buf.mapping : buf.vaddr;
+    } else if (buf.unmap != NULL) {
+        buf.unmap(buf.mapping, buf.vaddr, buf.size);
+    } else if (buf.vaddr != NULL) {
+        munmap(buf.vaddr, buf.size);
+    }
+    buf.vaddr = NULL;
+    buf.mapping = NULL;
+    buf.unmap = NULL;
+    return mapping;
+}
+
+/*===========================================================================
+ * FUNCTION   : findBufferLocked
+ *
+ * DESCRIPTION: take the oldest pooled buffer that fits. The request's own
+ *              size class and the next one are searched, which bounds the
+ *              waste of a reused buffer
+ *
+ * PARAMETERS :
+ *   @buf     : [output] reused buffer
+ *   @heap_id : type of heap
+ *   @size    : size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *   @secure_mode : SECURE for content protected buffers
+ *
+ * RETURN     : true if a buffer was found
+ *==========================================================================*/
+bool QCameraIonPool::findBufferLocked(qcamera_ion_buf_t &buf,
+        unsigned int heap_id, size_t size, bool cached, uint32_t secure_mode)
+{
+    uint32_t cls = sizeClassOf(size);
+    uint32_t last = (cls + 1 < NUM_SIZE_CLASSES) ? cls + 1 : cls;
+
+    for (; cls <= last; cls++) {
+        List<pool_entry_t>::iterator it = mClasses[cls].begin();
+        for (; it != mClasses[cls].end(); it++) {
+            const qcamera_ion_buf_t &e = (*it).buf;
+            if (e.size >= size && e.heap_id == heap_id &&
+                    e.cached == cached && e.secure_mode == secure_mode) {
+                buf = e;
+                mClasses[cls].erase(it);
+                mClassCount[cls]--;
+                mCachedCount--;
+                mCachedBytes -= buf.size;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocateBuffer
+ *
+ * DESCRIPTION: get a buffer from the pool, allocating a new one if nothing
+ *              pooled fits. A reused buffer keeps its CPU mapping (vaddr,
+ *              mapping), a new one has none. If ion runs out of memory the
+ *              pool is emptied and the allocation retried once
+ *
+ * PARAMETERS :
+ *   @buf     : [output] buffer
+ *   @heap_id : type of heap
+ *   @size    : size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *   @secure_mode : SECURE for content protected buffers
+ *   @reused  : [output] optional, whether a pooled buffer was reused
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int QCameraIonPool::allocateBuffer(qcamera_ion_buf_t &buf,
+        unsigned int heap_id, size_t size, bool cached, uint32_t secure_mode,
+        bool *reused)
+{
+    pthread_mutex_lock(&mLock);
+    bool found = findBufferLocked(buf, heap_id, size, cached, secure_mode);
+    if (found) {
+        mHits++;
+        mReusedBytes += buf.size;
+    } else {
+        mMisses++;
+    }
+    pthread_mutex_unlock(&mLock);
+    if (reused != NULL) {
+        *reused = found;
+    }
+    if (found) {
+        return NO_ERROR;
+    }
+
+    int rc = allocIonBuffer(buf, heap_id, size, cached, secure_mode);
+    if (rc != NO_ERROR) {
+        pthread_mutex_lock(&mLock);
+        bool havePooled = mCachedCount > 0;
+        if (havePooled) {
+            mPressureTrims++;
+        }
+        pthread_mutex_unlock(&mLock);
+        if (havePooled) {
+            ALOGW("%s: ion allocation of %zu failed, releasing pooled buffers",
+                    __func__, size);
+            clear();
+            rc = allocIonBuffer(buf, heap_id, size, cached, secure_mode);
+        }
+    }
+    if (rc == NO_ERROR) {
+        pthread_mutex_lock(&mLock);
+        mAllocatedBytes += buf.size;
+        pthread_mutex_unlock(&mLock);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseBuffer
+ *
+ * DESCRIPTION: return a buffer to the pool. Its CPU mapping, if any, must
+ *              be recorded in vaddr/mapping/unmap. Least recently released
+ *              buffers are freed to stay within the high-water marks
+ *
+ * PARAMETERS :
+ *   @buf     : buffer to be released; cleared on return
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::releaseBuffer(qcamera_ion_buf_t &buf)
+{
+    List<qcamera_ion_buf_t> toFree;
+    pool_entry_t entry;
+
+    if (buf.size == 0 || buf.main_ion_fd <= 0) {
+        return;
+    }
+
+    entry.buf = buf;
+    uint32_t cls = sizeClassOf(buf.size);
+
+    pthread_mutex_lock(&mLock);
+    entry.seq = mSeq++;
+    mClasses[cls].push_back(entry);
+    mClassCount[cls]++;
+    mCachedCount++;
+    mCachedBytes += buf.size;
+    trimLocked(mMaxBytes, cls, mMaxPerClass, toFree);
+    if (mCachedBytes > mPeakCachedBytes) {
+        mPeakCachedBytes = mCachedBytes;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    freeList(toFree);
+    memset(&buf, 0, sizeof(buf));
+}
+
+/*===========================================================================
+ * FUNCTION   : evictLocked
+ *
+ * DESCRIPTION: move the least recently released buffer of a size class, or
+ *              of the whole pool if cls is NUM_SIZE_CLASSES, to freeList
+ *
+ * PARAMETERS :
+ *   @cls      : size class index or NUM_SIZE_CLASSES
+ *   @freeList : [output] buffers to be freed outside the lock
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::evictLocked(uint32_t cls,
+        List<qcamera_ion_buf_t> &freeList)
+{
+    if (cls >= NUM_SIZE_CLASSES) {
+        uint64_t oldest = (uint64_t)-1;
+        for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+            if (!mClasses[i].empty() && (*mClasses[i].begin()).seq < oldest) {
+                oldest = (*mClasses[i].begin()).seq;
+                cls = i;
+            }
+        }
+        if (cls >= NUM_SIZE_CLASSES) {
+            return;
+        }
+    } else if (mClasses[cls].empty()) {
+        return;
+    }
+
+    List<pool_entry_t>::iterator it = mClasses[cls].begin();
+    freeList.push_back((*it).buf);
+    mCachedBytes -= (*it).buf.size;
+    mClasses[cls].erase(it);
+    mClassCount[cls]--;
+    mCachedCount--;
+    mEvictions++;
+}
+
+/*===========================================================================
+ * FUNCTION   : trimLocked
+ *
+ * DESCRIPTION: evict buffers until the pool is within the given limits
+ *
+ * PARAMETERS :
+ *   @maxBytes    : max total bytes to keep
+ *   @cls         : size class to check against maxPerClass, or
+ *                  NUM_SIZE_CLASSES for none
+ *   @maxPerClass : max buffers to keep in cls
+ *   @freeList    : [output] buffers to be freed outside the lock
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::trimLocked(size_t maxBytes, uint32_t cls,
+        uint32_t maxPerClass, List<qcamera_ion_buf_t> &freeList)
+{
+    if (cls < NUM_SIZE_CLASSES) {
+        while (mClassCount[cls] > maxPerClass) {
+            evictLocked(cls, freeList);
+        }
+    }
+    while (mCachedBytes > maxBytes && mCachedCount > 0) {
+        evictLocked(NUM_SIZE_CLASSES, freeList);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : freeList
+ *
+ * DESCRIPTION: free all buffers of a list
+ *
+ * PARAMETERS :
+ *   @list    : buffers to be freed
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::freeList(List<qcamera_ion_buf_t> &list)
+{
+    List<qcamera_ion_buf_t>::iterator it = list.begin();
+    for (; it != list.end(); it++) {
+        freeIonBuffer(*it);
+    }
+    list.clear();
+}
+
+/*===========================================================================
+ * FUNCTION   : setHighWaterMarks
+ *
+ * DESCRIPTION: change the pool limits, trimming it if needed
+ *
+ * PARAMETERS :
+ *   @maxBytes    : max total bytes kept in the pool
+ *   @maxPerClass : max buffers kept per size class
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::setHighWaterMarks(size_t maxBytes, uint32_t maxPerClass)
+{
+    List<qcamera_ion_buf_t> toFree;
+
+    pthread_mutex_lock(&mLock);
+    mMaxBytes = maxBytes;
+    mMaxPerClass = maxPerClass;
+    for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        trimLocked(mMaxBytes, i, mMaxPerClass, toFree);
+    }
+    pthread_mutex_unlock(&mLock);
+
+    freeList(toFree);
+}
+
+/*===========================================================================
+ * FUNCTION   : trim
+ *
+ * DESCRIPTION: free least recently released buffers until at most maxBytes
+ *              are pooled, e.g. on memory pressure. trim(0) empties the pool
+ *
+ * PARAMETERS :
+ *   @maxBytes : max total bytes to keep
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::trim(size_t maxBytes)
+{
+    List<qcamera_ion_buf_t> toFree;
+
+    pthread_mutex_lock(&mLock);
+    trimLocked(maxBytes, NUM_SIZE_CLASSES, 0, toFree);
+    pthread_mutex_unlock(&mLock);
+
+    freeList(toFree);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print pool statistics and occupancy
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to print to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraIonPool::dump(int fd)
+{
+    pthread_mutex_lock(&mLock);
+    dprintf(fd, "\nIon buffer pool: %u buffers, %zu KB cached (peak %zu KB,"
+            " limit %zu KB, %u per class)\n",
+            mCachedCount, mCachedBytes >> 10, mPeakCachedBytes >> 10,
+            mMaxBytes >> 10, mMaxPerClass);
+    dprintf(fd, "hits %u misses %u evictions %u pressure trims %u,"
+            " reused %llu KB allocated %llu KB\n",
+            mHits, mMisses, mEvictions, mPressureTrims,
+            (unsigned long long)(mReusedBytes >> 10),
+            (unsigned long long)(mAllocatedBytes >> 10));
+    for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        if (mClassCount[i] > 0) {
+            dprintf(fd, "  >= %8zu KB: %u\n", sizeClassBase(i) >> 10,
+                    mClassCount[i]);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+}; // namespace qcamera
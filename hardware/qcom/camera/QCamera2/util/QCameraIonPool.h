@@ -0,0 +1,129 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_ION_POOL_H__
+#define __QCAMERA_ION_POOL_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/List.h>
+
+extern "C" {
+#include <sys/types.h>
+#include <linux/msm_ion.h>
+}
+
+namespace qcamera {
+
+/* releases an owner specific CPU mapping of a pooled buffer */
+typedef void (*qcamera_ion_unmap_fn)(void *mapping, void *vaddr, size_t size);
+
+typedef struct {
+    int fd;
+    int main_ion_fd;
+    ion_user_handle_t handle;
+    size_t size;                 // allocated size, page aligned
+    bool cached;
+    unsigned int heap_id;
+    uint32_t secure_mode;
+    /* CPU mapping kept alive while the buffer sits in the pool. Either a
+     * plain mmap (mapping == NULL, unmap == NULL) or an owner specific
+     * object released through unmap. */
+    void *vaddr;
+    void *mapping;
+    qcamera_ion_unmap_fn unmap;
+} qcamera_ion_buf_t;
+
+/* Recycling pool of ion buffers shared by the stream memory objects of one
+ * camera session. Released buffers are kept together with their fds and
+ * CPU mappings, bucketed by size class and matched on heap, cache and
+ * secure flags, so restarting streams with similar sizes skips the
+ * ION_IOC_ALLOC/SHARE and mmap round trips. The pool is bounded by a total
+ * byte and a per size class count high-water mark (least recently released
+ * buffers go first), and is emptied when an allocation fails. */
+class QCameraIonPool {
+public:
+    QCameraIonPool();
+    virtual ~QCameraIonPool();
+
+    int allocateBuffer(qcamera_ion_buf_t &buf, unsigned int heap_id,
+            size_t size, bool cached, uint32_t secure_mode,
+            bool *reused = NULL);
+    void releaseBuffer(qcamera_ion_buf_t &buf);
+    void setHighWaterMarks(size_t maxBytes, uint32_t maxPerClass);
+    void trim(size_t maxBytes);
+    void clear() { trim(0); }
+    void dump(int fd);
+
+    static int allocIonBuffer(qcamera_ion_buf_t &buf, unsigned int heap_id,
+            size_t size, bool cached, uint32_t secure_mode);
+    static void freeIonBuffer(qcamera_ion_buf_t &buf);
+    static void *takeMapping(qcamera_ion_buf_t &buf, qcamera_ion_unmap_fn unmap);
+
+private:
+    // 4 classes per power of two of the page count
+    static const uint32_t NUM_SIZE_CLASSES = 4 * 24;
+
+    typedef struct {
+        qcamera_ion_buf_t buf;
+        uint64_t seq;            // release order, for LRU trimming
+    } pool_entry_t;
+
+    static uint32_t sizeClassOf(size_t size);
+    static size_t sizeClassBase(uint32_t cls);
+    bool findBufferLocked(qcamera_ion_buf_t &buf, unsigned int heap_id,
+            size_t size, bool cached, uint32_t secure_mode);
+    void evictLocked(uint32_t cls, android::List<qcamera_ion_buf_t> &freeList);
+    void trimLocked(size_t maxBytes, uint32_t cls, uint32_t maxPerClass,
+            android::List<qcamera_ion_buf_t> &freeList);
+    static void freeList(android::List<qcamera_ion_buf_t> &list);
+
+    android::List<pool_entry_t> mClasses[NUM_SIZE_CLASSES];
+    uint32_t mClassCount[NUM_SIZE_CLASSES];
+    size_t mMaxBytes;
+    uint32_t mMaxPerClass;
+    size_t mCachedBytes;
+    size_t mPeakCachedBytes;
+    uint32_t mCachedCount;
+    uint64_t mSeq;
+
+    // statistics
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mEvictions;
+    uint32_t mPressureTrims;
+    uint64_t mReusedBytes;
+    uint64_t mAllocatedBytes;
+
+    pthread_mutex_t mLock;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_ION_POOL_H__ */
@@ -0,0 +1,86 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <string.h>
+#include "QCameraParamDiff.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : diff
+ *
+ * DESCRIPTION: report keys whose values differ between two flattened
+ *              parameter strings with identical key order
+ *
+ * PARAMETERS :
+ *   @cur        : current flattened parameters
+ *   @next       : new flattened parameters
+ *   @changed_fn : called for each changed key
+ *   @user_data  : passed to changed_fn
+ *
+ * RETURN     : true  -- every changed key has been reported
+ *              false -- key sequences differ
+ *==========================================================================*/
+bool QCameraParamDiff::diff(const char *cur, const char *next,
+        param_changed_fn changed_fn, void *user_data)
+{
+    if (NULL == cur || NULL == next) {
+        return false;
+    }
+
+    while (*cur != '\0' || *next != '\0') {
+        const char *curEq = strchr(cur, '=');
+        const char *nextEq = strchr(next, '=');
+        if (NULL == curEq || NULL == nextEq) {
+            // Trailing junk without a value on either side
+            return (NULL == curEq && NULL == nextEq);
+        }
+        size_t keyLen = (size_t)(curEq - cur);
+        if (keyLen != (size_t)(nextEq - next) ||
+                memcmp(cur, next, keyLen) != 0) {
+            return false;
+        }
+
+        const char *curVal = curEq + 1;
+        const char *nextVal = nextEq + 1;
+        size_t curLen = strcspn(curVal, ";");
+        size_t nextLen = strcspn(nextVal, ";");
+        if (curLen != nextLen || memcmp(curVal, nextVal, curLen) != 0) {
+            changed_fn(cur, keyLen, user_data);
+        }
+
+        cur = curVal + curLen;
+        next = nextVal + nextLen;
+        if (*cur == ';') cur++;
+        if (*next == ';') next++;
+    }
+    return true;
+}
+
+}; // namespace qcamera
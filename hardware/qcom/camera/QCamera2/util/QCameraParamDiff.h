@@ -0,0 +1,57 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_PARAM_DIFF_H__
+#define __QCAMERA_PARAM_DIFF_H__
+
+#include <stddef.h>
+
+namespace qcamera {
+
+/* called once per key whose value differs; key is not NUL terminated */
+typedef void (*param_changed_fn)(const char *key, size_t keyLen,
+        void *user_data);
+
+/* Compares two flattened CameraParameters strings ("k1=v1;k2=v2;...")
+ * pair by pair, in place. Applications hand back the string they got from
+ * getParameters() with a few values edited, so in the common case both
+ * strings carry the same keys in the same order and only the changed
+ * values need to be looked at. */
+class QCameraParamDiff {
+public:
+    /* Returns false if the key sequences differ (key added, removed or
+     * reordered); changes reported before that point are incomplete and
+     * the caller has to treat every key as changed. */
+    static bool diff(const char *cur, const char *next,
+            param_changed_fn changed_fn, void *user_data);
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_PARAM_DIFF_H__ */
@@ -0,0 +1,694 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include "QCameraRingQueue.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraRingQueue
+ *
+ * DESCRIPTION: constructor of QCameraRingQueue without release function
+ *
+ * PARAMETERS :
+ *   @capacity : max number of entries, rounded up to a power of two
+ *   @mode     : SPSC or MPSC producer mode
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraRingQueue::QCameraRingQueue(uint32_t capacity,
+        qcamera_ring_q_mode_t mode)
+{
+    m_mode = mode;
+    m_dataFn = NULL;
+    m_userData = NULL;
+    initRings(capacity);
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraRingQueue
+ *
+ * DESCRIPTION: constructor of QCameraRingQueue
+ *
+ * PARAMETERS :
+ *   @capacity    : max number of entries, rounded up to a power of two
+ *   @data_rel_fn : function ptr to release node data internal resource
+ *   @user_data   : user data ptr
+ *   @mode        : SPSC or MPSC producer mode
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraRingQueue::QCameraRingQueue(uint32_t capacity,
+        release_data_fn data_rel_fn, void *user_data,
+        qcamera_ring_q_mode_t mode)
+{
+    m_mode = mode;
+    m_dataFn = data_rel_fn;
+    m_userData = user_data;
+    initRings(capacity);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraRingQueue
+ *
+ * DESCRIPTION: deconstructor of QCameraRingQueue
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraRingQueue::~QCameraRingQueue()
+{
+    flush();
+    if (m_waitFd >= 0) {
+        close(m_waitFd);
+        m_waitFd = -1;
+    }
+    free(m_ring.slots);
+    free(m_prioRing.slots);
+    pthread_mutex_destroy(&m_consumerLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : initRings
+ *
+ * DESCRIPTION: preallocate ring storage and the wakeup eventfd
+ *
+ * PARAMETERS :
+ *   @capacity : requested number of entries
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::initRings(uint32_t capacity)
+{
+    uint32_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_capacity = size;
+
+    ring_t *rings[] = {&m_ring, &m_prioRing};
+    for (uint32_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+        ring_t *ring = rings[i];
+        ring->slots = (ring_slot_t *)calloc(size, sizeof(ring_slot_t));
+        if (NULL == ring->slots) {
+            ALOGE("%s: No memory for ring slots", __func__);
+            ring->mask = 0;
+        } else {
+            ring->mask = size - 1;
+            for (uint32_t j = 0; j < size; j++) {
+                ring->slots[j].seq = j;
+            }
+        }
+        ring->head = 0;
+        ring->tail = 0;
+    }
+
+    m_size = 0;
+    m_producers = 0;
+    m_waiting = 0;
+    m_interrupted = 0;
+    m_active = (NULL != m_ring.slots) && (NULL != m_prioRing.slots);
+    m_waitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_waitFd < 0) {
+        ALOGE("%s: eventfd failed (%s)", __func__, strerror(errno));
+    }
+    pthread_mutex_init(&m_consumerLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: Put the queue to active state (ready to enqueue and dequeue)
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::init()
+{
+    pthread_mutex_lock(&m_consumerLock);
+    if ((NULL != m_ring.slots) && (NULL != m_prioRing.slots)) {
+        __atomic_store_n(&m_active, 1, __ATOMIC_SEQ_CST);
+    }
+    if (__atomic_exchange_n(&m_interrupted, 0, __ATOMIC_SEQ_CST) &&
+            (m_waitFd >= 0)) {
+        // drop the wakeup left behind by interrupt()
+        uint64_t val;
+        if (read(m_waitFd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+            ALOGE("%s: eventfd read failed (%s)", __func__, strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&m_consumerLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : isEmpty
+ *
+ * DESCRIPTION: return if the queue is empty or not
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- queue is empty; false -- not empty
+ *==========================================================================*/
+bool QCameraRingQueue::isEmpty()
+{
+    return __atomic_load_n(&m_size, __ATOMIC_SEQ_CST) <= 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : push
+ *
+ * DESCRIPTION: claim the next free slot of a ring and publish data into it.
+ *              In MPSC mode the tail is claimed with a CAS, in SPSC mode
+ *              the single producer owns the tail.
+ *
+ * PARAMETERS :
+ *   @ring    : ring to push into
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- ring is full
+ *==========================================================================*/
+bool QCameraRingQueue::push(ring_t *ring, void *data)
+{
+    ring_slot_t *slot;
+    uint32_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        slot = &ring->slots[pos & ring->mask];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (m_mode == QCAMERA_RING_Q_SPSC) {
+                __atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELAXED);
+                break;
+            }
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->data = data;
+    __atomic_add_fetch(&m_size, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : wake
+ *
+ * DESCRIPTION: signal the consumer if it is parked in waitForData. No
+ *              syscall is made while the consumer is running.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::wake()
+{
+    if (__atomic_load_n(&m_waiting, __ATOMIC_SEQ_CST) &&
+            __atomic_exchange_n(&m_waiting, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t val = 1;
+        if (write(m_waitFd, &val, sizeof(val)) != sizeof(val)) {
+            ALOGE("%s: eventfd write failed (%s)", __func__, strerror(errno));
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueue
+ *
+ * DESCRIPTION: enqueue data into the queue
+ *
+ * PARAMETERS :
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- failed (inactive or full)
+ *==========================================================================*/
+bool QCameraRingQueue::enqueue(void *data)
+{
+    bool rc = false;
+
+    if (NULL == data) {
+        return false;
+    }
+
+    __atomic_add_fetch(&m_producers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        rc = push(&m_ring, data);
+    }
+    __atomic_sub_fetch(&m_producers, 1, __ATOMIC_RELEASE);
+
+    if (rc) {
+        wake();
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : enqueueWithPriority
+ *
+ * DESCRIPTION: enqueue data into queue with priority. Priority entries are
+ *              dequeued ahead of all normal entries, in FIFO order among
+ *              themselves.
+ *
+ * PARAMETERS :
+ *   @data    : data to be enqueued
+ *
+ * RETURN     : true -- success; false -- failed (inactive or full)
+ *==========================================================================*/
+bool QCameraRingQueue::enqueueWithPriority(void *data)
+{
+    bool rc = false;
+
+    if (NULL == data) {
+        return false;
+    }
+
+    __atomic_add_fetch(&m_producers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        rc = push(&m_prioRing, data);
+    }
+    __atomic_sub_fetch(&m_producers, 1, __ATOMIC_RELEASE);
+
+    if (rc) {
+        wake();
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : popHead
+ *
+ * DESCRIPTION: consume the oldest published entry of a ring, skipping
+ *              tombstones. Caller must hold m_consumerLock.
+ *
+ * PARAMETERS :
+ *   @ring    : ring to pop from
+ *
+ * RETURN     : data ptr. NULL if no published data in the ring.
+ *==========================================================================*/
+void* QCameraRingQueue::popHead(ring_t *ring)
+{
+    for (;;) {
+        uint32_t pos = ring->head;
+        ring_slot_t *slot = &ring->slots[pos & ring->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            return NULL;
+        }
+        void *data = slot->data;
+        slot->data = NULL;
+        __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+        ring->head = pos + 1;
+        if (NULL != data) {
+            __atomic_sub_fetch(&m_size, 1, __ATOMIC_SEQ_CST);
+            return data;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : peekHead
+ *
+ * DESCRIPTION: return the oldest published entry of a ring without removing
+ *              it. Leading tombstones are retired on the way. Caller must
+ *              hold m_consumerLock.
+ *
+ * PARAMETERS :
+ *   @ring    : ring to peek into
+ *
+ * RETURN     : data ptr. NULL if no published data in the ring.
+ *==========================================================================*/
+void* QCameraRingQueue::peekHead(ring_t *ring)
+{
+    for (;;) {
+        uint32_t pos = ring->head;
+        ring_slot_t *slot = &ring->slots[pos & ring->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            return NULL;
+        }
+        if (NULL != slot->data) {
+            return slot->data;
+        }
+        __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+        ring->head = pos + 1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : popTail
+ *
+ * DESCRIPTION: remove the newest published entry of a ring by tombstoning
+ *              its slot. Caller must hold m_consumerLock.
+ *
+ * PARAMETERS :
+ *   @ring    : ring to pop from
+ *
+ * RETURN     : data ptr. NULL if no published data in the ring.
+ *==========================================================================*/
+void* QCameraRingQueue::popTail(ring_t *ring)
+{
+    ring_slot_t *last = NULL;
+
+    for (uint32_t pos = ring->head; ; pos++) {
+        ring_slot_t *slot = &ring->slots[pos & ring->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+        if (NULL != slot->data) {
+            last = slot;
+        }
+    }
+
+    if (NULL == last) {
+        return NULL;
+    }
+    void *data = last->data;
+    last->data = NULL;
+    __atomic_sub_fetch(&m_size, 1, __ATOMIC_SEQ_CST);
+    return data;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseData
+ *
+ * DESCRIPTION: release internal resources of node data and free it
+ *
+ * PARAMETERS :
+ *   @data    : node data
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::releaseData(void *data)
+{
+    if (m_dataFn) {
+        m_dataFn(data, m_userData);
+    }
+    free(data);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushRing
+ *
+ * DESCRIPTION: release published entries of a ring. Caller must hold
+ *              m_consumerLock.
+ *
+ * PARAMETERS :
+ *   @ring       : ring to flush
+ *   @match      : matching function, may be NULL
+ *   @match_data : matching function with spec data, may be NULL
+ *   @spec_data  : spec data passed to match_data
+ *   @flushAll   : if true, all entries are released regardless of match
+ *
+ * RETURN     : number of released entries
+ *==========================================================================*/
+uint32_t QCameraRingQueue::flushRing(ring_t *ring, match_fn match,
+        match_fn_data match_data, void *spec_data, bool flushAll)
+{
+    uint32_t cnt = 0;
+
+    if (flushAll) {
+        void *data;
+        while (NULL != (data = popHead(ring))) {
+            releaseData(data);
+            cnt++;
+        }
+        return cnt;
+    }
+
+    for (uint32_t pos = ring->head; ; pos++) {
+        ring_slot_t *slot = &ring->slots[pos & ring->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+        void *data = slot->data;
+        if (NULL == data) {
+            continue;
+        }
+        bool matched = (NULL != match) ? match(data, m_userData) :
+                match_data(data, m_userData, spec_data);
+        if (matched) {
+            slot->data = NULL;
+            __atomic_sub_fetch(&m_size, 1, __ATOMIC_SEQ_CST);
+            releaseData(data);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/*===========================================================================
+ * FUNCTION   : peek
+ *
+ * DESCRIPTION: return the head element without removing it
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : data ptr. NULL if not any data in the queue.
+ *==========================================================================*/
+void* QCameraRingQueue::peek()
+{
+    void *data = NULL;
+
+    pthread_mutex_lock(&m_consumerLock);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        data = peekHead(&m_prioRing);
+        if (NULL == data) {
+            data = peekHead(&m_ring);
+        }
+    }
+    pthread_mutex_unlock(&m_consumerLock);
+
+    return data;
+}
+
+/*===========================================================================
+ * FUNCTION   : dequeue
+ *
+ * DESCRIPTION: dequeue data from the queue
+ *
+ * PARAMETERS :
+ *   @bFromHead : if true, dequeue from the head
+ *                if false, dequeue from the tail
+ *
+ * RETURN     : data ptr. NULL if not any data in the queue.
+ *==========================================================================*/
+void* QCameraRingQueue::dequeue(bool bFromHead)
+{
+    void *data = NULL;
+
+    pthread_mutex_lock(&m_consumerLock);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        if (bFromHead) {
+            data = popHead(&m_prioRing);
+            if (NULL == data) {
+                data = popHead(&m_ring);
+            }
+        } else {
+            data = popTail(&m_ring);
+            if (NULL == data) {
+                data = popTail(&m_prioRing);
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_consumerLock);
+
+    return data;
+}
+
+/*===========================================================================
+ * FUNCTION   : waitForData
+ *
+ * DESCRIPTION: park the consumer until data is available or timeout
+ *
+ * PARAMETERS :
+ *   @timeout_ms : timeout in ms, -1 to wait forever
+ *
+ * RETURN     : true -- data available; false -- timeout or error
+ *==========================================================================*/
+bool QCameraRingQueue::waitForData(int timeout_ms)
+{
+    if (!isEmpty()) {
+        return true;
+    }
+    if ((m_waitFd < 0) || isInterrupted()) {
+        return false;
+    }
+
+    __atomic_store_n(&m_waiting, 1, __ATOMIC_SEQ_CST);
+    if (isEmpty() && !isInterrupted()) {
+        struct pollfd pfd;
+        pfd.fd = m_waitFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int rc = poll(&pfd, 1, timeout_ms);
+        if (rc > 0) {
+            uint64_t val;
+            if (read(m_waitFd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+                ALOGE("%s: eventfd read failed (%s)", __func__, strerror(errno));
+            }
+        } else if (rc < 0 && errno != EINTR) {
+            ALOGE("%s: poll failed (%s)", __func__, strerror(errno));
+        }
+    }
+    __atomic_store_n(&m_waiting, 0, __ATOMIC_SEQ_CST);
+
+    return !isEmpty();
+}
+
+/*===========================================================================
+ * FUNCTION   : interrupt
+ *
+ * DESCRIPTION: wake the consumer up and keep waitForData from waiting until
+ *              the queue is initialized again
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::interrupt()
+{
+    __atomic_store_n(&m_interrupted, 1, __ATOMIC_SEQ_CST);
+    if (m_waitFd >= 0) {
+        // the consumer may be between its interrupt check and poll, so
+        // always leave a wakeup behind
+        uint64_t val = 1;
+        if (write(m_waitFd, &val, sizeof(val)) != sizeof(val)) {
+            ALOGE("%s: eventfd write failed (%s)", __func__, strerror(errno));
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : isInterrupted
+ *
+ * DESCRIPTION: return if interrupt() was called since the last init()
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- interrupted; false -- not interrupted
+ *==========================================================================*/
+bool QCameraRingQueue::isInterrupted()
+{
+    return __atomic_load_n(&m_interrupted, __ATOMIC_SEQ_CST) != 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : flush
+ *
+ * DESCRIPTION: flush all nodes from the queue, queue will be empty after this
+ *              operation.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::flush()
+{
+    pthread_mutex_lock(&m_consumerLock);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&m_active, 0, __ATOMIC_SEQ_CST);
+        /* let producers that passed the active check finish publishing */
+        while (__atomic_load_n(&m_producers, __ATOMIC_ACQUIRE) > 0) {
+            sched_yield();
+        }
+        flushRing(&m_prioRing, NULL, NULL, NULL, true);
+        flushRing(&m_ring, NULL, NULL, NULL, true);
+        __atomic_store_n(&m_size, 0, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&m_consumerLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushNodes
+ *
+ * DESCRIPTION: flush only specific nodes, depending on
+ *              the given matching function.
+ *
+ * PARAMETERS :
+ *   @match   : matching function
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::flushNodes(match_fn match)
+{
+    if (NULL == match) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_consumerLock);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        flushRing(&m_prioRing, match, NULL, NULL, false);
+        flushRing(&m_ring, match, NULL, NULL, false);
+    }
+    pthread_mutex_unlock(&m_consumerLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushNodes
+ *
+ * DESCRIPTION: flush only specific nodes, depending on
+ *              the given matching function.
+ *
+ * PARAMETERS :
+ *   @match     : matching function
+ *   @spec_data : data passed to the matching function
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraRingQueue::flushNodes(match_fn_data match, void *spec_data)
+{
+    if (NULL == match) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_consumerLock);
+    if (__atomic_load_n(&m_active, __ATOMIC_SEQ_CST)) {
+        flushRing(&m_prioRing, NULL, match, spec_data, false);
+        flushRing(&m_ring, NULL, match, spec_data, false);
+    }
+    pthread_mutex_unlock(&m_consumerLock);
+}
+
+}; // namespace qcamera
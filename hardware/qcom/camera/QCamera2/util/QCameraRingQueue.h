@@ -0,0 +1,118 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_RING_QUEUE_H__
+#define __QCAMERA_RING_QUEUE_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include "QCameraQueue.h"
+
+namespace qcamera {
+
+typedef enum {
+    QCAMERA_RING_Q_SPSC,  /* single producer, single consumer */
+    QCAMERA_RING_Q_MPSC,  /* multiple producers, single consumer */
+} qcamera_ring_q_mode_t;
+
+/* Bounded, preallocated counterpart of QCameraQueue for per-frame data
+ * paths. Producers never take a lock or allocate; the consumer side
+ * (dequeue/peek/flush*) is serialized by a mutex that is uncontended as
+ * long as there is a single consumer thread. Entries removed out of order
+ * (flushNodes, dequeue from tail) are tombstoned in place and skipped. */
+class QCameraRingQueue {
+public:
+    QCameraRingQueue(uint32_t capacity,
+            qcamera_ring_q_mode_t mode = QCAMERA_RING_Q_MPSC);
+    QCameraRingQueue(uint32_t capacity, release_data_fn data_rel_fn,
+            void *user_data, qcamera_ring_q_mode_t mode = QCAMERA_RING_Q_MPSC);
+    virtual ~QCameraRingQueue();
+    void init();
+    bool enqueue(void *data);
+    bool enqueueWithPriority(void *data);
+    /* This call will put queue into uninitialized state.
+     * Need to call init() in order to use the queue again */
+    void flush();
+    void flushNodes(match_fn match);
+    void flushNodes(match_fn_data match, void *spec_data);
+    void* dequeue(bool bFromHead = true);
+    void* peek();
+    bool isEmpty();
+    int getCurrentSize() {return __atomic_load_n(&m_size, __ATOMIC_ACQUIRE);}
+    uint32_t getCapacity() const {return m_capacity;}
+
+    /* eventfd based wakeup, only signalled while the consumer is parked */
+    int getWaitFd() const {return m_waitFd;}
+    bool waitForData(int timeout_ms);
+    /* Makes waitForData return without waiting until init() is called
+     * again, so the consumer can move on to other work such as exiting */
+    void interrupt();
+    bool isInterrupted();
+
+private:
+    typedef struct {
+        uint32_t seq;
+        void *data;
+    } ring_slot_t;
+
+    typedef struct {
+        ring_slot_t *slots;
+        uint32_t mask;
+        uint32_t head;               // consumer owned
+        uint32_t tail __attribute__((aligned(64))); // producer claimed
+    } ring_t;
+
+    void initRings(uint32_t capacity);
+    bool push(ring_t *ring, void *data);
+    void* popHead(ring_t *ring);
+    void* popTail(ring_t *ring);
+    void* peekHead(ring_t *ring);
+    uint32_t flushRing(ring_t *ring, match_fn match, match_fn_data match_data,
+            void *spec_data, bool flushAll);
+    void releaseData(void *data);
+    void wake();
+
+    ring_t m_ring;              // normal entries
+    ring_t m_prioRing;          // entries enqueued with priority
+    uint32_t m_capacity;
+    qcamera_ring_q_mode_t m_mode;
+    int m_size;
+    int m_active;
+    int m_producers;            // producers between active check and publish
+    int m_waiting;              // consumer parked on m_waitFd
+    int m_interrupted;          // set by interrupt(), cleared by init()
+    int m_waitFd;
+    pthread_mutex_t m_consumerLock;
+    release_data_fn m_dataFn;
+    void * m_userData;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_RING_QUEUE_H__ */
@@ -0,0 +1,48 @@
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+# Queue benchmark: qcamera-queue-bench
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_SRC_FILES := \
+        QCameraQueueBench.cpp \
+        ../QCameraQueue.cpp \
+        ../QCameraRingQueue.cpp
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/.. \
+        $(LOCAL_PATH)/../../stack/common
+
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils
+
+LOCAL_MODULE := qcamera-queue-bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+include $(BUILD_EXECUTABLE)
+
+# Fence waiter test with sw_sync timelines: qcamera-fence-waiter-test
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_SRC_FILES := \
+        QCameraFenceWaiterTest.cpp \
+        ../QCameraFenceWaiter.cpp
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/.. \
+        $(LOCAL_PATH)/../../stack/common \
+        system/core/libsync
+
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libsync
+
+LOCAL_MODULE := qcamera-fence-waiter-test
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+include $(BUILD_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
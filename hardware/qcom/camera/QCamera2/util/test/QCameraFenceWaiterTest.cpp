@@ -0,0 +1,369 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+/* Exercises QCameraFenceWaiter against sw_sync timelines standing in for
+ * display/encoder consumers that release buffers late. Needs a kernel
+ * with CONFIG_SW_SYNC.
+ *
+ * usage: qcamera-fence-waiter-test [-n requests] [-d consumer delay us]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sw_sync.h>
+#include <utils/Errors.h>
+#include "QCameraFenceWaiter.h"
+
+using namespace android;
+using namespace qcamera;
+
+#define TEST_MAX_REQUESTS 256
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t signaled[TEST_MAX_REQUESTS];
+    int32_t status[TEST_MAX_REQUESTS];
+    uint64_t signal_ns[TEST_MAX_REQUESTS];
+    uint32_t order[TEST_MAX_REQUESTS];
+    uint32_t num_signaled;
+    uint32_t num_released;
+    uint32_t order_errors;
+    uint32_t last_signaled;
+} test_ctx_t;
+
+typedef struct {
+    int timeline;
+    uint32_t count;
+    uint32_t delay_us;
+    uint64_t *release_ns;
+} consumer_t;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void test_signaled(int32_t status, void *data, void *user_data)
+{
+    test_ctx_t *ctx = (test_ctx_t *)user_data;
+    uint32_t idx = (uint32_t)(uintptr_t)data;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->signaled[idx]++;
+    ctx->status[idx] = status;
+    ctx->signal_ns[idx] = now_ns();
+    if (ctx->num_signaled > 0 && idx < ctx->last_signaled) {
+        ctx->order_errors++;
+    }
+    ctx->last_signaled = idx;
+    ctx->order[ctx->num_signaled] = idx;
+    ctx->num_signaled++;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void test_release(void *data, void *user_data)
+{
+    test_ctx_t *ctx = (test_ctx_t *)user_data;
+    (void)data;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->num_released++;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void reset_ctx(test_ctx_t *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    memset(ctx->signaled, 0, sizeof(ctx->signaled));
+    memset(ctx->status, 0, sizeof(ctx->status));
+    memset(ctx->signal_ns, 0, sizeof(ctx->signal_ns));
+    memset(ctx->order, 0, sizeof(ctx->order));
+    ctx->num_signaled = 0;
+    ctx->num_released = 0;
+    ctx->order_errors = 0;
+    ctx->last_signaled = 0;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static uint32_t get_signaled(test_ctx_t *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    uint32_t n = ctx->num_signaled;
+    pthread_mutex_unlock(&ctx->lock);
+    return n;
+}
+
+static bool wait_signaled(test_ctx_t *ctx, uint32_t n, uint32_t timeout_ms)
+{
+    uint64_t deadline = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    while (get_signaled(ctx) < n) {
+        if (now_ns() > deadline) {
+            return false;
+        }
+        usleep(500);
+    }
+    return true;
+}
+
+/* Releases one buffer per delay_us, in order, like a display consumer
+ * that is slower than the camera */
+static void *consumer_routine(void *data)
+{
+    consumer_t *c = (consumer_t *)data;
+    for (uint32_t i = 0; i < c->count; i++) {
+        usleep(c->delay_us);
+        c->release_ns[i] = now_ns();
+        sw_sync_timeline_inc(c->timeline, 1);
+    }
+    return NULL;
+}
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("  FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return false; \
+        } \
+    } while (0)
+
+/* A fence that signals later must not be reported early, and must be
+ * reported once it signals */
+static bool test_single(QCameraFenceWaiter &waiter, test_ctx_t *ctx)
+{
+    reset_ctx(ctx);
+    int timeline = sw_sync_timeline_create();
+    CHECK(timeline >= 0, "no sw_sync timeline");
+    int fence = sw_sync_fence_create(timeline, "single", 1);
+    CHECK(fence >= 0, "fence create failed");
+
+    CHECK(waiter.waitAsync(fence, (void *)0) == NO_ERROR, "waitAsync failed");
+    usleep(20000);
+    CHECK(get_signaled(ctx) == 0, "signaled before the timeline advanced");
+    CHECK(waiter.getPendingCount() == 1, "pending %u", waiter.getPendingCount());
+
+    sw_sync_timeline_inc(timeline, 1);
+    CHECK(wait_signaled(ctx, 1, 1000), "no signal after timeline advanced");
+    CHECK(ctx->status[0] == NO_ERROR, "status %d", ctx->status[0]);
+    CHECK(waiter.getPendingCount() == 0, "pending %u", waiter.getPendingCount());
+    close(timeline);
+    return true;
+}
+
+/* Requests are submitted back to back against a consumer releasing one
+ * buffer every delay_us. Submission must not be paced by the consumer and
+ * every buffer must be handed back in fence order shortly after release. */
+static bool test_late_consumer(QCameraFenceWaiter &waiter, test_ctx_t *ctx,
+        uint32_t count, uint32_t delay_us)
+{
+    uint64_t release_ns[TEST_MAX_REQUESTS];
+    consumer_t consumer;
+    pthread_t tid;
+
+    reset_ctx(ctx);
+    int timeline = sw_sync_timeline_create();
+    CHECK(timeline >= 0, "no sw_sync timeline");
+
+    memset(release_ns, 0, sizeof(release_ns));
+    consumer.timeline = timeline;
+    consumer.count = count;
+    consumer.delay_us = delay_us;
+    consumer.release_ns = release_ns;
+    pthread_create(&tid, NULL, consumer_routine, &consumer);
+
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "late-%u", i);
+        int fence = sw_sync_fence_create(timeline, name, i + 1);
+        CHECK(fence >= 0, "fence create failed");
+        CHECK(waiter.waitAsync(fence, (void *)(uintptr_t)i) == NO_ERROR,
+                "waitAsync failed");
+    }
+    uint64_t submit_ns = now_ns() - start;
+
+    bool done = wait_signaled(ctx, count, count * delay_us / 1000 + 1000);
+    pthread_join(tid, NULL);
+    CHECK(done, "only %u of %u signaled", get_signaled(ctx), count);
+    // Blocking waits would take count * delay_us
+    CHECK(submit_ns < (uint64_t)count * delay_us * 1000ULL / 4,
+            "submission took %llu us, consumer delay is %u us",
+            (unsigned long long)(submit_ns / 1000), delay_us);
+    CHECK(ctx->order_errors == 0, "%u out of order signals", ctx->order_errors);
+
+    uint64_t max_lag = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        CHECK(ctx->signaled[i] == 1, "buffer %u signaled %u times", i,
+                ctx->signaled[i]);
+        CHECK(ctx->signal_ns[i] >= release_ns[i], "buffer %u signaled early", i);
+        uint64_t lag = ctx->signal_ns[i] - release_ns[i];
+        if (lag > max_lag) {
+            max_lag = lag;
+        }
+    }
+    printf("  %u requests submitted in %llu us, consumer %u us/buffer,"
+            " max signal lag %llu us\n", count,
+            (unsigned long long)(submit_ns / 1000), delay_us,
+            (unsigned long long)(max_lag / 1000));
+    close(timeline);
+    return true;
+}
+
+/* Two requests on one stream whose fences signal in reverse order, like
+ * buffers from two consumers. Buffers of a stream must still come back in
+ * submission order, including a buffer that had no fence to wait for,
+ * while another stream is not held back. */
+static bool test_stream_order(QCameraFenceWaiter &waiter, test_ctx_t *ctx)
+{
+    const uint64_t stream = 1, other_stream = 2;
+
+    reset_ctx(ctx);
+    int timeline0 = sw_sync_timeline_create();
+    int timeline1 = sw_sync_timeline_create();
+    CHECK(timeline0 >= 0 && timeline1 >= 0, "no sw_sync timeline");
+    int fence0 = sw_sync_fence_create(timeline0, "order-0", 1);
+    int fence1 = sw_sync_fence_create(timeline1, "order-1", 1);
+    int fence3 = sw_sync_fence_create(timeline1, "order-3", 1);
+    CHECK(fence0 >= 0 && fence1 >= 0 && fence3 >= 0, "fence create failed");
+
+    CHECK(waiter.waitAsync(fence0, (void *)0, stream) == NO_ERROR,
+            "waitAsync failed");
+    CHECK(waiter.waitAsync(fence1, (void *)1, stream) == NO_ERROR,
+            "waitAsync failed");
+    CHECK(waiter.waitAsync(-1, (void *)2, stream) == NO_ERROR,
+            "waitAsync without fence failed");
+    CHECK(waiter.waitAsync(fence3, (void *)3, other_stream) == NO_ERROR,
+            "waitAsync failed");
+    CHECK(waiter.waitAsync(-1, (void *)4) == BAD_VALUE,
+            "waitAsync without fence or order key accepted");
+
+    // Second request's fence signals first
+    sw_sync_timeline_inc(timeline1, 1);
+    CHECK(wait_signaled(ctx, 1, 1000), "other stream held back");
+    usleep(20000);
+    CHECK(get_signaled(ctx) == 1, "%u signaled before the first fence",
+            get_signaled(ctx));
+    CHECK(ctx->order[0] == 3, "buffer %u signaled first", ctx->order[0]);
+    CHECK(waiter.getPendingCount() == 3, "pending %u", waiter.getPendingCount());
+
+    sw_sync_timeline_inc(timeline0, 1);
+    CHECK(wait_signaled(ctx, 4, 1000), "only %u of 4 signaled",
+            get_signaled(ctx));
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK(ctx->order[i + 1] == i, "buffer %u signaled at %u",
+                ctx->order[i + 1], i);
+        CHECK(ctx->signaled[i] == 1, "buffer %u signaled %u times", i,
+                ctx->signaled[i]);
+        CHECK(ctx->status[i] == NO_ERROR, "status %d", ctx->status[i]);
+    }
+    CHECK(waiter.getPendingCount() == 0, "pending %u", waiter.getPendingCount());
+    close(timeline0);
+    close(timeline1);
+    return true;
+}
+
+/* cancelAll must drop pending waits without signalling them */
+static bool test_cancel(QCameraFenceWaiter &waiter, test_ctx_t *ctx)
+{
+    reset_ctx(ctx);
+    int timeline = sw_sync_timeline_create();
+    CHECK(timeline >= 0, "no sw_sync timeline");
+    for (uint32_t i = 0; i < 8; i++) {
+        int fence = sw_sync_fence_create(timeline, "cancel", i + 1);
+        CHECK(fence >= 0, "fence create failed");
+        CHECK(waiter.waitAsync(fence, (void *)(uintptr_t)i) == NO_ERROR,
+                "waitAsync failed");
+    }
+    waiter.cancelAll();
+    CHECK(waiter.getPendingCount() == 0, "pending %u", waiter.getPendingCount());
+    CHECK(ctx->num_released == 8, "released %u", ctx->num_released);
+
+    sw_sync_timeline_inc(timeline, 8);
+    usleep(20000);
+    CHECK(get_signaled(ctx) == 0, "cancelled wait was signaled");
+    close(timeline);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t count = 64;
+    uint32_t delay_us = 5000;
+    test_ctx_t ctx;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:d:")) != -1) {
+        switch (c) {
+        case 'n':
+            count = (uint32_t)atoi(optarg);
+            break;
+        case 'd':
+            delay_us = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-d consumer delay us]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (count == 0 || count > TEST_MAX_REQUESTS || delay_us == 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    QCameraFenceWaiter waiter(test_signaled, test_release, &ctx);
+    if (waiter.init("fenceWaitTest") != NO_ERROR) {
+        fprintf(stderr, "waiter init failed\n");
+        return 1;
+    }
+
+    int failures = 0;
+    printf("single fence\n");
+    failures += !test_single(waiter, &ctx);
+    printf("late consumer\n");
+    failures += !test_late_consumer(waiter, &ctx, count, delay_us);
+    printf("stream order\n");
+    failures += !test_stream_order(waiter, &ctx);
+    printf("cancel\n");
+    failures += !test_cancel(waiter, &ctx);
+
+    waiter.deinit();
+    pthread_mutex_destroy(&ctx.lock);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
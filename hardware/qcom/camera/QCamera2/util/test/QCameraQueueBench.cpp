@@ -0,0 +1,241 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+/* Compares QCameraQueue + cam_semaphore_t (the QCameraCmdThread data path)
+ * against QCameraRingQueue + eventfd wakeup on enqueue->dequeue latency
+ * and throughput.
+ *
+ * usage: qcamera-queue-bench [-n items] [-p producers] [-d depth]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <cam_semaphore.h>
+#include "QCameraQueue.h"
+#include "QCameraRingQueue.h"
+
+using namespace qcamera;
+
+#define BENCH_MAX_PRODUCERS 8
+
+typedef enum {
+    BENCH_LEGACY,
+    BENCH_RING_SPSC,
+    BENCH_RING_MPSC,
+} bench_mode_t;
+
+typedef struct {
+    uint64_t enq_ns;
+} bench_item_t;
+
+typedef struct {
+    bench_mode_t mode;
+    QCameraQueue *legacyQ;
+    cam_semaphore_t sem;
+    QCameraRingQueue *ringQ;
+    bench_item_t *items;
+    uint32_t num_items;         // per producer
+    uint32_t depth;             // max items in flight
+    uint32_t num_producers;
+    int in_flight;
+    uint64_t *lat_ns;
+    uint64_t enq_total_ns;
+} bench_ctx_t;
+
+typedef struct {
+    bench_ctx_t *ctx;
+    uint32_t id;
+} bench_producer_t;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void *bench_producer(void *data)
+{
+    bench_producer_t *p = (bench_producer_t *)data;
+    bench_ctx_t *ctx = p->ctx;
+    uint64_t enq_ns = 0;
+
+    for (uint32_t i = 0; i < ctx->num_items; i++) {
+        while (__atomic_load_n(&ctx->in_flight, __ATOMIC_ACQUIRE) >=
+                (int)ctx->depth) {
+            sched_yield();
+        }
+        __atomic_add_fetch(&ctx->in_flight, 1, __ATOMIC_ACQ_REL);
+
+        bench_item_t *item = &ctx->items[p->id * ctx->num_items + i];
+        item->enq_ns = now_ns();
+        bool rc;
+        if (ctx->mode == BENCH_LEGACY) {
+            rc = ctx->legacyQ->enqueue(item);
+            cam_sem_post(&ctx->sem);
+        } else {
+            rc = ctx->ringQ->enqueue(item);
+        }
+        enq_ns += now_ns() - item->enq_ns;
+        if (!rc) {
+            fprintf(stderr, "enqueue failed at %u\n", i);
+            __atomic_sub_fetch(&ctx->in_flight, 1, __ATOMIC_ACQ_REL);
+        }
+    }
+    __atomic_add_fetch(&ctx->enq_total_ns, enq_ns, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_run(bench_ctx_t *ctx, const char *name)
+{
+    pthread_t tids[BENCH_MAX_PRODUCERS];
+    bench_producer_t prods[BENCH_MAX_PRODUCERS];
+    uint32_t total = ctx->num_items * ctx->num_producers;
+    uint32_t received = 0;
+
+    ctx->in_flight = 0;
+    ctx->enq_total_ns = 0;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < ctx->num_producers; i++) {
+        prods[i].ctx = ctx;
+        prods[i].id = i;
+        pthread_create(&tids[i], NULL, bench_producer, &prods[i]);
+    }
+
+    while (received < total) {
+        bench_item_t *item;
+        if (ctx->mode == BENCH_LEGACY) {
+            cam_sem_wait(&ctx->sem);
+            item = (bench_item_t *)ctx->legacyQ->dequeue();
+        } else {
+            item = (bench_item_t *)ctx->ringQ->dequeue();
+            if (NULL == item) {
+                ctx->ringQ->waitForData(100);
+                continue;
+            }
+        }
+        if (NULL == item) {
+            continue;
+        }
+        ctx->lat_ns[received++] = now_ns() - item->enq_ns;
+        __atomic_sub_fetch(&ctx->in_flight, 1, __ATOMIC_ACQ_REL);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    for (uint32_t i = 0; i < ctx->num_producers; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    qsort(ctx->lat_ns, total, sizeof(uint64_t), cmp_u64);
+    printf("%-10s items %8u  thru %10.0f/s  enq avg %6llu ns  "
+            "lat p50 %7llu ns  p99 %8llu ns  max %9llu ns\n",
+            name, total, (double)total * 1e9 / (double)elapsed,
+            (unsigned long long)(ctx->enq_total_ns / total),
+            (unsigned long long)ctx->lat_ns[total / 2],
+            (unsigned long long)ctx->lat_ns[(uint64_t)total * 99 / 100],
+            (unsigned long long)ctx->lat_ns[total - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    bench_ctx_t ctx;
+    int c;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.num_items = 200000;
+    ctx.num_producers = 1;
+    ctx.depth = 8;
+
+    while ((c = getopt(argc, argv, "n:p:d:")) != -1) {
+        switch (c) {
+        case 'n':
+            ctx.num_items = (uint32_t)atoi(optarg);
+            break;
+        case 'p':
+            ctx.num_producers = (uint32_t)atoi(optarg);
+            break;
+        case 'd':
+            ctx.depth = (uint32_t)atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n items] [-p producers] [-d depth]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (ctx.num_items == 0 || ctx.depth == 0 || ctx.num_producers == 0 ||
+            ctx.num_producers > BENCH_MAX_PRODUCERS) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    uint32_t total = ctx.num_items * ctx.num_producers;
+    ctx.items = (bench_item_t *)calloc(total, sizeof(bench_item_t));
+    ctx.lat_ns = (uint64_t *)calloc(total, sizeof(uint64_t));
+    if (NULL == ctx.items || NULL == ctx.lat_ns) {
+        fprintf(stderr, "no memory\n");
+        return 1;
+    }
+
+    printf("producers %u, depth %u\n", ctx.num_producers, ctx.depth);
+
+    ctx.mode = BENCH_LEGACY;
+    ctx.legacyQ = new QCameraQueue();
+    cam_sem_init(&ctx.sem, 0);
+    bench_run(&ctx, "legacy");
+    cam_sem_destroy(&ctx.sem);
+    delete ctx.legacyQ;
+
+    if (ctx.num_producers == 1) {
+        ctx.mode = BENCH_RING_SPSC;
+        ctx.ringQ = new QCameraRingQueue(ctx.depth, QCAMERA_RING_Q_SPSC);
+        bench_run(&ctx, "ring-spsc");
+        delete ctx.ringQ;
+    }
+
+    ctx.mode = BENCH_RING_MPSC;
+    ctx.ringQ = new QCameraRingQueue(ctx.depth, QCAMERA_RING_Q_MPSC);
+    bench_run(&ctx, "ring-mpsc");
+    delete ctx.ringQ;
+    ctx.ringQ = NULL;
+
+    free(ctx.items);
+    free(ctx.lat_ns);
+    return 0;
+}